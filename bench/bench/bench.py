@@ -1,10 +1,11 @@
 import datetime
+import json
 import logging
 import sys
 import time
 from contextlib import ExitStack, contextmanager
 from pathlib import Path
-from threading import Event
+from threading import Event, Thread, get_ident
 from subprocess import check_output
 from typing import Optional
 
@@ -16,6 +17,7 @@ from pydantic import BaseModel
 from .tasks import *
 from .utils import (
     PAGE_SIZE,
+    Backing,
     Balloon,
     Kernel,
     function_name,
@@ -29,6 +31,26 @@ FORMAT = "%(asctime)s %(levelname)-8s %(name)-15s %(message)s"
 LOGGER = logging.getLogger(__name__)
 
 
+class ThreadFilter(logging.Filter):
+    """Pass the records of the threads of one bench only
+
+    The scheduler runs several benches in the threads of one process, which
+    share the root logger, so each main.log takes the records of the thread
+    that started the guests and of the helper threads it added.
+    """
+
+    def __init__(self):
+        super().__init__()
+        self.threads = {get_ident()}
+
+    def add(self, t: Thread) -> Thread:
+        self.threads.add(t.ident)
+        return t
+
+    def filter(self, record: logging.LogRecord) -> bool:
+        return record.thread in self.threads
+
+
 class Bench(BaseModel):
     """The configurations for running the bench"""
 
@@ -45,9 +67,20 @@ class Bench(BaseModel):
     balloon: Optional[Balloon] = (
         Balloon.hetero
     )  # Use our balloon the the traditional virtio-balloon
+    backing: Backing = Backing.base  # Host pages behind the memory zones
     gdb: bool = False  # Whether enable gdb or not
     env: dict = {}  # Additional environment variables to pass to the launcher
     pml: bool = False  # Whether enable PML or not
+    elastic: bool = False  # Redistribute DRAM between VMs by their demand
+    elastic_interval: float = 1.0  # Seconds between two rounds of redistribution
+    elastic_step: int = 1 << 30  # Bound the DRAM resized per VM in each round
+    resize: Optional[list[tuple[float, ...]]] = None  # See ResizeSchedule
+    telemetry: Optional[float] = 1.0  # Seconds between two guest telemetry records
+    first_id: int = 0  # Id of the first VM, offsets its tap, ip and rootfs
+    host_cpus: Optional[list[int]] = None  # Pin the vCPUs to these CPUs only
+    timeline: Optional[float] = None  # Seconds between two polls of the host timeline
+    snapshot: Optional[str] = None  # Restore the guests from this snapshot, or take it
+    warmup: Optional[str] = None  # Run in the guests before they are snapshotted
 
     @property
     def dram_size(self) -> int:
@@ -69,12 +102,43 @@ class Bench(BaseModel):
     def data_dir(self) -> Path:
         return Path("data")
 
-    def _enable_logging(self):
+    @property
+    def snapshot_dir(self) -> Path:
+        return Path("snapshot") / str(self.snapshot)
+
+    @property
+    def snapshot_key(self) -> dict:
+        """A snapshot restores the whole VM config, it is only reused if these match"""
+        return self.model_dump(
+            mode="json",
+            include={
+                "cpu",
+                "mem",
+                "dram_ratio",
+                "dram_node",
+                "pmem_node",
+                "kernel",
+                "hetero",
+                "balloon",
+                "backing",
+                "elastic",
+                "elastic_interval",
+                "host_cpus",
+                "warmup",
+            },
+        )
+
+    def _enable_logging(self, stack: ExitStack) -> ThreadFilter:
         logger = logging.getLogger()
         handler = logging.FileHandler(self.out_dir / "main.log")
         formatter = logging.Formatter(FORMAT)
         handler.setFormatter(formatter)
+        threads = ThreadFilter()
+        handler.addFilter(threads)
         logger.addHandler(handler)
+        stack.callback(handler.close)
+        stack.callback(logger.removeHandler, handler)
+        return threads
 
     def _guests_prepare(self, vms):
         if self.hetero:
@@ -90,7 +154,8 @@ class Bench(BaseModel):
                     batch = min(enough, remain)
                     if batch == 0:
                         break
-                    LOGGER.info(f"preparing guest id {remain - batch}..{remain}")
+                    first, last = vms[remain - batch].id, vms[remain - 1].id
+                    LOGGER.info(f"preparing guest id {first}..{last + 1}")
                     group = fabric.ThreadingGroup(
                         *[vm.ip for vm in vms[remain - batch : remain]],
                         **vms[0].ssh_config,
@@ -107,7 +172,7 @@ class Bench(BaseModel):
                 if retry == 0:
                     raise RuntimeError("Not enough memory for all VMs")
         else:
-            LOGGER.info(f"preparing guest id 0..{len(vms)}")
+            LOGGER.info(f"preparing guest id {vms[0].id}..{vms[-1].id + 1}")
             group = fabric.ThreadingGroup(*[vm.ip for vm in vms], **vms[0].ssh_config)
             prepare_dirs(group, kernel=self.kernel)
             prepare_kernel(group)
@@ -119,31 +184,49 @@ class Bench(BaseModel):
     def _guests_wait(self, vms):
         [vm.wait_for_boot() for vm in vms]
 
+    def _guests_snapshot(self, vms):
+        group = fabric.ThreadingGroup(*[vm.ip for vm in vms], **vms[0].ssh_config)
+        if self.warmup:
+            LOGGER.info(f"warming up guests: {self.warmup!r}")
+            group.run(self.warmup)
+        group.sudo("sync")
+        [vm.take_snapshot() for vm in vms]
+
     @contextmanager
     def guests(self):
         from .vm import Vm
 
         out = self.out_dir
         out.mkdir(parents=True)
-        self._enable_logging()
-        LOGGER.info("starting guests for workload:")
-        LOGGER.info(" ".join(f"'{arg}'" for arg in sys.argv))
-        LOGGER.info(self.model_dump())
-        Path("out").unlink(missing_ok=True)
-        Path("out").symlink_to(out)
         with ExitStack() as stack:
+            threads = self._enable_logging(stack)
+            LOGGER.info("starting guests for workload:")
+            LOGGER.info(" ".join(f"'{arg}'" for arg in sys.argv))
+            LOGGER.info(self.model_dump())
+            # replace atomically, concurrent benches may be starting
+            link = Path(f".out-{out.name}")
+            link.symlink_to(out)
+            link.replace("out")
             # fix permissions after all process shutdown
             stack.callback(
                 lambda: check_output(
                     f"sudo chown -R $(id -un):$(id -gn) {out}", shell=True
                 )
             )
-            vms = [stack.enter_context(Vm(id=id, bench=self)) for id in range(self.num)]
+            vms = [
+                stack.enter_context(Vm(id=id, bench=self))
+                for id in range(self.first_id, self.first_id + self.num)
+            ]
             self._guests = fabric.ThreadingGroup(
                 *map(lambda vm: vm.ip, vms), **vms[0].ssh_config
             )
-            self._guests_wait(vms)
-            self._guests_prepare(vms)
+            # restored guests are already prepared
+            [vm.resume_restored() for vm in vms if vm.restored]
+            if fresh := [vm for vm in vms if not vm.restored]:
+                self._guests_wait(fresh)
+                self._guests_prepare(fresh)
+                if self.snapshot:
+                    self._guests_snapshot(fresh)
             stack.callback(
                 lambda: check_output(
                     f"sudo cp -r /sys/kernel/debug/kvm {out}", shell=True
@@ -153,6 +236,36 @@ class Bench(BaseModel):
             # if self.pcm_memory:
             #     stack.enter_context(pcm_memory(out / "pcm-memory.csv"))
             exit_evt = Event()
+            if self.elastic and self.balloon == Balloon.hetero:
+                from .controller import TierController
+
+                threads.add(
+                    TierController(
+                        mem=self.mem,
+                        pool=self.dram_size * len(vms),
+                        interval=self.elastic_interval,
+                        max_step=self.elastic_step,
+                    ).start(vms, self.dram_size, exit_evt)
+                )
+            if self.resize and self.balloon == Balloon.hetero:
+                from .controller import ResizeSchedule
+
+                threads.add(
+                    ResizeSchedule(
+                        mem=self.mem,
+                        dram=self.dram_size,
+                        pmem=self.pmem_size,
+                        steps=self.resize,
+                    ).start(vms, out, exit_evt)
+                )
+            if self.timeline:
+                from .timeline import Timeline
+
+                t = threads.add(
+                    Timeline(interval=self.timeline).start(vms, out, exit_evt, stack)
+                )
+                # before the guests power off, the last samples are drained
+                stack.callback(t.join)
             try:
                 yield self._guests
             except GroupException as e:
@@ -179,6 +292,9 @@ class Bench(BaseModel):
         args = eval(f"{name}_args(**kwargs)")
         args += f"2> /out/{name}.err | /data/ansi2txt | tee /out/{name}.log "
         default_env = dict(OMP_NUM_THREADS=self.cpu)
+        if self.telemetry:
+            default_env["telemetry_ms"] = int(self.telemetry * 1000)
+            default_env["overhead_ms"] = int(self.telemetry * 1000)
         with self.guests() as guests:
             result = launch(
                 guests,
@@ -193,9 +309,38 @@ class Bench(BaseModel):
             else:
                 LOGGER.info(f"{name} finished")
 
+    def tune(self, workload: str, tuner: dict = {}, **kwargs):
+        """Search the demeter module params for workload, see Tuner"""
+        from .tune import Tuner
+
+        return Tuner(workload=workload, **tuner).run(self, **kwargs)
+
     def gups(self, **kwargs):
         return self._benchmark(function_name(), **kwargs)
 
+    def gups_multi(self, **kwargs):
+        """Several GUPS processes competing for the DRAM, see gups_multi_args(),
+        the GUPS of each and the fairness among them go to gups_multi.json"""
+        from .tune import gups_shares
+
+        launcher = None if self.hetero else "noop.py"
+        self._benchmark(function_name(), launcher=launcher, **kwargs)
+        shares = gups_shares(self.out_dir)
+        LOGGER.info(f"gups_multi: {shares}")
+        (self.out_dir / "gups_multi.json").write_text(json.dumps(shares, indent=2))
+        return shares
+
+    def gups_elastic(self, **kwargs):
+        """GUPS while the balloons are resized on the `resize` schedule, the dip,
+        recovery time and migrations after each step go to gups_elastic.json"""
+        from .tune import elastic_recovery
+
+        self._benchmark("gups", **kwargs)
+        recovery = elastic_recovery(self.out_dir)
+        LOGGER.info(f"gups_elastic: {recovery}")
+        (self.out_dir / "gups_elastic.json").write_text(json.dumps(recovery, indent=2))
+        return recovery
+
     def gups_perf_only(self, **kwargs):
         """
         mem_trans_retired.load_latency_gt_64
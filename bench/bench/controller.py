@@ -0,0 +1,158 @@
+import json
+import logging
+import time
+from pathlib import Path
+from threading import Event, Thread
+
+from pydantic import BaseModel
+
+from .utils import Balloon, round_down
+
+LOGGER = logging.getLogger(__name__)
+
+# The hetero balloon inflates and deflates in 2M pages
+GRANULE = 2 << 20
+
+
+class TierController(BaseModel):
+    """Redistribute the host DRAM between the VMs through the hetero balloon
+
+    The DRAM given to all VMs initially forms a pool. Every interval, each VM
+    gets a share of the pool proportional to the DRAM demand reported by its
+    guest (the `dram_demand` balloon statistic, or the DRAM in use if the guest
+    does not report one). Each VM keeps its total memory, so the PMEM balloon
+    returns what the DRAM balloon takes and vice versa. Every round starts from
+    the DRAM balloon sizes the hypervisor reports, as a resize may not have
+    settled yet or may fall short of the request.
+    """
+
+    mem: int  # Memory of each VM in byte, i.e. the size of both zones
+    pool: int  # DRAM shared by all VMs in byte
+    interval: float = 1.0  # Seconds between two rebalancing rounds
+    max_step: int = 1 << 30  # Bound the DRAM resized per VM in each round
+    min_dram: int = 1 << 30  # DRAM kept by each VM regardless of its demand
+    headroom: float = 0.1  # Extra DRAM on top of the demand
+
+    def demand(self, stats) -> int:
+        if stats.dram_demand:
+            return stats.dram_demand
+        return stats.dram_total - stats.dram_free
+
+    def dram(self, stats) -> int:
+        """The DRAM the VM has, by the reported size of its DRAM balloon"""
+        return self.mem - stats.actual
+
+    def plan(self, demands: list[int], current: list[int]) -> list[int]:
+        """The DRAM each VM should have after this round"""
+        floor = min(self.min_dram, self.pool // len(current))
+        wants = [
+            min(max(int(d * (1 + self.headroom)), floor), self.mem) for d in demands
+        ]
+        # Always hand out the whole pool to keep the DRAM utilized
+        scale = self.pool / sum(wants)
+        targets = [min(max(int(w * scale), floor), self.mem) for w in wants]
+        steps = [
+            min(max(t - c, -self.max_step), self.max_step)
+            for t, c in zip(targets, current)
+        ]
+        # Shrink first, the growing VMs share whatever becomes available
+        grow = sum(s for s in steps if s > 0)
+        avail = self.pool - sum(c + min(s, 0) for c, s in zip(current, steps))
+        ratio = min(1.0, max(avail, 0) / grow) if grow else 0.0
+        return [
+            round_down(c + (s * ratio if s > 0 else s), GRANULE)
+            for c, s in zip(current, steps)
+        ]
+
+    def rebalance(self, vms, requested: list[int]) -> list[int]:
+        """Resize the VMs from the DRAM last requested, returns the new one"""
+        stats = [vm.memory_stats() for vm in vms]
+        if any(s is None for s in stats):
+            LOGGER.warning("balloon statistics unavailable, skip rebalancing")
+            return requested
+        current = [self.dram(s) for s in stats]
+        for vm, want, have in zip(vms, requested, current):
+            if abs(want - have) >= GRANULE:
+                LOGGER.warning(f"vm {vm.id} has dram={have} instead of {want}")
+        planned = self.plan([self.demand(s) for s in stats], current)
+        for vm, old, new in zip(vms, requested, planned):
+            # Already requested, the balloon is still on its way
+            if old == new:
+                continue
+            size = Balloon.hetero.to_size(self.mem, new, self.mem - new)
+            vm.resize(desired_balloon=list(size))
+        return planned
+
+    def run(self, vms, initial: int, exit_evt: Event):
+        requested = [initial] * len(vms)
+        while not exit_evt.wait(self.interval):
+            try:
+                requested = self.rebalance(vms, requested)
+            except RuntimeError as e:
+                LOGGER.warning(f"rebalancing failed: {e}")
+        LOGGER.info(f"tier controller stopped with dram={requested}")
+
+    def start(self, vms, initial: int, exit_evt: Event) -> Thread:
+        LOGGER.info(f"tier controller started: {self.model_dump()}")
+        # Have fresh statistics for every round
+        for vm in vms:
+            vm.balloon_statistics(self.interval / 2)
+        t = Thread(target=self.run, args=(vms, initial, exit_evt), daemon=True)
+        t.start()
+        return t
+
+
+class ResizeSchedule(BaseModel):
+    """Resize the hetero balloon of every VM at fixed points of a run
+
+    A step `(at, dram)` or `(at, dram, pmem)` gives, `at` seconds after the
+    guests are up, each VM `dram` times its initial DRAM and `pmem` times its
+    initial PMEM. Without a `pmem` the VM keeps its total memory, so the PMEM
+    balloon returns what the DRAM balloon takes and vice versa. E.g.
+    `[(60, 0.5), (180, 1.0)]` halves the DRAM after a minute and gives it back
+    two minutes later. Each step is logged with the host wall clock to
+    resize.jsonl, for elastic_recovery() to line it up with the guest logs.
+    """
+
+    mem: int  # Memory of each VM in byte, i.e. the size of both zones
+    dram: int  # Initial DRAM of each VM in byte
+    pmem: int  # Initial PMEM of each VM in byte
+    steps: list[tuple[float, ...]]
+
+    def sizes(self, step: tuple[float, ...]) -> tuple[int, int]:
+        """The DRAM and PMEM of a VM after the step"""
+        _, dram, *pmem = step
+        new = min(round_down(self.dram * dram, GRANULE), self.mem)
+        if pmem and pmem[0] is not None:
+            return new, min(round_down(self.pmem * pmem[0], GRANULE), self.mem)
+        return new, min(self.dram + self.pmem - new, self.mem)
+
+    def run(self, vms, out: Path, exit_evt: Event):
+        start = time.monotonic()
+        with open(out / "resize.jsonl", "w") as log:
+            for step in sorted(self.steps, key=lambda s: s[0]):
+                if exit_evt.wait(max(start + step[0] - time.monotonic(), 0)):
+                    break
+                dram, pmem = self.sizes(step)
+                record = dict(
+                    t=round(time.monotonic() - start, 3),
+                    wall=time.time(),
+                    dram=dram,
+                    pmem=pmem,
+                    vms=[],
+                )
+                for vm in vms:
+                    size = Balloon.hetero.to_size(self.mem, dram, pmem)
+                    try:
+                        vm.resize(desired_balloon=list(size))
+                        record["vms"].append(vm.id)
+                    except RuntimeError as e:
+                        LOGGER.warning(f"resizing vm {vm.id} failed: {e}")
+                print(json.dumps(record, separators=(",", ":")), file=log, flush=True)
+        LOGGER.info("resize schedule stopped")
+
+    def start(self, vms, out: Path, exit_evt: Event) -> Thread:
+        LOGGER.info(f"resize schedule started: {self.model_dump()}")
+        t = Thread(target=self.run, args=(vms, out, exit_evt), daemon=True)
+        t.start()
+        return t
@@ -0,0 +1,171 @@
+import logging
+from collections import Counter
+from threading import Condition, Thread
+from typing import Callable, Iterable, Optional
+
+from pydantic import BaseModel, ConfigDict
+
+from .bench import Bench
+from .utils import node_memory_free, node_to_cpus
+
+LOGGER = logging.getLogger(__name__)
+
+# ichb0..16 of script/network.bash and root0..16.img of bin.mk
+MAX_VMS = 17
+
+
+class Experiment(BaseModel):
+    """One run of a workload, e.g. `Experiment(bench=bench(num=5), run=gups)`"""
+
+    model_config = ConfigDict(arbitrary_types_allowed=True)
+
+    bench: Bench
+    run: Callable[[Bench], object]  # Usually a partial of a Bench workload method
+    label: str = ""
+
+    @property
+    def cpus(self) -> Counter:
+        """Host CPUs needed per node, the vCPUs are pinned next to the DRAM"""
+        return Counter({self.bench.dram_node: self.bench.num * self.bench.cpu})
+
+    @property
+    def memory(self) -> Counter:
+        """Host memory needed per node in byte, once the balloons have settled"""
+        b = self.bench
+        if not b.hetero:
+            return Counter({b.dram_node: b.num * b.mem})
+        dram = Counter({b.dram_node: b.num * b.dram_size})
+        return dram + Counter({b.pmem_node: b.num * b.pmem_size})
+
+
+class Allocation(BaseModel):
+    first_id: int
+    host_cpus: Optional[list[int]]  # None if the experiment has the host to itself
+
+
+class Scheduler(BaseModel):
+    """Pack independent experiments onto the host and run them concurrently
+
+    The experiments are started in submission order as long as the host has
+    the memory of their nodes, the CPUs next to their DRAM and a contiguous
+    block of VM ids left for them; a later experiment that fits is started
+    ahead of an earlier one that does not (backfilling). Every experiment gets
+    CPUs of its own, so the VMs of different experiments only share the memory
+    bandwidth and the LLC. An experiment the idle host cannot fit, e.g. more
+    vCPUs than the node has CPUs, is run alone with the usual CPU assignment.
+    """
+
+    reserve: int = 4 << 30  # Memory in byte kept free on every node for the host
+    max_vms: int = MAX_VMS  # How many VMs the host has taps and rootfs images for
+    nodes: Optional[dict[int, int]] = None  # Free memory per node, or measured
+    node_cpus: Optional[dict[int, list[int]]] = None  # CPUs per node, or queried
+
+    def _resources(self, experiments: list[Experiment]):
+        nodes = set()
+        for e in experiments:
+            nodes |= set(e.memory) | set(e.cpus)
+        memory = self.nodes or {n: node_memory_free(n) for n in nodes}
+        cpus = self.node_cpus or {n: node_to_cpus(n) for n in nodes}
+        memory = {n: max(m - self.reserve, 0) for n, m in memory.items()}
+        return memory, {n: list(c) for n, c in cpus.items()}
+
+    def allocate(
+        self, e: Experiment, memory: dict, cpus: dict, ids: list[bool], idle: bool
+    ) -> Optional[Allocation]:
+        """Take the resources of `e` out of the free ones, None if it has to wait"""
+        num = e.bench.num
+        first_id = next(
+            (i for i in range(self.max_vms - num + 1) if all(ids[i : i + num])),
+            None,
+        )
+        if first_id is None:
+            return None
+        fits = all(memory.get(n, 0) >= m for n, m in e.memory.items()) and all(
+            len(cpus.get(n, [])) >= c for n, c in e.cpus.items()
+        )
+        if not fits and not idle:
+            return None
+        for n, m in e.memory.items():
+            memory[n] = memory.get(n, 0) - m
+        ids[first_id : first_id + num] = [False] * num
+        if not fits:
+            LOGGER.warning(f"{e.label} does not fit the host, running it alone")
+            for n in e.cpus:
+                cpus[n] = []
+            return Allocation(first_id=first_id, host_cpus=None)
+        host_cpus = []
+        for n, c in e.cpus.items():
+            host_cpus += cpus[n][:c]
+            cpus[n] = cpus[n][c:]
+        return Allocation(first_id=first_id, host_cpus=host_cpus)
+
+    def release(
+        self,
+        e: Experiment,
+        a: Allocation,
+        memory: dict,
+        cpus: dict,
+        ids: list[bool],
+        all_cpus: dict,
+    ):
+        """Give the resources taken by `allocate` back"""
+        for n, m in e.memory.items():
+            memory[n] += m
+        ids[a.first_id : a.first_id + e.bench.num] = [True] * e.bench.num
+        for n in e.cpus:
+            if a.host_cpus is None:
+                cpus[n] = sorted(all_cpus[n])
+            else:
+                cpus[n] = sorted(cpus[n] + [c for c in a.host_cpus if c in all_cpus[n]])
+
+    def run(self, experiments: Iterable[Experiment]) -> list[Optional[BaseException]]:
+        """Run all experiments, returns what each of them raised"""
+        experiments = list(experiments)
+        for i, e in enumerate(experiments):
+            if not e.label:
+                e.label = f"experiment {i}"
+            if e.bench.num > self.max_vms:
+                raise ValueError(f"{e.label} needs more than {self.max_vms} VMs")
+        memory, cpus = self._resources(experiments)
+        all_cpus = {n: set(c) for n, c in cpus.items()}
+        ids = [True] * self.max_vms
+        pending = list(range(len(experiments)))
+        running = 0
+        errors: list[Optional[BaseException]] = [None] * len(experiments)
+        done = Condition()
+
+        def target(i: int, a: Allocation):
+            nonlocal running
+            e = experiments[i]
+            try:
+                e.run(e.bench.model_copy(update=a.model_dump()))
+            except BaseException as exc:
+                LOGGER.error(f"{e.label} failed: {exc}")
+                errors[i] = exc
+            with done:
+                self.release(e, a, memory, cpus, ids, all_cpus)
+                running -= 1
+                LOGGER.info(f"{e.label} finished, {running} running")
+                done.notify()
+
+        threads = []
+        with done:
+            while pending:
+                for i in list(pending):
+                    a = self.allocate(experiments[i], memory, cpus, ids, running == 0)
+                    if a is None:
+                        continue
+                    pending.remove(i)
+                    running += 1
+                    LOGGER.info(
+                        f"{experiments[i].label} started, vm id {a.first_id}.. "
+                        f"cpus {a.host_cpus}, {running} running, {len(pending)} pending"
+                    )
+                    t = Thread(target=target, args=(i, a), name=experiments[i].label)
+                    t.start()
+                    threads.append(t)
+                if pending:
+                    done.wait()
+        for t in threads:
+            t.join()
+        return errors
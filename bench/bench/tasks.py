@@ -1,5 +1,6 @@
 # from fabric import task
 import logging
+import time
 
 from .utils import Balloon, Kernel
 
@@ -18,6 +19,16 @@ def prepare_dirs(c, kernel):
     c.sudo("uname -a > /out/uname")
 
 
+def remount_dirs(c):
+    """A restored guest talks to new virtiofsd, which need new fuse sessions"""
+    c.sudo("umount -l /data /out", warn=True)
+    c.sudo("mount -t virtiofs data /data")
+    c.sudo("mount -t virtiofs out /out")
+    c.sudo("chown -R clear:clear /out")
+    c.sudo(f"date -s @{time.time():.3f}", hide=True)
+    c.sudo("uname -a > /out/uname")
+
+
 def prepare_kernel(c):
     c.sudo("sudo swupd autoupdate --disable", hide=True)
     c.sudo("sysctl -w kernel.kptr_restrict=0", hide=True)
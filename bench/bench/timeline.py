@@ -0,0 +1,134 @@
+import json
+import logging
+import shutil
+import time
+from contextlib import ExitStack
+from pathlib import Path
+from threading import Event, Thread
+from typing import Optional
+
+from pydantic import BaseModel
+
+from .utils import pcm_memory
+
+LOGGER = logging.getLogger(__name__)
+
+
+class Tail:
+    """The complete lines appended to a file since the last call"""
+
+    def __init__(self, file: Path):
+        self.file = file
+        self.offset = 0
+        self.partial = b""
+
+    def lines(self) -> list[str]:
+        try:
+            with open(self.file, "rb") as f:
+                f.seek(self.offset)
+                chunk = f.read()
+        except FileNotFoundError:
+            return []
+        self.offset += len(chunk)
+        *lines, self.partial = (self.partial + chunk).split(b"\n")
+        return [line.decode() for line in lines if line.strip()]
+
+
+class PcmCsv:
+    """pcm-memory -csv has two header rows, the socket and the column names"""
+
+    def __init__(self, file: Path):
+        self.tail = Tail(file)
+        self.header: list[str] = []
+        self.columns: list[str] = []
+
+    def records(self) -> list[dict]:
+        records = []
+        for line in self.tail.lines():
+            row = [cell.strip() for cell in line.split(",")]
+            if not self.header:
+                self.header = row
+                continue
+            if not self.columns:
+                self.columns = [
+                    f"{group}.{name}" if group else name
+                    for group, name in zip(self.header, row)
+                ]
+                continue
+            record = {}
+            for column, cell in zip(self.columns, row):
+                try:
+                    record[column] = float(cell)
+                except ValueError:
+                    pass  # date and time
+            records.append(record)
+        return records
+
+
+class Timeline(BaseModel):
+    """Record host memory bandwidth, guest vmstat deltas and balloon counters
+    into one timeline.jsonl
+
+    Every source is polled each interval and each new sample is stamped with
+    the host CLOCK_MONOTONIC, in seconds since the timeline started, as it is
+    observed. A record is `{"t", "source", "vm", ...}` where source is `pcm`
+    (the bandwidth columns of pcm-memory, vm is None), `vmstat` (one record of
+    the telemetry.jsonl the launcher streams to /out, with its guest time as
+    `guest_t`) or `balloon` (the BalloonCounters of the VM, when they changed).
+    A sample therefore lands at most one interval after it was taken; pcm and
+    the launcher average over their own period, which ends at that point.
+    """
+
+    interval: float = 0.1  # Seconds between two polls of all sources
+    pcm_interval: float = 1.0  # Seconds between two pcm-memory samples
+    pcm: bool = True  # Run pcm-memory if it is installed
+
+    def run(self, vms, out: Path, exit_evt: Event, pcm: Optional[PcmCsv]):
+        start = time.monotonic()
+        telemetry = {vm.id: Tail(vm.out_dir / "telemetry.jsonl") for vm in vms}
+        balloon = {vm.id: None for vm in vms}
+        with open(out / "timeline.jsonl", "w") as log:
+
+            def emit(source, vm, **data):
+                t = round(time.monotonic() - start, 3)
+                record = dict(t=t, source=source, vm=vm, **data)
+                print(json.dumps(record, separators=(",", ":")), file=log)
+
+            while True:
+                stopping = exit_evt.is_set()
+                for record in pcm.records() if pcm else []:
+                    emit("pcm", None, **record)
+                for vm in vms:
+                    for line in telemetry[vm.id].lines():
+                        sample = json.loads(line)
+                        if "period_ms" in sample:
+                            continue  # the absolute counters at the start
+                        guest_t = sample.pop("t")
+                        emit("vmstat", vm.id, guest_t=guest_t, **sample)
+                    try:
+                        stats = vm.memory_stats()
+                    except Exception as e:
+                        LOGGER.debug(f"balloon counters of vm {vm.id}: {e}")
+                        continue
+                    if stats and stats != balloon[vm.id]:
+                        balloon[vm.id] = stats
+                        emit("balloon", vm.id, **stats.model_dump())
+                log.flush()
+                # drain the sources once more after the run has stopped
+                if stopping:
+                    break
+                exit_evt.wait(self.interval)
+        LOGGER.info("timeline stopped")
+
+    def start(self, vms, out: Path, exit_evt: Event, stack: ExitStack) -> Thread:
+        LOGGER.info(f"timeline started: {self.model_dump()}")
+        pcm = None
+        if self.pcm and shutil.which("pcm-memory"):
+            csv = out / "pcm-memory.csv"
+            stack.enter_context(pcm_memory(csv, self.pcm_interval))
+            pcm = PcmCsv(csv)
+        elif self.pcm:
+            LOGGER.warning("pcm-memory not found, no memory bandwidth in the timeline")
+        t = Thread(target=self.run, args=(vms, out, exit_evt, pcm), daemon=True)
+        t.start()
+        return t
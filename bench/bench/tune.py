@@ -0,0 +1,261 @@
+import json
+import logging
+import random
+import re
+from datetime import datetime
+from itertools import product
+from pathlib import Path
+from typing import Optional
+
+from pydantic import BaseModel
+
+from .bench import Bench
+
+LOGGER = logging.getLogger(__name__)
+
+# Candidates of the module params demeter() in script/launcher.py forwards
+SPACE = dict(
+    load_latency_sample_period=[17, 127, 509, 2039, 8191],
+    load_latency_threshold=[48, 64, 96, 128],
+    retired_stores_sample_period=[17, 127, 509, 2039, 8191],
+    split_period_ms=[100, 200, 500, 1000, 2000],
+    rtree_split_thresh=[5, 10, 15, 20, 25, 30],
+    rtree_exch_thresh=[1 << 18, 1 << 19, 1 << 20, 1 << 21, 1 << 22],
+)
+
+# The argument of each workload its runtime is linear in, and its default
+BUDGETS = dict(
+    gups=("update", int(8e8)),
+    graph500=("n", 10),
+    pagerank=("n", 5),
+    xsbench=("p", 10000000),
+    btree=("l", 2 * 10**10),
+    silo=("n", 100000000),
+)
+
+FLOAT = r"[+-]?(\d*\.\d+|\d+\.)([eE][+-]?\d+)?"
+GUPS = re.compile(rf"iteration last final (?P<gups>{FLOAT}) elapsed")
+# The tracing timestamp of a report is the guest wall clock in UTC
+REPORT = re.compile(
+    rf"^(?P<ts>\S+)\s.*GUPS: iteration .+ hitherto {FLOAT} "
+    rf"instaneous (?P<gups>{FLOAT})",
+    re.M,
+)
+ELAPSED = re.compile(
+    r"Elapsed \(wall clock\) time \(h:mm:ss or m:ss\): "
+    r"((?P<hh>\d+):)?(?P<mm>\d+):(?P<ss>\d+\.?\d*)"
+)
+
+
+def throughput(out: Path, workload: str, budget: float) -> Optional[float]:
+    """Mean over the VMs of a run, the GUPS of gups and budget per second otherwise"""
+    scores = []
+    for vm in filter(lambda p: p.is_dir() and p.name.isdigit(), out.iterdir()):
+        log, err = vm / f"{workload}.log", vm / f"{workload}.err"
+        if workload == "gups" and log.exists():
+            if m := GUPS.search(log.read_text()):
+                scores.append(float(m.group("gups")))
+                continue
+        if err.exists() and (m := ELAPSED.search(err.read_text())):
+            d = m.groupdict()
+            elapsed = sum(
+                float(d[k] or 0) * r for k, r in zip(["hh", "mm", "ss"], [3600, 60, 1])
+            )
+            if elapsed > 0:
+                scores.append(budget / elapsed)
+                continue
+        LOGGER.warning(f"no throughput for vm {vm.name} of {out}")
+        return None
+    return sum(scores) / len(scores) if scores else None
+
+
+def gups_shares(out: Path) -> dict:
+    """Per VM the final GUPS of each process of a gups_multi run, their total and
+    Jain's fairness index, 1 if they all got the same throughput"""
+    result = {}
+    for vm in sorted(filter(lambda p: p.is_dir() and p.name.isdigit(), out.iterdir())):
+        gups = []
+        targets = sorted(vm.glob("target*"), key=lambda p: int(p.name[len("target") :]))
+        for target in targets:
+            log = target / "gups.log"
+            m = GUPS.search(log.read_text()) if log.exists() else None
+            gups.append(float(m.group("gups")) if m else None)
+        done = [g for g in gups if g is not None]
+        squares = sum(g * g for g in done)
+        result[vm.name] = dict(
+            gups=gups,
+            total=sum(done),
+            fairness=sum(done) ** 2 / (len(done) * squares) if squares else None,
+        )
+    return result
+
+
+# The vmstat counters of the pages each design migrates, an exchange of demeter
+# moves two folios without going through migrate_pages()
+MIGRATIONS = dict(pgmigrate_success=1, folio_exchange_success=2)
+
+
+def _reports(log: Path) -> list[tuple[float, float]]:
+    """The wall clock and instantaneous GUPS of each report of a gups log"""
+    reports = []
+    for m in REPORT.finditer(log.read_text() if log.exists() else ""):
+        # at most microseconds for fromisoformat()
+        ts = re.sub(r"(\.\d{6})\d+", r"\1", m.group("ts")).replace("Z", "+00:00")
+        try:
+            reports.append((datetime.fromisoformat(ts).timestamp(), float(m["gups"])))
+        except ValueError:
+            continue
+    return reports
+
+
+def _migrations(telemetry: Path) -> list[tuple[float, int]]:
+    """The wall clock and the pages migrated in each telemetry record"""
+    if not telemetry.exists():
+        return []
+    header, *records = map(json.loads, telemetry.read_text().splitlines())
+    if "wall" not in header:
+        return []
+    return [
+        (
+            header["wall"] + r["t"],
+            sum(r["vmstat"].get(k, 0) * n for k, n in MIGRATIONS.items()),
+        )
+        for r in records
+    ]
+
+
+def elastic_recovery(out: Path, settle: int = 10, band: float = 0.05) -> dict:
+    """Per VM and per step of the resize schedule of a gups run, how the GUPS
+    react to the step
+
+    The baseline is the mean of the last `settle` reports before the step and
+    the level the one of the last `settle` reports before the next step (or the
+    end of the run). The dip is the fraction of the baseline lost at the worst
+    report after the step, the recovery the seconds until the GUPS stay within
+    `band` of the level, and `migrated` the pages migrated until the next step.
+    """
+    steps_log = out / "resize.jsonl"
+    if not steps_log.exists():
+        return {}
+    steps = [json.loads(line) for line in steps_log.read_text().splitlines()]
+    result = {}
+    for vm in sorted(filter(lambda p: p.is_dir() and p.name.isdigit(), out.iterdir())):
+        reports = _reports(vm / "gups.log")
+        migrations = _migrations(vm / "telemetry.jsonl")
+        ends = [s["wall"] for s in steps[1:]] + [float("inf")]
+        result[vm.name] = []
+        for i, (step, end) in enumerate(zip(steps, ends)):
+            begin = steps[i - 1]["wall"] if i else float("-inf")
+            before = [g for t, g in reports if begin <= t < step["wall"]][-settle:]
+            after = [(t, g) for t, g in reports if step["wall"] <= t < end]
+            summary = dict(
+                t=step["t"], dram=step["dram"], pmem=step["pmem"], baseline=None
+            )
+            summary["migrated"] = sum(
+                n for t, n in migrations if step["wall"] <= t < end
+            )
+            result[vm.name].append(summary)
+            if not before or not after:
+                continue
+            baseline = sum(before) / len(before)
+            level = sum(g for _, g in after[-settle:]) / len(after[-settle:])
+            outside = [
+                j for j, (_, g) in enumerate(after) if abs(g - level) > band * level
+            ]
+            j = min(outside[-1] + 1, len(after) - 1) if outside else 0
+            summary.update(
+                baseline=baseline,
+                level=level,
+                dip=1 - min(g for _, g in after) / baseline if baseline else None,
+                recovery=after[j][0] - step["wall"],
+            )
+    return result
+
+
+class Tuner(BaseModel):
+    """Successive halving over the demeter module params of one workload
+
+    A random sample of `configs` configurations from `space` each get a short
+    run of `min_budget` of the full run; the best 1/eta by throughput get a run
+    eta times as long, and so on for `rungs` rungs. The poor configurations are
+    stopped early, so most of the time goes into telling the good ones apart.
+    A workload without an argument its runtime is linear in always does full
+    runs. The best configuration is recorded in `record`/<workload>.json.
+    """
+
+    workload: str
+    configs: int = 27
+    eta: int = 3
+    rungs: int = 3
+    min_budget: float = 1 / 9  # Portion of the full run in the first rung
+    seed: int = 0
+    space: dict[str, list[int]] = SPACE
+    parallel: bool = False  # Run the configurations of a rung concurrently
+    record: Path = Path("tune")
+
+    def sample(self) -> list[dict]:
+        rng = random.Random(self.seed)
+        configs = [dict(zip(self.space, c)) for c in product(*self.space.values())]
+        return rng.sample(configs, min(self.configs, len(configs)))
+
+    def rung(self, bench: Bench, configs: list[dict], portion: float, **kwargs):
+        """Run every configuration once, returns their throughput"""
+        from .scheduler import Experiment, Scheduler
+
+        run = getattr(Bench, self.workload)
+        if resource := BUDGETS.get(self.workload):
+            arg, full = resource
+            full = kwargs.pop(arg, full)
+            budget = max(round(full * portion), 1)
+            kwargs[arg] = budget
+        else:
+            budget = 1
+        benches = [
+            Bench(**bench.model_dump() | dict(env=bench.env | config))
+            for config in configs
+        ]
+        if self.parallel:
+            Scheduler().run(
+                Experiment(bench=b, run=lambda b: run(b, **kwargs), label=str(c))
+                for b, c in zip(benches, configs)
+            )
+        else:
+            for b in benches:
+                run(b, **kwargs)
+        return [throughput(b.out_dir, self.workload, budget) for b in benches]
+
+    def run(self, bench: Bench, **kwargs) -> dict:
+        configs = self.sample()
+        portion = self.min_budget
+        history = []
+        for r in range(self.rungs):
+            LOGGER.info(f"rung {r}: {len(configs)} configs at {portion:.3f} of a run")
+            scores = self.rung(bench, configs, portion, **kwargs)
+            # a failed run ranks last
+            ranked = sorted(
+                zip(configs, scores),
+                key=lambda cs: float("-inf") if cs[1] is None else cs[1],
+                reverse=True,
+            )
+            results = [dict(config=c, throughput=s) for c, s in ranked]
+            history.append(dict(rung=r, portion=portion, results=results))
+            LOGGER.info(f"rung {r}: best {ranked[0]}")
+            keep = max(len(configs) // self.eta, 1)
+            if len(configs) == 1 or r == self.rungs - 1:
+                break
+            configs = [c for c, s in ranked[:keep] if s is not None] or [ranked[0][0]]
+            portion = min(portion * self.eta, 1.0)
+        best, score = ranked[0]
+        result = dict(
+            workload=self.workload,
+            best=best,
+            throughput=score,
+            bench=bench.model_dump(mode="json"),
+            kwargs=kwargs,
+            history=history,
+        )
+        self.record.mkdir(parents=True, exist_ok=True)
+        file = self.record / f"{self.workload}.json"
+        file.write_text(json.dumps(result, indent=2))
+        LOGGER.info(f"best config of {self.workload}: {best} ({score}), see {file}")
+        return result
@@ -22,6 +22,45 @@ class Kernel(str, Enum):
     # vanilla = "vanilla"
 
 
+class Backing(str, Enum):
+    """How the host backs the memory zones of the guests"""
+
+    base = "base"  # Base pages, unless the host shmem uses THPs anyway
+    thp = "thp"  # THPs of the shared memfd, needs a shmem_enabled that allows them
+    hugetlbfs = "hugetlbfs"  # 2 MiB pages reserved on the nodes beforehand
+
+    @property
+    def huge(self) -> bool:
+        return self != Backing.base
+
+    def zone(self) -> str:
+        """Options of a --memory-zone"""
+        return ",hugepages=on,hugepage_size=2M" if self == Backing.hugetlbfs else ""
+
+    def check(self, nodes: dict[int, int]):
+        """Raise if the host cannot back the memory in byte of each node"""
+        match self:
+            case Backing.thp:
+                # a shared memfd is never madvised, the default has to do
+                shmem = Path("/sys/kernel/mm/transparent_hugepage/shmem_enabled")
+                mode = shmem.read_text().split("[")[1].split("]")[0]
+                if mode not in ("always", "within_size", "force"):
+                    raise RuntimeError(f"{shmem} is {mode}, no THPs for the guests")
+            case Backing.hugetlbfs:
+                for node, size in nodes.items():
+                    free = int(
+                        Path(
+                            f"/sys/devices/system/node/node{node}/hugepages/"
+                            "hugepages-2048kB/free_hugepages"
+                        ).read_text()
+                    )
+                    if free << 21 < size:
+                        raise RuntimeError(
+                            f"node {node} has {free} free 2 MiB pages, "
+                            f"{size} byte needed"
+                        )
+
+
 class Balloon(str, Enum):
     hetero = "hetero"
     legacy = "legacy"
@@ -33,14 +72,23 @@ class Balloon(str, Enum):
             case Balloon.legacy:
                 return (total_mem - dram_avail + total_mem - pmem_avail, 0)
 
-    def to_cmdline(self, total_mem: int, dram_avail: int, pmem_avail: int):
+    def to_cmdline(
+        self,
+        total_mem: int,
+        dram_avail: int,
+        pmem_avail: int,
+        statistics=None,
+        huge_pages=False,
+    ):
         d, p = self.to_size(total_mem, dram_avail, pmem_avail)
-        # ,statistics=1000ms
+        opts = f",statistics={int(statistics * 1000)}ms" if statistics else ""
+        # the device only releases whole huge pages of huge page backed zones
+        opts += ",huge_pages=on" if huge_pages else ""
         match self:
             case Balloon.hetero:
-                return f"size=[{d},{p}],heterogeneous_memory=on"
+                return f"size=[{d},{p}],heterogeneous_memory=on{opts}"
             case Balloon.legacy:
-                return f"size=[{d},{p}]"
+                return f"size=[{d},{p}]{opts}"
 
 
 def erange(start, end, mul):
@@ -69,6 +117,12 @@ def memory_nodes():
     )
 
 
+def node_distance(src: int, dst: int) -> int:
+    """The SLIT distance between two host nodes, 10 for the same node"""
+    distances = Path(f"/sys/devices/system/node/node{src}/distance").read_text()
+    return int(distances.split()[dst])
+
+
 def node_to_cpus(node: int):
     from numa import LIBNUMA, utils
 
@@ -82,8 +136,9 @@ def node_to_cpus(node: int):
 
 
 @contextmanager
-def daemon(args, stdout, stderr, sudo=False):
-    with open(stdout, "w") as stdout, open(stderr, "w") as stderr:
+def daemon(args, stdout, stderr, sudo=False, append=False):
+    mode = "a" if append else "w"
+    with open(stdout, mode) as stdout, open(stderr, mode) as stderr:
         LOGGER.info(f"starting daemon {args[0]!r}")
         LOGGER.info(" ".join(f"{arg!r}" for arg in args))
         p = subprocess.Popen(
@@ -136,9 +191,10 @@ def cloud_hypervisor(socket: Path):
     )
 
 
-def pcm_memory(csv: Path):
+def pcm_memory(csv: Path, interval: float | None = None):
+    delay = [f"{interval}"] if interval else []
     return daemon(
-        ["sudo", "pcm-memory", "-nc", f"-csv={csv}"],
+        ["sudo", "pcm-memory", *delay, "-nc", f"-csv={csv}"],
         stdout=csv.with_suffix(".stdout"),
         stderr=csv.with_suffix(".stderr"),
         sudo=True,
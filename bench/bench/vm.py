@@ -1,5 +1,6 @@
 import json
 import logging
+import shutil
 from contextlib import ExitStack
 from io import StringIO
 from itertools import chain, cycle, islice
@@ -13,8 +14,17 @@ from paramiko.ssh_exception import NoValidConnectionsError
 from pydantic import BaseModel
 
 from .bench import Bench
-from .tasks import collect_logs
-from .utils import Balloon, Kernel, daemon, node_to_cpus, pid_children, virtiofsd
+from .tasks import collect_logs, remount_dirs
+from .utils import (
+    Backing,
+    Balloon,
+    Kernel,
+    daemon,
+    node_distance,
+    node_to_cpus,
+    pid_children,
+    virtiofsd,
+)
 from .vm_api import Api
 
 LOGGER = logging.getLogger(__name__)
@@ -50,6 +60,14 @@ class MemoryStatistics(BaseModel):
     pmem_accesses: int
     pmem_free: int
     pmem_total: int
+    dram_demand: int = 0
+    # Measured by the device for the last resize settled
+    resizes: int = 0
+    resize_first_chunk_us: int = 0
+    resize_latency_us: int = 0
+    resize_bytes: int = 0
+    resize_throughput: int = 0  # byte/s
+    madvise_us: int = 0
 
 
 class Vm(BaseModel):
@@ -60,6 +78,22 @@ class Vm(BaseModel):
     def out_dir(self) -> Path:
         return self.bench.out_dir / str(self.id)
 
+    @property
+    def snapshot_dir(self) -> Path | None:
+        if self.bench.snapshot:
+            return self.bench.snapshot_dir / str(self.id)
+
+    @property
+    def restorable(self) -> bool:
+        dir = self.snapshot_dir
+        if not dir or not (dir / "state.json").exists():
+            return False
+        return json.loads((dir / "bench.json").read_text()) == self.bench.snapshot_key
+
+    @property
+    def restored(self) -> bool:
+        return self._restored
+
     @property
     def tap(self) -> str:
         return f"ichb{self.id}"
@@ -100,6 +134,14 @@ class Vm(BaseModel):
             desired_balloon=desired_balloon,
         )
 
+    def balloon_statistics(self, interval: float):
+        """Change how often the balloon statistics are polled, in seconds"""
+        LOGGER.info(f"balloon statistics {interval=}")
+        secs, nanos = divmod(round(interval * 1e9), 1_000_000_000)
+        return self._api.vm.resize.put(
+            desired_balloon_statistics=dict(secs=secs, nanos=nanos)
+        )
+
     def cmdline(self, design, total_mem, dram_size, pmem_size):
         cmdline = [
             # essentials
@@ -138,6 +180,7 @@ class Vm(BaseModel):
         hetero,
         id,
         cpu_node,
+        host_cpus: list[int] | None,
         vcpus,
         total_mem,
         dram_node,
@@ -152,14 +195,23 @@ class Vm(BaseModel):
         tap,
         mac,
         balloon: Balloon | None,
+        backing: Backing,
+        statistics,
         gdb,
         pml,
         api,
     ):
-        host_cpus = list(
-            islice(cycle(node_to_cpus(cpu_node)), vcpus * id, vcpus * (id + 1))
-        )
+        # the vCPUs of the i-th VM take the i-th slice of the CPUs
+        if host_cpus:
+            slot = id - self.bench.first_id
+        else:
+            host_cpus, slot = node_to_cpus(cpu_node), id
+        host_cpus = list(islice(cycle(host_cpus), vcpus * slot, vcpus * (slot + 1)))
         host_cpus = ",".join(str(c) for c in host_cpus)
+        # The guest orders its tiers by the host distances from the vCPUs, a
+        # distance between two nodes has to exceed the local one though
+        near = max(node_distance(cpu_node, dram_node), 11) if hetero else 0
+        far = max(node_distance(cpu_node, pmem_node), near + 1) if hetero else 0
         affinity = ",".join(f"{v}@[{host_cpus}]" for v in range(vcpus))
         args = dict(
             binary=["cloud-hypervisor"],
@@ -167,16 +219,19 @@ class Vm(BaseModel):
             memory=["--memory", "size=0,shared=on"],
             zones=[
                 "--memory-zone",
-                f"id=dram,size={total_mem if balloon else dram_size},shared=on,host_numa_node={dram_node}",
-                f"id=pmem,size={total_mem if balloon else pmem_size},shared=on,host_numa_node={pmem_node}",
+                f"id=dram,size={total_mem if balloon else dram_size},shared=on,host_numa_node={dram_node}{backing.zone()}",
+                f"id=pmem,size={total_mem if balloon else pmem_size},shared=on,host_numa_node={pmem_node}{backing.zone()}",
             ]
             if hetero
-            else ["--memory-zone", f"id=ram,size={total_mem},shared=on"],
+            else [
+                "--memory-zone",
+                f"id=ram,size={total_mem},shared=on{backing.zone()}",
+            ],
             numa=[
                 "--numa",
-                f"guest_numa_id=0,cpus=[0-{vcpus - 1}]",
-                "guest_numa_id=1,memory_zones=[dram]",
-                "guest_numa_id=2,memory_zones=[pmem]",
+                f"guest_numa_id=0,cpus=[0-{vcpus - 1}],distances=[1@{near},2@{far}]",
+                f"guest_numa_id=1,memory_zones=[dram],distances=[0@{near},2@{far}]",
+                f"guest_numa_id=2,memory_zones=[pmem],distances=[0@{far},1@{far}]",
             ]
             if hetero
             else [],
@@ -191,32 +246,69 @@ class Vm(BaseModel):
             net=["--net", f"tap={tap},mac={mac}"],
             balloon=[
                 "--balloon",
-                balloon.to_cmdline(total_mem, dram_size, pmem_size)
+                balloon.to_cmdline(
+                    total_mem, dram_size, pmem_size, statistics, backing.huge
+                )
                 if hetero
-                else "size=[0,0]",
+                else "size=[0,0]" + (",huge_pages=on" if backing.huge else ""),
             ]
             if balloon
             else [],
             console=["--console", "off"],
             serial=["--serial", "tty"],
             gdb=["--gdb", f"path={gdb}"] if gdb else [],
-            pml=["--hmem", "delay=10s,interval=100ms"] if pml else [],
+            pml=["--pml", f"delay=10s,interval=100ms,output={pml}"] if pml else [],
             api=["--api-socket", f"path={api}"],
         )
         return list(chain.from_iterable(args.values()))
 
+    def take_snapshot(self):
+        """Save the prepared guest with its rootfs, to be restored by later benches"""
+        dir = self.snapshot_dir
+        LOGGER.info(f"vm {self.id} snapshot to {dir}")
+        self._api.vm.pause.put()
+        try:
+            self._api.vm.snapshot.put(destination_url=f"file://{dir.absolute()}")
+            shutil.copyfile(self._rootfs, dir / "root.img")
+            ch_stdout = self.out_dir / "cloud-hypervisor.stdout"
+            shutil.copyfile(ch_stdout, dir / "cloud-hypervisor.stdout")
+            (dir / "bench.json").write_text(json.dumps(self.bench.snapshot_key))
+        finally:
+            self._api.vm.resume.put()
+
+    def resume_restored(self):
+        self._api.vm.resume.put()
+        self.wait_for_boot()
+        remount_dirs(self._ssh)
+
     def __enter__(self):
         self.out_dir.mkdir(exist_ok=True)
+        self._restored = self.restorable
+        # the restored config refers to the vhost-user sockets by their paths
+        socket_dir = self.snapshot_dir or self.out_dir
+        if self.bench.snapshot and not self._restored:
+            shutil.rmtree(socket_dir, ignore_errors=True)
+            socket_dir.mkdir(parents=True)
         ch_socket = self.out_dir / "cloud-hypervisor.socket"
         gdb_socket = self.out_dir / "cloud-hypervisor-gdb.socket"
-        data_socket = self.out_dir / "virtiofsd.data.socket"
-        out_socket = self.out_dir / "virtiofsd.out.socket"
+        data_socket = socket_dir / "virtiofsd.data.socket"
+        out_socket = socket_dir / "virtiofsd.out.socket"
         kernel = self.bench.data_dir / self.bench.kernel.value / "vmlinux.bin"
         rootfs = self.bench.data_dir / f"root{self.id}.img"
+        self._rootfs = rootfs
+        if self._restored:
+            LOGGER.info(f"vm {self.id} restoring from {self.snapshot_dir}")
+            # the guest page cache matches the rootfs at the snapshot
+            shutil.copyfile(self.snapshot_dir / "root.img", rootfs)
+            shutil.copyfile(
+                self.snapshot_dir / "cloud-hypervisor.stdout",
+                ch_socket.with_suffix(".stdout"),
+            )
         args = self.args(
             hetero=self.bench.hetero,
             id=self.id,
             cpu_node=self.bench.dram_node,
+            host_cpus=self.bench.host_cpus,
             vcpus=self.bench.cpu,
             total_mem=self.bench.mem,
             dram_node=self.bench.dram_node,
@@ -236,10 +328,26 @@ class Vm(BaseModel):
             tap=self.tap,
             mac=self.mac,
             balloon=self.bench.balloon,
+            backing=self.bench.backing,
+            statistics=self.bench.elastic_interval if self.bench.elastic else None,
             gdb=gdb_socket if self.bench.gdb else None,
-            pml=self.bench.pml,
+            pml=self.out_dir / "pml-heat.json" if self.bench.pml else None,
             api=ch_socket,
         )
+        b = self.bench
+        b.backing.check(
+            {b.dram_node: b.dram_size, b.pmem_node: b.pmem_size}
+            if b.hetero
+            else {b.dram_node: b.mem}
+        )
+        if self._restored:
+            args = [
+                "cloud-hypervisor",
+                "--api-socket",
+                f"path={ch_socket}",
+                "--restore",
+                f"source_url=file://{self.snapshot_dir.absolute()}",
+            ]
         LOGGER.info(f"{args=}")
         self._stack = ExitStack().__enter__()
         try:
@@ -252,6 +360,8 @@ class Vm(BaseModel):
                     args,
                     stdout=ch_socket.with_suffix(".stdout"),
                     stderr=ch_socket.with_suffix(".stderr"),
+                    # after the boot log of the snapshot
+                    append=self._restored,
                 )
             )
             self._pid = ch.pid
@@ -16,6 +16,11 @@ def gups_args(
     # ms
     report: int | None = 1000,
     dram_ratio: int | None = None,  # report the percentage of memory in DRAM
+    phase: int | str | None = None,  # move the hot set every n updates or "<n>ms"
+    phase_shift: int | None = None,  # by the hot set length by default
+    reads: int = 0,  # percentage of accesses that only read
+    chase: bool = False,  # every access depends on the previous one
+    latency: int | None = None,  # time one access in every n
 ):
     delta = (2 << 20) * thread  # avoid some trivial corner cases
     len -= delta
@@ -23,6 +28,11 @@ def gups_args(
     args = f"{str(bin)} --{thread=} --{update=} --{len=} --{granularity=} "
     args += f"--{report=} " if report is not None else ""
     args += f"--dram-ratio {dram_ratio} " if dram_ratio is not None else ""
+    args += f"--phase {phase} " if phase is not None else ""
+    args += f"--phase-shift {phase_shift} " if phase_shift is not None else ""
+    args += f"--{reads=} " if reads else ""
+    args += "--chase " if chase else ""
+    args += f"--{latency=} " if latency is not None else ""
     match workload:
         case "hotset":
             args += f"{workload} --{hot=} --{weight=} "
@@ -37,6 +47,26 @@ def gups_args(
     return args
 
 
+# Three tenants with distinct hot sets for gups_multi_args()
+GUPS_TENANTS = [
+    dict(workload="hotset", hot=512 << 20, weight=9),
+    dict(workload="hotset", hot=2 << 30, weight=4),
+    dict(workload="zipf", exponent=0.99, reverse=False),
+]
+
+
+def gups_multi_args(
+    procs: list[dict] = GUPS_TENANTS,  # the gups_args of each process
+    thread: int = 1,
+    len: int = 4 << 30,
+    **kwargs,  # the gups_args shared by all
+):
+    """GUPS processes side by side, the launcher runs each as a target of its own
+    and logs it to /out/target<i>"""
+    common = dict(thread=thread, len=len) | kwargs
+    return "--- ".join(gups_args(**(common | p)) for p in procs)
+
+
 def graph500_args(
     bin: Path | str = Path("/data/omp-csr"),
     s: int = 24,  # (memory exponentially)
@@ -55,7 +85,7 @@ def pagerank_args(
     n: int = 5,  # (runtime)
 ):
     bin, f = str(bin), str(f)
-    args = f"{bin} -l -a -f {f} -n {n} -i {i} "
+    args = f"{bin} -l -a -j -f {f} -n {n} -i {i} "
     return args
 
 
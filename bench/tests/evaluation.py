@@ -8,6 +8,7 @@ from datetime import datetime, timezone
 import os
 
 from bench.bench import Bench
+from bench.scheduler import Experiment, Scheduler
 from bench.utils import (
     Balloon,
     Kernel,
@@ -142,6 +143,22 @@ def gups_base():
         dram_ratio=None,
     )
 
+@pytest.fixture
+def gups_elastic(gups_base):
+    return partial(Bench.gups_elastic, **gups_base.keywords)
+
+
+@pytest.fixture
+def resize_schedules():
+    """Fixture providing the balloon resize schedules, see ResizeSchedule"""
+    return dict(
+        # give half of the DRAM to PMEM, then restore it
+        shrink=[(60, 0.5), (180, 1.0)],
+        # take half as much DRAM again out of PMEM, then restore it
+        grow=[(60, 1.5), (180, 1.0)],
+    )
+
+
 @pytest.fixture
 def gups_base_pebs():
     return partial(
@@ -269,6 +286,12 @@ def test_gups(bench_base, gups_base, vm_numbers, kernel_variants):
             gups_base(bench_base(num=vmnum, kernel=kernel))
 
 
+def test_elastic_gups(bench_base, gups_elastic, resize_schedules, kernel_variants):
+    with collect_datapoints(function_name()):
+        for schedule, kernel in product(resize_schedules.values(), kernel_variants):
+            gups_elastic(bench_base(kernel=kernel, resize=schedule))
+
+
 def test_btree(bench_base, btree_base, vm_numbers, kernel_variants):
     with collect_datapoints(function_name()):
         for vmnum, kernel in product(vm_numbers, kernel_variants):
@@ -390,6 +413,32 @@ def test_ablation_sensitivity_acess_tracking(bench_base, gups_base, avg_vm_numbe
             )
 
 
+# figure 9a, with the independent datapoints packed onto the host concurrently
+def test_ablation_sensitivity_acess_tracking_packed(
+    bench_base, gups_base, avg_vm_number
+):
+    with collect_datapoints(function_name()):
+        errors = Scheduler().run(
+            Experiment(
+                bench=bench_base(
+                    num=avg_vm_number,
+                    balloon=None,
+                    env=dict(
+                        load_latency_sample_period=period,
+                        load_latency_threshold=thresh,
+                    ),
+                ),
+                run=gups_base,
+                label=f"period {period} thresh {thresh}",
+            )
+            for period, thresh in product(
+                [127, 257, 509, 1021, 2039, 4093, 8191, 16381, 32771, 65537],
+                range(48, 128 + 1, 8),
+            )
+        )
+        assert not any(errors)
+
+
 # figure 9b
 def test_ablation_sensitivity_hotness_classification(
     bench_base, gups_base, avg_vm_number
@@ -2,14 +2,14 @@ SHELL := /bin/bash -O globstar
 
 .PHONY: all clean
 GUEST_KERNELS := demeter memtis nomad tpp
-SCRIPTS := ansi2txt dram-pfn.py launcher.py $(addsuffix .py,$(GUEST_KERNELS))
+SCRIPTS := ansi2txt dram-pfn.py launcher.py noop.py $(addsuffix .py,$(GUEST_KERNELS))
 MAX_VMS := 16
 ROOT_IMGS := $(foreach i,$(shell seq 0 $(MAX_VMS)),bin/root$(i).img)
 
 all: $(addprefix bin/,$(GUEST_KERNELS)) \
 	bin/root.img $(ROOT_IMGS) \
 	bin/cloud-hypervisor bin/virtiofsd \
-	bin/damo bin/bind-stdin \
+	bin/damo bin/bind-stdin bin/demeter-sim bin/demeter-bench \
 	$(addprefix bin/,$(SCRIPTS))
 
 $(addprefix bin/,$(GUEST_KERNELS)): bin/%: build/%
@@ -47,6 +47,28 @@ bin/virtiofsd: $(VIRTIOFSD_TARBALL)
 bin/bind-stdin: script/bind-stdin.c
 	$(CC) $(CFLAGS) -o $@ $<
 
+# The headers of mm/demeter built in userspace against the shims next to it
+DEMETER_SOURCE_DIR := kernel/demeter
+bin/demeter-bench: script/demeter-bench/demeter-bench.c \
+		script/demeter-bench/**/*.h $(DEMETER_SOURCE_DIR)/.stamp
+	mkdir -p $(dir $@)
+	$(CC) -std=gnu11 -O2 -Wno-attributes -Wno-parentheses -pthread $(CFLAGS) \
+		-Iscript/demeter-bench -I$(DEMETER_SOURCE_DIR)/mm/demeter \
+		-o $@ $< $(DEMETER_SOURCE_DIR)/mm/demeter/vector.c -lm
+
+# The range tree is the C of mm/demeter against the shims of demeter-bench
+bin/demeter-sim: script/demeter-sim/demeter-sim.cpp script/demeter-sim/rtree.c \
+		script/demeter-sim/rtree.h script/demeter-bench/**/*.h \
+		$(DEMETER_SOURCE_DIR)/.stamp
+	mkdir -p $(dir $@) build/demeter-sim
+	$(CC) -std=gnu11 -O2 -Wno-attributes -Wno-parentheses $(CFLAGS) \
+		-Iscript/demeter-bench -I$(DEMETER_SOURCE_DIR)/mm/demeter \
+		-c -o build/demeter-sim/rtree.o script/demeter-sim/rtree.c
+	$(CXX) -std=c++17 -O2 $(CXXFLAGS) -o $@ $< build/demeter-sim/rtree.o
+
+$(DEMETER_SOURCE_DIR)/.stamp:
+	$(MAKE) -f kernel.mk demeter
+
 $(addprefix bin/,$(SCRIPTS)): bin/%: script/%
 	mkdir -p $(dir $@)
 	cp -v $< $@
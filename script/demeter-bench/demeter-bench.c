@@ -0,0 +1,480 @@
+// Userspace microbenchmarks of the data structures of mm/demeter, built from
+// the unmodified headers of the patched kernel tree against shim.h:
+//
+//   rtree      rt_count() per sample, then rt_split(), rt_merge() and
+//              rt_rank() per split period once the tree has grown to --ranges
+//   blacklist  the pfn set of the migration thread: insert, hit and miss
+//              lookups, and erase, as in migration_exchange_batch()
+//   chan       a producer and a consumer thread passing shard batches over a
+//              chan at --rate samples per second
+//   vector     push_back and indexing of a vector of u64
+//
+// The address space is a single anonymous mapping of --mapping GiB of folios
+// of --order, spread evenly over two nodes. Samples hit its 2 MiB regions by
+// a Zipf distribution (--skew) over a random permutation, so hot and cold
+// regions interleave as in a real heap.
+//
+// Every result is printed as one line of key=value pairs, for example
+//   make -f bin.mk bin/demeter-bench && bin/demeter-bench -b rtree,chan
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "range_tree.h"
+#include "chan.h"
+#include "vector.h"
+
+// The module params range_tree.h reads, at their defaults in module.h
+bool file_tiering = FILE_TIERING;
+ulong store_hot_permille = STORE_HOT_PERMILLE;
+ulong rtree_split_thresh = RTREE_SPLIT_THRESH;
+ulong rtree_decay_periods = RTREE_DECAY_PERIODS;
+ulong rtree_thp_split_util = RTREE_THP_SPLIT_UTIL;
+
+bool shim_verbose;
+int shim_nr_cpus = 8;
+ulong node_states[NR_NODE_STATES] = { [N_CPU] = 1, [N_MEMORY] = 3 };
+
+// Mirrors of the private constants and messages of core.c
+enum {
+	SHARD_CHAN_ENTRIES = 64,
+	SHARD_BATCH_SIZE = 128,
+	MIGRATION_BSET_BUCKET = 32,
+};
+struct shard_batch {
+	u32 samples, nr;
+	struct shard_page {
+		u64 vpn;
+		u32 weight, stores;
+	} pages[SHARD_BATCH_SIZE];
+};
+
+static struct {
+	ulong ranges, mapping_gib, order, samples, periods, period_samples;
+	ulong keys, rate;
+	double skew, seconds;
+	ulong seed;
+} opts = {
+	.ranges = RTREE_MAX_SIZE,
+	.mapping_gib = 64,
+	.order = 9,
+	.samples = 1ul << 22,
+	.periods = 64,
+	// About 1M samples per second over the default split_period_ms
+	.period_samples = 1ul << 19,
+	.keys = 1ul << 16,
+	.rate = 1000000,
+	.skew = 0.99,
+	.seconds = 1,
+	.seed = 1,
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static u64 rng_state;
+static u64 rng_next(void)
+{
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+	if (!p) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+#define BASE_ADDR 0x7f0000000000ul
+
+static struct mm_struct mm;
+static struct vm_area_struct vma;
+
+static void mm_init(void)
+{
+	ulong size = opts.mapping_gib << 30;
+	ulong nr = size >> (PAGE_SHIFT + opts.order);
+	vma = (struct vm_area_struct){
+		.vm_start = BASE_ADDR,
+		.vm_end = BASE_ADDR + size,
+		.folios = xmalloc(nr * sizeof(struct folio)),
+		.folio_order = opts.order,
+	};
+	for (ulong i = 0; i < nr; i++)
+		vma.folios[i] = (struct folio){
+			.nid = rng_next() & 1,
+			.anon = true,
+			.lru = true,
+			.order = opts.order,
+		};
+	mm = (struct mm_struct){ .vmas = &vma, .nr_vmas = 1 };
+}
+
+// Sample addresses drawn upfront, so the generator is not part of the timing
+static ulong *samples;
+
+static void samples_init(void)
+{
+	ulong regions = (opts.mapping_gib << 30) / RTREE_GRANULARITY;
+	double *cdf = xmalloc(regions * sizeof(*cdf));
+	ulong *perm = xmalloc(regions * sizeof(*perm));
+	double sum = 0;
+	for (ulong i = 0; i < regions; i++) {
+		sum += pow(i + 1, -opts.skew);
+		cdf[i] = sum;
+		perm[i] = i;
+	}
+	for (ulong i = regions - 1; i > 0; i--)
+		swap(perm[i], perm[rng_next() % (i + 1)]);
+	samples = xmalloc(opts.samples * sizeof(*samples));
+	for (ulong i = 0; i < opts.samples; i++) {
+		double u = (rng_next() >> 11) * 0x1p-53 * sum;
+		ulong lo = 0, hi = regions - 1;
+		while (lo < hi) {
+			ulong mid = (lo + hi) / 2;
+			if (cdf[mid] < u)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		samples[i] = vma.vm_start + perm[lo] * RTREE_GRANULARITY +
+			     rng_next() % RTREE_GRANULARITY;
+	}
+	free(perm);
+	free(cdf);
+}
+
+static void count_samples(struct range_tree *rt, ulong from, ulong nr)
+{
+	for (ulong i = 0; i < nr; i++) {
+		ulong addr = samples[(from + i) % opts.samples], store = (addr >> 6) & 1;
+		rt_count(rt, addr, 1, store, store, !store);
+	}
+}
+
+static void bench_rtree(void)
+{
+	struct range_tree rt;
+	rt_init(&rt);
+	rt_cover(&rt, &mm);
+
+	// Grow the tree as the policy worker would, one chunk of samples per
+	// split period, and cut the widest ranges if the samples cannot split
+	// it to the target size on their own
+	ulong chunk = opts.period_samples, pos = 0, calls = 0;
+	ulong grown = rt.len;
+	u64 split_ns = 0;
+	while (rt.len < opts.ranges && calls < 4 * opts.periods) {
+		count_samples(&rt, pos, chunk);
+		pos += chunk;
+		ulong len = rt.len;
+		u64 t = now_ns();
+		rt_split(&rt);
+		split_ns += now_ns() - t;
+		calls++;
+		if (rt.len == len && calls > opts.periods)
+			break;
+	}
+	grown = rt.len - grown;
+	printf("bench=rt_split phase=grow calls=%lu ranges=%lu added=%lu ns_per_call=%.0f\n",
+	       calls, rt.len, grown, calls ? (double)split_ns / calls : 0);
+	while (rt.len < min(opts.ranges, (ulong)RTREE_MAX_SIZE))
+		if (rt_split_at(&rt, samples[rng_next() % opts.samples]) < 0)
+			break;
+
+	u64 t = now_ns();
+	count_samples(&rt, 0, opts.samples);
+	t = now_ns() - t;
+	ulong hits = 0;
+	for (ulong i = 0; i < opts.samples; i++) {
+		ulong region = samples[i] / RTREE_GRANULARITY;
+		struct rt_cache_slot *slot =
+			&rt.cache[region & (RTREE_CACHE_SIZE - 1)];
+		if (slot->r && slot->region == region)
+			hits++;
+		rt_count(&rt, samples[i], 1, 0, 0, 1);
+	}
+	printf("bench=rt_count ranges=%lu samples=%lu ns_per_sample=%.2f cache_hit_ratio=%.3f\n",
+	       rt.len, opts.samples, (double)t / opts.samples,
+	       (double)hits / opts.samples);
+
+	// Steady state: every period samples some ranges, making them stale
+	// for rt_rank() to recount their folios
+	struct mrange **out = xmalloc(RTREE_MAX_SIZE * sizeof(*out));
+	u64 ns[3] = {};
+	ulong len = 0, ranked = 0;
+	for (ulong i = 0; i < opts.periods; i++) {
+		count_samples(&rt, pos, chunk);
+		pos += chunk;
+		t = now_ns();
+		rt_split(&rt);
+		ns[0] += now_ns() - t;
+		t = now_ns();
+		rt_merge(&rt);
+		ns[1] += now_ns() - t;
+		ulong nr = 0;
+		t = now_ns();
+		rt_rank(&rt, &mm, out, &nr);
+		ns[2] += now_ns() - t;
+		len += rt.len;
+		ranked += nr;
+	}
+	char const *names[] = { "rt_split", "rt_merge", "rt_rank" };
+	for (int i = 0; i < ARRAY_SIZE(names); i++)
+		printf("bench=%s phase=steady periods=%lu ranges=%.0f ranked=%.0f ns_per_call=%.0f\n",
+		       names[i], opts.periods, (double)len / opts.periods,
+		       (double)ranked / opts.periods,
+		       (double)ns[i] / opts.periods);
+	free(out);
+	rt_drop(&rt);
+}
+
+static void bench_blacklist(void)
+{
+	ulong nr = opts.keys;
+	u64 *pfns = xmalloc(2 * nr * sizeof(*pfns));
+	for (ulong i = 0; i < 2 * nr; i++)
+		pfns[i] = rng_next() >> 28;
+	HashMapU64U64 bset = HashMapU64U64_new(MIGRATION_BSET_BUCKET);
+
+	u64 t = now_ns();
+	for (ulong i = 0; i < nr; i++) {
+		HashMapU64U64_Entry e = { pfns[i], 0 };
+		HashMapU64U64_insert(&bset, &e);
+	}
+	u64 insert = now_ns() - t;
+
+	// Hits bump the backoff count as migration_exchange_batch() does
+	ulong found = 0;
+	t = now_ns();
+	for (ulong i = 0; i < nr; i++) {
+		u64 pfn = pfns[rng_next() % nr];
+		if (HashMapU64U64_contains(&bset, &pfn)) {
+			HashMapU64U64_Iter iter = HashMapU64U64_find(&bset, &pfn);
+			HashMapU64U64_Iter_get(&iter)->val++;
+			found++;
+		}
+	}
+	u64 hit = now_ns() - t;
+
+	t = now_ns();
+	for (ulong i = nr; i < 2 * nr; i++)
+		found += HashMapU64U64_contains(&bset, &pfns[i]);
+	u64 miss = now_ns() - t;
+
+	t = now_ns();
+	for (ulong i = 0; i < nr; i++)
+		HashMapU64U64_erase(&bset, &pfns[i]);
+	u64 erase = now_ns() - t;
+
+	printf("bench=blacklist keys=%lu found=%lu insert_ns=%.2f hit_ns=%.2f miss_ns=%.2f erase_ns=%.2f\n",
+	       nr, found, (double)insert / nr, (double)hit / nr,
+	       (double)miss / nr, (double)erase / nr);
+	HashMapU64U64_destroy(&bset);
+	free(pfns);
+}
+
+static struct chan_bench {
+	struct chan *ch;
+	atomic_bool stop;
+	ulong sent, rejected, received, samples;
+	u64 send_ns;
+} cb;
+
+static void *chan_producer(void *arg)
+{
+	struct shard_batch batch = { .samples = SHARD_BATCH_SIZE,
+				     .nr = SHARD_BATCH_SIZE };
+	for (int i = 0; i < SHARD_BATCH_SIZE; i++)
+		batch.pages[i].vpn = samples[i % opts.samples] >> PAGE_SHIFT;
+	// A batch is due every interval to offer the samples at opts.rate
+	u64 interval = opts.rate ? 1000000000ull * SHARD_BATCH_SIZE / opts.rate : 0;
+	u64 start = now_ns(), end = start + opts.seconds * 1e9, due = start;
+	for (u64 t; (t = now_ns()) < end;) {
+		if (t < due) {
+			sched_yield();
+			continue;
+		}
+		due += interval;
+		batch.pages[0].weight++;
+		ssize_t err = chan_send(cb.ch, &batch, sizeof(batch));
+		cb.send_ns += now_ns() - t;
+		err < 0 ? cb.rejected++ : cb.sent++;
+	}
+	atomic_store(&cb.stop, true);
+	return NULL;
+}
+
+static void *chan_consumer(void *arg)
+{
+	struct shard_batch batch;
+	for (;;) {
+		if (chan_recv(cb.ch, &batch, sizeof(batch)) > 0) {
+			cb.received++;
+			cb.samples += batch.samples;
+		} else if (atomic_load(&cb.stop) && chan_empty(cb.ch)) {
+			break;
+		} else {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void bench_chan(void)
+{
+	cb = (struct chan_bench){
+		.ch = chan_new(SHARD_CHAN_ENTRIES, sizeof(struct shard_batch),
+			       NULL),
+	};
+	pthread_t producer, consumer;
+	pthread_create(&consumer, NULL, chan_consumer, NULL);
+	pthread_create(&producer, NULL, chan_producer, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+	ulong offered = cb.sent + cb.rejected;
+	printf("bench=chan entries=%d slot=%zu rate=%lu seconds=%.1f sent=%lu rejected=%lu received=%lu samples_per_sec=%.0f send_ns=%.0f\n",
+	       SHARD_CHAN_ENTRIES, sizeof(struct shard_batch), opts.rate,
+	       opts.seconds, cb.sent, cb.rejected, cb.received,
+	       cb.samples / opts.seconds,
+	       offered ? (double)cb.send_ns / offered : 0);
+	chan_drop(cb.ch);
+}
+
+static void bench_vector(void)
+{
+	ulong nr = opts.samples;
+	struct vector v;
+	vector_new(&v, sizeof(u64), 16);
+	u64 t = now_ns();
+	for (ulong i = 0; i < nr; i++)
+		vector_push_back(&v, &samples[i]);
+	u64 push = now_ns() - t;
+	u64 sum = 0;
+	t = now_ns();
+	for (ulong i = 0; i < nr; i++)
+		sum += *(u64 *)vector_at(&v, rng_next() % nr);
+	u64 at = now_ns() - t;
+	printf("bench=vector elems=%lu push_back_ns=%.2f at_ns=%.2f sum=%lu\n",
+	       nr, (double)push / nr, (double)at / nr, (ulong)(sum & 0xff));
+	vector_drop(&v);
+}
+
+static const struct {
+	char const *name;
+	void (*run)(void);
+} benches[] = {
+	{ "rtree", bench_rtree },
+	{ "blacklist", bench_blacklist },
+	{ "chan", bench_chan },
+	{ "vector", bench_vector },
+};
+
+static void usage(char const *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -b, --bench LIST    comma separated of rtree,blacklist,chan,vector (all)\n"
+		"  -n, --ranges N      range tree size for rt_rank/rt_split (%lu)\n"
+		"  -m, --mapping GIB   size of the sampled mapping (%lu)\n"
+		"  -o, --order N       folio order of the mapping (%lu)\n"
+		"  -s, --samples N     samples drawn for rt_count (%lu)\n"
+		"  -z, --skew S        Zipf exponent over the 2 MiB regions (%.2f)\n"
+		"  -p, --periods N     split periods of the steady state (%lu)\n"
+		"  -P, --period-samples N  samples counted per split period (%lu)\n"
+		"  -c, --cpus N        online cpus, scales the split threshold (%d)\n"
+		"  -k, --keys N        blacklisted pfns (%lu)\n"
+		"  -r, --rate N        samples per second offered to the chan, 0 unpaced (%lu)\n"
+		"  -t, --seconds S     duration of the chan benchmark (%.1f)\n"
+		"  -S, --seed N        seed of the samples and keys (%lu)\n"
+		"  -v, --verbose       print the pr_info() of mm/demeter\n",
+		prog, opts.ranges, opts.mapping_gib, opts.order, opts.samples,
+		opts.skew, opts.periods, opts.period_samples, shim_nr_cpus,
+		opts.keys, opts.rate, opts.seconds, opts.seed);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_opts[] = {
+		{ "bench", required_argument, NULL, 'b' },
+		{ "ranges", required_argument, NULL, 'n' },
+		{ "mapping", required_argument, NULL, 'm' },
+		{ "order", required_argument, NULL, 'o' },
+		{ "samples", required_argument, NULL, 's' },
+		{ "skew", required_argument, NULL, 'z' },
+		{ "periods", required_argument, NULL, 'p' },
+		{ "period-samples", required_argument, NULL, 'P' },
+		{ "cpus", required_argument, NULL, 'c' },
+		{ "keys", required_argument, NULL, 'k' },
+		{ "rate", required_argument, NULL, 'r' },
+		{ "seconds", required_argument, NULL, 't' },
+		{ "seed", required_argument, NULL, 'S' },
+		{ "verbose", no_argument, NULL, 'v' },
+		{ "help", no_argument, NULL, 'h' },
+		{},
+	};
+	char *list = NULL;
+	for (int c; (c = getopt_long(argc, argv, "b:n:m:o:s:z:p:P:c:k:r:t:S:vh",
+				     long_opts, NULL)) != -1;) {
+		switch (c) {
+		case 'b': list = optarg; break;
+		case 'n': opts.ranges = strtoul(optarg, NULL, 0); break;
+		case 'm': opts.mapping_gib = strtoul(optarg, NULL, 0); break;
+		case 'o': opts.order = strtoul(optarg, NULL, 0); break;
+		case 's': opts.samples = strtoul(optarg, NULL, 0); break;
+		case 'z': opts.skew = strtod(optarg, NULL); break;
+		case 'p': opts.periods = strtoul(optarg, NULL, 0); break;
+		case 'P': opts.period_samples = strtoul(optarg, NULL, 0); break;
+		case 'c': shim_nr_cpus = atoi(optarg); break;
+		case 'k': opts.keys = strtoul(optarg, NULL, 0); break;
+		case 'r': opts.rate = strtoul(optarg, NULL, 0); break;
+		case 't': opts.seconds = strtod(optarg, NULL); break;
+		case 'S': opts.seed = strtoul(optarg, NULL, 0); break;
+		case 'v': shim_verbose = true; break;
+		case 'h': usage(argv[0]); return EXIT_SUCCESS;
+		default: usage(argv[0]); return EXIT_FAILURE;
+		}
+	}
+	if (!opts.mapping_gib || !opts.samples || !opts.periods ||
+	    !opts.period_samples || !opts.keys || opts.order > 9 ||
+	    shim_nr_cpus <= 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	rng_state = opts.seed * 0x9e3779b97f4a7c15ull ?: 1;
+	mm_init();
+	samples_init();
+
+	for (int i = 0; i < ARRAY_SIZE(benches); i++) {
+		if (list) {
+			char *l = strdup(list), *save = NULL;
+			bool want = false;
+			for (char *tok = strtok_r(l, ",", &save); tok;
+			     tok = strtok_r(NULL, ",", &save))
+				want |= !strcmp(tok, benches[i].name);
+			free(l);
+			if (!want)
+				continue;
+		}
+		benches[i].run();
+	}
+	free(samples);
+	free(vma.folios);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,3 @@
+// Also reached from the errno.h of libc
+#include_next <linux/errno.h>
+#include "../shim.h"
@@ -0,0 +1 @@
+#include "../shim.h"
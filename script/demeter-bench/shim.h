@@ -0,0 +1,554 @@
+// Just enough of the kernel for the data structures of mm/demeter to build in
+// userspace, see demeter-bench.c and demeter-sim/rtree.c. Every linux/*.h next
+// to this file includes it, so the headers of mm/demeter are compiled
+// unmodified.
+//
+// Only what the benchmarks call does anything: the allocators are libc's, the
+// maple tree is a sorted array searched by bisection, a VMA is an array of
+// folios, locks and wait queues are no-ops and printk is dropped unless
+// shim_verbose is set. What is timed is thus the code of mm/demeter itself and
+// the cost of the shimmed calls differs from the kernel's.
+#ifndef DEMETER_BENCH_SHIM_H
+#define DEMETER_BENCH_SHIM_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+// cwisstable.h defines its own
+#undef INT8_C
+#undef UINT64_C
+#define S8_C(x) x
+#define U64_C(x) x##ULL
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef unsigned long ulong;
+typedef unsigned int gfp_t;
+
+#define U32_MAX ((u32)~0U)
+#define BITS_PER_LONG 64
+#define BITS_PER_TYPE(type) (sizeof(type) * 8)
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define noinline __attribute__((__noinline__))
+#define __cleanup(func) __attribute__((__cleanup__(func)))
+#define ____cacheline_aligned_in_smp __attribute__((__aligned__(64)))
+
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile __typeof__(x) *)&(x) = (val))
+#define smp_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_mb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define struct_size(p, member, n) (sizeof(*(p)) + (n) * sizeof(*(p)->member))
+// A VLA instead of an error if cond is not a constant expression
+#define BUILD_BUG_ON(cond) ((void)sizeof(char[1 - 2 * !!(cond)]))
+#define static_assert(expr, ...) __static_assert(expr, ##__VA_ARGS__, #expr)
+#define __static_assert(expr, msg, ...) _Static_assert(expr, msg)
+
+#define min(x, y)                            \
+	({                                   \
+		__auto_type __x = (x);       \
+		__auto_type __y = (y);       \
+		__x < __y ? __x : __y;       \
+	})
+#define max(x, y)                            \
+	({                                   \
+		__auto_type __x = (x);       \
+		__auto_type __y = (y);       \
+		__x > __y ? __x : __y;       \
+	})
+#define min_t(type, x, y) min((type)(x), (type)(y))
+#define max_t(type, x, y) max((type)(x), (type)(y))
+#define swap(a, b)                           \
+	do {                                 \
+		__auto_type __t = (a);       \
+		(a) = (b);                   \
+		(b) = __t;                   \
+	} while (0)
+
+#define __round_mask(x, y) ((__typeof__(x))((y) - 1))
+#define round_up(x, y) ((((x) - 1) | __round_mask(x, y)) + 1)
+#define round_down(x, y) ((x) & ~__round_mask(x, y))
+#define ALIGN(x, a) round_up(x, a)
+#define ALIGN_DOWN(x, a) round_down(x, a)
+#define IS_ALIGNED(x, a) (((x) & ((__typeof__(x))(a) - 1)) == 0)
+#define mult_frac(x, n, d)                           \
+	({                                           \
+		__typeof__(x) __q = (x) / (d);       \
+		__typeof__(x) __r = (x) % (d);       \
+		__q * (n) + __r * (n) / (d);         \
+	})
+#define time_before(a, b) ((long)((a) - (b)) < 0)
+
+static inline bool is_power_of_2(ulong n)
+{
+	return n != 0 && (n & (n - 1)) == 0;
+}
+#define ilog2(n) ((int)(BITS_PER_LONG - 1 - __builtin_clzl((ulong)(n))))
+
+// splitmix64 from a fixed state, so runs are repeatable
+static inline u64 get_random_u64(void)
+{
+	static u64 state;
+	u64 z = (state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+// Errors
+#ifndef ENOTSUPP
+#define ENOTSUPP 524
+#endif
+#ifndef ENOGRACE
+#define ENOGRACE 531
+#endif
+#define MAX_ERRNO 4095
+#define IS_ERR_VALUE(x) unlikely((ulong)(void *)(x) >= (ulong)-MAX_ERRNO)
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+static inline bool IS_ERR(const void *ptr)
+{
+	return IS_ERR_VALUE((ulong)ptr);
+}
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return unlikely(!ptr) || IS_ERR_VALUE((ulong)ptr);
+}
+#define ERR_CAST(ptr) ((void *)(ptr))
+static inline const char *errname(int err)
+{
+	return NULL;
+}
+
+// printk, the formats use the %p extensions of the kernel
+extern bool shim_verbose;
+static inline void shim_printk(bool err, const char *fmt, ...)
+{
+	if (!err && !shim_verbose)
+		return;
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+#define pr_info(fmt, ...) shim_printk(false, "" fmt, ##__VA_ARGS__)
+#define pr_cont(fmt, ...) shim_printk(false, "" fmt, ##__VA_ARGS__)
+#define pr_err(fmt, ...) shim_printk(true, "" fmt, ##__VA_ARGS__)
+#define pr_err_ratelimited(fmt, ...) shim_printk(true, "" fmt, ##__VA_ARGS__)
+#define dump_stack() ((void)0)
+#define BUG()                                                          \
+	do {                                                           \
+		fprintf(stderr, "BUG at %s:%d\n", __FILE__, __LINE__); \
+		abort();                                               \
+	} while (0)
+#define BUG_ON(cond)               \
+	do {                       \
+		if (unlikely(cond)) \
+			BUG();     \
+	} while (0)
+
+// Allocators
+#define GFP_KERNEL 0u
+struct kmem_cache;
+#define kmalloc(size, gfp) malloc(size)
+#define kzalloc(size, gfp) calloc(1, size)
+#define kcalloc(n, size, gfp) calloc(n, size)
+#define kfree(p) free(p)
+#define kvmalloc(size, gfp) malloc(size)
+#define kvzalloc(size, gfp) calloc(1, size)
+#define kvcalloc(n, size, gfp) calloc(n, size)
+#define kvrealloc(p, oldsize, newsize, gfp) realloc((void *)(p), newsize)
+#define kvfree(p) free(p)
+
+// CPUs, nodes and per-cpu data
+extern int shim_nr_cpus;
+#define num_online_cpus() ((unsigned int)shim_nr_cpus)
+#define for_each_online_cpu(cpu) for ((cpu) = 0; (cpu) < shim_nr_cpus; (cpu)++)
+// An array of one, so that a scalar can be initialized with {}
+#define DEFINE_PER_CPU(type, name) __thread type name[1]
+#define this_cpu_ptr(p) ((__typeof__(**(p)) *)(p))
+
+enum node_states { N_CPU, N_MEMORY, NR_NODE_STATES };
+// Node 0 has the cpus and the fast memory, node 1 the slow memory
+extern ulong node_states[NR_NODE_STATES];
+#define first_node(mask) __builtin_ctzl(mask)
+#define last_node(mask) (BITS_PER_LONG - 1 - __builtin_clzl(mask))
+#define for_each_node_state(nid, state)            \
+	for ((nid) = 0; (nid) < BITS_PER_LONG; (nid)++) \
+		if (node_states[state] >> (nid) & 1)
+#define MEMTIER_ADISTANCE_DRAM 576
+static inline int mt_calc_adistance(int nid, int *adist)
+{
+	return 0;
+}
+static inline int node_distance(int from, int to)
+{
+	return from == to ? 10 : 20;
+}
+
+struct static_key_true {
+	int enabled;
+};
+#define DECLARE_STATIC_KEY_TRUE(name) extern struct static_key_true name
+
+struct perf_event_attr {
+	u64 config;
+};
+
+// The scoped classes of linux/cleanup.h
+#define DEFINE_CLASS(_name, _type, _exit, _init, _init_args...) \
+	typedef _type class_##_name##_t;                         \
+	static inline void class_##_name##_destructor(_type *p)  \
+	{                                                        \
+		_type _T = *p;                                   \
+		_exit;                                           \
+	}                                                        \
+	static inline _type class_##_name##_constructor(_init_args) \
+	{                                                        \
+		_type t = _init;                                 \
+		return t;                                        \
+	}
+#define CLASS(_name, var)                                            \
+	class_##_name##_t var __cleanup(class_##_name##_destructor) = \
+		class_##_name##_constructor
+
+// The kernel sorts with a heapsort, this shim with glibc
+typedef int (*cmp_r_func_t)(const void *a, const void *b, const void *priv);
+typedef void (*swap_r_func_t)(void *a, void *b, int size, const void *priv);
+static inline void sort_r(void *base, size_t num, size_t size,
+			  cmp_r_func_t cmp, swap_r_func_t swap_func,
+			  const void *priv)
+{
+	qsort_r(base, num, size,
+		(int (*)(const void *, const void *, void *))cmp,
+		(void *)priv);
+}
+
+// The maple tree as a sorted array of disjoint ranges
+struct maple_tree {
+	struct mt_slot {
+		ulong first, last;
+		void *entry;
+	} *slots;
+	ulong nr, cap;
+};
+static inline void mt_init(struct maple_tree *mt)
+{
+	*mt = (struct maple_tree){};
+}
+// Index of the first range ending at or after index
+static inline ulong mt_lower_bound(struct maple_tree const *mt, ulong index)
+{
+	ulong lo = 0, hi = mt->nr;
+	while (lo < hi) {
+		ulong mid = lo + (hi - lo) / 2;
+		if (mt->slots[mid].last < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+static inline int mtree_insert_range(struct maple_tree *mt, ulong first,
+				     ulong last, void *entry, gfp_t gfp)
+{
+	if (first > last || !entry)
+		return -EINVAL;
+	ulong i = mt_lower_bound(mt, first);
+	if (i < mt->nr && mt->slots[i].first <= last)
+		return -EEXIST;
+	if (mt->nr == mt->cap) {
+		ulong cap = mt->cap ? 2 * mt->cap : 64;
+		struct mt_slot *slots =
+			realloc(mt->slots, cap * sizeof(*slots));
+		if (!slots)
+			return -ENOMEM;
+		mt->slots = slots;
+		mt->cap = cap;
+	}
+	memmove(&mt->slots[i + 1], &mt->slots[i],
+		(mt->nr - i) * sizeof(*mt->slots));
+	mt->slots[i] = (struct mt_slot){ first, last, entry };
+	mt->nr += 1;
+	return 0;
+}
+static inline void *mtree_erase(struct maple_tree *mt, ulong index)
+{
+	ulong i = mt_lower_bound(mt, index);
+	if (i == mt->nr || mt->slots[i].first > index)
+		return NULL;
+	void *entry = mt->slots[i].entry;
+	memmove(&mt->slots[i], &mt->slots[i + 1],
+		(mt->nr - i - 1) * sizeof(*mt->slots));
+	mt->nr -= 1;
+	return entry;
+}
+static inline void mtree_destroy(struct maple_tree *mt)
+{
+	free(mt->slots);
+	mt_init(mt);
+}
+static inline void *mt_find(struct maple_tree *mt, ulong *index, ulong max)
+{
+	if (*index > max)
+		return NULL;
+	ulong i = mt_lower_bound(mt, *index);
+	if (i == mt->nr || mt->slots[i].first > max)
+		return NULL;
+	*index = mt->slots[i].last + 1;
+	return mt->slots[i].entry;
+}
+static inline void *mt_find_after(struct maple_tree *mt, ulong *index,
+				  ulong max)
+{
+	// The last range ended at ULONG_MAX
+	if (!*index)
+		return NULL;
+	return mt_find(mt, index, max);
+}
+#define mt_for_each(__tree, __entry, __index, __max)                 \
+	for (__entry = mt_find(__tree, &(__index), __max); __entry; \
+	     __entry = mt_find_after(__tree, &(__index), __max))
+
+// Memory, a VMA maps an array of folios of one order
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1ul << PAGE_SHIFT)
+#define TASK_SIZE_MAX ((1ul << 47) - PAGE_SIZE)
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+struct folio {
+	int nid;
+	bool anon, lru;
+	u8 order;
+};
+// A page is only ever turned into its folio
+struct page;
+#define page_folio(p) ((struct folio *)(p))
+struct address_space;
+
+// Files only key the ranges saved by rt_save()
+struct super_block {
+	u32 s_dev;
+};
+struct inode {
+	ulong i_ino;
+	struct super_block *i_sb;
+};
+struct file {
+	struct inode *f_inode;
+};
+static inline struct inode *file_inode(struct file const *f)
+{
+	return f->f_inode;
+}
+#define new_encode_dev(dev) ((u32)(dev))
+
+#define VM_EXEC 0x00000004ul
+#define VM_LOCKED 0x00002000ul
+#define VM_IO 0x00004000ul
+#define VM_PFNMAP 0x00000400ul
+#define VM_HUGETLB 0x00400000ul
+struct vm_area_struct {
+	ulong vm_start, vm_end, vm_flags, vm_pgoff;
+	struct file *vm_file;
+	struct folio *folios;
+	u8 folio_order;
+};
+struct mm_struct {
+	struct vm_area_struct *vmas;
+	int nr_vmas;
+};
+static inline bool vma_is_anonymous(struct vm_area_struct const *vma)
+{
+	return !vma->vm_file;
+}
+static inline bool vma_is_dax(struct vm_area_struct const *vma)
+{
+	return false;
+}
+// VMAs are sorted by address
+struct vma_iterator {
+	struct mm_struct *mm;
+	ulong addr;
+};
+#define VMA_ITERATOR(name, __mm, __addr) \
+	struct vma_iterator name = { .mm = (__mm), .addr = (__addr) }
+static inline struct vm_area_struct *vma_find(struct vma_iterator *vmi,
+					      ulong max)
+{
+	struct mm_struct *mm = vmi->mm;
+	for (int i = 0; i < mm->nr_vmas; i++) {
+		struct vm_area_struct *vma = &mm->vmas[i];
+		if (vma->vm_end <= vmi->addr)
+			continue;
+		if (vma->vm_start >= max)
+			return NULL;
+		vmi->addr = vma->vm_end;
+		return vma;
+	}
+	return NULL;
+}
+static inline struct vm_area_struct *vma_next(struct vma_iterator *vmi)
+{
+	return vma_find(vmi, ULONG_MAX);
+}
+#define FOLL_GET 0x04
+#define FOLL_DUMP 0x08
+static inline struct page *follow_page(struct vm_area_struct *vma, ulong addr,
+				       unsigned int foll_flags)
+{
+	if (!vma->folios)
+		return NULL;
+	ulong i = (addr - vma->vm_start) >> (PAGE_SHIFT + vma->folio_order);
+	return (struct page *)&vma->folios[i];
+}
+static inline ulong folio_nr_pages(struct folio const *folio)
+{
+	return 1ul << folio->order;
+}
+static inline ulong folio_size(struct folio const *folio)
+{
+	return PAGE_SIZE << folio->order;
+}
+static inline int folio_nid(struct folio const *folio)
+{
+	return folio->nid;
+}
+static inline bool folio_test_large(struct folio const *folio)
+{
+	return folio->order;
+}
+static inline bool folio_test_anon(struct folio const *folio)
+{
+	return folio->anon;
+}
+static inline struct address_space *folio_mapping(struct folio *folio)
+{
+	return NULL;
+}
+static inline bool folio_test_swapbacked(struct folio const *folio)
+{
+	return false;
+}
+static inline bool folio_test_dirty(struct folio const *folio)
+{
+	return false;
+}
+static inline bool folio_test_writeback(struct folio const *folio)
+{
+	return false;
+}
+static inline bool folio_test_clear_lru(struct folio *folio)
+{
+	bool lru = folio->lru;
+	folio->lru = false;
+	return lru;
+}
+static inline void folio_get(struct folio *folio)
+{
+}
+static inline void folio_put(struct folio *folio)
+{
+}
+struct folio_batch {
+	unsigned char nr;
+	struct folio *folios[31];
+};
+static inline void folio_batch_init(struct folio_batch *fbatch)
+{
+	fbatch->nr = 0;
+}
+static inline unsigned int folio_batch_count(struct folio_batch *fbatch)
+{
+	return fbatch->nr;
+}
+static inline unsigned int folio_batch_add(struct folio_batch *fbatch,
+					   struct folio *folio)
+{
+	fbatch->folios[fbatch->nr++] = folio;
+	return ARRAY_SIZE(fbatch->folios) - fbatch->nr;
+}
+
+#define mmap_read_lock(mm) ((void)(mm))
+#define mmap_read_unlock(mm) ((void)(mm))
+#define mmap_lock_is_contended(mm) false
+#define cond_resched() ((void)0)
+
+// The PEBS counters of linux/vm_event_item.h rt_count() reports into
+enum vm_event_item {
+	PEBS_NR_DISCARDED,
+	PEBS_NR_DISCARDED_NULL,
+	PEBS_NR_DISCARDED_PID,
+	PEBS_NR_DISCARDED_ERROR,
+	PEBS_NR_DISCARDED_IGNORE,
+};
+
+// Wait queues and kthreads, consumers poll instead of sleeping
+struct wait_queue_head {
+	int sleepers;
+};
+#define init_waitqueue_head(wq) ((wq)->sleepers = 0)
+#define wq_has_sleeper(wq) ({ smp_mb(); READ_ONCE((wq)->sleepers) != 0; })
+#define wake_up(wq) ((void)(wq))
+#define kthread_should_stop() false
+#define wait_event_interruptible(wq, cond) \
+	({                                 \
+		while (!(cond))            \
+			sched_yield();     \
+		0;                         \
+	})
+
+// The ring buffer behind mpsc.h is declared only, it cannot be built here
+struct trace_buffer;
+struct ring_buffer_event;
+typedef bool (*ring_buffer_cond_fn)(void *data);
+#define RB_FL_OVERWRITE (1 << 0)
+#define RING_BUFFER_ALL_CPUS -1
+struct trace_buffer *ring_buffer_alloc(ulong size, unsigned int flags);
+void ring_buffer_free(struct trace_buffer *buffer);
+struct ring_buffer_event *ring_buffer_lock_reserve(struct trace_buffer *buffer,
+						   ulong length);
+int ring_buffer_unlock_commit(struct trace_buffer *buffer);
+void *ring_buffer_event_data(struct ring_buffer_event *event);
+unsigned int ring_buffer_event_length(struct ring_buffer_event *event);
+struct ring_buffer_event *ring_buffer_consume(struct trace_buffer *buffer,
+					      int cpu, u64 *ts,
+					      ulong *lost_events);
+bool ring_buffer_empty(struct trace_buffer *buffer);
+ulong ring_buffer_overruns(struct trace_buffer *buffer);
+int ring_buffer_wait(struct trace_buffer *buffer, int cpu, int full,
+		     ring_buffer_cond_fn cond, void *data);
+
+#endif // !DEMETER_BENCH_SHIM_H
@@ -0,0 +1,630 @@
+// Replay a trace of the demeter placement policy offline, see the trace_records
+// module param, through several tiering policies and estimate the fast tier hit
+// ratio and the migration volume of each of them.
+//
+// Usage: demeter-sim [options] trace.bin
+//
+// The samples are replayed in time order. A page enters the simulation on its
+// first sample and is placed into the fast tier as long as there is room, like
+// local allocation would. A sample is a hit if its page is in the fast tier at
+// that time. Every period ends with a decay, then the policy may migrate pages
+// under the exchange batch budget. Only two tiers are modeled, the fastest one
+// and the rest.
+//
+// Policies:
+//   rtree     the range tree of mm/demeter/range_tree.h itself, see rtree.c,
+//             packed the same way and exchanging page for page
+//   recorded  the rankings and exchange volumes recorded by the kernel
+//   lru       promote the pages sampled last period, demote the least recently
+//             sampled ones once the fast tier is full, e.g. TPP
+//   hotness   promote the pages in the hottest log2 bins of the decayed access
+//             count that fit the fast tier, e.g. Memtis
+//   none      first-touch placement only
+#include <getopt.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rtree.h"
+
+using u32 = uint32_t;
+using u64 = uint64_t;
+
+// Mirrors of mm/demeter/core.c
+enum { TARGET_TRACE_MAGIC = 0x52544d44 };
+enum target_trace_type {
+	TRACE_NONE,
+	TRACE_SAMPLE,
+	TRACE_TIER,
+	TRACE_RANGE,
+	TRACE_EXCHANGE,
+};
+struct target_trace_record {
+	u64 time, addr, value;
+	u32 type, arg;
+};
+struct target_trace_hdr {
+	u32 magic, record_size, cpus, split_period_ms;
+	u64 nr, lost;
+	u64 rtree_split_thresh, rtree_exch_thresh, rtree_decay_periods;
+	u64 exch_batch_bytes;
+};
+
+enum : u64 { PAGE_SHIFT = 12 };
+
+struct params {
+	u64 fast_pages;
+	u64 period_ns;
+	// Pages promoted per period at most, 0 for unlimited
+	u64 batch_pages;
+	// rtree_split_thresh, scaled by the cpus in rt_split()
+	u64 split_thresh;
+	unsigned int cpus;
+	u64 exch_thresh;
+	u64 decay_periods;
+};
+
+struct page {
+	// The sampled weight, halved every period like the sketch
+	u64 heat;
+	// The period heat was last brought up to
+	u64 epoch;
+	bool fast;
+};
+
+class sim {
+    public:
+	explicit sim(params const &p) : p(p)
+	{
+	}
+	params const p;
+	// Keyed by the virtual page number
+	std::map<u64, page> pages;
+	u64 fast = 0, epoch = 0;
+	u64 samples = 0, hits = 0, weight = 0, hit_weight = 0;
+	u64 promoted = 0, demoted = 0;
+
+	page &access(u64 vpn, u64 w)
+	{
+		auto [it, created] = pages.try_emplace(vpn);
+		page &pg = it->second;
+		if (created) {
+			pg.epoch = epoch;
+			pg.fast = fast < p.fast_pages;
+			fast += pg.fast;
+		}
+		pg.heat = heat(pg) + w;
+		samples += 1;
+		weight += w;
+		if (pg.fast) {
+			hits += 1;
+			hit_weight += w;
+		}
+		return pg;
+	}
+	u64 heat(page &pg)
+	{
+		u64 elapsed = epoch - pg.epoch;
+		pg.heat = elapsed < 64 ? pg.heat >> elapsed : 0;
+		pg.epoch = epoch;
+		return pg.heat;
+	}
+	page *find(u64 vpn)
+	{
+		auto it = pages.find(vpn);
+		return it == pages.end() ? nullptr : &it->second;
+	}
+	// Promote at most budget candidates in order, 0 for unlimited. With swap every
+	// promotion is matched by a demotion as long as there are victims, as the
+	// exchange of demeter does, otherwise victims are only demoted once the
+	// fast tier is full. Both return nullptr once exhausted, a candidate must
+	// be in the slow tier and a victim in the fast one.
+	void migrate(u64 budget, bool swap,
+		     std::function<page *()> const &candidate,
+		     std::function<page *()> const &victim)
+	{
+		for (u64 n = 0; n < (budget ?: UINT64_MAX); ++n) {
+			page *pg = candidate();
+			if (!pg)
+				break;
+			if (swap || fast >= p.fast_pages) {
+				page *v = victim();
+				if (v) {
+					v->fast = false;
+					fast -= 1;
+					demoted += 1;
+				} else if (fast >= p.fast_pages) {
+					break;
+				}
+			}
+			pg->fast = true;
+			fast += 1;
+			promoted += 1;
+		}
+	}
+};
+
+struct policy {
+	virtual ~policy() = default;
+	virtual char const *name() const = 0;
+	// Any record, with the page of a sample after it was accounted
+	virtual void record(sim &, target_trace_record const &, page *)
+	{
+	}
+	// At the end of every period, after the decay
+	virtual void period(sim &)
+	{
+	}
+};
+
+struct none_policy : policy {
+	char const *name() const override
+	{
+		return "none";
+	}
+};
+
+// The fast pages in the order they were last sampled, or promoted
+class fast_list {
+	std::list<u64> list;
+	std::unordered_map<u64, std::list<u64>::iterator> where;
+
+    public:
+	void touch(u64 vpn)
+	{
+		auto it = where.find(vpn);
+		if (it != where.end())
+			list.erase(it->second);
+		list.push_front(vpn);
+		where[vpn] = list.begin();
+	}
+	// Remove the least recent page for which keep() is false, keep() moves
+	// the others to the front, each of the pages is considered once
+	std::optional<u64> evict(std::function<bool(u64)> const &keep)
+	{
+		for (size_t n = list.size(); n--;) {
+			u64 vpn = list.back();
+			list.pop_back();
+			where.erase(vpn);
+			if (!keep(vpn))
+				return vpn;
+			touch(vpn);
+		}
+		return std::nullopt;
+	}
+};
+
+// The slow pages sampled in the current period, most recent first
+class recent_set {
+	std::unordered_map<u64, u64> last;
+	u64 seq = 0;
+
+    public:
+	void touch(u64 vpn)
+	{
+		last[vpn] = seq++;
+	}
+	std::vector<u64> take()
+	{
+		std::vector<std::pair<u64, u64> > v(last.begin(), last.end());
+		std::sort(v.begin(), v.end(),
+			  [](auto &a, auto &b) { return a.second > b.second; });
+		last.clear();
+		std::vector<u64> out;
+		for (auto &[vpn, _] : v)
+			out.push_back(vpn);
+		return out;
+	}
+};
+
+struct lru_policy : policy {
+	fast_list active;
+	recent_set recent;
+
+	char const *name() const override
+	{
+		return "lru";
+	}
+	void record(sim &, target_trace_record const &r, page *pg) override
+	{
+		if (!pg)
+			return;
+		u64 vpn = r.addr >> PAGE_SHIFT;
+		pg->fast ? active.touch(vpn) : recent.touch(vpn);
+	}
+	void period(sim &s) override
+	{
+		std::vector<u64> cand = recent.take();
+		size_t i = 0;
+		s.migrate(
+			s.p.batch_pages, false,
+			[&]() -> page * {
+				while (i < cand.size()) {
+					page *pg = s.find(cand[i++]);
+					if (!pg->fast)
+						return pg;
+				}
+				return nullptr;
+			},
+			[&]() -> page * {
+				auto vpn = active.evict(
+					[](u64) { return false; });
+				return vpn ? s.find(*vpn) : nullptr;
+			});
+		for (u64 vpn : cand)
+			if (s.find(vpn)->fast)
+				active.touch(vpn);
+	}
+};
+
+// A log2 histogram of the decayed access counts kept up to date as pages are
+// sampled. Halving every count shifts a page down by exactly one bin, so a
+// page is filed under its bin plus the epoch it was last updated at, and its
+// bin in a later epoch is that level minus the epoch. Levels at or below the
+// epoch are cold and forgotten, their pages have decayed to zero.
+struct hotness_policy : policy {
+	std::map<u64, u64> levels;
+	u64 hot_level = 0;
+	fast_list active;
+	recent_set recent;
+
+	static u64 bin(u64 heat)
+	{
+		return heat ? 64 - __builtin_clzll(heat) : 0;
+	}
+	char const *name() const override
+	{
+		return "hotness";
+	}
+	void record(sim &s, target_trace_record const &r, page *pg) override
+	{
+		if (!pg)
+			return;
+		u64 vpn = r.addr >> PAGE_SHIFT, w = r.value;
+		// Undo the sample to find where the page was filed
+		u64 before = pg->heat - w, level = bin(before) + pg->epoch;
+		if (before && !--levels[level])
+			levels.erase(level);
+		levels[bin(pg->heat) + s.epoch] += 1;
+		pg->fast ? active.touch(vpn) : recent.touch(vpn);
+	}
+	u64 level(page &pg)
+	{
+		return pg.heat ? bin(pg.heat) + pg.epoch : 0;
+	}
+	void period(sim &s) override
+	{
+		levels.erase(levels.begin(), levels.upper_bound(s.epoch));
+		// The lowest level whose pages and those above fit the fast tier,
+		// at least the hottest one
+		u64 pages = 0;
+		hot_level = levels.empty() ? UINT64_MAX : levels.rbegin()->first;
+		for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+			if ((pages += it->second) > s.p.fast_pages)
+				break;
+			hot_level = it->first;
+		}
+		std::vector<u64> cand = recent.take();
+		std::stable_sort(cand.begin(), cand.end(), [&](u64 a, u64 b) {
+			return s.find(a)->heat > s.find(b)->heat;
+		});
+		size_t i = 0;
+		s.migrate(
+			s.p.batch_pages, false,
+			[&]() -> page * {
+				while (i < cand.size()) {
+					page *pg = s.find(cand[i++]);
+					if (!pg->fast && level(*pg) >= hot_level)
+						return pg;
+				}
+				return nullptr;
+			},
+			[&]() -> page * {
+				auto vpn = active.evict([&](u64 vpn) {
+					return level(*s.find(vpn)) >= hot_level;
+				});
+				return vpn ? s.find(*vpn) : nullptr;
+			});
+		for (u64 vpn : cand)
+			if (s.find(vpn)->fast)
+				active.touch(vpn);
+	}
+};
+
+// Promote the sampled slow pages of the ranges packed into the fast tier,
+// hottest range first, matched by the fast pages of the ranges packed below,
+// coldest range first, as policy_send_exch_req() does. ranked is in ascending
+// order and only the first rlen entries are considered.
+static void exchange_ranked(sim &s, std::vector<sim_range> const &ranked,
+			    size_t rlen, u64 budget)
+{
+	std::vector<u64> promo, demo;
+	budget = budget ?: UINT64_MAX;
+	for (size_t i = rlen; i-- > 0 && promo.size() < budget;) {
+		sim_range const &r = ranked[i];
+		if (r.target != 0)
+			continue;
+		auto it = s.pages.lower_bound(r.start >> PAGE_SHIFT);
+		for (; it != s.pages.end() && it->first < r.end >> PAGE_SHIFT &&
+		       promo.size() < budget;
+		     ++it)
+			if (!it->second.fast && s.heat(it->second))
+				promo.push_back(it->first);
+	}
+	for (size_t i = 0; i < rlen && demo.size() < promo.size(); ++i) {
+		sim_range const &r = ranked[i];
+		if (r.target <= 0)
+			continue;
+		auto it = s.pages.lower_bound(r.start >> PAGE_SHIFT);
+		for (; it != s.pages.end() && it->first < r.end >> PAGE_SHIFT &&
+		       demo.size() < promo.size();
+		     ++it)
+			if (it->second.fast)
+				demo.push_back(it->first);
+	}
+	size_t p = 0, d = 0;
+	s.migrate(
+		budget, true,
+		[&]() { return p < promo.size() ? s.find(promo[p++]) : nullptr; },
+		[&]() { return d < demo.size() ? s.find(demo[d++]) : nullptr; });
+}
+
+// The range tree of mm/demeter/range_tree.h itself, see rtree.c
+class rtree_policy : public policy {
+	std::unique_ptr<sim_rtree, decltype(&sim_rtree_drop)> rt;
+
+	// policy_pack_tiers() with the fast tier and the rest, by the pages of
+	// the simulation resident in each range
+	void pack(sim &s, std::vector<sim_range> &ranked, size_t rlen)
+	{
+		int tier = 0;
+		u64 used = 0;
+		for (size_t i = rlen; i-- > 0;) {
+			sim_range &r = ranked[i];
+			auto begin = s.pages.lower_bound(r.start >> PAGE_SHIFT),
+			     end = s.pages.lower_bound(r.end >> PAGE_SHIFT);
+			u64 resident = std::distance(begin, end);
+			if (tier == 0 &&
+			    (!r.nr_access || used + resident > s.p.fast_pages))
+				tier = 1;
+			r.target = tier;
+			used += resident;
+		}
+	}
+
+    public:
+	explicit rtree_policy(params const &p)
+		: rt(nullptr, sim_rtree_drop)
+	{
+		sim_rtree_params rp = { p.cpus, p.split_thresh,
+					p.decay_periods };
+		rt.reset(sim_rtree_new(&rp));
+		if (!rt) {
+			perror("Error: sim_rtree_new");
+			exit(EXIT_FAILURE);
+		}
+	}
+	char const *name() const override
+	{
+		return "rtree";
+	}
+	void record(sim &, target_trace_record const &r, page *pg) override
+	{
+		if (pg)
+			sim_rtree_count(rt.get(), r.addr, r.value, r.arg);
+	}
+	// policy_handle_splt_reqs() then policy_send_exch_reqs()
+	void period(sim &s) override
+	{
+		size_t diff = sim_rtree_period(rt.get());
+		if (!diff || sim_rtree_min_range(rt.get()) > s.p.exch_thresh)
+			return;
+		std::vector<sim_range> ranked(sim_rtree_len(rt.get()));
+		size_t rlen = sim_rtree_rank(rt.get(), ranked.data());
+		pack(s, ranked, rlen);
+		exchange_ranked(s, ranked, rlen, s.p.batch_pages);
+	}
+};
+
+// The ranking of the kernel, exchanged with the volume it requested
+class recorded_policy : public policy {
+	std::vector<sim_range> ranking;
+	u32 fast_nid = 0;
+
+    public:
+	char const *name() const override
+	{
+		return "recorded";
+	}
+	void record(sim &s, target_trace_record const &r, page *) override
+	{
+		switch (r.type) {
+		case TRACE_TIER:
+			if (r.arg == 0) {
+				ranking.clear();
+				fast_nid = r.addr;
+			}
+			break;
+		case TRACE_RANGE:
+			// Only the fastest tier is modeled, the others are slow
+			ranking.push_back(sim_range{
+				r.addr, r.addr + r.value, 0,
+				(int)r.arg < 0 ? -1 : (int)r.arg > 0 });
+			break;
+		case TRACE_EXCHANGE: {
+			// Between the slower tiers
+			if (r.arg >> 16 != fast_nid || !r.value)
+				break;
+			// The ranges left alone are the hottest ones, ranked last
+			size_t rlen = std::count_if(
+				ranking.begin(), ranking.end(),
+				[](auto &m) { return m.target >= 0; });
+			exchange_ranked(s, ranking, rlen, r.value);
+			break;
+		}
+		}
+	}
+};
+
+static std::unique_ptr<policy> policy_new(std::string const &name,
+					  params const &p)
+{
+	if (name == "rtree")
+		return std::make_unique<rtree_policy>(p);
+	if (name == "recorded")
+		return std::make_unique<recorded_policy>();
+	if (name == "lru")
+		return std::make_unique<lru_policy>();
+	if (name == "hotness")
+		return std::make_unique<hotness_policy>();
+	if (name == "none")
+		return std::make_unique<none_policy>();
+	return nullptr;
+}
+
+static void replay(std::vector<target_trace_record> const &records,
+		   params const &p, policy &pol)
+{
+	sim s(p);
+	u64 next = 0;
+	for (auto const &r : records) {
+		if (r.type == TRACE_SAMPLE && !next)
+			next = r.time + p.period_ns;
+		while (next && r.time >= next) {
+			s.epoch += 1;
+			pol.period(s);
+			next += p.period_ns;
+		}
+		page *pg = r.type == TRACE_SAMPLE ?
+				   &s.access(r.addr >> PAGE_SHIFT, r.value) :
+				   nullptr;
+		pol.record(s, r, pg);
+	}
+	double mib = (1ul << 20) >> PAGE_SHIFT;
+	printf("policy=%s samples=%lu hit_ratio=%.4f weighted_hit_ratio=%.4f promoted_mib=%.1f demoted_mib=%.1f footprint_mib=%.1f periods=%lu\n",
+	       pol.name(), s.samples,
+	       s.samples ? (double)s.hits / s.samples : 0,
+	       s.weight ? (double)s.hit_weight / s.weight : 0,
+	       s.promoted / mib, s.demoted / mib, s.pages.size() / mib,
+	       s.epoch);
+}
+
+static void usage(char const *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] trace.bin\n"
+		"  -p, --policy LIST       comma separated, defaults to rtree,recorded,lru,hotness,none\n"
+		"  -f, --fast-mib N        fast tier capacity, defaults to the one recorded\n"
+		"  -t, --period-ms N       defaults to split_period_ms\n"
+		"  -b, --batch-mib N       promoted per period, 0 for unlimited, defaults to exch_batch_bytes\n"
+		"  -s, --split-thresh N    defaults to rtree_split_thresh\n"
+		"  -c, --cpus N            the split threshold is scaled by, defaults to the traced cpus\n"
+		"  -e, --exch-thresh N     bytes, defaults to rtree_exch_thresh\n"
+		"  -d, --decay-periods N   defaults to rtree_decay_periods\n",
+		prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct option const options[] = {
+		{ "policy", required_argument, nullptr, 'p' },
+		{ "fast-mib", required_argument, nullptr, 'f' },
+		{ "period-ms", required_argument, nullptr, 't' },
+		{ "batch-mib", required_argument, nullptr, 'b' },
+		{ "split-thresh", required_argument, nullptr, 's' },
+		{ "cpus", required_argument, nullptr, 'c' },
+		{ "exch-thresh", required_argument, nullptr, 'e' },
+		{ "decay-periods", required_argument, nullptr, 'd' },
+		{ "help", no_argument, nullptr, 'h' },
+		{},
+	};
+	std::string policies = "rtree,recorded,lru,hotness,none";
+	std::map<char, u64> opts;
+	for (int c; (c = getopt_long(argc, argv, "p:f:t:b:s:c:e:d:h", options,
+				     nullptr)) != -1;) {
+		if (c == 'p')
+			policies = optarg;
+		else if (c != 'h' && c != '?')
+			opts[c] = strtoull(optarg, nullptr, 0);
+		else
+			usage(argv[0]);
+	}
+	if (optind + 1 != argc)
+		usage(argv[0]);
+
+	std::ifstream in(argv[optind], std::ios::binary);
+	target_trace_hdr hdr = {};
+	if (!in.read((char *)&hdr, sizeof(hdr)) ||
+	    hdr.magic != TARGET_TRACE_MAGIC ||
+	    hdr.record_size != sizeof(target_trace_record)) {
+		fprintf(stderr, "Error: '%s' is not a demeter trace\n",
+			argv[optind]);
+		return EXIT_FAILURE;
+	}
+	// The dump may carry records appended after its header was read
+	std::vector<target_trace_record> records;
+	for (target_trace_record r; in.read((char *)&r, sizeof(r));)
+		if (r.type != TRACE_NONE)
+			records.push_back(r);
+	std::stable_sort(records.begin(), records.end(),
+			 [](auto &a, auto &b) { return a.time < b.time; });
+
+	u64 fast_pages = 0, exchanges = 0, promoted = 0, demoted = 0;
+	for (auto const &r : records) {
+		if (r.type == TRACE_TIER && r.arg == 0 && !fast_pages)
+			fast_pages = r.value;
+		if (r.type == TRACE_EXCHANGE) {
+			exchanges += 1;
+			promoted += r.value;
+			demoted += r.addr;
+		}
+	}
+	auto opt = [&](char c, u64 def) {
+		return opts.count(c) ? opts[c] : def;
+	};
+	params p = {};
+	p.fast_pages = opts.count('f') ? opts['f'] << 20 >> PAGE_SHIFT :
+					 fast_pages;
+	p.period_ns = opt('t', hdr.split_period_ms) * 1000000;
+	p.batch_pages = opts.count('b') ? opts['b'] << 20 >> PAGE_SHIFT :
+					  hdr.exch_batch_bytes >> PAGE_SHIFT;
+	p.split_thresh = opt('s', hdr.rtree_split_thresh);
+	p.cpus = opt('c', hdr.cpus);
+	p.exch_thresh = opt('e', hdr.rtree_exch_thresh);
+	p.decay_periods = opt('d', hdr.rtree_decay_periods);
+	if (!p.fast_pages || !p.period_ns) {
+		fprintf(stderr,
+			"Error: no ranking recorded, the fast tier capacity and the period have to be given\n");
+		return EXIT_FAILURE;
+	}
+	double mib = (1ul << 20) >> PAGE_SHIFT;
+	printf("trace=%s records=%zu lost=%lu exchanges=%lu promoted_mib=%.1f demoted_mib=%.1f fast_mib=%.1f\n",
+	       argv[optind], records.size(), hdr.lost, exchanges,
+	       promoted / mib, demoted / mib, p.fast_pages / mib);
+
+	for (size_t pos = 0; pos <= policies.size();) {
+		size_t end = std::min(policies.find(',', pos), policies.size());
+		std::string name = policies.substr(pos, end - pos);
+		pos = end + 1;
+		auto pol = policy_new(name, p);
+		if (!pol) {
+			fprintf(stderr, "Error: unknown policy '%s'\n",
+				name.c_str());
+			return EXIT_FAILURE;
+		}
+		replay(records, p, *pol);
+	}
+	return EXIT_SUCCESS;
+}
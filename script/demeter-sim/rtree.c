@@ -0,0 +1,135 @@
+// The range tree of the patched kernel tree, built from the unmodified
+// range_tree.h against the shims of demeter-bench, so the replay follows the
+// kernel as it is instead of a port of it.
+//
+// The trace does not know the VMAs, so the 1GiB aligned spans of the sampled
+// addresses stand for the anonymous ones. They have no folios: rt_rank() has
+// no residency to count and the simulator packs the tiers by its own pages.
+// The period of a sample is not traced either, every sample stands for one
+// event when telling if a range is store hot.
+#include "range_tree.h"
+#include "rtree.h"
+
+// The module params range_tree.h reads, at their defaults in module.h
+bool file_tiering = FILE_TIERING;
+ulong store_hot_permille = STORE_HOT_PERMILLE;
+ulong rtree_split_thresh = RTREE_SPLIT_THRESH;
+ulong rtree_decay_periods = RTREE_DECAY_PERIODS;
+ulong rtree_thp_split_util = RTREE_THP_SPLIT_UTIL;
+
+bool shim_verbose;
+int shim_nr_cpus = 1;
+ulong node_states[NR_NODE_STATES] = { [N_CPU] = 1, [N_MEMORY] = 3 };
+
+struct sim_rtree {
+	struct range_tree rt;
+	// The spans mapped so far, sorted by address
+	struct mm_struct mm;
+	int cap;
+	struct mrange **out;
+};
+
+struct sim_rtree *sim_rtree_new(struct sim_rtree_params const *p)
+{
+	struct sim_rtree *self = calloc(1, sizeof(*self));
+	if (!self)
+		return NULL;
+	shim_nr_cpus = max(p->cpus, 1u);
+	rtree_split_thresh = p->split_thresh;
+	rtree_decay_periods = p->decay_periods;
+	self->out = malloc(RTREE_MAX_SIZE * sizeof(*self->out));
+	if (!self->out || rt_init(&self->rt)) {
+		free(self->out);
+		free(self);
+		return NULL;
+	}
+	return self;
+}
+
+void sim_rtree_drop(struct sim_rtree *self)
+{
+	rt_drop(&self->rt);
+	mtree_destroy(&self->rt.tree);
+	free(self->mm.vmas);
+	free(self->out);
+	free(self);
+}
+
+// Map the span of addr unless it already is
+static void sim_rtree_map(struct sim_rtree *self, ulong addr)
+{
+	struct mm_struct *mm = &self->mm;
+	ulong start = ALIGN_DOWN(addr, RTREE_COVER_ALIGN);
+	int i = 0;
+	while (i < mm->nr_vmas && mm->vmas[i].vm_end <= start)
+		i++;
+	if (i < mm->nr_vmas && mm->vmas[i].vm_start == start)
+		return;
+	if (mm->nr_vmas == self->cap) {
+		int cap = self->cap ? 2 * self->cap : 16;
+		struct vm_area_struct *vmas =
+			realloc(mm->vmas, cap * sizeof(*vmas));
+		if (!vmas)
+			return;
+		mm->vmas = vmas;
+		self->cap = cap;
+	}
+	memmove(&mm->vmas[i + 1], &mm->vmas[i],
+		(mm->nr_vmas - i) * sizeof(*mm->vmas));
+	mm->vmas[i] = (struct vm_area_struct){
+		.vm_start = start,
+		.vm_end = start + RTREE_COVER_ALIGN,
+	};
+	mm->nr_vmas += 1;
+}
+
+bool sim_rtree_count(struct sim_rtree *self, uint64_t addr, uint64_t weight,
+		     uint32_t config)
+{
+	bool store = config == MEM_INST_RETIRED_ALL_STORES ||
+		     config == MEM_INST_RETIRED_STLB_MISS_STORES;
+	if (!rt_count(&self->rt, addr, weight, store ? weight : 0, store,
+		      !store))
+		return true;
+	sim_rtree_map(self, addr);
+	return false;
+}
+
+size_t sim_rtree_period(struct sim_rtree *self)
+{
+	struct range_tree *rt = &self->rt;
+	if (rt->uncovered)
+		rt_cover(rt, &self->mm);
+	ulong len = rt->len;
+	rt_split(rt);
+	ulong diff = rt->len - len;
+	rt_merge(rt);
+	return diff;
+}
+
+size_t sim_rtree_len(struct sim_rtree const *self)
+{
+	return self->rt.len;
+}
+
+uint64_t sim_rtree_min_range(struct sim_rtree const *self)
+{
+	return self->rt.min_range;
+}
+
+size_t sim_rtree_rank(struct sim_rtree *self, struct sim_range *out)
+{
+	struct range_tree *rt = &self->rt;
+	ulong rlen = rt->len;
+	rt_rank(rt, &self->mm, self->out, &rlen);
+	for (ulong i = 0; i < rt->len; ++i) {
+		struct mrange const *r = self->out[i];
+		out[i] = (struct sim_range){
+			.start = r->start,
+			.end = r->end,
+			.nr_access = r->nr_access,
+			.target = -1,
+		};
+	}
+	return rlen;
+}
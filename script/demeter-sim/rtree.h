@@ -0,0 +1,48 @@
+// The range tree of mm/demeter/range_tree.h behind a plain C interface, so
+// demeter-sim.cpp does not have to build the kernel headers as C++. See
+// rtree.c for how it is built.
+#ifndef DEMETER_SIM_RTREE_H
+#define DEMETER_SIM_RTREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A range in the ranking, target is filled in by the caller
+struct sim_range {
+	uint64_t start, end, nr_access;
+	int target;
+};
+
+// The module params the tree reads, shared by every tree as in the kernel
+struct sim_rtree_params {
+	unsigned int cpus;
+	uint64_t split_thresh, decay_periods;
+};
+
+struct sim_rtree;
+
+struct sim_rtree *sim_rtree_new(struct sim_rtree_params const *p);
+void sim_rtree_drop(struct sim_rtree *self);
+// rt_count() a sample of the event config, false if it fell outside of all
+// ranges. Its 1GiB span is then mapped, and covered at the next period.
+bool sim_rtree_count(struct sim_rtree *self, uint64_t addr, uint64_t weight,
+		     uint32_t config);
+// policy_handle_splt_reqs(): rt_cover() if needed, rt_split() and rt_merge().
+// Returns the number of ranges rt_split() added.
+size_t sim_rtree_period(struct sim_rtree *self);
+size_t sim_rtree_len(struct sim_rtree const *self);
+uint64_t sim_rtree_min_range(struct sim_rtree const *self);
+// rt_rank() into out of sim_rtree_len() entries, in ascending order. Returns
+// the number of the first ones that are settled, the others are left alone.
+size_t sim_rtree_rank(struct sim_rtree *self, struct sim_range *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !DEMETER_SIM_RTREE_H
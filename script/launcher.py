@@ -1,9 +1,13 @@
 #!/usr/bin/env python3
 import argparse
 import ctypes
+import json
 import os
+import shutil
 import signal
 import sys
+import threading
+import time
 from contextlib import ExitStack, contextmanager
 from enum import Enum
 from errno import EINVAL
@@ -13,8 +17,17 @@ from signal import SIGINT
 from subprocess import DEVNULL, Popen, run
 
 
+# The commands of a launch that run side by side, each as a target of its own
+SEPARATOR = "---"
+
+
+def out_dir(i: int, n: int) -> Path:
+    """Where the i-th of n children writes its logs, /out itself for a single one"""
+    return Path("/out") if n == 1 else Path("/out") / f"target{i}"
+
+
 @contextmanager
-def noop(pid: int = -1):
+def noop(*pids: int):
     try:
         yield
     finally:
@@ -22,7 +35,7 @@ def noop(pid: int = -1):
 
 
 @contextmanager
-def demeter(pid: int = -1):
+def demeter(*pids: int):
     procfs = Path("/proc/sys")
     sysfs = Path("/sys/kernel")
     targets = Path("/sys/kernel/mm/demeter/targets")
@@ -37,6 +50,17 @@ def demeter(pid: int = -1):
         "throttle_pulse_period_ms",
         "rtree_split_thresh",
         "rtree_exch_thresh",
+        "trace_records",
+        "file_tiering",
+        "fast_free_permyriad",
+        "demotion_young_check",
+        "pgtable_fast",
+        "store_hot_permille",
+        "exch_rate_mibps",
+        "exch_global_rate_mibps",
+        "thp_collapse_fast",
+        "worker_cgroup",
+        "worker_cpu_permyriad",
     ]:
         exec(f"""if {modarg} := os.getenv("{modarg}", None):
             {modarg} = int({modarg})
@@ -47,17 +71,28 @@ def demeter(pid: int = -1):
         (sysfs / "mm" / "numa" / "demotion_enabled").write_text("0")
         print(modprobe, file=sys.stderr)
         run(modprobe)
-        (targets / "nr_targets").write_text("3")
-        (targets / "0" / "pid").write_text(str(pid))
+        (targets / "nr_targets").write_text(str(max(3, len(pids))))
+        for i, pid in enumerate(pids):
+            (targets / str(i) / "pid").write_text(str(pid))
         yield
     finally:
-        (targets / "0" / "pid").write_text("-1")
+        for i in range(len(pids)):
+            # the trace goes with the target, replay it with bin/demeter-sim
+            if os.getenv("trace_records", None):
+                try:
+                    with open(targets / str(i) / "trace", "rb") as src:
+                        out = out_dir(i, len(pids)) / "trace.bin"
+                        with open(out, "wb") as dst:
+                            shutil.copyfileobj(src, dst, 1 << 20)
+                except OSError as e:
+                    print(f"trace of target {i} not dumped: {e}", file=sys.stderr)
+            (targets / str(i) / "pid").write_text("-1")
 
 
 class Syscall(Enum):
     @staticmethod
     def build(nr, *argtypes):
-        fn = ctypes.CDLL(None).syscall
+        fn = ctypes.CDLL(None, use_errno=True).syscall
         fn.argtypes = [ctypes.c_long, *argtypes]
         fn.restype = ctypes.c_long
         return partial(fn, nr)
@@ -67,10 +102,187 @@ class Syscall(Enum):
 
     htmm_start = build(449, ctypes.c_int, ctypes.c_int)
     htmm_end = build(450, ctypes.c_int)
+    # pid, va_start, va_end, chunk_size, nr_nodes, counts (demeter)
+    node_residency = build(
+        507,
+        ctypes.c_int,
+        ctypes.c_uint64,
+        ctypes.c_uint64,
+        ctypes.c_uint64,
+        ctypes.c_int,
+        ctypes.POINTER(ctypes.c_uint64),
+    )
+
+
+def node_list(path: Path) -> list[int]:
+    nodes = []
+    for r in path.read_text().strip().split(","):
+        first, _, last = r.partition("-")
+        nodes += range(int(first), int(last or first) + 1)
+    return nodes
+
+
+def node_residency(pid: int, start: int, end: int, chunk: int, nr_nodes: int):
+    """Resident pages of [start, end) of pid per chunk per node."""
+    nr_chunks = (end - start + chunk - 1) // chunk
+    counts = (ctypes.c_uint64 * (nr_chunks * nr_nodes))()
+    if Syscall.node_residency(pid, start, end, chunk, nr_nodes, counts) != 0:
+        err = ctypes.get_errno()
+        raise OSError(err, os.strerror(err))
+    return [counts[c * nr_nodes : (c + 1) * nr_nodes] for c in range(nr_chunks)]
+
+
+@contextmanager
+def residency(pid: int, out=Path("/out")):
+    """Log the DRAM portion of every GiB of the anonymous mappings of pid every
+    residency_ms, from the page tables rather than /proc/pid/pagemap."""
+    if not (period := os.getenv("residency_ms", None)):
+        yield
+        return
+    page_size, gib = os.sysconf("SC_PAGE_SIZE"), 1 << 30
+    nodes = Path("/sys/devices/system/node")
+    nr_nodes = node_list(nodes / "possible")[-1] + 1
+    dram = node_list(nodes / "has_memory")[0]
+    stop = threading.Event()
+
+    def sample(log):
+        while not stop.wait(int(period) / 1000):
+            ratios = []
+            try:
+                maps = (Path("/proc") / str(pid) / "maps").read_text().splitlines()
+                for line in maps:
+                    addrs, perms, _, _, inode, *_ = line.split()
+                    start, end = (int(a, 16) for a in addrs.split("-"))
+                    if perms[:2] != "rw" or perms[3] != "p" or inode != "0":
+                        continue
+                    for c, counts in enumerate(
+                        node_residency(pid, start, end, gib, nr_nodes)
+                    ):
+                        size = min(gib, end - start - c * gib)
+                        ratios.append(counts[dram] / (size // page_size))
+            except (FileNotFoundError, ProcessLookupError):
+                break
+            except OSError as e:
+                print(f"node_residency: {e}", file=sys.stderr)
+                break
+            print(f"dram portion per gb: {ratios}", file=log, flush=True)
+
+    with open(out / "residency.log", "w") as log:
+        t = threading.Thread(target=sample, args=(log,), daemon=True)
+        t.start()
+        try:
+            yield
+        finally:
+            stop.set()
+            t.join()
+
+
+def vmstat() -> dict[str, int]:
+    lines = Path("/proc/vmstat").read_text().splitlines()
+    return {name: int(value) for name, value in map(str.split, lines)}
+
+
+def proc_stat(pid: int) -> dict[str, float]:
+    # the fields after the command, which may contain spaces
+    stat = (Path("/proc") / str(pid) / "stat").read_text()
+    stat = stat.rpartition(")")[2].split()
+    ticks, page_size = os.sysconf("SC_CLK_TCK"), os.sysconf("SC_PAGE_SIZE")
+    return dict(
+        cpu=(int(stat[11]) + int(stat[12])) / ticks,
+        rss=int(stat[21]) * page_size,
+    )
 
 
 @contextmanager
-def memtis(pid: int = -1):
+def telemetry(pid: int, out=Path("/out")):
+    """Stream the vmstat counters that changed and the CPU time and RSS of pid
+    every telemetry_ms to telemetry.jsonl, one compact JSON object per line, so
+    the host can follow a run without scanning the logs afterwards."""
+    if not (period := os.getenv("telemetry_ms", None)):
+        yield
+        return
+    stop = threading.Event()
+
+    def sample(log):
+        start, last = time.monotonic(), vmstat()
+        # the wall clock lines the records up with the host and the logs
+        header = dict(t=0.0, wall=time.time(), period_ms=int(period), pid=pid)
+        header["vmstat"] = last
+        print(json.dumps(header, separators=(",", ":")), file=log, flush=True)
+        while not stop.wait(int(period) / 1000):
+            try:
+                record = dict(t=round(time.monotonic() - start, 3), **proc_stat(pid))
+            except (FileNotFoundError, ProcessLookupError):
+                break
+            now = vmstat()
+            record["vmstat"] = {
+                k: v - last.get(k, 0) for k, v in now.items() if v != last.get(k)
+            }
+            last = now
+            print(json.dumps(record, separators=(",", ":")), file=log, flush=True)
+
+    with open(out / "telemetry.jsonl", "w") as log:
+        t = threading.Thread(target=sample, args=(log,), daemon=True)
+        t.start()
+        try:
+            yield
+        finally:
+            stop.set()
+            t.join()
+
+
+def demeter_stats(target: Path) -> dict:
+    """The stats of a demeter target, and the time accounted on each cpu"""
+    stats = {}
+    for name, *values in map(str.split, (target / "stats").read_text().splitlines()):
+        # histograms have a value per bucket
+        stats[name] = int(values[0]) if len(values) == 1 else list(map(int, values))
+    header, *rows = (target / "cpu_stats").read_text().splitlines()
+    names = header.split()[1:]
+    cpus = {
+        cpu: dict(zip(names, map(int, ns))) for cpu, *ns in map(str.split, rows)
+    }
+    return dict(stats=stats, cpu_stats=cpus)
+
+
+@contextmanager
+def overhead(pid: int, out=Path("/out"), index: int = 0):
+    """Stream the stats of the demeter target every overhead_ms to overhead.jsonl,
+    the cpu time of its parts overall and per cpu, up to just before it is
+    dropped, instead of only the permyriad it prints to dmesg then."""
+    target = Path("/sys/kernel/mm/demeter/targets") / str(index)
+    if not (period := os.getenv("overhead_ms", None)) or not target.exists():
+        yield
+        return
+    stop = threading.Event()
+
+    def sample(log):
+        start = time.monotonic()
+        while True:
+            stopping = stop.wait(int(period) / 1000)
+            try:
+                t = round(time.monotonic() - start, 3)
+                record = dict(t=t, **demeter_stats(target))
+            except OSError:
+                # not started yet, or already gone
+                record = None
+            if record:
+                print(json.dumps(record, separators=(",", ":")), file=log, flush=True)
+            if stopping:
+                break
+
+    with open(out / "overhead.jsonl", "w") as log:
+        t = threading.Thread(target=sample, args=(log,), daemon=True)
+        t.start()
+        try:
+            yield
+        finally:
+            stop.set()
+            t.join()
+
+
+@contextmanager
+def memtis(*pids: int):
     """Enable HTMM globally by default."""
     procfs = Path("/proc/sys")
     sysfs = Path("/sys/kernel")
@@ -105,14 +317,16 @@ def memtis(pid: int = -1):
         (sysfs / "mm" / "numa" / "demotion_enabled").write_text("0")
         for key, value in modargs.items():
             (sysfs / "mm" / "htmm" / key).write_text(str(value))
-        Syscall.htmm_start(pid, 0)
+        for pid in pids:
+            Syscall.htmm_start(pid, 0)
         yield
     finally:
-        Syscall.htmm_end(pid)
+        for pid in pids:
+            Syscall.htmm_end(pid)
 
 
 @contextmanager
-def nomad(pid: int = -1):
+def nomad(*pids: int):
     procfs = Path("/proc/sys")
     sysfs = Path("/sys/kernel")
     debugfs = sysfs / "debug"
@@ -135,7 +349,7 @@ def nomad(pid: int = -1):
 
 
 @contextmanager
-def tpp(pid: int = -1):
+def tpp(*pids: int):
     procfs = Path("/proc/sys")
     sysfs = Path("/sys/kernel")
     debugfs = sysfs / "debug"
@@ -191,22 +405,55 @@ def trace():
             pass
 
 
-def parent(ctxfn, child: int):
+def parent(ctxfn, children: list[int]):
     parent = os.getpid()
-    err = -1
-    with ctxfn(child), trace():
-        print(f"{parent=} {child=}")
+    errs = [-1] * len(children)
+    # overhead() samples the target one last time before ctxfn() drops it
+    with ExitStack() as stack:
+        stack.enter_context(ctxfn(*children))
+        stack.enter_context(trace())
+        for i, child in enumerate(children):
+            out = out_dir(i, len(children))
+            out.mkdir(parents=True, exist_ok=True)
+            stack.enter_context(residency(child, out))
+            stack.enter_context(telemetry(child, out))
+            stack.enter_context(overhead(child, out, i))
+        print(f"{parent=} {children=}")
         try:
-            pid, status = os.waitpid(child, 0)
-            err = os.waitstatus_to_exitcode(status)
+            for i, child in enumerate(children):
+                _, status = os.waitpid(child, 0)
+                errs[i] = os.waitstatus_to_exitcode(status)
         except KeyboardInterrupt:
-            os.kill(child, SIGINT)
-    sys.exit(err)
+            for child in children:
+                os.kill(child, SIGINT)
+    if len(children) > 1:
+        print(f"exit codes {errs}")
+    sys.exit(next((err for err in errs if err), 0))
+
+
+def child(args: list[str], out: Path | None = None):
+    """Exec args, with its output in out if it runs beside others"""
+    if out:
+        out.mkdir(parents=True, exist_ok=True)
+        stem = (out / Path(args[0]).name).with_suffix("")
+        for fd, suffix in [(1, ".log"), (2, ".err")]:
+            f = os.open(stem.with_suffix(suffix), os.O_WRONLY | os.O_CREAT | os.O_TRUNC)
+            os.dup2(f, fd)
+            os.close(f)
+        os.environ["NO_COLOR"] = "1"
+    print(f"execvp({args=})", flush=True)
+    os.execvp(args[0], args)
 
 
-def child(file, *args):
-    print(f"execvp({file=}, {args=}")
-    os.execvp(file, args)
+def split(args: list[str]) -> list[list[str]]:
+    """The commands of args separated by SEPARATOR"""
+    commands = [[]]
+    for arg in args:
+        if arg == SEPARATOR:
+            commands.append([])
+        else:
+            commands[-1].append(arg)
+    return [c for c in commands if c]
 
 
 @contextmanager
@@ -231,7 +478,9 @@ def prog2ctx(prog):
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(
-        description="Launch a program with tiered memory support enabled."
+        description="Launch a program with tiered memory support enabled.",
+        epilog=f"Several programs separated by {SEPARATOR} run side by side, as a "
+        "target each, with their logs in /out/target<i>.",
     )
     parser.add_argument("CHILD", nargs=argparse.REMAINDER)
     args = parser.parse_args()
@@ -241,8 +490,13 @@ if __name__ == "__main__":
         child_args = args.CHILD
         if child_args and child_args[0] == "--":
             child_args.pop(0)
-        if not child_args:
+        commands = split(child_args)
+        if not commands:
             parser.print_help()
             sys.exit(EINVAL)
-        pid = os.fork()
-        parent(ctxfn, pid) if pid > 0 else child(child_args[0], *child_args)
+        children = []
+        for i, command in enumerate(commands):
+            if (pid := os.fork()) == 0:
+                child(command, out_dir(i, len(commands)) if len(commands) > 1 else None)
+            children.append(pid)
+        parent(ctxfn, children)
@@ -0,0 +1 @@
+launcher.py
\ No newline at end of file
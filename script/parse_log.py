@@ -3,6 +3,7 @@ import json
 import logging
 import re
 from dataclasses import InitVar, asdict, dataclass, field
+from functools import lru_cache
 from pathlib import Path
 from typing import Any, Callable, Dict, List
 
@@ -24,6 +25,12 @@ TRANSFORM = jq.compile("""
 """)
 
 
+@lru_cache(maxsize=16)
+def read_text(file: Path) -> str:
+    """Most files are matched by many metrics, read each of them once."""
+    return file.read_text()
+
+
 @dataclass
 class Metric:
     key: str
@@ -43,7 +50,7 @@ class RegexMetric(Metric):
             return
         pattern = re.compile(regex)
         try:
-            if m := pattern.search(file.read_text()):
+            if m := pattern.search(read_text(file)):
                 self.value = m.group(self.key)
         except OSError as e:
             LOGGER.error(e)
@@ -61,12 +68,30 @@ class FnRegexMetric(RegexMetric):
             return
         pattern = re.compile(regex)
         try:
-            if m := pattern.search(file.read_text()):
+            if m := pattern.search(read_text(file)):
                 self.value = fn(m.groupdict())
         except OSError as e:
             LOGGER.error(e)
 
 
+@dataclass
+class JsonLinesMetric(Metric):
+    """Collects every line of the file that matches regex, parsed as JSON, in a list."""
+
+    file: InitVar[Path]
+    regex: InitVar[str]
+
+    def __post_init__(self, file, regex):
+        if not file.exists():
+            return
+        pattern = re.compile(regex, re.MULTILINE)
+        try:
+            if lines := pattern.findall(read_text(file)):
+                self.value = [json.loads(line) for line in lines]
+        except (OSError, json.JSONDecodeError) as e:
+            LOGGER.error(e)
+
+
 @dataclass
 class ElapsedMetric(FnRegexMetric):
     regex: InitVar[str] = (
@@ -193,6 +218,12 @@ class VmMetrics:
             ElapsedMetric(key="xsbench", value=None, file=self.vmid / "xsbench.err"),
             ElapsedMetric(key="graph500", value=None, file=self.vmid / "graph500.err"),
             ElapsedMetric(key="pagerank", value=None, file=self.vmid / "pagerank.err"),
+            JsonLinesMetric(
+                key="pagerank_trials",
+                value=None,
+                file=self.vmid / "pagerank.log",
+                regex=r"^\{\"trial\": .*\}$",
+            ),
             ElapsedMetric(
                 key="liblinear", value=None, file=self.vmid / "liblinear.err"
             ),
@@ -205,6 +236,18 @@ class VmMetrics:
                 file=self.vmid / "cloud-hypervisor.stdout",
                 regex=r"total runtime: (?P<memtis_runtime>\d+) ns, total cputime: (?P<memtis_cputime>\d+) us, cpu usage: (?P<memtis_cpu_usage>\d+)",
             ),
+            RegexMetric(
+                key="gups_latency_mean",
+                value=None,
+                file=self.vmid / "gups.log",
+                regex=rf"iteration (?P<label>last) latency ns mean (?P<gups_latency_mean>{FLOAT}) p50 {FLOAT} p90 {FLOAT} p99 (?P<gups_latency_p99>{FLOAT})",
+            ),
+            RegexMetric(
+                key="gups_latency_p99",
+                value=None,
+                file=self.vmid / "gups.log",
+                regex=rf"iteration (?P<label>last) latency ns mean (?P<gups_latency_mean>{FLOAT}) p50 {FLOAT} p90 {FLOAT} p99 (?P<gups_latency_p99>{FLOAT})",
+            ),
             RegexMetric(
                 key="dram_ratio_first_gib",
                 value=None,
@@ -467,6 +510,115 @@ def parse_log(start=0, stop=None, dir=Path("bench/archive")):
     return pd.json_normalize(data)
 
 
+def read_telemetry(vmid: Path) -> pd.DataFrame:
+    """The samples of telemetry.jsonl streamed by the launcher, one row per
+    sample, with the vmstat deltas as vmstat.<counter> columns."""
+    file = Path(vmid) / "telemetry.jsonl"
+    if not file.exists():
+        return pd.DataFrame()
+    with open(file) as f:
+        # the first line holds the absolute counters at the start
+        samples = [json.loads(line) for line in f][1:]
+    data = pd.json_normalize(samples)
+    deltas = [c for c in data.columns if c.startswith("vmstat.")]
+    data[deltas] = data[deltas].fillna(0)
+    return data
+
+
+def parse_telemetry(start=0, stop=None, dir=Path("bench/archive")):
+    """The telemetry of every VM of the runs selected as by parse_log()."""
+    newest = sorted(filter(Path.is_dir, Path(dir).iterdir()), key=lambda x: x.name)[
+        start:stop
+    ]
+    data = []
+    for folder in newest:
+        vmids = filter(lambda p: p.is_dir() and p.name.isdigit(), folder.iterdir())
+        for vmid in vmids:
+            samples = read_telemetry(vmid)
+            samples.insert(0, "vmid", vmid.name)
+            samples.insert(0, "runid", folder.name)
+            data.append(samples)
+    return pd.concat(data, ignore_index=True) if data else pd.DataFrame()
+
+
+# The parts of the demeter target whose cpu time is accounted, see target_drop()
+OVERHEAD_PARTS = [
+    "overflow_handler",
+    "throttle",
+    "policy",
+    "migration",
+    "perf_prepare",
+    "split",
+]
+
+
+def read_overhead(vmid: Path) -> pd.DataFrame:
+    """The last stats of the demeter target in overhead.jsonl: the cpu time of
+    each part as permyriad of the wall time, in total (cpu "all") and per cpu,
+    and the bytes exchanged per cpu-second the target spent."""
+    file = Path(vmid) / "overhead.jsonl"
+    if not file.exists() or not (lines := file.read_text().splitlines()):
+        return pd.DataFrame()
+    last = json.loads(lines[-1])
+    stats, elapsed = last["stats"], last["stats"]["elapsed_ns"] + 1
+    cpus = sorted(last["cpu_stats"].items(), key=lambda kv: int(kv[0]))
+    data = pd.DataFrame(
+        dict(cpu=cpu, part=part, ns=ns.get(f"{part}_ns", 0))
+        for cpu, ns in [("all", stats), *cpus]
+        for part in OVERHEAD_PARTS
+    )
+    data["permyriad"] = data["ns"] * 10000 / elapsed
+    cpu_seconds = sum(stats.get(f"{part}_ns", 0) for part in OVERHEAD_PARTS) / 1e9
+    data["exchanged_bytes"] = stats.get("exchanged_bytes", 0)
+    data["exchanged_bytes_per_cpu_second"] = (
+        data["exchanged_bytes"] / cpu_seconds if cpu_seconds else float("nan")
+    )
+    return data
+
+
+def parse_overhead(start=0, stop=None, dir=Path("bench/archive")):
+    """The overhead of every VM of the runs selected as by parse_log()."""
+    newest = sorted(filter(Path.is_dir, Path(dir).iterdir()), key=lambda x: x.name)[
+        start:stop
+    ]
+    data = []
+    for folder in newest:
+        vmids = filter(lambda p: p.is_dir() and p.name.isdigit(), folder.iterdir())
+        for vmid in vmids:
+            overhead = read_overhead(vmid)
+            overhead.insert(0, "vmid", vmid.name)
+            overhead.insert(0, "runid", folder.name)
+            data.append(overhead)
+    return pd.concat(data, ignore_index=True) if data else pd.DataFrame()
+
+
+def read_timeline(run: Path) -> pd.DataFrame:
+    """The records of timeline.jsonl written by the host during a run, one row
+    per record on the host monotonic clock, with the vmstat deltas as
+    vmstat.<counter> columns."""
+    file = Path(run) / "timeline.jsonl"
+    if not file.exists():
+        return pd.DataFrame()
+    with open(file) as f:
+        data = pd.json_normalize([json.loads(line) for line in f])
+    deltas = [c for c in data.columns if c.startswith("vmstat.")]
+    data[deltas] = data[deltas].fillna(0)
+    return data
+
+
+def parse_timeline(start=0, stop=None, dir=Path("bench/archive")):
+    """The timeline of every run selected as by parse_log()."""
+    newest = sorted(filter(Path.is_dir, Path(dir).iterdir()), key=lambda x: x.name)[
+        start:stop
+    ]
+    data = []
+    for folder in newest:
+        records = read_timeline(folder)
+        records.insert(0, "runid", folder.name)
+        data.append(records)
+    return pd.concat(data, ignore_index=True) if data else pd.DataFrame()
+
+
 def main(**kwargs):
     data = parse_log(**kwargs)
     print(data.to_csv())
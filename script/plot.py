@@ -4,7 +4,7 @@ import fire
 from pathlib import Path
 
 
-from parse_log import parse_log
+from parse_log import parse_log, parse_overhead, parse_telemetry, parse_timeline
 from altair_theme import jlhu_theme, COLUMN_WIDTH, DEFAULT_HEIGHT
 
 
@@ -152,7 +152,143 @@ def plot(
     return chart
 
 
-def main(**kwargs):
+def plot_telemetry(data, counters):
+    """Rate of the given vmstat counters over the run, as streamed by each VM."""
+    columns = [f"vmstat.{c}" for c in counters if f"vmstat.{c}" in data.columns]
+    dt = data.groupby(["runid", "vmid"])["t"].diff().fillna(data["t"])
+    rates = data[["runid", "vmid", "t"]].copy()
+    for column in columns:
+        rates[column.removeprefix("vmstat.")] = data[column] / dt
+    rates = rates.melt(["runid", "vmid", "t"], var_name="counter", value_name="rate")
+    chart = (
+        alt.Chart(rates)
+        .mark_line()
+        .encode(
+            x=alt.X("t:Q").title("Time (s)"),
+            y=alt.Y("rate:Q").title("Per Second"),
+            color=alt.Color("vmid:N").title("VM"),
+            strokeDash=alt.StrokeDash("runid:N").legend(None),
+        )
+        .properties(width=COLUMN_WIDTH, height=DEFAULT_HEIGHT * 0.5)
+        .facet(row=alt.Row("counter:N").title(None))
+        .resolve_scale(y="independent")
+    )
+    return chart
+
+
+def plot_timeline(data, counters, bandwidth=r"^SKT\d+\.Mem (Read|Write)"):
+    """Host memory bandwidth and guest vmstat rates on the host clock, with a
+    rule at every balloon resize, to attribute bandwidth spikes to actions."""
+    pcm = data[data["source"] == "pcm"]
+    columns = pcm.columns[pcm.columns.str.contains(bandwidth)]
+    pcm = pcm.melt(["runid", "t"], columns, var_name="series", value_name="value")
+
+    vmstat = data[data["source"] == "vmstat"]
+    dt = vmstat.groupby(["runid", "vm"])["guest_t"].diff().fillna(vmstat["guest_t"])
+    rates = vmstat[["runid", "t"]].copy()
+    columns = [f"vmstat.{c}" for c in counters if f"vmstat.{c}" in vmstat.columns]
+    for column in columns:
+        rates[column.removeprefix("vmstat.")] = vmstat[column] / dt
+    rates["vm"] = vmstat["vm"].astype(int).astype(str)
+    rates = rates.melt(["runid", "t", "vm"], var_name="counter", value_name="value")
+    rates["series"] = "VM " + rates["vm"] + " " + rates["counter"]
+
+    resizes = pd.DataFrame(columns=["runid", "t", "vm"])
+    if "resizes" in data.columns:
+        balloon = data[data["source"] == "balloon"]
+        resized = balloon.groupby(["runid", "vm"])["resizes"].diff().fillna(0) > 0
+        resizes = balloon[resized][["runid", "t", "vm"]]
+
+    def panel(values, title):
+        lines = (
+            alt.Chart(values)
+            .mark_line()
+            .encode(
+                x=alt.X("t:Q").title("Time (s)"),
+                y=alt.Y("value:Q").title(title),
+                color=alt.Color("series:N").title(None),
+                strokeDash=alt.StrokeDash("runid:N").legend(None),
+            )
+        )
+        rules = (
+            alt.Chart(resizes)
+            .mark_rule(strokeDash=[2, 2], opacity=0.5)
+            .encode(x="t:Q", tooltip=["vm:N"])
+        )
+        return (lines + rules).properties(
+            width=COLUMN_WIDTH, height=DEFAULT_HEIGHT * 0.5
+        )
+
+    return alt.vconcat(
+        panel(pcm, "Bandwidth (MB/s)"), panel(rates, "Per Second")
+    ).resolve_scale(color="independent")
+
+
+def overhead_report(data):
+    """One row per VM: the permyriad of the wall time of each part of the target,
+    their total, the busiest cpu and the bytes exchanged per cpu-second."""
+    vms = ["runid", "vmid"]
+    report = data[data["cpu"] == "all"].pivot_table(
+        index=vms, columns="part", values="permyriad"
+    )
+    report["total"] = report.sum(axis=1)
+    percpu = data[data["cpu"] != "all"]
+    report["busiest_cpu"] = (
+        percpu.groupby([*vms, "cpu"])["permyriad"].sum().groupby(vms).max()
+    )
+    report["exchanged_bytes_per_cpu_second"] = data.groupby(vms)[
+        "exchanged_bytes_per_cpu_second"
+    ].first()
+    return report
+
+
+def plot_overhead(data):
+    """The cpu time of the parts of the target, per VM and per cpu."""
+    data = data.assign(vm=data["runid"] + "/" + data["vmid"])
+    total = (
+        alt.Chart(data[data["cpu"] == "all"])
+        .mark_bar()
+        .encode(
+            x=alt.X("vm:N").title(None),
+            y=alt.Y("sum(permyriad):Q").title("Overhead (permyriad)"),
+            color=alt.Color("part:N").title(None),
+        )
+        .properties(width=COLUMN_WIDTH, height=DEFAULT_HEIGHT * 0.5)
+    )
+    percpu = (
+        alt.Chart(data[data["cpu"] != "all"])
+        .mark_bar()
+        .encode(
+            x=alt.X("cpu:O").title("CPU"),
+            y=alt.Y("sum(permyriad):Q").title("Overhead (permyriad)"),
+            color=alt.Color("part:N").title(None),
+        )
+        .properties(width=COLUMN_WIDTH, height=DEFAULT_HEIGHT * 0.5)
+        .facet(row=alt.Row("vm:N").title(None))
+    )
+    return alt.vconcat(total, percpu)
+
+
+def main(
+    telemetry=None,
+    timeline=None,
+    overhead=None,
+    counters=("pebs_nr_sampled", "folio_exchange_success", "folio_exchange_failed"),
+    **kwargs,
+):
+    if overhead:
+        data = parse_overhead(dir=overhead)
+        print(overhead_report(data).to_csv())
+        plot_overhead(data).save("overhead.svg")
+        return
+    if timeline:
+        data = parse_timeline(dir=timeline)
+        plot_timeline(data, counters).save("timeline.svg")
+        return
+    if telemetry:
+        data = parse_telemetry(dir=telemetry)
+        plot_telemetry(data, counters).save("telemetry.svg")
+        return
     data = preprocess(**kwargs)
     chart = plot(data)
     chart.save("chart.svg")
@@ -88,8 +88,10 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <sched.h>
 #include <sys/time.h>
 #include <string.h>
+#include <math.h>
 
 #ifdef _OPENMP
 #    include <omp.h>
@@ -98,7 +100,7 @@
 // Minimum order is necessarily 3.  We set the maximum
 // order arbitrarily.  You may change the maximum order.
 #define MIN_ORDER 3
-#define MAX_ORDER 20
+#define MAX_ORDER 256
 
 // Constant for optional command-line input with "i" command.
 #define BUFFER_SIZE 256
@@ -122,7 +124,7 @@ static inline void *allocate(size_t size, size_t alignment)
         exit(1);
     }
 
-    allocator_stat += size;
+    __atomic_fetch_add(&allocator_stat, size, __ATOMIC_RELAXED);
 
     memset(memptr, 0, size);
     return memptr;
@@ -138,7 +140,7 @@ static inline void *allocate_align64(size_t size)
         exit(1);
     }
 
-    allocator_stat += size;
+    __atomic_fetch_add(&allocator_stat, size, __ATOMIC_RELAXED);
 
     memset(memptr, 0, size);
     return memptr;
@@ -209,6 +211,7 @@ typedef struct node
     uint64_t num_keys;
     uint64_t stats;
     struct node *next;  // Used for queue.
+    uint64_t version;   // Odd while locked, see the optimistic lock coupling.
 } node;
 
 
@@ -279,6 +282,10 @@ node *insert_into_new_root(node *left, uint64_t key, node *right);
 node *start_new_tree(uint64_t key, record *pointer);
 node *insert(node *root, uint64_t key, uint64_t value);
 
+// Bulk loading.
+
+node *bulk_load(const void *elements, size_t element_size, size_t n);
+
 // Deletion.
 
 uint64_t get_neighbor_index(node *n);
@@ -290,6 +297,12 @@ node *redistribute_nodes(node *root, node *n, node *neighbor, uint64_t neighbor_
 node *delete_entry(node *root, node *n, uint64_t key, void *pointer);
 node *delete (node *root, uint64_t key);
 
+// Concurrent access.
+
+record *find_olc(node **rootp, uint64_t key);
+void insert_olc(node **rootp, uint64_t key, uint64_t value);
+bool delete_olc(node **rootp, uint64_t key);
+
 
 // FUNCTION DEFINITIONS.
 
@@ -545,7 +558,7 @@ void find_and_print_range(node *const root, uint64_t key_start, uint64_t key_end
 /* Finds keys and their pointers, if present, in the range specified
  * by key_start and key_end, inclusive.  Places these in the arrays
  * returned_keys and returned_pointers, and returns the number of
- * entries found.
+ * entries found.  Only the leaves overlapping the range are visited.
  */
 uint64_t find_range(node *const root, uint64_t key_start, uint64_t key_end, bool verbose,
                     uint64_t returned_keys[], void *returned_pointers[])
@@ -557,14 +570,16 @@ uint64_t find_range(node *const root, uint64_t key_start, uint64_t key_end, bool
         return 0;
     for (i = 0; i < n->num_keys && n->keys[i] < key_start; i++)
         ;
-    if (i == n->num_keys)
-        return 0;
+    /* the range may start past the last key of the leaf, then the next
+     * leaf holds its first key */
     while (n != NULL) {
         for (; i < n->num_keys && n->keys[i] <= key_end; i++) {
             returned_keys[num_found] = n->keys[i];
             returned_pointers[num_found] = n->pointers[i];
             num_found++;
         }
+        if (i < n->num_keys)
+            break;
         n = n->pointers[order - 1];
         i = 0;
     }
@@ -664,9 +679,12 @@ uint64_t cut(uint64_t length)
 // INSERTION
 
 
+/* The free lists are per thread, so the threads of the concurrent mode
+ * allocate from slabs of their own.
+ */
 #define NODE_SLAB_GROW (1 << 20)
 
-struct node *free_nodes = NULL;
+__thread struct node *free_nodes = NULL;
 
 node *alloc_node()
 {
@@ -698,7 +716,7 @@ void free_node(node *n)
 
 #define RECORD_SLAB_GROW (1 << 20)
 
-struct record *free_recs = NULL;
+__thread struct record *free_recs = NULL;
 
 record *alloc_record()
 {
@@ -770,6 +788,7 @@ node *make_node(void)
     new_node->num_keys = 0;
     new_node->parent = NULL;
     new_node->next = NULL;
+    new_node->version = 0;
     return new_node;
 }
 
@@ -1129,6 +1148,129 @@ node *insert(node *root, uint64_t key, uint64_t value)
 }
 
 
+// BULK LOADING.
+
+/* Allocates an arena of size bytes, aligned to a huge page and not touched,
+ * so that the threads filling it also place it.
+ */
+static void *allocate_arena(size_t size)
+{
+    void *memptr;
+    if (posix_memalign(&memptr, ALIGNMET, size)) {
+        printf("ENOMEM\n");
+        exit(1);
+    }
+    allocator_stat += size;
+    return memptr;
+}
+
+/* Bytes of a node with its keys and pointers inline, in whole cache lines.
+ */
+static size_t arena_node_size(void)
+{
+    size_t size = sizeof(node) + (order - 1) * sizeof(uint64_t) + order * sizeof(void *);
+    return (size + CONFIG_CACHELINE_SIZE - 1) & ~(size_t)(CONFIG_CACHELINE_SIZE - 1);
+}
+
+/* Lays out the i-th node of a level arena, keys and pointers follow the
+ * node itself.
+ */
+static node *arena_node(char *arena, size_t i, bool is_leaf)
+{
+    node *n = (node *)(arena + i * arena_node_size());
+    n->keys = (uint64_t *)(n + 1);
+    n->pointers = (void **)(n->keys + (order - 1));
+    n->parent = NULL;
+    n->is_leaf = is_leaf;
+    n->num_keys = 0;
+    n->stats = 0;
+    n->next = NULL;
+    n->version = 0;
+    return n;
+}
+
+/* Builds a tree bottom-up from an array of n elements of element_size bytes
+ * each, keyed by their first quad word (sorted in increasing order, without
+ * duplicates), with the address of each element as its value. Each level is built in parallel into its
+ * own arena, from the leaves up, so the nodes of a level are contiguous and
+ * all inner levels take a few pages. The entries are spread evenly over the
+ * nodes of each level, so they are all (nearly) full. The records are also
+ * allocated in one arena, in key order.
+ *
+ * The tree can be searched and inserted into as usual, but its nodes are not
+ * individually allocated, so it must not be destroyed or deleted from.
+ */
+#define ELEMENT_KEY(i) (*(const uint64_t *)((const char *)elements + (i) * element_size))
+
+node *bulk_load(const void *elements, size_t element_size, size_t n)
+{
+    if (n == 0)
+        return NULL;
+
+    record *records = allocate_arena(n * sizeof(record));
+#ifdef _OPENMP
+#    pragma omp parallel for
+#endif
+    for (size_t i = 0; i < n; i++) {
+        records[i].value = (uint64_t)elements + i * element_size;
+        records[i].next = NULL;
+        records[i].flags = 0;
+        records[i].stats = 0;
+    }
+
+    /* leaves, linked in key order through their last pointer */
+    size_t count = (n + order - 2) / (order - 1);
+    char *level = allocate_arena(count * arena_node_size());
+    /* the smallest key below each node of the current level */
+    uint64_t *mins = malloc(count * sizeof(uint64_t));
+#ifdef _OPENMP
+#    pragma omp parallel for
+#endif
+    for (size_t l = 0; l < count; l++) {
+        node *leaf = arena_node(level, l, true);
+        size_t first = n * l / count, last = n * (l + 1) / count;
+        for (size_t i = first; i < last; i++) {
+            leaf->keys[i - first] = ELEMENT_KEY(i);
+            leaf->pointers[i - first] = &records[i];
+        }
+        leaf->num_keys = last - first;
+        leaf->pointers[order - 1] =
+            l + 1 < count ? (void *)(level + (l + 1) * arena_node_size()) : NULL;
+        mins[l] = ELEMENT_KEY(first);
+    }
+
+    /* inner levels, one key less than children, until a single root */
+    while (count > 1) {
+        size_t parents = (count + order - 1) / order;
+        char *up = allocate_arena(parents * arena_node_size());
+        uint64_t *up_mins = malloc(parents * sizeof(uint64_t));
+#ifdef _OPENMP
+#    pragma omp parallel for
+#endif
+        for (size_t p = 0; p < parents; p++) {
+            node *parent = arena_node(up, p, false);
+            size_t first = count * p / parents, last = count * (p + 1) / parents;
+            for (size_t i = first; i < last; i++) {
+                node *child = (node *)(level + i * arena_node_size());
+                child->parent = parent;
+                parent->pointers[i - first] = child;
+                if (i > first)
+                    parent->keys[i - first - 1] = mins[i];
+            }
+            parent->num_keys = last - first - 1;
+            up_mins[p] = mins[first];
+        }
+        free(mins);
+        mins = up_mins;
+        level = up;
+        count = parents;
+    }
+    free(mins);
+
+    return (node *)level;
+}
+
+
 // DELETION.
 
 /* Utility function for deletion.  Retrieves
@@ -1511,6 +1653,257 @@ node *destroy_tree(node *root)
 }
 
 
+// CONCURRENT ACCESS
+
+/* Optimistic lock coupling (Leis et al., "The ART of Practical
+ * Synchronization", DaMoN '16) over the same nodes, so lookups, inserts and
+ * deletes can run concurrently.  Every node has a version that is odd while
+ * a writer holds it.  Readers take no locks: they read the version of a node
+ * before and after reading its keys, and start over from the root if it
+ * changed in between.  Writers upgrade the version they read to a lock, so
+ * they too restart if the node was modified since.
+ *
+ * Inserts split full nodes on the way down, so a split only needs the lock
+ * of the node and of its parent, which then has room for the separator.
+ * Deletes only remove the entry from its leaf and never merge nodes, so no
+ * node is freed while a reader may still be on it.  The records of deleted
+ * keys go back to the free list of the deleting thread, their memory stays
+ * mapped, so a reader racing with the delete at worst reads a stale value.
+ */
+
+static inline void olc_backoff(uint64_t *restarts)
+{
+    if (++*restarts % 64 == 0)
+        sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+    else
+        __builtin_ia32_pause();
+#endif
+}
+
+/* Returns the version of n, or an odd one if n is locked. */
+static inline uint64_t olc_read(node *n)
+{
+    return __atomic_load_n(&n->version, __ATOMIC_ACQUIRE);
+}
+
+/* Whether n is unchanged since its version v was read. */
+static inline bool olc_validate(node *n, uint64_t v)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&n->version, __ATOMIC_RELAXED) == v;
+}
+
+/* Locks n if it is unchanged since its version v was read. */
+static inline bool olc_upgrade(node *n, uint64_t v)
+{
+    return !(v & 1)
+           && __atomic_compare_exchange_n(&n->version, &v, v + 1, false, __ATOMIC_ACQUIRE,
+                                          __ATOMIC_RELAXED);
+}
+
+static inline void olc_unlock(node *n)
+{
+    __atomic_fetch_add(&n->version, 1, __ATOMIC_RELEASE);
+}
+
+static inline node *olc_child(node *n, uint64_t key)
+{
+    uint64_t i = 0, num_keys = n->num_keys;
+    while (i < num_keys && key >= n->keys[i])
+        i++;
+    return n->pointers[i];
+}
+
+/* Descends to the leaf that would hold key, returns it with its version in
+ * *v and its parent with the parent's version in *parent, *pv, or NULL if
+ * it must be retried.
+ */
+static node *olc_find_leaf(node **rootp, uint64_t key, uint64_t *v, node **parent,
+                           uint64_t *pv)
+{
+    node *n = __atomic_load_n(rootp, __ATOMIC_ACQUIRE);
+    *v = olc_read(n);
+    *parent = NULL;
+    if ((*v & 1) || n != __atomic_load_n(rootp, __ATOMIC_ACQUIRE))
+        return NULL;
+    while (!n->is_leaf) {
+        node *child = olc_child(n, key);
+        if (!olc_validate(n, *v))
+            return NULL;
+        uint64_t cv = olc_read(child);
+        if ((cv & 1) || !olc_validate(n, *v))
+            return NULL;
+        *parent = n;
+        *pv = *v;
+        n = child;
+        *v = cv;
+    }
+    return n;
+}
+
+record *find_olc(node **rootp, uint64_t key)
+{
+    uint64_t restarts = 0;
+    for (;; olc_backoff(&restarts)) {
+        node *leaf, *parent;
+        uint64_t v, pv;
+        if (!(leaf = olc_find_leaf(rootp, key, &v, &parent, &pv)))
+            continue;
+        record *r = NULL;
+        for (uint64_t i = 0, num_keys = leaf->num_keys; i < num_keys; i++) {
+            if (leaf->keys[i] == key) {
+                r = leaf->pointers[i];
+                break;
+            }
+        }
+        if (olc_validate(leaf, v))
+            return r;
+    }
+}
+
+/* Splits the locked full node n in two, the new right half is returned in
+ * *right and its smallest key in *sep.
+ */
+static void olc_split(node *n, uint64_t *sep, node **right)
+{
+    uint64_t i, j, split;
+    node *r;
+    if (n->is_leaf) {
+        r = make_leaf();
+        split = cut(order - 1);
+        for (i = split, j = 0; i < n->num_keys; i++, j++) {
+            r->keys[j] = n->keys[i];
+            r->pointers[j] = n->pointers[i];
+            n->pointers[i] = NULL;
+        }
+        r->num_keys = j;
+        r->pointers[order - 1] = n->pointers[order - 1];
+        n->pointers[order - 1] = r;
+        *sep = r->keys[0];
+    } else {
+        /* the separator moves up, the keys after it go right */
+        r = make_node();
+        split = n->num_keys / 2;
+        *sep = n->keys[split];
+        for (i = split + 1, j = 0; i < n->num_keys; i++, j++) {
+            r->keys[j] = n->keys[i];
+            r->pointers[j] = n->pointers[i];
+            ((node *)r->pointers[j])->parent = r;
+        }
+        r->pointers[j] = n->pointers[i];
+        ((node *)r->pointers[j])->parent = r;
+        r->num_keys = j;
+    }
+    r->parent = n->parent;
+    n->num_keys = split;
+    *right = r;
+}
+
+/* One attempt of insert_olc(), returns false if it must be retried, which
+ * it also is after splitting a node.
+ */
+static bool insert_olc_try(node **rootp, uint64_t key, uint64_t value)
+{
+    node *n = __atomic_load_n(rootp, __ATOMIC_ACQUIRE);
+    node *parent = NULL;
+    uint64_t v = olc_read(n), pv = 0;
+    if ((v & 1) || n != __atomic_load_n(rootp, __ATOMIC_ACQUIRE))
+        return false;
+
+    for (;;) {
+        if (n->num_keys == order - 1) {
+            /* split it with its parent locked, then start over */
+            if (parent && !olc_upgrade(parent, pv))
+                return false;
+            if (!olc_upgrade(n, v)) {
+                if (parent)
+                    olc_unlock(parent);
+                return false;
+            }
+            if (!parent && n != __atomic_load_n(rootp, __ATOMIC_ACQUIRE)) {
+                olc_unlock(n);
+                return false;
+            }
+            uint64_t sep;
+            node *right;
+            olc_split(n, &sep, &right);
+            if (parent)
+                insert_into_node(NULL, parent, get_left_index(parent, n), sep, right);
+            else
+                __atomic_store_n(rootp, insert_into_new_root(n, sep, right), __ATOMIC_RELEASE);
+            olc_unlock(n);
+            if (parent)
+                olc_unlock(parent);
+            return false;
+        }
+        if (parent && !olc_validate(parent, pv))
+            return false;
+        if (n->is_leaf)
+            break;
+        node *child = olc_child(n, key);
+        if (!olc_validate(n, v))
+            return false;
+        uint64_t cv = olc_read(child);
+        if ((cv & 1) || !olc_validate(n, v))
+            return false;
+        parent = n;
+        pv = v;
+        n = child;
+        v = cv;
+    }
+
+    /* the leaf has room */
+    if (!olc_upgrade(n, v))
+        return false;
+    uint64_t i = 0;
+    while (i < n->num_keys && n->keys[i] != key)
+        i++;
+    if (i < n->num_keys)
+        ((record *)n->pointers[i])->value = value;
+    else
+        insert_into_leaf(n, key, make_record(value));
+    olc_unlock(n);
+    return true;
+}
+
+void insert_olc(node **rootp, uint64_t key, uint64_t value)
+{
+    uint64_t restarts = 0;
+    while (!insert_olc_try(rootp, key, value))
+        olc_backoff(&restarts);
+}
+
+/* Removes key from its leaf, returns whether it was found. */
+bool delete_olc(node **rootp, uint64_t key)
+{
+    uint64_t restarts = 0;
+    for (;; olc_backoff(&restarts)) {
+        node *leaf, *parent;
+        uint64_t v, pv;
+        if (!(leaf = olc_find_leaf(rootp, key, &v, &parent, &pv)) || !olc_upgrade(leaf, v))
+            continue;
+        uint64_t i = 0;
+        while (i < leaf->num_keys && leaf->keys[i] != key)
+            i++;
+        if (i == leaf->num_keys) {
+            olc_unlock(leaf);
+            return false;
+        }
+        record *r = leaf->pointers[i];
+        for (i++; i < leaf->num_keys; i++) {
+            leaf->keys[i - 1] = leaf->keys[i];
+            leaf->pointers[i - 1] = leaf->pointers[i];
+        }
+        leaf->num_keys--;
+        leaf->pointers[leaf->num_keys] = NULL;
+        olc_unlock(leaf);
+        free_record(r);
+        return true;
+    }
+}
+
+
 /*
  * ================================================================================================
  * Random Number Generator
@@ -1562,6 +1955,81 @@ void myrandseed(int32_t seedval)
     SEED(X0, LOW(seedval), HIGH(seedval));
 }
 
+/* Reentrant version of myrand(), so every thread can draw from its own
+ * stream: the same 48-bit linear congruential generator (a = 0x5DEECE66D,
+ * c = 0xB), kept in one word and returning the same upper 31 bits.
+ */
+typedef struct rand_state
+{
+    uint64_t x;
+} rand_state;
+
+#define RAND_MASK ((1UL << 48) - 1)
+
+uint64_t myrand_r(rand_state *s)
+{
+    s->x = (0x5DEECE66DUL * s->x + C) & RAND_MASK;
+    return s->x >> 17;
+}
+
+/* Seeds stream `stream` of seedval, the seed is scrambled (splitmix64) so
+ * that the streams of consecutive ids are not correlated.
+ */
+void myrandseed_r(rand_state *s, int32_t seedval, uint64_t stream)
+{
+    uint64_t z = ((uint64_t)(uint32_t)seedval << 32) + (stream + 1) * 0x9E3779B97F4A7C15UL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    s->x = (z ^ (z >> 31)) & RAND_MASK;
+}
+
+/* Uniform double in [0, 1) from a stream. */
+static inline double myrand_unit_r(rand_state *s)
+{
+    return myrand_r(s) / (double)(1UL << 31);
+}
+
+
+/* Zipfian distribution over [0, n), item i drawn with probability
+ * proportional to 1 / (i + 1)^theta, for 0 < theta < 1.  This is the
+ * generator of Gray et al. ("Quickly Generating Billion-Record Synthetic
+ * Databases", SIGMOD '94), also used by YCSB: zeta(n) is computed once (in
+ * parallel), after which every draw takes one uniform number and a pow().
+ */
+typedef struct zipf
+{
+    uint64_t n;
+    double theta, alpha, zetan, eta;
+} zipf;
+
+void zipf_init(zipf *z, uint64_t n, double theta)
+{
+    double zetan = 0;
+#ifdef _OPENMP
+#    pragma omp parallel for reduction(+ : zetan)
+#endif
+    for (uint64_t i = 1; i <= n; i++)
+        zetan += 1.0 / pow((double)i, theta);
+    double zeta2 = 1.0 + pow(0.5, theta);
+    z->n = n;
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zetan = zetan;
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+}
+
+uint64_t zipf_next_r(const zipf *z, rand_state *s)
+{
+    double u = myrand_unit_r(s);
+    double uz = u * z->zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + pow(0.5, z->theta))
+        return 1;
+    uint64_t ret = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return ret < z->n ? ret : z->n - 1;
+}
+
 static void next(void)
 {
     uint64_t p[2], q[2], r[2], carry0, carry1;
@@ -1585,6 +2053,43 @@ static void next(void)
  * ================================================================================================
  */
 
+/* Distribution of the looked up keys over the key space [0, nkeys).  The
+ * skewed distributions are not scrambled: the hot keys are the lowest ones,
+ * so the hot set is a contiguous range of leaves and records.
+ */
+enum key_dist
+{
+    DIST_UNIFORM,
+    DIST_ZIPF,     ///< zipfian with skew theta
+    DIST_HOTSPOT,  ///< hot_frac of the keys take hot_prob of the lookups
+};
+
+typedef struct lookup_keys
+{
+    enum key_dist dist;
+    uint64_t nkeys;
+    zipf z;
+    double hot_frac, hot_prob;
+} lookup_keys;
+
+static inline uint64_t next_key(const lookup_keys *k, rand_state *s)
+{
+    switch (k->dist) {
+    case DIST_ZIPF:
+        return zipf_next_r(&k->z, s);
+    case DIST_HOTSPOT: {
+        uint64_t nhot = k->hot_frac * k->nkeys;
+        if (nhot == 0)
+            nhot = 1;
+        if (myrand_unit_r(s) < k->hot_prob || nhot == k->nkeys)
+            return myrand_r(s) % nhot;
+        return nhot + myrand_r(s) % (k->nkeys - nhot);
+    }
+    default:
+        return myrand_r(s) % k->nkeys;
+    }
+}
+
 int real_main(int argc, char **argv)
 {
     char *input_file;
@@ -1599,9 +2104,15 @@ int real_main(int argc, char **argv)
 
     size_t nelements = CONFIG_DEFAULT_NELEMENTS;
     size_t nlookup = CONFIG_DEFAULT_NLOOKUP;
+    bool update_stats = true;
+    bool bulk = false;
+    const char *dist = "uniform";
+    double theta = 0.99, hot_frac = 0.1, hot_prob = 0.9;
+    size_t scan_len = 0;
+    long insert_pct = 0, delete_pct = 0;
 
     int c;
-    while ((c = getopt(argc, argv, "n:l:")) != -1) {
+    while ((c = getopt(argc, argv, "n:l:rbo:d:t:f:p:s:i:e:")) != -1) {
         switch (c) {
         case 'n':
             nelements = strtol(optarg, NULL, 10);
@@ -1609,15 +2120,89 @@ int real_main(int argc, char **argv)
         case 'l':
             nlookup = strtol(optarg, NULL, 10);
             break;
-		case 'o':
-			order = strtol(optarg, NULL, 10);
-			break;
+        case 'r':
+            /* read-only lookups, without the stats counter writes */
+            update_stats = false;
+            break;
+        case 'b':
+            /* build the tree bottom-up from the sorted elements */
+            bulk = true;
+            break;
+        case 'o':
+            order = strtol(optarg, NULL, 10);
+            if (order < MIN_ORDER || order > MAX_ORDER) {
+                fprintf(stderr, "order must be between %d and %d\n", MIN_ORDER, MAX_ORDER);
+                return -1;
+            }
+            break;
+        case 'd':
+            /* key distribution: uniform, zipf or hotspot */
+            dist = optarg;
+            break;
+        case 't':
+            theta = strtod(optarg, NULL);
+            break;
+        case 'f':
+            hot_frac = strtod(optarg, NULL);
+            break;
+        case 'p':
+            hot_prob = strtod(optarg, NULL);
+            break;
+        case 's':
+            /* scan this many elements from each key instead of a lookup */
+            scan_len = strtol(optarg, NULL, 10);
+            break;
+        case 'i':
+            /* this percentage of the operations insert the key */
+            insert_pct = strtol(optarg, NULL, 10);
+            break;
+        case 'e':
+            /* this percentage of the operations delete the key */
+            delete_pct = strtol(optarg, NULL, 10);
+            break;
         default:
             printf("unknown option '%c'\n", c);
             return -1;
         }
     }
 
+    /* with any inserts or deletes all operations use the concurrent paths,
+     * on which range scans are not implemented */
+    bool mixed = insert_pct || delete_pct;
+    if (insert_pct < 0 || delete_pct < 0 || insert_pct + delete_pct > 100) {
+        fprintf(stderr, "insert and delete percentages must add up to at most 100\n");
+        return -1;
+    }
+    if (mixed && order < 4) {
+        /* a full inner node of order 3 splits into one with no keys */
+        fprintf(stderr, "inserts and deletes need an order of at least 4\n");
+        return -1;
+    }
+    if (mixed && scan_len) {
+        fprintf(stderr, "range scans cannot be mixed with inserts or deletes\n");
+        return -1;
+    }
+
+    lookup_keys keys = { .dist = DIST_UNIFORM, .nkeys = nelements * 2,
+                         .hot_frac = hot_frac, .hot_prob = hot_prob };
+    if (strcmp(dist, "zipf") == 0) {
+        if (theta <= 0 || theta >= 1) {
+            fprintf(stderr, "zipf theta must be between 0 and 1\n");
+            return -1;
+        }
+        keys.dist = DIST_ZIPF;
+        zipf_init(&keys.z, keys.nkeys, theta);
+    } else if (strcmp(dist, "hotspot") == 0) {
+        if (hot_frac <= 0 || hot_frac > 1 || hot_prob < 0 || hot_prob > 1) {
+            fprintf(stderr, "hotspot fraction and probability must be between 0 and 1\n");
+            return -1;
+        }
+        keys.dist = DIST_HOTSPOT;
+    } else if (strcmp(dist, "uniform") != 0) {
+        fprintf(stderr, "unknown key distribution '%s'\n", dist);
+        return -1;
+    }
+
     struct element
     {
         uint64_t key;
@@ -1632,28 +2217,47 @@ int real_main(int argc, char **argv)
         exit(1);
     }
 
-    /* setup the elements */
+    /* setup the elements, every CONFIG_DEFAULT_KEY_STRIDE-th key exists */
     for (size_t i = 0; i < nelements; i++) {
-        elms[i].key = 2 * CONFIG_DEFAULT_KEY_STRIDE;
+        elms[i].key = i * CONFIG_DEFAULT_KEY_STRIDE;
         elms[i].stats = 0;
         elms[i].value = 1;
     }
 
-    /* shuffle for insertions */
-    for (size_t i = nelements; i > 1; i--) {
-        size_t j = myrand() % (i + 1);
-        uint64_t tmp = elms[i].key;
-        elms[i].key = elms[j].key;
-        elms[j].key = tmp;
-    }
+    struct timeval build_start, build_end;
+    gettimeofday(&build_start, NULL);
+    if (bulk) {
+        root = bulk_load(elms, sizeof(struct element), nelements);
+    } else {
+        /* shuffle for insertions */
+        for (size_t i = nelements - 1; i > 0; i--) {
+            size_t j = myrand() % (i + 1);
+            uint64_t tmp = elms[i].key;
+            elms[i].key = elms[j].key;
+            elms[j].key = tmp;
+        }
 
-    for (size_t i = 0; i < nelements; i++) {
-        root = insert(root, elms[i].key, (uint64_t)&elms[i]);
+        for (size_t i = 0; i < nelements; i++) {
+            root = insert(root, elms[i].key, (uint64_t)&elms[i]);
+        }
     }
+    gettimeofday(&build_end, NULL);
 
     printf("BTree Elements: %zu\n", nelements);
+    printf("BTree Height: %zu\n", root ? height(root) : 0);
     printf("Btree Fanout: %zu\n", order);
+    printf("Key Distribution: %s\n", dist);
+    if (scan_len)
+        printf("Scan Length: %zu\n", scan_len);
+    if (mixed && !root) {
+        fprintf(stderr, "inserts and deletes need a non-empty tree\n");
+        return -1;
+    }
+    if (mixed)
+        printf("Mix: %ld%% inserts, %ld%% deletes\n", insert_pct, delete_pct);
     printf("Allocator: %zu MB\n", allocator_stat >> 20);
+    printf("Build: %lf seconds\n",
+           (build_end.tv_sec - build_start.tv_sec) + (build_end.tv_usec - build_start.tv_usec) / 1000000.0);
 
     fprintf(stderr, "signalling readyness to %s\n", CONFIG_SHM_FILE_NAME ".ready");
     FILE *fd2 = fopen(CONFIG_SHM_FILE_NAME ".ready", "w");
@@ -1666,23 +2270,67 @@ int real_main(int argc, char **argv)
     usleep(250);
 
 
-    uint64_t sum = 0;
+    uint64_t sum = 0, ninserts = 0, ndeletes = 0;
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
+    /* every thread draws its keys from its own stream and sums its own
+     * matches, the only shared writes left are the (optional) stats */
 #ifdef _OPENMP
-#    pragma omp parallel for
+#    pragma omp parallel reduction(+ : sum, ninserts, ndeletes)
+#endif
+    {
+        rand_state rs;
+#ifdef _OPENMP
+        myrandseed_r(&rs, 0xcafebabe, omp_get_thread_num());
+#else
+        myrandseed_r(&rs, 0xcafebabe, 0);
+#endif
+        uint64_t *scan_keys = scan_len ? malloc(scan_len * sizeof(uint64_t)) : NULL;
+        void **scan_records = scan_len ? malloc(scan_len * sizeof(void *)) : NULL;
+#ifdef _OPENMP
+#    pragma omp for
 #endif
-    for (size_t i = 0; i < nlookup; i++) {
-        size_t rdn = myrand() % (nelements * 2);
-        record *r = find(root, rdn, false, NULL);
-        if (r) {
-            struct element *e = (struct element *)r->value;
-            r->stats++;
-            if (e) {
-                sum += e->value;
+        for (size_t i = 0; i < nlookup; i++) {
+            size_t rdn = next_key(&keys, &rs);
+            if (mixed) {
+                /* the values of inserted keys are the element of the key
+                 * below, every key has one in [0, nelements) */
+                long op = myrand_r(&rs) % 100;
+                if (op < insert_pct) {
+                    insert_olc(&root, rdn, (uint64_t)&elms[rdn / CONFIG_DEFAULT_KEY_STRIDE]);
+                    ninserts++;
+                    continue;
+                }
+                if (op < insert_pct + delete_pct) {
+                    ndeletes += delete_olc(&root, rdn);
+                    continue;
+                }
+            }
+            if (scan_len) {
+                uint64_t nfound =
+                    find_range(root, rdn, rdn + scan_len * CONFIG_DEFAULT_KEY_STRIDE - 1, false,
+                               scan_keys, scan_records);
+                for (uint64_t j = 0; j < nfound; j++) {
+                    record *r = scan_records[j];
+                    if (update_stats)
+                        r->stats++;
+                    sum += ((struct element *)r->value)->value;
+                }
+                continue;
+            }
+            record *r = mixed ? find_olc(&root, rdn) : find(root, rdn, false, NULL);
+            if (r) {
+                struct element *e = (struct element *)r->value;
+                if (update_stats)
+                    r->stats++;
+                if (e) {
+                    sum += e->value;
+                }
             }
         }
+        free(scan_keys);
+        free(scan_records);
     }
     gettimeofday(&end, NULL);
 
@@ -1694,6 +2342,8 @@ int real_main(int argc, char **argv)
         exit(-1);
     }
     double usec = end.tv_sec * 1000000 + end.tv_usec - start.tv_sec * 1000000 - start.tv_usec;
+    if (mixed)
+        printf("did %zu inserts and %zu deletes of present keys\n", ninserts, ndeletes);
     printf("got %zu matches in %lf seconds\n", sum, usec/1000000.0);
 
     return EXIT_SUCCESS;
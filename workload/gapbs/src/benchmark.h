@@ -7,12 +7,17 @@
 #include <algorithm>
 #include <cinttypes>
 #include <functional>
+#include <memory>
 #include <random>
 #include <utility>
 #include <vector>
 
+#include <sys/resource.h>
+
 #include "builder.h"
+#include "compressed_graph.h"
 #include "graph.h"
+#include "perf_counters.h"
 #include "timer.h"
 #include "util.h"
 #include "writer.h"
@@ -34,6 +39,7 @@ typedef NodeWeight<NodeID, WeightT> WNode;
 
 typedef CSRGraph<NodeID> Graph;
 typedef CSRGraph<NodeID, WNode> WGraph;
+typedef CompressedGraph<NodeID> CGraph;
 
 typedef BuilderBase<NodeID, NodeID, WeightT> Builder;
 typedef BuilderBase<NodeID, WNode, WeightT> WeightedBuilder;
@@ -88,26 +94,107 @@ std::vector<std::pair<ValT, KeyT>> TopK(
 }
 
 
+// Calls block(begin, end) on consecutive ranges of vertices that together
+// cover all of them, so kernels can process a graph in blocks of edges
+//  - A graph in memory (or any other graph type) is a single block
+//  - A streamed graph (-S) has blocks of about kEdgeBlockEdges (in-)neighbors.
+//    While a block is processed the next one is read ahead, and the pages of
+//    a processed block are the first to be reclaimed, so the neighbors can be
+//    larger than memory without the kernel being stalled on most page faults
+const SGOffset kEdgeBlockEdges = 1 << 24;
+
+template<typename GraphT_, typename BlockFunc>
+void ForEachEdgeBlock(const GraphT_ &g, bool in_graph, BlockFunc block) {
+  block(0, g.num_nodes());
+}
+
+template<typename NodeID_, typename DestID_, bool MakeInverse,
+         typename BlockFunc>
+void ForEachEdgeBlock(const CSRGraph<NodeID_, DestID_, MakeInverse> &g,
+                      bool in_graph, BlockFunc block) {
+  if (!g.streamed()) {
+    block(0, g.num_nodes());
+    return;
+  }
+  NodeID_ begin = 0;
+  NodeID_ end = g.EdgeBlockEnd(begin, kEdgeBlockEdges, in_graph);
+  g.AdviseNeighs(begin, end, MADV_WILLNEED, in_graph);
+  while (begin < g.num_nodes()) {
+    NodeID_ next_end = end < g.num_nodes() ?
+                       g.EdgeBlockEnd(end, kEdgeBlockEdges, in_graph) : end;
+    g.AdviseNeighs(end, next_end, MADV_WILLNEED, in_graph);
+    block(begin, end);
+#ifdef MADV_COLD
+    g.AdviseNeighs(begin, end, MADV_COLD, in_graph);
+#else
+    g.AdviseNeighs(begin, end, MADV_DONTNEED, in_graph);
+#endif
+    begin = end;
+    end = next_end;
+  }
+}
+
+
 bool VerifyUnimplemented(...) {
   std::cout << "** verify unimplemented **" << std::endl;
   return false;
 }
 
 
+// Prints a trial as one line of JSON, with null for unavailable counters
+//  - edges is the number of directed edges in the graph, so gteps is nominal
+//    (the same for every kernel) rather than counting the edges each visits
+//  - bytes_read estimates memory reads by LLC read misses of 64B lines
+//  - max_rss_kb is the peak of the whole process up to the end of the trial
+void PrintTrialJSON(int trial, double seconds, int64_t edges,
+                    const PerfCounters *counters) {
+  const int64_t kLineBytes = 64;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  int64_t llc_misses = -1, llc_read_misses = -1;
+  if (counters != nullptr) {
+    llc_misses = counters->Count(PerfCounters::kLLCMisses);
+    llc_read_misses = counters->Count(PerfCounters::kLLCReadMisses);
+  }
+  printf("{\"trial\": %d, \"seconds\": %.6lf, \"edges\": %" PRId64
+         ", \"gteps\": %.6lf, \"max_rss_kb\": %ld", trial, seconds, edges,
+         edges / seconds / 1e9, usage.ru_maxrss);
+  if (llc_misses != -1)
+    printf(", \"llc_misses\": %" PRId64, llc_misses);
+  else
+    printf(", \"llc_misses\": null");
+  if (llc_read_misses != -1)
+    printf(", \"bytes_read\": %" PRId64 "}\n", llc_read_misses * kLineBytes);
+  else
+    printf(", \"bytes_read\": null}\n");
+}
+
+
 // Calls (and times) kernel according to command line arguments
 template<typename GraphT_, typename GraphFunc, typename AnalysisFunc,
          typename VerifierFunc>
 void BenchmarkKernel(const CLApp &cli, const GraphT_ &g,
                      GraphFunc kernel, AnalysisFunc stats,
                      VerifierFunc verify) {
+  PropertyPlacement() = cli.property_placement();
   g.PrintStats();
   double total_seconds = 0;
   Timer trial_timer;
+  std::unique_ptr<PerfCounters> counters;
+  if (cli.trial_json())
+    counters.reset(new PerfCounters());
   for (int iter=0; iter < cli.num_trials(); iter++) {
+    if (counters)
+      counters->Start();
     trial_timer.Start();
     auto result = kernel(g);
     trial_timer.Stop();
+    if (counters)
+      counters->Stop();
     PrintTime("Trial Time", trial_timer.Seconds());
+    if (cli.trial_json())
+      PrintTrialJSON(iter, trial_timer.Seconds(), g.num_edges_directed(),
+                     counters.get());
     total_seconds += trial_timer.Seconds();
     if (cli.do_analysis() && (iter == (cli.num_trials()-1)))
       stats(g, result);
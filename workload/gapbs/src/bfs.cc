@@ -1,6 +1,7 @@
 // Copyright (c) 2015, The Regents of the University of California (Regents)
 // See LICENSE.txt for license details
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -27,6 +28,10 @@ It uses the alpha and beta parameters to determine whether to switch search
 directions. For representing the frontier, it uses a SlidingQueue for the
 top-down approach and a Bitmap for the bottom-up approach. To reduce
 false-sharing for the top-down approach, thread-local QueueBuffer's are used.
+The bottom-up approach works on a word of the bitmaps (64 vertices) at a time,
+keeping the visited vertices in a bitmap too so it skips whole words of them
+rather than checking each of their parents, which late in the search is most
+of the work of a step.
 
 To save time computing the number of edges exiting the frontier, this
 implementation precomputes the degrees in bulk at the beginning by storing
@@ -43,28 +48,35 @@ them in the parent array as negative numbers. Thus, the encoding of parent is:
 
 using namespace std;
 
-int64_t BUStep(const Graph &g, pvector<NodeID> &parent, Bitmap &front,
-               Bitmap &next) {
+template <typename GraphT_>
+int64_t BUStep(const GraphT_ &g, pvector<NodeID> &parent, Bitmap &front,
+               Bitmap &next, Bitmap &visited) {
   int64_t awake_count = 0;
-  next.reset();
-  #pragma omp parallel for reduction(+ : awake_count) schedule(dynamic, 1024)
-  for (NodeID u=0; u < g.num_nodes(); u++) {
-    if (parent[u] < 0) {
+  const int64_t num_words = visited.num_words();
+  #pragma omp parallel for reduction(+ : awake_count) schedule(dynamic, 16)
+  for (int64_t w=0; w < num_words; w++) {
+    uint64_t awake = 0;
+    for (uint64_t todo = ~visited.get_word(w); todo != 0; todo &= todo - 1) {
+      int bit = __builtin_ctzll(todo);
+      NodeID u = w * Bitmap::kBitsPerWord + bit;
       for (NodeID v : g.in_neigh(u)) {
         if (front.get_bit(v)) {
           parent[u] = v;
-          awake_count++;
-          next.set_bit(u);
+          awake |= static_cast<uint64_t>(1) << bit;
           break;
         }
       }
     }
+    next.set_word(w, awake);
+    visited.set_word(w, visited.get_word(w) | awake);
+    awake_count += __builtin_popcountll(awake);
   }
   return awake_count;
 }
 
 
-int64_t TDStep(const Graph &g, pvector<NodeID> &parent,
+template <typename GraphT_>
+int64_t TDStep(const GraphT_ &g, pvector<NodeID> &parent,
                SlidingQueue<NodeID> &queue) {
   int64_t scout_count = 0;
   #pragma omp parallel
@@ -97,30 +109,50 @@ void QueueToBitmap(const SlidingQueue<NodeID> &queue, Bitmap &bm) {
   }
 }
 
-void BitmapToQueue(const Graph &g, const Bitmap &bm,
-                   SlidingQueue<NodeID> &queue) {
+void BitmapToQueue(const Bitmap &bm, SlidingQueue<NodeID> &queue) {
+  const int64_t num_words = bm.num_words();
   #pragma omp parallel
   {
     QueueBuffer<NodeID> lqueue(queue);
     #pragma omp for nowait
-    for (NodeID n=0; n < g.num_nodes(); n++)
-      if (bm.get_bit(n))
-        lqueue.push_back(n);
+    for (int64_t w=0; w < num_words; w++)
+      for (uint64_t bits = bm.get_word(w); bits != 0; bits &= bits - 1)
+        lqueue.push_back(w * Bitmap::kBitsPerWord + __builtin_ctzll(bits));
     lqueue.flush();
   }
   queue.slide_window();
 }
 
-pvector<NodeID> InitParent(const Graph &g) {
-  pvector<NodeID> parent(g.num_nodes());
+// Bits past the last vertex are set so they are never searched from
+template <typename GraphT_>
+void ParentToBitmap(const GraphT_ &g, const pvector<NodeID> &parent,
+                    Bitmap &visited) {
+  const int64_t num_words = visited.num_words();
+  #pragma omp parallel for
+  for (int64_t w=0; w < num_words; w++) {
+    int64_t word_start = w * Bitmap::kBitsPerWord;
+    int64_t word_bits = std::min<int64_t>(Bitmap::kBitsPerWord,
+                                          g.num_nodes() - word_start);
+    uint64_t word = word_bits < 64 ? ~0ULL << word_bits : 0;
+    for (int64_t bit=0; bit < word_bits; bit++)
+      word |= static_cast<uint64_t>(parent[word_start + bit] >= 0) << bit;
+    visited.set_word(w, word);
+  }
+}
+
+template <typename GraphT_>
+pvector<NodeID> InitParent(const GraphT_ &g) {
+  pvector<NodeID> parent(g.num_nodes(), PropertyPlacement());
   #pragma omp parallel for
   for (NodeID n=0; n < g.num_nodes(); n++)
     parent[n] = g.out_degree(n) != 0 ? -g.out_degree(n) : -1;
   return parent;
 }
 
-pvector<NodeID> DOBFS(const Graph &g, NodeID source, bool logging_enabled = false,
-                      int alpha = 15, int beta = 18) {
+template <typename GraphT_>
+pvector<NodeID> DOBFS(const GraphT_ &g, NodeID source,
+                      bool logging_enabled = false, int alpha = 15,
+                      int beta = 18) {
   if (logging_enabled)
     PrintStep("Source", static_cast<int64_t>(source));
   Timer t;
@@ -137,12 +169,16 @@ pvector<NodeID> DOBFS(const Graph &g, NodeID source, bool logging_enabled = fals
   curr.reset();
   Bitmap front(g.num_nodes());
   front.reset();
+  Bitmap visited(g.num_nodes());
   int64_t edges_to_check = g.num_edges_directed();
   int64_t scout_count = g.out_degree(source);
   while (!queue.empty()) {
     if (scout_count > edges_to_check / alpha) {
       int64_t awake_count, old_awake_count;
-      TIME_OP(t, QueueToBitmap(queue, front));
+      t.Start();
+      QueueToBitmap(queue, front);
+      ParentToBitmap(g, parent, visited);
+      t.Stop();
       if (logging_enabled)
         PrintStep("e", t.Seconds());
       awake_count = queue.size();
@@ -150,14 +186,14 @@ pvector<NodeID> DOBFS(const Graph &g, NodeID source, bool logging_enabled = fals
       do {
         t.Start();
         old_awake_count = awake_count;
-        awake_count = BUStep(g, parent, front, curr);
+        awake_count = BUStep(g, parent, front, curr, visited);
         front.swap(curr);
         t.Stop();
         if (logging_enabled)
           PrintStep("bu", t.Seconds(), awake_count);
       } while ((awake_count >= old_awake_count) ||
                (awake_count > g.num_nodes() / beta));
-      TIME_OP(t, BitmapToQueue(g, front, queue));
+      TIME_OP(t, BitmapToQueue(front, queue));
       if (logging_enabled)
         PrintStep("c", t.Seconds());
       scout_count = 1;
@@ -179,7 +215,8 @@ pvector<NodeID> DOBFS(const Graph &g, NodeID source, bool logging_enabled = fals
 }
 
 
-void PrintBFSStats(const Graph &g, const pvector<NodeID> &bfs_tree) {
+template <typename GraphT_>
+void PrintBFSStats(const GraphT_ &g, const pvector<NodeID> &bfs_tree) {
   int64_t tree_size = 0;
   int64_t n_edges = 0;
   for (NodeID n : g.vertices()) {
@@ -198,7 +235,8 @@ void PrintBFSStats(const Graph &g, const pvector<NodeID> &bfs_tree) {
 // - parent[v] = u  =>  depth[v] = depth[u] + 1 (except for source)
 // - parent[v] = u  => there is edge from u to v
 // - all vertices reachable from source have a parent
-bool BFSVerifier(const Graph &g, NodeID source,
+template <typename GraphT_>
+bool BFSVerifier(const GraphT_ &g, NodeID source,
                  const pvector<NodeID> &parent) {
   pvector<int> depth(g.num_nodes(), -1);
   depth[source] = 0;
@@ -247,20 +285,33 @@ bool BFSVerifier(const Graph &g, NodeID source,
 }
 
 
+template <typename GraphT_>
+void RunBFS(const CLApp &cli, const GraphT_ &g) {
+  SourcePicker<GraphT_> sp(g, cli.start_vertex());
+  auto BFSBound = [&sp,&cli] (const GraphT_ &g) {
+    return DOBFS(g, sp.PickNext(), cli.logging_en());
+  };
+  SourcePicker<GraphT_> vsp(g, cli.start_vertex());
+  auto VerifierBound = [&vsp] (const GraphT_ &g,
+                               const pvector<NodeID> &parent) {
+    return BFSVerifier(g, vsp.PickNext(), parent);
+  };
+  BenchmarkKernel(cli, g, BFSBound, PrintBFSStats<GraphT_>, VerifierBound);
+}
+
+
 int main(int argc, char* argv[]) {
   CLApp cli(argc, argv, "breadth-first search");
   if (!cli.ParseArgs())
     return -1;
   Builder b(cli);
   Graph g = b.MakeGraph();
-  SourcePicker<Graph> sp(g, cli.start_vertex());
-  auto BFSBound = [&sp,&cli] (const Graph &g) {
-    return DOBFS(g, sp.PickNext(), cli.logging_en());
-  };
-  SourcePicker<Graph> vsp(g, cli.start_vertex());
-  auto VerifierBound = [&vsp] (const Graph &g, const pvector<NodeID> &parent) {
-    return BFSVerifier(g, vsp.PickNext(), parent);
-  };
-  BenchmarkKernel(cli, g, BFSBound, PrintBFSStats, VerifierBound);
+  if (cli.compressed()) {
+    CGraph cg(g);
+    g = Graph();
+    RunBFS(cli, cg);
+  } else {
+    RunBFS(cli, g);
+  }
   return 0;
 }
@@ -17,11 +17,16 @@ Author: Scott Beamer
 
 Parallel bitmap that is thread-safe
  - Can set bits in parallel (set_bit_atomic) unlike std::vector<bool>
+ - Can be read and written a word (kBitsPerWord bits) at a time, so whole
+   words of clear bits can be skipped, words are independent so need no
+   atomics if each is only written by one thread
 */
 
 
 class Bitmap {
  public:
+  static const uint64_t kBitsPerWord = 64;
+
   explicit Bitmap(size_t size) {
     uint64_t num_words = (size + kBitsPerWord - 1) / kBitsPerWord;
     start_ = new uint64_t[num_words];
@@ -52,6 +57,18 @@ class Bitmap {
     return (start_[word_offset(pos)] >> bit_offset(pos)) & 1l;
   }
 
+  size_t num_words() const {
+    return end_ - start_;
+  }
+
+  uint64_t get_word(size_t word) const {
+    return start_[word];
+  }
+
+  void set_word(size_t word, uint64_t val) {
+    start_[word] = val;
+  }
+
   void swap(Bitmap &other) {
     std::swap(start_, other.start_);
     std::swap(end_, other.end_);
@@ -61,7 +78,6 @@ class Bitmap {
   uint64_t *start_;
   uint64_t *end_;
 
-  static const uint64_t kBitsPerWord = 64;
   static uint64_t word_offset(size_t n) { return n / kBitsPerWord; }
   static uint64_t bit_offset(size_t n) { return n & (kBitsPerWord - 1); }
 };
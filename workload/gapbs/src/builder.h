@@ -8,8 +8,10 @@
 #include <cinttypes>
 #include <fstream>
 #include <functional>
+#include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "command_line.h"
 #include "generator.h"
@@ -30,6 +32,10 @@ Given arguments from the command line (cli), returns a built graph
  - MakeGraph() will parse cli and obtain edgelist to call
    MakeGraphFromEL(edgelist) to perform the actual graph construction
  - edgelist can be from file (Reader) or synthetically generated (Generator)
+ - A synthetic graph is built straight from the Generator instead, unless it
+   is built in place (-m), see MakeGraphFromGenerator
+ - If an order is given (-o), relabels the vertices of the graph in that order
+   before returning it, converter then saves the reordered graph
  - Common case: BuilderBase typedef'd (w/ params) to be Builder (benchmark.h)
 */
 
@@ -40,6 +46,10 @@ class BuilderBase {
   typedef EdgePair<NodeID_, DestID_> Edge;
   typedef pvector<Edge> EdgeList;
 
+  // Sorting the edgelist takes passes of kRadixBits bits over blocks of it
+  static const int kRadixBits = 11;
+  static const int64_t kRadixBlocks = 256;
+
   const CLBase &cli_;
   bool symmetrize_;
   bool needs_weights_;
@@ -56,6 +66,12 @@ class BuilderBase {
                 << std::endl;
       exit(-30);
     }
+    const std::string &order = cli_.vertex_order();
+    if (order != "" && order != "degree" && order != "hubsort" &&
+        order != "hubcluster" && order != "rcm") {
+      std::cout << "Unknown vertex order: " << order << std::endl;
+      exit(-31);
+    }
   }
 
   DestID_ GetSource(EdgePair<NodeID_, NodeID_> e) {
@@ -66,6 +82,30 @@ class BuilderBase {
     return NodeWeight<NodeID_, WeightT_>(e.u, e.v.w);
   }
 
+  static void SetWeight(EdgePair<NodeID_, NodeID_> &e, WeightT_ w) {}
+
+  static void SetWeight(EdgePair<NodeID_, NodeWeight<NodeID_, WeightT_>> &e,
+                        WeightT_ w) {
+    e.v.w = w;
+  }
+
+  // Storage for num_neighs neighbors, its pages not yet touched but placed
+  static DestID_* NewNeighs(size_t num_neighs, const Placement &place) {
+    DestID_* neighs = new DestID_[num_neighs];
+    if (place.any())
+      PlacePages(neighs, num_neighs * sizeof(DestID_), place);
+    return neighs;
+  }
+
+  static NodeID_ Renumber(NodeID_ v, const pvector<NodeID_> &new_ids) {
+    return new_ids[v];
+  }
+
+  static NodeWeight<NodeID_, WeightT_> Renumber(
+      NodeWeight<NodeID_, WeightT_> v, const pvector<NodeID_> &new_ids) {
+    return NodeWeight<NodeID_, WeightT_>(new_ids[v.v], v.w);
+  }
+
   NodeID_ FindMaxNodeID(const EdgeList &el) {
     NodeID_ max_seen = 0;
     #pragma omp parallel for reduction(max : max_seen)
@@ -139,7 +179,7 @@ class BuilderBase {
   // Removes self-loops and redundant edges
   // Side effect: neighbor IDs will be sorted
   void SquishCSR(const CSRGraph<NodeID_, DestID_, invert> &g, bool transpose,
-                 DestID_*** sq_index, DestID_** sq_neighs) {
+                 SGOffset** sq_index, DestID_** sq_neighs) {
     pvector<NodeID_> diffs(g.num_nodes());
     DestID_ *n_start, *n_end;
     #pragma omp parallel for private(n_start, n_end)
@@ -157,21 +197,23 @@ class BuilderBase {
       diffs[n] = new_end - n_start;
     }
     pvector<SGOffset> sq_offsets = ParallelPrefixSum(diffs);
-    *sq_neighs = new DestID_[sq_offsets[g.num_nodes()]];
-    *sq_index = CSRGraph<NodeID_, DestID_>::GenIndex(sq_offsets, *sq_neighs);
+    *sq_neighs = NewNeighs(sq_offsets[g.num_nodes()], cli_.graph_placement());
+    *sq_index = CSRGraph<NodeID_, DestID_>::GenIndex(sq_offsets,
+        cli_.graph_placement());
     #pragma omp parallel for private(n_start)
     for (NodeID_ n=0; n < g.num_nodes(); n++) {
       if (transpose)
         n_start = g.in_neigh(n).begin();
       else
         n_start = g.out_neigh(n).begin();
-      std::copy(n_start, n_start+diffs[n], (*sq_index)[n]);
+      std::copy(n_start, n_start+diffs[n], *sq_neighs + sq_offsets[n]);
     }
   }
 
   CSRGraph<NodeID_, DestID_, invert> SquishGraph(
       const CSRGraph<NodeID_, DestID_, invert> &g) {
-    DestID_ **out_index, *out_neighs, **in_index, *in_neighs;
+    SGOffset *out_index, *in_index;
+    DestID_ *out_neighs, *in_neighs;
     SquishCSR(g, false, &out_index, &out_neighs);
     if (g.directed()) {
       if (invert)
@@ -194,8 +236,8 @@ class BuilderBase {
     - if being symmetrized
       - search for needed inverses, make room for them, add them in place
   */
-  void MakeCSRInPlace(EdgeList &el, DestID_*** index, DestID_** neighs,
-                      DestID_*** inv_index, DestID_** inv_neighs) {
+  void MakeCSRInPlace(EdgeList &el, SGOffset** index, DestID_** neighs,
+                      SGOffset** inv_index, DestID_** inv_neighs) {
     // preprocess EdgeList - sort & squish in place
     std::sort(el.begin(), el.end());
     auto new_end = std::unique(el.begin(), el.end());
@@ -218,15 +260,17 @@ class BuilderBase {
     if (!symmetrize_) {   // not going to symmetrize so no need to add edges
       size_t new_size = num_edges * sizeof(DestID_);
       *neighs = static_cast<DestID_*>(std::realloc(*neighs, new_size));
-      *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, *neighs);
+      *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets,
+          cli_.graph_placement());
       if (invert) {       // create inv_neighs & inv_index for incoming edges
         pvector<SGOffset> inoffsets = ParallelPrefixSum(indegrees);
-        *inv_neighs = new DestID_[inoffsets[num_nodes_]];
+        *inv_neighs = NewNeighs(inoffsets[num_nodes_],
+                                cli_.graph_placement());
         *inv_index = CSRGraph<NodeID_, DestID_>::GenIndex(inoffsets,
-                                                          *inv_neighs);
+            cli_.graph_placement());
         for (NodeID_ u = 0; u < num_nodes_; u++) {
-          for (DestID_* it = (*index)[u]; it < (*index)[u+1]; it++) {
-            NodeID_ v = static_cast<NodeID_>(*it);
+          for (SGOffset i = (*index)[u]; i < (*index)[u+1]; i++) {
+            NodeID_ v = static_cast<NodeID_>((*neighs)[i]);
             (*inv_neighs)[inoffsets[v]] = u;
             inoffsets[v]++;
           }
@@ -286,36 +330,173 @@ class BuilderBase {
       }
       for (NodeID_ n = 0; n < num_nodes_; n++)
         std::sort(*neighs + offsets[n], *neighs + offsets[n+1]);
-      *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, *neighs);
+      *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets,
+          cli_.graph_placement());
+    }
+  }
+
+  // Bits needed to tell all vertices apart
+  int NodeBits() const {
+    int bits = 1;
+    while ((static_cast<int64_t>(1) << bits) < num_nodes_)
+      bits++;
+    return bits;
+  }
+
+  static uint64_t SortKey(Edge e, int node_bits) {
+    return (static_cast<uint64_t>(e.u) << node_bits) |
+           static_cast<uint64_t>(static_cast<NodeID_>(e.v));
+  }
+
+  // Sorts el by source then destination with a parallel LSD radix sort, using
+  // buf (resized to el) as the other half of each pass. Each block of el is
+  // counted and scattered by one thread, edges equal by key keep their order
+  void RadixSortEL(EdgeList &el, EdgeList &buf) {
+    const int64_t num_buckets = static_cast<int64_t>(1) << kRadixBits;
+    const int64_t num_edges = el.size();
+    const int64_t block_size = (num_edges + kRadixBlocks - 1) / kRadixBlocks;
+    const int node_bits = NodeBits();
+    buf.resize(num_edges);
+    pvector<SGOffset> counts(kRadixBlocks * num_buckets);
+    for (int shift=0; shift < 2 * node_bits; shift += kRadixBits) {
+      #pragma omp parallel for schedule(static, 1)
+      for (int64_t b=0; b < kRadixBlocks; b++) {
+        SGOffset* bucket = counts.data() + b * num_buckets;
+        std::fill(bucket, bucket + num_buckets, 0);
+        int64_t block_end = std::min((b + 1) * block_size, num_edges);
+        for (int64_t i=b * block_size; i < block_end; i++)
+          bucket[(SortKey(el[i], node_bits) >> shift) & (num_buckets - 1)]++;
+      }
+      SGOffset total = 0;
+      for (int64_t d=0; d < num_buckets; d++) {
+        for (int64_t b=0; b < kRadixBlocks; b++) {
+          SGOffset count = counts[b * num_buckets + d];
+          counts[b * num_buckets + d] = total;
+          total += count;
+        }
+      }
+      #pragma omp parallel for schedule(static, 1)
+      for (int64_t b=0; b < kRadixBlocks; b++) {
+        SGOffset* bucket = counts.data() + b * num_buckets;
+        int64_t block_end = std::min((b + 1) * block_size, num_edges);
+        for (int64_t i=b * block_size; i < block_end; i++) {
+          Edge e = el[i];
+          buf[bucket[(SortKey(e, node_bits) >> shift) & (num_buckets - 1)]++] =
+              e;
+        }
+      }
+      el.swap(buf);
+    }
+  }
+
+  // Copies sorted el into squished without self-loops and redundant edges,
+  // keeping the lightest of each run of edges equal by key (like SquishCSR)
+  void SquishEL(const EdgeList &el, EdgeList &squished) {
+    const int64_t num_edges = el.size();
+    const int64_t block_size = (num_edges + kRadixBlocks - 1) / kRadixBlocks;
+    auto same_key = [&el](int64_t i, int64_t j) {
+      // Compares only the destinations of weighted edges
+      return el[i].u == el[j].u && el[i].v == el[j].v;
+    };
+    auto keep = [&el, &same_key](int64_t i) {
+      Edge e = el[i];
+      NodeID_ v = static_cast<NodeID_>(e.v);
+      if (e.u == v)
+        return false;
+      return i == 0 || !same_key(i-1, i);
+    };
+    pvector<SGOffset> block_starts(kRadixBlocks + 1);
+    #pragma omp parallel for schedule(static, 1)
+    for (int64_t b=0; b < kRadixBlocks; b++) {
+      SGOffset count = 0;
+      int64_t block_end = std::min((b + 1) * block_size, num_edges);
+      for (int64_t i=b * block_size; i < block_end; i++)
+        count += keep(i);
+      block_starts[b] = count;
+    }
+    SGOffset total = 0;
+    for (int64_t b=0; b <= kRadixBlocks; b++) {
+      SGOffset count = b < kRadixBlocks ? block_starts[b] : 0;
+      block_starts[b] = total;
+      total += count;
+    }
+    squished.resize(total);
+    #pragma omp parallel for schedule(static, 1)
+    for (int64_t b=0; b < kRadixBlocks; b++) {
+      SGOffset pos = block_starts[b];
+      int64_t block_end = std::min((b + 1) * block_size, num_edges);
+      for (int64_t i=b * block_size; i < block_end; i++) {
+        if (keep(i)) {
+          Edge lightest = el[i];
+          for (int64_t j=i+1; j < num_edges && same_key(i, j); j++)
+            if (el[j].v < lightest.v)
+              lightest = el[j];
+          squished[pos++] = lightest;
+        }
+      }
     }
   }
 
+  // Neighbors are written in order by a static schedule, so their pages are
+  // first touched (and placed) by the threads that later work on them, unless
+  // the graph is placed otherwise (-N, -x)
+  void MakeCSRFromSortedEL(const EdgeList &el, SGOffset** index,
+                           DestID_** neighs) {
+    pvector<SGOffset> offsets(num_nodes_ + 1);
+    #pragma omp parallel for
+    for (int64_t n=0; n <= num_nodes_; n++)
+      offsets[n] = std::lower_bound(el.begin(), el.end(), n,
+                                    [](const Edge &e, int64_t n) {
+                                      return e.u < n;
+                                    }) - el.begin();
+    *neighs = NewNeighs(el.size(), cli_.graph_placement());
+    #pragma omp parallel for schedule(static)
+    for (size_t i=0; i < el.size(); i++)
+      (*neighs)[i] = el[i].v;
+    *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets,
+        cli_.graph_placement());
+  }
+
   /*
   Graph Building Steps (for CSR):
-    - Read edgelist once to determine vertex degrees (CountDegrees)
-    - Determine vertex offsets by a prefix sum (ParallelPrefixSum)
-    - Allocate storage and set points according to offsets (GenIndex)
-    - Copy edges into storage
+    - If symmetrizing, add the inverse of every edge to the edgelist
+    - Sort edgelist by source and destination (RadixSortEL)
+    - Remove self-loops and redundant edges (SquishEL)
+    - Find vertex offsets by binary search and copy destinations into storage
+      (MakeCSRFromSortedEL)
+    - If inverse is needed, transpose squished edgelist and repeat
   */
-  void MakeCSR(const EdgeList &el, bool transpose, DestID_*** index,
-               DestID_** neighs) {
-    pvector<NodeID_> degrees = CountDegrees(el, transpose);
-    pvector<SGOffset> offsets = ParallelPrefixSum(degrees);
-    *neighs = new DestID_[offsets[num_nodes_]];
-    *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, *neighs);
-    #pragma omp parallel for
-    for (auto it = el.begin(); it < el.end(); it++) {
-      Edge e = *it;
-      if (symmetrize_ || (!symmetrize_ && !transpose))
-        (*neighs)[fetch_and_add(offsets[e.u], 1)] = e.v;
-      if (symmetrize_ || (!symmetrize_ && transpose))
-        (*neighs)[fetch_and_add(offsets[static_cast<NodeID_>(e.v)], 1)] =
-            GetSource(e);
+  void MakeCSR(EdgeList &el, SGOffset** index, DestID_** neighs,
+               SGOffset** inv_index, DestID_** inv_neighs) {
+    EdgeList buf;
+    if (symmetrize_) {
+      buf.resize(2 * el.size());
+      #pragma omp parallel for
+      for (size_t i=0; i < el.size(); i++) {
+        Edge e = el[i];
+        buf[2*i] = e;
+        buf[2*i+1] = Edge(static_cast<NodeID_>(e.v), GetSource(e));
+      }
+      el.swap(buf);
+      buf = EdgeList();
+    }
+    RadixSortEL(el, buf);
+    SquishEL(el, buf);
+    MakeCSRFromSortedEL(buf, index, neighs);
+    if (!symmetrize_ && invert) {
+      el.resize(buf.size());
+      #pragma omp parallel for
+      for (size_t i=0; i < buf.size(); i++) {
+        Edge e = buf[i];
+        el[i] = Edge(static_cast<NodeID_>(e.v), GetSource(e));
+      }
+      RadixSortEL(el, buf);
+      MakeCSRFromSortedEL(el, inv_index, inv_neighs);
     }
   }
 
   CSRGraph<NodeID_, DestID_, invert> MakeGraphFromEL(EdgeList &el) {
-    DestID_ **index = nullptr, **inv_index = nullptr;
+    SGOffset *index = nullptr, *inv_index = nullptr;
     DestID_ *neighs = nullptr, *inv_neighs = nullptr;
     Timer t;
     t.Start();
@@ -326,10 +507,7 @@ class BuilderBase {
     if (in_place_) {
       MakeCSRInPlace(el, &index, &neighs, &inv_index, &inv_neighs);
     } else {
-      MakeCSR(el, false, &index, &neighs);
-      if (!symmetrize_ && invert) {
-        MakeCSR(el, true, &inv_index, &inv_neighs);
-      }
+      MakeCSR(el, &index, &neighs, &inv_index, &inv_neighs);
     }
     t.Stop();
     PrintTime("Build Time", t.Seconds());
@@ -340,27 +518,101 @@ class BuilderBase {
                                                 inv_index, inv_neighs);
   }
 
+  /*
+  Streaming Graph Building Steps (synthetic graph, always symmetrized)
+    - count the degrees with a pass over the generated edges and both of
+      their directions, find the number of vertices like FindMaxNodeID
+    - fill the neighbors in a second pass that generates the same edges again
+    - sort and squish every neighborhood (like SquishCSR) and copy them into
+      the final storage
+  The edgelist and the copies sorting it needs are never stored, so the raw
+  and the squished neighbors (4 bytes per direction of an edge each, 8 with
+  weights) are the most memory building takes
+  */
+  CSRGraph<NodeID_, DestID_, invert> MakeGraphFromGenerator(
+      Generator<NodeID_, DestID_, WeightT_> &gen, int64_t max_nodes) {
+    Timer t;
+    t.Start();
+    pvector<NodeID_> degrees(max_nodes, 0);
+    gen.ForEachEdge(cli_.uniform(), needs_weights_,
+                    [&degrees](int64_t e, NodeID_ u, NodeID_ v, WeightT_ w) {
+                      fetch_and_add(degrees[u], 1);
+                      fetch_and_add(degrees[v], 1);
+                    });
+    NodeID_ max_seen = 0;
+    #pragma omp parallel for reduction(max : max_seen)
+    for (NodeID_ n=0; n < max_nodes; n++) {
+      if (degrees[n] != 0)
+        max_seen = std::max(max_seen, n);
+    }
+    num_nodes_ = max_seen + 1;
+    degrees.resize(num_nodes_);
+    pvector<SGOffset> offsets = ParallelPrefixSum(degrees);
+    pvector<SGOffset> tails(offsets.begin(), offsets.end());
+    DestID_* raw_neighs = new DestID_[offsets[num_nodes_]];
+    gen.ForEachEdge(cli_.uniform(), needs_weights_,
+                    [&](int64_t i, NodeID_ u, NodeID_ v, WeightT_ w) {
+                      Edge e(u, v);
+                      SetWeight(e, w);
+                      raw_neighs[fetch_and_add(tails[u], 1)] = e.v;
+                      raw_neighs[fetch_and_add(tails[v], 1)] = GetSource(e);
+                    });
+    t.Stop();
+    PrintTime("Generate Time", t.Seconds());
+    t.Start();
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (NodeID_ n=0; n < num_nodes_; n++) {
+      DestID_* n_start = raw_neighs + offsets[n];
+      DestID_* n_end = raw_neighs + offsets[n+1];
+      std::sort(n_start, n_end);
+      DestID_* new_end = std::unique(n_start, n_end);
+      new_end = std::remove(n_start, new_end, n);
+      degrees[n] = new_end - n_start;
+    }
+    pvector<SGOffset> sq_offsets = ParallelPrefixSum(degrees);
+    DestID_* neighs = NewNeighs(sq_offsets[num_nodes_],
+                                cli_.graph_placement());
+    #pragma omp parallel for schedule(static)
+    for (NodeID_ n=0; n < num_nodes_; n++)
+      std::copy(raw_neighs + offsets[n], raw_neighs + offsets[n] + degrees[n],
+                neighs + sq_offsets[n]);
+    delete[] raw_neighs;
+    SGOffset* index = CSRGraph<NodeID_, DestID_>::GenIndex(sq_offsets,
+        cli_.graph_placement());
+    t.Stop();
+    PrintTime("Build Time", t.Seconds());
+    return CSRGraph<NodeID_, DestID_, invert>(num_nodes_, index, neighs);
+  }
+
   CSRGraph<NodeID_, DestID_, invert> MakeGraph() {
+    if (cli_.vertex_order() == "")
+      return LoadGraph();
+    return Reorder(LoadGraph(), cli_.vertex_order(), cli_.graph_placement());
+  }
+
+  CSRGraph<NodeID_, DestID_, invert> LoadGraph() {
     CSRGraph<NodeID_, DestID_, invert> g;
     {  // extra scope to trigger earlier deletion of el (save memory)
       EdgeList el;
       if (cli_.filename() != "") {
-        Reader<NodeID_, DestID_, WeightT_, invert> r(cli_.filename());
+        Reader<NodeID_, DestID_, WeightT_, invert> r(cli_.filename(),
+            cli_.map_graph(), cli_.map_populate(), cli_.map_huge(),
+            cli_.graph_placement(), cli_.stream());
         if ((r.GetSuffix() == ".sg") || (r.GetSuffix() == ".wsg")) {
           return r.ReadSerializedGraph();
         } else {
           el = r.ReadFile(needs_weights_);
         }
       } else if (cli_.scale() != -1) {
-        Generator<NodeID_, DestID_> gen(cli_.scale(), cli_.degree());
+        Generator<NodeID_, DestID_, WeightT_> gen(cli_.scale(),
+                                                  cli_.degree());
+        if (!in_place_ && symmetrize_)
+          return MakeGraphFromGenerator(gen, 1l << cli_.scale());
         el = gen.GenerateEL(cli_.uniform());
       }
       g = MakeGraphFromEL(el);
     }
-    if (in_place_)
-      return g;
-    else
-      return SquishGraph(g);
+    return g;
   }
 
   // Relabels (and rebuilds) graph by order of decreasing degree
@@ -373,6 +625,48 @@ class BuilderBase {
     }
     Timer t;
     t.Start();
+    CSRGraph<NodeID_, DestID_, invert> relabeled = Relabel(g, DegreeOrder(g));
+    t.Stop();
+    PrintTime("Relabel", t.Seconds());
+    return relabeled;
+  }
+
+  /*
+  Vertex Orders
+    - new_ids[u] is the new label of u
+    - degrees are out-degrees, for a directed graph that is how many times a
+      pull kernel reads the data of a vertex
+    - degree: decreasing degree
+    - hubsort: hubs (degree above average) first by decreasing degree, then the
+      other vertices in their original order
+    - hubcluster: hubs first, hubs and other vertices in their original order
+    - rcm: reverse Cuthill-McKee, a BFS from a vertex of minimum degree of each
+      component visiting neighbors by increasing degree, reversed. Follows
+      both directions of a directed graph
+  */
+  static
+  CSRGraph<NodeID_, DestID_, invert> Reorder(
+      const CSRGraph<NodeID_, DestID_, invert> &g, const std::string &order,
+      const Placement &place = Placement()) {
+    Timer t;
+    t.Start();
+    pvector<NodeID_> new_ids;
+    if (order == "degree")
+      new_ids = DegreeOrder(g);
+    else if (order == "hubsort")
+      new_ids = HubOrder(g, true);
+    else if (order == "hubcluster")
+      new_ids = HubOrder(g, false);
+    else
+      new_ids = RCMOrder(g);
+    CSRGraph<NodeID_, DestID_, invert> reordered = Relabel(g, new_ids, place);
+    t.Stop();
+    PrintTime("Reorder Time", t.Seconds());
+    return reordered;
+  }
+
+  static pvector<NodeID_> DegreeOrder(
+      const CSRGraph<NodeID_, DestID_, invert> &g) {
     typedef std::pair<int64_t, NodeID_> degree_node_p;
     pvector<degree_node_p> degree_id_pairs(g.num_nodes());
     #pragma omp parallel for
@@ -380,25 +674,128 @@ class BuilderBase {
       degree_id_pairs[n] = std::make_pair(g.out_degree(n), n);
     std::sort(degree_id_pairs.begin(), degree_id_pairs.end(),
               std::greater<degree_node_p>());
-    pvector<NodeID_> degrees(g.num_nodes());
     pvector<NodeID_> new_ids(g.num_nodes());
     #pragma omp parallel for
-    for (NodeID_ n=0; n < g.num_nodes(); n++) {
-      degrees[n] = degree_id_pairs[n].first;
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
       new_ids[degree_id_pairs[n].second] = n;
+    return new_ids;
+  }
+
+  static pvector<NodeID_> HubOrder(const CSRGraph<NodeID_, DestID_, invert> &g,
+                                   bool sort_hubs) {
+    const int64_t avg_degree = g.num_edges_directed() / g.num_nodes();
+    typedef std::pair<int64_t, NodeID_> degree_node_p;
+    std::vector<degree_node_p> hubs;
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      if (g.out_degree(n) > avg_degree)
+        hubs.push_back(std::make_pair(g.out_degree(n), n));
+    if (sort_hubs)
+      std::stable_sort(hubs.begin(), hubs.end(),
+                       [](const degree_node_p &a, const degree_node_p &b) {
+                         return a.first > b.first;
+                       });
+    pvector<NodeID_> new_ids(g.num_nodes());
+    NodeID_ next_id = 0;
+    for (degree_node_p hub : hubs)
+      new_ids[hub.second] = next_id++;
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      if (g.out_degree(n) <= avg_degree)
+        new_ids[n] = next_id++;
+    return new_ids;
+  }
+
+  static pvector<NodeID_> RCMOrder(
+      const CSRGraph<NodeID_, DestID_, invert> &g) {
+    auto degree = [&g](NodeID_ n) {
+      return g.out_degree(n) + (g.directed() ? g.in_degree(n) : 0);
+    };
+    auto by_degree = [&degree](NodeID_ a, NodeID_ b) {
+      return degree(a) < degree(b);
+    };
+    pvector<NodeID_> starts(g.num_nodes());
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      starts[n] = n;
+    std::stable_sort(starts.begin(), starts.end(), by_degree);
+    pvector<NodeID_> order(g.num_nodes());
+    std::vector<bool> visited(g.num_nodes(), false);
+    std::vector<NodeID_> next;
+    NodeID_ tail = 0;
+    for (NodeID_ start : starts) {
+      if (visited[start])
+        continue;
+      visited[start] = true;
+      order[tail++] = start;
+      for (NodeID_ head = tail - 1; head < tail; head++) {
+        NodeID_ u = order[head];
+        next.clear();
+        for (DestID_ v : g.out_neigh(u))
+          if (!visited[static_cast<NodeID_>(v)]) {
+            visited[static_cast<NodeID_>(v)] = true;
+            next.push_back(static_cast<NodeID_>(v));
+          }
+        if (g.directed()) {
+          for (DestID_ v : g.in_neigh(u))
+            if (!visited[static_cast<NodeID_>(v)]) {
+              visited[static_cast<NodeID_>(v)] = true;
+              next.push_back(static_cast<NodeID_>(v));
+            }
+        }
+        std::stable_sort(next.begin(), next.end(), by_degree);
+        for (NodeID_ v : next)
+          order[tail++] = v;
+      }
     }
-    pvector<SGOffset> offsets = ParallelPrefixSum(degrees);
-    DestID_* neighs = new DestID_[offsets[g.num_nodes()]];
-    DestID_** index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, neighs);
+    pvector<NodeID_> new_ids(g.num_nodes());
+    #pragma omp parallel for
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      new_ids[order[n]] = g.num_nodes() - 1 - n;
+    return new_ids;
+  }
+
+  // Rebuilds graph with vertex u labeled new_ids[u], neighbors stay sorted
+  static
+  CSRGraph<NodeID_, DestID_, invert> Relabel(
+      const CSRGraph<NodeID_, DestID_, invert> &g,
+      const pvector<NodeID_> &new_ids, const Placement &place = Placement()) {
+    SGOffset *out_index, *in_index = nullptr;
+    DestID_ *out_neighs, *in_neighs = nullptr;
+    RelabelCSR(g, new_ids, false, &out_index, &out_neighs, place);
+    if (g.directed()) {
+      if (invert)
+        RelabelCSR(g, new_ids, true, &in_index, &in_neighs, place);
+      return CSRGraph<NodeID_, DestID_, invert>(g.num_nodes(), out_index,
+                                                out_neighs, in_index,
+                                                in_neighs);
+    } else {
+      return CSRGraph<NodeID_, DestID_, invert>(g.num_nodes(), out_index,
+                                                out_neighs);
+    }
+  }
+
+  static void RelabelCSR(const CSRGraph<NodeID_, DestID_, invert> &g,
+                         const pvector<NodeID_> &new_ids, bool transpose,
+                         SGOffset** index, DestID_** neighs,
+                         const Placement &place) {
+    pvector<NodeID_> degrees(g.num_nodes());
     #pragma omp parallel for
+    for (NodeID_ n=0; n < g.num_nodes(); n++)
+      degrees[new_ids[n]] = transpose ? g.in_degree(n) : g.out_degree(n);
+    pvector<SGOffset> offsets = ParallelPrefixSum(degrees);
+    *neighs = NewNeighs(offsets[g.num_nodes()], place);
+    *index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, place);
+    #pragma omp parallel for schedule(dynamic, 1024)
     for (NodeID_ u=0; u < g.num_nodes(); u++) {
-      for (NodeID_ v : g.out_neigh(u))
-        neighs[offsets[new_ids[u]]++] = new_ids[v];
-      std::sort(index[new_ids[u]], index[new_ids[u]+1]);
+      DestID_* n_start = *neighs + offsets[new_ids[u]];
+      DestID_* n_end = n_start;
+      if (transpose) {
+        for (DestID_ v : g.in_neigh(u))
+          *n_end++ = Renumber(v, new_ids);
+      } else {
+        for (DestID_ v : g.out_neigh(u))
+          *n_end++ = Renumber(v, new_ids);
+      }
+      std::sort(n_start, n_end);
     }
-    t.Stop();
-    PrintTime("Relabel", t.Seconds());
-    return CSRGraph<NodeID_, DestID_, invert>(g.num_nodes(), index, neighs);
   }
 };
 
@@ -31,6 +31,12 @@ which restructures and extends the Shiloach-Vishkin algorithm [2].
 
 [2] Yossi Shiloach and Uzi Vishkin. "An o(logn) parallel connectivity algorithm"
     Journal of Algorithms, 3(1):57–67, 1982.
+
+Every pass over the edges goes over the vertices in blocks of edges, so a
+streamed graph (-S) only needs a few blocks of neighbors resident at a time.
+For directed graphs the final pass goes over the out-neighbors and then over
+the in-neighbors, rather than both for each vertex, so each pass streams one
+neighbor array.
 */
 
 
@@ -94,7 +100,7 @@ NodeID SampleFrequentElement(const pvector<NodeID>& comp,
 
 pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
                          int32_t neighbor_rounds = 2) {
-  pvector<NodeID> comp(g.num_nodes());
+  pvector<NodeID> comp(g.num_nodes(), PropertyPlacement());
 
   // Initialize each node to a single-node self-pointing tree
   #pragma omp parallel for
@@ -104,14 +110,16 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
   // Process a sparse sampled subgraph first for approximating components.
   // Sample by processing a fixed number of neighbors for each node (see paper)
   for (int r = 0; r < neighbor_rounds; ++r) {
-  #pragma omp parallel for schedule(dynamic,16384)
-    for (NodeID u = 0; u < g.num_nodes(); u++) {
-      for (NodeID v : g.out_neigh(u, r)) {
-        // Link at most one time if neighbor available at offset r
-        Link(u, v, comp);
-        break;
+    ForEachEdgeBlock(g, false, [&](NodeID begin, NodeID end) {
+      #pragma omp parallel for schedule(dynamic,16384)
+      for (NodeID u = begin; u < end; u++) {
+        for (NodeID v : g.out_neigh(u, r)) {
+          // Link at most one time if neighbor available at offset r
+          Link(u, v, comp);
+          break;
+        }
       }
-    }
+    });
     Compress(g, comp);
   }
 
@@ -120,9 +128,9 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
   NodeID c = SampleFrequentElement(comp, logging_enabled);
 
   // Final 'link' phase over remaining edges (excluding the largest component)
-  if (!g.directed()) {
+  ForEachEdgeBlock(g, false, [&](NodeID begin, NodeID end) {
     #pragma omp parallel for schedule(dynamic, 16384)
-    for (NodeID u = 0; u < g.num_nodes(); u++) {
+    for (NodeID u = begin; u < end; u++) {
       // Skip processing nodes in the largest component
       if (comp[u] == c)
         continue;
@@ -131,19 +139,19 @@ pvector<NodeID> Afforest(const Graph &g, bool logging_enabled = false,
         Link(u, v, comp);
       }
     }
-  } else {
-    #pragma omp parallel for schedule(dynamic, 16384)
-    for (NodeID u = 0; u < g.num_nodes(); u++) {
-      if (comp[u] == c)
-        continue;
-      for (NodeID v : g.out_neigh(u, neighbor_rounds)) {
-        Link(u, v, comp);
-      }
-      // To support directed graphs, process reverse graph completely
-      for (NodeID v : g.in_neigh(u)) {
-        Link(u, v, comp);
+  });
+  if (g.directed()) {
+    // To support directed graphs, process reverse graph completely
+    ForEachEdgeBlock(g, true, [&](NodeID begin, NodeID end) {
+      #pragma omp parallel for schedule(dynamic, 16384)
+      for (NodeID u = begin; u < end; u++) {
+        if (comp[u] == c)
+          continue;
+        for (NodeID v : g.in_neigh(u)) {
+          Link(u, v, comp);
+        }
       }
-    }
+    });
   }
   // Finally, 'compress' for final convergence
   Compress(g, comp);
@@ -47,7 +47,7 @@ using namespace std;
 // direction, so we use a min-max swap such that lower component IDs propagate
 // independent of the edge's direction.
 pvector<NodeID> ShiloachVishkin(const Graph &g) {
-  pvector<NodeID> comp(g.num_nodes());
+  pvector<NodeID> comp(g.num_nodes(), PropertyPlacement());
   #pragma omp parallel for
   for (NodeID n=0; n < g.num_nodes(); n++)
     comp[n] = n;
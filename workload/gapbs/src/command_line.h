@@ -13,6 +13,8 @@
 #include <type_traits>
 #include <vector>
 
+#include "util.h"
+
 
 /*
 GAP Benchmark Suite
@@ -30,7 +32,7 @@ class CLBase {
   int argc_;
   char** argv_;
   std::string name_;
-  std::string get_args_ = "f:g:hk:su:m";
+  std::string get_args_ = "f:g:hk:su:mzpHo:NSx:";
   std::vector<std::string> help_strings_;
 
   int scale_ = -1;
@@ -39,6 +41,12 @@ class CLBase {
   bool symmetrize_ = false;
   bool uniform_ = false;
   bool in_place_ = false;
+  bool map_graph_ = false;
+  bool map_populate_ = false;
+  bool map_huge_ = false;
+  Placement graph_place_;
+  bool stream_ = false;
+  std::string vertex_order_ = "";
 
   void AddHelpLine(char opt, std::string opt_arg, std::string text,
                    std::string def = "") {
@@ -64,6 +72,17 @@ class CLBase {
     AddHelpLine('k', "degree", "average degree for synthetic graph",
                 std::to_string(degree_));
     AddHelpLine('m', "", "reduces memory usage during graph building", "false");
+    AddHelpLine('z', "", "map serialized graph instead of reading it", "false");
+    AddHelpLine('p', "", "prefault mapped graph (implies -z)", "false");
+    AddHelpLine('H', "", "use huge pages for mapped graph (implies -z)",
+                "false");
+    AddHelpLine('o', "order",
+                "relabel vertices (degree|hubsort|hubcluster|rcm)", "none");
+    AddHelpLine('N', "", "interleave graph over NUMA nodes", "false");
+    AddHelpLine('S', "", "stream mapped graph in edge blocks (implies -z)",
+                "false");
+    AddHelpLine('x', "place", "place graph (huge,interleave,bind=n,prefer=n)",
+                "none");
   }
 
   bool ParseArgs() {
@@ -90,6 +109,20 @@ class CLBase {
       case 's': symmetrize_ = true;                         break;
       case 'u': uniform_ = true; scale_ = atoi(opt_arg);    break;
       case 'm': in_place_ = true;                           break;
+      case 'z': map_graph_ = true;                          break;
+      case 'p': map_graph_ = map_populate_ = true;          break;
+      case 'H': map_graph_ = map_huge_ = true;              break;
+      case 'o': vertex_order_ = std::string(opt_arg);       break;
+      case 'N': graph_place_.interleave = true;             break;
+      case 'S': map_graph_ = stream_ = true;                break;
+      case 'x': ParsePlacementArg(opt, opt_arg, &graph_place_); break;
+    }
+  }
+
+  void ParsePlacementArg(signed char opt, char* opt_arg, Placement *place) {
+    if (!ParsePlacement(opt_arg, place)) {
+      std::cout << "Bad placement (-" << opt << "): " << opt_arg << std::endl;
+      std::exit(-1);
     }
   }
 
@@ -107,6 +140,12 @@ class CLBase {
   bool symmetrize() const { return symmetrize_; }
   bool uniform() const { return uniform_; }
   bool in_place() const { return in_place_; }
+  bool map_graph() const { return map_graph_; }
+  bool map_populate() const { return map_populate_; }
+  bool map_huge() const { return map_huge_; }
+  const Placement& graph_placement() const { return graph_place_; }
+  bool stream() const { return stream_; }
+  const std::string& vertex_order() const { return vertex_order_; }
 };
 
 
@@ -117,15 +156,21 @@ class CLApp : public CLBase {
   int64_t start_vertex_ = -1;
   bool do_verify_ = false;
   bool enable_logging_ = false;
+  bool compressed_ = false;
+  bool trial_json_ = false;
+  Placement property_place_;
 
  public:
   CLApp(int argc, char** argv, std::string name) : CLBase(argc, argv, name) {
-    get_args_ += "an:r:vl";
+    get_args_ += "an:r:vlcjy:";
     AddHelpLine('a', "", "output analysis of last run", "false");
     AddHelpLine('n', "n", "perform n trials", std::to_string(num_trials_));
     AddHelpLine('r', "node", "start from node r", "rand");
     AddHelpLine('v', "", "verify the output of each run", "false");
     AddHelpLine('l', "", "log performance within each trial", "false");
+    AddHelpLine('c', "", "compress neighborhoods (bfs, pr only)", "false");
+    AddHelpLine('j', "", "print each trial (and counters) as JSON", "false");
+    AddHelpLine('y', "place", "place vertex properties (like -x)", "none");
   }
 
   void HandleArg(signed char opt, char* opt_arg) override {
@@ -135,6 +180,9 @@ class CLApp : public CLBase {
       case 'r': start_vertex_ = atol(opt_arg);          break;
       case 'v': do_verify_ = true;                      break;
       case 'l': enable_logging_ = true;                 break;
+      case 'c': compressed_ = true;                     break;
+      case 'j': trial_json_ = true;                     break;
+      case 'y': ParsePlacementArg(opt, opt_arg, &property_place_); break;
       default: CLBase::HandleArg(opt, opt_arg);
     }
   }
@@ -144,6 +192,9 @@ class CLApp : public CLBase {
   int64_t start_vertex() const { return start_vertex_; }
   bool do_verify() const { return do_verify_; }
   bool logging_en() const { return enable_logging_; }
+  bool compressed() const { return compressed_; }
+  bool trial_json() const { return trial_json_; }
+  const Placement& property_placement() const { return property_place_; }
 };
 
 
@@ -169,6 +220,29 @@ class CLIterApp : public CLApp {
 };
 
 
+class CLBatchIterApp : public CLIterApp {
+  int batch_size_;
+
+ public:
+  CLBatchIterApp(int argc, char** argv, std::string name, int num_iters,
+                 int batch_size) :
+    CLIterApp(argc, argv, name, num_iters), batch_size_(batch_size) {
+    get_args_ += "b:";
+    AddHelpLine('b', "b", "traverse from b sources at once (at most 64)",
+                std::to_string(batch_size_));
+  }
+
+  void HandleArg(signed char opt, char* opt_arg) override {
+    switch (opt) {
+      case 'b': batch_size_ = atoi(opt_arg);           break;
+      default: CLIterApp::HandleArg(opt, opt_arg);
+    }
+  }
+
+  int batch_size() const { return batch_size_; }
+};
+
+
 
 class CLPageRank : public CLApp {
   int max_iters_;
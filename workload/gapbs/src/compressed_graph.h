@@ -0,0 +1,250 @@
+// Copyright (c) 2015, The Regents of the University of California (Regents)
+// See LICENSE.txt for license details
+
+#ifndef COMPRESSED_GRAPH_H_
+#define COMPRESSED_GRAPH_H_
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include <cinttypes>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#include "graph.h"
+#include "pvector.h"
+#include "util.h"
+
+
+/*
+GAP Benchmark Suite
+Class:  CompressedGraph
+Author: Scott Beamer
+
+Read-only copy of an unweighted CSRGraph with compressed neighborhoods
+ - Each neighborhood is delta-encoded (as in Ligra+): the first neighbor as
+   the zigzagged difference to the vertex, then the gaps between consecutive
+   neighbors, each as a byte-varint (7 bits per byte, high bit set on all
+   but the last byte)
+ - Neighborhoods are decoded sequentially by their iterator, so they only
+   support range-based for loops (with break), not random access
+ - With BMI2 (e.g. -march=native), a varint is decoded with one unaligned
+   load and a pext instead of a loop
+ - Provides the subset of the CSRGraph interface used by the kernels that
+   can run on it (bfs, pr)
+*/
+
+
+template <class NodeID_, bool MakeInverse = true>
+class CompressedGraph {
+  static_assert(std::is_integral<NodeID_>::value,
+                "only unweighted graphs can be compressed");
+
+  // Decoding may load 8 bytes from the start of the last varint
+  static const int kSlackBytes = 8;
+
+  static inline uint64_t Zigzag(int64_t x) {
+    return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+  }
+
+  static inline int64_t Unzigzag(uint64_t x) {
+    return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+  }
+
+  static inline int VarintBytes(uint64_t x) {
+    int num_bytes = 1;
+    while (x >= 0x80) {
+      x >>= 7;
+      num_bytes++;
+    }
+    return num_bytes;
+  }
+
+  static inline uint8_t* EncodeVarint(uint64_t x, uint8_t* out) {
+    while (x >= 0x80) {
+      *out++ = static_cast<uint8_t>(x) | 0x80;
+      x >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(x);
+    return out;
+  }
+
+  static inline uint64_t DecodeVarint(const uint8_t* &in) {
+    if (*in < 0x80)
+      return *in++;
+#ifdef __BMI2__
+    uint64_t word;
+    std::memcpy(&word, in, sizeof(word));
+    uint64_t len = (__builtin_ctzll(~word & 0x8080808080808080ULL) >> 3) + 1;
+    in += len;
+    return _pext_u64(word, 0x7f7f7f7f7f7f7f7fULL >> (64 - 8 * len));
+#else
+    uint64_t x = 0;
+    int shift = 0;
+    while (*in >= 0x80) {
+      x |= static_cast<uint64_t>(*in++ & 0x7f) << shift;
+      shift += 7;
+    }
+    return x | (static_cast<uint64_t>(*in++) << shift);
+#endif
+  }
+
+  class Neighborhood {
+    NodeID_ n_;
+    const uint8_t* bytes_;
+    int64_t degree_;
+   public:
+    Neighborhood(NodeID_ n, const uint8_t* bytes, int64_t degree) :
+        n_(n), bytes_(bytes), degree_(degree) {}
+
+    class iterator {
+      const uint8_t* next_;
+      int64_t left_;
+      NodeID_ v_;
+     public:
+      iterator(const uint8_t* next, int64_t left, NodeID_ n) :
+          next_(next), left_(left), v_(n) {
+        if (left_ > 0)
+          v_ = static_cast<NodeID_>(n + Unzigzag(DecodeVarint(next_)));
+      }
+      NodeID_ operator*() const { return v_; }
+      iterator& operator++() {
+        if (--left_ > 0)
+          v_ += static_cast<NodeID_>(DecodeVarint(next_));
+        return *this;
+      }
+      bool operator==(const iterator& other) const {
+        return left_ == other.left_;
+      }
+      bool operator!=(const iterator& other) const {
+        return left_ != other.left_;
+      }
+    };
+
+    iterator begin() const { return iterator(bytes_, degree_, n_); }
+    iterator end() const { return iterator(nullptr, 0, n_); }
+  };
+
+  // Encodes every neighborhood after its byte offset in index
+  static void Compress(const CSRGraph<NodeID_, NodeID_, MakeInverse> &g,
+                       bool transpose, pvector<SGOffset> &index,
+                       pvector<NodeID_> &degrees, pvector<uint8_t> &bytes) {
+    index.resize(g.num_nodes() + 1);
+    degrees.resize(g.num_nodes());
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (NodeID_ u=0; u < g.num_nodes(); u++) {
+      SGOffset num_bytes = 0;
+      NodeID_ prev = u;
+      bool first = true;
+      for (NodeID_ v : (transpose ? g.in_neigh(u) : g.out_neigh(u))) {
+        num_bytes += VarintBytes(first ? Zigzag(static_cast<int64_t>(v) - u) :
+                                         static_cast<uint64_t>(v - prev));
+        prev = v;
+        first = false;
+      }
+      index[u] = num_bytes;
+      degrees[u] = transpose ? g.in_degree(u) : g.out_degree(u);
+    }
+    SGOffset total = 0;
+    for (NodeID_ u=0; u < g.num_nodes(); u++) {
+      SGOffset num_bytes = index[u];
+      index[u] = total;
+      total += num_bytes;
+    }
+    index[g.num_nodes()] = total;
+    bytes.resize(total + kSlackBytes);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (NodeID_ u=0; u < g.num_nodes(); u++) {
+      uint8_t* out = bytes.data() + index[u];
+      NodeID_ prev = u;
+      bool first = true;
+      for (NodeID_ v : (transpose ? g.in_neigh(u) : g.out_neigh(u))) {
+        out = EncodeVarint(first ? Zigzag(static_cast<int64_t>(v) - u) :
+                                   static_cast<uint64_t>(v - prev), out);
+        prev = v;
+        first = false;
+      }
+    }
+    std::memset(bytes.data() + total, 0, kSlackBytes);
+  }
+
+ public:
+  // Neighborhoods of g must be sorted, as built by a Builder
+  explicit CompressedGraph(const CSRGraph<NodeID_, NodeID_, MakeInverse> &g) :
+      directed_(g.directed()), num_nodes_(g.num_nodes()),
+      num_edges_(g.num_edges()) {
+    Compress(g, false, out_index_, out_degrees_, out_bytes_);
+    if (directed_ && MakeInverse)
+      Compress(g, true, in_index_, in_degrees_, in_bytes_);
+  }
+
+  bool directed() const {
+    return directed_;
+  }
+
+  int64_t num_nodes() const {
+    return num_nodes_;
+  }
+
+  int64_t num_edges() const {
+    return num_edges_;
+  }
+
+  int64_t num_edges_directed() const {
+    return directed_ ? num_edges_ : 2*num_edges_;
+  }
+
+  int64_t out_degree(NodeID_ v) const {
+    return out_degrees_[v];
+  }
+
+  int64_t in_degree(NodeID_ v) const {
+    static_assert(MakeInverse, "Graph inversion disabled but reading inverse");
+    return directed_ ? in_degrees_[v] : out_degrees_[v];
+  }
+
+  Neighborhood out_neigh(NodeID_ n) const {
+    return Neighborhood(n, out_bytes_.data() + out_index_[n], out_degrees_[n]);
+  }
+
+  Neighborhood in_neigh(NodeID_ n) const {
+    static_assert(MakeInverse, "Graph inversion disabled but reading inverse");
+    if (!directed_)
+      return out_neigh(n);
+    return Neighborhood(n, in_bytes_.data() + in_index_[n], in_degrees_[n]);
+  }
+
+  void PrintStats() const {
+    std::cout << "Graph has " << num_nodes_ << " nodes and "
+              << num_edges_ << " ";
+    if (!directed_)
+      std::cout << "un";
+    std::cout << "directed edges for degree: ";
+    std::cout << num_edges_/num_nodes_ << std::endl;
+    int64_t num_bytes = out_index_[num_nodes_] +
+                        (directed_ && MakeInverse ? in_index_[num_nodes_] : 0);
+    int64_t num_stored = directed_ && MakeInverse ? 2*num_edges_ :
+                                                    num_edges_directed();
+    PrintLabel("Bytes per edge",
+               std::to_string(static_cast<double>(num_bytes) / num_stored));
+  }
+
+  Range<NodeID_> vertices() const {
+    return Range<NodeID_>(num_nodes());
+  }
+
+ private:
+  bool directed_;
+  int64_t num_nodes_;
+  int64_t num_edges_;
+  pvector<SGOffset> out_index_;
+  pvector<NodeID_>  out_degrees_;
+  pvector<uint8_t>  out_bytes_;
+  pvector<SGOffset> in_index_;
+  pvector<NodeID_>  in_degrees_;
+  pvector<uint8_t>  in_bytes_;
+};
+
+#endif  // COMPRESSED_GRAPH_H_
@@ -23,6 +23,8 @@ Author: Scott Beamer
 Given scale and degree, generates edgelist for synthetic graph
  - Intended to be called from Builder
  - GenerateEL(uniform) generates and returns the edgelist
+ - ForEachEdge(uniform, weighted, edge) generates the edges without storing
+   them, the same ones each time
  - Can generate uniform random (uniform=true) or R-MAT graph according
    to Graph500 parameters (uniform=false)
  - Can also randomize weights within a weighted edgelist (InsertWeights)
@@ -90,78 +92,77 @@ class Generator {
     }
   }
 
-  void PermuteIDs(EdgeList &el) {
+  // Random relabeling of the vertices of an R-MAT graph, so the degree of a
+  // vertex does not depend on its ID
+  pvector<NodeID_> Permutation() {
     pvector<NodeID_> permutation(num_nodes_);
     rng_t_ rng(kRandSeed);
     #pragma omp parallel for
     for (NodeID_ n=0; n < num_nodes_; n++)
       permutation[n] = n;
     shuffle(permutation.begin(), permutation.end(), rng);
-    #pragma omp parallel for
-    for (int64_t e=0; e < num_edges_; e++)
-      el[e] = Edge(permutation[el[e].u], permutation[el[e].v]);
+    return permutation;
   }
 
-  EdgeList MakeUniformEL() {
-    EdgeList el(num_edges_);
-    #pragma omp parallel
-    {
-      rng_t_ rng;
-      UniDist<NodeID_, rng_t_> udist(num_nodes_-1, rng);
-      #pragma omp for
-      for (int64_t block=0; block < num_edges_; block+=block_size) {
-        rng.seed(kRandSeed + block/block_size);
-        for (int64_t e=block; e < std::min(block+block_size, num_edges_); e++) {
-          el[e] = Edge(udist(), udist());
-        }
-      }
-    }
-    return el;
-  }
-
-  EdgeList MakeRMatEL() {
+  // Calls edge(e, u, v, w) for every edge e of the graph from many threads,
+  // w being its weight as InsertWeights gives it if weighted. Every call
+  // produces the same edges, so a graph can be built in several passes over
+  // them instead of from a stored edgelist (see Builder)
+  template <typename EdgeFunc>
+  void ForEachEdge(bool uniform, bool weighted, EdgeFunc edge) {
     const uint32_t max = std::numeric_limits<uint32_t>::max();
     const uint32_t A = 0.57*max, B = 0.19*max, C = 0.19*max;
-    EdgeList el(num_edges_);
+    if (!uniform && permutation_.empty())
+      permutation_ = Permutation();
     #pragma omp parallel
     {
-      std::mt19937 rng;
+      rng_t_ rng, weight_rng;
+      std::mt19937 rmat_rng;
+      UniDist<NodeID_, rng_t_> udist(num_nodes_-1, rng);
+      UniDist<WeightT_, rng_t_> wdist(254, weight_rng);
       #pragma omp for
       for (int64_t block=0; block < num_edges_; block+=block_size) {
         rng.seed(kRandSeed + block/block_size);
+        rmat_rng.seed(kRandSeed + block/block_size);
+        weight_rng.seed(kRandSeed + block/block_size);
         for (int64_t e=block; e < std::min(block+block_size, num_edges_); e++) {
           NodeID_ src = 0, dst = 0;
-          for (int depth=0; depth < scale_; depth++) {
-            uint32_t rand_point = rng();
-            src = src << 1;
-            dst = dst << 1;
-            if (rand_point < A+B) {
-              if (rand_point > A)
-                dst++;
-            } else {
-              src++;
-              if (rand_point > A+B+C)
-                dst++;
+          if (uniform) {
+            Edge pair(udist(), udist());
+            src = pair.u;
+            dst = pair.v;
+          } else {
+            for (int depth=0; depth < scale_; depth++) {
+              uint32_t rand_point = rmat_rng();
+              src = src << 1;
+              dst = dst << 1;
+              if (rand_point < A+B) {
+                if (rand_point > A)
+                  dst++;
+              } else {
+                src++;
+                if (rand_point > A+B+C)
+                  dst++;
+              }
             }
+            src = permutation_[src];
+            dst = permutation_[dst];
           }
-          el[e] = Edge(src, dst);
+          WeightT_ w = weighted ? static_cast<WeightT_>(wdist()+1) : 1;
+          edge(e, src, dst, w);
         }
       }
     }
-    PermuteIDs(el);
-    // TIME_PRINT("Shuffle", std::shuffle(el.begin(), el.end(),
-    //                                    std::mt19937()));
-    return el;
   }
 
   EdgeList GenerateEL(bool uniform) {
-    EdgeList el;
+    EdgeList el(num_edges_);
     Timer t;
     t.Start();
-    if (uniform)
-      el = MakeUniformEL();
-    else
-      el = MakeRMatEL();
+    ForEachEdge(uniform, false,
+                [&el](int64_t e, NodeID_ u, NodeID_ v, WeightT_ w) {
+                  el[e] = Edge(u, v);
+                });
     t.Stop();
     PrintTime("Generate Time", t.Seconds());
     return el;
@@ -190,6 +191,7 @@ class Generator {
   int scale_;
   int64_t num_nodes_;
   int64_t num_edges_;
+  pvector<NodeID_> permutation_;
   static const int64_t block_size = 1<<18;
 };
 
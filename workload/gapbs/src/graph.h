@@ -4,6 +4,9 @@
 #ifndef GRAPH_H_
 #define GRAPH_H_
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cinttypes>
 #include <cstddef>
@@ -93,6 +96,23 @@ typedef int32_t SGID;
 typedef EdgePair<SGID> SGEdge;
 typedef int64_t SGOffset;
 
+// Header of the mappable serialized layout: the magic takes the place of the
+// directed flag of the original layout (whose first byte is 0 or 1) and all
+// fields are 8 bytes, so the offsets and neighbors that follow are aligned and
+// can be used in place. Each neighbor array is padded to a multiple of 8 bytes
+struct SGHeader {
+  char magic[8];
+  int64_t directed;
+  SGOffset num_edges;
+  SGOffset num_nodes;
+};
+
+static const char kSGMagic[8] = {'G', 'A', 'P', 'B', 'S', 'S', 'G', '1'};
+
+inline SGOffset SGAlign(SGOffset num_bytes) {
+  return (num_bytes + 7) & ~static_cast<SGOffset>(7);
+}
+
 
 
 template <class NodeID_, class DestID_ = NodeID_, bool MakeInverse = true>
@@ -102,21 +122,25 @@ class CSRGraph {
 
   // Used to access neighbors of vertex, basically sugar for iterators
   class Neighborhood {
-    NodeID_ n_;
-    DestID_** g_index_;
-    OffsetT start_offset_;
+    DestID_* begin_;
+    DestID_* end_;
    public:
-    Neighborhood(NodeID_ n, DestID_** g_index, OffsetT start_offset) :
-        n_(n), g_index_(g_index), start_offset_(0) {
-      OffsetT max_offset = end() - begin();
-      start_offset_ = std::min(start_offset, max_offset);
+    Neighborhood(NodeID_ n, const SGOffset* g_index, DestID_* g_neighs,
+                 OffsetT start_offset) :
+        begin_(g_neighs + g_index[n]), end_(g_neighs + g_index[n+1]) {
+      OffsetT max_offset = end_ - begin_;
+      begin_ += std::min(start_offset, max_offset);
     }
     typedef DestID_* iterator;
-    iterator begin() { return g_index_[n_] + start_offset_; }
-    iterator end()   { return g_index_[n_+1]; }
+    iterator begin() { return begin_; }
+    iterator end()   { return end_; }
   };
 
   void ReleaseResources() {
+    if (mapping_ != nullptr) {
+      munmap(mapping_, mapping_length_);
+      return;
+    }
     if (out_index_ != nullptr)
       delete[] out_index_;
     if (out_neighbors_ != nullptr)
@@ -135,15 +159,15 @@ class CSRGraph {
     out_index_(nullptr), out_neighbors_(nullptr),
     in_index_(nullptr), in_neighbors_(nullptr) {}
 
-  CSRGraph(int64_t num_nodes, DestID_** index, DestID_* neighs) :
+  CSRGraph(int64_t num_nodes, SGOffset* index, DestID_* neighs) :
     directed_(false), num_nodes_(num_nodes),
     out_index_(index), out_neighbors_(neighs),
     in_index_(index), in_neighbors_(neighs) {
       num_edges_ = (out_index_[num_nodes_] - out_index_[0]) / 2;
     }
 
-  CSRGraph(int64_t num_nodes, DestID_** out_index, DestID_* out_neighs,
-        DestID_** in_index, DestID_* in_neighs) :
+  CSRGraph(int64_t num_nodes, SGOffset* out_index, DestID_* out_neighs,
+        SGOffset* in_index, DestID_* in_neighs) :
     directed_(true), num_nodes_(num_nodes),
     out_index_(out_index), out_neighbors_(out_neighs),
     in_index_(in_index), in_neighbors_(in_neighs) {
@@ -153,13 +177,18 @@ class CSRGraph {
   CSRGraph(CSRGraph&& other) : directed_(other.directed_),
     num_nodes_(other.num_nodes_), num_edges_(other.num_edges_),
     out_index_(other.out_index_), out_neighbors_(other.out_neighbors_),
-    in_index_(other.in_index_), in_neighbors_(other.in_neighbors_) {
+    in_index_(other.in_index_), in_neighbors_(other.in_neighbors_),
+    mapping_(other.mapping_), mapping_length_(other.mapping_length_),
+    streamed_(other.streamed_) {
       other.num_edges_ = -1;
       other.num_nodes_ = -1;
       other.out_index_ = nullptr;
       other.out_neighbors_ = nullptr;
       other.in_index_ = nullptr;
       other.in_neighbors_ = nullptr;
+      other.mapping_ = nullptr;
+      other.mapping_length_ = 0;
+      other.streamed_ = false;
   }
 
   ~CSRGraph() {
@@ -176,12 +205,18 @@ class CSRGraph {
       out_neighbors_ = other.out_neighbors_;
       in_index_ = other.in_index_;
       in_neighbors_ = other.in_neighbors_;
+      mapping_ = other.mapping_;
+      mapping_length_ = other.mapping_length_;
+      streamed_ = other.streamed_;
       other.num_edges_ = -1;
       other.num_nodes_ = -1;
       other.out_index_ = nullptr;
       other.out_neighbors_ = nullptr;
       other.in_index_ = nullptr;
       other.in_neighbors_ = nullptr;
+      other.mapping_ = nullptr;
+      other.mapping_length_ = 0;
+      other.streamed_ = false;
     }
     return *this;
   }
@@ -212,12 +247,12 @@ class CSRGraph {
   }
 
   Neighborhood out_neigh(NodeID_ n, OffsetT start_offset = 0) const {
-    return Neighborhood(n, out_index_, start_offset);
+    return Neighborhood(n, out_index_, out_neighbors_, start_offset);
   }
 
   Neighborhood in_neigh(NodeID_ n, OffsetT start_offset = 0) const {
     static_assert(MakeInverse, "Graph inversion disabled but reading inverse");
-    return Neighborhood(n, in_index_, start_offset);
+    return Neighborhood(n, in_index_, in_neighbors_, start_offset);
   }
 
   void PrintStats() const {
@@ -239,12 +274,58 @@ class CSRGraph {
     }
   }
 
-  static DestID_** GenIndex(const pvector<SGOffset> &offsets, DestID_* neighs) {
+  // Index and neighbors point into a file mapping (see Reader), which is
+  // unmapped on release instead of freeing them. A streamed graph is
+  // processed in edge blocks by the kernels that support it (see
+  // ForEachEdgeBlock in benchmark.h)
+  void SetMapping(void* addr, size_t length, bool streamed = false) {
+    mapping_ = addr;
+    mapping_length_ = length;
+    streamed_ = streamed;
+  }
+
+  bool streamed() const {
+    return streamed_;
+  }
+
+  // First vertex after begin whose neighbors start at least num_edges after
+  // those of begin (or num_nodes), so [begin, end) is a block of edges
+  NodeID_ EdgeBlockEnd(NodeID_ begin, SGOffset num_edges,
+                       bool in_graph = false) const {
+    const SGOffset* index = in_graph ? in_index_ : out_index_;
+    return std::lower_bound(index + begin + 1, index + num_nodes_,
+                            index[begin] + num_edges) - index;
+  }
+
+  // Passes advice (madvise) on the pages holding the neighbors of
+  // [begin, end) of a mapped graph, does nothing for a graph in memory
+  void AdviseNeighs(NodeID_ begin, NodeID_ end, int advice,
+                    bool in_graph = false) const {
+    if (mapping_ == nullptr)
+      return;
+    const uintptr_t kPageSize = sysconf(_SC_PAGESIZE);
+    const SGOffset* index = in_graph ? in_index_ : out_index_;
+    const DestID_* neighs = in_graph ? in_neighbors_ : out_neighbors_;
+    uintptr_t start = reinterpret_cast<uintptr_t>(neighs + index[begin]) &
+                      ~(kPageSize - 1);
+    uintptr_t stop = reinterpret_cast<uintptr_t>(neighs + index[end]);
+    if (start < stop)
+      madvise(reinterpret_cast<void*>(start), stop - start, advice);
+  }
+
+  // The index holds the offset of each neighborhood into the neighbors rather
+  // than a pointer, so it is the same data as the offsets and can be
+  // serialized or mapped as is. The pages of the index are placed like those
+  // of the neighbors (see Builder)
+  static SGOffset* GenIndex(const pvector<SGOffset> &offsets,
+                            const Placement &place = Placement()) {
     NodeID_ length = offsets.size();
-    DestID_** index = new DestID_*[length];
+    SGOffset* index = new SGOffset[length];
+    if (place.any())
+      PlacePages(index, length * sizeof(SGOffset), place);
     #pragma omp parallel for
     for (NodeID_ n=0; n < length; n++)
-      index[n] = neighs + offsets[n];
+      index[n] = offsets[n];
     return index;
   }
 
@@ -266,10 +347,13 @@ class CSRGraph {
   bool directed_;
   int64_t num_nodes_;
   int64_t num_edges_;
-  DestID_** out_index_;
+  SGOffset* out_index_;
   DestID_*  out_neighbors_;
-  DestID_** in_index_;
+  SGOffset* in_index_;
   DestID_*  in_neighbors_;
+  void*     mapping_ = nullptr;
+  size_t    mapping_length_ = 0;
+  bool      streamed_ = false;
 };
 
 #endif  // GRAPH_H_
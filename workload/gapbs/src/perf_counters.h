@@ -0,0 +1,117 @@
+// Copyright (c) 2015, The Regents of the University of California (Regents)
+// See LICENSE.txt for license details
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+
+/*
+GAP Benchmark Suite
+Class:  PerfCounters
+Author: Scott Beamer
+
+Counts memory events of the kernels with perf_event_open
+ - Each event is counted by one counter per OpenMP thread, opened by the
+   thread itself inside a parallel region, so the threads of the (reused)
+   thread pool are counted as well as the main thread
+ - Only user-space events are counted, so perf_event_paranoid up to 2 works
+ - An event the machine (or VM) does not support is not available, Count()
+   then returns -1
+*/
+
+
+class PerfCounters {
+ public:
+  enum Event { kLLCMisses, kLLCReadMisses, kNumEvents };
+
+  PerfCounters() {
+    #pragma omp parallel
+    {
+      int fds[kNumEvents];
+      for (int e=0; e < kNumEvents; e++)
+        fds[e] = Open(static_cast<Event>(e));
+      #pragma omp critical
+      {
+        for (int e=0; e < kNumEvents; e++) {
+          if (fds[e] == -1)
+            failed_[e] = true;
+          else
+            fds_[e].push_back(fds[e]);
+        }
+      }
+    }
+  }
+
+  ~PerfCounters() {
+    for (int e=0; e < kNumEvents; e++)
+      for (int fd : fds_[e])
+        close(fd);
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  void Start() {
+    for (int e=0; e < kNumEvents; e++) {
+      for (int fd : fds_[e]) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  void Stop() {
+    for (int e=0; e < kNumEvents; e++)
+      for (int fd : fds_[e])
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  }
+
+  // Sum over all threads since Start(), -1 if not available
+  int64_t Count(Event e) const {
+    if (failed_[e] || fds_[e].empty())
+      return -1;
+    int64_t total = 0;
+    for (int fd : fds_[e]) {
+      uint64_t count;
+      if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+      total += count;
+    }
+    return total;
+  }
+
+ private:
+  static int Open(Event e) {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    if (e == kLLCMisses) {
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    } else {
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_LL |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  std::vector<int> fds_[kNumEvents];
+  bool failed_[kNumEvents] = {};
+};
+
+#endif  // PERF_COUNTERS_H_
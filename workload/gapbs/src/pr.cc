@@ -3,8 +3,13 @@
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
 #include <vector>
 
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
 #include "benchmark.h"
 #include "builder.h"
 #include "command_line.h"
@@ -21,7 +26,16 @@ Will return pagerank scores for all vertices once total change < epsilon
 This PR implementation uses the traditional iterative approach. It performs
 updates in the pull direction to remove the need for atomics, and it allows
 new values to be immediately visible (like Gauss-Seidel method). The prior PR
-implementation is still available in src/pr_spmv.cc.
+implementation is still available in src/pr_spmv.cc. Each iteration goes over
+the vertices in blocks of edges, so a streamed graph (-S) only needs a few
+blocks of neighbors resident at a time.
+
+The vertices of a block are split into ranges of about equal numbers of
+in-edges, a few per thread, which the threads take one at a time. A hub that
+has more in-edges than a range is left out of its range, and the sum over its
+in-neighbors is split into slices that different threads add up, so one
+vertex does not keep a thread busy while the others wait at the end of the
+iteration.
 */
 
 
@@ -30,28 +44,210 @@ using namespace std;
 typedef float ScoreT;
 const float kDamp = 0.85;
 
+// Ranges of pull work per thread, so the last ranges even out
+const int64_t kRangesPerThread = 8;
+
+
+int NumThreads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+
+// Sum of contrib over in-neighbors [first, last) of u, the array based graph
+// can start at any of them
+template <typename NodeID_, typename DestID_, bool MakeInverse>
+ScoreT SumContribs(const CSRGraph<NodeID_, DestID_, MakeInverse> &g, NodeID u,
+                   int64_t first, int64_t last,
+                   const pvector<ScoreT> &contrib) {
+  auto neighs = g.in_neigh(u, first);
+  auto stop = min(neighs.end(), neighs.begin() + (last - first));
+  ScoreT total = 0;
+  for (auto it = neighs.begin(); it < stop; it++)
+    total += contrib[*it];
+  return total;
+}
+
+template <typename NodeID_, typename DestID_, bool MakeInverse>
+bool CanSliceNeighs(const CSRGraph<NodeID_, DestID_, MakeInverse> &g) {
+  return true;
+}
+
+// Other graphs (compressed) are only read from the first neighbor on, so their
+// hubs are not split
+template <typename GraphT_>
+ScoreT SumContribs(const GraphT_ &g, NodeID u, int64_t first, int64_t last,
+                   const pvector<ScoreT> &contrib) {
+  ScoreT total = 0;
+  int64_t i = 0;
+  for (NodeID v : g.in_neigh(u)) {
+    if (i >= first && i < last)
+      total += contrib[v];
+    i++;
+  }
+  return total;
+}
+
+template <typename GraphT_>
+bool CanSliceNeighs(const GraphT_ &g) {
+  return false;
+}
+
+
+// The pull work of the vertices [begin, end) of an edge block. Range r is
+// [bounds[r], bounds[r+1]) without its hubs (in-degree over hub_degree). The
+// in-neighbors of hubs[h] are split into the slices [hub_slices[h],
+// hub_slices[h+1]), slice s of hubs[slice_hub[s]] starting at its in-neighbor
+// slice_first[s] and spanning (up to) slice_edges of them
+struct PullPlan {
+  vector<NodeID> bounds;
+  vector<NodeID> hubs;
+  vector<size_t> hub_slices;
+  vector<size_t> slice_hub;
+  vector<int64_t> slice_first;
+  int64_t hub_degree;
+  int64_t slice_edges;
+};
+
+
+// Balances the ranges by their in-edges plus one per vertex, found with two
+// parallel passes over chunks of the vertices: the work of each chunk, then
+// where the ranges (multiples of the work per range) start within it
+template <typename GraphT_>
+PullPlan MakePullPlan(const GraphT_ &g, NodeID begin, NodeID end) {
+  PullPlan plan;
+  const int64_t num_ranges = NumThreads() * kRangesPerThread;
+  const NodeID num_chunks = max<NodeID>(min<int64_t>(num_ranges, end - begin),
+                                        1);
+  const NodeID chunk_size = (end - begin + num_chunks - 1) / num_chunks;
+  auto chunk_begin = [&](NodeID c) {
+    return min<NodeID>(begin + c * chunk_size, end);
+  };
+  vector<int64_t> chunk_work(num_chunks + 1, 0);
+  auto sum_chunks = [&](int64_t hub_degree) {
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (NodeID c=0; c < num_chunks; c++) {
+      int64_t work = 0;
+      for (NodeID u=chunk_begin(c); u < chunk_begin(c+1); u++) {
+        int64_t degree = g.in_degree(u);
+        work += 1 + (degree > hub_degree ? 0 : degree);
+      }
+      chunk_work[c] = work;
+    }
+    int64_t total = 0;
+    for (NodeID c=0; c <= num_chunks; c++) {
+      int64_t work = c < num_chunks ? chunk_work[c] : 0;
+      chunk_work[c] = total;
+      total += work;
+    }
+    return total;
+  };
+  const int64_t kNoHubs = numeric_limits<int64_t>::max();
+  plan.hub_degree = kNoHubs;
+  if (CanSliceNeighs(g))
+    plan.hub_degree = max<int64_t>(sum_chunks(kNoHubs) / num_ranges, 1);
+  plan.slice_edges = max<int64_t>(sum_chunks(plan.hub_degree) / num_ranges,
+                                  1);
+  vector<vector<NodeID>> chunk_bounds(num_chunks), chunk_hubs(num_chunks);
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (NodeID c=0; c < num_chunks; c++) {
+    int64_t work = chunk_work[c];
+    for (NodeID u=chunk_begin(c); u < chunk_begin(c+1); u++) {
+      int64_t degree = g.in_degree(u);
+      int64_t next_work = work + 1 + (degree > plan.hub_degree ? 0 : degree);
+      if (u != begin && work / plan.slice_edges != next_work / plan.slice_edges)
+        chunk_bounds[c].push_back(u);
+      if (degree > plan.hub_degree)
+        chunk_hubs[c].push_back(u);
+      work = next_work;
+    }
+  }
+  plan.bounds.push_back(begin);
+  for (NodeID c=0; c < num_chunks; c++) {
+    plan.bounds.insert(plan.bounds.end(), chunk_bounds[c].begin(),
+                       chunk_bounds[c].end());
+    plan.hubs.insert(plan.hubs.end(), chunk_hubs[c].begin(),
+                     chunk_hubs[c].end());
+  }
+  plan.bounds.push_back(end);
+  for (size_t h=0; h < plan.hubs.size(); h++) {
+    plan.hub_slices.push_back(plan.slice_first.size());
+    int64_t degree = g.in_degree(plan.hubs[h]);
+    for (int64_t first=0; first < degree; first += plan.slice_edges) {
+      plan.slice_hub.push_back(h);
+      plan.slice_first.push_back(first);
+    }
+  }
+  plan.hub_slices.push_back(plan.slice_first.size());
+  return plan;
+}
+
 
-pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
+template <typename GraphT_>
+pvector<ScoreT> PageRankPullGS(const GraphT_ &g, int max_iters,
+                               double epsilon = 0,
                                bool logging_enabled = false) {
   const ScoreT init_score = 1.0f / g.num_nodes();
   const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
-  pvector<ScoreT> scores(g.num_nodes(), init_score);
-  pvector<ScoreT> outgoing_contrib(g.num_nodes());
+  pvector<ScoreT> scores(g.num_nodes(), init_score, PropertyPlacement());
+  pvector<ScoreT> outgoing_contrib(g.num_nodes(), PropertyPlacement());
   #pragma omp parallel for
   for (NodeID n=0; n < g.num_nodes(); n++)
     outgoing_contrib[n] = init_score / g.out_degree(n);
+  auto update = [&](NodeID u, ScoreT incoming_total) {
+    ScoreT old_score = scores[u];
+    scores[u] = base_score + kDamp * incoming_total;
+    outgoing_contrib[u] = scores[u] / g.out_degree(u);
+    return fabs(scores[u] - old_score);
+  };
+  // planned in the first iteration, the blocks are the same in every one
+  vector<PullPlan> plans;
+  vector<ScoreT> slice_totals;
   for (int iter=0; iter < max_iters; iter++) {
     double error = 0;
-    #pragma omp parallel for reduction(+ : error) schedule(dynamic, 16384)
-    for (NodeID u=0; u < g.num_nodes(); u++) {
-      ScoreT incoming_total = 0;
-      for (NodeID v : g.in_neigh(u))
-        incoming_total += outgoing_contrib[v];
-      ScoreT old_score = scores[u];
-      scores[u] = base_score + kDamp * incoming_total;
-      error += fabs(scores[u] - old_score);
-      outgoing_contrib[u] = scores[u] / g.out_degree(u);
-    }
+    size_t block = 0;
+    ForEachEdgeBlock(g, true, [&](NodeID begin, NodeID end) {
+      if (block == plans.size())
+        plans.push_back(MakePullPlan(g, begin, end));
+      const PullPlan &plan = plans[block++];
+      double block_error = 0;
+      #pragma omp parallel for reduction(+ : block_error) schedule(dynamic, 1)
+      for (size_t r=0; r < plan.bounds.size() - 1; r++) {
+        const NodeID range_end = plan.bounds[r+1];
+        const int64_t hub_degree = plan.hub_degree;
+        for (NodeID u=plan.bounds[r]; u < range_end; u++) {
+          if (g.in_degree(u) > hub_degree)
+            continue;
+          ScoreT incoming_total = 0;
+          for (NodeID v : g.in_neigh(u))
+            incoming_total += outgoing_contrib[v];
+          block_error += update(u, incoming_total);
+        }
+      }
+      if (!plan.hubs.empty()) {
+        slice_totals.resize(plan.slice_first.size());
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t s=0; s < plan.slice_first.size(); s++) {
+          slice_totals[s] = SumContribs(g, plan.hubs[plan.slice_hub[s]],
+                                        plan.slice_first[s],
+                                        plan.slice_first[s] + plan.slice_edges,
+                                        outgoing_contrib);
+        }
+        double hub_error = 0;
+        #pragma omp parallel for reduction(+ : hub_error)
+        for (size_t h=0; h < plan.hubs.size(); h++) {
+          ScoreT incoming_total = 0;
+          for (size_t s=plan.hub_slices[h]; s < plan.hub_slices[h+1]; s++)
+            incoming_total += slice_totals[s];
+          hub_error += update(plan.hubs[h], incoming_total);
+        }
+        block_error += hub_error;
+      }
+      error += block_error;
+    });
     if (logging_enabled)
       PrintStep(iter, error);
     if (error < epsilon)
@@ -61,7 +257,8 @@ pvector<ScoreT> PageRankPullGS(const Graph &g, int max_iters, double epsilon=0,
 }
 
 
-void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
+template <typename GraphT_>
+void PrintTopScores(const GraphT_ &g, const pvector<ScoreT> &scores) {
   vector<pair<NodeID, ScoreT>> score_pairs(g.num_nodes());
   for (NodeID n=0; n < g.num_nodes(); n++) {
     score_pairs[n] = make_pair(n, scores[n]);
@@ -75,7 +272,8 @@ void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
 
 // Verifies by asserting a single serial iteration in push direction has
 //   error < target_error
-bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
+template <typename GraphT_>
+bool PRVerifier(const GraphT_ &g, const pvector<ScoreT> &scores,
                         double target_error) {
   const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
   pvector<ScoreT> incoming_sums(g.num_nodes(), 0);
@@ -94,18 +292,31 @@ bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
 }
 
 
+template <typename GraphT_>
+void RunPR(const CLPageRank &cli, const GraphT_ &g) {
+  auto PRBound = [&cli] (const GraphT_ &g) {
+    return PageRankPullGS(g, cli.max_iters(), cli.tolerance(), cli.logging_en());
+  };
+  auto VerifierBound = [&cli] (const GraphT_ &g,
+                               const pvector<ScoreT> &scores) {
+    return PRVerifier(g, scores, cli.tolerance());
+  };
+  BenchmarkKernel(cli, g, PRBound, PrintTopScores<GraphT_>, VerifierBound);
+}
+
+
 int main(int argc, char* argv[]) {
   CLPageRank cli(argc, argv, "pagerank", 1e-4, 20);
   if (!cli.ParseArgs())
     return -1;
   Builder b(cli);
   Graph g = b.MakeGraph();
-  auto PRBound = [&cli] (const Graph &g) {
-    return PageRankPullGS(g, cli.max_iters(), cli.tolerance(), cli.logging_en());
-  };
-  auto VerifierBound = [&cli] (const Graph &g, const pvector<ScoreT> &scores) {
-    return PRVerifier(g, scores, cli.tolerance());
-  };
-  BenchmarkKernel(cli, g, PRBound, PrintTopScores, VerifierBound);
+  if (cli.compressed()) {
+    CGraph cg(g);
+    g = Graph();
+    RunPR(cli, cg);
+  } else {
+    RunPR(cli, g);
+  }
   return 0;
 }
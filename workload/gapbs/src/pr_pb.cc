@@ -0,0 +1,178 @@
+// Copyright (c) 2015, The Regents of the University of California (Regents)
+// See LICENSE.txt for license details
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "benchmark.h"
+#include "builder.h"
+#include "command_line.h"
+#include "graph.h"
+#include "pvector.h"
+
+
+/*
+GAP Benchmark Suite
+Kernel: PageRank (PR)
+Author: Scott Beamer
+
+Will return pagerank scores for all vertices once total change < epsilon
+
+This PR implementation uses propagation blocking [1] so that no step of an
+iteration reads or writes a vertex array at random beyond a cache-sized
+slice. Destinations are partitioned into bins of consecutive vertices. Each
+iteration first pushes the contribution of every edge, in order of its source,
+into the bin of its destination, which only appends to as many streams as
+there are bins. It then applies each bin to its slice of the sums, which fits
+in cache. The destination of each binned contribution does not change across
+iterations, so it is only written once up front (deterministic propagation
+blocking), and values are not visible until the next iteration (like
+Jacobi-style method).
+
+[1] Scott Beamer, Krste Asanović, and David Patterson. "Reducing PageRank
+    Communication via Propagation Blocking." International Parallel &
+    Distributed Processing Symposium (IPDPS), 2017.
+*/
+
+
+using namespace std;
+
+typedef float ScoreT;
+const float kDamp = 0.85;
+
+// A bin covers 2^kBinBits destinations, so the sums it updates take 256KB
+const int kBinBits = 16;
+
+// Sources are split in chunks of about the same number of edges, each
+// binning into its own part of every bin so no two threads share a stream
+const int kNumChunks = 64;
+
+
+pvector<ScoreT> PageRankPB(const Graph &g, int max_iters, double epsilon = 0,
+                           bool logging_enabled = false) {
+  const ScoreT init_score = 1.0f / g.num_nodes();
+  const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
+  const int64_t num_bins = (g.num_nodes() + (1 << kBinBits) - 1) >> kBinBits;
+  pvector<ScoreT> scores(g.num_nodes(), init_score, PropertyPlacement());
+  pvector<ScoreT> sums(g.num_nodes(), 0, PropertyPlacement());
+  pvector<NodeID> chunk_starts(kNumChunks + 1);
+  const SGOffset edges_per_chunk = g.num_edges_directed() / kNumChunks + 1;
+  SGOffset edges_seen = 0;
+  int chunk = 1;
+  chunk_starts[0] = 0;
+  for (NodeID u=0; u < g.num_nodes(); u++) {
+    edges_seen += g.out_degree(u);
+    while (chunk < kNumChunks && edges_seen >= chunk * edges_per_chunk)
+      chunk_starts[chunk++] = u + 1;
+  }
+  while (chunk <= kNumChunks)
+    chunk_starts[chunk++] = g.num_nodes();
+  // Start of the part of bin b filled by chunk c at b * kNumChunks + c
+  pvector<SGOffset> bin_starts(num_bins * kNumChunks + 1, 0);
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (int c=0; c < kNumChunks; c++) {
+    for (NodeID u=chunk_starts[c]; u < chunk_starts[c+1]; u++)
+      for (NodeID v : g.out_neigh(u))
+        bin_starts[(v >> kBinBits) * kNumChunks + c]++;
+  }
+  SGOffset total = 0;
+  for (int64_t i=0; i < num_bins * kNumChunks + 1; i++) {
+    SGOffset count = bin_starts[i];
+    bin_starts[i] = total;
+    total += count;
+  }
+  pvector<NodeID> dests(g.num_edges_directed());
+  pvector<ScoreT> contribs(g.num_edges_directed());
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (int c=0; c < kNumChunks; c++) {
+    pvector<SGOffset> cursors(num_bins);
+    for (int64_t b=0; b < num_bins; b++)
+      cursors[b] = bin_starts[b * kNumChunks + c];
+    for (NodeID u=chunk_starts[c]; u < chunk_starts[c+1]; u++)
+      for (NodeID v : g.out_neigh(u))
+        dests[cursors[v >> kBinBits]++] = v;
+  }
+  for (int iter=0; iter < max_iters; iter++) {
+    double error = 0;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int c=0; c < kNumChunks; c++) {
+      pvector<SGOffset> cursors(num_bins);
+      for (int64_t b=0; b < num_bins; b++)
+        cursors[b] = bin_starts[b * kNumChunks + c];
+      for (NodeID u=chunk_starts[c]; u < chunk_starts[c+1]; u++) {
+        ScoreT outgoing_contrib = scores[u] / g.out_degree(u);
+        for (NodeID v : g.out_neigh(u))
+          contribs[cursors[v >> kBinBits]++] = outgoing_contrib;
+      }
+    }
+    #pragma omp parallel for reduction(+ : error) schedule(dynamic, 1)
+    for (int64_t b=0; b < num_bins; b++) {
+      for (SGOffset i=bin_starts[b * kNumChunks];
+           i < bin_starts[(b + 1) * kNumChunks]; i++)
+        sums[dests[i]] += contribs[i];
+      NodeID bin_end = min<int64_t>((b + 1) << kBinBits, g.num_nodes());
+      for (NodeID u=b << kBinBits; u < bin_end; u++) {
+        ScoreT old_score = scores[u];
+        scores[u] = base_score + kDamp * sums[u];
+        error += fabs(scores[u] - old_score);
+        sums[u] = 0;
+      }
+    }
+    if (logging_enabled)
+      PrintStep(iter, error);
+    if (error < epsilon)
+      break;
+  }
+  return scores;
+}
+
+
+void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
+  vector<pair<NodeID, ScoreT>> score_pairs(g.num_nodes());
+  for (NodeID n=0; n < g.num_nodes(); n++) {
+    score_pairs[n] = make_pair(n, scores[n]);
+  }
+  int k = 5;
+  vector<pair<ScoreT, NodeID>> top_k = TopK(score_pairs, k);
+  for (auto kvp : top_k)
+    cout << kvp.second << ":" << kvp.first << endl;
+}
+
+
+// Verifies by asserting a single serial iteration in push direction has
+//   error < target_error
+bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
+                        double target_error) {
+  const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
+  pvector<ScoreT> incoming_sums(g.num_nodes(), 0);
+  double error = 0;
+  for (NodeID u : g.vertices()) {
+    ScoreT outgoing_contrib = scores[u] / g.out_degree(u);
+    for (NodeID v : g.out_neigh(u))
+      incoming_sums[v] += outgoing_contrib;
+  }
+  for (NodeID n : g.vertices()) {
+    error += fabs(base_score + kDamp * incoming_sums[n] - scores[n]);
+    incoming_sums[n] = 0;
+  }
+  PrintTime("Total Error", error);
+  return error < target_error;
+}
+
+
+int main(int argc, char* argv[]) {
+  CLPageRank cli(argc, argv, "pagerank", 1e-4, 20);
+  if (!cli.ParseArgs())
+    return -1;
+  Builder b(cli);
+  Graph g = b.MakeGraph();
+  auto PRBound = [&cli] (const Graph &g) {
+    return PageRankPB(g, cli.max_iters(), cli.tolerance(), cli.logging_en());
+  };
+  auto VerifierBound = [&cli] (const Graph &g, const pvector<ScoreT> &scores) {
+    return PRVerifier(g, scores, cli.tolerance());
+  };
+  BenchmarkKernel(cli, g, PRBound, PrintTopScores, VerifierBound);
+  return 0;
+}
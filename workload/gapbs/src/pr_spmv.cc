@@ -36,8 +36,8 @@ pvector<ScoreT> PageRankPull(const Graph &g, int max_iters, double epsilon = 0,
                              bool logging_enabled = false) {
   const ScoreT init_score = 1.0f / g.num_nodes();
   const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
-  pvector<ScoreT> scores(g.num_nodes(), init_score);
-  pvector<ScoreT> outgoing_contrib(g.num_nodes());
+  pvector<ScoreT> scores(g.num_nodes(), init_score, PropertyPlacement());
+  pvector<ScoreT> outgoing_contrib(g.num_nodes(), PropertyPlacement());
   for (int iter=0; iter < max_iters; iter++) {
     double error = 0;
     #pragma omp parallel for
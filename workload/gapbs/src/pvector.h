@@ -6,6 +6,8 @@
 
 #include <algorithm>
 
+#include "util.h"
+
 
 /*
 GAP Benchmark Suite
@@ -16,6 +18,8 @@ Vector class with ability to not initialize or do initialization in parallel
  - std::vector (when resizing) will always initialize, and does so serially
  - When pvector is resized, new elements are uninitialized
  - Resizing is not thread-safe
+ - Can be given a Placement (util.h) for the pages of its storage, which it
+   keeps when it grows
 */
 
 
@@ -26,13 +30,16 @@ class pvector {
 
   pvector() : start_(nullptr), end_size_(nullptr), end_capacity_(nullptr) {}
 
-  explicit pvector(size_t num_elements) {
-    start_ = new T_[num_elements];
+  explicit pvector(size_t num_elements, const Placement &place = Placement())
+      : place_(place) {
+    start_ = Allocate(num_elements);
     end_size_ = start_ + num_elements;
     end_capacity_ = end_size_;
   }
 
-  pvector(size_t num_elements, T_ init_val) : pvector(num_elements) {
+  pvector(size_t num_elements, T_ init_val,
+          const Placement &place = Placement())
+      : pvector(num_elements, place) {
     fill(init_val);
   }
 
@@ -49,7 +56,7 @@ class pvector {
   // prefer move because too much data to copy
   pvector(pvector &&other)
       : start_(other.start_), end_size_(other.end_size_),
-        end_capacity_(other.end_capacity_) {
+        end_capacity_(other.end_capacity_), place_(other.place_) {
     other.start_ = nullptr;
     other.end_size_ = nullptr;
     other.end_capacity_ = nullptr;
@@ -62,6 +69,7 @@ class pvector {
       start_ = other.start_;
       end_size_ = other.end_size_;
       end_capacity_ = other.end_capacity_;
+      place_ = other.place_;
       other.start_ = nullptr;
       other.end_size_ = nullptr;
       other.end_capacity_ = nullptr;
@@ -82,7 +90,7 @@ class pvector {
   // not thread-safe
   void reserve(size_t num_elements) {
     if (num_elements > capacity()) {
-      T_ *new_range = new T_[num_elements];
+      T_ *new_range = Allocate(num_elements);
       #pragma omp parallel for
       for (size_t i=0; i < size(); i++)
         new_range[i] = start_[i];
@@ -159,13 +167,22 @@ class pvector {
     std::swap(start_, other.start_);
     std::swap(end_size_, other.end_size_);
     std::swap(end_capacity_, other.end_capacity_);
+    std::swap(place_, other.place_);
   }
 
 
  private:
+  T_* Allocate(size_t num_elements) {
+    T_* range = new T_[num_elements];
+    if (place_.any())
+      PlacePages(range, num_elements * sizeof(T_), place_);
+    return range;
+  }
+
   T_* start_;
   T_* end_size_;
   T_* end_capacity_;
+  Placement place_;
   static const size_t growth_factor = 2;
 };
 
@@ -4,6 +4,12 @@
 #ifndef READER_H_
 #define READER_H_
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -24,6 +30,8 @@ Given filename, returns an edgelist or the entire graph (if serialized)
  - Determines file format from the filename's suffix
  - If the input graph is serialized (.sg or .wsg), reads the graph
    directly into the returned graph instance
+ - If asked to and the serialized graph has the mappable layout, maps it and
+   uses its neighbor arrays in place
  - Otherwise, reads the file and returns an edgelist
 */
 
@@ -34,9 +42,24 @@ class Reader {
   typedef EdgePair<NodeID_, DestID_> Edge;
   typedef pvector<Edge> EdgeList;
   std::string filename_;
+  bool map_, populate_, huge_;
+  Placement place_;
+  bool stream_;
+
+  // Places the pages of a graph array before reading into it, see util.h
+  void PlaceArray(void* addr, size_t bytes) {
+    if (place_.any())
+      PlacePages(addr, bytes, place_);
+    ParallelFirstTouch(addr, bytes);
+  }
 
  public:
-  explicit Reader(std::string filename) : filename_(filename) {}
+  explicit Reader(std::string filename, bool map = false,
+                  bool populate = false, bool huge = false,
+                  const Placement &place = Placement(),
+                  bool stream = false) :
+    filename_(filename), map_(map), populate_(populate), huge_(huge),
+    place_(place), stream_(stream) {}
 
   std::string GetSuffix() {
     std::size_t suff_pos = filename_.rfind('.');
@@ -276,25 +299,50 @@ class Reader {
     }
     Timer t;
     t.Start();
+    SGHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(SGHeader));
+    bool mappable = file.gcount() == sizeof(SGHeader) &&
+        std::equal(kSGMagic, kSGMagic + sizeof(kSGMagic), header.magic);
+    if (mappable && map_) {
+      file.close();
+      return MapSerializedGraph(header, t);
+    }
+    if (map_)
+      std::cout << filename_ << " is not mappable, reading it instead "
+                << "(rewrite it with converter)" << std::endl;
     bool directed;
     SGOffset num_nodes, num_edges;
-    DestID_ **index = nullptr, **inv_index = nullptr;
+    SGOffset *index = nullptr, *inv_index = nullptr;
     DestID_ *neighs = nullptr, *inv_neighs = nullptr;
-    file.read(reinterpret_cast<char*>(&directed), sizeof(bool));
-    file.read(reinterpret_cast<char*>(&num_edges), sizeof(SGOffset));
-    file.read(reinterpret_cast<char*>(&num_nodes), sizeof(SGOffset));
-    pvector<SGOffset> offsets(num_nodes+1);
+    if (mappable) {
+      directed = header.directed;
+      num_edges = header.num_edges;
+      num_nodes = header.num_nodes;
+    } else {
+      file.clear();
+      file.seekg(0);
+      file.read(reinterpret_cast<char*>(&directed), sizeof(bool));
+      file.read(reinterpret_cast<char*>(&num_edges), sizeof(SGOffset));
+      file.read(reinterpret_cast<char*>(&num_nodes), sizeof(SGOffset));
+    }
+    index = new SGOffset[num_nodes+1];
     neighs = new DestID_[num_edges];
     std::streamsize num_index_bytes = (num_nodes+1) * sizeof(SGOffset);
     std::streamsize num_neigh_bytes = num_edges * sizeof(DestID_);
-    file.read(reinterpret_cast<char*>(offsets.data()), num_index_bytes);
+    std::streamsize num_pad_bytes =
+        mappable ? SGAlign(num_neigh_bytes) - num_neigh_bytes : 0;
+    PlaceArray(index, num_index_bytes);
+    PlaceArray(neighs, num_neigh_bytes);
+    file.read(reinterpret_cast<char*>(index), num_index_bytes);
     file.read(reinterpret_cast<char*>(neighs), num_neigh_bytes);
-    index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, neighs);
+    file.ignore(num_pad_bytes);
     if (directed && invert) {
+      inv_index = new SGOffset[num_nodes+1];
       inv_neighs = new DestID_[num_edges];
-      file.read(reinterpret_cast<char*>(offsets.data()), num_index_bytes);
+      PlaceArray(inv_index, num_index_bytes);
+      PlaceArray(inv_neighs, num_neigh_bytes);
+      file.read(reinterpret_cast<char*>(inv_index), num_index_bytes);
       file.read(reinterpret_cast<char*>(inv_neighs), num_neigh_bytes);
-      inv_index = CSRGraph<NodeID_, DestID_>::GenIndex(offsets, inv_neighs);
     }
     file.close();
     t.Stop();
@@ -305,6 +353,70 @@ class Reader {
     else
       return CSRGraph<NodeID_, DestID_, invert>(num_nodes, index, neighs);
   }
+
+ private:
+  // Maps the whole file and uses its offsets and neighbors in place as the
+  // index and neighbors of the graph. The mapping is private and read-only so
+  // nothing is copied and the page cache is shared with any other run on the
+  // same graph
+  CSRGraph<NodeID_, DestID_, invert> MapSerializedGraph(const SGHeader &header,
+                                                        Timer &t) {
+    int fd = open(filename_.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      std::cout << "Couldn't open file " << filename_ << std::endl;
+      std::exit(-6);
+    }
+    bool directed = header.directed;
+    SGOffset num_edges = header.num_edges;
+    SGOffset num_nodes = header.num_nodes;
+    SGOffset num_index_bytes = (num_nodes+1) * sizeof(SGOffset);
+    SGOffset num_neigh_bytes = SGAlign(num_edges * sizeof(DestID_));
+    SGOffset num_bytes = sizeof(SGHeader) +
+        (num_index_bytes + num_neigh_bytes) * (directed ? 2 : 1);
+    if (st.st_size < num_bytes) {
+      std::cout << filename_ << " is truncated" << std::endl;
+      std::exit(-6);
+    }
+    // Populated after the advice so huge pages can be used right away
+    int flags = MAP_PRIVATE | (populate_ && !huge_ ? MAP_POPULATE : 0);
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      std::cout << "Couldn't map file " << filename_ << std::endl;
+      std::exit(-6);
+    }
+    if (huge_) {
+      madvise(addr, st.st_size, MADV_HUGEPAGE);
+      if (populate_)
+#ifdef MADV_POPULATE_READ
+        madvise(addr, st.st_size, MADV_POPULATE_READ);
+#else
+        madvise(addr, st.st_size, MADV_WILLNEED);
+#endif
+    }
+    // Streamed neighbors are read ahead further and dropped sooner
+    if (stream_)
+      madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    char* pos = static_cast<char*>(addr) + sizeof(SGHeader);
+    SGOffset *index = nullptr, *inv_index = nullptr;
+    DestID_ *neighs = nullptr, *inv_neighs = nullptr;
+    index = reinterpret_cast<SGOffset*>(pos);
+    neighs = reinterpret_cast<DestID_*>(pos + num_index_bytes);
+    if (directed && invert) {
+      pos += num_index_bytes + num_neigh_bytes;
+      inv_index = reinterpret_cast<SGOffset*>(pos);
+      inv_neighs = reinterpret_cast<DestID_*>(pos + num_index_bytes);
+    }
+    t.Stop();
+    PrintTime("Read Time", t.Seconds());
+    CSRGraph<NodeID_, DestID_, invert> g = directed ?
+        CSRGraph<NodeID_, DestID_, invert>(num_nodes, index, neighs,
+                                           inv_index, inv_neighs) :
+        CSRGraph<NodeID_, DestID_, invert>(num_nodes, index, neighs);
+    g.SetMapping(addr, st.st_size, stream_);
+    return g;
+  }
 };
 
 #endif  // READER_H_
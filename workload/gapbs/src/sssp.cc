@@ -30,12 +30,15 @@ incorporates a new bucket fusion optimization [2] that significantly reduces
 the number of iterations (& barriers) needed.
 
 The bins of width delta are actually all thread-local and of type std::vector,
-so they can grow but are otherwise capacity-proportional. Each iteration is
+so they can grow but are otherwise capacity-proportional. Their storage is
+kept when they are emptied, so it is reused by later bins rather than
+reallocated every iteration. Each iteration is
 done in two phases separated by barriers. In the first phase, the current
 shared bin is processed by all threads. As they find vertices whose distance
 they are able to improve, they add them to their thread-local bins. During this
 phase, each thread also votes on what the next bin should be (smallest
-non-empty bin). In the next phase, each thread copies its selected
+non-empty bin), with an atomic min rather than a lock. In the next phase, each
+thread copies its selected
 thread-local bin into the shared bin.
 
 Once a vertex is added to a bin, it is not removed, even if its distance is
@@ -47,7 +50,9 @@ The bucket fusion optimization [2] executes the next thread-local bin in
 the same iteration if the vertices in the next thread-local bin have the
 same priority as those in the current shared bin. This optimization greatly
 reduces the number of iterations needed without violating the priority-based
-execution order, leading to significant speedup on large diameter road networks.
+execution order, leading to significant speedup on large diameter road networks. The fused
+bin is swapped out into a second thread-local vector before it is processed,
+so fusing does not copy or allocate either.
 
 [1] Ulrich Meyer and Peter Sanders. "δ-stepping: a parallelizable shortest path
     algorithm." Journal of Algorithms, 49(1):114–152, 2003.
@@ -87,7 +92,7 @@ void RelaxEdges(const WGraph &g, NodeID u, WeightT delta,
 pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
                            bool logging_enabled = false) {
   Timer t;
-  pvector<WeightT> dist(g.num_nodes(), kDistInf);
+  pvector<WeightT> dist(g.num_nodes(), kDistInf, PropertyPlacement());
   dist[source] = 0;
   pvector<NodeID> frontier(g.num_edges_directed());
   // two element arrays for double buffering curr=iter&1, next=(iter+1)&1
@@ -98,6 +103,7 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
   #pragma omp parallel
   {
     vector<vector<NodeID> > local_bins(0);
+    vector<NodeID> fused_bin;
     size_t iter = 0;
     while (shared_indexes[iter&1] != kMaxBin) {
       size_t &curr_bin_index = shared_indexes[iter&1];
@@ -113,15 +119,17 @@ pvector<WeightT> DeltaStep(const WGraph &g, NodeID source, WeightT delta,
       while (curr_bin_index < local_bins.size() &&
              !local_bins[curr_bin_index].empty() &&
              local_bins[curr_bin_index].size() < kBinSizeThreshold) {
-        vector<NodeID> curr_bin_copy = local_bins[curr_bin_index];
-        local_bins[curr_bin_index].resize(0);
-        for (NodeID u : curr_bin_copy)
+        fused_bin.swap(local_bins[curr_bin_index]);
+        for (NodeID u : fused_bin)
           RelaxEdges(g, u, delta, dist, local_bins);
+        fused_bin.resize(0);
       }
       for (size_t i=curr_bin_index; i < local_bins.size(); i++) {
         if (!local_bins[i].empty()) {
-          #pragma omp critical
-          next_bin_index = min(next_bin_index, i);
+          size_t old_index = next_bin_index;
+          while (i < old_index &&
+                 !compare_and_swap(next_bin_index, old_index, i))
+            old_index = next_bin_index;
           break;
         }
       }
@@ -4,8 +4,15 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <linux/mempolicy.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <cinttypes>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
 #include <string>
 
 #include "timer.h"
@@ -45,6 +52,119 @@ void PrintStep(int step, double seconds, int64_t count = -1) {
   PrintStep(std::to_string(step), seconds, count);
 }
 
+// Sets the memory policy of the whole pages inside [addr, addr+bytes), mbind
+// is called directly to not need libnuma, returns whether it worked
+bool MbindPages(void* addr, size_t bytes, int mode, unsigned long nodes) {
+  const uintptr_t kPageSize = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = (reinterpret_cast<uintptr_t>(addr) + kPageSize - 1) &
+                    ~(kPageSize - 1);
+  uintptr_t end = (reinterpret_cast<uintptr_t>(addr) + bytes) &
+                  ~(kPageSize - 1);
+  if (begin >= end)
+    return true;
+  // Kernel ignores the last bit of maxnode
+  return syscall(SYS_mbind, begin, end - begin, mode, &nodes,
+                 8 * sizeof(nodes) + 1, 0) == 0;
+}
+
+// Spreads the (untouched) pages of [addr, addr+bytes) round-robin over all
+// memory nodes, so no one node or tier serves all of an array. Only the whole
+// pages inside the range are affected, and failing to (e.g. without NUMA
+// support) is harmless
+void InterleavePages(void* addr, size_t bytes) {
+  if (!MbindPages(addr, bytes, MPOL_INTERLEAVE, ~0UL))
+    printf("Couldn't interleave pages (ignoring)\n");
+}
+
+/*
+Where the pages of an array go, set on the command line as a comma separated
+list (-x for the graph, -y for vertex properties):
+ - huge: advise transparent huge pages
+ - interleave: round-robin over all nodes (like -N)
+ - bind=n: only on node n, e.g. the DRAM or the PMEM node of a tiered machine
+ - prefer=n: on node n while it has free memory, elsewhere after
+The policy applies to pages not yet touched, so it is set right after the
+allocation and before the (parallel) first touch
+*/
+struct Placement {
+  bool huge = false;
+  bool interleave = false;
+  int node = -1;
+  bool strict = false;  // bind rather than prefer node
+
+  bool any() const { return huge || interleave || node != -1; }
+};
+
+// Parses the spec of a Placement, returns false if it is malformed
+bool ParsePlacement(const std::string &spec, Placement *place) {
+  Placement p;
+  std::stringstream ss(spec);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    std::string key = item.substr(0, item.find('='));
+    std::string arg = key.size() < item.size() ? item.substr(key.size()+1) : "";
+    if (key == "huge" && arg == "") {
+      p.huge = true;
+    } else if (key == "interleave" && arg == "") {
+      p.interleave = true;
+    } else if ((key == "bind" || key == "prefer") && arg != "") {
+      char* end;
+      p.node = strtol(arg.c_str(), &end, 10);
+      if (*end != '\0' || p.node < 0 || p.node >= 64)
+        return false;
+      p.strict = key == "bind";
+    } else {
+      return false;
+    }
+  }
+  if (p.interleave && p.node != -1)
+    return false;
+  *place = p;
+  return true;
+}
+
+// Applies place to the untouched pages of [addr, addr+bytes), a huge page can
+// only back the 2MB aligned part of the range. Like interleaving, failing to
+// is harmless and reported once
+void PlacePages(void* addr, size_t bytes, const Placement &place) {
+  static bool warned = false;
+  bool ok = true;
+  if (place.huge) {
+    const uintptr_t kPageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~(kPageSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(addr) + bytes;
+    ok &= madvise(reinterpret_cast<void*>(begin), end - begin,
+                  MADV_HUGEPAGE) == 0;
+  }
+  if (place.interleave)
+    ok &= MbindPages(addr, bytes, MPOL_INTERLEAVE, ~0UL);
+  else if (place.node != -1)
+    ok &= MbindPages(addr, bytes, place.strict ? MPOL_BIND : MPOL_PREFERRED,
+                     1UL << place.node);
+  if (!ok && !warned) {
+    printf("Couldn't place pages (ignoring)\n");
+    warned = true;
+  }
+}
+
+// Placement of the vertex property arrays of the kernels (-y), set from the
+// command line by BenchmarkKernel and passed to the pvectors that hold them
+Placement& PropertyPlacement() {
+  static Placement place;
+  return place;
+}
+
+// Writes every page of [addr, addr+bytes) with a static schedule, so each is
+// allocated by (and local to) the thread that gets that part of the range in
+// the static parallel loops that use it
+void ParallelFirstTouch(void* addr, size_t bytes) {
+  const int64_t kPageSize = 4096;
+  char* start = static_cast<char*>(addr);
+  #pragma omp parallel for schedule(static)
+  for (int64_t i=0; i < static_cast<int64_t>(bytes); i += kPageSize)
+    start[i] = 0;
+}
+
 // Runs op and prints the time it took to execute labelled by label
 #define TIME_PRINT(label, op) {   \
   Timer t_;                       \
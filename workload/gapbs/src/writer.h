@@ -55,16 +55,24 @@ class WriterBase {
       neigh_bytes = edges_to_write * sizeof(SGID);
     else
       neigh_bytes = edges_to_write * sizeof(NodeWeight<NodeID_, SGID>);
-    out.write(reinterpret_cast<char*>(&directed), sizeof(bool));
-    out.write(reinterpret_cast<char*>(&edges_to_write), sizeof(SGOffset));
-    out.write(reinterpret_cast<char*>(&num_nodes), sizeof(SGOffset));
+    // Always the mappable layout, Reader still reads the original one
+    SGHeader header = {};
+    std::copy(kSGMagic, kSGMagic + sizeof(kSGMagic), header.magic);
+    header.directed = directed;
+    header.num_edges = edges_to_write;
+    header.num_nodes = num_nodes;
+    const char padding[8] = {};
+    std::streamsize padding_bytes = SGAlign(neigh_bytes) - neigh_bytes;
+    out.write(reinterpret_cast<char*>(&header), sizeof(header));
     pvector<SGOffset> offsets = g_.VertexOffsets(false);
     out.write(reinterpret_cast<char*>(offsets.data()), index_bytes);
     out.write(reinterpret_cast<char*>(g_.out_neigh(0).begin()), neigh_bytes);
+    out.write(padding, padding_bytes);
     if (directed) {
       offsets = g_.VertexOffsets(true);
       out.write(reinterpret_cast<char*>(offsets.data()), index_bytes);
       out.write(reinterpret_cast<char*>(g_.in_neigh(0).begin()), neigh_bytes);
+      out.write(padding, padding_bytes);
     }
   }
 
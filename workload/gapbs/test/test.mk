@@ -7,7 +7,7 @@
 #-----------------------------------------------------------------------#
 
 # Dependencies are the tests it will run
-test-all: test-build test-generate test-load test-verify
+test-all: test-build test-generate test-load test-serialize test-verify
 
 # Does everthing, intended target for users
 test: test-score
@@ -65,6 +65,28 @@ test-load-%: test/out/load-%.out
 		else echo " $(FAIL) Load $*"; \
 	fi
 
+# Serialized graphs written by converter, read back and mapped
+test-serialize: test-serialize-read test-serialize-map test-serialize-stream
+
+test/out/4.sg: test/out converter
+	./converter -f test/graphs/4.el -b $@ > /dev/null
+
+test/out/serialize-read.out: test/out/4.sg $(GENERATE_KERNEL)
+	./$(GENERATE_KERNEL) -f $< -n0 > $@
+
+test/out/serialize-map.out: test/out/4.sg $(GENERATE_KERNEL)
+	./$(GENERATE_KERNEL) -f $< -z -n0 > $@
+
+test/out/serialize-stream.out: test/out/4.sg $(GENERATE_KERNEL)
+	./$(GENERATE_KERNEL) -f $< -S -n0 > $@
+
+.SECONDARY:
+test-serialize-%: test/out/serialize-%.out
+	@if grep -q "`cat test/reference/graph-4.el.out`" $<; \
+		then echo " $(PASS) Serialize $*"; \
+		else echo " $(FAIL) Serialize $*"; \
+	fi
+
 
 
 # Kernel Output Verification -------------------------------------------#
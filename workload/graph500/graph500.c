@@ -40,10 +40,17 @@ static double construction_time;
 static double bfs_time[NBFS_max];
 static int64_t bfs_nedge[NBFS_max];
 
+static double sssp_time[NBFS_max];
+static int64_t sssp_nedge[NBFS_max];
+
 static packed_edge * restrict IJ;
+static float * restrict W; /* Weights of the SSSP */
 static int64_t nedge;
 
 static void run_bfs (void);
+#if defined(HAVE_SSSP)
+static void run_sssp (void);
+#endif
 static void output_results (const int64_t SCALE, int64_t nvtx_scale,
 			    int64_t edgefactor,
 			    const double A, const double B,
@@ -51,7 +58,32 @@ static void output_results (const int64_t SCALE, int64_t nvtx_scale,
 			    const double generation_time,
 			    const double construction_time,
 			    const int NBFS,
-			    const double *bfs_time, const int64_t *bfs_nedge);
+			    const double *bfs_time, const int64_t *bfs_nedge,
+			    const double *sssp_time, const int64_t *sssp_nedge);
+
+#if defined(HAVE_SSSP)
+#define WEIGHT_CHUNK (((int64_t)1)<<16)
+
+/* The weights in [0, 1), far enough into the random stream of the
+   edges that they do not overlap. */
+static void
+make_weights (float * restrict W, int64_t nedge)
+{
+  OMP("omp parallel") {
+    double *buf = xmalloc (WEIGHT_CHUNK * sizeof (*buf));
+    int64_t c, k;
+    OMP("omp for schedule(static)")
+      for (c = 0; c < (nedge + WEIGHT_CHUNK - 1) / WEIGHT_CHUNK; ++c) {
+	const int64_t first = c * WEIGHT_CHUNK;
+	const int64_t n = (first + WEIGHT_CHUNK < nedge? WEIGHT_CHUNK : nedge - first);
+	make_random_numbers (n, userseed, userseed, first, buf);
+	for (k = 0; k < n; ++k)
+	  W[first + k] = buf[k];
+      }
+    free (buf);
+  }
+}
+#endif
 
 static ssize_t read_all(int fd, void *buf, size_t count)
 {
@@ -120,12 +152,30 @@ main (int argc, char **argv)
     close (fd);
   }
 
+  if (SSSP) {
+#if defined(HAVE_SSSP)
+    double weight_time;
+    W = xmalloc_large_ext (nedge * sizeof (*W));
+    TIME(weight_time, make_weights (W, nedge));
+    generation_time += weight_time;
+#else
+    fprintf (stderr, "No SSSP in this implementation.\n");
+    return EXIT_FAILURE;
+#endif
+  }
+
   run_bfs ();
+#if defined(HAVE_SSSP)
+  if (SSSP) run_sssp ();
+#endif
+  destroy_graph ();
 
   xfree_large (IJ);
+  if (W) xfree_large (W);
 
   output_results (SCALE, nvtx_scale, edgefactor, A, B, C, D,
-		  generation_time, construction_time, NBFS, bfs_time, bfs_nedge);
+		  generation_time, construction_time, NBFS, bfs_time, bfs_nedge,
+		  (SSSP? sssp_time : NULL), (SSSP? sssp_nedge : NULL));
 
   return EXIT_SUCCESS;
 }
@@ -144,6 +194,19 @@ run_bfs (void)
     fprintf (stderr, "Failure creating graph.\n");
     exit (EXIT_FAILURE);
   }
+#if defined(HAVE_SSSP)
+  if (SSSP) {
+    double weight_time;
+    if (VERBOSE) fprintf (stderr, "Adding weights...");
+    TIME(weight_time, err = add_edge_weights (IJ, W, nedge));
+    if (VERBOSE) fprintf (stderr, "done, took %lfs.\n", weight_time);
+    if (err) {
+      fprintf (stderr, "Failure adding the weights.\n");
+      exit (EXIT_FAILURE);
+    }
+    construction_time += weight_time;
+  }
+#endif
 
   /*
     If running the benchmark under an architecture simulator, replace
@@ -210,7 +273,8 @@ run_bfs (void)
     int64_t *bfs_tree, max_bfsvtx;
 
     /* Re-allocate. Some systems may randomize the addres... */
-    bfs_tree = xmalloc_large (nvtx_scale * sizeof (*bfs_tree));
+    bfs_tree = xmalloc_large_class (nvtx_scale * sizeof (*bfs_tree),
+				    XALLOC_TREE, -1);
     assert (bfs_root[m] < nvtx_scale);
 
     if (VERBOSE) fprintf (stderr, "Running bfs %d...", m);
@@ -222,10 +286,17 @@ run_bfs (void)
       abort ();
     }
 
-    if (!getenv("SKIP_VALIDATION")) {
+    if (getenv("SKIP_VALIDATION")) {
+      /* Nothing, not even the TEPS. */
+    } else if (NVALIDATE > 0 && NVALIDATE < NBFS &&
+	       ((int64_t)m * NVALIDATE) % NBFS >= NVALIDATE) {
+      /* Not in the sample, only count the edges for its TEPS. */
+      bfs_nedge[m] = count_bfs_tree_edges (bfs_tree, max_bfsvtx, IJ, nedge);
+    } else {
+      double verify_time;
       if (VERBOSE) fprintf (stderr, "Verifying bfs %d...", m);
-      bfs_nedge[m] = verify_bfs_tree (bfs_tree, max_bfsvtx, bfs_root[m], IJ, nedge);
-      if (VERBOSE) fprintf (stderr, "done\n");
+      TIME(verify_time, bfs_nedge[m] = verify_bfs_tree (bfs_tree, max_bfsvtx, bfs_root[m], IJ, nedge));
+      if (VERBOSE) fprintf (stderr, "done, took %lfs.\n", verify_time);
       if (bfs_nedge[m] < 0) {
 	fprintf (stderr, "bfs %d from %" PRId64 " failed verification (%" PRId64 ")\n",
 		 m, bfs_root[m], bfs_nedge[m]);
@@ -235,9 +306,55 @@ run_bfs (void)
 
     xfree_large (bfs_tree);
   }
+}
 
-  destroy_graph ();
+#if defined(HAVE_SSSP)
+/* From the roots of the BFS, validated like them. */
+void
+run_sssp (void)
+{
+  int m, err;
+
+  for (m = 0; m < NBFS; ++m) {
+    int64_t *sssp_tree, max_ssspvtx;
+    float *dist;
+
+    sssp_tree = xmalloc_large_class (nvtx_scale * sizeof (*sssp_tree),
+				     XALLOC_TREE, -1);
+    dist = xmalloc_large_class (nvtx_scale * sizeof (*dist),
+				XALLOC_TREE, -1);
+
+    if (VERBOSE) fprintf (stderr, "Running sssp %d...", m);
+    TIME(sssp_time[m], err = make_sssp_tree (sssp_tree, dist, &max_ssspvtx, bfs_root[m]));
+    if (VERBOSE) fprintf (stderr, "done, took %lfs.\n", sssp_time[m]);
+
+    if (err) {
+      perror ("make_sssp_tree failed");
+      abort ();
+    }
+
+    if (getenv("SKIP_VALIDATION")) {
+      /* Nothing, not even the TEPS. */
+    } else if (NVALIDATE > 0 && NVALIDATE < NBFS &&
+	       ((int64_t)m * NVALIDATE) % NBFS >= NVALIDATE) {
+      sssp_nedge[m] = count_bfs_tree_edges (sssp_tree, max_ssspvtx, IJ, nedge);
+    } else {
+      double verify_time;
+      if (VERBOSE) fprintf (stderr, "Verifying sssp %d...", m);
+      TIME(verify_time, sssp_nedge[m] = verify_sssp_tree (sssp_tree, dist, max_ssspvtx, bfs_root[m], IJ, W, nedge));
+      if (VERBOSE) fprintf (stderr, "done, took %lfs.\n", verify_time);
+      if (sssp_nedge[m] < 0) {
+	fprintf (stderr, "sssp %d from %" PRId64 " failed verification (%" PRId64 ")\n",
+		 m, bfs_root[m], sssp_nedge[m]);
+	abort ();
+      }
+    }
+
+    xfree_large (dist);
+    xfree_large (sssp_tree);
+  }
 }
+#endif
 
 #define NSTAT 9
 #define PRINT_STATS(lbl, israte)					\
@@ -339,7 +456,8 @@ output_results (const int64_t SCALE, int64_t nvtx_scale, int64_t edgefactor,
 		const double A, const double B, const double C, const double D,
 		const double generation_time,
 		const double construction_time,
-		const int NBFS, const double *bfs_time, const int64_t *bfs_nedge)
+		const int NBFS, const double *bfs_time, const int64_t *bfs_nedge,
+		const double *sssp_time, const int64_t *sssp_nedge)
 {
   int k;
   int64_t sz;
@@ -375,4 +493,20 @@ output_results (const int64_t SCALE, int64_t nvtx_scale, int64_t edgefactor,
     tm[k] = bfs_nedge[k] / bfs_time[k];
   statistics (stats, tm, NBFS);
   PRINT_STATS("TEPS", 1);
+
+  if (!sssp_time) return;
+
+  memcpy (tm, sssp_time, NBFS*sizeof(tm[0]));
+  statistics (stats, tm, NBFS);
+  PRINT_STATS("sssp_time", 0);
+
+  for (k = 0; k < NBFS; ++k)
+    tm[k] = sssp_nedge[k];
+  statistics (stats, tm, NBFS);
+  PRINT_STATS("sssp_nedge", 0);
+
+  for (k = 0; k < NBFS; ++k)
+    tm[k] = sssp_nedge[k] / sssp_time[k];
+  statistics (stats, tm, NBFS);
+  PRINT_STATS("sssp_TEPS", 1);
 }
@@ -16,6 +16,18 @@ int create_graph_from_edgelist (struct packed_edge *IJ, int64_t nedge);
 int make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 		   int64_t srcvtx);
 
+#if defined(HAVE_SSSP)
+/** Attach the weights of the SSSP to the graph, W[k] to the edge
+    IJ[k].  The lightest of repeated edges counts. */
+int add_edge_weights (const struct packed_edge *IJ, const float *W,
+		      int64_t nedge);
+
+/** Create the SSSP tree and the distances from a given source
+    vertex, INFINITY for the vertices it does not reach. */
+int make_sssp_tree (int64_t *sssp_tree_out, float *dist_out,
+		    int64_t *max_vtx_out, int64_t srcvtx);
+#endif
+
 /** Clean up. */
 void destroy_graph (void);
 
@@ -4,6 +4,7 @@
 #define BITMAP_H
 
 #include "../compat.h"
+#include "../xalloc.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -34,7 +35,8 @@ static inline void
 bm_init(bitmap_t* bm, int size)
 {
   int num_longs = (size + 63) / 64;
-  bm->start = (uint64_t*) malloc(sizeof(uint64_t) * num_longs);
+  bm->start = (uint64_t*) xmalloc_large_class(sizeof(uint64_t) * num_longs,
+                                              XALLOC_BITMAP, -1);
   bm->end = bm->start + num_longs;
   bm_reset(bm);
 }
@@ -107,7 +109,7 @@ static inline void bm_swap(bitmap_t* a, bitmap_t* b)
 static inline void
 bm_free(bitmap_t* bm)
 {
-  free(bm->start);
+  xfree_large(bm->start);
 }
 
 #endif // BITMAP_H
@@ -7,6 +7,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <assert.h>
 
@@ -15,9 +20,28 @@
 static int64_t int64_fetch_add (int64_t* p, int64_t incr);
 static int64_t int64_casval(int64_t* p, int64_t oldval, int64_t newval);
 static int int64_cas(int64_t* p, int64_t oldval, int64_t newval);
+static int int32_cas(int32_t* p, int32_t oldval, int32_t newval);
+
+/*
+  Building with -DUSE_32BIT_VERTEX stores the neighbors, the frontier
+  queues and the BFS tree as 32-bit vertices, for SCALE < 32.  That
+  halves the bytes per edge and per vertex of everything but xoff
+  (whose edge offsets do not fit).  The tree is written out with 64
+  bits at the end of every BFS.
+*/
+#if defined(USE_32BIT_VERTEX)
+typedef int32_t vtx_t;
+#define vtx_cas int32_cas
+#define BFS_TREE(out) (bfs_tree_store)
+#else
+typedef int64_t vtx_t;
+#define vtx_cas int64_cas
+#define BFS_TREE(out) (out)
+#endif
 
 #include "../graph500.h"
 #include "../xalloc.h"
+#include "../options.h"
 #include "../generator/graph_generator.h"
 #include "../timer.h"
 
@@ -25,13 +49,46 @@ static int int64_cas(int64_t* p, int64_t oldval, int64_t newval);
 
 #define MINVECT_SIZE 2
 #define THREAD_BUF_LEN 16384
+#define PART_BUF_LEN 1024
 #define ALPHA 14
 #define BETA  24
 
 static int64_t maxvtx, nv, sz;
 static int64_t * restrict xoff; /* Length 2*nv+2 */
-static int64_t * restrict xadjstore; /* Length MINVECT_SIZE + (xoff[nv] == nedge) */
-static int64_t * restrict xadj;
+static vtx_t * restrict xadjstore; /* Length MINVECT_SIZE + (xoff[nv] == nedge) */
+static vtx_t * restrict xadj;
+static vtx_t * restrict bfs_tree_store; /* With 32-bit vertices */
+static float * restrict xwstore; /* SSSP weights, like xadjstore */
+static float * restrict xw;
+
+/*
+  With -p, the vertices are block-distributed over npartitions
+  partitions, each with its own slice of xoff and of the adjacency
+  array, allocated on its own NUMA node.  Offsets stay global: the
+  slices are reached through base pointers shifted by the first
+  vertex and the first edge of the partition.  The threads are split
+  into one contiguous group per partition (see part_slice), and both
+  BFS directions only walk the adjacency of the partition of the
+  thread.  Blocks are whole bitmap words so that no two partitions
+  share a word of the frontier bitmaps.
+*/
+struct partition {
+  int64_t begin, end;
+  int64_t first, last; /* Edge offsets */
+  int64_t * restrict xoff; /* XOFF(k) is xoff[2*k] for begin <= k < end */
+  vtx_t * restrict xadj; /* Indexed by the global edge offset */
+  float * restrict xw; /* Likewise, the SSSP weights */
+  int64_t *xoffstore;
+  vtx_t *xadjstore;
+  float *xwstore;
+};
+
+static struct partition *part;
+static int64_t part_nv, part_nedge;
+
+#define PART_OF(k) ((k) / part_nv)
+#define PXOFF(p, k) ((p)->xoff[2*(k)])
+#define PXENDOFF(p, k) ((p)->xoff[1+2*(k)])
 
 static void
 find_nv (const struct packed_edge * restrict IJ, const int64_t nedge)
@@ -54,193 +111,556 @@ find_nv (const struct packed_edge * restrict IJ, const int64_t nedge)
   nv = 1+maxvtx;
 }
 
+#define XOFF(k) (xoff[2*(k)])
+#define XENDOFF(k) (xoff[1+2*(k)])
+
+/*
+  The graph is built in three passes over the edges, none of them
+  with atomics:
+  count: every thread counts the edges of its share of IJ per bucket
+    of 2^bshift consecutive source vertices, in both directions;
+  scatter: every thread writes its edges to the adjacency array,
+    bucket by bucket, as keys holding the source relative to the
+    bucket above the destination;
+  sort: every bucket is radix-sorted in place, which groups its edges
+    by source and orders the neighbors, then duplicates are dropped
+    and the offsets of the vertices of the bucket are filled in.
+  A bucket covers few enough vertices and edges that the sort mostly
+  works in cache.  32-bit vertices leave no room for the source in
+  the adjacency array, it goes to isrc instead, so a bucket covers at
+  most 2^16 vertices.
+*/
+#define MAX_BUCKET_BITS 12
+#define RADIX_BITS 11
+#if defined(USE_32BIT_VERTEX)
+#define MAX_BSHIFT 16
+#else
+#define MAX_BSHIFT 64
+#endif
+
+static int bshift, jbits;
+static int64_t nbucket, maxbucket;
+static int64_t * restrict bstart; /* Length nbucket+1 */
+#if defined(USE_32BIT_VERTEX)
+static uint16_t * restrict isrc;
+#endif
+static double count_time, scatter_time, sort_time;
+static FILE *trace; /* The -t trace file */
+
+static double
+wtime (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+/* The XOFF, XENDOFF pair and the adjacency array of vertex v. */
+static inline int64_t *
+vtx_off (int64_t v)
+{
+  return part? &PXOFF(&part[PART_OF(v)], v) : &XOFF(v);
+}
+
+static inline vtx_t *
+vtx_adj (int64_t v)
+{
+  return part? part[PART_OF(v)].xadj : xadj;
+}
+
+static inline float *
+vtx_w (int64_t v)
+{
+  return part? part[PART_OF(v)].xw : xw;
+}
+
+static void
+setup_buckets (void)
+{
+  bshift = 0;
+  while (((nv-1) >> bshift) >> MAX_BUCKET_BITS && bshift < MAX_BSHIFT)
+    ++bshift;
+  nbucket = ((nv-1) >> bshift) + 1;
+  jbits = 1;
+  while ((nv-1) >> jbits)
+    ++jbits;
+  assert (bshift + jbits <= 64);
+  assert (sizeof (vtx_t) == 8 || jbits < 32);
+}
+
+/* Allocates the adjacency of every partition, whose blocks are whole
+   buckets. */
+static void
+alloc_partitions (void)
+{
+  const int64_t bwidth = (int64_t)1 << bshift;
+  const int64_t align = (bwidth > 64? bwidth : 64);
+  int p;
+
+  part_nv = (nv + npartitions - 1) / npartitions;
+  part_nv = (part_nv + align - 1) / align * align;
+  part_nedge = bstart[nbucket];
+  part = xmalloc_large (npartitions * sizeof (*part));
+  for (p = 0; p < npartitions; ++p) {
+    struct partition *P = &part[p];
+    P->begin = (p * part_nv < nv? p * part_nv : nv);
+    P->end = (P->begin + part_nv < nv? P->begin + part_nv : nv);
+    P->first = bstart[(P->begin + bwidth - 1) >> bshift];
+    P->last = bstart[(P->end + bwidth - 1) >> bshift];
+    P->xoffstore = xmalloc_large_class ((2*(P->end - P->begin) + 2)
+					* sizeof (*P->xoffstore), XALLOC_CSR, p);
+    P->xadjstore = xmalloc_large_class ((P->last - P->first + 1)
+					* sizeof (*P->xadjstore), XALLOC_CSR, p);
+    P->xoff = P->xoffstore - 2*P->begin;
+    P->xadj = P->xadjstore - P->first;
+    P->xwstore = NULL;
+    P->xw = NULL;
+  }
+}
+
 static int
-alloc_graph (int64_t nedge)
+alloc_graph (void)
 {
+  int64_t k;
+  if (npartitions) {
+    alloc_partitions ();
+    return 0;
+  }
   sz = (2*nv+2) * sizeof (*xoff);
-  xoff = xmalloc_large_ext (sz);
+  xoff = xmalloc_large_class (sz, XALLOC_CSR, -1);
   if (!xoff) return -1;
+  xadjstore = xmalloc_large_class ((bstart[nbucket] + MINVECT_SIZE)
+				   * sizeof (*xadjstore), XALLOC_CSR, -1);
+  if (!xadjstore) {
+    xfree_large (xoff);
+    return -1;
+  }
+  xadj = &xadjstore[MINVECT_SIZE]; /* Cheat and permit xadj[-1] to work. */
+  for (k = 0; k < MINVECT_SIZE; ++k)
+    xadjstore[k] = -1;
+  XOFF(nv) = XENDOFF(nv) = bstart[nbucket];
   return 0;
 }
 
 static void
 free_graph (void)
 {
+  int p;
+  if (bfs_tree_store) {
+    xfree_large (bfs_tree_store);
+    bfs_tree_store = NULL;
+  }
+  if (part) {
+    for (p = 0; p < npartitions; ++p) {
+      if (part[p].xwstore) xfree_large (part[p].xwstore);
+      xfree_large (part[p].xadjstore);
+      xfree_large (part[p].xoffstore);
+    }
+    xfree_large (part);
+    part = NULL;
+    return;
+  }
+  if (xwstore) {
+    xfree_large (xwstore);
+    xwstore = xw = NULL;
+  }
   xfree_large (xadjstore);
   xfree_large (xoff);
 }
 
-#define XOFF(k) (xoff[2*(k)])
-#define XENDOFF(k) (xoff[1+2*(k)])
-
-static int64_t
-prefix_sum (int64_t *buf)
+static void
+sort_bucket (int64_t b, uint64_t * restrict scratch)
 {
-  int nt, tid;
-  int64_t slice_begin, slice_end, t1, t2, k;
+  const int64_t first = bstart[b], n = bstart[b+1] - first;
+  const int64_t vbegin = b << bshift;
+  const int64_t vend = (b+1 < nbucket? (b+1) << bshift : nv);
+  const uint64_t jmask = (jbits < 64? ((uint64_t)1 << jbits) - 1 : ~(uint64_t)0);
+  vtx_t * restrict adj = vtx_adj (vbegin);
+#if defined(USE_32BIT_VERTEX)
+  uint64_t *src = scratch, *dst = scratch + maxbucket, *tmp;
+#else
+  uint64_t *src = (uint64_t *)&adj[first], *dst = scratch, *tmp;
+#endif
+  int64_t count[1 << RADIX_BITS];
+  int64_t k, w, v, d, accum;
+  int shift;
 
-  nt = omp_get_num_threads ();
-  tid = omp_get_thread_num ();
+#if defined(USE_32BIT_VERTEX)
+  for (k = 0; k < n; ++k)
+    src[k] = ((uint64_t)isrc[first + k] << jbits) | (uint32_t)adj[first + k];
+#endif
 
-  t1 = nv / nt;
-  t2 = nv % nt;
-  slice_begin = t1 * tid + (tid < t2? tid : t2);
-  slice_end = t1 * (tid+1) + ((tid+1) < t2? (tid+1) : t2);
+  for (shift = 0; n && shift < bshift + jbits; shift += RADIX_BITS) {
+    for (d = 0; d < (1 << RADIX_BITS); ++d)
+      count[d] = 0;
+    for (k = 0; k < n; ++k)
+      ++count[(src[k] >> shift) & ((1 << RADIX_BITS) - 1)];
+    if (count[(src[0] >> shift) & ((1 << RADIX_BITS) - 1)] == n)
+      continue; /* All the same digit, nothing moves. */
+    for (accum = 0, d = 0; d < (1 << RADIX_BITS); ++d) {
+      const int64_t tmpcnt = count[d];
+      count[d] = accum;
+      accum += tmpcnt;
+    }
+    for (k = 0; k < n; ++k)
+      dst[count[(src[k] >> shift) & ((1 << RADIX_BITS) - 1)]++] = src[k];
+    tmp = src;
+    src = dst;
+    dst = tmp;
+  }
 
-  buf[tid] = 0;
-  for (k = slice_begin; k < slice_end; ++k)
-    buf[tid] += XOFF(k);
-  OMP("omp barrier");
-  OMP("omp single")
-    for (k = 1; k < nt; ++k)
-      buf[k] += buf[k-1];
-  if (tid)
-    t1 = buf[tid-1];
-  else
-    t1 = 0;
-  for (k = slice_begin; k < slice_end; ++k) {
-    int64_t tmp = XOFF(k);
-    XOFF(k) = t1;
-    t1 += tmp;
+  /* The neighbors never move up, so they can overwrite the keys when
+     the sorted keys ended up in the bucket itself. */
+  w = first;
+  k = 0;
+  for (v = vbegin; v < vend; ++v) {
+    int64_t * restrict off = vtx_off (v);
+    off[0] = w;
+    for (; k < n && (src[k] >> jbits) == (uint64_t)(v - vbegin); ++k) {
+      const vtx_t j = src[k] & jmask;
+      if (w == off[0] || adj[w-1] != j)
+	adj[w++] = j;
+    }
+    off[1] = w;
   }
-  OMP("omp flush (xoff)");
-  OMP("omp barrier");
-  return buf[nt-1];
+  for (; w < first + n; ++w)
+    adj[w] = -1;
 }
 
 static int
-setup_deg_off (const struct packed_edge * restrict IJ, int64_t nedge)
+build_graph (const struct packed_edge * restrict IJ, int64_t nedge)
 {
+  int64_t * restrict hist = NULL;
   int err = 0;
-  int64_t *buf = NULL;
-  xadj = NULL;
+  double t = wtime ();
+
+  find_nv (IJ, nedge);
+  if (maxvtx > (sizeof (vtx_t) < 8? INT32_MAX : INT64_MAX)) {
+    fprintf (stderr, "Vertex %" PRId64 " does not fit in %d bits.\n",
+	     maxvtx, (int)(8*sizeof (vtx_t)));
+    return -1;
+  }
+  setup_buckets ();
+  bstart = xmalloc ((nbucket + 1) * sizeof (*bstart));
+  maxbucket = 0;
+
   OMP("omp parallel") {
-    int64_t k, accum;
-    OMP("omp for")
-      for (k = 0; k < 2*nv+2; ++k)
-	xoff[k] = 0;
-    OMP("omp for")
-      for (k = 0; k < nedge; ++k) {
-	int64_t i = get_v0_from_edge(&IJ[k]);
-	int64_t j = get_v1_from_edge(&IJ[k]);
-	if (i != j) { /* Skip self-edges. */
-	  if (i >= 0)
-	    OMP("omp atomic")
-	      ++XOFF(i);
-	  if (j >= 0)
-	    OMP("omp atomic")
-	      ++XOFF(j);
-	}
+    const int nt = omp_get_num_threads ();
+    const int tid = omp_get_thread_num ();
+    const int64_t kbegin = nedge * tid / nt, kend = nedge * (tid+1) / nt;
+    int64_t * restrict cursor;
+    int64_t k, b;
+
+    OMP("omp single")
+      hist = xmalloc (nt * nbucket * sizeof (*hist));
+    cursor = &hist[tid * nbucket];
+    for (b = 0; b < nbucket; ++b)
+      cursor[b] = 0;
+    for (k = kbegin; k < kend; ++k) {
+      const int64_t i = get_v0_from_edge(&IJ[k]);
+      const int64_t j = get_v1_from_edge(&IJ[k]);
+      if (i >= 0 && j >= 0 && i != j) { /* Skip self-edges. */
+	++cursor[i >> bshift];
+	++cursor[j >> bshift];
       }
+    }
+    OMP("omp barrier");
+    /* Threads write their part of a bucket in thread order. */
     OMP("omp single") {
-      buf = alloca (omp_get_num_threads () * sizeof (*buf));
-      if (!buf) {
-	perror ("alloca for prefix-sum hosed");
-	abort ();
+      int64_t accum = 0, tmp;
+      int tt;
+      for (b = 0; b < nbucket; ++b) {
+	bstart[b] = accum;
+	for (tt = 0; tt < nt; ++tt) {
+	  tmp = hist[tt * nbucket + b];
+	  hist[tt * nbucket + b] = accum;
+	  accum += tmp;
+	}
+	if (accum - bstart[b] > maxbucket)
+	  maxbucket = accum - bstart[b];
       }
+      bstart[nbucket] = accum;
+      err = alloc_graph ();
+#if defined(USE_32BIT_VERTEX)
+      isrc = xmalloc_large ((accum + 1) * sizeof (*isrc));
+#endif
+      count_time = wtime () - t;
+      t = wtime ();
     }
-    OMP("omp for")
-      for (k = 0; k < nv; ++k)
-	if (XOFF(k) < MINVECT_SIZE) XOFF(k) = MINVECT_SIZE;
-
-    accum = prefix_sum (buf);
 
-    OMP("omp for")
-      for (k = 0; k < nv; ++k)
-	XENDOFF(k) = XOFF(k);
-    OMP("omp single") {
-      XOFF(nv) = accum;
-      if (!(xadjstore = xmalloc_large_ext ((XOFF(nv) + MINVECT_SIZE) * sizeof (*xadjstore))))
-	err = -1;
-      if (!err) {
-	xadj = &xadjstore[MINVECT_SIZE]; /* Cheat and permit xadj[-1] to work. */
-	for (k = 0; k < XOFF(nv) + MINVECT_SIZE; ++k)
-	  xadjstore[k] = -1;
+    if (!err) {
+      const uint64_t bmask = ((uint64_t)1 << bshift) - 1;
+      uint64_t * restrict scratch;
+      for (k = kbegin; k < kend; ++k) {
+	const int64_t i = get_v0_from_edge(&IJ[k]);
+	const int64_t j = get_v1_from_edge(&IJ[k]);
+	if (i >= 0 && j >= 0 && i != j) {
+#if defined(USE_32BIT_VERTEX)
+	  isrc[cursor[i >> bshift]] = i & bmask;
+	  vtx_adj (i)[cursor[i >> bshift]++] = j;
+	  isrc[cursor[j >> bshift]] = j & bmask;
+	  vtx_adj (j)[cursor[j >> bshift]++] = i;
+#else
+	  vtx_adj (i)[cursor[i >> bshift]++] = ((i & bmask) << jbits) | j;
+	  vtx_adj (j)[cursor[j >> bshift]++] = ((j & bmask) << jbits) | i;
+#endif
+	}
+      }
+      OMP("omp barrier");
+      OMP("omp single") {
+	scatter_time = wtime () - t;
+	t = wtime ();
       }
+
+      scratch = xmalloc ((2*maxbucket + 1) * sizeof (*scratch));
+      OMP("omp for schedule(dynamic, 1)")
+	for (b = 0; b < nbucket; ++b)
+	  sort_bucket (b, scratch);
+      free (scratch);
     }
   }
-  return !xadj;
+  sort_time = wtime () - t;
+
+  free (hist);
+  free (bstart);
+  bstart = NULL;
+#if defined(USE_32BIT_VERTEX)
+  xfree_large (isrc);
+  isrc = NULL;
+#endif
+  return err;
+}
+
+/*
+  A CSR image (-w, -l) holds a header, xoff of all vertices with the
+  global offsets (2*nv+2 entries) and the adjacency array, as built.
+  On load, the arrays are read into anonymous memory rather than
+  mapped from the file: page cache pages can neither be placed on the
+  node of a partition nor backed by transparent huge pages.
+*/
+#define IMAGE_MAGIC "G500CSR"
+#define IMAGE_VERSION 2
+#define IMAGE_CHUNK ((int64_t)1 << 26)
+#define HUGE_PAGE_SIZE ((uintptr_t)1 << 21)
+
+struct csr_image {
+  char magic[8];
+  int64_t version;
+  int64_t nv, maxvtx, nedge, nslot;
+  uint64_t fingerprint;
+  int64_t vtxsize;
+};
+
+/* Ties an image to its edge list: a hash of a sample of the edges. */
+static uint64_t
+edge_fingerprint (const struct packed_edge * restrict IJ, int64_t nedge)
+{
+  const int64_t step = nedge / 4096 + 1;
+  uint64_t h = nedge;
+  int64_t k;
+  for (k = 0; k < nedge; k += step)
+    h = (h * 1000003 + get_v0_from_edge(&IJ[k])) * 1000003
+      + get_v1_from_edge(&IJ[k]);
+  return h;
 }
 
 static void
-scatter_edge (const int64_t i, const int64_t j)
+advise_huge (void *p, size_t len)
 {
-  int64_t where;
-  where = int64_fetch_add (&XENDOFF(i), 1);
-  xadj[where] = j;
+#if defined(MADV_HUGEPAGE)
+  const uintptr_t begin = ((uintptr_t)p + HUGE_PAGE_SIZE-1) & ~(HUGE_PAGE_SIZE-1);
+  const uintptr_t end = ((uintptr_t)p + len) & ~(HUGE_PAGE_SIZE-1);
+  if (begin < end)
+    madvise ((void *)begin, end - begin, MADV_HUGEPAGE);
+#endif
 }
 
 static int
-i64cmp (const void *a, const void *b)
+write_array (int fd, const void *buf, size_t len)
 {
-  const int64_t ia = *(const int64_t*)a;
-  const int64_t ib = *(const int64_t*)b;
-  if (ia < ib) return -1;
-  if (ia > ib) return 1;
+  size_t done = 0;
+  while (done < len) {
+    ssize_t w = write (fd, (const char *)buf + done, len - done);
+    if (w < 0) {
+      perror ("Error writing CSR image");
+      return -1;
+    }
+    done += w;
+  }
   return 0;
 }
 
-static void
-pack_vtx_edges (const int64_t i)
+/* Reads len bytes at off into buf, in parallel chunks. */
+static int
+read_array (int fd, void *buf, size_t len, off_t off)
 {
-  int64_t kcur, k;
-  if (XOFF(i)+1 >= XENDOFF(i)) return;
-  qsort (&xadj[XOFF(i)], XENDOFF(i)-XOFF(i), sizeof(*xadj), i64cmp);
-  kcur = XOFF(i);
-  for (k = XOFF(i)+1; k < XENDOFF(i); ++k)
-    if (xadj[k] != xadj[kcur])
-      xadj[++kcur] = xadj[k];
-  ++kcur;
-  for (k = kcur; k < XENDOFF(i); ++k)
-    xadj[k] = -1;
-  XENDOFF(i) = kcur;
+  int err = 0;
+  int64_t c;
+  OMP("omp parallel for schedule(dynamic, 1)")
+    for (c = 0; c < (int64_t)((len + IMAGE_CHUNK-1) / IMAGE_CHUNK); ++c) {
+      size_t done = c * IMAGE_CHUNK;
+      const size_t end = (done + IMAGE_CHUNK < len? done + IMAGE_CHUNK : len);
+      while (done < end) {
+	ssize_t r = pread (fd, (char *)buf + done, end - done, off + done);
+	if (r <= 0) {
+	  err = -1;
+	  break;
+	}
+	done += r;
+      }
+    }
+  if (err)
+    fprintf (stderr, "Error reading CSR image, truncated?\n");
+  return err;
 }
 
-static void
-pack_edges (void)
+static int
+dump_graph (const char *name, const struct packed_edge *IJ, int64_t nedge)
 {
-  int64_t v;
+  struct csr_image hdr;
+  int fd, p, err = 0;
 
-  OMP("omp for")
-    for (v = 0; v < nv; ++v)
-      pack_vtx_edges (v);
+  memset (&hdr, 0, sizeof (hdr));
+  strcpy (hdr.magic, IMAGE_MAGIC);
+  hdr.version = IMAGE_VERSION;
+  hdr.nv = nv;
+  hdr.maxvtx = maxvtx;
+  hdr.nedge = nedge;
+  hdr.nslot = (part? part_nedge : XOFF(nv));
+  hdr.fingerprint = edge_fingerprint (IJ, nedge);
+  hdr.vtxsize = sizeof (vtx_t);
+
+  if ((fd = open (name, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+    perror ("Cannot create CSR image");
+    return -1;
+  }
+  err = write_array (fd, &hdr, sizeof (hdr));
+  if (!part) {
+    if (!err) err = write_array (fd, xoff, (2*nv+2) * sizeof (*xoff));
+    if (!err) err = write_array (fd, xadj, hdr.nslot * sizeof (*xadj));
+  } else {
+    const int64_t last[2] = { hdr.nslot, hdr.nslot };
+    for (p = 0; p < npartitions && !err; ++p)
+      err = write_array (fd, part[p].xoffstore, 2*(part[p].end - part[p].begin)
+			 * sizeof (*part[p].xoffstore));
+    if (!err) err = write_array (fd, last, sizeof (last));
+    for (p = 0; p < npartitions && !err; ++p) {
+      const struct partition *P = &part[p];
+      err = write_array (fd, &P->xadj[P->first],
+			 (P->last - P->first) * sizeof (*P->xadj));
+    }
+  }
+  if (close (fd) && !err) {
+    perror ("Error writing CSR image");
+    err = -1;
+  }
+  return err;
 }
 
-static void
-gather_edges (const struct packed_edge * restrict IJ, int64_t nedge)
+static int
+load_graph (const char *name, const struct packed_edge *IJ, int64_t nedge)
 {
-  OMP("omp parallel") {
-    int64_t k;
+  struct csr_image hdr;
+  const off_t xoffpos = sizeof (hdr);
+  off_t xadjpos;
+  int64_t b;
+  int fd, p, err = 0;
 
-    OMP("omp for")
-      for (k = 0; k < nedge; ++k) {
-	int64_t i = get_v0_from_edge(&IJ[k]);
-	int64_t j = get_v1_from_edge(&IJ[k]);
-	if (i >= 0 && j >= 0 && i != j) {
-	  scatter_edge (i, j);
-	  scatter_edge (j, i);
-	}
-      }
+  if ((fd = open (name, O_RDONLY)) < 0) {
+    perror ("Cannot open CSR image");
+    return -1;
+  }
+  if (pread (fd, &hdr, sizeof (hdr), 0) != sizeof (hdr)
+      || strcmp (hdr.magic, IMAGE_MAGIC) || hdr.version != IMAGE_VERSION) {
+    fprintf (stderr, "%s is not a CSR image.\n", name);
+    close (fd);
+    return -1;
+  }
+  if (hdr.vtxsize != sizeof (vtx_t)) {
+    fprintf (stderr, "CSR image %s has %" PRId64 "-byte vertices, not %d.\n",
+	     name, hdr.vtxsize, (int)sizeof (vtx_t));
+    close (fd);
+    return -1;
+  }
+  if (hdr.nedge != nedge || hdr.fingerprint != edge_fingerprint (IJ, nedge)) {
+    fprintf (stderr, "CSR image %s was not built from this edge list.\n", name);
+    close (fd);
+    return -1;
+  }
+  nv = hdr.nv;
+  maxvtx = hdr.maxvtx;
+  xadjpos = xoffpos + (2*nv+2) * sizeof (*xoff);
 
-    pack_edges ();
+  /* The buckets only decide the blocks of the partitions here. */
+  setup_buckets ();
+  bstart = xmalloc ((nbucket + 1) * sizeof (*bstart));
+  for (b = 0; b < nbucket && !err; ++b)
+    if (pread (fd, &bstart[b], sizeof (*bstart),
+	       xoffpos + 2*(b << bshift) * sizeof (*bstart)) != sizeof (*bstart))
+      err = -1;
+  bstart[nbucket] = hdr.nslot;
+  if (err)
+    fprintf (stderr, "Error reading CSR image, truncated?\n");
+  else
+    err = alloc_graph ();
+
+  if (!err && !part) {
+    advise_huge (xoff, (2*nv+2) * sizeof (*xoff));
+    advise_huge (xadj, hdr.nslot * sizeof (*xadj));
+    err = read_array (fd, xoff, (2*nv+2) * sizeof (*xoff), xoffpos);
+    if (!err)
+      err = read_array (fd, xadj, hdr.nslot * sizeof (*xadj),
+			xadjpos);
+  }
+  for (p = 0; part && p < npartitions && !err; ++p) {
+    const struct partition *P = &part[p];
+    const size_t xoffsz = 2*(P->end - P->begin) * sizeof (*P->xoffstore);
+    const size_t xadjsz = (P->last - P->first) * sizeof (*P->xadjstore);
+    advise_huge (P->xoffstore, xoffsz);
+    advise_huge (P->xadjstore, xadjsz);
+    err = read_array (fd, P->xoffstore, xoffsz,
+		      xoffpos + 2*P->begin * sizeof (*P->xoffstore));
+    if (!err)
+      err = read_array (fd, P->xadjstore, xadjsz,
+			xadjpos + P->first * sizeof (*P->xadjstore));
   }
+
+  free (bstart);
+  bstart = NULL;
+  close (fd);
+  return err;
 }
 
 int
 create_graph_from_edgelist (struct packed_edge *IJ, int64_t nedge)
 {
-  find_nv (IJ, nedge);
-  if (alloc_graph (nedge)) return -1;
-  if (setup_deg_off (IJ, nedge)) {
-    xfree_large (xoff);
+  double t;
+  if (csrloadname) {
+    if (load_graph (csrloadname, IJ, nedge)) return -1;
+  } else {
+    if (build_graph (IJ, nedge)) return -1;
+    printf ("construction_count_time: %20.17e\n", count_time);
+    printf ("construction_scatter_time: %20.17e\n", scatter_time);
+    printf ("construction_sort_time: %20.17e\n", sort_time);
+    if (csrdumpname) {
+      t = wtime ();
+      if (dump_graph (csrdumpname, IJ, nedge)) return -1;
+      printf ("construction_dump_time: %20.17e\n", wtime () - t);
+    }
+  }
+#if defined(USE_32BIT_VERTEX)
+  bfs_tree_store = xmalloc_large_class (nv * sizeof (*bfs_tree_store),
+					XALLOC_TREE, -1);
+#endif
+  if (tracename && !(trace = fopen (tracename, "w"))) {
+    perror ("Cannot open the trace file");
     return -1;
   }
-  gather_edges (IJ, nedge);
   return 0;
 }
 
 static void
-fill_bitmap_from_queue(bitmap_t *bm, int64_t *vlist, int64_t out, int64_t in)
+fill_bitmap_from_queue(bitmap_t *bm, vtx_t *vlist, int64_t out, int64_t in)
 {
   OMP("omp for")
     for (long q_index=out; q_index<in; q_index++)
@@ -248,8 +668,8 @@ fill_bitmap_from_queue(bitmap_t *bm, int64_t *vlist, int64_t out, int64_t in)
 }
 
 static void
-fill_queue_from_bitmap(bitmap_t *bm, int64_t *vlist, int64_t *out, int64_t *in,
-		       int64_t *local)
+fill_queue_from_bitmap(bitmap_t *bm, vtx_t *vlist, int64_t *out, int64_t *in,
+		       vtx_t *local)
 {
   OMP("omp single") {
     *out = 0;
@@ -286,22 +706,24 @@ fill_queue_from_bitmap(bitmap_t *bm, int64_t *vlist, int64_t *out, int64_t *in,
 }
 
 static int64_t
-bfs_bottom_up_step(int64_t *bfs_tree, bitmap_t *past, bitmap_t *next)
+bfs_bottom_up_step(vtx_t *bfs_tree, bitmap_t *past, bitmap_t *next,
+		   int64_t *checked)
 {
   OMP("omp single") {
     bm_swap(past, next);
   }
   OMP("omp barrier");
   bm_reset(next);
-  static int64_t awake_count;
+  static int64_t awake_count, check_count;
   OMP("omp single")
-    awake_count = 0;
+    awake_count = check_count = 0;
   OMP("omp barrier");
-  OMP("omp for reduction(+ : awake_count)")
+  OMP("omp for reduction(+ : awake_count, check_count)")
     for (int64_t i=0; i<nv; i++) {
       if (bfs_tree[i] == -1) {
-	  for (int64_t vo = XOFF(i); vo < XENDOFF(i); vo++) {
-	    const int64_t j = xadj[vo];
+	int64_t vo;
+	for (vo = XOFF(i); vo < XENDOFF(i); vo++) {
+	  const int64_t j = xadj[vo];
 	  if (bm_get_bit(past, j)) {
 	    // printf("%lu\n",i);
 	    bfs_tree[i] = j;
@@ -310,14 +732,16 @@ bfs_bottom_up_step(int64_t *bfs_tree, bitmap_t *past, bitmap_t *next)
 	    break;
 	  }
 	}
+	check_count += vo - XOFF(i) + (vo < XENDOFF(i));
       }
     }
   OMP("omp barrier");
+  *checked = check_count;
   return awake_count;
 }
 
 static void
-bfs_top_down_step(int64_t *bfs_tree, int64_t *vlist, int64_t *local, int64_t *k1_p, int64_t *k2_p)
+bfs_top_down_step(vtx_t *bfs_tree, vtx_t *vlist, vtx_t *local, int64_t *k1_p, int64_t *k2_p)
 {
   const int64_t oldk2 = *k2_p;
   int64_t kbuf = 0;
@@ -330,7 +754,7 @@ bfs_top_down_step(int64_t *bfs_tree, int64_t *vlist, int64_t *local, int64_t *k1
 	  for (vo = XOFF(v); vo < veo; ++vo) {
 	    const int64_t j = xadj[vo];
 	    if (bfs_tree[j] == -1) {
-	      if (int64_cas (&bfs_tree[j], -1, v)) {
+	      if (vtx_cas (&bfs_tree[j], -1, v)) {
 		if (kbuf < THREAD_BUF_LEN) {
 		  local[kbuf++] = j;
 		} else {
@@ -357,19 +781,344 @@ bfs_top_down_step(int64_t *bfs_tree, int64_t *vlist, int64_t *local, int64_t *k1
   return;
 }
 
+static void
+write_bfs_tree (int64_t *out, const vtx_t *tree)
+{
+#if defined(USE_32BIT_VERTEX)
+  int64_t k;
+  OMP("omp parallel for")
+    for (k = 0; k < nv; ++k)
+      out[k] = tree[k];
+#endif
+}
+
+/*
+  The -t trace, one JSON object per line.  Only the master thread
+  writes it, from values it holds after the barrier that ends a
+  level.
+*/
+static int64_t trace_search = -1;
+static double trace_start, trace_last;
+
+static void
+trace_begin (void)
+{
+  ++trace_search;
+  trace_start = trace_last = wtime ();
+}
+
+static void
+trace_level (int64_t srcvtx, int64_t level, int topdown, int64_t frontier,
+	     int64_t frontier_edges, int64_t unexplored_edges,
+	     int64_t edges_checked, int64_t discovered)
+{
+  const double t = wtime ();
+  fprintf (trace, "{\"search\": %" PRId64 ", \"root\": %" PRId64
+	   ", \"level\": %" PRId64 ", \"direction\": \"%s\""
+	   ", \"frontier\": %" PRId64 ", \"frontier_edges\": %" PRId64
+	   ", \"unexplored_edges\": %" PRId64
+	   ", \"edges_checked\": %" PRId64 ", \"discovered\": %" PRId64
+	   ", \"time\": %20.17e}\n",
+	   trace_search, srcvtx, level, topdown? "top-down" : "bottom-up",
+	   frontier, frontier_edges, unexplored_edges, edges_checked,
+	   discovered, t - trace_last);
+  trace_last = t;
+}
+
+static void
+trace_end (int64_t srcvtx, int64_t nlevel)
+{
+  fprintf (trace, "{\"search\": %" PRId64 ", \"root\": %" PRId64
+	   ", \"levels\": %" PRId64 ", \"time\": %20.17e}\n",
+	   trace_search, srcvtx, nlevel, wtime () - trace_start);
+}
+
+/* The frontier of a partitioned BFS: one queue per partition, each
+   only holding vertices of its partition. */
+struct part_queue {
+  vtx_t * restrict v;
+  int64_t k1, k2, kend;
+};
+
+/*
+  Sets [*b, *e) to the share of [lo, hi) of the calling thread when
+  the threads of partition p split it, empty if the thread does not
+  work on p.  Partitions get contiguous groups of threads, or one
+  thread each if there are fewer threads than partitions.
+*/
+static void
+part_slice (int p, int64_t lo, int64_t hi, int64_t *b, int64_t *e)
+{
+  const int nt = omp_get_num_threads ();
+  const int tid = omp_get_thread_num ();
+  const int t0 = (int64_t)p * nt / npartitions;
+  int t1 = (int64_t)(p+1) * nt / npartitions;
+  if (t1 <= t0) t1 = t0 + 1;
+  if (tid < t0 || tid >= t1) {
+    *b = *e = lo;
+    return;
+  }
+  *b = lo + (hi - lo) * (tid - t0) / (t1 - t0);
+  *e = lo + (hi - lo) * (tid - t0 + 1) / (t1 - t0);
+}
+
+/* Appends the vertices buffered for partition p to its queue. */
+static void
+flush_part_buf (struct part_queue *Q, vtx_t *buf, int64_t *nbuf, int p)
+{
+  const int64_t voff = int64_fetch_add (&Q[p].k2, nbuf[p]);
+  int64_t k;
+  assert (voff + nbuf[p] <= part[p].end - part[p].begin);
+  for (k = 0; k < nbuf[p]; ++k)
+    Q[p].v[voff + k] = buf[p*PART_BUF_LEN + k];
+  nbuf[p] = 0;
+}
+
+static void
+push_part (struct part_queue *Q, vtx_t *buf, int64_t *nbuf, int64_t j)
+{
+  const int p = PART_OF(j);
+  if (nbuf[p] == PART_BUF_LEN)
+    flush_part_buf (Q, buf, nbuf, p);
+  buf[p*PART_BUF_LEN + nbuf[p]++] = j;
+}
+
+static void
+fill_bitmap_from_queues (bitmap_t *bm, struct part_queue *Q)
+{
+  int p;
+  for (p = 0; p < npartitions; ++p) {
+    int64_t b, e, k;
+    part_slice (p, Q[p].k1, Q[p].k2, &b, &e);
+    for (k = b; k < e; ++k)
+      bm_set_bit_atomic (bm, Q[p].v[k]);
+  }
+  OMP("omp barrier");
+}
+
+static void
+fill_queues_from_bitmap (bitmap_t *bm, struct part_queue *Q,
+			 vtx_t *buf, int64_t *nbuf)
+{
+  int p;
+  OMP("omp single")
+    for (p = 0; p < npartitions; ++p)
+      Q[p].k1 = Q[p].k2 = 0;
+  for (p = 0; p < npartitions; ++p) {
+    int64_t b, e, w;
+    part_slice (p, part[p].begin / 64, (part[p].end + 63) / 64, &b, &e);
+    for (w = b; w < e; ++w) {
+      uint64_t word = bm->start[w];
+      while (word) {
+	push_part (Q, buf, nbuf, 64*w + __builtin_ctzll (word));
+	word &= word - 1;
+      }
+    }
+    if (nbuf[p])
+      flush_part_buf (Q, buf, nbuf, p);
+  }
+  OMP("omp barrier");
+}
+
+static int64_t
+bfs_bottom_up_step_part (vtx_t *bfs_tree, bitmap_t *past, bitmap_t *next,
+			 int64_t *checked)
+{
+  static int64_t awake_count, check_count;
+  int64_t count = 0, nchecked = 0;
+  int p;
+  OMP("omp single")
+    bm_swap(past, next);
+  bm_reset(next);
+  OMP("omp single")
+    awake_count = check_count = 0;
+  for (p = 0; p < npartitions; ++p) {
+    const struct partition *P = &part[p];
+    int64_t b, e, i, vo;
+    part_slice (p, P->begin, P->end, &b, &e);
+    for (i = b; i < e; ++i) {
+      if (bfs_tree[i] == -1) {
+	for (vo = PXOFF(P, i); vo < PXENDOFF(P, i); ++vo) {
+	  const int64_t j = P->xadj[vo];
+	  if (bm_get_bit(past, j)) {
+	    bfs_tree[i] = j;
+	    bm_set_bit_atomic(next, i);
+	    ++count;
+	    break;
+	  }
+	}
+	nchecked += vo - PXOFF(P, i) + (vo < PXENDOFF(P, i));
+      }
+    }
+  }
+  OMP("omp atomic")
+    awake_count += count;
+  OMP("omp atomic")
+    check_count += nchecked;
+  OMP("omp barrier");
+  *checked = check_count;
+  return awake_count;
+}
+
+/* Every thread expands the frontier of its partition, and hands the
+   vertices it discovers to the queues of their partitions. */
+static void
+bfs_top_down_step_part (vtx_t *bfs_tree, struct part_queue *Q,
+			vtx_t *buf, int64_t *nbuf)
+{
+  int p;
+  OMP("omp single")
+    for (p = 0; p < npartitions; ++p)
+      Q[p].kend = Q[p].k2;
+  for (p = 0; p < npartitions; ++p) {
+    const struct partition *P = &part[p];
+    int64_t b, e, k;
+    part_slice (p, Q[p].k1, Q[p].kend, &b, &e);
+    for (k = b; k < e; ++k) {
+      const int64_t v = Q[p].v[k];
+      const int64_t veo = PXENDOFF(P, v);
+      int64_t vo;
+      for (vo = PXOFF(P, v); vo < veo; ++vo) {
+	const int64_t j = P->xadj[vo];
+	if (bfs_tree[j] == -1 && vtx_cas (&bfs_tree[j], -1, v))
+	  push_part (Q, buf, nbuf, j);
+      }
+    }
+  }
+  for (p = 0; p < npartitions; ++p)
+    if (nbuf[p])
+      flush_part_buf (Q, buf, nbuf, p);
+  OMP("omp barrier");
+  OMP("omp single")
+    for (p = 0; p < npartitions; ++p)
+      Q[p].k1 = Q[p].kend;
+}
+
+static int
+make_bfs_tree_part (int64_t *bfs_tree_out, int64_t *max_vtx_out,
+		    int64_t srcvtx)
+{
+  vtx_t * restrict bfs_tree = BFS_TREE(bfs_tree_out);
+  struct part_queue *Q;
+  const struct partition *S = &part[PART_OF(srcvtx)];
+  int p;
+
+  *max_vtx_out = maxvtx;
+
+  Q = xmalloc (npartitions * sizeof (*Q));
+  for (p = 0; p < npartitions; ++p) {
+    Q[p].v = xmalloc_large_class ((part[p].end - part[p].begin + 1)
+				  * sizeof (*Q[p].v), XALLOC_VLIST, p);
+    Q[p].k1 = Q[p].k2 = 0;
+  }
+  Q[PART_OF(srcvtx)].v[0] = srcvtx;
+  Q[PART_OF(srcvtx)].k2 = 1;
+
+  bitmap_t past, next;
+  bm_init(&past, nv);
+  bm_init(&next, nv);
+
+  int64_t down_cutoff = nv / BETA;
+  int64_t scout_count = PXENDOFF(S, srcvtx) - PXOFF(S, srcvtx);
+
+  if (trace) trace_begin ();
+
+  OMP("omp parallel shared(scout_count)") {
+    vtx_t *buf = xmalloc (npartitions * PART_BUF_LEN * sizeof (*buf));
+    int64_t *nbuf = xmalloc (npartitions * sizeof (*nbuf));
+    int64_t awake_count = 1;
+    int64_t edges_to_check = part_nedge;
+    int64_t b, e, k, count, frontier, checked, fedges, uedges, level = 0;
+    int q;
+
+    for (q = 0; q < npartitions; ++q) {
+      nbuf[q] = 0;
+      part_slice (q, part[q].begin, part[q].end, &b, &e);
+      for (k = b; k < e; ++k)
+	bfs_tree[k] = (k == srcvtx? srcvtx : -1);
+    }
+    OMP("omp barrier");
+
+    while (awake_count != 0) {
+      const int64_t scout = scout_count;
+      // Top-down
+      if (scout < ((edges_to_check - scout)/ALPHA)) {
+	frontier = awake_count;
+	bfs_top_down_step_part(bfs_tree, Q, buf, nbuf);
+	awake_count = 0;
+	for (q = 0; q < npartitions; ++q)
+	  awake_count += Q[q].k2 - Q[q].k1;
+	OMP("omp master")
+	  if (trace)
+	    trace_level (srcvtx, level, 1, frontier, scout, edges_to_check,
+			 scout, awake_count);
+	edges_to_check -= scout;
+	++level;
+      // Bottom-up
+      } else {
+	fill_bitmap_from_queues(&next, Q);
+	fedges = scout;
+	uedges = edges_to_check;
+	do {
+	  frontier = awake_count;
+	  awake_count = bfs_bottom_up_step_part(bfs_tree, &past, &next,
+						&checked);
+	  OMP("omp master")
+	    if (trace)
+	      trace_level (srcvtx, level, 0, frontier, fedges, uedges,
+			   checked, awake_count);
+	  fedges = uedges = -1;
+	  ++level;
+	} while ((awake_count > down_cutoff));
+	fill_queues_from_bitmap(&next, Q, buf, nbuf);
+      }
+      // Count the number of edges in the frontier
+      OMP("omp single")
+	scout_count = 0;
+      count = 0;
+      for (q = 0; q < npartitions; ++q) {
+	const struct partition *P = &part[q];
+	part_slice (q, Q[q].k1, Q[q].k2, &b, &e);
+	for (k = b; k < e; ++k)
+	  count += PXENDOFF(P, Q[q].v[k]) - PXOFF(P, Q[q].v[k]);
+      }
+      OMP("omp atomic")
+	scout_count += count;
+      OMP("omp barrier");
+    }
+    OMP("omp master")
+      if (trace) trace_end (srcvtx, level);
+
+    free (nbuf);
+    free (buf);
+  }
+
+  bm_free(&past);
+  bm_free(&next);
+  for (p = 0; p < npartitions; ++p)
+    xfree_large (Q[p].v);
+  free (Q);
+  write_bfs_tree (bfs_tree_out, bfs_tree);
+
+  return 0;
+}
+
 int
 make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 	       int64_t srcvtx)
 {
-  int64_t * restrict bfs_tree = bfs_tree_out;
+  vtx_t * restrict bfs_tree = BFS_TREE(bfs_tree_out);
   int err = 0;
 
-  int64_t * restrict vlist = NULL;
+  if (part)
+    return make_bfs_tree_part (bfs_tree_out, max_vtx_out, srcvtx);
+
+  vtx_t * restrict vlist = NULL;
   int64_t k1, k2;
 
   *max_vtx_out = maxvtx;
 
-  vlist = xmalloc_large (nv * sizeof (*vlist));
+  vlist = xmalloc_large_class (nv * sizeof (*vlist), XALLOC_VLIST, -1);
   if (!vlist) return -1;
 
   vlist[0] = srcvtx;
@@ -383,9 +1132,11 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
   int64_t down_cutoff = nv / BETA;
   int64_t scout_count = XENDOFF(srcvtx) - XOFF(srcvtx);
 
+  if (trace) trace_begin ();
+
   OMP("omp parallel shared(k1, k2, scout_count)") {
-    int64_t k;
-    int64_t nbuf[THREAD_BUF_LEN];
+    int64_t k, frontier, checked, fedges, uedges, level = 0;
+    vtx_t nbuf[THREAD_BUF_LEN];
     int64_t awake_count = 1;
     int64_t edges_to_check = XOFF(nv);
 
@@ -397,16 +1148,32 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 	bfs_tree[k] = -1;
 
     while (awake_count != 0) {
+      const int64_t scout = scout_count;
       // Top-down
-      if (scout_count < ((edges_to_check - scout_count)/ALPHA)) {
+      if (scout < ((edges_to_check - scout)/ALPHA)) {
+	frontier = awake_count;
 	bfs_top_down_step(bfs_tree, vlist, nbuf, &k1, &k2);
-	edges_to_check -= scout_count;
 	awake_count = k2-k1;
+	OMP("omp master")
+	  if (trace)
+	    trace_level (srcvtx, level, 1, frontier, scout, edges_to_check,
+			 scout, awake_count);
+	edges_to_check -= scout;
+	++level;
       // Bottom-up
       } else {
 	fill_bitmap_from_queue(&next, vlist, k1, k2);
+	fedges = scout;
+	uedges = edges_to_check;
 	do {
-	  awake_count = bfs_bottom_up_step(bfs_tree, &past, &next);
+	  frontier = awake_count;
+	  awake_count = bfs_bottom_up_step(bfs_tree, &past, &next, &checked);
+	  OMP("omp master")
+	    if (trace)
+	      trace_level (srcvtx, level, 0, frontier, fedges, uedges,
+			   checked, awake_count);
+	  fedges = uedges = -1;
+	  ++level;
 	} while ((awake_count > down_cutoff));
 	fill_queue_from_bitmap(&next, vlist, &k1, &k2, nbuf);
 	OMP("omp barrier");
@@ -420,19 +1187,279 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 	scout_count += XENDOFF(v) - XOFF(v);
       }
     }
+    OMP("omp master")
+      if (trace) trace_end (srcvtx, level);
   }
 
   bm_free(&past);
   bm_free(&next);
   xfree_large (vlist);
+  write_bfs_tree (bfs_tree_out, bfs_tree);
+
+  return err;
+}
+
+/* {{{ SSSP */
+
+/*
+  Delta-stepping (Meyer and Sanders, J. Algorithms 49(1), 2003) in the
+  bucket layout of the GAP benchmark suite: every thread keeps its own
+  buckets of width delta, and the vertices of the lowest nonempty
+  bucket of any thread are gathered into one shared frontier that is
+  relaxed by all threads, until no thread has a bucket left.  A vertex
+  improved twice is queued twice, the stale copy is skipped when its
+  bucket is done.
+
+  The tentative distance and the parent it came from are swapped in
+  together, the float bits above the 32-bit parent, only when the
+  distance strictly drops.  Weights are never negative, so the bits
+  order like the distances, and the parents end up a tree even with
+  zero weights or additions lost to rounding.
+*/
+
+#define SSSP_NOPARENT ((uint32_t)-1)
+
+static inline int64_t
+sp_pack (float d, int64_t parent)
+{
+  union { float f; uint32_t u; } b;
+  b.f = d;
+  return ((int64_t)b.u << 32) | (uint32_t)parent;
+}
+
+static inline float
+sp_dist (int64_t sp)
+{
+  union { float f; uint32_t u; } b;
+  b.u = (uint64_t)sp >> 32;
+  return b.f;
+}
+
+/* Keeps the lightest weight of the edge i -> j, 0 if j is found. */
+static int
+set_weight (int64_t i, int64_t j, float w)
+{
+  const int64_t * const off = vtx_off (i);
+  const vtx_t * const adj = vtx_adj (i);
+  float * const wt = vtx_w (i);
+  int64_t lo = off[0], hi = off[1];
+  while (lo < hi) {
+    const int64_t mid = lo + (hi - lo) / 2;
+    if (adj[mid] < j) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == off[1] || adj[lo] != j) return -1;
+  /* Positive floats compare like their bits. */
+  for (;;) {
+    union { float f; int32_t i; } o, n;
+    o.f = wt[lo];
+    n.f = w;
+    if (!(w < o.f) || int32_cas ((int32_t *)&wt[lo], o.i, n.i))
+      return 0;
+  }
+}
+
+int
+add_edge_weights (const struct packed_edge *IJ, const float *W,
+		  int64_t nedge)
+{
+  int err = 0;
+  int p;
+
+  if (part) {
+    for (p = 0; p < npartitions; ++p) {
+      struct partition *P = &part[p];
+      P->xwstore = xmalloc_large_class ((P->last - P->first + 1)
+					* sizeof (*P->xwstore), XALLOC_CSR, p);
+      P->xw = P->xwstore - P->first;
+    }
+  } else {
+    xwstore = xmalloc_large_class ((XOFF(nv) + MINVECT_SIZE)
+				   * sizeof (*xwstore), XALLOC_CSR, -1);
+    xw = &xwstore[MINVECT_SIZE];
+  }
 
+  OMP("omp parallel shared(err)") {
+    int64_t k, e;
+    OMP("omp for")
+      for (k = 0; k < nv; ++k) {
+	const int64_t * const off = vtx_off (k);
+	float * const wt = vtx_w (k);
+	for (e = off[0]; e < off[1]; ++e)
+	  wt[e] = INFINITY;
+      }
+    OMP("omp for")
+      for (k = 0; k < nedge; ++k) {
+	const int64_t i = get_v0_from_edge(&IJ[k]);
+	const int64_t j = get_v1_from_edge(&IJ[k]);
+	if (i < 0 || j < 0 || i == j) continue;
+	if (set_weight (i, j, W[k]) || set_weight (j, i, W[k]))
+	  err = -1;
+      }
+  }
   return err;
 }
 
+struct sssp_bin {
+  vtx_t *v;
+  int64_t n, cap;
+};
+
+struct sssp_bins {
+  struct sssp_bin *bin;
+  int64_t n;
+};
+
+static void
+push_bin (struct sssp_bins *B, int64_t b, vtx_t v)
+{
+  struct sssp_bin *bin;
+  if (b >= B->n) {
+    int64_t n = (B->n? 2*B->n : 64);
+    while (n <= b) n *= 2;
+    if (!(B->bin = realloc (B->bin, n * sizeof (*B->bin)))) {
+      perror ("Growing the SSSP buckets failed");
+      abort ();
+    }
+    memset (&B->bin[B->n], 0, (n - B->n) * sizeof (*B->bin));
+    B->n = n;
+  }
+  bin = &B->bin[b];
+  if (bin->n == bin->cap) {
+    bin->cap = (bin->cap? 2*bin->cap : 256);
+    if (!(bin->v = realloc (bin->v, bin->cap * sizeof (*bin->v)))) {
+      perror ("Growing an SSSP bucket failed");
+      abort ();
+    }
+  }
+  bin->v[bin->n++] = v;
+}
+
+static void
+sssp_relax (int64_t u, int64_t * restrict sp, float delta,
+	    struct sssp_bins *B)
+{
+  const int64_t * const off = vtx_off (u);
+  const vtx_t * const adj = vtx_adj (u);
+  const float * const wt = vtx_w (u);
+  const float du = sp_dist (sp[u]);
+  int64_t e;
+  for (e = off[0]; e < off[1]; ++e) {
+    const int64_t v = adj[e];
+    const float d = du + wt[e];
+    int64_t old = sp[v];
+    while (d < sp_dist (old)) {
+      if (int64_cas (&sp[v], old, sp_pack (d, u))) {
+	push_bin (B, (int64_t)(d / delta), v);
+	break;
+      }
+      old = sp[v];
+    }
+  }
+}
+
+int
+make_sssp_tree (int64_t *sssp_tree_out, float *dist_out,
+		int64_t *max_vtx_out, int64_t srcvtx)
+{
+  const int64_t nslot = (part? part_nedge : XOFF(nv));
+  int64_t * restrict sp;
+  vtx_t * restrict frontier;
+  int64_t frontier_tail[2] = {1, 0};
+  int64_t bin_index[2] = {0, INT64_MAX};
+  float delta = sssp_delta;
+  int64_t k;
+
+  *max_vtx_out = maxvtx;
+
+  if (!(part? part[0].xw : xw)) {
+    errno = EINVAL; /* No weights */
+    return -1;
+  }
+  assert (nv <= (int64_t)SSSP_NOPARENT);
+  if (!(delta > 0))
+    delta = (nslot? (double)nv / nslot : 1);
+
+  sp = xmalloc_large_class (nv * sizeof (*sp), XALLOC_TREE, -1);
+  /* Every improvement is queued, at most one per edge. */
+  frontier = xmalloc_large_class ((nslot + 1) * sizeof (*frontier),
+				  XALLOC_VLIST, -1);
+
+  OMP("omp parallel for")
+    for (k = 0; k < nv; ++k)
+      sp[k] = sp_pack (INFINITY, SSSP_NOPARENT);
+  sp[srcvtx] = sp_pack (0, srcvtx);
+  frontier[0] = srcvtx;
+
+  OMP("omp parallel") {
+    struct sssp_bins B = { NULL, 0 };
+    int64_t iter = 0, b;
+
+    while (bin_index[iter&1] != INT64_MAX) {
+      const int64_t cur = bin_index[iter&1];
+      const int64_t tail = frontier_tail[iter&1];
+      int64_t * const next_index = &bin_index[(iter+1)&1];
+      int64_t * const next_tail = &frontier_tail[(iter+1)&1];
+
+      OMP("omp for schedule(dynamic, 64) nowait")
+	for (k = 0; k < tail; ++k) {
+	  const int64_t u = frontier[k];
+	  /* The same rounding as the buckets, so that no improvement
+	     lands below the bucket being relaxed. */
+	  if ((int64_t)(sp_dist (sp[u]) / delta) >= cur)
+	    sssp_relax (u, sp, delta, &B);
+	}
+
+      for (b = cur; b < B.n; ++b)
+	if (B.bin[b].n) {
+	  int64_t old = *next_index;
+	  while (b < old)
+	    old = int64_casval (next_index, old, b);
+	  break;
+	}
+      OMP("omp barrier");
+
+      OMP("omp single nowait") {
+	bin_index[iter&1] = INT64_MAX;
+	frontier_tail[iter&1] = 0;
+      }
+      if (*next_index < B.n && B.bin[*next_index].n) {
+	struct sssp_bin * const bin = &B.bin[*next_index];
+	const int64_t at = int64_fetch_add (next_tail, bin->n);
+	memcpy (&frontier[at], bin->v, bin->n * sizeof (*bin->v));
+	bin->n = 0;
+      }
+      ++iter;
+      OMP("omp barrier");
+    }
+
+    for (b = 0; b < B.n; ++b)
+      free (B.bin[b].v);
+    free (B.bin);
+  }
+
+  OMP("omp parallel for")
+    for (k = 0; k < nv; ++k) {
+      const uint32_t parent = (uint32_t)sp[k];
+      dist_out[k] = sp_dist (sp[k]);
+      sssp_tree_out[k] = (parent == SSSP_NOPARENT? -1 : (int64_t)parent);
+    }
+
+  xfree_large (frontier);
+  xfree_large (sp);
+  return 0;
+}
+
+/* }}} */
+
 void
 destroy_graph (void)
 {
   free_graph ();
+  if (trace) {
+    fclose (trace);
+    trace = NULL;
+  }
 }
 
 #if defined(_OPENMP)
@@ -452,6 +1479,11 @@ int64_cas(int64_t* p, int64_t oldval, int64_t newval)
 {
   return __sync_bool_compare_and_swap (p, oldval, newval);
 }
+int
+int32_cas(int32_t* p, int32_t oldval, int32_t newval)
+{
+  return __sync_bool_compare_and_swap (p, oldval, newval);
+}
 #else
 /* XXX: These are not correct, but suffice for the above uses. */
 int64_t
@@ -491,6 +1523,20 @@ int64_cas(int64_t* p, int64_t oldval, int64_t newval)
   OMP("omp flush (p)");
   return out;
 }
+int
+int32_cas(int32_t* p, int32_t oldval, int32_t newval)
+{
+  int out = 0;
+  OMP("omp critical (CAS)") {
+    int32_t v = *p;
+    if (v == oldval) {
+      *p = newval;
+      out = 1;
+    }
+  }
+  OMP("omp flush (p)");
+  return out;
+}
 #endif
 #else
 int64_t
@@ -519,4 +1565,15 @@ int64_cas(int64_t* p, int64_t oldval, int64_t newval)
   }
   return out;
 }
+int
+int32_cas(int32_t* p, int32_t oldval, int32_t newval)
+{
+  int32_t v = *p;
+  int out = 0;
+  if (v == oldval) {
+    *p = newval;
+    out = 1;
+  }
+  return out;
+}
 #endif
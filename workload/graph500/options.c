@@ -24,6 +24,9 @@ int use_RMAT = 0;
 
 char *dumpname = NULL;
 char *rootname = NULL;
+char *csrdumpname = NULL;
+char *csrloadname = NULL;
+char *tracename = NULL;
 
 double A = A_PARAM;
 double B = B_PARAM;
@@ -31,6 +34,12 @@ double C = C_PARAM;
 double D = 1.0 - (A_PARAM + B_PARAM + C_PARAM);
 
 int NBFS = NBFS_max;
+int NVALIDATE = 0;
+
+int SSSP = 0;
+double sssp_delta = 0;
+
+int npartitions = 0;
 
 int64_t SCALE = default_SCALE;
 int64_t edgefactor = default_edgefactor;
@@ -48,7 +57,7 @@ get_options (int argc, char **argv) {
   if (getenv ("VERBOSE"))
     VERBOSE = 1;
 
-  while ((c = getopt (argc, argv, "v?hRs:e:A:a:B:b:C:c:D:d:Vo:r:n:")) != -1)
+  while ((c = getopt (argc, argv, "v?hRs:e:A:a:B:b:C:c:D:d:Vo:r:n:m:p:w:l:t:Sx:")) != -1)
     switch (c) {
     case 'v':
       printf ("%s version %d\n", NAME, VERSION);
@@ -73,6 +82,21 @@ get_options (int argc, char **argv) {
 	      "  o   : Read the edge list from (or dump to) the named file\n"
 	      "  r   : Read the BFS roots from (or dump to) the named file\n"
 	      "  n   : Run NBFS iterations\n"
+	      "  m   : Validate only m of the BFS trees, evenly spread over\n"
+	      "        the roots (default: all), the edges of the others are\n"
+	      "        only counted\n"
+	      "  p   : Split the graph into p partitions (omp-csr), one per\n"
+	      "        NUMA node (default: one shared graph)\n"
+	      "  w   : Dump the graph built from the edge list to the named\n"
+	      "        file (omp-csr)\n"
+	      "  l   : Load the graph from the named file instead of building\n"
+	      "        it, the edge list must be the same (omp-csr)\n"
+	      "  t   : Write a trace of every BFS level to the named file\n"
+	      "        (omp-csr)\n"
+	      "  S   : Also run SSSP from the BFS roots, on weights in [0, 1)\n"
+	      "        (omp-csr)\n"
+	      "  x   : Bucket width of the delta-stepping SSSP (default: one\n"
+	      "        over the average degree)\n"
 	      "\n"
 	      "Outputs take the form of \"key: value\", with keys:\n"
 	      "  SCALE\n"
@@ -99,6 +123,7 @@ get_options (int argc, char **argv) {
 	      "  max_TEPS\n"
 	      "  harmonic_mean_TEPS\n"
 	      "  harmonic_stddev_TEPS\n"
+	      "and with S, the same with sssp_time, sssp_nedge and sssp_TEPS\n"
 	      , default_SCALE, default_edgefactor,
 	      A_PARAM, B_PARAM, C_PARAM,
 	      (1.0 - (A_PARAM + B_PARAM + C_PARAM))
@@ -237,6 +262,66 @@ get_options (int argc, char **argv) {
 	err = -1;
       }
       break;
+    case 'm':
+      errno = 0;
+      NVALIDATE = strtol (optarg, NULL, 10);
+      if (errno) {
+	fprintf (stderr, "Error parsing validation count %s\n", optarg);
+	err = -1;
+      }
+      if (NVALIDATE <= 0) {
+	fprintf (stderr, "Validation count must be positive.\n");
+	err = -1;
+      }
+      break;
+    case 'w':
+      csrdumpname = strdup (optarg);
+      if (!csrdumpname) {
+	fprintf (stderr, "Cannot copy CSR dump file name.\n");
+	err = 1;
+      }
+      break;
+    case 'l':
+      csrloadname = strdup (optarg);
+      if (!csrloadname) {
+	fprintf (stderr, "Cannot copy CSR load file name.\n");
+	err = 1;
+      }
+      break;
+    case 't':
+      tracename = strdup (optarg);
+      if (!tracename) {
+	fprintf (stderr, "Cannot copy trace file name.\n");
+	err = 1;
+      }
+      break;
+    case 'S':
+      SSSP = 1;
+      break;
+    case 'x':
+      errno = 0;
+      sssp_delta = strtod (optarg, NULL);
+      if (errno) {
+	fprintf (stderr, "Error parsing SSSP delta %s\n", optarg);
+	err = -1;
+      }
+      if (!(sssp_delta > 0)) {
+	fprintf (stderr, "SSSP delta must be positive.\n");
+	err = -1;
+      }
+      break;
+    case 'p':
+      errno = 0;
+      npartitions = strtol (optarg, NULL, 10);
+      if (errno) {
+	fprintf (stderr, "Error parsing partitions %s\n", optarg);
+	err = -1;
+      }
+      if (npartitions <= 0) {
+	fprintf (stderr, "Partitions must be positive.\n");
+	err = -1;
+      }
+      break;
     default:
       fprintf (stderr, "Unrecognized option\n");
       err = -1;
@@ -8,6 +8,9 @@ extern int VERBOSE;
 extern int use_RMAT;
 extern char *dumpname;
 extern char *rootname;
+extern char *csrdumpname;
+extern char *csrloadname;
+extern char *tracename;
 
 #define A_PARAM 0.57
 #define B_PARAM 0.19
@@ -19,6 +22,16 @@ extern double A, B, C, D;
 #define NBFS_max 64
 extern int NBFS;
 
+/* How many of the NBFS trees are validated, 0 if all. */
+extern int NVALIDATE;
+
+/* Run SSSP as well, delta-stepping with buckets of sssp_delta (0 for
+   the kernel's default). */
+extern int SSSP;
+extern double sssp_delta;
+
+extern int npartitions;
+
 #define default_SCALE ((int64_t)14)
 #define default_edgefactor ((int64_t)16)
 
@@ -41,7 +41,7 @@ static int
 alloc_graph (int64_t nedge)
 {
   sz = (2*nv+2) * sizeof (*xoff);
-  xoff = xmalloc_large_ext (sz);
+  xoff = xmalloc_large_class (sz, XALLOC_CSR, -1);
   if (!xoff) return -1;
   return 0;
 }
@@ -80,7 +80,8 @@ setup_deg_off (const struct packed_edge * restrict IJ, int64_t nedge)
   XOFF(nv) = accum;
   for (k = 0; k < nv; ++k)
     XENDOFF(k) = XOFF(k);
-  if (!(xadjstore = xmalloc_large_ext ((accum + MINVECT_SIZE) * sizeof (*xadjstore))))
+  if (!(xadjstore = xmalloc_large_class ((accum + MINVECT_SIZE) * sizeof (*xadjstore),
+					 XALLOC_CSR, -1)))
     return -1;
   xadj = &xadjstore[MINVECT_SIZE]; /* Cheat and permit xadj[-1] to work. */
   for (k = 0; k < accum + MINVECT_SIZE; ++k)
@@ -173,7 +174,7 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 
   *max_vtx_out = maxvtx;
 
-  vlist = xmalloc_large (nv * sizeof (*vlist));
+  vlist = xmalloc_large_class (nv * sizeof (*vlist), XALLOC_VLIST, -1);
   if (!vlist) return -1;
 
   for (k1 = 0; k1 < nv; ++k1)
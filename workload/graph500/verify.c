@@ -76,6 +76,32 @@ compute_levels (int64_t * level,
   return err;
 }
 
+/*
+  The edge list is checked in blocks of VERIFY_CHUNK edges, a
+  contiguous run of blocks per thread.  Each thread keeps its own
+  error and count of tree edges, and the shared error is only read
+  between blocks, so a failure still stops every thread soon but the
+  loop over the edges has no shared writes besides the (idempotent)
+  seen marks.
+*/
+#define VERIFY_CHUNK (((int64_t)1)<<16)
+
+static int
+read_err (const int *err)
+{
+  int e;
+  OMP("omp atomic read")
+    e = *err;
+  return e;
+}
+
+static void
+set_err (int *err, int e)
+{
+  OMP("omp atomic write")
+    *err = e;
+}
+
 int64_t
 verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
 		 int64_t root,
@@ -86,94 +112,234 @@ verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
 
   int err;
   int64_t nedge_traversed;
-  int64_t * restrict seen_edge, * restrict level;
+  int64_t * restrict level;
+  unsigned char * restrict seen_edge;
 
   const int64_t nv = max_bfsvtx+1;
-
-  /*
-    This code is horrifically contorted because many compilers
-    complain about continue, return, etc. in parallel sections.
-  */
+  const int64_t nchunk = (nedge + VERIFY_CHUNK - 1) / VERIFY_CHUNK;
 
   if (root > max_bfsvtx || bfs_tree[root] != root)
     return -999;
 
   err = 0;
   nedge_traversed = 0;
-  seen_edge = xmalloc_large (2 * (nv) * sizeof (*seen_edge));
-  level = &seen_edge[nv];
+  level = xmalloc_large (nv * sizeof (*level));
+  seen_edge = xmalloc_large (nv * sizeof (*seen_edge));
 
   err = compute_levels (level, nv, bfs_tree, root);
 
   if (err) goto done;
 
   OMP("omp parallel shared(err)") {
-    int64_t k;
+    int64_t c, k;
+    int64_t nlocal = 0;
     int terr = 0;
     OMP("omp for")
       for (k = 0; k < nv; ++k)
 	seen_edge[k] = 0;
 
-    OMP("omp for reduction(+:nedge_traversed)")
+    OMP("omp for schedule(static)")
     MTA("mta assert parallel") MTA("mta use 100 streams")
-      for (k = 0; k < nedge; ++k) {
-	const int64_t i = get_v0_from_edge (&IJ[k]);
-	const int64_t j = get_v1_from_edge (&IJ[k]);
-	int64_t lvldiff;
-	terr = err;
+      for (c = 0; c < nchunk; ++c) {
+	const int64_t kend = (c+1 < nchunk? (c+1) * VERIFY_CHUNK : nedge);
+	if (terr || read_err (&err)) continue;
+	for (k = c * VERIFY_CHUNK; k < kend && !terr; ++k) {
+	  const int64_t i = get_v0_from_edge (&IJ[k]);
+	  const int64_t j = get_v1_from_edge (&IJ[k]);
+	  int64_t lvldiff;
 
-	if (i < 0 || j < 0) continue;
-	if (i > max_bfsvtx && j <= max_bfsvtx) terr = -10;
-	if (j > max_bfsvtx && i <= max_bfsvtx) terr = -11;
-	if (terr) { err = terr; OMP("omp flush(err)"); }
-	if (terr || i > max_bfsvtx /* both i & j are on the same side of max_bfsvtx */)
-	  continue;
-
-	/* All neighbors must be in the tree. */
-	if (bfs_tree[i] >= 0 && bfs_tree[j] < 0) terr = -12;
-	if (bfs_tree[j] >= 0 && bfs_tree[i] < 0) terr = -13;
-	if (terr) { err = terr; OMP("omp flush(err)"); }
-	if (terr || bfs_tree[i] < 0 /* both i & j have the same sign */)
-	  continue;
-
-	/* Both i and j are in the tree, count as a traversed edge.
-
-	   NOTE: This counts self-edges and repeated edges.  They're
-	   part of the input data.
-	*/
-	++nedge_traversed;
-	/* Mark seen tree edges. */
-	if (i != j) {
-	  if (bfs_tree[i] == j)
-	    seen_edge[i] = 1;
-	  if (bfs_tree[j] == i)
-	    seen_edge[j] = 1;
+	  if (i < 0 || j < 0) continue;
+	  if (i > max_bfsvtx && j <= max_bfsvtx) terr = -10;
+	  else if (j > max_bfsvtx && i <= max_bfsvtx) terr = -11;
+	  if (terr || i > max_bfsvtx /* both i & j are on the same side of max_bfsvtx */)
+	    continue;
+
+	  /* All neighbors must be in the tree. */
+	  if (bfs_tree[i] >= 0 && bfs_tree[j] < 0) terr = -12;
+	  else if (bfs_tree[j] >= 0 && bfs_tree[i] < 0) terr = -13;
+	  if (terr || bfs_tree[i] < 0 /* both i & j have the same sign */)
+	    continue;
+
+	  /* Both i and j are in the tree, count as a traversed edge.
+
+	     NOTE: This counts self-edges and repeated edges.  They're
+	     part of the input data.
+	  */
+	  ++nlocal;
+	  /* Mark seen tree edges. */
+	  if (i != j) {
+	    if (bfs_tree[i] == j)
+	      seen_edge[i] = 1;
+	    if (bfs_tree[j] == i)
+	      seen_edge[j] = 1;
+	  }
+	  lvldiff = level[i] - level[j];
+	  /* Check that the levels differ by no more than one. */
+	  if (lvldiff > 1 || lvldiff < -1)
+	    terr = -14;
 	}
-	lvldiff = level[i] - level[j];
-	/* Check that the levels differ by no more than one. */
-	if (lvldiff > 1 || lvldiff < -1)
-	  terr = -14;
-	if (terr) { err = terr; OMP("omp flush(err)"); }
+	if (terr) set_err (&err, terr);
       }
 
-    if (!terr) {
-      /* Check that every BFS edge was seen and that there's only one root. */
-      OMP("omp for") MTA("mta assert parallel") MTA("mta use 100 streams")
-	for (k = 0; k < nv; ++k) {
-	  terr = err;
-	  if (!terr && k != root) {
-	    if (bfs_tree[k] >= 0 && !seen_edge[k])
-	      terr = -15;
-	    if (bfs_tree[k] == k)
-	      terr = -16;
-	    if (terr) { err = terr; OMP("omp flush(err)"); }
+    OMP("omp atomic")
+      nedge_traversed += nlocal;
+  }
+
+  if (err) goto done;
+
+  /* Check that every BFS edge was seen and that there's only one root. */
+  OMP("omp parallel shared(err)") {
+    int64_t k;
+    int terr = 0;
+    OMP("omp for schedule(static)") MTA("mta assert parallel") MTA("mta use 100 streams")
+      for (k = 0; k < nv; ++k) {
+	if (terr || k == root) continue;
+	if (bfs_tree[k] >= 0 && !seen_edge[k])
+	  terr = -15;
+	if (bfs_tree[k] == k)
+	  terr = -16;
+	if (terr) set_err (&err, terr);
+      }
+  }
+ done:
+
+  xfree_large (seen_edge);
+  xfree_large (level);
+  if (err) return err;
+  return nedge_traversed;
+}
+
+int64_t
+count_bfs_tree_edges (const int64_t *bfs_tree_in, int64_t max_bfsvtx,
+		      const struct packed_edge *IJ_in, int64_t nedge)
+{
+  const int64_t * restrict bfs_tree = bfs_tree_in;
+  const struct packed_edge * restrict IJ = IJ_in;
+  int64_t k, nedge_traversed = 0;
+
+  OMP("omp parallel for schedule(static) reduction(+:nedge_traversed)")
+  MTA("mta assert parallel")
+    for (k = 0; k < nedge; ++k) {
+      const int64_t i = get_v0_from_edge (&IJ[k]);
+      const int64_t j = get_v1_from_edge (&IJ[k]);
+      if (i >= 0 && j >= 0 && i <= max_bfsvtx && j <= max_bfsvtx &&
+	  bfs_tree[i] >= 0 && bfs_tree[j] >= 0)
+	++nedge_traversed;
+    }
+  return nedge_traversed;
+}
+
+/* Distances differ by the rounding of one addition at most. */
+#define SSSP_EPS 1e-5f
+
+static int
+close_dist (float a, float b)
+{
+  return fabsf (a - b) <= SSSP_EPS * (a > 1? a : 1);
+}
+
+int64_t
+verify_sssp_tree (int64_t *sssp_tree_in, float *dist_in,
+		  int64_t max_ssspvtx, int64_t root,
+		  const struct packed_edge *IJ_in, const float *W_in,
+		  int64_t nedge)
+{
+  int64_t * restrict sssp_tree = sssp_tree_in;
+  const float * restrict dist = dist_in;
+  const struct packed_edge * restrict IJ = IJ_in;
+  const float * restrict W = W_in;
+
+  int err;
+  int64_t nedge_traversed;
+  int64_t * restrict level;
+  unsigned char * restrict seen_edge;
+
+  const int64_t nv = max_ssspvtx+1;
+  const int64_t nchunk = (nedge + VERIFY_CHUNK - 1) / VERIFY_CHUNK;
+
+  if (root > max_ssspvtx || sssp_tree[root] != root || dist[root] != 0)
+    return -999;
+
+  err = 0;
+  nedge_traversed = 0;
+  level = xmalloc_large (nv * sizeof (*level));
+  seen_edge = xmalloc_large (nv * sizeof (*seen_edge));
+
+  /* Only for the cycles, the levels of a shortest path tree are not
+     BFS levels. */
+  err = compute_levels (level, nv, sssp_tree, root);
+
+  if (err) goto done;
+
+  OMP("omp parallel shared(err)") {
+    int64_t c, k;
+    int64_t nlocal = 0;
+    int terr = 0;
+    OMP("omp for")
+      for (k = 0; k < nv; ++k)
+	seen_edge[k] = 0;
+
+    OMP("omp for schedule(static)")
+    MTA("mta assert parallel") MTA("mta use 100 streams")
+      for (c = 0; c < nchunk; ++c) {
+	const int64_t kend = (c+1 < nchunk? (c+1) * VERIFY_CHUNK : nedge);
+	if (terr || read_err (&err)) continue;
+	for (k = c * VERIFY_CHUNK; k < kend && !terr; ++k) {
+	  const int64_t i = get_v0_from_edge (&IJ[k]);
+	  const int64_t j = get_v1_from_edge (&IJ[k]);
+	  const float w = W[k];
+
+	  if (i < 0 || j < 0) continue;
+	  if (i > max_ssspvtx && j <= max_ssspvtx) terr = -10;
+	  else if (j > max_ssspvtx && i <= max_ssspvtx) terr = -11;
+	  if (terr || i > max_ssspvtx)
+	    continue;
+
+	  if (sssp_tree[i] >= 0 && sssp_tree[j] < 0) terr = -12;
+	  else if (sssp_tree[j] >= 0 && sssp_tree[i] < 0) terr = -13;
+	  if (terr || sssp_tree[i] < 0)
+	    continue;
+
+	  ++nlocal;
+	  /* No edge shortens a path... */
+	  if (dist[j] > dist[i] + w && !close_dist (dist[j], dist[i] + w))
+	    terr = -20;
+	  else if (dist[i] > dist[j] + w && !close_dist (dist[i], dist[j] + w))
+	    terr = -20;
+	  /* ...and every tree edge is one with its weight. */
+	  else if (i != j) {
+	    if (sssp_tree[i] == j && close_dist (dist[i], dist[j] + w))
+	      seen_edge[i] = 1;
+	    if (sssp_tree[j] == i && close_dist (dist[j], dist[i] + w))
+	      seen_edge[j] = 1;
 	  }
 	}
-    }
+	if (terr) set_err (&err, terr);
+      }
+
+    OMP("omp atomic")
+      nedge_traversed += nlocal;
+  }
+
+  if (err) goto done;
+
+  OMP("omp parallel shared(err)") {
+    int64_t k;
+    int terr = 0;
+    OMP("omp for schedule(static)") MTA("mta assert parallel") MTA("mta use 100 streams")
+      for (k = 0; k < nv; ++k) {
+	if (terr || k == root) continue;
+	if (sssp_tree[k] >= 0 && !seen_edge[k])
+	  terr = -15;
+	if (sssp_tree[k] == k)
+	  terr = -16;
+	if (terr) set_err (&err, terr);
+      }
   }
  done:
 
   xfree_large (seen_edge);
+  xfree_large (level);
   if (err) return err;
   return nedge_traversed;
 }
@@ -11,4 +11,16 @@ int64_t verify_bfs_tree (int64_t *bfs_tree, int64_t max_bfsvtx,
 			 int64_t root,
 			 const struct packed_edge *IJ, int64_t nedge);
 
+/** Count the edges verify_bfs_tree would for a valid tree, without
+    checking it. */
+int64_t count_bfs_tree_edges (const int64_t *bfs_tree, int64_t max_bfsvtx,
+			      const struct packed_edge *IJ, int64_t nedge);
+
+/** Verify an SSSP tree and its distances for the weights W, return
+    volume or a negative error. */
+int64_t verify_sssp_tree (int64_t *sssp_tree, float *dist,
+			  int64_t max_ssspvtx, int64_t root,
+			  const struct packed_edge *IJ, const float *W,
+			  int64_t nedge);
+
 #endif /* VERIFY_HEADER_ */
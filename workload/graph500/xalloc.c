@@ -8,31 +8,45 @@
 #include <signal.h>
 #include <errno.h>
 #include <limits.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <time.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 #if defined(HAVE_LIBNUMA)
 #include <numa.h>
 #endif
 
+#include "xalloc.h"
+
 #if !defined(MAP_POPULATE)
 #define MAP_POPULATE 0
 #endif
 #if !defined(MAP_NOSYNC)
 #define MAP_NOSYNC 0
 #endif
-/* Unused... for now. */
 #if !defined(MAP_HUGETLB)
 #define MAP_HUGETLB 0
 #endif
 
 extern void *xmalloc (size_t);
 
-#if defined(__MTA__)||defined(USE_MMAP_LARGE)||defined(USE_MMAP_LARGE_EXT)
-#define MAX_LARGE 32
+/* From numaif.h, which comes with libnuma. */
+#if !defined(MPOL_PREFERRED)
+#define MPOL_PREFERRED 1
+#endif
+#if !defined(MPOL_MF_MOVE)
+#define MPOL_MF_MOVE (1<<1)
+#endif
+
+/* Also holds the mappings of xmalloc_large_class, e.g. a queue per
+   partition. */
+#define MAX_LARGE 1024
 static int n_large_alloc = 0;
 static struct {
   void * p;
@@ -40,6 +54,7 @@ static struct {
   int fd;
 } large_alloc[MAX_LARGE];
 
+#if defined(__MTA__)||defined(USE_MMAP_LARGE)||defined(USE_MMAP_LARGE_EXT)
 static int installed_handler = 0;
 static void (*old_abort_handler)(int);
 
@@ -99,7 +114,6 @@ xmalloc_large (size_t sz)
 void
 xfree_large (void *p)
 {
-#if defined(__MTA__)||defined(USE_MMAP_LARGE)||defined(USE_MMAP_LARGE_EXT)
   int k, found = 0;
   for (k = 0; k < n_large_alloc; ++k) {
     if (p == large_alloc[k].p) {
@@ -119,11 +133,199 @@ xfree_large (void *p)
       large_alloc[k] = large_alloc[k+1];
   } else
     free (p);
+}
+
+static int
+numa_nodes (void)
+{
+  static int n = 0;
+  if (!n) {
+#if defined(HAVE_LIBNUMA)
+    n = numa_available () < 0? 1 : numa_num_configured_nodes ();
 #else
-  free (p);
+    char path[64];
+    do
+      sprintf (path, "/sys/devices/system/node/node%d", n);
+    while (!access (path, F_OK) && ++n < 1024);
+#endif
+    if (n < 1) n = 1;
+  }
+  return n;
+}
+
+static void
+prefer_node (void *p, size_t sz, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  /* Only a preference: a full node spills over to the others.  Pages
+     already populated are moved, and placement is skipped where
+     mbind is not permitted. */
+  const uintptr_t pgsz = sysconf (_SC_PAGESIZE);
+  const uintptr_t begin = (uintptr_t)p & ~(pgsz-1);
+  const uintptr_t end = ((uintptr_t)p + sz + pgsz-1) & ~(pgsz-1);
+  unsigned long mask[1024 / (8*sizeof (unsigned long))];
+  memset (mask, 0, sizeof (mask));
+  node %= numa_nodes ();
+  mask[node / (8*sizeof (*mask))] = 1UL << (node % (8*sizeof (*mask)));
+  syscall (SYS_mbind, begin, end - begin, MPOL_PREFERRED, mask,
+	   8*sizeof (mask), MPOL_MF_MOVE);
+#endif
+}
+
+void *
+xmalloc_large_node (size_t sz, int node)
+{
+  void *out = xmalloc_large (sz);
+  prefer_node (out, sz, node);
+  return out;
+}
+
+/* {{{ Allocation classes */
+
+#define THP_SIZE ((size_t)1 << 21)
+
+struct xalloc_policy {
+  int thp, hugetlb, node;
+};
+
+static const char *class_name[XALLOC_NCLASS] = {
+  "CSR", "TREE", "VLIST", "BITMAP"
+};
+
+static void
+parse_policy (const char *var, const char *spec, struct xalloc_policy *P)
+{
+  while (*spec) {
+    const size_t len = strcspn (spec, ",");
+    if (len == 3 && !strncmp (spec, "thp", 3))
+      P->thp = 1;
+    else if (len == 7 && !strncmp (spec, "hugetlb", 7))
+      P->hugetlb = 1;
+    else if (len > 5 && !strncmp (spec, "node=", 5) && isdigit (spec[5]))
+      P->node = atoi (spec + 5);
+    else if (len)
+      fprintf (stderr, "Ignoring \"%.*s\" in %s, not thp, hugetlb or node=n\n",
+	       (int)len, spec, var);
+    spec += len;
+    if (*spec) ++spec;
+  }
+}
+
+static const struct xalloc_policy *
+get_policy (enum xalloc_class cls)
+{
+  static struct xalloc_policy policy[XALLOC_NCLASS];
+  static int parsed = 0;
+  if (!parsed) {
+    int k;
+    for (k = 0; k < XALLOC_NCLASS; ++k) {
+      char var[64];
+      const char *spec;
+      sprintf (var, "GRAPH500_ALLOC_%s", class_name[k]);
+      if (!(spec = getenv (var))) {
+	strcpy (var, "GRAPH500_ALLOC");
+	spec = getenv (var);
+      }
+      policy[k].thp = policy[k].hugetlb = 0;
+      policy[k].node = -1;
+      if (spec) parse_policy (var, spec, &policy[k]);
+    }
+    parsed = 1;
+  }
+  return &policy[cls];
+}
+
+static size_t
+hugetlb_page_size (void)
+{
+  static size_t sz = 0;
+  if (!sz) {
+    FILE *f = fopen ("/proc/meminfo", "r");
+    char line[128];
+    unsigned long kb;
+    sz = THP_SIZE;
+    if (f) {
+      while (fgets (line, sizeof (line), f))
+	if (sscanf (line, "Hugepagesize: %lu kB", &kb) == 1) {
+	  sz = (size_t)kb << 10;
+	  break;
+	}
+      fclose (f);
+    }
+  }
+  return sz;
+}
+
+/* Anonymous memory aligned to THP_SIZE, so that it can be backed by
+   huge pages from its first byte. */
+static void *
+map_aligned (size_t len)
+{
+  char *base, *out;
+  size_t head;
+  base = mmap (NULL, len + THP_SIZE, PROT_READ|PROT_WRITE,
+	       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) return base;
+  out = (char *)(((uintptr_t)base + THP_SIZE-1) & ~(uintptr_t)(THP_SIZE-1));
+  head = out - base;
+  if (head) munmap (base, head);
+  munmap (out + len, THP_SIZE - head);
+  return out;
+}
+
+void *
+xmalloc_large_class (size_t sz, enum xalloc_class cls, int node)
+{
+  static int warned = 0;
+  const struct xalloc_policy *P = get_policy (cls);
+  void *out = MAP_FAILED;
+  size_t len = 0;
+  int which;
+
+  if (P->node >= 0) node = P->node;
+  if (!P->thp && !P->hugetlb) {
+    if (node >= 0) return xmalloc_large_node (sz, node);
+    return (cls == XALLOC_CSR? xmalloc_large_ext (sz) : xmalloc_large (sz));
+  }
+
+  if (n_large_alloc >= MAX_LARGE) {
+    fprintf (stderr, "Too many large allocations. %d %d\n", n_large_alloc, MAX_LARGE);
+    abort ();
+  }
+  if (P->hugetlb && MAP_HUGETLB) {
+    const size_t hpsz = hugetlb_page_size ();
+    len = (sz + hpsz-1) / hpsz * hpsz;
+    out = mmap (NULL, len, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+  }
+  if (P->hugetlb && out == MAP_FAILED && !warned) {
+    warned = 1;
+    fprintf (stderr, "No hugetlbfs pages for %s arrays, using THP instead\n",
+	     class_name[cls]);
+  }
+  if (out == MAP_FAILED) {
+    len = (sz + THP_SIZE-1) & ~(THP_SIZE-1);
+    if ((out = map_aligned (len)) == MAP_FAILED) {
+      perror ("mmap failed");
+      abort ();
+    }
+#if defined(MADV_HUGEPAGE)
+    madvise (out, len, MADV_HUGEPAGE);
 #endif
+  }
+  /* Nothing is populated yet, so every page is faulted in on the
+     node. */
+  if (node >= 0) prefer_node (out, len, node);
+
+  which = n_large_alloc++;
+  large_alloc[which].p = out;
+  large_alloc[which].sz = len;
+  large_alloc[which].fd = -1;
+  return out;
 }
 
+/* }}} */
+
 void *
 xmalloc_large_ext (size_t sz)
 {
@@ -8,5 +8,24 @@ void * xmalloc (size_t);
 void * xmalloc_large (size_t);
 void xfree_large (void *);
 void * xmalloc_large_ext (size_t);
+/** xmalloc_large preferring NUMA node (modulo the number of nodes). */
+void * xmalloc_large_node (size_t, int);
+
+/** The arrays with a placement policy of their own, set in the
+    environment by GRAPH500_ALLOC_<class> (or GRAPH500_ALLOC for every
+    class) as a comma separated list of thp (advise transparent huge
+    pages), hugetlb (map from the hugetlbfs pool, falls back to thp
+    when it is empty) and node=n (prefer NUMA node n). */
+enum xalloc_class {
+  XALLOC_CSR,       /* graph offsets and adjacency */
+  XALLOC_TREE,      /* BFS tree */
+  XALLOC_VLIST,     /* frontier queues */
+  XALLOC_BITMAP,    /* frontier bitmaps */
+  XALLOC_NCLASS
+};
+/** xmalloc_large with the policy of the class, preferring node unless
+    it is negative or the policy names a node.  Without a policy, a CSR
+    array is xmalloc_large_ext and the others xmalloc_large(_node). */
+void * xmalloc_large_class (size_t, enum xalloc_class, int node);
 
 #endif /* XALLOC_HEADER_ */
@@ -0,0 +1,232 @@
+//! Read-only, read-mostly and dependent accesses with sampled latencies.
+//!
+//! By default every access is an update, a load and a store of the element.
+//! With `--reads` only the given percentage of accesses stay loads, spread
+//! evenly among the updates, so the store sampling of the tiering policy sees
+//! fewer of them. With `--chase` the address of every access also depends on
+//! the value of the previous one, as in a pointer chase: the index drawn from the
+//! distribution is combined with the loaded value through a zero the compiler
+//! cannot see, so the distribution is unchanged but the loads are serialized
+//! and the throughput follows the latency of the memory. `--latency` times one
+//! access in every given number with the TSC, into a histogram per worker.
+
+use std::{
+    arch::x86_64::{_mm_lfence, _rdtsc},
+    hint, ptr,
+    sync::OnceLock,
+    thread, time,
+};
+
+/// How the workers access the elements
+#[derive(Debug, Clone, Copy)]
+pub struct Access {
+    /// Percentage of accesses that only load
+    pub reads: u32,
+    /// Every access depends on the previous one
+    pub chase: bool,
+    /// Time one access in this many
+    pub latency: Option<usize>,
+}
+
+impl Access {
+    pub fn is_default(&self) -> bool {
+        self.reads == 0 && !self.chase && self.latency.is_none()
+    }
+}
+
+/// Loads the element `i` of `g` bytes, truncated to 64 bits
+fn load(mem: &[u8], g: usize, i: usize) -> u64 {
+    fn load<T: Copy>(mem: &[u8], i: usize) -> T {
+        assert!(i < mem.len() / std::mem::size_of::<T>());
+        unsafe { ptr::read_volatile((mem.as_ptr() as *const T).add(i)) }
+    }
+    match g {
+        1 => load::<u8>(mem, i) as u64,
+        2 => load::<u16>(mem, i) as u64,
+        4 => load::<u32>(mem, i) as u64,
+        8 => load::<u64>(mem, i),
+        16 => load::<u128>(mem, i) as u64,
+        _ => unimplemented!(),
+    }
+}
+
+// 8 linear buckets per power of two above 16 cycles, at most 12.5% off
+const LINEAR: usize = 16;
+const SUB_BITS: u32 = 3;
+const BUCKETS: usize = LINEAR + (64 - 4) * (1 << SUB_BITS);
+
+/// Latencies in TSC cycles
+#[derive(Clone)]
+pub struct Histogram {
+    buckets: Box<[u64; BUCKETS]>,
+    sum: u64,
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self {
+            buckets: Box::new([0; BUCKETS]),
+            sum: 0,
+        }
+    }
+}
+
+impl Histogram {
+    fn bucket(cycles: u64) -> usize {
+        if cycles < LINEAR as u64 {
+            return cycles as usize;
+        }
+        let exp = 63 - cycles.leading_zeros();
+        let sub = (cycles >> (exp - SUB_BITS)) as usize & ((1 << SUB_BITS) - 1);
+        LINEAR + (exp as usize - 4) * (1 << SUB_BITS) + sub
+    }
+
+    /// The smallest latency of a bucket
+    fn lower(bucket: usize) -> u64 {
+        if bucket < LINEAR {
+            return bucket as u64;
+        }
+        let (exp, sub) = (
+            (bucket - LINEAR) >> SUB_BITS,
+            (bucket - LINEAR) & ((1 << SUB_BITS) - 1),
+        );
+        ((1 << SUB_BITS) + sub as u64) << (exp + 4 - SUB_BITS as usize)
+    }
+
+    fn record(&mut self, cycles: u64) {
+        self.buckets[Self::bucket(cycles)] += 1;
+        self.sum += cycles;
+    }
+
+    pub fn merge(&mut self, other: &Self) {
+        for (b, o) in self.buckets.iter_mut().zip(other.buckets.iter()) {
+            *b += o;
+        }
+        self.sum += other.sum;
+    }
+
+    fn samples(&self) -> u64 {
+        self.buckets.iter().sum()
+    }
+
+    fn percentile(&self, p: f64) -> u64 {
+        let rank = (self.samples() as f64 * p).ceil().max(1.0) as u64;
+        let mut seen = 0;
+        for (bucket, &n) in self.buckets.iter().enumerate() {
+            seen += n;
+            if seen >= rank {
+                return Self::lower(bucket);
+            }
+        }
+        0
+    }
+
+    /// Logs the latency distribution of iteration `label` in ns
+    pub fn log(&self, label: &str) {
+        let samples = self.samples();
+        if samples == 0 {
+            return;
+        }
+        let ns = |cycles: u64| cycles as f64 / tsc_per_ns();
+        let mean = ns(self.sum) / samples as f64;
+        let [p50, p90, p99, p999] = [0.5, 0.9, 0.99, 0.999].map(|p| ns(self.percentile(p)));
+        tracing::info!(
+            "iteration {label} latency ns mean {mean:.1} p50 {p50:.1} p90 {p90:.1} p99 {p99:.1} p999 {p999:.1} samples {samples}"
+        );
+    }
+}
+
+/// TSC cycles per ns, measured once against the monotonic clock
+fn tsc_per_ns() -> f64 {
+    static TSC_PER_NS: OnceLock<f64> = OnceLock::new();
+    *TSC_PER_NS.get_or_init(|| {
+        let (start, tsc) = (time::Instant::now(), unsafe { _rdtsc() });
+        thread::sleep(time::Duration::from_millis(20));
+        let cycles = unsafe { _rdtsc() } - tsc;
+        cycles as f64 / start.elapsed().as_nanos() as f64
+    })
+}
+
+/// The access state of one worker
+pub struct Accessor {
+    access: Access,
+    /// Bresenham error of the writes among the accesses
+    writes: u32,
+    /// Zero, as far as the compiler knows anything
+    zero: usize,
+    carry: u64,
+    until_timed: usize,
+    pub histogram: Histogram,
+}
+
+impl Accessor {
+    pub fn new(access: Access) -> Self {
+        if access.latency.is_some() {
+            tsc_per_ns();
+        }
+        Self {
+            access,
+            writes: 0,
+            zero: hint::black_box(0),
+            carry: 0,
+            until_timed: access.latency.unwrap_or(0),
+            histogram: Histogram::default(),
+        }
+    }
+
+    // Separate copies with and without the chase, otherwise the index may be
+    // selected branch-free, which makes every access wait for the previous one
+    #[inline(always)]
+    fn access_as<const CHASE: bool>(&mut self, mem: &mut [u8], g: usize, i: usize) {
+        let i = if CHASE {
+            i ^ (self.carry as usize & self.zero)
+        } else {
+            i
+        };
+        self.writes += 100 - self.access.reads;
+        if self.writes >= 100 {
+            self.writes -= 100;
+            crate::update(mem, g, i);
+            if CHASE {
+                // forwarded from the store, which waited for the load
+                self.carry = load(mem, g, i);
+            }
+        } else if CHASE {
+            self.carry = load(mem, g, i);
+        } else {
+            load(mem, g, i);
+        }
+    }
+
+    #[inline(always)]
+    fn access(&mut self, mem: &mut [u8], g: usize, i: usize) {
+        if self.access.chase {
+            self.access_as::<true>(mem, g, i)
+        } else {
+            self.access_as::<false>(mem, g, i)
+        }
+    }
+
+    /// Accesses the element `i` of `g` bytes of `mem`, timing it if it is its turn
+    #[inline(always)]
+    pub fn run(&mut self, mem: &mut [u8], g: usize, i: usize) {
+        if self.access.latency.is_none() {
+            return self.access(mem, g, i);
+        }
+        self.until_timed -= 1;
+        if self.until_timed != 0 {
+            return self.access(mem, g, i);
+        }
+        self.until_timed = self.access.latency.unwrap();
+        unsafe {
+            _mm_lfence();
+            let start = _rdtsc();
+            _mm_lfence();
+            self.access(mem, g, i);
+            // an update is timed until its load completes, its store is buffered
+            _mm_lfence();
+            let end = _rdtsc();
+            self.histogram.record(end.saturating_sub(start));
+        }
+    }
+}
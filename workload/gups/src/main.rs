@@ -14,6 +14,11 @@ use zipf::ZipfDistribution;
 
 use structopt::StructOpt;
 
+mod access;
+mod phase;
+mod pinned;
+mod residency;
+
 type Result<T> = std::result::Result<T, Box<dyn std::error::Error + Send + Sync>>;
 
 /// GUPS hotset version with `weight` times as more updates going to the hot region than to the rest.
@@ -38,6 +43,24 @@ struct Args {
     /// Show the portion of memory pages mapped to the DRAM every given interval in ms
     #[structopt(short, long)]
     dram_ratio: Option<u64>,
+    /// Update from pinned threads without locks, sharing the region as racy or disjoint
+    #[structopt(long)]
+    pinned: Option<pinned::Sharing>,
+    /// Move the hot set every given number of updates, or every given interval with an ms suffix
+    #[structopt(long)]
+    phase: Option<phase::Every>,
+    /// How far the hot set moves every phase, the hot region length (or len / 8 without one) by default
+    #[structopt(long)]
+    phase_shift: Option<usize>,
+    /// Percentage of the accesses that only read the element instead of updating it
+    #[structopt(long, default_value = "0")]
+    reads: u32,
+    /// Make every access depend on the value of the previous one, like a pointer chase
+    #[structopt(long)]
+    chase: bool,
+    /// Time one access in every given number into a latency histogram
+    #[structopt(long)]
+    latency: Option<usize>,
     #[structopt(subcommand)]
     workload: Workload,
 }
@@ -73,13 +96,46 @@ fn main() -> Result<()> {
     tracing_subscriber::fmt::init();
     let args = Args::from_args();
     tracing::info!("gups args {args:?}");
-    if args.dram_ratio.unwrap_or(u64::MAX) != u64::MAX {
+    if args.reads > 100 || args.latency == Some(0) {
+        return Err("reads is a percentage and latency samples one in at least one access".into());
+    }
+    if args.dram_ratio.unwrap_or(u64::MAX) != u64::MAX && RESIDENCY.is_none() {
+        tracing::warn!("node_residency(2) not available, falling back to pagemap");
         // ensure the DRAM_PFN_RANGE is initialized
         let _ = *DRAM_PFN_RANGE;
     }
     let mem = vec![0xddu8; args.len].into_boxed_slice();
     tracing::info!("memory {:?} length {:?}", mem.as_ptr(), mem.len());
-    async_std::task::block_on(main_loop(args, Arc::new(sync::RwLock::new(mem))))?;
+    if let Some(sharing) = args.pinned {
+        pinned_main_loop(args, sharing, mem)?;
+    } else {
+        async_std::task::block_on(main_loop(args, Arc::new(sync::RwLock::new(mem))))?;
+    }
+    Ok(())
+}
+
+fn pinned_main_loop(args: Args, sharing: pinned::Sharing, mut mem: Box<[u8]>) -> Result<()> {
+    let region = mem_region(mem.as_ptr() as _);
+    let report = args.report.map(time::Duration::from_millis);
+    let ratio = args
+        .dram_ratio
+        .map(|ms| (time::Duration::from_millis(ms), region));
+    for (start, label) in [
+        ("warm up", "first"),
+        ("second", "warm up"),
+        ("third", "last"),
+    ] {
+        tracing::info!("{start} iteration start");
+        let run = PinnedLoop {
+            label,
+            mem: &mut mem[..],
+            sharing,
+            report,
+            ratio: ratio.clone(),
+            phases: phase_tracker(&args),
+        };
+        gups_worker(args, run)?;
+    }
     Ok(())
 }
 
@@ -99,20 +155,34 @@ async fn main_loop(args: Args, mem: Arc<sync::RwLock<Box<[u8]>>>) -> Result<()>
 
 async fn iteration(label: &str, args: Args, mem: Arc<sync::RwLock<Box<[u8]>>>) -> Result<()> {
     let (count_tx, count_rx) = mpsc::unbounded();
+    let latency = Arc::new(sync::Mutex::new(access::Histogram::default()));
+    let histogram = latency.clone();
     let region = {
         let ptr = mem.read().unwrap().as_ptr();
         mem_region(ptr as _)
     };
+    // before the workers start on the rotation of the previous iteration
+    let phases = phase_tracker(&args);
     join!(
-        async_std::task::spawn_blocking(move || gups_worker(args, mem, count_tx).unwrap()),
+        async_std::task::spawn_blocking(move || gups_worker(
+            args,
+            RayonLoop {
+                mem,
+                count_tx,
+                latency,
+            }
+        )
+        .unwrap()),
         reporting_actor(
             label,
             count_rx,
             time::Duration::from_millis(u64::MAX.min(args.report.unwrap_or(u64::MAX))),
             time::Duration::from_millis(u64::MAX.min(args.dram_ratio.unwrap_or(u64::MAX))),
             region,
+            phases,
         )
     );
+    histogram.lock().unwrap().log(label);
     Ok(())
 }
 
@@ -180,14 +250,98 @@ where
     }
 }
 
-fn gups_worker(
-    args: Args,
+/// Runs the updates of an iteration at the indices drawn from a distribution
+trait UpdateLoop {
+    fn run<D: Distribution<usize> + Sync>(self, args: Args, dist: D) -> Result<()>;
+}
+
+/// The rayon workers, counting through the channel of `reporting_actor`
+struct RayonLoop {
     mem: Arc<sync::RwLock<Box<[u8]>>>,
-    count: mpsc::UnboundedSender<usize>,
+    count_tx: mpsc::UnboundedSender<usize>,
+    latency: Arc<sync::Mutex<access::Histogram>>,
+}
+
+impl UpdateLoop for RayonLoop {
+    fn run<D: Distribution<usize> + Sync>(self, args: Args, dist: D) -> Result<()> {
+        let mem = &mut **self.mem.write().unwrap();
+        gups_do(
+            args.update,
+            args.thread,
+            args.granularity,
+            mem,
+            dist,
+            self.count_tx,
+            access(&args),
+            &self.latency,
+        )
+    }
+}
+
+/// The pinned workers of `pinned::gups_do`
+struct PinnedLoop<'a> {
+    label: &'a str,
+    mem: &'a mut [u8],
+    sharing: pinned::Sharing,
+    report: Option<time::Duration>,
+    ratio: Option<(time::Duration, pagemap::MemoryRegion)>,
+    phases: Option<phase::Tracker>,
+}
+
+impl UpdateLoop for PinnedLoop<'_> {
+    fn run<D: Distribution<usize> + Sync>(self, args: Args, dist: D) -> Result<()> {
+        pinned::gups_do(
+            self.label,
+            args.update,
+            args.thread,
+            args.granularity,
+            self.mem,
+            dist,
+            self.sharing,
+            self.report,
+            self.ratio,
+            self.phases,
+            access(&args),
+        )
+    }
+}
+
+fn access(args: &Args) -> access::Access {
+    access::Access {
+        reads: args.reads,
+        chase: args.chase,
+        latency: args.latency,
+    }
+}
+
+/// The phases of an iteration, if the hot set moves
+fn phase_tracker(args: &Args) -> Option<phase::Tracker> {
+    let shift = args.phase_shift.unwrap_or(match args.workload {
+        Workload::Hotset { hot, .. } => hot,
+        _ => args.len / 8,
+    });
+    let end = args.len / args.granularity;
+    args.phase
+        .map(|every| phase::Tracker::new(every, shift / args.granularity, end))
+}
+
+/// Runs the updates at the indices of `dist`, rotated by the phase if the hot set moves
+fn run_phased<D: Distribution<usize> + Sync>(
+    run: impl UpdateLoop,
+    args: Args,
+    dist: D,
+    end: usize,
 ) -> Result<()> {
-    let (updates, thread, len, g) = (args.update, args.thread, args.len, args.granularity);
+    if args.phase.is_some() {
+        run.run(args, phase::Phased::new(dist, end))
+    } else {
+        run.run(args, dist)
+    }
+}
+
+fn gups_worker(args: Args, run: impl UpdateLoop) -> Result<()> {
+    let (len, g) = (args.len, args.granularity);
     let end = args.len / args.granularity;
-    let mem = &mut **mem.write().unwrap();
     match args.workload {
         Workload::Hotset {
             hot,
@@ -198,9 +352,9 @@ fn gups_worker(
             let v = [Uniform::new(0, split), Uniform::new(split, end)];
             let d = Mod::new(Mix::new(v, [weight, 1]).unwrap(), end);
             if r {
-                gups_do(updates, thread, g, mem, Backwards::new(d, end - 1), count)?;
+                run_phased(run, args, Backwards::new(d, end - 1), end)?;
             } else {
-                gups_do(updates, thread, g, mem, d, count)?;
+                run_phased(run, args, d, end)?;
             }
         }
         Workload::Zipf {
@@ -210,21 +364,14 @@ fn gups_worker(
             let nelems = len / g;
             let d = ZipfDistribution::new(nelems, exponent).unwrap();
             if r {
-                gups_do(
-                    updates,
-                    thread,
-                    g,
-                    mem,
-                    Backwards::new(d, nelems - 1),
-                    count,
-                )?;
+                run_phased(run, args, Backwards::new(d, nelems - 1), nelems)?;
             } else {
-                gups_do(updates, thread, g, mem, d, count)?;
+                run_phased(run, args, d, nelems)?;
             }
         }
         Workload::Random {} => {
             let d = Uniform::new(0, end);
-            gups_do(updates, thread, g, mem, d, count)?;
+            run_phased(run, args, d, end)?;
         }
     }
     Ok(())
@@ -240,6 +387,8 @@ fn gups_do<D: Distribution<usize> + Sync>(
     mem: &mut [u8],
     dist: D,
     count_tx: mpsc::UnboundedSender<usize>,
+    access: access::Access,
+    latency: &sync::Mutex<access::Histogram>,
 ) -> Result<()> {
     let chunk_size = 4096;
     let do_init = || {
@@ -258,9 +407,19 @@ fn gups_do<D: Distribution<usize> + Sync>(
             .for_each(|indices| {
                 MEM.with(|m| {
                     let mem = &mut **m.borrow_mut();
+                    if access.is_default() {
+                        indices.iter().for_each(|&index| {
+                            update(mem, granularity, index);
+                        });
+                        return;
+                    }
+                    let mut accessor = access::Accessor::new(access);
                     indices.iter().for_each(|&index| {
-                        update(mem, granularity, index);
-                    })
+                        accessor.run(mem, granularity, index);
+                    });
+                    if access.latency.is_some() {
+                        latency.lock().unwrap().merge(&accessor.histogram);
+                    }
                 });
                 count_tx.unbounded_send(indices.len()).unwrap();
             });
@@ -287,6 +446,7 @@ async fn reporting_actor(
     gups_dur: time::Duration,
     ratio_dur: time::Duration,
     region: pagemap::MemoryRegion,
+    mut phases: Option<phase::Tracker>,
 ) {
     let region = region.clone();
     let chunk_size = 1usize << 30;
@@ -305,6 +465,9 @@ async fn reporting_actor(
                 Some(c) => {
                     period += c;
                     total +=c;
+                    if let Some(phases) = phases.as_mut() {
+                        phases.poll(label, total);
+                    }
                 },
                 // All sender dropped
                 None => break,
@@ -326,6 +489,9 @@ async fn reporting_actor(
             },
         }
     }
+    if let Some(phases) = phases {
+        phases.finish(label, total);
+    }
     let elapsed = start.elapsed();
     let gups = total as f64 / elapsed.as_secs_f64() / chunk_size as f64;
     tracing::info!("GUPS: iteration {label} final {gups:.6} elapsed {elapsed:?}");
@@ -359,6 +525,17 @@ fn mem_region(addr: u64) -> pagemap::MemoryRegion {
 }
 
 fn dram_ratio(region: pagemap::MemoryRegion, chunk_size: usize) -> Vec<f64> {
+    if let Some(residency) = RESIDENCY.as_ref() {
+        match residency.dram_ratio(
+            region.start_address(),
+            region.size(),
+            chunk_size as _,
+            *PAGE_SIZE as _,
+        ) {
+            Ok(ratios) => return ratios,
+            Err(e) => tracing::warn!("node_residency(2) failed: {e}"),
+        }
+    }
     let ptes = pagemap::PageMap::new(process::id() as _)
         .unwrap()
         .pagemap_region(&region)
@@ -374,7 +551,7 @@ fn dram_ratio(region: pagemap::MemoryRegion, chunk_size: usize) -> Vec<f64> {
         .collect()
 }
 
-// The drgn script to get dram pfn range:
+// The drgn script to get dram pfn range, only run without node_residency(2):
 // ```python
 // #!/usr/bin/env python3
 //
@@ -400,6 +577,8 @@ fn dram_ratio(region: pagemap::MemoryRegion, chunk_size: usize) -> Vec<f64> {
 lazy_static::lazy_static! {
     static ref PAGE_SIZE: usize = pagemap::page_size().unwrap() as _;
 
+    static ref RESIDENCY: Option<residency::Residency> = residency::Residency::probe();
+
     static ref DRAM_PFN_RANGE : ops::Range<u64> = {
         let output = process::Command::new("sudo").arg("-E").arg("dram-pfn.py").env("LD_PRELOAD", "")
             .output()
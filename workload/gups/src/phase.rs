@@ -0,0 +1,128 @@
+//! Phase-changing schedule: the hot set moves while the updates run.
+//!
+//! Every phase the indices drawn from the distribution are rotated by another
+//! `shift` elements around the region, which moves the hot set of `hotset` or
+//! the hottest ranks of `zipf` to memory that was cold so far. The rotation is
+//! one shared offset that the reporting side advances and the samplers only
+//! read, so the update loop stays free of synchronization. Each iteration
+//! replays the schedule from the unrotated start.
+
+use std::{
+    str::FromStr,
+    sync::atomic::{AtomicUsize, Ordering},
+    time,
+};
+
+use rand::distributions::Distribution;
+
+/// The rotation of the current phase, in elements
+static OFFSET: AtomicUsize = AtomicUsize::new(0);
+
+/// When the phase changes
+#[derive(Debug, Clone, Copy)]
+pub enum Every {
+    Updates(usize),
+    Duration(time::Duration),
+}
+
+/// Parses `<n>` updates or `<n>ms`
+impl FromStr for Every {
+    type Err = String;
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        let every = match s.strip_suffix("ms") {
+            Some(ms) => ms
+                .parse()
+                .map(|ms| Self::Duration(time::Duration::from_millis(ms))),
+            None => s.parse().map(Self::Updates),
+        }
+        .map_err(|e| format!("invalid phase {s:?}: {e}"))?;
+        match every {
+            Self::Updates(0) => Err("a phase needs at least one update".into()),
+            Self::Duration(d) if d.is_zero() => Err("a phase cannot be empty".into()),
+            every => Ok(every),
+        }
+    }
+}
+
+/// Rotates the indices of `distribution` by the offset of the current phase
+pub struct Phased<D> {
+    distribution: D,
+    end: usize,
+}
+
+impl<D: Distribution<usize>> Phased<D> {
+    pub fn new(distribution: D, end: usize) -> Self {
+        Self { distribution, end }
+    }
+}
+
+impl<D: Distribution<usize>> Distribution<usize> for Phased<D> {
+    fn sample<R: rand::Rng + ?Sized>(&self, rng: &mut R) -> usize {
+        let i = self.distribution.sample(rng) + OFFSET.load(Ordering::Relaxed);
+        if i >= self.end {
+            i - self.end
+        } else {
+            i
+        }
+    }
+}
+
+/// Advances the phases of an iteration and logs the GUPS of every phase
+pub struct Tracker {
+    every: Every,
+    shift: usize,
+    end: usize,
+    phase: usize,
+    start: time::Instant,
+    start_total: usize,
+}
+
+impl Tracker {
+    /// Starts the first phase of an iteration, `shift` and `end` in elements
+    pub fn new(every: Every, shift: usize, end: usize) -> Self {
+        OFFSET.store(0, Ordering::Relaxed);
+        Self {
+            every,
+            shift: shift % end,
+            end,
+            phase: 0,
+            start: time::Instant::now(),
+            start_total: 0,
+        }
+    }
+
+    fn log(&self, label: &str, total: usize, now: time::Instant) {
+        let elapsed = now - self.start;
+        let gups =
+            (total - self.start_total) as f64 / elapsed.as_secs_f64() / (1usize << 30) as f64;
+        tracing::info!(
+            "GUPS: iteration {label} phase {} {gups:.6} elapsed {elapsed:?}",
+            self.phase
+        );
+    }
+
+    /// Moves on to the next phase once this one is over, given the updates so far
+    pub fn poll(&mut self, label: &str, total: usize) {
+        let now = time::Instant::now();
+        let over = match self.every {
+            Every::Updates(n) => total - self.start_total >= n,
+            Every::Duration(d) => now - self.start >= d,
+        };
+        if !over {
+            return;
+        }
+        self.log(label, total, now);
+        self.phase += 1;
+        let offset = (self.phase as u128 * self.shift as u128 % self.end as u128) as usize;
+        OFFSET.store(offset, Ordering::Relaxed);
+        (self.start, self.start_total) = (now, total);
+        tracing::info!("iteration {label} phase {} offset {offset}", self.phase);
+    }
+
+    /// Logs the GUPS of the last, possibly cut short, phase
+    pub fn finish(&self, label: &str, total: usize) {
+        if total > self.start_total {
+            self.log(label, total, time::Instant::now());
+        }
+    }
+}
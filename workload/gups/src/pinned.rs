@@ -0,0 +1,250 @@
+//! Lock-free update loop on pinned threads.
+//!
+//! Every worker is pinned to a CPU of its own, draws its indices from its own RNG
+//! stream and updates the region directly, without the `RwLock`, rayon or the
+//! reporting channel. Progress goes to per-worker counters padded to their own
+//! cache lines, which the calling thread samples to report, so the GUPS numbers
+//! only depend on where the memory is placed.
+
+use std::{
+    mem, slice,
+    str::FromStr,
+    sync::atomic::{AtomicUsize, Ordering},
+    thread, time,
+};
+
+use rand::{distributions::Distribution, RngCore};
+
+use crate::access::{Access, Accessor, Histogram};
+
+/// How the pinned workers share the memory region
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Sharing {
+    /// Every worker updates the whole region, so concurrent updates of an element may be lost
+    Racy,
+    /// The cache lines are dealt round-robin to the workers, which only update their own
+    Disjoint,
+}
+
+impl FromStr for Sharing {
+    type Err = String;
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        match s {
+            "racy" => Ok(Self::Racy),
+            "disjoint" => Ok(Self::Disjoint),
+            _ => Err(format!("unknown sharing {s:?}, expected racy or disjoint")),
+        }
+    }
+}
+
+/// Updates between two stores to the counter of a worker
+const COUNT_BATCH: usize = 4096;
+/// How often the calling thread checks for the reports and the end of the workers
+const POLL: time::Duration = time::Duration::from_millis(1);
+const CACHE_LINE: usize = 64;
+
+/// A counter alone in two cache lines, so that the workers do not false-share,
+/// not even through the adjacent line prefetcher
+#[repr(align(128))]
+#[derive(Default)]
+struct PaddedCounter(AtomicUsize);
+
+/// SplitMix64, seeded differently for every worker
+struct SplitMix64(u64);
+
+impl SplitMix64 {
+    fn new(stream: u64) -> Self {
+        let mut rng = Self(stream);
+        // skip the first outputs, which are close for close seeds
+        rng.next_u64();
+        rng
+    }
+}
+
+impl RngCore for SplitMix64 {
+    fn next_u32(&mut self) -> u32 {
+        (self.next_u64() >> 32) as u32
+    }
+    fn next_u64(&mut self) -> u64 {
+        self.0 = self.0.wrapping_add(0x9e3779b97f4a7c15);
+        let mut z = self.0;
+        z = (z ^ (z >> 30)).wrapping_mul(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94d049bb133111eb);
+        z ^ (z >> 31)
+    }
+    fn fill_bytes(&mut self, dest: &mut [u8]) {
+        for chunk in dest.chunks_mut(8) {
+            let bytes = self.next_u64().to_le_bytes();
+            chunk.copy_from_slice(&bytes[..chunk.len()]);
+        }
+    }
+    fn try_fill_bytes(&mut self, dest: &mut [u8]) -> Result<(), rand::Error> {
+        self.fill_bytes(dest);
+        Ok(())
+    }
+}
+
+// glibc, with a cpu_set_t of 1024 CPUs
+extern "C" {
+    fn sched_getaffinity(pid: i32, cpusetsize: usize, mask: *mut u64) -> i32;
+    fn sched_setaffinity(pid: i32, cpusetsize: usize, mask: *const u64) -> i32;
+}
+const CPU_SET_WORDS: usize = 1024 / 64;
+
+/// The CPUs this process may run on
+fn allowed_cpus() -> Vec<usize> {
+    let mut mask = [0u64; CPU_SET_WORDS];
+    if unsafe { sched_getaffinity(0, mem::size_of_val(&mask), mask.as_mut_ptr()) } != 0 {
+        return Vec::new();
+    }
+    (0..64 * CPU_SET_WORDS)
+        .filter(|&cpu| mask[cpu / 64] & (1 << (cpu % 64)) != 0)
+        .collect()
+}
+
+fn pin_current_thread(cpu: usize) -> bool {
+    let mut mask = [0u64; CPU_SET_WORDS];
+    mask[cpu / 64] |= 1 << (cpu % 64);
+    unsafe { sched_setaffinity(0, mem::size_of_val(&mask), mask.as_ptr()) == 0 }
+}
+
+/// Moves the element `i` into the nearest cache line of worker `t` (`Sharing::Disjoint`).
+/// There must be at least `threads` full lines of `per_line` elements in `lines`.
+fn own_index(i: usize, t: usize, threads: usize, per_line: usize, lines: usize) -> usize {
+    let line = i / per_line;
+    let mut owned = line - line % threads + t;
+    if owned >= lines {
+        owned -= threads;
+    }
+    owned * per_line + i % per_line
+}
+
+/// Performs `updates` updates of `granularity` bytes at the indices drawn from `dist`,
+/// spread evenly over `threads` pinned workers. Logs the GUPS of iteration `label`
+/// every `report`, the DRAM portion of `region` every `ratio` and the GUPS of every phase,
+/// as `reporting_actor`, then the latencies sampled by `access`.
+pub fn gups_do<D: Distribution<usize> + Sync>(
+    label: &str,
+    updates: usize,
+    threads: usize,
+    granularity: usize,
+    mem: &mut [u8],
+    dist: D,
+    sharing: Sharing,
+    report: Option<time::Duration>,
+    ratio: Option<(time::Duration, pagemap::MemoryRegion)>,
+    mut phases: Option<crate::phase::Tracker>,
+    access: Access,
+) -> crate::Result<()> {
+    let per_line = (CACHE_LINE / granularity).max(1);
+    let lines = mem.len() / granularity / per_line;
+    if sharing == Sharing::Disjoint && lines < threads {
+        return Err(
+            format!("{threads} threads cannot update disjoint cache lines of {lines}").into(),
+        );
+    }
+    let cpus = allowed_cpus();
+    let counters: Vec<PaddedCounter> = (0..threads).map(|_| PaddedCounter::default()).collect();
+    // the workers alias the region on purpose, as the rayon loop does
+    let (ptr, len) = (mem.as_mut_ptr() as usize, mem.len());
+    let dist = &dist;
+    let gib = (1usize << 30) as f64;
+
+    let start = time::Instant::now();
+    let mut latency = Histogram::default();
+    thread::scope(|s| -> crate::Result<()> {
+        let mut workers = Vec::with_capacity(threads);
+        for (t, counter) in counters.iter().enumerate() {
+            let cpu = (!cpus.is_empty()).then(|| cpus[t % cpus.len()]);
+            let n = updates / threads + (t < updates % threads) as usize;
+            let worker = thread::Builder::new()
+                .name(format!("gups-pinned-{t}"))
+                .spawn_scoped(s, move || {
+                    match cpu {
+                        Some(cpu) if pin_current_thread(cpu) => {
+                            tracing::info!("thread {t} pinned to cpu {cpu}")
+                        }
+                        _ => tracing::warn!("thread {t} not pinned"),
+                    }
+                    let mem = unsafe { slice::from_raw_parts_mut(ptr as *mut u8, len) };
+                    let mut rng = SplitMix64::new(t as u64);
+                    let mut accessor = (!access.is_default()).then(|| Accessor::new(access));
+                    let mut done = 0;
+                    while done < n {
+                        let batch = COUNT_BATCH.min(n - done);
+                        for _ in 0..batch {
+                            let mut index = dist.sample(&mut rng);
+                            if sharing == Sharing::Disjoint {
+                                index = own_index(index, t, threads, per_line, lines);
+                            }
+                            match accessor.as_mut() {
+                                Some(accessor) => accessor.run(mem, granularity, index),
+                                None => crate::update(mem, granularity, index),
+                            }
+                        }
+                        done += batch;
+                        counter.0.store(done, Ordering::Relaxed);
+                    }
+                    accessor.map(|a| a.histogram.clone())
+                })?;
+            workers.push(worker);
+        }
+
+        let total = || {
+            counters
+                .iter()
+                .map(|c| c.0.load(Ordering::Relaxed))
+                .sum::<usize>()
+        };
+        let mut next_report = report.map(|d| (start + d, d));
+        let mut next_ratio = ratio.as_ref().map(|(d, _)| start + *d);
+        let (mut last, mut last_total) = (start, 0);
+        while !workers.iter().all(|w| w.is_finished()) {
+            thread::sleep(POLL);
+            let now = time::Instant::now();
+            if let Some((at, d)) = next_report {
+                if now >= at {
+                    let total = total();
+                    let hitherto = total as f64 / (now - start).as_secs_f64() / gib;
+                    let instaneous = (total - last_total) as f64 / (now - last).as_secs_f64() / gib;
+                    tracing::info!(
+                        "GUPS: iteration {label} hitherto {hitherto:.6} instaneous {instaneous:.6}"
+                    );
+                    (last, last_total) = (now, total);
+                    next_report = Some((at + d, d));
+                }
+            }
+            if let (Some(at), Some((d, region))) = (next_ratio, ratio.as_ref()) {
+                if now >= at {
+                    let ratios = crate::dram_ratio(region.clone(), 1 << 30);
+                    tracing::info!("iteration {label} dram portion per gb: {ratios:?}");
+                    next_ratio = Some(at + *d);
+                }
+            }
+            if let Some(phases) = phases.as_mut() {
+                phases.poll(label, total());
+            }
+        }
+        for worker in workers {
+            if let Some(histogram) = worker.join().map_err(|_| "gups worker panicked")? {
+                latency.merge(&histogram);
+            }
+        }
+        Ok(())
+    })?;
+    let elapsed = start.elapsed();
+
+    let counts: Vec<usize> = counters
+        .iter()
+        .map(|c| c.0.load(Ordering::Relaxed))
+        .collect();
+    let total = counts.iter().sum::<usize>();
+    if let Some(phases) = phases {
+        phases.finish(label, total);
+    }
+    let gups = total as f64 / elapsed.as_secs_f64() / gib;
+    tracing::info!("iteration {label} updates per thread {counts:?}");
+    tracing::info!("GUPS: iteration {label} final {gups:.6} elapsed {elapsed:?}");
+    latency.log(label);
+    Ok(())
+}
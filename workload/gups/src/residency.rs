@@ -0,0 +1,99 @@
+//! Tier residency from the `node_residency(2)` system call of the demeter patch.
+//!
+//! The kernel walks the page tables of the region and only copies out one count
+//! per node for every chunk, instead of the one pagemap entry per page that
+//! `/proc/self/pagemap` returns, so sampling a large region barely perturbs the
+//! updates it is measuring.
+
+use std::{fs, io, ptr};
+
+/// x86_64 number, see arch/x86/entry/syscalls/syscall_64.tbl of the patch
+const SYS_NODE_RESIDENCY: i64 = 507;
+const ENOSYS: i32 = 38;
+
+extern "C" {
+    fn syscall(num: i64, ...) -> i64;
+}
+
+/// Parses a node list of sysfs, e.g. `0-1,3`
+fn node_list(name: &str) -> Option<Vec<usize>> {
+    let list = fs::read_to_string(format!("/sys/devices/system/node/{name}")).ok()?;
+    let mut nodes = Vec::new();
+    for range in list.trim().split(',') {
+        let (first, last) = range.split_once('-').unwrap_or((range, range));
+        nodes.extend(first.parse::<usize>().ok()?..=last.parse().ok()?);
+    }
+    Some(nodes)
+}
+
+pub struct Residency {
+    nr_nodes: usize,
+    /// The first node with memory is DRAM, as `dram-pfn.py` assumes
+    dram_node: usize,
+}
+
+impl Residency {
+    /// `None` if the running kernel does not have `node_residency(2)`
+    pub fn probe() -> Option<Self> {
+        // an empty range is rejected before anything else is looked at
+        let ret = unsafe {
+            syscall(
+                SYS_NODE_RESIDENCY,
+                0,
+                0u64,
+                0u64,
+                0u64,
+                0,
+                ptr::null_mut::<u64>(),
+            )
+        };
+        if ret == 0 || io::Error::last_os_error().raw_os_error() == Some(ENOSYS) {
+            return None;
+        }
+        Some(Self {
+            nr_nodes: node_list("possible")?.last()? + 1,
+            dram_node: *node_list("has_memory")?.first()?,
+        })
+    }
+
+    /// Resident pages of every `chunk_size` chunk of `[start, start + len)` per node
+    pub fn counts(&self, start: u64, len: u64, chunk_size: u64) -> io::Result<Vec<Vec<u64>>> {
+        let nr_chunks = len.div_ceil(chunk_size) as usize;
+        let mut counts = vec![0u64; nr_chunks * self.nr_nodes];
+        // pid 0 is the calling process
+        let ret = unsafe {
+            syscall(
+                SYS_NODE_RESIDENCY,
+                0,
+                start,
+                start + len,
+                chunk_size,
+                self.nr_nodes as i32,
+                counts.as_mut_ptr(),
+            )
+        };
+        if ret != 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(counts.chunks(self.nr_nodes).map(<[u64]>::to_vec).collect())
+    }
+
+    /// The portion of every chunk that is in DRAM, counting the pages that are not resident
+    pub fn dram_ratio(
+        &self,
+        start: u64,
+        len: u64,
+        chunk_size: u64,
+        page_size: u64,
+    ) -> io::Result<Vec<f64>> {
+        let counts = self.counts(start, len, chunk_size)?;
+        Ok(counts
+            .iter()
+            .enumerate()
+            .map(|(c, counts)| {
+                let pages = chunk_size.min(len - c as u64 * chunk_size) / page_size;
+                counts[self.dram_node] as f64 / pages as f64
+            })
+            .collect())
+    }
+}
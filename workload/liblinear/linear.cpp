@@ -4,6 +4,9 @@
 #include <string.h>
 #include <stdarg.h>
 #include <locale.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "linear.h"
 #include "newton.h"	
 #include <omp.h>
@@ -32,6 +35,7 @@ static void print_string_stdout(const char *s)
 static void print_null(const char *s) {}
 
 static void (*liblinear_print_string) (const char *) = &print_string_stdout;
+static void (*liblinear_trace_string) (const char *) = NULL;
 
 #if 1
 static void info(const char *fmt,...)
@@ -50,9 +54,7 @@ static void info(const char *fmt,...) {}
 static inline int rand_int(const int max)
 {
 	static int seed = omp_get_thread_num();
-#ifdef CV_OMP
 #pragma omp threadprivate(seed)
-#endif
 	seed = ((seed * 1103515245) + 12345) & 0x7fffffff;
 	return seed%max;
 }
@@ -122,8 +124,21 @@ public:
 			y[xk->index-1] += a*xk->value;
 		}
 	}
+
+	// axpy of the asynchronous dual solvers, several threads add to y at once
+	static void axpy_atomic(const double a, const feature_node *x, double *y)
+	{
+		while(x->index != -1)
+		{
+#pragma omp atomic
+			y[x->index-1] += a*x->value;
+			x++;
+		}
+	}
 };
 
+class CSR_Matrix;
+
 class Reduce_Vectors
 {
 public:
@@ -132,6 +147,7 @@ public:
 
 	void init(void);
 	void sum_scale_x(double scalar, feature_node *x);
+	void sum_scale_x(double scalar, const CSR_Matrix *x, int i);
 	void reduce_sum(double* v);
 
 private:
@@ -146,13 +162,13 @@ Reduce_Vectors::Reduce_Vectors(int size)
 	this->size = size;
 	tmp_array = new double*[nr_thread];
 	for(int i = 0; i < nr_thread; i++)
-		tmp_array[i] = new double[size];
+		tmp_array[i] = new_hot_vector(size);
 }
 
 Reduce_Vectors::~Reduce_Vectors(void)
 {
 	for(int i = 0; i < nr_thread; i++)
-		delete[] tmp_array[i];
+		delete_hot_vector(tmp_array[i]);
 	delete[] tmp_array;
 }
 
@@ -182,6 +198,648 @@ void Reduce_Vectors::reduce_sum(double* v)
 	}
 }
 
+// The per-thread vectors of X^T v when each thread owns a fixed range of
+// rows (XTV_THREAD_BLOCKS), cut so the ranges have about the same number
+// of nonzeros. The features of the rows of a thread are known up front,
+// so only the blocks of its vector they fall into are cleared and summed,
+// and the other pages of the vector are never touched. A thread takes a
+// row once for the dot product and the axpy of Hv, and the sums do not
+// depend on the scheduling.
+class Thread_Blocks
+{
+public:
+	Thread_Blocks(const problem *prob, int size);
+	~Thread_Blocks();
+
+	int get_nr_thread(void) const { return nr_thread; }
+	int row_begin(int t) const { return row_start[t]; }
+	double *get_vector(int t) const { return tmp_array[t]; }
+	void clear(int t);
+	void reduce_sum(double *v);
+	double get_bytes(void) const;
+
+private:
+	enum { block_size = 512 }; // doubles, a 4KB page
+	int nr_thread;
+	int size;
+	int nr_block;
+	int *row_start;
+	bool *touched; // thread t, block b at t*nr_block+b
+	size_t nr_touched;
+	double **tmp_array;
+};
+
+Thread_Blocks::Thread_Blocks(const problem *prob, int size)
+{
+	int l = prob->l;
+	int i, t;
+
+	nr_thread = omp_get_max_threads();
+	this->size = size;
+	nr_block = (size + block_size - 1)/block_size;
+
+	size_t *nr_node = Malloc(size_t, l+1);
+	nr_node[0] = 0;
+	for(i=0;i<l;i++)
+	{
+		feature_node *xi = prob->x[i];
+		while(xi->index != -1)
+			xi++;
+		nr_node[i+1] = nr_node[i] + (size_t)(xi - prob->x[i]);
+	}
+	row_start = new int[nr_thread+1];
+	row_start[0] = 0;
+	for(t=1, i=0;t<nr_thread;t++)
+	{
+		while(i < l && nr_node[i] < nr_node[l]/(size_t)nr_thread*(size_t)t)
+			i++;
+		row_start[t] = i;
+	}
+	row_start[nr_thread] = l;
+	free(nr_node);
+
+	touched = new bool[(size_t)nr_thread*nr_block];
+	memset(touched, 0, sizeof(bool)*(size_t)nr_thread*nr_block);
+	nr_touched = 0;
+#pragma omp parallel for private(t,i) reduction(+:nr_touched) schedule(static,1)
+	for(t=0;t<nr_thread;t++)
+	{
+		bool *touched_t = touched + (size_t)t*nr_block;
+		for(i=row_start[t];i<row_start[t+1];i++)
+			for(feature_node *xi = prob->x[i]; xi->index != -1; xi++)
+				touched_t[(xi->index-1)/block_size] = true;
+		for(int b=0;b<nr_block;b++)
+			nr_touched += touched_t[b];
+	}
+
+	tmp_array = new double*[nr_thread];
+	for(t=0;t<nr_thread;t++)
+		tmp_array[t] = new_hot_vector(size);
+}
+
+Thread_Blocks::~Thread_Blocks()
+{
+	for(int t=0;t<nr_thread;t++)
+		delete_hot_vector(tmp_array[t]);
+	delete[] tmp_array;
+	delete[] touched;
+	delete[] row_start;
+}
+
+// Called by thread t before its rows, so the blocks are still in cache
+void Thread_Blocks::clear(int t)
+{
+	const bool *touched_t = touched + (size_t)t*nr_block;
+	for(int b=0;b<nr_block;b++)
+		if(touched_t[b])
+		{
+			int end = min((b+1)*block_size, size);
+			for(int j=b*block_size;j<end;j++)
+				tmp_array[t][j] = 0;
+		}
+}
+
+void Thread_Blocks::reduce_sum(double *v)
+{
+	int b;
+#pragma omp parallel for private(b) schedule(static)
+	for(b=0;b<nr_block;b++)
+	{
+		int begin = b*block_size;
+		int end = min(begin+block_size, size);
+		for(int j=begin;j<end;j++)
+			v[j] = 0;
+		for(int t=0;t<nr_thread;t++)
+			if(touched[(size_t)t*nr_block+b])
+				for(int j=begin;j<end;j++)
+					v[j] += tmp_array[t][j];
+	}
+}
+
+// cleared and summed blocks, and the result
+double Thread_Blocks::get_bytes(void) const
+{
+	return (double)(2*nr_touched*block_size + (size_t)size)*sizeof(double);
+}
+
+// The instances in compressed sparse rows, with 0-based int indices and
+// double, float or no values (STORAGE_CSR_PATTERN, every value is 1).
+// The rows are the instances, or the features if transposed; then
+// every thread of Mv owns whole features when computing X^T v, so no
+// per-thread dense vectors are needed. A nonzero takes 12, 8 or 4
+// bytes instead of the 16 of a feature_node. The copy is built
+// serially in instance order, so the sums are deterministic.
+// A view takes some rows of another matrix, without copying them.
+class CSR_Matrix
+{
+public:
+	CSR_Matrix(const problem *prob, int storage_type, bool transpose);
+	CSR_Matrix(const CSR_Matrix *rows_of, const int *rows, int nr_row);
+	~CSR_Matrix();
+
+	double dot(const double *s, int i) const;
+	void axpy(double a, int i, double *y) const;
+	void axpy_sq(double a, int i, double *y) const;
+	void Mv(const double *v, double *Mv) const;
+	double get_bytes(void) const;
+
+private:
+	int storage_type;
+	int nr_row;
+	size_t *row_start;
+	size_t *row_end; // row_start+1, unless a view
+	size_t nnz;
+	bool is_view; // index and values are those of another matrix
+	int *index;
+	double *value_double;
+	float *value_float;
+	void set(size_t k, int index, double value);
+};
+
+// The loops are written for omp simd: built with AVX2 or AVX-512 (see
+// the Makefile), the loads of s are gathers. The indices of a row are
+// distinct, so the updates of axpy do not conflict.
+template <class T> static inline double csr_dot(const double *s,
+	const int *index, const T *value, size_t begin, size_t end)
+{
+	double ret = 0;
+#pragma omp simd reduction(+:ret)
+	for(size_t k=begin; k<end; k++)
+		ret += s[index[k]]*value[k];
+	return ret;
+}
+
+static inline double csr_dot(const double *s, const int *index,
+	size_t begin, size_t end)
+{
+	double ret = 0;
+#pragma omp simd reduction(+:ret)
+	for(size_t k=begin; k<end; k++)
+		ret += s[index[k]];
+	return ret;
+}
+
+template <class T> static inline void csr_axpy(double a, const int *index,
+	const T *value, size_t begin, size_t end, double *y)
+{
+#pragma omp simd
+	for(size_t k=begin; k<end; k++)
+		y[index[k]] += a*value[k];
+}
+
+static inline void csr_axpy(double a, const int *index,
+	size_t begin, size_t end, double *y)
+{
+#pragma omp simd
+	for(size_t k=begin; k<end; k++)
+		y[index[k]] += a;
+}
+
+template <class T> static inline void csr_axpy_sq(double a, const int *index,
+	const T *value, size_t begin, size_t end, double *y)
+{
+#pragma omp simd
+	for(size_t k=begin; k<end; k++)
+		y[index[k]] += a*value[k]*value[k];
+}
+
+CSR_Matrix::CSR_Matrix(const problem *prob, int storage_type, bool transpose)
+{
+	int i, j;
+	int l = prob->l;
+	feature_node **x = prob->x;
+
+	this->storage_type = storage_type;
+	nr_row = transpose ? prob->n : l;
+	row_start = new size_t[nr_row+1];
+	for(j=0;j<=nr_row;j++)
+		row_start[j] = 0;
+	for(i=0;i<l;i++)
+		for(feature_node *xi=x[i]; xi->index!=-1; xi++)
+			row_start[transpose ? xi->index : i+1]++;
+	for(j=0;j<nr_row;j++)
+		row_start[j+1] += row_start[j];
+	row_end = row_start+1;
+	is_view = false;
+
+	nnz = row_start[nr_row];
+	index = new int[nnz];
+	value_double = NULL;
+	value_float = NULL;
+	if(storage_type == STORAGE_CSR_FLOAT)
+		value_float = new float[nnz];
+	else if(storage_type != STORAGE_CSR_PATTERN)
+		value_double = new double[nnz];
+
+	if(transpose)
+	{
+		size_t *next = new size_t[nr_row];
+		memcpy(next, row_start, sizeof(size_t)*nr_row);
+		for(i=0;i<l;i++)
+			for(feature_node *xi=x[i]; xi->index!=-1; xi++)
+				set(next[xi->index-1]++, i, xi->value);
+		delete[] next;
+	}
+	else
+	{
+#pragma omp parallel for private(i) schedule(guided)
+		for(i=0;i<l;i++)
+		{
+			size_t k = row_start[i];
+			for(feature_node *xi=x[i]; xi->index!=-1; xi++)
+				set(k++, xi->index-1, xi->value);
+		}
+	}
+}
+
+CSR_Matrix::CSR_Matrix(const CSR_Matrix *rows_of, const int *rows, int nr_row)
+{
+	storage_type = rows_of->storage_type;
+	this->nr_row = nr_row;
+	row_start = new size_t[nr_row];
+	row_end = new size_t[nr_row];
+	nnz = 0;
+	for(int i=0;i<nr_row;i++)
+	{
+		row_start[i] = rows_of->row_start[rows[i]];
+		row_end[i] = rows_of->row_end[rows[i]];
+		nnz += row_end[i]-row_start[i];
+	}
+	is_view = true;
+	index = rows_of->index;
+	value_double = rows_of->value_double;
+	value_float = rows_of->value_float;
+}
+
+CSR_Matrix::~CSR_Matrix()
+{
+	delete[] row_start;
+	if(is_view)
+	{
+		delete[] row_end;
+		return;
+	}
+	delete[] index;
+	delete[] value_double;
+	delete[] value_float;
+}
+
+inline void CSR_Matrix::set(size_t k, int index, double value)
+{
+	this->index[k] = index;
+	if(value_double)
+		value_double[k] = value;
+	else if(value_float)
+		value_float[k] = (float)value;
+}
+
+double CSR_Matrix::dot(const double *s, int i) const
+{
+	if(value_double)
+		return csr_dot(s, index, value_double, row_start[i], row_end[i]);
+	else if(value_float)
+		return csr_dot(s, index, value_float, row_start[i], row_end[i]);
+	else
+		return csr_dot(s, index, row_start[i], row_end[i]);
+}
+
+void CSR_Matrix::axpy(double a, int i, double *y) const
+{
+	if(value_double)
+		csr_axpy(a, index, value_double, row_start[i], row_end[i], y);
+	else if(value_float)
+		csr_axpy(a, index, value_float, row_start[i], row_end[i], y);
+	else
+		csr_axpy(a, index, row_start[i], row_end[i], y);
+}
+
+void CSR_Matrix::axpy_sq(double a, int i, double *y) const
+{
+	if(value_double)
+		csr_axpy_sq(a, index, value_double, row_start[i], row_end[i], y);
+	else if(value_float)
+		csr_axpy_sq(a, index, value_float, row_start[i], row_end[i], y);
+	else
+		csr_axpy(a, index, row_start[i], row_end[i], y);
+}
+
+// of one pass over all the rows
+double CSR_Matrix::get_bytes(void) const
+{
+	double value_size = value_double ? sizeof(double) : value_float ? sizeof(float) : 0;
+	double row_size = is_view ? 2*sizeof(size_t) : sizeof(size_t);
+	return (double)nr_row*row_size + (double)nnz*((double)sizeof(int)+value_size);
+}
+
+void CSR_Matrix::Mv(const double *v, double *Mv) const
+{
+	int i;
+#pragma omp parallel for private(i) schedule(guided)
+	for(i=0;i<nr_row;i++)
+		Mv[i] = dot(v, i);
+}
+
+// The CSR rows of the whole problem of cross_validation and
+// find_parameters, which the folds train on instead of a copy each. A
+// subproblem shares the feature_node arrays of the problem, so the rows
+// of its instances, also in the order train groups the classes in, are
+// found by their pointers. The folds set cv_rows on their own thread.
+class CV_Rows
+{
+public:
+	CV_Rows(const problem *prob, int storage_type);
+	~CV_Rows();
+
+	CSR_Matrix *view(const problem *subprob, int storage_type) const;
+
+private:
+	struct row_of { const feature_node *x; int row; };
+	static int compare(const void *a, const void *b);
+	CSR_Matrix *csr;
+	int storage_type;
+	int l;
+	row_of *rows; // sorted by x
+};
+
+static const CV_Rows *cv_rows = NULL;
+#pragma omp threadprivate(cv_rows)
+
+CV_Rows::CV_Rows(const problem *prob, int storage_type)
+{
+	this->storage_type = storage_type;
+	l = prob->l;
+	csr = new CSR_Matrix(prob, storage_type, false);
+	rows = new row_of[l];
+	for(int i=0;i<l;i++)
+	{
+		rows[i].x = prob->x[i];
+		rows[i].row = i;
+	}
+	qsort(rows, (size_t)l, sizeof(row_of), compare);
+}
+
+CV_Rows::~CV_Rows()
+{
+	delete csr;
+	delete[] rows;
+}
+
+int CV_Rows::compare(const void *a, const void *b)
+{
+	const feature_node *xa = ((const row_of *)a)->x;
+	const feature_node *xb = ((const row_of *)b)->x;
+	return xa < xb ? -1 : xa > xb;
+}
+
+// NULL if an instance of subprob is not one of the problem
+CSR_Matrix *CV_Rows::view(const problem *subprob, int storage_type) const
+{
+	if(storage_type != this->storage_type)
+		return NULL;
+	int *sub_rows = new int[subprob->l];
+	for(int i=0;i<subprob->l;i++)
+	{
+		row_of key = {subprob->x[i], 0};
+		const row_of *r = (const row_of *)bsearch(&key, rows, (size_t)l, sizeof(row_of), compare);
+		if(r == NULL)
+		{
+			delete[] sub_rows;
+			return NULL;
+		}
+		sub_rows[i] = r->row;
+	}
+	CSR_Matrix *v = new CSR_Matrix(csr, sub_rows, subprob->l);
+	delete[] sub_rows;
+	return v;
+}
+
+void Reduce_Vectors::sum_scale_x(double scalar, const CSR_Matrix *x, int i)
+{
+	int thread_id = omp_get_thread_num();
+
+	x->axpy(scalar, i, tmp_array[thread_id]);
+}
+
+// The instances of an out-of-core problem, streamed from its cache file
+// (see linear.h) in blocks of about block_size MB. Every pass over X takes
+// the blocks in order, so a thread reads the blocks round and round the
+// file, each into the buffer the previous pass has released, while the
+// other one is used. The pages read are dropped from the page cache, so
+// only the two buffers and the row pointers stay in memory.
+class Stream_X
+{
+public:
+	Stream_X(const char *file_name, int l, int block_size);
+	~Stream_X();
+
+	void start_pass(void);
+	bool next_block(int *begin, int *end);
+	double get_bytes(void) const;
+
+	feature_node **x; // valid for the rows of the current block
+
+private:
+	int fd;
+	int l;
+	int64_t *row_start; // in nodes
+	off_t data_offset;
+	int nr_block;
+	int *block_start;
+	feature_node *buffer[2];
+	int nr_taken; // blocks of the current pass
+
+	// buffer seq%2 holds seq%nr_block, the read_seq-th block read
+	long taken_seq;
+	long read_seq;
+	long ready_seq[2];
+	bool in_use[2];
+	bool stop;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	void read_block(long seq);
+	static void *prefetch(void *arg);
+};
+
+Stream_X::Stream_X(const char *file_name, int l, int block_size)
+{
+	int i;
+	problem_cache_header h;
+
+	this->l = l;
+	fd = open(file_name, O_RDONLY);
+	if(fd < 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.l != l)
+	{
+		fprintf(stderr, "ERROR: can't stream %s\n", file_name);
+		exit(1);
+	}
+	row_start = new int64_t[l+1];
+	off_t offset = (off_t)(sizeof(h) + (size_t)l*sizeof(double));
+	if(pread(fd, row_start, (size_t)l*sizeof(int64_t), offset) != (ssize_t)((size_t)l*sizeof(int64_t)))
+	{
+		fprintf(stderr, "ERROR: can't stream %s\n", file_name);
+		exit(1);
+	}
+	row_start[l] = h.nr_node;
+	data_offset = offset + (off_t)((size_t)l*sizeof(int64_t));
+
+	// whole rows, at least one per block
+	int64_t block_nodes = max((int64_t)1, ((int64_t)block_size<<20)/(int64_t)sizeof(feature_node));
+	int64_t buffer_nodes = 0;
+	block_start = new int[l+1];
+	nr_block = 0;
+	for(i=0;i<l;)
+	{
+		int begin = i;
+		for(i++; i<l && row_start[i+1]-row_start[begin] <= block_nodes; i++)
+			;
+		block_start[nr_block++] = begin;
+		buffer_nodes = max(buffer_nodes, row_start[i]-row_start[begin]);
+	}
+	block_start[nr_block] = l;
+
+	x = new feature_node*[l];
+	buffer[0] = new feature_node[buffer_nodes];
+	buffer[1] = nr_block > 1 ? new feature_node[buffer_nodes] : NULL;
+	nr_taken = 0;
+	taken_seq = 0;
+	read_seq = 0;
+	ready_seq[0] = ready_seq[1] = -1;
+	in_use[0] = in_use[1] = false;
+	stop = false;
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&cond, NULL);
+
+	// a single block is read once and kept
+	if(nr_block == 1)
+	{
+		read_block(0);
+		ready_seq[0] = 0;
+	}
+	else if(nr_block > 1)
+		pthread_create(&thread, NULL, prefetch, this);
+}
+
+Stream_X::~Stream_X()
+{
+	if(nr_block > 1)
+	{
+		pthread_mutex_lock(&lock);
+		stop = true;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&lock);
+		pthread_join(thread, NULL);
+	}
+	pthread_mutex_destroy(&lock);
+	pthread_cond_destroy(&cond);
+	close(fd);
+	delete[] row_start;
+	delete[] block_start;
+	delete[] x;
+	delete[] buffer[0];
+	delete[] buffer[1];
+}
+
+// reads the block of seq into its buffer and points its rows there
+void Stream_X::read_block(long seq)
+{
+	int b = (int)(seq % nr_block);
+	feature_node *buf = buffer[seq % 2];
+	int64_t first = row_start[block_start[b]];
+	size_t size = (size_t)(row_start[block_start[b+1]] - first)*sizeof(feature_node);
+	off_t offset = data_offset + (off_t)first*(off_t)sizeof(feature_node);
+	size_t done = 0;
+
+	while(done < size)
+	{
+		ssize_t r = pread(fd, (char *)buf + done, size - done, offset + (off_t)done);
+		if(r <= 0)
+		{
+			fprintf(stderr, "ERROR: can't read the instances to stream\n");
+			exit(1);
+		}
+		done += (size_t)r;
+	}
+	posix_fadvise(fd, offset, (off_t)size, POSIX_FADV_DONTNEED);
+	for(int i=block_start[b];i<block_start[b+1];i++)
+		x[i] = buf + (row_start[i] - first);
+}
+
+void *Stream_X::prefetch(void *arg)
+{
+	Stream_X *s = (Stream_X *)arg;
+
+	pthread_mutex_lock(&s->lock);
+	while(1)
+	{
+		long seq = s->read_seq;
+		while(!s->stop && (s->in_use[seq%2] || s->ready_seq[seq%2] >= 0))
+			pthread_cond_wait(&s->cond, &s->lock);
+		if(s->stop)
+			break;
+		pthread_mutex_unlock(&s->lock);
+		s->read_block(seq);
+		pthread_mutex_lock(&s->lock);
+		s->ready_seq[seq%2] = seq;
+		s->read_seq++;
+		pthread_cond_broadcast(&s->cond);
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+void Stream_X::start_pass(void)
+{
+	nr_taken = 0;
+}
+
+// The rows [*begin, *end) of the next block of this pass, false after
+// the last one. The previous block is released.
+bool Stream_X::next_block(int *begin, int *end)
+{
+	if(nr_block == 1)
+	{
+		if(nr_taken++ > 0)
+			return false;
+		*begin = 0;
+		*end = l;
+		return true;
+	}
+	if(nr_block == 0)
+		return false;
+
+	pthread_mutex_lock(&lock);
+	if(taken_seq > 0 && in_use[(taken_seq-1)%2])
+	{
+		in_use[(taken_seq-1)%2] = false;
+		ready_seq[(taken_seq-1)%2] = -1;
+		pthread_cond_broadcast(&cond);
+	}
+	if(nr_taken == nr_block)
+	{
+		pthread_mutex_unlock(&lock);
+		return false;
+	}
+	while(ready_seq[taken_seq%2] != taken_seq)
+		pthread_cond_wait(&cond, &lock);
+	in_use[taken_seq%2] = true;
+	pthread_mutex_unlock(&lock);
+
+	int b = (int)(taken_seq % nr_block);
+	*begin = block_start[b];
+	*end = block_start[b+1];
+	taken_seq++;
+	nr_taken++;
+	return true;
+}
+
+// of one pass over all the rows
+double Stream_X::get_bytes(void) const
+{
+	return (double)row_start[l]*sizeof(feature_node) + (double)l*sizeof(feature_node *);
+}
+
 // L2-regularized empirical risk minimization
 // min_w w^Tw/2 + \sum C_i \xi(w^Tx_i), where \xi() is the loss
 
@@ -194,11 +852,20 @@ public:
 	double fun(double *w);
 	double linesearch_and_update(double *w, double *d, double *f, double *g, double alpha);
 	int get_nr_variable(void);
+	double get_bytes_touched(void);
 
 protected:
 	virtual double C_times_loss(int i, double wx_i) = 0;
+	void count_Xv_bytes(double fraction);
+	void count_XTv_bytes(double fraction, bool rows_counted);
 	void Xv(double *v, double *Xv);
 	void XTv(double *v, double *XTv);
+	double dot_x(const double *s, int i);
+	void sum_scale_x(double scalar, int i);
+	void axpy_x(double scalar, int i, double *y);
+	void add_scale_x_sq(double scalar, int i, double *M);
+	void start_pass(void);
+	bool next_block(int *begin, int *end);
 
 	double *C;
 	const problem *prob;
@@ -207,6 +874,15 @@ protected:
 	double wTw;
 	int regularize_bias;
 	Reduce_Vectors *reduce_vectors;	
+	Thread_Blocks *thread_blocks; // instead of reduce_vectors if XTV_THREAD_BLOCKS
+	CSR_Matrix *csr_x; // instead of prob->x unless STORAGE_FEATURE_NODE
+	CSR_Matrix *column_major_x; // instead of reduce_vectors if XTV_COLUMN_MAJOR
+	double *xtv_v; // a working array of length l for column_major_x
+	double x_bytes, column_bytes; // of one pass over the rows, the columns
+	double bytes_touched;
+	feature_node **x; // prob->x, or that of stream_x
+	Stream_X *stream_x; // if param->stream_file
+	bool pass_done; // without stream_x, a pass is one block of all rows
 };
 
 l2r_erm_fun::l2r_erm_fun(const problem *prob, const parameter *param, double *C)
@@ -215,10 +891,60 @@ l2r_erm_fun::l2r_erm_fun(const problem *prob, const parameter *param, double *C)
 
 	this->prob = prob;
 
-	wx = new double[l];
-	tmp = new double[l];
+	wx = new_hot_vector(l);
+	tmp = new_hot_vector(l);
+
+	if(param->stream_file != NULL)
+	{
+		stream_x = new Stream_X(param->stream_file, l, param->stream_block_size);
+		x = stream_x->x;
+	}
+	else
+	{
+		stream_x = NULL;
+		x = prob->x;
+	}
+
+	csr_x = NULL;
+	if(param->storage_type != STORAGE_FEATURE_NODE && cv_rows != NULL)
+		csr_x = cv_rows->view(prob, param->storage_type);
+	if(param->storage_type != STORAGE_FEATURE_NODE && csr_x == NULL)
+		csr_x = new CSR_Matrix(prob, param->storage_type, false);
+
+	reduce_vectors = NULL;
+	thread_blocks = NULL;
+	column_major_x = NULL;
+	xtv_v = NULL;
+	if(param->xtv_type == XTV_COLUMN_MAJOR)
+	{
+		column_major_x = new CSR_Matrix(prob, param->storage_type, true);
+		xtv_v = new_hot_vector(l);
+	}
+	else if(param->xtv_type == XTV_THREAD_BLOCKS)
+		thread_blocks = new Thread_Blocks(prob, get_nr_variable());
+	else
+		reduce_vectors = new Reduce_Vectors(get_nr_variable());
 
-	reduce_vectors = new Reduce_Vectors(get_nr_variable());
+	if(csr_x)
+		x_bytes = csr_x->get_bytes();
+	else if(stream_x)
+		x_bytes = stream_x->get_bytes();
+	else
+	{
+		size_t nr_node = 0;
+		int i;
+#pragma omp parallel for private(i) reduction(+:nr_node) schedule(static)
+		for(i=0;i<l;i++)
+		{
+			feature_node *xi = prob->x[i];
+			while(xi->index != -1)
+				xi++;
+			nr_node += (size_t)(xi - prob->x[i]) + 1;
+		}
+		x_bytes = (double)nr_node*sizeof(feature_node) + (double)l*sizeof(feature_node *);
+	}
+	column_bytes = column_major_x ? column_major_x->get_bytes() : 0;
+	bytes_touched = 0;
 
 	this->C = C;
 	this->regularize_bias = param->regularize_bias;
@@ -226,9 +952,14 @@ l2r_erm_fun::l2r_erm_fun(const problem *prob, const parameter *param, double *C)
 
 l2r_erm_fun::~l2r_erm_fun()
 {
-	delete[] wx;
-	delete[] tmp;
+	delete_hot_vector(wx);
+	delete_hot_vector(tmp);
 	delete reduce_vectors;	
+	delete thread_blocks;
+	delete csr_x;
+	delete column_major_x;
+	delete stream_x;
+	delete_hot_vector(xtv_v);
 }
 
 double l2r_erm_fun::fun(double *w)
@@ -328,33 +1059,173 @@ double l2r_erm_fun::linesearch_and_update(double *w, double *s, double *f, doubl
 	return alpha;
 }
 
-void l2r_erm_fun::Xv(double *v, double *Xv)
+double l2r_erm_fun::get_bytes_touched(void)
 {
-	int i;
-	int l=prob->l;
-	feature_node **x=prob->x;
-
-#pragma omp parallel for private (i) schedule(guided)	
-	for(i=0;i<l;i++)
-		Xv[i]=sparse_operator::dot(v, x[i]);
+	return bytes_touched;
 }
 
-void l2r_erm_fun::XTv(double *v, double *XTv)
+// The byte counts are estimates: the instances in the products with X
+// (a fraction of them, for the L2 losses) and the vectors streamed with
+// them, but not the other O(l) loops.
+//
+// X v over a fraction of the rows reads v once and writes a result per row
+void l2r_erm_fun::count_Xv_bytes(double fraction)
 {
-	int i;
-	int l=prob->l;
-	feature_node **x=prob->x;
-
-	reduce_vectors->init();
+	int l = prob->l;
+	int w_size = get_nr_variable();
 
-#pragma omp parallel for private(i) schedule(guided)
-	for(i=0;i<l;i++)
-		reduce_vectors->sum_scale_x(v[i], x[i]);
-	
-	reduce_vectors->reduce_sum(XTv);
+	bytes_touched += fraction*(x_bytes + (double)l*sizeof(double)) + (double)w_size*sizeof(double);
 }
 
-class l2r_lr_fun: public l2r_erm_fun
+// X^T v over a fraction of the rows: the rows, unless they were already
+// counted by the X v fused with it, and the per-thread vectors (or their
+// touched blocks) cleared and summed; or one pass over the (all) columns
+// and the length l vector
+void l2r_erm_fun::count_XTv_bytes(double fraction, bool rows_counted)
+{
+	int l = prob->l;
+	int w_size = get_nr_variable();
+
+	if(column_major_x)
+		bytes_touched += column_bytes + (double)(l + w_size)*sizeof(double);
+	else
+	{
+		if(!rows_counted)
+			bytes_touched += fraction*(x_bytes + (double)l*sizeof(double));
+		if(thread_blocks)
+			bytes_touched += thread_blocks->get_bytes();
+		else
+			bytes_touched += (double)(2*omp_get_max_threads() + 1)*w_size*sizeof(double);
+	}
+}
+
+inline double l2r_erm_fun::dot_x(const double *s, int i)
+{
+	if(csr_x)
+		return csr_x->dot(s, i);
+	return sparse_operator::dot(s, x[i]);
+}
+
+inline void l2r_erm_fun::sum_scale_x(double scalar, int i)
+{
+	if(csr_x)
+		reduce_vectors->sum_scale_x(scalar, csr_x, i);
+	else
+		reduce_vectors->sum_scale_x(scalar, x[i]);
+}
+
+// y += scalar * x_i, for the vectors of thread_blocks
+inline void l2r_erm_fun::axpy_x(double scalar, int i, double *y)
+{
+	if(csr_x)
+		csr_x->axpy(scalar, i, y);
+	else
+		sparse_operator::axpy(scalar, x[i], y);
+}
+
+// M += scalar * x_i.^2, for the diagonal preconditioners
+void l2r_erm_fun::add_scale_x_sq(double scalar, int i, double *M)
+{
+	if(csr_x)
+	{
+		csr_x->axpy_sq(scalar, i, M);
+		return;
+	}
+	feature_node *xi = x[i];
+	while (xi->index!=-1)
+	{
+		M[xi->index-1] += xi->value*xi->value*scalar;
+		xi++;
+	}
+}
+
+// A pass over X goes through the blocks of rows of stream_x, or all rows
+// at once, as in
+//	for(start_pass(); next_block(&begin, &end); )
+//		for(i=begin;i<end;i++)
+//			... x[i] ...
+void l2r_erm_fun::start_pass(void)
+{
+	if(stream_x)
+		stream_x->start_pass();
+	pass_done = false;
+}
+
+bool l2r_erm_fun::next_block(int *begin, int *end)
+{
+	if(stream_x)
+		return stream_x->next_block(begin, end);
+	if(pass_done)
+		return false;
+	*begin = 0;
+	*end = prob->l;
+	pass_done = true;
+	return true;
+}
+
+void l2r_erm_fun::Xv(double *v, double *Xv)
+{
+	int i;
+
+	int begin, end;
+
+	count_Xv_bytes(1);
+
+	if(csr_x)
+	{
+		csr_x->Mv(v, Xv);
+		return;
+	}
+
+	for(start_pass(); next_block(&begin, &end); )
+	{
+#pragma omp parallel for private (i) schedule(guided)	
+		for(i=begin;i<end;i++)
+			Xv[i]=dot_x(v, i);
+	}
+}
+
+void l2r_erm_fun::XTv(double *v, double *XTv)
+{
+	int i;
+	int begin, end;
+
+	count_XTv_bytes(1, false);
+
+	if(column_major_x)
+	{
+		column_major_x->Mv(v, XTv);
+		return;
+	}
+
+	if(thread_blocks)
+	{
+		int t, nr_thread = thread_blocks->get_nr_thread();
+#pragma omp parallel for private(t,i) schedule(dynamic,1)
+		for(t=0;t<nr_thread;t++)
+		{
+			double *y = thread_blocks->get_vector(t);
+			thread_blocks->clear(t);
+			for(i=thread_blocks->row_begin(t);i<thread_blocks->row_begin(t+1);i++)
+				axpy_x(v[i], i, y);
+		}
+		thread_blocks->reduce_sum(XTv);
+		return;
+	}
+
+	reduce_vectors->init();
+
+	for(start_pass(); next_block(&begin, &end); )
+	{
+#pragma omp parallel for private(i) schedule(guided)
+		for(i=begin;i<end;i++)
+			sum_scale_x(v[i], i);
+	}
+	
+	reduce_vectors->reduce_sum(XTv);
+}
+
+class l2r_lr_fun: public l2r_erm_fun
 {
 public:
 	l2r_lr_fun(const problem *prob, const parameter *param, double *C);
@@ -374,12 +1245,12 @@ l2r_lr_fun::l2r_lr_fun(const problem *prob, const parameter *param, double *C):
 	l2r_erm_fun(prob, param, C)
 {
 	int l=prob->l;
-	D = new double[l];
+	D = new_hot_vector(l);
 }
 
 l2r_lr_fun::~l2r_lr_fun()
 {
-	delete[] D;
+	delete_hot_vector(D);
 }
 
 double l2r_lr_fun::C_times_loss(int i, double wx_i)
@@ -417,24 +1288,17 @@ void l2r_lr_fun::grad(double *w, double *g)
 void l2r_lr_fun::get_diag_preconditioner(double *M)
 {
 	int i;
-	int l = prob->l;
 	int w_size=get_nr_variable();
-	feature_node **x = prob->x;
 
 	for (i=0; i<w_size; i++)
 		M[i] = 1;
 	if(regularize_bias == 0)
 		M[w_size-1] = 0;
 
-	for (i=0; i<l; i++)
-	{
-		feature_node *xi = x[i];
-		while (xi->index!=-1)
-		{
-			M[xi->index-1] += xi->value*xi->value*C[i]*D[i];
-			xi++;
-		}
-	}
+	int begin, end;
+	for(start_pass(); next_block(&begin, &end); )
+		for (i=begin; i<end; i++)
+			add_scale_x_sq(C[i]*D[i], i, M);
 }
 
 void l2r_lr_fun::Hv(double *s, double *Hs)
@@ -442,22 +1306,51 @@ void l2r_lr_fun::Hv(double *s, double *Hs)
 	int i;
 	int l=prob->l;
 	int w_size=get_nr_variable();
-	feature_node **x=prob->x;
 
-	reduce_vectors->init();
+	count_Xv_bytes(1);
+	count_XTv_bytes(1, true);
 
+	if(column_major_x)
+	{
 #pragma omp parallel for private(i) schedule(guided)
-	for(i=0;i<l;i++)
+		for(i=0;i<l;i++)
+			xtv_v[i] = C[i]*D[i]*dot_x(s, i);
+		column_major_x->Mv(xtv_v, Hs);
+	}
+	else if(thread_blocks)
 	{
-		feature_node * const xi=x[i];
-		double xTs = sparse_operator::dot(s, xi);
+		int t, nr_thread = thread_blocks->get_nr_thread();
+#pragma omp parallel for private(t,i) schedule(dynamic,1)
+		for(t=0;t<nr_thread;t++)
+		{
+			double *y = thread_blocks->get_vector(t);
+			thread_blocks->clear(t);
+			for(i=thread_blocks->row_begin(t);i<thread_blocks->row_begin(t+1);i++)
+				axpy_x(C[i]*D[i]*dot_x(s, i), i, y);
+		}
+		thread_blocks->reduce_sum(Hs);
+	}
+	else
+	{
+		int begin, end;
 
-		xTs = C[i]*D[i]*xTs;
+		reduce_vectors->init();
 
-		reduce_vectors->sum_scale_x(xTs, xi);
-	}
+		for(start_pass(); next_block(&begin, &end); )
+		{
+#pragma omp parallel for private(i) schedule(guided)
+			for(i=begin;i<end;i++)
+			{
+				double xTs = dot_x(s, i);
 
-	reduce_vectors->reduce_sum(Hs);
+				xTs = C[i]*D[i]*xTs;
+
+				sum_scale_x(xTs, i);
+			}
+		}
+
+		reduce_vectors->reduce_sum(Hs);
+	}
 #pragma omp parallel for private(i) schedule(static)
 	for(i=0;i<w_size;i++)
 		Hs[i] = s[i] + Hs[i];
@@ -478,6 +1371,9 @@ public:
 
 protected:
 	void subXTv(double *v, double *XTv);
+	void clear_xtv_v(void);
+	void get_I_range(int end, int *Ibegin, int *Iend);
+	int lower_I(int row);
 
 	int *I;
 	int sizeI;
@@ -537,22 +1433,18 @@ void l2r_l2_svc_fun::get_diag_preconditioner(double *M)
 {
 	int i;
 	int w_size=get_nr_variable();
-	feature_node **x = prob->x;
 
 	for (i=0; i<w_size; i++)
 		M[i] = 1;
 	if(regularize_bias == 0)
 		M[w_size-1] = 0;
 
-	for (i=0; i<sizeI; i++)
+	int begin, end, Ibegin, Iend = 0;
+	for(start_pass(); next_block(&begin, &end); )
 	{
-		int idx = I[i];
-		feature_node *xi = x[idx];
-		while (xi->index!=-1)
-		{
-			M[xi->index-1] += xi->value*xi->value*C[idx]*2;
-			xi++;
-		}
+		get_I_range(end, &Ibegin, &Iend);
+		for (i=Ibegin; i<Iend; i++)
+			add_scale_x_sq(C[I[i]]*2, I[i], M);
 	}
 }
 
@@ -560,22 +1452,54 @@ void l2r_l2_svc_fun::Hv(double *s, double *Hs)
 {
 	int i;
 	int w_size=get_nr_variable();
-	feature_node **x=prob->x;
 
-	reduce_vectors->init();
+	count_Xv_bytes((double)sizeI/prob->l);
+	count_XTv_bytes((double)sizeI/prob->l, true);
 
+	if(column_major_x)
+	{
+		clear_xtv_v();
 #pragma omp parallel for private(i) schedule(guided)
-	for(i=0;i<sizeI;i++)
+		for(i=0;i<sizeI;i++)
+			xtv_v[I[i]] = C[I[i]]*dot_x(s, I[i]);
+		column_major_x->Mv(xtv_v, Hs);
+	}
+	else if(thread_blocks)
 	{
-		feature_node * const xi=x[I[i]];
-		double xTs = sparse_operator::dot(s, xi);
+		int t, nr_thread = thread_blocks->get_nr_thread();
+#pragma omp parallel for private(t,i) schedule(dynamic,1)
+		for(t=0;t<nr_thread;t++)
+		{
+			double *y = thread_blocks->get_vector(t);
+			int row_end = thread_blocks->row_begin(t+1);
+			thread_blocks->clear(t);
+			for(i=lower_I(thread_blocks->row_begin(t));i<sizeI && I[i]<row_end;i++)
+				axpy_x(C[I[i]]*dot_x(s, I[i]), I[i], y);
+		}
+		thread_blocks->reduce_sum(Hs);
+	}
+	else
+	{
+		int begin, end, Ibegin, Iend = 0;
 
-		xTs = C[I[i]]*xTs;
+		reduce_vectors->init();
 
-		reduce_vectors->sum_scale_x(xTs, xi);
-	}
+		for(start_pass(); next_block(&begin, &end); )
+		{
+			get_I_range(end, &Ibegin, &Iend);
+#pragma omp parallel for private(i) schedule(guided)
+			for(i=Ibegin;i<Iend;i++)
+			{
+				double xTs = dot_x(s, I[i]);
+
+				xTs = C[I[i]]*xTs;
+
+				sum_scale_x(xTs, I[i]);
+			}
+		}
 	
-	reduce_vectors->reduce_sum(Hs);
+		reduce_vectors->reduce_sum(Hs);
+	}
 #pragma omp parallel for private(i) schedule(static)
 	for(i=0;i<w_size;i++)
 		Hs[i] = s[i] + 2*Hs[i];
@@ -583,16 +1507,83 @@ void l2r_l2_svc_fun::Hv(double *s, double *Hs)
 		Hs[w_size-1] -= s[w_size-1];
 }
 
+// I is in increasing order: the part of it in the block of a pass that
+// ends at end follows the part in the previous block
+void l2r_l2_svc_fun::get_I_range(int end, int *Ibegin, int *Iend)
+{
+	*Ibegin = *Iend;
+	while(*Iend < sizeI && I[*Iend] < end)
+		(*Iend)++;
+}
+
+// The first position of I with I[k] >= row
+int l2r_l2_svc_fun::lower_I(int row)
+{
+	int begin = 0, end = sizeI;
+	while(begin < end)
+	{
+		int mid = begin + (end - begin)/2;
+		if(I[mid] < row)
+			begin = mid + 1;
+		else
+			end = mid;
+	}
+	return begin;
+}
+
+// The instances outside I take no part in subXTv and Hv
+void l2r_l2_svc_fun::clear_xtv_v(void)
+{
+	int i;
+	int l=prob->l;
+#pragma omp parallel for private(i) schedule(static)
+	for(i=0;i<l;i++)
+		xtv_v[i] = 0;
+}
+
 void l2r_l2_svc_fun::subXTv(double *v, double *XTv)
 {
 	int i;
-	feature_node **x=prob->x;
+
+	count_XTv_bytes((double)sizeI/prob->l, false);
+
+	if(column_major_x)
+	{
+		clear_xtv_v();
+#pragma omp parallel for private(i) schedule(static)
+		for(i=0;i<sizeI;i++)
+			xtv_v[I[i]] = v[i];
+		column_major_x->Mv(xtv_v, XTv);
+		return;
+	}
+
+	if(thread_blocks)
+	{
+		int t, nr_thread = thread_blocks->get_nr_thread();
+#pragma omp parallel for private(t,i) schedule(dynamic,1)
+		for(t=0;t<nr_thread;t++)
+		{
+			double *y = thread_blocks->get_vector(t);
+			int row_end = thread_blocks->row_begin(t+1);
+			thread_blocks->clear(t);
+			for(i=lower_I(thread_blocks->row_begin(t));i<sizeI && I[i]<row_end;i++)
+				axpy_x(v[i], I[i], y);
+		}
+		thread_blocks->reduce_sum(XTv);
+		return;
+	}
+
+	int begin, end, Ibegin, Iend = 0;
 
 	reduce_vectors->init();
 
+	for(start_pass(); next_block(&begin, &end); )
+	{
+		get_I_range(end, &Ibegin, &Iend);
 #pragma omp parallel for private(i) schedule(guided)
-	for(i=0;i<sizeI;i++)
-		reduce_vectors->sum_scale_x(v[i], x[I[i]]);
+		for(i=Ibegin;i<Iend;i++)
+			sum_scale_x(v[i], I[i]);
+	}
 
 	reduce_vectors->reduce_sum(XTv);
 }
@@ -1253,6 +2244,147 @@ static int solve_l2r_l1l2_svc(const problem *prob, const parameter *param, doubl
 	return iter;
 }
 
+// The asynchronous variant of solve_l2r_l1l2_svc for -a 1
+//
+// Every thread owns a fixed part of a random permutation of the instances,
+// shuffles it each iteration and updates its alpha_i one after the other,
+// reading w without locks and adding d*y_i*x_i to it atomically. w may thus
+// miss the updates of other threads in flight, the dual still converges
+// (PASSCoDe-Atomic, see Hsieh et al., ICML 2015). There is no shrinking;
+// the iteration stops when the projected gradients of all alpha are within
+// eps of each other.
+
+static int solve_l2r_l1l2_svc_async(const problem *prob, const parameter *param, double *w, double Cp, double Cn, int max_iter=300)
+{
+	int l = prob->l;
+	int w_size = prob->n;
+	double eps = param->eps;
+	int solver_type = param->solver_type;
+	int i, iter = 0;
+	double *QD = new double[l];
+	int *index = new int[l];
+	double *alpha = new double[l];
+	schar *y = new schar[l];
+
+	// default solver_type: L2R_L2LOSS_SVC_DUAL
+	double diag[3] = {0.5/Cn, 0, 0.5/Cp};
+	double upper_bound[3] = {INF, 0, INF};
+	if(solver_type == L2R_L1LOSS_SVC_DUAL)
+	{
+		diag[0] = 0;
+		diag[2] = 0;
+		upper_bound[0] = Cn;
+		upper_bound[2] = Cp;
+	}
+
+	for(i=0; i<l; i++)
+	{
+		if(prob->y[i] > 0)
+			y[i] = +1;
+		else
+			y[i] = -1;
+		alpha[i] = 0;
+	}
+
+	for(i=0; i<w_size; i++)
+		w[i] = 0;
+	for(i=0; i<l; i++)
+	{
+		QD[i] = diag[GETI(i)];
+
+		feature_node * const xi = prob->x[i];
+		QD[i] += sparse_operator::nrm2_sq(xi);
+		sparse_operator::axpy(y[i]*alpha[i], xi, w);
+
+		index[i] = i;
+	}
+	for(i=0; i<l; i++)
+	{
+		int j = i+rand_int(l-i);
+		swap(index[i], index[j]);
+	}
+
+	while (iter < max_iter)
+	{
+		double PGmax_new = -INF;
+		double PGmin_new = INF;
+
+#pragma omp parallel private(i)
+		{
+			int nr_thread = omp_get_num_threads();
+			int thread_id = omp_get_thread_num();
+			int begin = (int)((int64_t)l*thread_id/nr_thread);
+			int end = (int)((int64_t)l*(thread_id+1)/nr_thread);
+			double PGmax = -INF, PGmin = INF;
+
+			for(int s=begin; s<end; s++)
+			{
+				int j = s+rand_int(end-s);
+				swap(index[s], index[j]);
+			}
+			for(int s=begin; s<end; s++)
+			{
+				i = index[s];
+				const schar yi = y[i];
+				feature_node * const xi = prob->x[i];
+				double C = upper_bound[GETI(i)];
+				double G = yi*sparse_operator::dot(w, xi)-1 + alpha[i]*diag[GETI(i)];
+
+				double PG = G;
+				if(alpha[i] == 0)
+					PG = min(G, 0.0);
+				else if(alpha[i] == C)
+					PG = max(G, 0.0);
+				PGmax = max(PGmax, PG);
+				PGmin = min(PGmin, PG);
+
+				if(fabs(PG) > 1.0e-12)
+				{
+					double alpha_old = alpha[i];
+					alpha[i] = min(max(alpha[i] - G/QD[i], 0.0), C);
+					sparse_operator::axpy_atomic((alpha[i] - alpha_old)*yi, xi, w);
+				}
+			}
+#pragma omp critical
+			{
+				PGmax_new = max(PGmax_new, PGmax);
+				PGmin_new = min(PGmin_new, PGmin);
+			}
+		}
+
+		iter++;
+		if(iter % 10 == 0)
+			info(".");
+
+		if(PGmax_new - PGmin_new <= eps)
+			break;
+	}
+
+	info("\noptimization finished, #iter = %d\n",iter);
+
+	// calculate objective value
+
+	double v = 0;
+	int nSV = 0;
+	for(i=0; i<w_size; i++)
+		v += w[i]*w[i];
+	for(i=0; i<l; i++)
+	{
+		v += alpha[i]*(alpha[i]*diag[GETI(i)] - 2);
+		if(alpha[i] > 0)
+			++nSV;
+	}
+	info("Objective value = %lf\n",v/2);
+	info("nSV = %d\n",nSV);
+
+	delete [] QD;
+	delete [] alpha;
+	delete [] y;
+	delete [] index;
+
+	return iter;
+}
+
 
 // A coordinate descent algorithm for
 // L1-loss and L2-loss epsilon-SVR dual problem
@@ -1357,67 +2489,242 @@ static int solve_l2r_l1l2_svr(const problem *prob, const parameter *param, doubl
 			double violation = 0;
 			if(beta[i] == 0)
 			{
-				if(Gp < 0)
-					violation = -Gp;
-				else if(Gn > 0)
-					violation = Gn;
-				else if(Gp>Gmax_old && Gn<-Gmax_old)
-				{
-					active_size--;
-					swap(index[s], index[active_size]);
-					s--;
-					continue;
-				}
+				if(Gp < 0)
+					violation = -Gp;
+				else if(Gn > 0)
+					violation = Gn;
+				else if(Gp>Gmax_old && Gn<-Gmax_old)
+				{
+					active_size--;
+					swap(index[s], index[active_size]);
+					s--;
+					continue;
+				}
+			}
+			else if(beta[i] >= upper_bound[GETI(i)])
+			{
+				if(Gp > 0)
+					violation = Gp;
+				else if(Gp < -Gmax_old)
+				{
+					active_size--;
+					swap(index[s], index[active_size]);
+					s--;
+					continue;
+				}
+			}
+			else if(beta[i] <= -upper_bound[GETI(i)])
+			{
+				if(Gn < 0)
+					violation = -Gn;
+				else if(Gn > Gmax_old)
+				{
+					active_size--;
+					swap(index[s], index[active_size]);
+					s--;
+					continue;
+				}
+			}
+			else if(beta[i] > 0)
+				violation = fabs(Gp);
+			else
+				violation = fabs(Gn);
+
+			Gmax_new = max(Gmax_new, violation);
+			Gnorm1_new += violation;
+
+			// obtain Newton direction d
+			if(Gp < H*beta[i])
+				d = -Gp/H;
+			else if(Gn > H*beta[i])
+				d = -Gn/H;
+			else
+				d = -beta[i];
+
+			if(fabs(d) < 1.0e-12)
+				continue;
+
+			double beta_old = beta[i];
+			beta[i] = min(max(beta[i]+d, -upper_bound[GETI(i)]), upper_bound[GETI(i)]);
+			d = beta[i]-beta_old;
+
+			if(d != 0)
+				sparse_operator::axpy(d, xi, w);
+		}
+
+		if(iter == 0)
+			Gnorm1_init = Gnorm1_new;
+		iter++;
+		if(iter % 10 == 0)
+			info(".");
+
+		if(Gnorm1_new <= eps*Gnorm1_init)
+		{
+			if(active_size == l)
+				break;
+			else
+			{
+				active_size = l;
+				info("*");
+				Gmax_old = INF;
+				continue;
+			}
+		}
+
+		Gmax_old = Gmax_new;
+	}
+
+	info("\noptimization finished, #iter = %d\n", iter);
+
+	// calculate objective value
+	double v = 0;
+	int nSV = 0;
+	for(i=0; i<w_size; i++)
+		v += w[i]*w[i];
+	v = 0.5*v;
+	for(i=0; i<l; i++)
+	{
+		v += p*fabs(beta[i]) - y[i]*beta[i] + 0.5*lambda[GETI(i)]*beta[i]*beta[i];
+		if(beta[i] != 0)
+			nSV++;
+	}
+
+	info("Objective value = %lf\n", v);
+	info("nSV = %d\n",nSV);
+
+	delete [] beta;
+	delete [] QD;
+	delete [] index;
+
+	return iter;
+}
+
+// The asynchronous variant of solve_l2r_l1l2_svr for -a 1, updating beta
+// like solve_l2r_l1l2_svc_async does alpha. There is no shrinking; the
+// iteration stops when the violation of all beta has gone down to eps of
+// the first one.
+
+static int solve_l2r_l1l2_svr_async(const problem *prob, const parameter *param, double *w, int max_iter=300)
+{
+	const int solver_type = param->solver_type;
+	int l = prob->l;
+	double C = param->C;
+	double p = param->p;
+	int w_size = prob->n;
+	double eps = param->eps;
+	int i, iter = 0;
+	int *index = new int[l];
+
+	double Gnorm1_init = -1.0; // Gnorm1_init is initialized at the first iteration
+	double *beta = new double[l];
+	double *QD = new double[l];
+	double *y = prob->y;
+
+	// L2R_L2LOSS_SVR_DUAL
+	double lambda[1], upper_bound[1];
+	lambda[0] = 0.5/C;
+	upper_bound[0] = INF;
+
+	if(solver_type == L2R_L1LOSS_SVR_DUAL)
+	{
+		lambda[0] = 0;
+		upper_bound[0] = C;
+	}
+
+	// Initial beta can be set here. Note that
+	// -upper_bound <= beta[i] <= upper_bound
+	for(i=0; i<l; i++)
+		beta[i] = 0;
+
+	for(i=0; i<w_size; i++)
+		w[i] = 0;
+	for(i=0; i<l; i++)
+	{
+		feature_node * const xi = prob->x[i];
+		QD[i] = sparse_operator::nrm2_sq(xi);
+		sparse_operator::axpy(beta[i], xi, w);
+
+		index[i] = i;
+	}
+	for(i=0; i<l; i++)
+	{
+		int j = i+rand_int(l-i);
+		swap(index[i], index[j]);
+	}
+
+	while(iter < max_iter)
+	{
+		double Gnorm1_new = 0;
+
+#pragma omp parallel private(i)
+		{
+			int nr_thread = omp_get_num_threads();
+			int thread_id = omp_get_thread_num();
+			int begin = (int)((int64_t)l*thread_id/nr_thread);
+			int end = (int)((int64_t)l*(thread_id+1)/nr_thread);
+			double Gnorm1 = 0;
+
+			for(int s=begin; s<end; s++)
+			{
+				int j = s+rand_int(end-s);
+				swap(index[s], index[j]);
 			}
-			else if(beta[i] >= upper_bound[GETI(i)])
+			for(int s=begin; s<end; s++)
 			{
-				if(Gp > 0)
-					violation = Gp;
-				else if(Gp < -Gmax_old)
+				i = index[s];
+				double G = -y[i] + lambda[GETI(i)]*beta[i];
+				double H = QD[i] + lambda[GETI(i)];
+
+				feature_node * const xi = prob->x[i];
+				G += sparse_operator::dot(w, xi);
+
+				double Gp = G+p;
+				double Gn = G-p;
+				double violation = 0;
+				if(beta[i] == 0)
 				{
-					active_size--;
-					swap(index[s], index[active_size]);
-					s--;
-					continue;
+					if(Gp < 0)
+						violation = -Gp;
+					else if(Gn > 0)
+						violation = Gn;
 				}
-			}
-			else if(beta[i] <= -upper_bound[GETI(i)])
-			{
-				if(Gn < 0)
-					violation = -Gn;
-				else if(Gn > Gmax_old)
+				else if(beta[i] >= upper_bound[GETI(i)])
 				{
-					active_size--;
-					swap(index[s], index[active_size]);
-					s--;
-					continue;
+					if(Gp > 0)
+						violation = Gp;
 				}
-			}
-			else if(beta[i] > 0)
-				violation = fabs(Gp);
-			else
-				violation = fabs(Gn);
-
-			Gmax_new = max(Gmax_new, violation);
-			Gnorm1_new += violation;
+				else if(beta[i] <= -upper_bound[GETI(i)])
+				{
+					if(Gn < 0)
+						violation = -Gn;
+				}
+				else if(beta[i] > 0)
+					violation = fabs(Gp);
+				else
+					violation = fabs(Gn);
+				Gnorm1 += violation;
 
-			// obtain Newton direction d
-			if(Gp < H*beta[i])
-				d = -Gp/H;
-			else if(Gn > H*beta[i])
-				d = -Gn/H;
-			else
-				d = -beta[i];
+				// obtain Newton direction d
+				double d;
+				if(Gp < H*beta[i])
+					d = -Gp/H;
+				else if(Gn > H*beta[i])
+					d = -Gn/H;
+				else
+					d = -beta[i];
 
-			if(fabs(d) < 1.0e-12)
-				continue;
+				if(fabs(d) < 1.0e-12)
+					continue;
 
-			double beta_old = beta[i];
-			beta[i] = min(max(beta[i]+d, -upper_bound[GETI(i)]), upper_bound[GETI(i)]);
-			d = beta[i]-beta_old;
+				double beta_old = beta[i];
+				beta[i] = min(max(beta[i]+d, -upper_bound[GETI(i)]), upper_bound[GETI(i)]);
+				d = beta[i]-beta_old;
 
-			if(d != 0)
-				sparse_operator::axpy(d, xi, w);
+				if(d != 0)
+					sparse_operator::axpy_atomic(d, xi, w);
+			}
+#pragma omp critical
+			Gnorm1_new += Gnorm1;
 		}
 
 		if(iter == 0)
@@ -1427,19 +2734,7 @@ static int solve_l2r_l1l2_svr(const problem *prob, const parameter *param, doubl
 			info(".");
 
 		if(Gnorm1_new <= eps*Gnorm1_init)
-		{
-			if(active_size == l)
-				break;
-			else
-			{
-				active_size = l;
-				info("*");
-				Gmax_old = INF;
-				continue;
-			}
-		}
-
-		Gmax_old = Gmax_new;
+			break;
 	}
 
 	info("\noptimization finished, #iter = %d\n", iter);
@@ -1633,6 +2928,164 @@ static int solve_l2r_lr_dual(const problem *prob, const parameter *param, double
 	return iter;
 }
 
+// The asynchronous variant of solve_l2r_lr_dual for -a 1, running the inner
+// Newton method of each alpha_i like solve_l2r_l1l2_svc_async updates it
+
+static int solve_l2r_lr_dual_async(const problem *prob, const parameter *param, double *w, double Cp, double Cn, int max_iter=300)
+{
+	int l = prob->l;
+	int w_size = prob->n;
+	double eps = param->eps;
+	int i, iter = 0;
+	double *xTx = new double[l];
+	int *index = new int[l];
+	double *alpha = new double[2*l]; // store alpha and C - alpha
+	schar *y = new schar[l];
+	int max_inner_iter = 100; // for inner Newton
+	double innereps = 1e-2;
+	double innereps_min = min(1e-8, eps);
+	double upper_bound[3] = {Cn, 0, Cp};
+
+	for(i=0; i<l; i++)
+	{
+		if(prob->y[i] > 0)
+			y[i] = +1;
+		else
+			y[i] = -1;
+	}
+
+	// Initial alpha can be set here. Note that
+	// 0 < alpha[i] < upper_bound[GETI(i)]
+	// alpha[2*i] + alpha[2*i+1] = upper_bound[GETI(i)]
+	for(i=0; i<l; i++)
+	{
+		alpha[2*i] = min(0.001*upper_bound[GETI(i)], 1e-8);
+		alpha[2*i+1] = upper_bound[GETI(i)] - alpha[2*i];
+	}
+
+	for(i=0; i<w_size; i++)
+		w[i] = 0;
+	for(i=0; i<l; i++)
+	{
+		feature_node * const xi = prob->x[i];
+		xTx[i] = sparse_operator::nrm2_sq(xi);
+		sparse_operator::axpy(y[i]*alpha[2*i], xi, w);
+		index[i] = i;
+	}
+	for(i=0; i<l; i++)
+	{
+		int j = i+rand_int(l-i);
+		swap(index[i], index[j]);
+	}
+
+	while (iter < max_iter)
+	{
+		int newton_iter = 0;
+		double Gmax = 0;
+
+#pragma omp parallel private(i)
+		{
+			int nr_thread = omp_get_num_threads();
+			int thread_id = omp_get_thread_num();
+			int begin = (int)((int64_t)l*thread_id/nr_thread);
+			int end = (int)((int64_t)l*(thread_id+1)/nr_thread);
+			int thread_newton_iter = 0;
+			double thread_Gmax = 0;
+
+			for(int s=begin; s<end; s++)
+			{
+				int j = s+rand_int(end-s);
+				swap(index[s], index[j]);
+			}
+			for(int s=begin; s<end; s++)
+			{
+				i = index[s];
+				const schar yi = y[i];
+				double C = upper_bound[GETI(i)];
+				feature_node * const xi = prob->x[i];
+				double a = xTx[i], b = yi*sparse_operator::dot(w, xi);
+
+				// Decide to minimize g_1(z) or g_2(z)
+				int ind1 = 2*i, ind2 = 2*i+1, sign = 1;
+				if(0.5*a*(alpha[ind2]-alpha[ind1])+b < 0)
+				{
+					ind1 = 2*i+1;
+					ind2 = 2*i;
+					sign = -1;
+				}
+
+				//  g_t(z) = z*log(z) + (C-z)*log(C-z) + 0.5a(z-alpha_old)^2 + sign*b(z-alpha_old)
+				double alpha_old = alpha[ind1];
+				double z = alpha_old;
+				if(C - z < 0.5 * C)
+					z = 0.1*z;
+				double gp = a*(z-alpha_old)+sign*b+log(z/(C-z));
+				thread_Gmax = max(thread_Gmax, fabs(gp));
+
+				// Newton method on the sub-problem
+				const double eta = 0.1; // xi in the paper
+				int inner_iter = 0;
+				while (inner_iter <= max_inner_iter)
+				{
+					if(fabs(gp) < innereps)
+						break;
+					double gpp = a + C/(C-z)/z;
+					double tmpz = z - gp/gpp;
+					if(tmpz <= 0)
+						z *= eta;
+					else // tmpz in (0, C)
+						z = tmpz;
+					gp = a*(z-alpha_old)+sign*b+log(z/(C-z));
+					thread_newton_iter++;
+					inner_iter++;
+				}
+
+				if(inner_iter > 0) // update w
+				{
+					alpha[ind1] = z;
+					alpha[ind2] = C-z;
+					sparse_operator::axpy_atomic(sign*(z-alpha_old)*yi, xi, w);
+				}
+			}
+#pragma omp critical
+			{
+				newton_iter += thread_newton_iter;
+				Gmax = max(Gmax, thread_Gmax);
+			}
+		}
+
+		iter++;
+		if(iter % 10 == 0)
+			info(".");
+
+		if(Gmax < eps)
+			break;
+
+		if(newton_iter <= l/10)
+			innereps = max(innereps_min, 0.1*innereps);
+	}
+
+	info("\noptimization finished, #iter = %d\n",iter);
+
+	// calculate objective value
+
+	double v = 0;
+	for(i=0; i<w_size; i++)
+		v += w[i] * w[i];
+	v *= 0.5;
+	for(i=0; i<l; i++)
+		v += alpha[2*i] * log(alpha[2*i]) + alpha[2*i+1] * log(alpha[2*i+1])
+			- upper_bound[GETI(i)] * log(upper_bound[GETI(i)]);
+	info("Objective value = %lf\n", v);
+
+	delete [] xTx;
+	delete [] alpha;
+	delete [] y;
+	delete [] index;
+
+	return iter;
+}
+
 // A coordinate descent algorithm for
 // L1-regularized L2-loss support vector classification
 //
@@ -2944,6 +4397,7 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 			l2r_lr_fun fun_obj(prob, param, C);
 			NEWTON newton_obj(&fun_obj, primal_solver_tol);
 			newton_obj.set_print_string(liblinear_print_string);
+			newton_obj.set_trace(liblinear_trace_string);
 			newton_obj.newton(w);
 			break;
 		}
@@ -2952,12 +4406,16 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 			l2r_l2_svc_fun fun_obj(prob, param, C);
 			NEWTON newton_obj(&fun_obj, primal_solver_tol);
 			newton_obj.set_print_string(liblinear_print_string);
+			newton_obj.set_trace(liblinear_trace_string);
 			newton_obj.newton(w);
 			break;
 		}
 		case L2R_L2LOSS_SVC_DUAL:
 		{
-			iter = solve_l2r_l1l2_svc(prob, param, w, Cp, Cn, dual_solver_max_iter);
+			if(param->dcd_type == DCD_ASYNC)
+				iter = solve_l2r_l1l2_svc_async(prob, param, w, Cp, Cn, dual_solver_max_iter);
+			else
+				iter = solve_l2r_l1l2_svc(prob, param, w, Cp, Cn, dual_solver_max_iter);
 			if(iter >= dual_solver_max_iter)
 			{
 				info("\nWARNING: reaching max number of iterations\nSwitching to use -s 2\n\n");
@@ -2966,13 +4424,17 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 				l2r_l2_svc_fun fun_obj(prob, param, C);
 				NEWTON newton_obj(&fun_obj, primal_solver_tol);
 				newton_obj.set_print_string(liblinear_print_string);
+				newton_obj.set_trace(liblinear_trace_string);
 				newton_obj.newton(w);
 			}
 			break;
 		}
 		case L2R_L1LOSS_SVC_DUAL:
 		{
-			iter = solve_l2r_l1l2_svc(prob, param, w, Cp, Cn, dual_solver_max_iter);
+			if(param->dcd_type == DCD_ASYNC)
+				iter = solve_l2r_l1l2_svc_async(prob, param, w, Cp, Cn, dual_solver_max_iter);
+			else
+				iter = solve_l2r_l1l2_svc(prob, param, w, Cp, Cn, dual_solver_max_iter);
 			if(iter >= dual_solver_max_iter)
 				info("\nWARNING: reaching max number of iterations\nUsing -s 2 may be faster (also see FAQ)\n\n");			
 			break;
@@ -3001,7 +4463,10 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 		}
 		case L2R_LR_DUAL:
 		{
-			iter = solve_l2r_lr_dual(prob, param, w, Cp, Cn, dual_solver_max_iter);
+			if(param->dcd_type == DCD_ASYNC)
+				iter = solve_l2r_lr_dual_async(prob, param, w, Cp, Cn, dual_solver_max_iter);
+			else
+				iter = solve_l2r_lr_dual(prob, param, w, Cp, Cn, dual_solver_max_iter);
 			if(iter >= dual_solver_max_iter)
 			{
 				info("\nWARNING: reaching max number of iterations\nSwitching to use -s 0\n\n");
@@ -3010,6 +4475,7 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 				l2r_lr_fun fun_obj(prob, param, C);
 				NEWTON newton_obj(&fun_obj, primal_solver_tol);
 				newton_obj.set_print_string(liblinear_print_string);
+				newton_obj.set_trace(liblinear_trace_string);
 				newton_obj.newton(w);
 			}
 			break;
@@ -3019,12 +4485,16 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 			l2r_l2_svr_fun fun_obj(prob, param, C);
 			NEWTON newton_obj(&fun_obj, primal_solver_tol);
 			newton_obj.set_print_string(liblinear_print_string);
+			newton_obj.set_trace(liblinear_trace_string);
 			newton_obj.newton(w);
 			break;
 		}
 		case L2R_L1LOSS_SVR_DUAL:
 		{
-			iter = solve_l2r_l1l2_svr(prob, param, w, dual_solver_max_iter);
+			if(param->dcd_type == DCD_ASYNC)
+				iter = solve_l2r_l1l2_svr_async(prob, param, w, dual_solver_max_iter);
+			else
+				iter = solve_l2r_l1l2_svr(prob, param, w, dual_solver_max_iter);
 			if(iter >= dual_solver_max_iter)
 				info("\nWARNING: reaching max number of iterations\nUsing -s 11 may be faster (also see FAQ)\n\n");			
 
@@ -3032,7 +4502,10 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 		}
 		case L2R_L2LOSS_SVR_DUAL:
 		{
-			iter = solve_l2r_l1l2_svr(prob, param, w, dual_solver_max_iter);
+			if(param->dcd_type == DCD_ASYNC)
+				iter = solve_l2r_l1l2_svr_async(prob, param, w, dual_solver_max_iter);
+			else
+				iter = solve_l2r_l1l2_svr(prob, param, w, dual_solver_max_iter);
 			if(iter >= dual_solver_max_iter)
 			{
 				info("\nWARNING: reaching max number of iterations\nSwitching to use -s 11\n\n");
@@ -3041,6 +4514,7 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 				l2r_l2_svr_fun fun_obj(prob, param, C);
 				NEWTON newton_obj(&fun_obj, primal_solver_tol);
 				newton_obj.set_print_string(liblinear_print_string);
+				newton_obj.set_trace(liblinear_trace_string);
 				newton_obj.newton(w);
 			}
 			break;
@@ -3108,7 +4582,27 @@ static double calc_max_p(const problem *prob)
 	return max_p;
 }
 
-static void find_parameter_C(const problem *prob, parameter *param_tmp, double start_C, double max_C, double *best_C, double *best_score, const int *fold_start, const int *perm, const problem *subprob, int nr_fold)
+// How many folds train at the same time, each with nr_thread threads
+static int get_nr_fold_thread(const parameter *param, int nr_fold)
+{
+	int nr_fold_thread = max(min(param->nr_fold_thread, nr_fold), 1);
+	if(nr_fold_thread > 1 && param->nr_thread > 1)
+		omp_set_max_active_levels(2);
+	return nr_fold_thread;
+}
+
+// The rows the folds share, if their solver stores them in CSR
+static CV_Rows *new_cv_rows(const problem *prob, const parameter *param)
+{
+	if(param->storage_type == STORAGE_FEATURE_NODE || param->stream_file != NULL)
+		return NULL;
+	if(param->solver_type != L2R_LR && param->solver_type != L2R_L2LOSS_SVC
+		&& param->solver_type != L2R_L2LOSS_SVR)
+		return NULL;
+	return new CV_Rows(prob, param->storage_type);
+}
+
+static void find_parameter_C(const problem *prob, parameter *param_tmp, double start_C, double max_C, double *best_C, double *best_score, const int *fold_start, const int *perm, const problem *subprob, int nr_fold, const CV_Rows *rows)
 {
 	// variables for CV
 	int i;
@@ -3121,6 +4615,7 @@ static void find_parameter_C(const problem *prob, parameter *param_tmp, double s
 		prev_w[i] = NULL;
 	int num_unchanged_w = 0;
 	void (*default_print_string) (const char *) = liblinear_print_string;
+	int nr_fold_thread = get_nr_fold_thread(param_tmp, nr_fold);
 
 	if(param_tmp->solver_type == L2R_LR || param_tmp->solver_type == L2R_L2LOSS_SVC)
 		*best_score = 0.0;
@@ -3134,9 +4629,7 @@ static void find_parameter_C(const problem *prob, parameter *param_tmp, double s
 		//Output disabled for running CV at a particular C
 		set_print_string_function(&print_null);
 
-#ifdef CV_OMP
-#pragma omp parallel for private(i) schedule(dynamic)
-#endif
+#pragma omp parallel for private(i) schedule(dynamic) num_threads(nr_fold_thread) if(nr_fold_thread > 1)
 		for(i=0; i<nr_fold; i++)
 		{
 			int j;
@@ -3145,7 +4638,9 @@ static void find_parameter_C(const problem *prob, parameter *param_tmp, double s
 
 			struct parameter param_t = *param_tmp;
 			param_t.init_sol = prev_w[i];
+			cv_rows = rows;
 			struct model *submodel = train(&subprob[i],&param_t);
+			cv_rows = NULL;
 
 			int total_w_size;
 			if(submodel->nr_class == 2)
@@ -3235,6 +4730,44 @@ static void find_parameter_C(const problem *prob, parameter *param_tmp, double s
 }
 
 
+// Out of core, the instances stay in the order of the stream, as the
+// primal solvers do not depend on it: only y is relabeled for each class
+static void train_in_order(const problem *prob, const parameter *param, model *model_, const double *weighted_C)
+{
+	int i, j, k;
+	int l = prob->l;
+	int w_size = prob->n;
+	int nr_class = model_->nr_class;
+	int nr_w = nr_class == 2 ? 1 : nr_class;
+	problem sub_prob = *prob;
+	double *w = Malloc(double, w_size);
+
+	sub_prob.y = Malloc(double, l);
+	model_->w = Malloc(double, w_size*nr_w);
+	for(i=0;i<nr_w;i++)
+	{
+		for(k=0;k<l;k++)
+			sub_prob.y[k] = (int)prob->y[k] == model_->label[i] ? +1 : -1;
+
+		if(param->init_sol != NULL)
+			for(j=0;j<w_size;j++)
+				w[j] = param->init_sol[j*nr_w+i];
+		else
+			for(j=0;j<w_size;j++)
+				w[j] = 0;
+
+		if(nr_class == 2)
+			train_one(&sub_prob, param, w, weighted_C[0], weighted_C[1]);
+		else
+			train_one(&sub_prob, param, w, weighted_C[i], param->C);
+
+		for(j=0;j<w_size;j++)
+			model_->w[j*nr_w+i] = w[j];
+	}
+	free(w);
+	free(sub_prob.y);
+}
+
 //
 // Interface functions
 //
@@ -3254,6 +4787,7 @@ model* train(const problem *prob, const parameter *param)
 	model_->bias = prob->bias;
 
 	omp_set_num_threads(param->nr_thread);
+	set_hot_node(param->hot_node);
 
 	if(check_regression_model(model_))
 	{
@@ -3308,6 +4842,17 @@ model* train(const problem *prob, const parameter *param)
 				weighted_C[j] *= param->weight[i];
 		}
 
+		if(param->stream_file != NULL)
+		{
+			train_in_order(prob, param, model_, weighted_C);
+			free(label);
+			free(start);
+			free(count);
+			free(perm);
+			free(weighted_C);
+			return model_;
+		}
+
 		// constructing the subproblem
 		feature_node **x = Malloc(feature_node *,l);
 		for(i=0;i<l;i++)
@@ -3422,9 +4967,9 @@ void cross_validation(const problem *prob, const parameter *param, int nr_fold,
 	for(i=0;i<=nr_fold;i++)
 		fold_start[i]=i*l/nr_fold;
 
-#ifdef CV_OMP
-#pragma omp parallel for private(i) schedule(dynamic)
-#endif
+	int nr_fold_thread = get_nr_fold_thread(param, nr_fold);
+	CV_Rows *rows = new_cv_rows(prob, param);
+#pragma omp parallel for private(i) schedule(dynamic) num_threads(nr_fold_thread) if(nr_fold_thread > 1)
 	for(i=0;i<nr_fold;i++)
 	{
 		int begin = fold_start[i];
@@ -3451,13 +4996,16 @@ void cross_validation(const problem *prob, const parameter *param, int nr_fold,
 			subprob.y[k] = prob->y[perm[j]];
 			++k;
 		}
+		cv_rows = rows;
 		struct model *submodel = train(&subprob,param);
+		cv_rows = NULL;
 		for(j=begin;j<end;j++)
 			target[perm[j]] = predict(submodel,prob->x[perm[j]]);
 		free_and_destroy_model(&submodel);
 		free(subprob.x);
 		free(subprob.y);
 	}
+	delete rows;
 	free(fold_start);
 	free(perm);
 }
@@ -3516,6 +5064,7 @@ void find_parameters(const problem *prob, const parameter *param, int nr_fold, d
 	}
 
 	struct parameter param_tmp = *param;
+	CV_Rows *rows = new_cv_rows(prob, param);
 	*best_p = -1;
 	if(param->solver_type == L2R_LR || param->solver_type == L2R_L2LOSS_SVC)
 	{
@@ -3525,7 +5074,7 @@ void find_parameters(const problem *prob, const parameter *param, int nr_fold, d
 		start_C = min(start_C, max_C);
 		double best_C_tmp, best_score_tmp;
 
-		find_parameter_C(prob, &param_tmp, start_C, max_C, &best_C_tmp, &best_score_tmp, fold_start, perm, subprob, nr_fold);
+		find_parameter_C(prob, &param_tmp, start_C, max_C, &best_C_tmp, &best_score_tmp, fold_start, perm, subprob, nr_fold, rows);
 
 		*best_C = best_C_tmp;
 		*best_score = best_score_tmp;
@@ -3551,7 +5100,7 @@ void find_parameters(const problem *prob, const parameter *param, int nr_fold, d
 			start_C_tmp = min(start_C_tmp, max_C);
 			double best_C_tmp, best_score_tmp;
 
-			find_parameter_C(prob, &param_tmp, start_C_tmp, max_C, &best_C_tmp, &best_score_tmp, fold_start, perm, subprob, nr_fold);
+			find_parameter_C(prob, &param_tmp, start_C_tmp, max_C, &best_C_tmp, &best_score_tmp, fold_start, perm, subprob, nr_fold, rows);
 
 			if(best_score_tmp < *best_score)
 			{
@@ -3562,6 +5111,7 @@ void find_parameters(const problem *prob, const parameter *param, int nr_fold, d
 		}
 	}
 
+	delete rows;
 	free(fold_start);
 	free(perm);
 	for(i=0; i<nr_fold; i++)
@@ -3592,12 +5142,18 @@ double predict_values(const struct model *model_, const struct feature_node *x,
 	const feature_node *lx=x;
 	for(i=0;i<nr_w;i++)
 		dec_values[i] = 0;
+	// the weights of a feature are next to each other for all classes
 	for(; (idx=lx->index)!=-1; lx++)
 	{
 		// the dimension of testing data may exceed that of training
 		if(idx<=n)
+		{
+			const double *wi = &w[(size_t)(idx-1)*nr_w];
+			const double v = lx->value;
+#pragma omp simd
 			for(i=0;i<nr_w;i++)
-				dec_values[i] += w[(idx-1)*nr_w+i]*lx->value;
+				dec_values[i] += wi[i]*v;
+		}
 	}
 	if(check_oneclass_model(model_))
 		dec_values[0] -= model_->rho;
@@ -3665,6 +5221,35 @@ double predict_probability(const struct model *model_, const struct feature_node
 		return 0;
 }
 
+// predict_values of the instances x[0..l-1], spread over the threads. The
+// labels go to labels[i] and, unless dec_values is NULL, the decision
+// values to the nr_class entries (one for two classes, except -s 4) of
+// dec_values from i*nr_class on.
+void predict_values_batch(const struct model *model_, struct feature_node *const *x, int l, double *dec_values, double *labels)
+{
+	int nr_class = model_->nr_class;
+	int i;
+#pragma omp parallel private(i)
+	{
+		double *tmp = dec_values ? NULL : Malloc(double, nr_class);
+#pragma omp for schedule(guided)
+		for(i=0;i<l;i++)
+			labels[i] = predict_values(model_, x[i], dec_values ? &dec_values[(size_t)i*nr_class] : tmp);
+		free(tmp);
+	}
+}
+
+// predict_probability of the instances x[0..l-1], spread over the threads,
+// with the nr_class estimates of x[i] from prob_estimates[i*nr_class] on
+void predict_probability_batch(const struct model *model_, struct feature_node *const *x, int l, double *prob_estimates, double *labels)
+{
+	int nr_class = model_->nr_class;
+	int i;
+#pragma omp parallel for private(i) schedule(guided)
+	for(i=0;i<l;i++)
+		labels[i] = predict_probability(model_, x[i], &prob_estimates[(size_t)i*nr_class]);
+}
+
 static const char *solver_type_table[]=
 {
 	"L2R_LR", "L2R_L2LOSS_SVC_DUAL", "L2R_L2LOSS_SVC", "L2R_L1LOSS_SVC_DUAL", "MCSVM_CS",
@@ -3779,6 +5364,12 @@ struct model *load_model(const char *model_file_name)
 	param.weight_label = NULL;
 	param.weight = NULL;
 	param.init_sol = NULL;
+	param.xtv_type = XTV_THREAD_VECTORS;
+	param.storage_type = STORAGE_FEATURE_NODE;
+	param.hot_node = -1;
+	param.stream_file = NULL;
+	param.stream_block_size = 0;
+	param.dcd_type = DCD_SEQUENTIAL;
 
 	model_->label = NULL;
 
@@ -4027,6 +5618,57 @@ const char *check_parameter(const problem *prob, const parameter *param)
 		&& param->solver_type != ONECLASS_SVM)
 		return "unknown solver type";
 
+	if(param->xtv_type != XTV_THREAD_VECTORS
+		&& param->xtv_type != XTV_COLUMN_MAJOR
+		&& param->xtv_type != XTV_THREAD_BLOCKS)
+		return "unknown xtv type";
+
+	if(param->storage_type != STORAGE_FEATURE_NODE
+		&& param->storage_type != STORAGE_CSR_DOUBLE
+		&& param->storage_type != STORAGE_CSR_FLOAT
+		&& param->storage_type != STORAGE_CSR_PATTERN)
+		return "unknown storage type";
+
+	if(param->hot_node < -1 || param->hot_node >= 1024)
+		return "hot node must be -1 or a memory node below 1024";
+
+	if(param->nr_fold_thread < 1)
+		return "nr_fold_thread < 1";
+
+	if(param->dcd_type != DCD_SEQUENTIAL
+		&& param->dcd_type != DCD_ASYNC)
+		return "unknown dcd type";
+
+	if(param->stream_file != NULL)
+	{
+		if(param->solver_type != L2R_LR
+			&& param->solver_type != L2R_L2LOSS_SVC
+			&& param->solver_type != L2R_L2LOSS_SVR)
+			return "streaming only supports -s 0, 2 and 11";
+		if(param->storage_type != STORAGE_FEATURE_NODE
+			|| param->xtv_type != XTV_THREAD_VECTORS)
+			return "streaming needs the default storage and xtv types";
+		if(param->stream_block_size <= 0)
+			return "stream block size <= 0";
+
+		problem_cache_header h;
+		FILE *fp = fopen(param->stream_file, "rb");
+		bool ok = fp != NULL && fread(&h, sizeof(h), 1, fp) == 1
+			&& memcmp(h.magic, PROBLEM_CACHE_MAGIC, sizeof(h.magic)) == 0
+			&& h.l == prob->l && h.n == prob->n;
+		if(fp != NULL)
+			fclose(fp);
+		if(!ok)
+			return "stream file is not the cache of this problem";
+	}
+	else if(param->storage_type == STORAGE_CSR_PATTERN)
+	{
+		for(int i=0;i<prob->l;i++)
+			for(feature_node *xi=prob->x[i]; xi->index!=-1; xi++)
+				if(xi->value != 1)
+					return "pattern storage needs all feature values (and the bias) to be 1";
+	}
+
 	if(param->init_sol != NULL
 		&& param->solver_type != L2R_LR
 		&& param->solver_type != L2R_L2LOSS_SVC
@@ -4063,3 +5705,8 @@ void set_print_string_function(void (*print_func)(const char*))
 		liblinear_print_string = print_func;
 }
 
+void set_trace_function(void (*trace_func)(const char*))
+{
+	liblinear_trace_string = trace_func;
+}
+
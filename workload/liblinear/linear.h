@@ -3,6 +3,8 @@
 
 #define LIBLINEAR_VERSION 247
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,6 +25,30 @@ struct problem
 	double bias;            /* < 0 if no bias term */
 };
 
+/*
+ * The binary problem cache of train -k, which parameter.stream_file
+ * streams: this header, y[l], the int64 start of every instance in
+ * x_space, then the nr_node feature_nodes of x_space. It is valid as long
+ * as the input file keeps its size and modification time and bias stays
+ * the same.
+ */
+#define PROBLEM_CACHE_MAGIC "LIBLINR1"
+
+struct problem_cache_header
+{
+	char magic[8];
+	int64_t input_size;
+	int64_t input_mtime;
+	double bias;
+	int64_t l;
+	int64_t nr_node;
+	int64_t n;
+};
+
+enum { XTV_THREAD_VECTORS, XTV_COLUMN_MAJOR, XTV_THREAD_BLOCKS }; /* xtv_type */
+enum { STORAGE_FEATURE_NODE, STORAGE_CSR_DOUBLE, STORAGE_CSR_FLOAT, STORAGE_CSR_PATTERN }; /* storage_type */
+enum { DCD_SEQUENTIAL, DCD_ASYNC }; /* dcd_type */
+
 enum { L2R_LR, L2R_L2LOSS_SVC_DUAL, L2R_L2LOSS_SVC, L2R_L1LOSS_SVC_DUAL, MCSVM_CS, L1R_L2LOSS_SVC, L1R_LR, L2R_LR_DUAL, L2R_L2LOSS_SVR = 11, L2R_L2LOSS_SVR_DUAL, L2R_L1LOSS_SVR_DUAL, ONECLASS_SVM = 21 }; /* solver_type */
 
 struct parameter
@@ -40,6 +66,13 @@ struct parameter
 	double nu;
 	double *init_sol;
 	int regularize_bias;
+	int xtv_type;
+	int storage_type;
+	int hot_node;
+	const char *stream_file;
+	int stream_block_size;
+	int nr_fold_thread;     /* folds of cross validation trained at the same time */
+	int dcd_type;           /* how the dual coordinate descent solvers update */
 };
 
 struct model
@@ -60,6 +93,8 @@ void find_parameters(const struct problem *prob, const struct parameter *param,
 double predict_values(const struct model *model_, const struct feature_node *x, double* dec_values);
 double predict(const struct model *model_, const struct feature_node *x);
 double predict_probability(const struct model *model_, const struct feature_node *x, double* prob_estimates);
+void predict_values_batch(const struct model *model_, struct feature_node *const *x, int l, double *dec_values, double *labels);
+void predict_probability_batch(const struct model *model_, struct feature_node *const *x, int l, double *prob_estimates, double *labels);
 
 int save_model(const char *model_file_name, const struct model *model_);
 struct model *load_model(const char *model_file_name);
@@ -80,6 +115,7 @@ int check_probability_model(const struct model *model);
 int check_regression_model(const struct model *model);
 int check_oneclass_model(const struct model *model);
 void set_print_string_function(void (*print_func) (const char*));
+void set_trace_function(void (*trace_func) (const char*));
 
 #ifdef __cplusplus
 }
@@ -67,6 +67,20 @@ void exit_with_help()
 	"-v n: n-fold cross validation mode\n"
 	"-C : find parameters (C for -s 0, 2 and C, p for -s 11)\n"
 	"-m nr_thread : parallel version with [nr_thread] threads (default 1; only for -s 0, 1, 2, 3, 5, 6, 11, 21)\n"
+	"-j nr_fold_thread : train [nr_fold_thread] folds of -v at the same time, each with the threads of -m (default 1)\n"
+	"-a type : set how the dual solvers -s 1, 3, 7, 12 and 13 update (default 0)\n"
+	"        0 -- one coordinate after the other; -m only for -s 1 and 3\n"
+	"        1 -- asynchronously by the threads of -m, each on its own instances\n"
+	"-x type : set how X^T v is computed by -s 0, 2 and 11 (default 0)\n"
+	"        0 -- sum of a dense vector per thread\n"
+	"        1 -- column-major copy of the data, no per-thread vectors\n"
+	"        2 -- fixed rows per thread, only the touched blocks of its vector\n"
+	"-f type : set how -s 0, 2 and 11 store the data (default 0)\n"
+	"        0 -- feature_node arrays\n"
+	"        1 -- CSR with double values\n"
+	"        2 -- CSR with float values\n"
+	"        3 -- CSR without values, all feature values must be 1\n"
+	"-H node : prefer memory node [node] for the vectors of -s 0, 2 and 11 (default -1, no preference)\n"
 	"-q : quiet mode (no outputs)\n"
 	"col:\n"
 	"	if 'col' is setted, training_instance_matrix is parsed in column format, otherwise is in row format\n"
@@ -176,6 +190,13 @@ int parse_command_line(int nrhs, const mxArray *prhs[], char *model_file_name)
 	param.weight = NULL;
 	param.init_sol = NULL;
 	param.regularize_bias = 1;
+	param.xtv_type = XTV_THREAD_VECTORS;
+	param.storage_type = STORAGE_FEATURE_NODE;
+	param.hot_node = -1;
+	param.stream_file = NULL;
+	param.stream_block_size = 0;
+	param.nr_fold_thread = 1;
+	param.dcd_type = DCD_SEQUENTIAL;
 	flag_cross_validation = 0;
 	col_format_flag = 0;
 	flag_C_specified = 0;
@@ -240,6 +261,21 @@ int parse_command_line(int nrhs, const mxArray *prhs[], char *model_file_name)
 				flag_omp = 1;
 				param.nr_thread = atoi(argv[i]);
 				break;
+			case 'x':
+				param.xtv_type = atoi(argv[i]);
+				break;
+			case 'f':
+				param.storage_type = atoi(argv[i]);
+				break;
+			case 'H':
+				param.hot_node = atoi(argv[i]);
+				break;
+			case 'j':
+				param.nr_fold_thread = atoi(argv[i]);
+				break;
+			case 'a':
+				param.dcd_type = atoi(argv[i]);
+				break;
 			case 'v':
 				flag_cross_validation = 1;
 				nr_fold = atoi(argv[i]);
@@ -308,31 +344,24 @@ int parse_command_line(int nrhs, const mxArray *prhs[], char *model_file_name)
 			param.solver_type != L2R_L2LOSS_SVC_DUAL &&
 			param.solver_type != L1R_L2LOSS_SVC &&
 			param.solver_type != L1R_LR &&
-			param.solver_type != ONECLASS_SVM)
+			param.solver_type != ONECLASS_SVM &&
+			!(param.dcd_type == DCD_ASYNC &&
+			  (param.solver_type == L2R_LR_DUAL ||
+			   param.solver_type == L2R_L2LOSS_SVR_DUAL ||
+			   param.solver_type == L2R_L1LOSS_SVR_DUAL)))
 		{
 			mexPrintf("WARNING: parallel solvers are only available for -s 0, 1, 2, 3, 5, 6, 11, 21 now; use single-core solvers instead.\n");
 			param.nr_thread = 1;
 		}
-#ifndef CV_OMP
-		mexPrintf("Total threads used: %d\n", param.nr_thread);
-#endif
+		if(!flag_cross_validation)
+			mexPrintf("Total threads used: %d\n", param.nr_thread);
 	}
-#ifdef CV_OMP
 	if(flag_cross_validation)
 	{
-		int cvthreads = nr_fold;
-		int maxthreads = omp_get_num_procs();
-		if(flag_omp)
-		{
-			omp_set_nested(1);
-			maxthreads = omp_get_num_procs()/param.nr_thread;
-		}
-		if(cvthreads > maxthreads)
-			cvthreads = maxthreads;
-		omp_set_num_threads(cvthreads);
-		mexPrintf("Total threads used: %d\n", cvthreads*param.nr_thread);
+		if(param.nr_fold_thread > nr_fold)
+			param.nr_fold_thread = nr_fold;
+		mexPrintf("Total threads used: %d\n", param.nr_fold_thread*param.nr_thread);
 	}
-#endif
 
 	if(param.eps == INF)
 	{
@@ -2,6 +2,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "newton.h"
 
 #ifndef min
@@ -25,6 +30,77 @@ extern int dscal_(int *, double *, double *, int *);
 }
 #endif
 
+/* From numaif.h, which comes with libnuma. */
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static int hot_node = -1;
+
+// In front of every hot vector, padded to a cache line
+struct hot_header
+{
+	size_t bytes;
+	int mapped;
+};
+static const size_t hot_header_size = 64;
+
+void set_hot_node(int node)
+{
+	hot_node = node;
+}
+
+double *new_hot_vector(size_t n)
+{
+	size_t bytes = hot_header_size + n*sizeof(double);
+	char *p = NULL;
+	int mapped = 0;
+
+	if(hot_node >= 0)
+	{
+		size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+		bytes = (bytes + page_size - 1) & ~(page_size - 1);
+		void *m = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(m != MAP_FAILED)
+		{
+			// The pages are not populated yet, so a preference is enough.
+			// Failing (e.g. without NUMA support) is harmless.
+			unsigned long mask[1024/(8*sizeof(unsigned long))];
+			memset(mask, 0, sizeof(mask));
+			mask[(size_t)hot_node/(8*sizeof(*mask))] = 1UL << ((size_t)hot_node%(8*sizeof(*mask)));
+			syscall(SYS_mbind, m, bytes, MPOL_PREFERRED, mask, 8*sizeof(mask), 0);
+			p = (char *)m;
+			mapped = 1;
+		}
+	}
+	if(p == NULL)
+		p = new char[bytes];
+
+	struct hot_header *h = (struct hot_header *)p;
+	h->bytes = bytes;
+	h->mapped = mapped;
+	return (double *)(p + hot_header_size);
+}
+
+void delete_hot_vector(double *v)
+{
+	if(v == NULL)
+		return;
+	char *p = (char *)v - hot_header_size;
+	struct hot_header *h = (struct hot_header *)p;
+	if(h->mapped)
+		munmap(p, h->bytes);
+	else
+		delete[] p;
+}
+
+static double wall_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
 static void default_print(const char *buf)
 {
 	fputs(buf,stdout);
@@ -39,7 +115,7 @@ double function::linesearch_and_update(double *w, double *s, double *f, double *
 	double eta = 0.01;
 	int n = get_nr_variable();
 	int max_num_linesearch = 20;
-	double *w_new = new double[n];
+	double *w_new = new_hot_vector(n);
 	double fold = *f;
 
 	for (int i=0;i<n;i++)
@@ -65,7 +141,7 @@ double function::linesearch_and_update(double *w, double *s, double *f, double *
 	else
 		memcpy(w, w_new, sizeof(double)*n);
 
-	delete [] w_new;
+	delete_hot_vector(w_new);
 	return alpha;
 }
 
@@ -79,6 +155,18 @@ void NEWTON::info(const char *fmt,...)
 	(*newton_print_string)(buf);
 }
 
+void NEWTON::trace(const char *fmt,...)
+{
+	if(newton_trace_string == NULL)
+		return;
+	char buf[BUFSIZ];
+	va_list ap;
+	va_start(ap,fmt);
+	vsprintf(buf,fmt,ap);
+	va_end(ap);
+	(*newton_trace_string)(buf);
+}
+
 NEWTON::NEWTON(const function *fun_obj, double eps, double eps_cg, int max_iter)
 {
 	this->fun_obj=const_cast<function *>(fun_obj);
@@ -86,13 +174,14 @@ NEWTON::NEWTON(const function *fun_obj, double eps, double eps_cg, int max_iter)
 	this->eps_cg=eps_cg;
 	this->max_iter=max_iter;
 	newton_print_string = default_print;
+	newton_trace_string = NULL;
 }
 
 NEWTON::~NEWTON()
 {
 }
 
-void NEWTON::newton(double *w)
+void NEWTON::newton(double *w_out)
 {
 	int n = fun_obj->get_nr_variable();
 	int i, cg_iter;
@@ -100,39 +189,65 @@ void NEWTON::newton(double *w)
 	double f, fold, actred;
 	double init_step_size = 1;
 	int search = 1, iter = 1, inc = 1;
-	double *s = new double[n];
-	double *r = new double[n];
-	double *g = new double[n];
+	double *w = new_hot_vector(n);
+	double *s = new_hot_vector(n);
+	double *r = new_hot_vector(n);
+	double *g = new_hot_vector(n);
 
 	const double alpha_pcg = 0.01;
-	double *M = new double[n];
+	double *M = new_hot_vector(n);
+
+	memcpy(w, w_out, sizeof(double)*n);
 
 	// calculate gradient norm at w=0 for stopping condition.
-	double *w0 = new double[n];
+	double *w0 = new_hot_vector(n);
 	for (i=0; i<n; i++)
 		w0[i] = 0;
 	fun_obj->fun(w0);
 	fun_obj->grad(w0, g);
 	double gnorm0 = dnrm2_(&n, g, &inc);
-	delete [] w0;
+	delete_hot_vector(w0);
+
+	// per iteration, one JSON object per line to the trace function
+	double start_time = wall_time(), t, fun_time, grad_time;
+	double precond_time, cg_time, linesearch_time;
+	double bytes = fun_obj->get_bytes_touched();
 
+	t = wall_time();
 	f = fun_obj->fun(w);
+	fun_time = wall_time() - t;
+	t = wall_time();
 	fun_obj->grad(w, g);
+	grad_time = wall_time() - t;
 	double gnorm = dnrm2_(&n, g, &inc);
 	info("init f %5.3e |g| %5.3e\n", f, gnorm);
+	trace("{\"iter\": 0, \"f\": %.10e, \"gnorm\": %.10e, "
+		"\"fun_time\": %.6f, \"grad_time\": %.6f, \"bytes\": %.0f, "
+		"\"time\": %.6f}\n", f, gnorm, fun_time, grad_time,
+		fun_obj->get_bytes_touched() - bytes, wall_time() - start_time);
 
 	if (gnorm <= eps*gnorm0)
 		search = 0;
 
 	while (iter <= max_iter && search)
 	{
+		bytes = fun_obj->get_bytes_touched();
+		t = wall_time();
 		fun_obj->get_diag_preconditioner(M);
 		for(i=0; i<n; i++)
 			M[i] = (1-alpha_pcg) + alpha_pcg*M[i];
+		precond_time = wall_time() - t;
+
+		hv_time = 0;
+		hv_bytes = 0;
+		t = wall_time();
 		cg_iter = pcg(g, M, s, r);
+		cg_time = wall_time() - t;
 
 		fold = f;
+		t = wall_time();
 		step_size = fun_obj->linesearch_and_update(w, s, &f, g, init_step_size);
+		linesearch_time = wall_time() - t;
 
 		if (step_size == 0)
 		{
@@ -140,10 +255,21 @@ void NEWTON::newton(double *w)
 			break;
 		}
 
+		t = wall_time();
 		fun_obj->grad(w, g);
+		grad_time = wall_time() - t;
 		gnorm = dnrm2_(&n, g, &inc);
 
 		info("iter %2d f %5.3e |g| %5.3e CG %3d step_size %4.2e \n", iter, f, gnorm, cg_iter, step_size);
+		trace("{\"iter\": %d, \"f\": %.10e, \"gnorm\": %.10e, \"cg\": %d, "
+			"\"step_size\": %.4e, \"precond_time\": %.6f, \"cg_time\": %.6f, "
+			"\"hv_time\": %.6f, \"hv_time_per_cg\": %.6f, "
+			"\"linesearch_time\": %.6f, \"grad_time\": %.6f, "
+			"\"bytes\": %.0f, \"hv_bytes\": %.0f, \"time\": %.6f}\n",
+			iter, f, gnorm, cg_iter, step_size, precond_time, cg_time,
+			hv_time, hv_time/cg_iter, linesearch_time, grad_time,
+			fun_obj->get_bytes_touched() - bytes, hv_bytes,
+			wall_time() - start_time);
 		
 		if (gnorm <= eps*gnorm0)
 			break;
@@ -165,10 +291,12 @@ void NEWTON::newton(double *w)
 	if(iter >= max_iter)
 		info("\nWARNING: reaching max number of Newton iterations\n");
 
-	delete[] g;
-	delete[] r;
-	delete[] s;
-	delete[] M;
+	memcpy(w_out, w, sizeof(double)*n);
+	delete_hot_vector(w);
+	delete_hot_vector(g);
+	delete_hot_vector(r);
+	delete_hot_vector(s);
+	delete_hot_vector(M);
 }
 
 int NEWTON::pcg(double *g, double *M, double *s, double *r)
@@ -176,10 +304,10 @@ int NEWTON::pcg(double *g, double *M, double *s, double *r)
 	int i, inc = 1;
 	int n = fun_obj->get_nr_variable();
 	double one = 1;
-	double *d = new double[n];
-	double *Hd = new double[n];
+	double *d = new_hot_vector(n);
+	double *Hd = new_hot_vector(n);
 	double zTr, znewTrnew, alpha, beta, cgtol, dHd;
-	double *z = new double[n];
+	double *z = new_hot_vector(n);
 	double Q = 0, newQ, Qdiff;
 
 	for (i=0; i<n; i++)
@@ -200,7 +328,10 @@ int NEWTON::pcg(double *g, double *M, double *s, double *r)
 	{
 		cg_iter++;
 
+		double t = wall_time(), bytes = fun_obj->get_bytes_touched();
 		fun_obj->Hv(d, Hd);
+		hv_time += wall_time() - t;
+		hv_bytes += fun_obj->get_bytes_touched() - bytes;
 		dHd = ddot_(&n, d, &inc, Hd, &inc);
 		// avoid 0/0 in getting alpha
 		if (dHd <= 1.0e-16)
@@ -238,13 +369,18 @@ int NEWTON::pcg(double *g, double *M, double *s, double *r)
 	if (cg_iter == max_cg_iter)
 		info("WARNING: reaching maximal number of CG steps\n");
 
-	delete[] d;
-	delete[] Hd;
-	delete[] z;
+	delete_hot_vector(d);
+	delete_hot_vector(Hd);
+	delete_hot_vector(z);
 
 	return cg_iter;
 }
 
+void NEWTON::set_trace(void (*trace_string) (const char *buf))
+{
+	newton_trace_string = trace_string;
+}
+
 void NEWTON::set_print_string(void (*print_string) (const char *buf))
 {
 	newton_print_string = print_string;
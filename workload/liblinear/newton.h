@@ -1,6 +1,18 @@
 #ifndef _NEWTON_H
 #define _NEWTON_H
 
+#include <stddef.h>
+
+// The vectors the Newton iterations reuse or access at random (w, the CG
+// vectors, wx, D, ...) come from new_hot_vector. After set_hot_node(node)
+// each gets pages of its own with a preference for memory node node, so
+// even a tiering that only sees the fault order keeps them in fast memory
+// while the instances are streamed from slow memory. With node -1 (the
+// default) they are allocated like any other array.
+void set_hot_node(int node);
+double *new_hot_vector(size_t n);
+void delete_hot_vector(double *v);
+
 class function
 {
 public:
@@ -9,6 +21,8 @@ public:
 	virtual void Hv(double *s, double *Hs) = 0 ;
 	virtual int get_nr_variable(void) = 0 ;
 	virtual void get_diag_preconditioner(double *M) = 0 ;
+	// estimated bytes fun, grad and Hv have read and written so far
+	virtual double get_bytes_touched(void) { return 0; }
 	virtual ~function(void){}
 
 	// base implementation in newton.cpp
@@ -23,6 +37,7 @@ public:
 
 	void newton(double *w);
 	void set_print_string(void (*i_print) (const char *buf));
+	void set_trace(void (*i_trace) (const char *buf));
 
 private:
 	int pcg(double *g, double *M, double *s, double *r);
@@ -32,6 +47,10 @@ private:
 	int max_iter;
 	function *fun_obj;
 	void info(const char *fmt,...);
+	void trace(const char *fmt,...);
 	void (*newton_print_string)(const char *buf);
+	void (*newton_trace_string)(const char *buf);
+	double hv_time; // in the current iteration
+	double hv_bytes;
 };
 #endif
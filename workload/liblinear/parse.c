@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <omp.h>
+#include "parse.h"
+
+#define Malloc(type,n) (type *)malloc((n)*sizeof(type))
+
+// The text is cut into chunks of whole lines, which are parsed in parallel
+// in two passes: the first counts the lines and features of every chunk,
+// so that the second can parse each chunk straight into its place in
+// x_space, with the same layout as reading line by line.
+struct chunk
+{
+	const char *begin, *end;
+	size_t nr_line, nr_feature;
+	size_t line_start, node_start; // of the first line of the chunk
+	int max_index;
+	size_t error_line; // 0 if the chunk parsed
+};
+
+static inline int is_blank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline int is_separator(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// strtod of the number at [p, end), returns its end or p if there is none.
+// A decimal with at most 15 significant digits and a power of ten up to
+// 22 is a correctly rounded product or quotient of two exact doubles;
+// anything else goes through strtod on a copy, so the values are
+// always those of strtod.
+static const char *parse_double(const char *p, const char *end, double *value)
+{
+	const char *q = p;
+	int negative = 0, digits = 0, significant = 0, exp10 = 0;
+	uint64_t mantissa = 0;
+
+	if(q < end && (*q == '+' || *q == '-'))
+		negative = *q++ == '-';
+	for(; q < end && *q >= '0' && *q <= '9'; q++, digits++)
+		if(mantissa || *q != '0')
+		{
+			mantissa = mantissa*10 + (uint64_t)(*q - '0');
+			significant++;
+		}
+	if(q < end && *q == '.')
+		for(q++; q < end && *q >= '0' && *q <= '9'; q++, digits++)
+		{
+			if(mantissa || *q != '0')
+			{
+				mantissa = mantissa*10 + (uint64_t)(*q - '0');
+				significant++;
+			}
+			exp10--;
+		}
+	if(digits > 0 && q < end && (*q == 'e' || *q == 'E'))
+	{
+		const char *e = q+1;
+		int exp_negative = 0, exp_value = 0;
+		if(e < end && (*e == '+' || *e == '-'))
+			exp_negative = *e++ == '-';
+		if(e < end && *e >= '0' && *e <= '9')
+		{
+			for(; e < end && *e >= '0' && *e <= '9'; e++)
+				if(exp_value < 10000)
+					exp_value = exp_value*10 + (*e - '0');
+			exp10 += exp_negative ? -exp_value : exp_value;
+			q = e;
+		}
+	}
+	if(digits > 0 && significant <= 15 && exp10 >= -22 && exp10 <= 22
+		&& (q == end || is_separator(*q) || *q == ':'))
+	{
+		double v = (double)mantissa;
+		v = exp10 < 0 ? v/exact_pow10[-exp10] : v*exact_pow10[exp10];
+		*value = negative ? -v : v;
+		return q;
+	}
+
+	char buf[128];
+	size_t len = 0;
+	while(p+len < end && len < sizeof(buf)-1 && !is_separator(p[len]))
+		len++;
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+	char *endptr;
+	errno = 0;
+	*value = strtod(buf, &endptr);
+	if(errno != 0)
+		return p;
+	return p + (endptr - buf);
+}
+
+// Parses the instance at p into *x, terminated as parse_problem does, and
+// returns the start of the next line, or NULL if the line is malformed
+static const char *parse_line(const char *p, const char *end, double *y,
+	struct feature_node **x, int *max_index, double bias, int bias_index,
+	int max_feature)
+{
+	struct feature_node *xi = *x;
+	int inst_max_index = 0;
+	const char *q;
+
+	while(p < end && is_blank(*p))
+		p++;
+	q = parse_double(p, end, y);
+	if(q == p || (q < end && !is_separator(*q))) // also an empty line
+		return NULL;
+	p = q;
+
+	while(1)
+	{
+		while(p < end && (is_blank(*p) || *p == '\r'))
+			p++;
+		if(p == end || *p == '\n')
+			break;
+
+		int64_t index = 0;
+		for(q = p; q < end && *q >= '0' && *q <= '9' && index <= INT_MAX; q++)
+			index = index*10 + (*q - '0');
+		if(q == p || index > INT_MAX || index <= inst_max_index || q == end || *q != ':')
+			return NULL;
+		xi->index = inst_max_index = (int)index;
+
+		p = q+1;
+		q = parse_double(p, end, &xi->value);
+		if(q == p || (q < end && !is_separator(*q)))
+			return NULL;
+		p = q;
+		// e.g. features of a test set that the model has no weight for
+		if(xi->index <= max_feature)
+			xi++;
+	}
+
+	if(inst_max_index > max_feature)
+		inst_max_index = max_feature;
+	if(inst_max_index > *max_index)
+		*max_index = inst_max_index;
+
+	if(bias >= 0)
+	{
+		xi->index = bias_index;
+		(xi++)->value = bias;
+	}
+
+	(xi++)->index = -1;
+	*x = xi;
+	return p < end ? p+1 : p;
+}
+
+size_t parse_problem(const char *text, size_t size, double bias, int bias_index,
+	int max_feature, struct problem *prob, struct feature_node **x_space,
+	size_t *nr_node, int *max_index)
+{
+	size_t j, nr_chunk, error_line;
+	struct chunk *chunks;
+
+	// at least 1MB of text per chunk
+	nr_chunk = (size_t)omp_get_num_procs();
+	if(nr_chunk > size/(1<<20) + 1)
+		nr_chunk = size/(1<<20) + 1;
+	chunks = Malloc(struct chunk,nr_chunk);
+	for(j=0;j<nr_chunk;j++)
+	{
+		const char *begin = j == 0 ? text : chunks[j-1].end;
+		const char *end = text + size*(j+1)/nr_chunk;
+		if(end < begin)
+			end = begin;
+		while(end < text + size && end > text && end[-1] != '\n')
+			end++;
+		chunks[j].begin = begin;
+		chunks[j].end = end;
+	}
+
+#pragma omp parallel for schedule(dynamic,1) num_threads((int)nr_chunk)
+	for(j=0;j<nr_chunk;j++)
+	{
+		struct chunk *c = &chunks[j];
+		size_t nr_line = 0, nr_feature = 0;
+		for(const char *p = c->begin; p < c->end; p++)
+		{
+			nr_line += *p == '\n';
+			nr_feature += *p == ':';
+		}
+		if(c->end > c->begin && c->end[-1] != '\n')
+			nr_line++;
+		c->nr_line = nr_line;
+		c->nr_feature = nr_feature;
+		c->max_index = 0;
+		c->error_line = 0;
+	}
+
+	prob->l = 0;
+	j = 0;
+	for(size_t k=0;k<nr_chunk;k++)
+	{
+		chunks[k].line_start = (size_t)prob->l;
+		chunks[k].node_start = j;
+		prob->l += (int)chunks[k].nr_line;
+		j += chunks[k].nr_feature + chunks[k].nr_line*(bias >= 0 ? 2 : 1);
+	}
+
+	prob->y = Malloc(double,prob->l);
+	prob->x = Malloc(struct feature_node *,prob->l);
+	*x_space = Malloc(struct feature_node,j+1);
+
+#pragma omp parallel for schedule(dynamic,1) num_threads((int)nr_chunk)
+	for(j=0;j<nr_chunk;j++)
+	{
+		struct chunk *c = &chunks[j];
+		const char *p = c->begin;
+		size_t k = c->line_start;
+		struct feature_node *x = &(*x_space)[c->node_start];
+		while(p < c->end)
+		{
+			prob->x[k] = x;
+			p = parse_line(p, c->end, &prob->y[k], &x, &c->max_index,
+				bias, bias_index, max_feature);
+			if(p == NULL)
+			{
+				c->error_line = k+1;
+				break;
+			}
+			k++;
+		}
+	}
+
+	*max_index = 0;
+	error_line = 0;
+	for(j=0;j<nr_chunk;j++)
+	{
+		if(chunks[j].error_line && !error_line)
+			error_line = chunks[j].error_line;
+		if(chunks[j].max_index > *max_index)
+			*max_index = chunks[j].max_index;
+	}
+	free(chunks);
+
+	*nr_node = 0;
+	if(prob->l > 0 && !error_line)
+	{
+		j = (size_t)(prob->x[prob->l-1] - *x_space);
+		while((*x_space)[j].index != -1)
+			j++;
+		*nr_node = j+1;
+	}
+	return error_line;
+}
@@ -0,0 +1,20 @@
+#ifndef _PARSE_H
+#define _PARSE_H
+
+#include <stddef.h>
+#include "linear.h"
+
+/*
+ * Parses the libsvm format lines at [text, text+size) into prob->y, prob->x
+ * and *x_space, laid out as if read line by line, in parallel chunks of at
+ * least 1MB. Features above max_feature are dropped. If bias >= 0, every
+ * instance ends with a node of index bias_index and value bias. Sets
+ * prob->l, *nr_node (the nodes used) and *max_index (of the features kept);
+ * prob->n and prob->bias are left to the caller. Returns 0, or the line of
+ * the first malformed instance, counted from 1.
+ */
+size_t parse_problem(const char *text, size_t size, double bias, int bias_index,
+	int max_feature, struct problem *prob, struct feature_node **x_space,
+	size_t *nr_node, int *max_index);
+
+#endif /* _PARSE_H */
@@ -3,15 +3,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
 #include "linear.h"
+#include "parse.h"
 
 int print_null(const char *s,...) {return 0;}
 
 static int (*info)(const char *fmt,...) = &printf;
 
-struct feature_node *x;
-int max_nr_attr = 64;
-
 struct model* model_;
 int flag_predict_probability=0;
 
@@ -21,28 +24,14 @@ void exit_input_error(int line_num)
 	exit(1);
 }
 
-static char *line = NULL;
-static int max_line_len;
-
-static char* readline(FILE *input)
-{
-	int len;
+// The instances are parsed and predicted in batches of this many bytes of
+// the mapped test file, so that the memory does not grow with the file
+#define BATCH_SIZE (64<<20)
 
-	if(fgets(line,max_line_len,input) == NULL)
-		return NULL;
+// The longest %.17g, and a separator
+#define NUMBER_WIDTH 26
 
-	while(strrchr(line,'\n') == NULL)
-	{
-		max_line_len *= 2;
-		line = (char *) realloc(line,max_line_len);
-		len = (int) strlen(line);
-		if(fgets(line+len,max_line_len-len,input) == NULL)
-			break;
-	}
-	return line;
-}
-
-void do_predict(FILE *input, FILE *output)
+void do_predict(const char *text, size_t size, FILE *output)
 {
 	int correct = 0;
 	int total = 0;
@@ -50,7 +39,6 @@ void do_predict(FILE *input, FILE *output)
 	double sump = 0, sumt = 0, sumpp = 0, sumtt = 0, sumpt = 0;
 
 	int nr_class=get_nr_class(model_);
-	double *prob_estimates=NULL;
 	int j, n;
 	int nr_feature=get_nr_feature(model_);
 	if(model_->bias>=0)
@@ -70,7 +58,6 @@ void do_predict(FILE *input, FILE *output)
 
 		labels=(int *) malloc(nr_class*sizeof(int));
 		get_labels(model_,labels);
-		prob_estimates = (double *) malloc(nr_class*sizeof(double));
 		fprintf(output,"labels");
 		for(j=0;j<nr_class;j++)
 			fprintf(output," %d",labels[j]);
@@ -78,85 +65,79 @@ void do_predict(FILE *input, FILE *output)
 		free(labels);
 	}
 
-	max_line_len = 1024;
-	line = (char *)malloc(max_line_len*sizeof(char));
-	while(readline(input) != NULL)
+	// every output line is formatted into its own slot, in parallel
+	size_t width = NUMBER_WIDTH*(flag_predict_probability ? (size_t)nr_class+1 : 1) + 1;
+	const char *end = text + size;
+	while(text < end)
 	{
-		int i = 0;
-		double target_label, predict_label;
-		char *idx, *val, *label, *endptr;
-		int inst_max_index = 0; // strtol gives 0 if wrong format
-
-		label = strtok(line," \t\n");
-		if(label == NULL) // empty line
-			exit_input_error(total+1);
-
-		target_label = strtod(label,&endptr);
-		if(endptr == label || *endptr != '\0')
-			exit_input_error(total+1);
+		const char *batch_end = text + BATCH_SIZE < end ? text + BATCH_SIZE : end;
+		while(batch_end < end && batch_end[-1] != '\n')
+			batch_end++;
+
+		struct problem batch;
+		struct feature_node *x_space;
+		size_t nr_node;
+		int max_index;
+		size_t error_line = parse_problem(text, (size_t)(batch_end - text), model_->bias, n,
+			nr_feature, &batch, &x_space, &nr_node, &max_index);
+		if(error_line)
+			exit_input_error(total + (int)error_line);
+
+		int l = batch.l;
+		double *predict_labels = (double *) malloc(l*sizeof(double));
+		double *prob_estimates = NULL;
+		if(flag_predict_probability)
+		{
+			prob_estimates = (double *) malloc((size_t)l*nr_class*sizeof(double));
+			predict_probability_batch(model_, batch.x, l, prob_estimates, predict_labels);
+		}
+		else
+			predict_values_batch(model_, batch.x, l, NULL, predict_labels);
 
-		while(1)
+		char *lines = (char *) malloc((size_t)l*width);
+		int *line_len = (int *) malloc(l*sizeof(int));
+		int i;
+#pragma omp parallel for private(i,j) schedule(static)
+		for(i=0;i<l;i++)
 		{
-			if(i>=max_nr_attr-2)    // need one more for index = -1
+			char *p = &lines[(size_t)i*width];
+			if(flag_predict_probability)
 			{
-				max_nr_attr *= 2;
-				x = (struct feature_node *) realloc(x,max_nr_attr*sizeof(struct feature_node));
+				const double *e = &prob_estimates[(size_t)i*nr_class];
+				int len = snprintf(p, width, "%g", predict_labels[i]);
+				for(j=0;j<nr_class;j++)
+					len += snprintf(p+len, width-len, " %g", e[j]);
+				len += snprintf(p+len, width-len, "\n");
+				line_len[i] = len;
 			}
-
-			idx = strtok(NULL,":");
-			val = strtok(NULL," \t");
-
-			if(val == NULL)
-				break;
-			errno = 0;
-			x[i].index = (int) strtol(idx,&endptr,10);
-			if(endptr == idx || errno != 0 || *endptr != '\0' || x[i].index <= inst_max_index)
-				exit_input_error(total+1);
 			else
-				inst_max_index = x[i].index;
-
-			errno = 0;
-			x[i].value = strtod(val,&endptr);
-			if(endptr == val || errno != 0 || (*endptr != '\0' && !isspace(*endptr)))
-				exit_input_error(total+1);
-
-			// feature indices larger than those in training are not used
-			if(x[i].index <= nr_feature)
-				++i;
+				line_len[i] = snprintf(p, width, "%.17g\n", predict_labels[i]);
 		}
 
-		if(model_->bias>=0)
+		for(i=0;i<l;i++)
 		{
-			x[i].index = n;
-			x[i].value = model_->bias;
-			i++;
+			double target_label = batch.y[i], predict_label = predict_labels[i];
+			fwrite(&lines[(size_t)i*width], 1, (size_t)line_len[i], output);
+
+			if(predict_label == target_label)
+				++correct;
+			error += (predict_label-target_label)*(predict_label-target_label);
+			sump += predict_label;
+			sumt += target_label;
+			sumpp += predict_label*predict_label;
+			sumtt += target_label*target_label;
+			sumpt += predict_label*target_label;
+			++total;
 		}
-		x[i].index = -1;
 
-		if(flag_predict_probability)
-		{
-			int j;
-			predict_label = predict_probability(model_,x,prob_estimates);
-			fprintf(output,"%g",predict_label);
-			for(j=0;j<model_->nr_class;j++)
-				fprintf(output," %g",prob_estimates[j]);
-			fprintf(output,"\n");
-		}
-		else
-		{
-			predict_label = predict(model_,x);
-			fprintf(output,"%.17g\n",predict_label);
-		}
-
-		if(predict_label == target_label)
-			++correct;
-		error += (predict_label-target_label)*(predict_label-target_label);
-		sump += predict_label;
-		sumt += target_label;
-		sumpp += predict_label*predict_label;
-		sumtt += target_label*target_label;
-		sumpt += predict_label*target_label;
-		++total;
+		free(lines);
+		free(line_len);
+		free(predict_labels);
+		free(prob_estimates);
+		free(batch.y);
+		free(batch.x);
+		free(x_space);
+		text = batch_end;
 	}
 	if(check_regression_model(model_))
 	{
@@ -168,8 +149,6 @@ void do_predict(FILE *input, FILE *output)
 	}
 	else
 		info("Accuracy = %g%% (%d/%d)\n",(double) correct/total*100,correct,total);
-	if(flag_predict_probability)
-		free(prob_estimates);
 }
 
 void exit_with_help()
@@ -178,6 +157,7 @@ void exit_with_help()
 	"Usage: predict [options] test_file model_file output_file\n"
 	"options:\n"
 	"-b probability_estimates: whether to output probability estimates, 0 or 1 (default 0); currently for logistic regression only\n"
+	"-m nr_thread : predict with nr_thread threads (default: the number of processors)\n"
 	"-q : quiet mode (no outputs)\n"
 	);
 	exit(1);
@@ -185,8 +165,12 @@ void exit_with_help()
 
 int main(int argc, char **argv)
 {
-	FILE *input, *output;
+	FILE *output;
 	int i;
+	int nr_thread = omp_get_num_procs();
+	struct stat st;
+	const char *text = NULL;
+	size_t size;
 
 	// parse options
 	for(i=1;i<argc;i++)
@@ -198,6 +182,11 @@ int main(int argc, char **argv)
 			case 'b':
 				flag_predict_probability = atoi(argv[i]);
 				break;
+			case 'm':
+				nr_thread = atoi(argv[i]);
+				if(nr_thread < 1)
+					exit_with_help();
+				break;
 			case 'q':
 				info = &print_null;
 				i--;
@@ -211,12 +200,24 @@ int main(int argc, char **argv)
 	if(i>=argc)
 		exit_with_help();
 
-	input = fopen(argv[i],"r");
-	if(input == NULL)
+	int fd = open(argv[i], O_RDONLY);
+	if(fd < 0 || fstat(fd, &st) != 0)
 	{
 		fprintf(stderr,"can't open input file %s\n",argv[i]);
 		exit(1);
 	}
+	size = (size_t)st.st_size;
+	if(size > 0)
+	{
+		text = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(text == MAP_FAILED)
+		{
+			fprintf(stderr,"can't map input file %s\n",argv[i]);
+			exit(1);
+		}
+		madvise((void *)text, size, MADV_SEQUENTIAL);
+	}
+	close(fd);
 
 	output = fopen(argv[i+2],"w");
 	if(output == NULL)
@@ -231,12 +232,11 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	x = (struct feature_node *) malloc(max_nr_attr*sizeof(struct feature_node));
-	do_predict(input, output);
+	omp_set_num_threads(nr_thread);
+	do_predict(text, size, output);
 	free_and_destroy_model(&model_);
-	free(line);
-	free(x);
-	fclose(input);
+	if(text)
+		munmap((void *)text, size);
 	fclose(output);
 	return 0;
 }
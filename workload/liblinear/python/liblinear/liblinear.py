@@ -22,6 +22,9 @@ __all__ = ['liblinear', 'feature_node', 'gen_feature_nodearray', 'problem',
            'L2R_L2LOSS_SVC', 'L2R_L1LOSS_SVC_DUAL', 'MCSVM_CS',
            'L1R_L2LOSS_SVC', 'L1R_LR', 'L2R_LR_DUAL', 'L2R_L2LOSS_SVR',
            'L2R_L2LOSS_SVR_DUAL', 'L2R_L1LOSS_SVR_DUAL', 'ONECLASS_SVM',
+           'XTV_THREAD_VECTORS', 'XTV_COLUMN_MAJOR', 'XTV_THREAD_BLOCKS', 'STORAGE_FEATURE_NODE',
+           'STORAGE_CSR_DOUBLE', 'STORAGE_CSR_FLOAT', 'STORAGE_CSR_PATTERN',
+           'DCD_SEQUENTIAL', 'DCD_ASYNC',
            'print_null']
 
 try:
@@ -57,6 +60,18 @@ L2R_L2LOSS_SVR_DUAL = 12
 L2R_L1LOSS_SVR_DUAL = 13
 ONECLASS_SVM = 21
 
+XTV_THREAD_VECTORS = 0
+XTV_COLUMN_MAJOR = 1
+XTV_THREAD_BLOCKS = 2
+
+STORAGE_FEATURE_NODE = 0
+STORAGE_CSR_DOUBLE = 1
+STORAGE_CSR_FLOAT = 2
+STORAGE_CSR_PATTERN = 3
+
+DCD_SEQUENTIAL = 0
+DCD_ASYNC = 1
+
 PRINT_STRING_FUN = CFUNCTYPE(None, c_char_p)
 def print_null(s):
     return
@@ -236,8 +251,8 @@ class problem(Structure):
 
 
 class parameter(Structure):
-    _names = ["solver_type", "eps", "C", "nr_thread", "nr_weight", "weight_label", "weight", "p", "nu", "init_sol", "regularize_bias"]
-    _types = [c_int, c_double, c_double, c_int, c_int, POINTER(c_int), POINTER(c_double), c_double, c_double, POINTER(c_double), c_int]
+    _names = ["solver_type", "eps", "C", "nr_thread", "nr_weight", "weight_label", "weight", "p", "nu", "init_sol", "regularize_bias", "xtv_type", "storage_type", "hot_node", "stream_file", "stream_block_size", "nr_fold_thread", "dcd_type"]
+    _types = [c_int, c_double, c_double, c_int, c_int, POINTER(c_int), POINTER(c_double), c_double, c_double, POINTER(c_double), c_int, c_int, c_int, c_int, c_char_p, c_int, c_int, c_int]
     _fields_ = genFields(_names, _types)
 
     def __init__(self, options = None):
@@ -268,6 +283,13 @@ class parameter(Structure):
         self.init_sol = None
         self.bias = -1
         self.regularize_bias = 1
+        self.xtv_type = XTV_THREAD_VECTORS
+        self.storage_type = STORAGE_FEATURE_NODE
+        self.hot_node = -1
+        self.stream_file = None
+        self.stream_block_size = 0
+        self.nr_fold_thread = 1
+        self.dcd_type = DCD_SEQUENTIAL
         self.flag_cross_validation = False
         self.flag_C_specified = False
         self.flag_p_specified = False
@@ -322,6 +344,21 @@ class parameter(Structure):
                 i = i + 1
                 self.flag_omp = True
                 self.nr_thread = int(argv[i])
+            elif argv[i] == "-x":
+                i = i + 1
+                self.xtv_type = int(argv[i])
+            elif argv[i] == "-f":
+                i = i + 1
+                self.storage_type = int(argv[i])
+            elif argv[i] == "-H":
+                i = i + 1
+                self.hot_node = int(argv[i])
+            elif argv[i] == "-j":
+                i = i + 1
+                self.nr_fold_thread = int(argv[i])
+            elif argv[i] == "-a":
+                i = i + 1
+                self.dcd_type = int(argv[i])
             elif argv[i].startswith("-w"):
                 i = i + 1
                 self.nr_weight += 1
@@ -359,7 +396,8 @@ class parameter(Structure):
                 print("Solver not specified. Using -s 2")
                 self.solver_type = L2R_L2LOSS_SVC
                 self.flag_solver_specified = True
-            elif self.solver_type not in [L2R_LR, L2R_L2LOSS_SVC, L2R_L2LOSS_SVR, L2R_L1LOSS_SVC_DUAL, L2R_L2LOSS_SVC_DUAL, L1R_L2LOSS_SVC, L1R_LR, ONECLASS_SVM]:
+            elif self.solver_type not in [L2R_LR, L2R_L2LOSS_SVC, L2R_L2LOSS_SVR, L2R_L1LOSS_SVC_DUAL, L2R_L2LOSS_SVC_DUAL, L1R_L2LOSS_SVC, L1R_LR, ONECLASS_SVM] and \
+                    not (self.dcd_type == DCD_ASYNC and self.solver_type in [L2R_LR_DUAL, L2R_L2LOSS_SVR_DUAL, L2R_L1LOSS_SVR_DUAL]):
                 print("WARNING: parallel solvers are only available for -s 0, 1, 2, 3, 5, 6, 11, 21 now; use single-core solvers instead.\n")
                 self.nr_thread = 1
 
@@ -105,6 +105,9 @@ def train(arg1, arg2=None, arg3=None):
         -v n: n-fold cross validation mode
         -C : find parameters (C for -s 0, 2 and C, p for -s 11)
         -m nr_thread : parallel version with [nr_thread] threads (default 1; only for -s 0, 1, 2, 3, 5, 6, 11)
+        -a type : set how the dual solvers -s 1, 3, 7, 12 and 13 update (default 0)
+            0 -- one coordinate after the other; -m only for -s 1 and 3
+            1 -- asynchronously by the threads of -m, each on its own instances
         -q : quiet mode (no outputs)
     """
     prob, param = None, None
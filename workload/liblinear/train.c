@@ -4,13 +4,27 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "linear.h"
+#include "parse.h"
 #include <omp.h>
 #define Malloc(type,n) (type *)malloc((n)*sizeof(type))
 #define INF HUGE_VAL
 
 void print_null(const char *s) {}
 
+static FILE *trace_fp;
+
+void print_trace(const char *s)
+{
+	fputs(s, trace_fp);
+}
+
 void exit_with_help()
 {
 	printf(
@@ -57,6 +71,25 @@ void exit_with_help()
 	"-v n: n-fold cross validation mode\n"
 	"-C : find parameters (C for -s 0, 2 and C, p for -s 11)\n"
 	"-m nr_thread : parallel version with [nr_thread] threads (default 1; only for -s 0, 1, 2, 3, 5, 6, 11, 21)\n"
+	"-j nr_fold_thread : train [nr_fold_thread] folds of -v or -C at the same time, each with the threads of -m (default 1)\n"
+	"-a type : set how the dual solvers -s 1, 3, 7, 12 and 13 update (default 0)\n"
+	"        0 -- one coordinate after the other; -m only for -s 1 and 3\n"
+	"        1 -- asynchronously by the threads of -m, each on its own instances\n"
+	"-x type : set how X^T v is computed by -s 0, 2 and 11 (default 0)\n"
+	"        0 -- sum of a dense vector per thread\n"
+	"        1 -- column-major copy of the data, no per-thread vectors\n"
+	"        2 -- fixed rows per thread, only the touched blocks of its vector\n"
+	"-f type : set how -s 0, 2 and 11 store the data (default 0)\n"
+	"        0 -- feature_node arrays\n"
+	"        1 -- CSR with double values\n"
+	"        2 -- CSR with float values\n"
+	"        3 -- CSR without values, all feature values must be 1\n"
+	"-H node : prefer memory node [node] for the vectors of -s 0, 2 and 11 (default -1, no preference)\n"
+	"-T trace_file : write the timings of each Newton iteration of -s 0, 2 and 11 to trace_file\n"
+	"-k cache_file : load the training set from cache_file if it is up to date,\n"
+	"                otherwise parse it and save it there\n"
+	"-S block_size : with -k, train -s 0, 2 and 11 out of core, streaming the instances\n"
+	"                from cache_file in blocks of block_size MB\n"
 	"-q : quiet mode (no outputs)\n"
 	);
 	exit(1);
@@ -68,27 +101,6 @@ void exit_input_error(int line_num)
 	exit(1);
 }
 
-static char *line = NULL;
-static int max_line_len;
-
-static char* readline(FILE *input)
-{
-	int len;
-
-	if(fgets(line,max_line_len,input) == NULL)
-		return NULL;
-
-	while(strrchr(line,'\n') == NULL)
-	{
-		max_line_len *= 2;
-		line = (char *) realloc(line,max_line_len);
-		len = (int) strlen(line);
-		if(fgets(line+len,max_line_len-len,input) == NULL)
-			break;
-	}
-	return line;
-}
-
 void parse_command_line(int argc, char **argv, char *input_file_name, char *model_file_name);
 void read_problem(const char *filename);
 void do_cross_validation();
@@ -106,6 +118,8 @@ int flag_p_specified;
 int flag_solver_specified;
 int nr_fold;
 double bias;
+const char *cache_file_name;
+int stream_block_size;
 
 int main(int argc, char **argv)
 {
@@ -145,7 +159,8 @@ int main(int argc, char **argv)
 	free(prob.y);
 	free(prob.x);
 	free(x_space);
-	free(line);
+	if(trace_fp)
+		fclose(trace_fp);
 
 	return 0;
 }
@@ -228,6 +243,13 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 	param.weight_label = NULL;
 	param.weight = NULL;
 	param.init_sol = NULL;
+	param.xtv_type = XTV_THREAD_VECTORS;
+	param.storage_type = STORAGE_FEATURE_NODE;
+	param.hot_node = -1;
+	param.stream_file = NULL;
+	param.stream_block_size = 0;
+	param.nr_fold_thread = 1;
+	param.dcd_type = DCD_SEQUENTIAL;
 	flag_cross_validation = 0;
 	flag_C_specified = 0;
 	flag_p_specified = 0;
@@ -276,6 +298,54 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 				param.nr_thread = atoi(argv[i]);
 				break;
 
+			case 'x':
+				param.xtv_type = atoi(argv[i]);
+				break;
+
+			case 'f':
+				param.storage_type = atoi(argv[i]);
+				break;
+
+			case 'H':
+				param.hot_node = atoi(argv[i]);
+				break;
+
+			case 'j':
+				param.nr_fold_thread = atoi(argv[i]);
+				if(param.nr_fold_thread < 1)
+				{
+					fprintf(stderr,"nr_fold_thread must be at least 1\n");
+					exit_with_help();
+				}
+				break;
+
+			case 'a':
+				param.dcd_type = atoi(argv[i]);
+				break;
+
+			case 'k':
+				cache_file_name = argv[i];
+				break;
+
+			case 'S':
+				stream_block_size = atoi(argv[i]);
+				if(stream_block_size <= 0)
+				{
+					fprintf(stderr,"-S block_size: block_size must be > 0\n");
+					exit_with_help();
+				}
+				break;
+
+			case 'T':
+				trace_fp = fopen(argv[i], "w");
+				if(trace_fp == NULL)
+				{
+					fprintf(stderr,"can't open trace file %s\n",argv[i]);
+					exit(1);
+				}
+				set_trace_function(&print_trace);
+				break;
+
 			case 'w':
 				++param.nr_weight;
 				param.weight_label = (int *) realloc(param.weight_label,sizeof(int)*param.nr_weight);
@@ -353,22 +423,24 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 		}
 	}
 
-	int cvthreads = 1;
-#ifdef CV_OMP
-	if(flag_cross_validation || flag_find_parameters)
+	if(stream_block_size > 0)
 	{
-		cvthreads = nr_fold;
-		int maxthreads = omp_get_num_procs();
-		if(flag_omp)
+		if(cache_file_name == NULL || flag_cross_validation || flag_find_parameters)
 		{
-			omp_set_nested(1);
-			maxthreads = omp_get_num_procs()/param.nr_thread;
+			fprintf(stderr, "-S needs -k and does not work with -v or -C\n");
+			exit_with_help();
 		}
-		if(cvthreads > maxthreads)
-			cvthreads = maxthreads;
-		omp_set_num_threads(cvthreads);
+		param.stream_file = cache_file_name;
+		param.stream_block_size = stream_block_size;
+	}
+
+	int cvthreads = 1;
+	if(flag_cross_validation || flag_find_parameters)
+	{
+		if(param.nr_fold_thread > nr_fold)
+			param.nr_fold_thread = nr_fold;
+		cvthreads = param.nr_fold_thread;
 	}
-#endif
 
 	//default solver for parallel execution is L2R_L2LOSS_SVC
 	if(flag_omp)
@@ -385,7 +457,11 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 			param.solver_type != L2R_L2LOSS_SVC_DUAL &&
 			param.solver_type != L1R_L2LOSS_SVC &&
 			param.solver_type != L1R_LR &&
-			param.solver_type != ONECLASS_SVM)
+			param.solver_type != ONECLASS_SVM &&
+			!(param.dcd_type == DCD_ASYNC &&
+			  (param.solver_type == L2R_LR_DUAL ||
+			   param.solver_type == L2R_L2LOSS_SVR_DUAL ||
+			   param.solver_type == L2R_L1LOSS_SVR_DUAL)))
 		{
 			printf("WARNING: parallel solvers are only available for -s 0, 1, 2, 3, 5, 6, 11, 21 now; use single-core solvers instead.\n");
 			param.nr_thread = 1;
@@ -430,94 +506,149 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 	}
 }
 
-// read in a problem (in libsvm format)
-void read_problem(const char *filename)
+// The cache is the parsed problem as it is in memory (see linear.h)
+static void get_cache_header(struct problem_cache_header *h, const struct stat *st)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, PROBLEM_CACHE_MAGIC, sizeof(h->magic));
+	h->input_size = (int64_t)st->st_size;
+	h->input_mtime = (int64_t)st->st_mtim.tv_sec*1000000000 + st->st_mtim.tv_nsec;
+	h->bias = bias;
+}
+
+// returns 0 if the problem was loaded from the cache; out of core
+// (stream_block_size > 0), only y is loaded and prob.x is NULL
+static int load_cache(const char *cache_file, const struct stat *st)
 {
-	int max_index, inst_max_index, i;
-	size_t elements, j;
-	FILE *fp = fopen(filename,"r");
-	char *endptr;
-	char *idx, *val, *label;
+	struct problem_cache_header h, expected;
+	FILE *fp = fopen(cache_file, "rb");
+	int64_t *offset;
+	int i;
 
 	if(fp == NULL)
+		return -1;
+	get_cache_header(&expected, st);
+	if(fread(&h, sizeof(h), 1, fp) != 1
+		|| memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0
+		|| h.input_size != expected.input_size
+		|| h.input_mtime != expected.input_mtime
+		|| h.bias != expected.bias)
 	{
-		fprintf(stderr,"can't open input file %s\n",filename);
-		exit(1);
+		fclose(fp);
+		return -1;
 	}
 
-	prob.l = 0;
-	elements = 0;
-	max_line_len = 1024;
-	line = Malloc(char,max_line_len);
-	while(readline(fp)!=NULL)
+	prob.l = (int)h.l;
+	prob.n = (int)h.n;
+	prob.bias = bias;
+	prob.y = Malloc(double,prob.l);
+	if(stream_block_size > 0)
 	{
-		char *p = strtok(line," \t"); // label
-
-		// features
-		while(1)
+		prob.x = NULL;
+		x_space = NULL;
+		if(fread(prob.y, sizeof(double), (size_t)prob.l, fp) != (size_t)prob.l)
 		{
-			p = strtok(NULL," \t");
-			if(p == NULL || *p == '\n') // check '\n' as ' ' may be after the last feature
-				break;
-			elements++;
+			fprintf(stderr,"can't read cache file %s\n",cache_file);
+			exit(1);
 		}
-		elements++; // for bias term
-		prob.l++;
+		fclose(fp);
+		return 0;
 	}
-	rewind(fp);
-
-	prob.bias=bias;
-
-	prob.y = Malloc(double,prob.l);
 	prob.x = Malloc(struct feature_node *,prob.l);
-	x_space = Malloc(struct feature_node,elements+prob.l);
+	x_space = Malloc(struct feature_node,h.nr_node);
+	offset = Malloc(int64_t,prob.l);
+	if(fread(prob.y, sizeof(double), (size_t)prob.l, fp) != (size_t)prob.l
+		|| fread(offset, sizeof(int64_t), (size_t)prob.l, fp) != (size_t)prob.l
+		|| fread(x_space, sizeof(struct feature_node), (size_t)h.nr_node, fp) != (size_t)h.nr_node)
+	{
+		fprintf(stderr,"can't read cache file %s\n",cache_file);
+		exit(1);
+	}
+	for(i=0;i<prob.l;i++)
+		prob.x[i] = &x_space[offset[i]];
+	free(offset);
+	fclose(fp);
+	return 0;
+}
 
-	max_index = 0;
-	j=0;
+// written next to the cache and renamed, so a run never sees half of it
+static void save_cache(const char *cache_file, const struct stat *st, size_t nr_node)
+{
+	struct problem_cache_header h;
+	char *tmp_file = Malloc(char,strlen(cache_file)+5);
+	int64_t *offset = Malloc(int64_t,prob.l);
+	FILE *fp;
+	int i, ok;
+
+	sprintf(tmp_file, "%s.tmp", cache_file);
+	fp = fopen(tmp_file, "wb");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"can't write cache file %s\n",cache_file);
+		free(tmp_file);
+		free(offset);
+		return;
+	}
+	get_cache_header(&h, st);
+	h.l = prob.l;
+	h.nr_node = (int64_t)nr_node;
+	h.n = prob.n;
 	for(i=0;i<prob.l;i++)
+		offset[i] = prob.x[i] - x_space;
+	ok = fwrite(&h, sizeof(h), 1, fp) == 1
+		&& fwrite(prob.y, sizeof(double), (size_t)prob.l, fp) == (size_t)prob.l
+		&& fwrite(offset, sizeof(int64_t), (size_t)prob.l, fp) == (size_t)prob.l
+		&& fwrite(x_space, sizeof(struct feature_node), nr_node, fp) == nr_node;
+	ok = fclose(fp) == 0 && ok;
+	if(!ok || rename(tmp_file, cache_file) != 0)
 	{
-		inst_max_index = 0; // strtol gives 0 if wrong format
-		readline(fp);
-		prob.x[i] = &x_space[j];
-		label = strtok(line," \t\n");
-		if(label == NULL) // empty line
-			exit_input_error(i+1);
-
-		prob.y[i] = strtod(label,&endptr);
-		if(endptr == label || *endptr != '\0')
-			exit_input_error(i+1);
-
-		while(1)
-		{
-			idx = strtok(NULL,":");
-			val = strtok(NULL," \t");
-
-			if(val == NULL)
-				break;
+		fprintf(stderr,"can't write cache file %s\n",cache_file);
+		remove(tmp_file);
+	}
+	free(tmp_file);
+	free(offset);
+}
 
-			errno = 0;
-			x_space[j].index = (int) strtol(idx,&endptr,10);
-			if(endptr == idx || errno != 0 || *endptr != '\0' || x_space[j].index <= inst_max_index)
-				exit_input_error(i+1);
-			else
-				inst_max_index = x_space[j].index;
+// read in a problem (in libsvm format), mapped and parsed by parse_problem
+void read_problem(const char *filename)
+{
+	int max_index, i;
+	size_t j, size, error_line;
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	const char *text;
 
-			errno = 0;
-			x_space[j].value = strtod(val,&endptr);
-			if(endptr == val || errno != 0 || (*endptr != '\0' && !isspace(*endptr)))
-				exit_input_error(i+1);
+	if(fd < 0 || fstat(fd, &st) != 0)
+	{
+		fprintf(stderr,"can't open input file %s\n",filename);
+		exit(1);
+	}
+	if(cache_file_name && load_cache(cache_file_name, &st) == 0)
+	{
+		close(fd);
+		return;
+	}
 
-			++j;
+	size = (size_t)st.st_size;
+	text = NULL;
+	if(size > 0)
+	{
+		text = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(text == MAP_FAILED)
+		{
+			fprintf(stderr,"can't map input file %s\n",filename);
+			exit(1);
 		}
-
-		if(inst_max_index > max_index)
-			max_index = inst_max_index;
-
-		if(prob.bias >= 0)
-			x_space[j++].value = prob.bias;
-
-		x_space[j++].index = -1;
+		madvise((void *)text, size, MADV_SEQUENTIAL);
 	}
+	close(fd);
+
+	prob.bias=bias;
+	error_line = parse_problem(text, size, bias, 0, INT_MAX, &prob, &x_space, &j, &max_index);
+	if(error_line)
+		exit_input_error((int)error_line);
+	if(text)
+		munmap((void *)text, size);
 
 	if(prob.bias >= 0)
 	{
@@ -529,5 +660,19 @@ void read_problem(const char *filename)
 	else
 		prob.n=max_index;
 
-	fclose(fp);
+	if(cache_file_name)
+		save_cache(cache_file_name, &st, j);
+
+	if(stream_block_size > 0)
+	{
+		// parsed only to create the cache
+		free(prob.y);
+		free(prob.x);
+		free(x_space);
+		if(load_cache(cache_file_name, &st) != 0)
+		{
+			fprintf(stderr,"can't stream from cache file %s\n",cache_file_name);
+			exit(1);
+		}
+	}
 }
@@ -3,7 +3,10 @@
 #include <map>
 #include <iostream>
 #include <cstring>
+#include <thread>
+#include <vector>
 #include <numa.h>
+#include <numaif.h>
 
 #include "allocator.h"
 #include "spinlock.h"
@@ -13,7 +16,7 @@
 
 using namespace util;
 
-static event_counter evt_allocator_total_region_usage(
+static basic_event_counter<EVENT_CAT_ALLOCATOR> evt_allocator_total_region_usage(
     "allocator_total_region_usage_bytes");
 
 // page+alloc routines taken from masstree
@@ -74,6 +77,58 @@ allocator::UseMAdvWillNeed()
   return use_madv;
 }
 
+bool
+allocator::UseMAdvHugepage()
+{
+  static const char *px = getenv("DISABLE_MADV_HUGEPAGE");
+  static const std::string s = px ? to_lower(px) : "";
+  static const bool use_madv = !(s == "1" || s == "true");
+  return use_madv;
+}
+
+int
+allocator::MAdvAdvice()
+{
+  return (UseMAdvHugepage() ? MADV_HUGEPAGE : 0) |
+         (UseMAdvWillNeed() ? MADV_WILLNEED : 0);
+}
+
+const char *
+allocator::ClassName(AllocClass c)
+{
+  static const char *names[NClasses] = {"general", "index", "tuple", "version"};
+  INVARIANT(c < NClasses);
+  return names[c];
+}
+
+const char *
+allocator::PlacementName(Placement p)
+{
+  static const char *names[] = {"interleave", "local", "far", "none"};
+  return names[p];
+}
+
+bool
+allocator::ParsePlacement(const std::string &s, Placement &p)
+{
+  for (int i = PlacementInterleave; i <= PlacementNone; i++) {
+    if (s == PlacementName(Placement(i))) {
+      p = Placement(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+allocator::SetPlacement(AllocClass c, Placement p)
+{
+  ALWAYS_ASSERT(!g_memstart);
+  INVARIANT(c < NClasses);
+  g_placements[c] = p;
+  g_class_aware = true;
+}
+
 void
 allocator::Initialize(size_t ncpus, size_t maxpercore)
 {
@@ -113,6 +168,7 @@ allocator::Initialize(size_t ncpus, size_t maxpercore)
   std::cerr << "allocator::Initialize()" << std::endl
             << "  hugepgsize: " << hugepgsize << std::endl
             << "  use MADV_WILLNEED: " << UseMAdvWillNeed() << std::endl
+            << "  use MADV_HUGEPAGE: " << UseMAdvHugepage() << std::endl
             << "  mmap() region [" << x << ", " << endpx << ")" << std::endl;
 
   g_memstart = reinterpret_cast<void *>(util::iceil(uintptr_t(x), hugepgsize));
@@ -134,6 +190,14 @@ allocator::Initialize(size_t ncpus, size_t maxpercore)
     ALWAYS_ASSERT(g_regions[i].region_end <= endpx);
   }
 
+  if (g_class_aware) {
+    // zeroed, ie everything starts out as ClassGeneral
+    g_hugepage_class = new uint8_t[g_ncpus * g_maxpercore / hugepgsize]();
+    for (size_t i = 0; i < NClasses; i++)
+      std::cerr << "  " << ClassName(AllocClass(i)) << " placement: "
+                << PlacementName(g_placements[i]) << std::endl;
+  }
+
   s_init = true;
 }
 
@@ -151,6 +215,15 @@ allocator::DumpStats()
   }
 }
 
+size_t
+allocator::ClassBytes(AllocClass c)
+{
+  size_t ret = 0;
+  for (size_t i = 0; i < g_ncpus; i++)
+    ret += __atomic_load_n(&g_regions[i].class_bytes[c], __ATOMIC_RELAXED);
+  return ret;
+}
+
 static void *
 initialize_page(void *page, const size_t pagesize, const size_t unit)
 {
@@ -187,8 +260,69 @@ initialize_page(void *page, const size_t pagesize, const size_t unit)
   return first;
 }
 
+// the nearest node with memory but without cpus, which is how PMEM (and CXL
+// memory) shows up. -1 if there is none
+static int
+far_node_of(int node)
+{
+  int best = -1;
+  struct bitmask *cpus = numa_allocate_cpumask();
+  for (int n = 0; n <= numa_max_node(); n++) {
+    if (n == node || !numa_bitmask_isbitset(numa_all_nodes_ptr, n))
+      continue;
+    if (numa_node_to_cpus(n, cpus) || numa_bitmask_weight(cpus))
+      continue;
+    if (best == -1 || numa_distance(node, n) < numa_distance(node, best))
+      best = n;
+  }
+  numa_free_cpumask(cpus);
+  return best;
+}
+
+// with move set, the pages already faulted in [px, px + sz) are migrated to
+// comply. without, only future faults are affected
+static void
+numa_hint_memory_placement(void *px, size_t sz, unsigned node,
+                           allocator::Placement placement, bool move)
+{
+  struct bitmask *bm = numa_allocate_nodemask();
+  int mode = MPOL_DEFAULT;
+  switch (placement) {
+  case allocator::PlacementInterleave:
+    mode = MPOL_INTERLEAVE;
+    numa_bitmask_setbit(bm, node);
+    break;
+  case allocator::PlacementLocal:
+    mode = MPOL_PREFERRED;
+    numa_bitmask_setbit(bm, node);
+    break;
+  case allocator::PlacementFar:
+    {
+      static bool s_warned = false;
+      const int far = far_node_of(node);
+      if (far == -1 && !s_warned) {
+        std::cerr << "[WARNING] node" << node
+                  << " has no cpu-less node to place far allocations on"
+                  << std::endl;
+        s_warned = true;
+      }
+      mode = MPOL_PREFERRED;
+      numa_bitmask_setbit(bm, far == -1 ? node : far);
+    }
+    break;
+  case allocator::PlacementNone:
+    break;
+  }
+  // maxnode counts bits, and the kernel ignores the last one
+  const unsigned long maxnode = mode == MPOL_DEFAULT ? 0 : bm->size + 1;
+  if (mbind(px, sz, mode, mode == MPOL_DEFAULT ? nullptr : bm->maskp,
+            maxnode, move ? MPOL_MF_MOVE : 0))
+    perror("mbind");
+  numa_free_nodemask(bm);
+}
+
 void *
-allocator::AllocateArenas(size_t cpu, size_t arena)
+allocator::AllocateArenas(size_t cpu, size_t arena, AllocClass cls)
 {
   INVARIANT(cpu < g_ncpus);
   INVARIANT(arena < MAX_ARENAS);
@@ -196,17 +330,29 @@ allocator::AllocateArenas(size_t cpu, size_t arena)
   INVARIANT(g_maxpercore);
   static const size_t hugepgsize = GetHugepageSize();
 
+  INVARIANT(cls == EffectiveClass(cls));
+
   regionctx &pc = g_regions[cpu];
   pc.lock.lock();
-  if (likely(pc.arenas[arena])) {
+  if (likely(pc.arenas[cls][arena])) {
     // claim
-    void *ret = pc.arenas[arena];
-    pc.arenas[arena] = nullptr;
+    void *ret = pc.arenas[cls][arena];
+    pc.arenas[cls][arena] = nullptr;
     pc.lock.unlock();
     return ret;
   }
 
+  pc.class_bytes[cls] += hugepgsize;
   void * const mypx = AllocateUnmanagedWithLock(pc, 1); // releases lock
+  if (g_class_aware && cls != ClassGeneral) {
+    // nobody else can see this hugepage yet
+    g_hugepage_class[
+      (reinterpret_cast<char *>(mypx) -
+       reinterpret_cast<char *>(g_memstart)) / hugepgsize] = cls;
+    if (g_placements[cls] != g_placements[ClassGeneral])
+      numa_hint_memory_placement(
+          mypx, hugepgsize, numa_node_of_cpu(cpu), g_placements[cls], true);
+  }
   return initialize_page(mypx, hugepgsize, (arena + 1) * AllocAlignment);
 }
 
@@ -252,9 +398,8 @@ allocator::AllocateUnmanagedWithLock(regionctx &pc, size_t nhugepgs)
       ALWAYS_ASSERT(false);
     }
     INVARIANT(x == mypx);
-    const int advice =
-      UseMAdvWillNeed() ? MADV_HUGEPAGE | MADV_WILLNEED : MADV_HUGEPAGE;
-    if (madvise(x, hugepgsize, advice)) {
+    const int advice = MAdvAdvice();
+    if (advice && madvise(x, hugepgsize, advice)) {
       perror("madvise");
       ALWAYS_ASSERT(false);
     }
@@ -264,7 +409,7 @@ allocator::AllocateUnmanagedWithLock(regionctx &pc, size_t nhugepgs)
 }
 
 void
-allocator::ReleaseArenas(void **arenas)
+allocator::ReleaseArenas(void **arenas, AllocClass cls)
 {
   // cpu -> [(head, tail)]
   // XXX: use a small_map here?
@@ -274,6 +419,7 @@ allocator::ReleaseArenas(void **arenas)
     while (p) {
       void * const pnext = *reinterpret_cast<void **>(p);
       const size_t cpu = PointerToCpu(p);
+      INVARIANT(PointerToClass(p) == cls);
       auto it = m.find(cpu);
       if (it == m.end()) {
         auto &v = m[cpu];
@@ -301,21 +447,12 @@ allocator::ReleaseArenas(void **arenas)
       INVARIANT(bool(p.second[arena].first) == bool(p.second[arena].second));
       if (!p.second[arena].first)
         continue;
-      *reinterpret_cast<void **>(p.second[arena].second) = pc.arenas[arena];
-      pc.arenas[arena] = p.second[arena].first;
+      *reinterpret_cast<void **>(p.second[arena].second) = pc.arenas[cls][arena];
+      pc.arenas[cls][arena] = p.second[arena].first;
     }
   }
 }
 
-static void
-numa_hint_memory_placement(void *px, size_t sz, unsigned node)
-{
-  struct bitmask *bm = numa_allocate_nodemask();
-  numa_bitmask_setbit(bm, node);
-  numa_interleave_memory(px, sz, bm);
-  numa_free_nodemask(bm);
-}
-
 void
 allocator::FaultRegion(size_t cpu)
 {
@@ -344,33 +481,56 @@ allocator::FaultRegion(size_t cpu)
     ALWAYS_ASSERT(false);
   }
   ALWAYS_ASSERT(x == pc.region_begin);
-  const int advice =
-    UseMAdvWillNeed() ? MADV_HUGEPAGE | MADV_WILLNEED : MADV_HUGEPAGE;
-  if (madvise(x, sz, advice)) {
+  const int advice = MAdvAdvice();
+  if (advice && madvise(x, sz, advice)) {
     perror("madvise");
     ALWAYS_ASSERT(false);
   }
   numa_hint_memory_placement(
       pc.region_begin,
       (uintptr_t)pc.region_end - (uintptr_t)pc.region_begin,
-      numa_node_of_cpu(cpu));
+      numa_node_of_cpu(cpu),
+      g_placements[ClassGeneral], false);
   const size_t nfaults =
     ((uintptr_t)pc.region_end - (uintptr_t)pc.region_begin) / hugepgsize;
   std::cerr << "cpu" << cpu << " starting faulting region ("
             << intptr_t(pc.region_end) - intptr_t(pc.region_begin)
             << " bytes / " << nfaults << " hugepgs)" << std::endl;
+  // one write per page is enough to fault it, be it a huge one or not
+  static const size_t pgsize = GetPageSize();
   timer t;
   for (char *px = (char *) pc.region_begin;
        px < (char *) pc.region_end;
-       px += CACHELINE_SIZE)
+       px += pgsize)
     *px = 0xDE;
   std::cerr << "cpu" << cpu << " finished faulting region in "
             << t.lap_ms() << " ms" << std::endl;
   pc.region_faulted = true;
 }
 
+void
+allocator::FaultRegions()
+{
+  ALWAYS_ASSERT(g_memstart);
+  timer t;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < g_ncpus; i++)
+    threads.emplace_back([i]() {
+      // first touch from the cpu's node, as the loaders would
+      ALWAYS_ASSERT(!numa_run_on_node(numa_node_of_cpu(i)));
+      FaultRegion(i);
+    });
+  for (auto &th : threads)
+    th.join();
+  std::cerr << "faulted " << g_ncpus << " regions in parallel in "
+            << t.lap_ms() << " ms" << std::endl;
+}
+
 void *allocator::g_memstart = nullptr;
 void *allocator::g_memend = nullptr;
 size_t allocator::g_ncpus = 0;
 size_t allocator::g_maxpercore = 0;
+bool allocator::g_class_aware = false;
+allocator::Placement allocator::g_placements[allocator::NClasses] = {};
+uint8_t *allocator::g_hugepage_class = nullptr;
 percore<allocator::regionctx> allocator::g_regions;
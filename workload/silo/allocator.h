@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <iterator>
 #include <mutex>
+#include <string>
 
 #include "util.h"
 #include "core.h"
@@ -20,11 +21,52 @@ public:
   // w/o calling Initialize(), behavior for this class is undefined
   static void Initialize(size_t ncpus, size_t maxpercore);
 
+  // allocations are tagged with the kind of data they hold, so that each kind
+  // can live on its own memory tier. untagged allocations are ClassGeneral
+  enum AllocClass {
+    ClassGeneral = 0,
+    ClassIndex,   // index nodes
+    ClassTuple,   // latest record versions (header + inline value)
+    ClassVersion, // superseded record versions, only read by snapshots
+    NClasses,
+  };
+
+  enum Placement {
+    PlacementInterleave = 0, // interleave over the cpu's node (the default)
+    PlacementLocal,          // prefer the cpu's node, ie DRAM
+    PlacementFar,            // prefer the nearest cpu-less node, ie PMEM
+    PlacementNone,           // leave it to the kernel
+  };
+
+  static const char *ClassName(AllocClass c);
+  static const char *PlacementName(Placement p);
+
+  // returns false if s does not name a placement
+  static bool ParsePlacement(const std::string &s, Placement &p);
+
+  // must be called before Initialize(). placing any class enables the
+  // class-aware mode: each hugepage of a cpu's region then only serves a
+  // single class, and is bound to the tier of that class (migrating what was
+  // already faulted) when it is carved out of the region
+  static void SetPlacement(AllocClass c, Placement p);
+
+  static inline AllocClass
+  EffectiveClass(AllocClass c)
+  {
+    return g_class_aware ? c : ClassGeneral;
+  }
+
   static void DumpStats();
 
+  // bytes of the hugepages carved out for class c so far, over all cpus.
+  // the class pages are recycled within the class and never go back to the
+  // region, so this is the footprint of c. without the class-aware mode
+  // everything is ClassGeneral
+  static size_t ClassBytes(AllocClass c);
+
   // returns an arena linked-list
   static void *
-  AllocateArenas(size_t cpu, size_t sz);
+  AllocateArenas(size_t cpu, size_t sz, AllocClass cls = ClassGeneral);
 
   // allocates nhugepgs * hugepagesize contiguous bytes from CPU's region and
   // returns the raw, unmanaged pointer.
@@ -35,8 +77,9 @@ public:
   static void *
   AllocateUnmanaged(size_t cpu, size_t nhugepgs);
 
+  // all arenas must belong to class cls
   static void
-  ReleaseArenas(void **arenas);
+  ReleaseArenas(void **arenas, AllocClass cls = ClassGeneral);
 
   static const size_t LgAllocAlignment = 4; // all allocations aligned to 2^4 = 16
   static const size_t AllocAlignment = 1 << LgAllocAlignment;
@@ -54,6 +97,11 @@ public:
   static void
   FaultRegion(size_t cpu);
 
+  // FaultRegion() for every cpu at once, from threads running on the node of
+  // each cpu. returns once all regions are faulted
+  static void
+  FaultRegions();
+
   // returns true if managed by this allocator, false otherwise
   static inline bool
   ManagesPointer(const void *p)
@@ -75,6 +123,21 @@ public:
     return ret;
   }
 
+  // assumes p is managed by this allocator- returns the class of the hugepage
+  // p was allocated from
+  static inline AllocClass
+  PointerToClass(const void *p)
+  {
+    if (!g_class_aware)
+      return ClassGeneral;
+    static const size_t hugepgsize = GetHugepageSize();
+    INVARIANT(ManagesPointer(p));
+    const size_t pg =
+      (reinterpret_cast<const char *>(p) -
+       reinterpret_cast<const char *>(g_memstart)) / hugepgsize;
+    return AllocClass(g_hugepage_class[pg]);
+  }
+
 #ifdef MEMCHECK_MAGIC
   struct pgmetadata {
     uint32_t unit_; // 0-indexed
@@ -104,6 +167,8 @@ private:
   static size_t GetPageSizeImpl();
   static size_t GetHugepageSizeImpl();
   static bool UseMAdvWillNeed();
+  static bool UseMAdvHugepage();
+  static int MAdvAdvice();
 
   struct regionctx {
     regionctx()
@@ -112,6 +177,7 @@ private:
         region_faulted(false)
     {
       NDB_MEMSET(arenas, 0, sizeof(arenas));
+      NDB_MEMSET(class_bytes, 0, sizeof(class_bytes));
     }
     regionctx(const regionctx &) = delete;
     regionctx(regionctx &&) = delete;
@@ -125,7 +191,8 @@ private:
 
     spinlock lock;
     std::mutex fault_lock; // XXX: hacky
-    void *arenas[MAX_ARENAS];
+    void *arenas[NClasses][MAX_ARENAS];
+    size_t class_bytes[NClasses]; // written under lock, read racily
   };
 
   // assumes caller has the regionctx lock held, and
@@ -139,6 +206,12 @@ private:
   static size_t g_ncpus;
   static size_t g_maxpercore;
 
+  // set by SetPlacement(). in the class-aware mode, g_hugepage_class holds the
+  // AllocClass of every hugepage in [g_memstart, g_memend)
+  static bool g_class_aware;
+  static Placement g_placements[NClasses];
+  static uint8_t *g_hugepage_class;
+
   static percore<regionctx> g_regions CACHE_ALIGNED;
 };
 
@@ -37,10 +37,12 @@ public:
       been_destructed(false)
   {
     base_txn_btree_handler<Transaction>::on_construct();
+    transaction_base::NameAbortTable(&underlying_btree, name);
   }
 
   ~base_txn_btree()
   {
+    transaction_base::UnnameAbortTable(&underlying_btree);
     if (!been_destructed)
       unsafe_purge(false);
   }
@@ -51,6 +53,14 @@ public:
     return underlying_btree.size();
   }
 
+  /**
+   * Bytes held by the index nodes and by the latest versions of the
+   * records, walking the whole tree. The older versions are not reachable
+   * safely (the gc frees them without rcu), see ClassVersion of the
+   * allocator for those
+   */
+  std::map<std::string, uint64_t> footprint() const;
+
   inline size_type
   get_value_size_hint() const
   {
@@ -79,6 +89,16 @@ public:
 
 private:
 
+  struct footprint_tree_walker : public concurrent_btree::tree_walk_callback {
+    footprint_tree_walker() : nrecords(0), record_bytes(0) {}
+    virtual void on_node_begin(const typename concurrent_btree::node_opaque_t *n);
+    virtual void on_node_success();
+    virtual void on_node_failure();
+    std::vector<std::pair<typename concurrent_btree::value_type, bool>> spec_values;
+    size_t nrecords;
+    size_t record_bytes;
+  };
+
   struct purge_tree_walker : public concurrent_btree::tree_walk_callback {
     virtual void on_node_begin(const typename concurrent_btree::node_opaque_t *n);
     virtual void on_node_success();
@@ -145,10 +165,11 @@ protected:
   struct txn_search_range_callback : public concurrent_btree::low_level_search_range_callback {
     constexpr txn_search_range_callback(
           Transaction<Traits> *t,
+          const concurrent_btree *btr,
           Callback *caller_callback,
           KeyReader *key_reader,
           ValueReader *value_reader)
-      : t(t), caller_callback(caller_callback),
+      : t(t), btr(btr), caller_callback(caller_callback),
         key_reader(key_reader), value_reader(value_reader) {}
 
     virtual void on_resp_node(const typename concurrent_btree::node_opaque_t *n, uint64_t version);
@@ -157,6 +178,7 @@ protected:
 
   private:
     Transaction<Traits> *const t;
+    const concurrent_btree *const btr;
     Callback *const caller_callback;
     KeyReader *const key_reader;
     ValueReader *const value_reader;
@@ -168,6 +190,13 @@ protected:
             const typename P::Key &k,
             ValueReader &value_reader);
 
+  // do_search() of a key already encoded, e.g. on the stack of the caller
+  template <typename Traits, typename ValueReader>
+  inline bool
+  do_search_bytes(Transaction<Traits> &t,
+                  const varkey &k,
+                  ValueReader &value_reader);
+
   template <typename Traits, typename Callback,
             typename KeyReader, typename ValueReader>
   inline void
@@ -219,22 +248,32 @@ base_txn_btree<Transaction, P>::do_search(
     const typename P::Key &k,
     ValueReader &value_reader)
 {
-  t.ensure_active();
-
   typename P::KeyWriter key_writer(&k);
   const std::string * const key_str =
     key_writer.fully_materialize(true, t.string_allocator());
+  return do_search_bytes(t, varkey(*key_str), value_reader);
+}
+
+template <template <typename> class Transaction, typename P>
+template <typename Traits, typename ValueReader>
+bool
+base_txn_btree<Transaction, P>::do_search_bytes(
+    Transaction<Traits> &t,
+    const varkey &k,
+    ValueReader &value_reader)
+{
+  t.ensure_active();
 
   // search the underlying btree to map k=>(btree_node|tuple)
   typename concurrent_btree::value_type underlying_v{};
   concurrent_btree::versioned_node_t search_info;
-  const bool found = this->underlying_btree.search(varkey(*key_str), underlying_v, &search_info);
+  const bool found = this->underlying_btree.search(k, underlying_v, &search_info);
   if (found) {
     const dbtuple * const tuple = reinterpret_cast<const dbtuple *>(underlying_v);
-    return t.do_tuple_read(tuple, value_reader);
+    return t.do_tuple_read(&this->underlying_btree, tuple, value_reader);
   } else {
     // not found, add to absent_set
-    t.do_node_read(search_info.first, search_info.second);
+    t.do_node_read(&this->underlying_btree, search_info.first, search_info.second);
     return false;
   }
 }
@@ -258,6 +297,51 @@ base_txn_btree<Transaction, P>::unsafe_purge(bool dump_stats)
 #endif
 }
 
+template <template <typename> class Transaction, typename P>
+std::map<std::string, uint64_t>
+base_txn_btree<Transaction, P>::footprint() const
+{
+  footprint_tree_walker w;
+  underlying_btree.tree_walk(w);
+  const typename concurrent_btree::node_footprint f =
+    underlying_btree.footprint();
+  std::map<std::string, uint64_t> ret;
+  ret["records"] = w.nrecords;
+  ret["record_bytes"] = w.record_bytes;
+  ret["leaf_nodes"] = f.nleaves_;
+  ret["internal_nodes"] = f.ninternodes_;
+  ret["node_bytes"] = f.bytes_;
+  return ret;
+}
+
+template <template <typename> class Transaction, typename P>
+void
+base_txn_btree<Transaction, P>::footprint_tree_walker::on_node_begin(const typename concurrent_btree::node_opaque_t *n)
+{
+  INVARIANT(spec_values.empty());
+  spec_values = concurrent_btree::ExtractValues(n);
+}
+
+template <template <typename> class Transaction, typename P>
+void
+base_txn_btree<Transaction, P>::footprint_tree_walker::on_node_success()
+{
+  // the tree walk holds an rcu region, so the latest versions cannot go away
+  for (size_t i = 0; i < spec_values.size(); i++) {
+    const dbtuple *tuple = (const dbtuple *) spec_values[i].first;
+    nrecords++;
+    record_bytes += sizeof(dbtuple) + tuple->alloc_size;
+  }
+  spec_values.clear();
+}
+
+template <template <typename> class Transaction, typename P>
+void
+base_txn_btree<Transaction, P>::footprint_tree_walker::on_node_failure()
+{
+  spec_values.clear();
+}
+
 template <template <typename> class Transaction, typename P>
 void
 base_txn_btree<Transaction, P>::purge_tree_walker::on_node_begin(const typename concurrent_btree::node_opaque_t *n)
@@ -388,7 +472,7 @@ base_txn_btree<Transaction, P>
   VERBOSE(std::cerr << "on_resp_node(): <node=0x" << util::hexify(intptr_t(n))
                << ", version=" << version << ">" << std::endl);
   VERBOSE(std::cerr << "  " << concurrent_btree::NodeStringify(n) << std::endl);
-  t->do_node_read(n, version);
+  t->do_node_read(btr, n, version);
 }
 
 template <template <typename> class Transaction, typename P>
@@ -406,7 +490,7 @@ base_txn_btree<Transaction, P>
                     << ", version=" << version << ">" << std::endl
                     << "  " << *((dbtuple *) v) << std::endl);
   const dbtuple * const tuple = reinterpret_cast<const dbtuple *>(v);
-  if (t->do_tuple_read(tuple, *value_reader))
+  if (t->do_tuple_read(btr, tuple, *value_reader))
     return caller_callback->invoke(
         (*key_reader)(k), value_reader->results());
   return true;
@@ -446,7 +530,7 @@ base_txn_btree<Transaction, P>::do_search_range_call(
     return;
 
   txn_search_range_callback<Traits, Callback, KeyReader, ValueReader> c(
-			&t, &callback, &key_reader, &value_reader);
+			&t, &this->underlying_btree, &callback, &key_reader, &value_reader);
 
   varkey uppervk;
   if (upper_str)
@@ -482,7 +566,7 @@ base_txn_btree<Transaction, P>::do_rsearch_range_call(
     return;
 
   txn_search_range_callback<Traits, Callback, KeyReader, ValueReader> c(
-			&t, &callback, &key_reader, &value_reader);
+			&t, &this->underlying_btree, &callback, &key_reader, &value_reader);
 
   varkey lowervk;
   if (lower_str)
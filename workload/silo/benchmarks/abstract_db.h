@@ -74,6 +74,7 @@ public:
     HINT_KV_GET_PUT, // KV workloads over a single key
     HINT_KV_RMW, // get/put over a single key
     HINT_KV_SCAN, // KV scan workloads (~100 keys)
+    HINT_KV_SCAN_READ_ONLY, // same, over a snapshot
 
     // tpcc profiles
     HINT_TPCC_NEW_ORDER,
@@ -8,6 +8,7 @@
 
 #include "../macros.h"
 #include "../str_arena.h"
+#include "../varkey.h"
 
 /**
  * The underlying index manages memory for keys/values, but
@@ -29,6 +30,21 @@ public:
       std::string &value,
       size_t max_bytes_read = std::string::npos) = 0;
 
+  /**
+   * get() of the 8 byte key u64_varkey(key) encodes. Indexes searching by
+   * the key bytes take it off the stack, the default materializes a string
+   */
+  virtual bool get_u64(
+      void *txn,
+      uint64_t key,
+      std::string &value,
+      size_t max_bytes_read = std::string::npos)
+  {
+    const u64_varkey k(key);
+    return get(txn, std::string((const char *) k.data(), k.size()), value,
+               max_bytes_read);
+  }
+
   class scan_callback {
   public:
     virtual ~scan_callback() {}
@@ -94,6 +110,18 @@ public:
                     static_cast<const std::string &>(value));
   }
 
+  /**
+   * put() of the 8 byte key u64_varkey(key) encodes, see get_u64()
+   */
+  virtual const char *
+  put_u64(void *txn,
+          uint64_t key,
+          const std::string &value)
+  {
+    const u64_varkey k(key);
+    return put(txn, std::string((const char *) k.data(), k.size()), value);
+  }
+
   /**
    * Insert a key of length keylen.
    *
@@ -141,6 +169,16 @@ public:
    */
   virtual size_t size() const = 0;
 
+  /**
+   * Bytes held by the index, by what holds them. Not transactional either,
+   * empty if the index cannot tell
+   */
+  virtual std::map<std::string, uint64_t>
+  footprint() const
+  {
+    return std::map<std::string, uint64_t>();
+  }
+
   /**
    * Not thread safe for now
    */
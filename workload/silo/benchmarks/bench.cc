@@ -1,13 +1,17 @@
-#include "TDigest.h"
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <thread>
+#include <set>
 #include <sstream>
 #include <vector>
 #include <utility>
 #include <string>
 
+#include <math.h>
 #include <stdlib.h>
 #include <sched.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/sysinfo.h>
 
@@ -44,6 +48,70 @@ int slow_exit = 0;
 int retry_aborted_transaction = 0;
 int no_reset_counters = 0;
 int backoff_aborted_transaction = 0;
+double arrival_rate = 0.0;
+int arrival_dist = ARRIVAL_POISSON;
+string timeline_file;
+uint64_t timeline_interval_ms = 1000;
+string db_image_save;
+string db_image_load;
+tenant_group *tenants = nullptr;
+
+static __thread const string *tl_tenant_name = nullptr;
+
+void
+tenant_group::begin_setup(const string &name)
+{
+  setup_lock_.lock();
+  tl_tenant_name = &name;
+}
+
+void
+tenant_group::wait_loaded()
+{
+  setup_lock_.unlock();
+  std::unique_lock<std::mutex> l(lock_);
+  if (!--nloading_)
+    loaded_cv_.notify_all();
+  loaded_cv_.wait(l, [this] { return !nloading_; });
+}
+
+const string &
+tenant_group::current()
+{
+  static const string none;
+  return tl_tenant_name ? *tl_tenant_name : none;
+}
+
+// the tables bench_footprint() walks, set once loaded
+static spinlock g_footprint_lock;
+static map<string, abstract_ordered_index *> g_footprint_tables;
+
+map<string, uint64_t>
+bench_footprint()
+{
+  map<string, uint64_t> ret;
+  {
+    ::lock_guard<spinlock> l(g_footprint_lock);
+    // tpcc opens the same index under many names, walk each once
+    set<abstract_ordered_index *> seen;
+    for (auto &t : g_footprint_tables) {
+      if (!seen.insert(t.second).second)
+        continue;
+      for (auto &p : t.second->footprint()) {
+        ret["footprint_" + t.first + "_" + p.first] += p.second;
+        ret["footprint_total_" + p.first] += p.second;
+      }
+    }
+  }
+  for (size_t c = 0; c < ::allocator::NClasses; c++) {
+    const auto cls = ::allocator::AllocClass(c);
+    ret[string("footprint_allocator_") + ::allocator::ClassName(cls) + "_bytes"] =
+      ::allocator::ClassBytes(cls);
+  }
+  ret["footprint_rcu_deferred_bytes"] = rcu::s_instance.deferred_bytes();
+  ret["footprint_rcu_peak_deferred_bytes"] = rcu::s_instance.peak_deferred_bytes();
+  return ret;
+}
 
 template <typename T>
 static void
@@ -105,6 +173,50 @@ write_cb(void *p, const char *s)
 
 static event_avg_counter evt_avg_abort_spins("avg_abort_spins");
 
+void
+bench_worker::set_phase(size_t phase)
+{
+  ALWAYS_ASSERT(phase >= this->phase);
+  const uint64_t now = timer::cur_usec();
+  // skipped phases are left empty
+  while (phase_stats.size() <= phase) {
+    phase_stats.back().end_us = now;
+    phase_stats.push_back({0, now, 0});
+  }
+  this->phase = phase;
+}
+
+uint64_t
+bench_worker::next_arrival_gap_ns(double mean_gap_ns)
+{
+  if (arrival_dist == ARRIVAL_CONSTANT)
+    return uint64_t(mean_gap_ns);
+  // exponential inter-arrival times, 1 - u is in (0, 1]
+  return uint64_t(-log(1.0 - arrival_r.next_uniform()) * mean_gap_ns);
+}
+
+// sleeps through most of the wait and spins the rest, a sleep overshoots by
+// tens of us
+static void
+wait_until_nsec(uint64_t t)
+{
+  static const uint64_t SpinNs = 50000;
+  for (;;) {
+    const uint64_t now = timer::cur_nsec();
+    if (now >= t || !running)
+      return;
+    if (t - now > 2 * SpinNs) {
+      const uint64_t ns = t - now - SpinNs;
+      struct timespec ts;
+      ts.tv_sec = ns / 1000000000;
+      ts.tv_nsec = ns % 1000000000;
+      nanosleep(&ts, nullptr);
+    } else {
+      nop_pause();
+    }
+  }
+}
+
 void
 bench_worker::run()
 {
@@ -121,7 +233,21 @@ bench_worker::run()
   txn_counts.resize(workload.size());
   barrier_a->count_down();
   barrier_b->wait_for();
+  phase_stats.assign(1, {0, timer::cur_usec(), 0});
+  // open-loop: the txns arrive on a schedule whether or not the previous ones
+  // are done, and their latency runs from the scheduled start, so a stall is
+  // also charged to the txns queued behind it (no coordinated omission)
+  const bool open_loop = arrival_rate > 0.0;
+  const double mean_gap_ns = open_loop ? 1e9 / arrival_rate : 0.0;
+  uint64_t next_arrival_ns = timer::cur_nsec();
   while (running && (run_mode != RUNMODE_OPS || ntxn_commits < ops_per_worker)) {
+    const uint64_t arrival_ns = next_arrival_ns;
+    if (open_loop) {
+      next_arrival_ns += next_arrival_gap_ns(mean_gap_ns);
+      wait_until_nsec(arrival_ns);
+      if (!running)
+        break;
+    }
     double d = r.next_uniform();
     for (size_t i = 0; i < workload.size(); i++) {
       if ((i + 1) == workload.size() || d < workload[i].frequency) {
@@ -131,12 +257,15 @@ bench_worker::run()
         const auto ret = workload[i].fn(this);
         if (likely(ret.first)) {
           ++ntxn_commits;
+          ++phase_stats.back().ntxn_commits;
           auto lap_ns = t.lap_ns();
-          tdigest.add(lap_ns);
+          if (open_loop)
+            lap_ns = timer::cur_nsec() - arrival_ns;
+          latencies.record(lap_ns);
           latency_numer_us += lap_ns / 1000;
           backoff_shifts >>= 1;
         } else {
-          ++ntxn_aborts;
+          __atomic_store_n(&ntxn_aborts, ntxn_aborts + 1, __ATOMIC_RELAXED);
           if (retry_aborted_transaction && running) {
             if (backoff_aborted_transaction) {
               if (backoff_shifts < 63)
@@ -162,13 +291,56 @@ bench_worker::run()
       d -= workload[i].frequency;
     }
   }
+  phase_stats.back().end_us = timer::cur_usec();
+}
+
+// writes the throughput and latency of every interval of the run as csv
+// lines to timeline_file, until done is set. the intervals are taken as the
+// difference between two snapshots of the worker histograms
+static void
+report_timeline(const vector<bench_worker *> &workers, const volatile bool &done)
+{
+  // one file per tenant
+  ofstream ofs(tenants ? timeline_file + "." + tenant_group::current() : timeline_file);
+  ALWAYS_ASSERT(ofs.is_open());
+  ofs << "time_sec,commits,aborts,throughput,p50_latency_ns,p90_latency_ns,p99_latency_ns" << endl;
+  const uint64_t start_us = timer::cur_usec();
+  uint64_t last_us = start_us;
+  vector<latency_histogram> prev(workers.size());
+  size_t prev_aborts = 0;
+  for (uint64_t next_us = start_us + timeline_interval_ms * 1000; !done;
+       next_us += timeline_interval_ms * 1000) {
+    // wake up often enough to notice the end of the run
+    for (uint64_t now = timer::cur_usec(); !done && now < next_us; now = timer::cur_usec())
+      usleep(min(next_us - now, uint64_t(10000)));
+    latency_histogram latencies;
+    size_t aborts = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+      latencies.merge_delta(workers[i]->get_latencies(), prev[i]);
+      aborts += workers[i]->get_ntxn_aborts();
+    }
+    const uint64_t commits = latencies.count();
+    const size_t interval_aborts = aborts - prev_aborts;
+    prev_aborts = aborts;
+    const uint64_t now = timer::cur_usec();
+    const double interval_sec = double(now - last_us) / 1000000.0;
+    last_us = now;
+    ofs << double(now - start_us) / 1000000.0 << ","
+        << commits << ","
+        << interval_aborts << ","
+        << (interval_sec > 0.0 ? double(commits) / interval_sec : 0.0) << ","
+        << latencies.quantile(0.50) << ","
+        << latencies.quantile(0.90) << ","
+        << latencies.quantile(0.99) << endl;
+  }
 }
 
 void
 bench_runner::run()
 {
   // load data
-  const vector<bench_loader *> loaders = make_loaders();
+  const vector<bench_loader *> loaders = db_image_load.empty() ?
+    make_loaders() : make_db_image_loaders(db, open_tables, db_image_load);
   {
     spin_barrier b(loaders.size());
     const pair<uint64_t, uint64_t> mem_info_before = get_system_memory_info();
@@ -201,6 +373,28 @@ bench_runner::run()
   }
   db->reset_ntxn_persisted();
 
+  {
+    ::lock_guard<spinlock> l(g_footprint_lock);
+    // all the tenants' tables, which do not share names
+    g_footprint_tables.insert(open_tables.begin(), open_tables.end());
+  }
+
+  if (!db_image_save.empty()) {
+    const vector<bench_loader *> savers =
+      make_db_image_savers(db, open_tables, db_image_save, nthreads);
+    spin_barrier b(savers.size());
+    {
+      scoped_timer t("dbimage", verbose);
+      for (auto s : savers) {
+        s->set_barrier(b);
+        s->start();
+      }
+      for (auto s : savers)
+        s->join();
+    }
+    delete_pointers(savers);
+  }
+
   if (!no_reset_counters) {
     event_counter::reset_all_counters(); // XXX: for now - we really should have a before/after loading
     PERF_EXPR(scopedperf::perfsum_base::resetall());
@@ -215,6 +409,9 @@ bench_runner::run()
     }
   }
 
+  if (tenants)
+    tenants->wait_loaded();
+
   map<string, size_t> table_sizes_before;
   if (verbose) {
     for (map<string, abstract_ordered_index *>::iterator it = open_tables.begin();
@@ -238,6 +435,10 @@ bench_runner::run()
   barrier_a.wait_for(); // wait for all threads to start up
   timer t, t_nosync;
   barrier_b.count_down(); // bombs away!
+  volatile bool timeline_done = false;
+  thread timeline_reporter;
+  if (!timeline_file.empty())
+    timeline_reporter = thread(report_timeline, cref(workers), cref(timeline_done));
   if (run_mode == RUNMODE_TIME) {
     sleep(runtime);
     running = false;
@@ -245,17 +446,20 @@ bench_runner::run()
   __sync_synchronize();
   for (size_t i = 0; i < nthreads; i++)
     workers[i]->join();
+  timeline_done = true;
+  if (timeline_reporter.joinable())
+    timeline_reporter.join();
   const unsigned long elapsed_nosync = t_nosync.lap();
   db->do_txn_finish(); // waits for all worker txns to persist
   size_t n_commits = 0;
   size_t n_aborts = 0;
   uint64_t latency_numer_us = 0;
-  tdigest::TDigest tdigest;
+  latency_histogram latencies;
   for (size_t i = 0; i < nthreads; i++) {
     n_commits += workers[i]->get_ntxn_commits();
     n_aborts += workers[i]->get_ntxn_aborts();
     latency_numer_us += workers[i]->get_latency_numer_us();
-    tdigest.merge(&workers[i]->get_tdigest());
+    latencies.merge(workers[i]->get_latencies());
   }
   const auto persisted_info = db->get_ntxn_persisted();
 
@@ -292,7 +496,13 @@ bench_runner::run()
   const double avg_persist_latency_ms =
     get<2>(persisted_info) / 1000.0;
 
+  std::unique_lock<std::mutex> report_guard;
+  if (tenants)
+    report_guard = std::unique_lock<std::mutex>(tenants->report_lock);
+
   if (verbose) {
+    if (tenants)
+      cerr << "--- tenant " << tenant_group::current() << " ---" << endl;
     const pair<uint64_t, uint64_t> mem_info_after = get_system_memory_info();
     const int64_t delta = int64_t(mem_info_before.first) - int64_t(mem_info_after.first); // free mem
     const double delta_mb = double(delta)/1048576.0;
@@ -333,11 +543,17 @@ bench_runner::run()
     cerr << "runtime: " << elapsed_sec << " sec" << endl;
     cerr << "memory delta: " << delta_mb  << " MB" << endl;
     cerr << "memory delta rate: " << (delta_mb / elapsed_sec)  << " MB/sec" << endl;
+    cerr << "rcu deferred: " << (double(rcu::s_instance.deferred_bytes()) / 1048576.0)
+         << " MB (peak " << (double(rcu::s_instance.peak_deferred_bytes()) / 1048576.0)
+         << " MB)" << endl;
     cerr << "logical memory delta: " << size_delta_mb << " MB" << endl;
     cerr << "logical memory delta rate: " << (size_delta_mb / elapsed_sec) << " MB/sec" << endl;
     cerr << "agg_nosync_throughput: " << agg_nosync_throughput << " ops/sec" << endl;
     cerr << "avg_nosync_per_core_throughput: " << avg_nosync_per_core_throughput << " ops/sec/core" << endl;
     cerr << "agg_throughput: " << agg_throughput << " ops/sec" << endl;
+    // below the offered load, the workers fell behind the schedule
+    if (arrival_rate > 0.0)
+      cerr << "offered_load: " << arrival_rate * workers.size() << " ops/sec" << endl;
     cerr << "avg_per_core_throughput: " << avg_per_core_throughput << " ops/sec/core" << endl;
     cerr << "agg_persist_throughput: " << agg_persist_throughput << " ops/sec" << endl;
     cerr << "avg_per_core_persist_throughput: " << avg_per_core_persist_throughput << " ops/sec/core" << endl;
@@ -345,11 +561,31 @@ bench_runner::run()
     cerr << "avg_persist_latency: " << avg_persist_latency_ms << " ms" << endl;
     cerr << "agg_abort_rate: " << agg_abort_rate << " aborts/sec" << endl;
     cerr << "avg_per_core_abort_rate: " << avg_per_core_abort_rate << " aborts/sec/core" << endl;
-    cerr << "p50_latency: " << tdigest.quantile(0.50) << " ns" << endl;
-    cerr << "p90_latency: " << tdigest.quantile(0.90) << " ns" << endl;
-    cerr << "p95_latency: " << tdigest.quantile(0.95) << " ns" << endl;
-    cerr << "p99_latency: " << tdigest.quantile(0.99) << " ns" << endl;
+    cerr << "p50_latency: " << latencies.quantile(0.50) << " ns" << endl;
+    cerr << "p90_latency: " << latencies.quantile(0.90) << " ns" << endl;
+    cerr << "p95_latency: " << latencies.quantile(0.95) << " ns" << endl;
+    cerr << "p99_latency: " << latencies.quantile(0.99) << " ns" << endl;
     cerr << "txn breakdown: " << format_list(agg_txn_counts.begin(), agg_txn_counts.end()) << endl;
+    // a phase spans from its first worker entering to its last one leaving
+    size_t nphases = 0;
+    for (size_t i = 0; i < workers.size(); i++)
+      nphases = max(nphases, workers[i]->get_phase_stats().size());
+    for (size_t p = 0; nphases > 1 && p < nphases; p++) {
+      size_t phase_commits = 0;
+      uint64_t start_us = numeric_limits<uint64_t>::max(), end_us = 0;
+      for (size_t i = 0; i < workers.size(); i++) {
+        const auto &stats = workers[i]->get_phase_stats();
+        if (p >= stats.size())
+          continue;
+        phase_commits += stats[p].ntxn_commits;
+        start_us = min(start_us, stats[p].start_us);
+        end_us = max(end_us, stats[p].end_us);
+      }
+      const double phase_sec = double(end_us - start_us) / 1000000.0;
+      cerr << "phase " << p << ": " << phase_sec << " sec "
+           << (phase_sec > 0.0 ? double(phase_commits) / phase_sec : 0.0)
+           << " ops/sec" << endl;
+    }
     cerr << "--- system counters (for benchmark) ---" << endl;
     for (map<string, counter_data>::iterator it = ctrs.begin();
          it != ctrs.end(); ++it)
@@ -371,7 +607,9 @@ bench_runner::run()
 #endif
   }
 
-  // output for plotting script
+  // output for plotting script, prefixed with the tenant
+  if (tenants)
+    cout << tenant_group::current() << " ";
   cout << agg_throughput << " "
        << agg_persist_throughput << " "
        << avg_latency_ms << " "
@@ -382,6 +620,12 @@ bench_runner::run()
   if (!slow_exit)
     return;
 
+  {
+    ::lock_guard<spinlock> l(g_footprint_lock);
+    for (auto &p : open_tables)
+      g_footprint_tables.erase(p.first);
+  }
+
   map<string, uint64_t> agg_stats;
   for (map<string, abstract_ordered_index *>::iterator it = open_tables.begin();
        it != open_tables.end(); ++it) {
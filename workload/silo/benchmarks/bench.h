@@ -3,7 +3,9 @@
 
 #include <stdint.h>
 
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <utility>
 #include <string>
@@ -14,7 +16,7 @@
 #include "../util.h"
 #include "../spinbarrier.h"
 #include "../rcu.h"
-#include "TDigest.h"
+#include "latency_histogram.h"
 
 extern void ycsb_do_test(abstract_db *db, int argc, char **argv);
 extern void tpcc_do_test(abstract_db *db, int argc, char **argv);
@@ -27,6 +29,12 @@ enum {
   RUNMODE_OPS  = 1
 };
 
+// how the open-loop workers space their transactions, see arrival_rate
+enum {
+  ARRIVAL_CONSTANT = 0,
+  ARRIVAL_POISSON  = 1
+};
+
 // benchmark global variables
 extern size_t nthreads;
 extern volatile bool running;
@@ -42,6 +50,51 @@ extern int slow_exit;
 extern int retry_aborted_transaction;
 extern int no_reset_counters;
 extern int backoff_aborted_transaction;
+extern double arrival_rate; // txns/sec per worker, 0 runs closed-loop
+extern int arrival_dist;
+extern std::string timeline_file;
+extern uint64_t timeline_interval_ms;
+extern std::string db_image_save;
+extern std::string db_image_load;
+
+// multi-tenant runs, see --tenant in dbtest.cc: every tenant runs its own
+// benchmark against its own abstract_db from a thread of its own. the
+// benchmarks parse their options with getopt and share the globals above, so
+// the tenants set up and load one at a time, then all of them start running
+// together and report one after the other
+class tenant_group {
+public:
+  tenant_group(size_t ntenants) : nloading_(ntenants) {}
+
+  tenant_group(const tenant_group &) = delete;
+  tenant_group &operator=(const tenant_group &) = delete;
+
+  // called from the thread of a tenant before it starts its benchmark,
+  // name must outlive the run
+  void begin_setup(const std::string &name);
+
+  // called once the tenant is loaded, lets the next one set up and waits
+  // for the others
+  void wait_loaded();
+
+  // the tenant of the calling thread, empty outside of a tenant run
+  static const std::string &current();
+
+  std::mutex report_lock;
+
+private:
+  std::mutex setup_lock_;
+  std::mutex lock_;
+  std::condition_variable loaded_cv_;
+  size_t nloading_;
+};
+
+extern tenant_group *tenants; // nullptr unless --tenant is given
+
+// the bytes held by the tables of the running benchmark, by table and
+// nodes/records, plus the allocator classes and the deferred rcu frees.
+// walks every table, so expensive. empty until the data is loaded
+std::map<std::string, uint64_t> bench_footprint();
 
 class scoped_db_thread_ctx {
 public:
@@ -89,6 +142,15 @@ public:
     scoped_db_thread_ctx ctx(db, true);
     load();
   }
+
+  // loads on the calling thread instead of a thread of its own, which must
+  // already be an rcu and db thread
+  inline void
+  load_here()
+  {
+    load();
+  }
+
 protected:
   inline void *txn_buf() { return (void *) txn_obj_buf.data(); }
 
@@ -102,6 +164,17 @@ protected:
   str_arena arena;
 };
 
+// the loaded tables as a directory of record chunks, run just like the
+// loaders of the benchmark, see bench_image.cc
+std::vector<bench_loader *>
+make_db_image_savers(abstract_db *db,
+                     const std::map<std::string, abstract_ordered_index *> &open_tables,
+                     const std::string &dir, size_t nchunks);
+std::vector<bench_loader *>
+make_db_image_loaders(abstract_db *db,
+                      const std::map<std::string, abstract_ordered_index *> &open_tables,
+                      const std::string &dir);
+
 class bench_worker : public ndb_thread {
 public:
 
@@ -111,13 +184,15 @@ public:
                const std::map<std::string, abstract_ordered_index *> &open_tables,
                spin_barrier *barrier_a, spin_barrier *barrier_b)
     : worker_id(worker_id), set_core_id(set_core_id),
-      r(seed), db(db), open_tables(open_tables),
+      r(seed), arrival_r(seed ^ 0x5deece66dUL),
+      db(db), open_tables(open_tables),
       barrier_a(barrier_a), barrier_b(barrier_b),
       // the ntxn_* numbers are per worker
       ntxn_commits(0), ntxn_aborts(0),
       latency_numer_us(0),
-      tdigest(),
+      latencies(),
       backoff_shifts(0), // spin between [0, 2^backoff_shifts) times before retry
+      phase(0),
       size_delta(0)
   {
     txn_obj_buf.reserve(str_arena::MinStrReserveLength);
@@ -148,7 +223,8 @@ public:
   virtual void run();
 
   inline size_t get_ntxn_commits() const { return ntxn_commits; }
-  inline size_t get_ntxn_aborts() const { return ntxn_aborts; }
+  // also read by the timeline reporter while running
+  inline size_t get_ntxn_aborts() const { return __atomic_load_n(&ntxn_aborts, __ATOMIC_RELAXED); }
 
   inline uint64_t get_latency_numer_us() const { return latency_numer_us; }
 
@@ -158,14 +234,28 @@ public:
     return double(latency_numer_us) / double(ntxn_commits);
   }
 
-  inline tdigest::TDigest const&
-  get_tdigest()
+  // commit latencies in ns, safe to read while running
+  inline const latency_histogram &
+  get_latencies() const
   {
-    return tdigest;
+    return latencies;
   }
 
   std::map<std::string, size_t> get_txn_counts() const;
 
+  // commits and wall time of the worker in one phase of the run, see
+  // set_phase()
+  struct phase_stat {
+    size_t ntxn_commits;
+    uint64_t start_us;
+    uint64_t end_us;
+  };
+  inline const std::vector<phase_stat> &
+  get_phase_stats() const
+  {
+    return phase_stats;
+  }
+
   typedef abstract_db::counter_map counter_map;
   typedef abstract_db::txn_counter_map txn_counter_map;
 
@@ -185,9 +275,16 @@ protected:
 
   inline void *txn_buf() { return (void *) txn_obj_buf.data(); }
 
+  // the following commits count towards the given phase, phases only move
+  // forward. workloads with a schedule (e.g. a moving hot set) call this so
+  // the runner can report the throughput of each phase
+  void set_phase(size_t phase);
+
   unsigned int worker_id;
   bool set_core_id;
   util::fast_random r;
+  // kept apart from r so that the schedule does not change the txns drawn
+  util::fast_random arrival_r;
   abstract_db *const db;
   std::map<std::string, abstract_ordered_index *> open_tables;
   spin_barrier *const barrier_a;
@@ -197,11 +294,16 @@ private:
   size_t ntxn_commits;
   size_t ntxn_aborts;
   uint64_t latency_numer_us;
-  tdigest::TDigest tdigest;
+  latency_histogram latencies;
   unsigned backoff_shifts;
+  std::vector<phase_stat> phase_stats;
+
+  uint64_t next_arrival_gap_ns(double mean_gap_ns);
 
 protected:
 
+  size_t phase;
+
 #ifdef ENABLE_BENCH_TXN_COUNTERS
   txn_counter_map local_txn_counters;
   void measure_txn_counters(void *txn, const char *txn_name);
@@ -0,0 +1,278 @@
+#include <iostream>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+using namespace std;
+using namespace util;
+
+// an image is a directory holding a MANIFEST, with the number of chunks on
+// the first line and one table per line after, and the chunk files
+// <table>.<chunk>. each table is cut into nchunks key ranges of about the
+// same number of records, so that the chunks can be loaded in parallel
+//
+// the records are saved as logical key/value pairs rather than as the
+// in-memory trees: the loader rebuilds the indexes with plain inserts, which
+// skips generating the data but still places every tuple and node in the
+// arena of the thread inserting it
+
+static const char *const ManifestName = "MANIFEST";
+
+// records per transaction, both when scanning and when inserting
+static const size_t ImageBatchSize = 512;
+
+static inline string
+chunk_path(const string &dir, const string &table, size_t chunk)
+{
+  return dir + "/" + table + "." + to_string(chunk);
+}
+
+// the tables by unique index, tpcc maps the same index under many names
+static vector<pair<string, abstract_ordered_index *>>
+unique_tables(const map<string, abstract_ordered_index *> &open_tables)
+{
+  vector<pair<string, abstract_ordered_index *>> ret;
+  set<abstract_ordered_index *> seen;
+  for (auto &p : open_tables)
+    if (seen.insert(p.second).second)
+      ret.emplace_back(p.first, p.second);
+  return ret;
+}
+
+class db_image_saver : public bench_loader {
+public:
+  db_image_saver(abstract_db *db,
+                 const map<string, abstract_ordered_index *> &open_tables,
+                 const string &dir, const string &table,
+                 abstract_ordered_index *idx, size_t nchunks)
+    : bench_loader(0, db, open_tables),
+      dir(dir), table(table), idx(idx), nchunks(nchunks)
+  {}
+
+protected:
+  struct batch_callback : public abstract_ordered_index::scan_callback {
+    vector<pair<string, string>> records;
+    virtual bool
+    invoke(const char *keyp, size_t keylen, const string &value)
+    {
+      records.emplace_back(string(keyp, keylen), value);
+      return records.size() < ImageBatchSize;
+    }
+  };
+
+  virtual void
+  load()
+  {
+    // only an estimate, the last chunk takes whatever is left
+    const size_t per_chunk = max<size_t>(1, idx->size() / nchunks);
+    size_t chunk = 0, nrecords = 0, nbytes = 0;
+    FILE *f = open_chunk(chunk);
+    string start;
+    for (;;) {
+      batch_callback c;
+      scoped_str_arena s_arena(arena);
+      void * const txn = db->new_txn(txn_flags, arena, txn_buf());
+      try {
+        idx->scan(txn, start, nullptr, c, s_arena.get());
+        ALWAYS_ASSERT(db->commit_txn(txn));
+      } catch (abstract_db::abstract_abort_exception &ex) {
+        // nothing else is running
+        ALWAYS_ASSERT(false);
+      }
+      for (auto &r : c.records) {
+        if (nrecords >= (chunk + 1) * per_chunk && chunk + 1 < nchunks) {
+          ALWAYS_ASSERT(!fclose(f));
+          f = open_chunk(++chunk);
+        }
+        const uint32_t lens[2] = {uint32_t(r.first.size()),
+                                  uint32_t(r.second.size())};
+        ALWAYS_ASSERT(fwrite(lens, sizeof(lens), 1, f) == 1);
+        ALWAYS_ASSERT(fwrite(r.first.data(), r.first.size(), 1, f) == 1);
+        if (!r.second.empty())
+          ALWAYS_ASSERT(fwrite(r.second.data(), r.second.size(), 1, f) == 1);
+        nrecords++;
+        nbytes += sizeof(lens) + r.first.size() + r.second.size();
+      }
+      if (c.records.size() < ImageBatchSize)
+        break;
+      // the smallest key after the last one
+      start = c.records.back().first;
+      start.push_back('\0');
+    }
+    ALWAYS_ASSERT(!fclose(f));
+    // the remaining chunks exist but are empty
+    while (++chunk < nchunks)
+      ALWAYS_ASSERT(!fclose(open_chunk(chunk)));
+    if (verbose)
+      cerr << "[INFO] saved " << table << ": " << nrecords << " records, "
+           << nbytes << " bytes" << endl;
+  }
+
+private:
+  FILE *
+  open_chunk(size_t chunk)
+  {
+    const string path = chunk_path(dir, table, chunk);
+    FILE * const f = fopen(path.c_str(), "w");
+    if (!f) {
+      cerr << "[ERROR] cannot create " << path << ": " << strerror(errno) << endl;
+      ALWAYS_ASSERT(false);
+    }
+    return f;
+  }
+
+  const string dir;
+  const string table;
+  abstract_ordered_index *const idx;
+  const size_t nchunks;
+};
+
+class db_image_loader : public bench_loader {
+public:
+  db_image_loader(abstract_db *db,
+                  const map<string, abstract_ordered_index *> &open_tables,
+                  const string &dir,
+                  const vector<pair<string, abstract_ordered_index *>> &tables,
+                  size_t nchunks, size_t id)
+    : bench_loader(0, db, open_tables),
+      dir(dir), tables(tables), nchunks(nchunks), id(id)
+  {}
+
+protected:
+  virtual void
+  load()
+  {
+    // chunk i holds about the i-th key range, which is where the worker of
+    // partition i mostly lives (keys start with the warehouse in tpcc)
+    if (pin_cpus) {
+      rcu::s_instance.pin_current_thread(id % nthreads);
+      rcu::s_instance.fault_region();
+    }
+    size_t nrecords = 0;
+    for (size_t chunk = id; chunk < nchunks; chunk += nthreads)
+      for (auto &t : tables)
+        nrecords += load_chunk(t.second, chunk_path(dir, t.first, chunk));
+    if (verbose)
+      cerr << "[INFO] image loader " << id << " finished: "
+           << nrecords << " records" << endl;
+  }
+
+private:
+  size_t
+  load_chunk(abstract_ordered_index *idx, const string &path)
+  {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      cerr << "[ERROR] cannot open " << path << ": " << strerror(errno) << endl;
+      ALWAYS_ASSERT(false);
+    }
+    struct stat st;
+    ALWAYS_ASSERT(!fstat(fd, &st));
+    const size_t sz = st.st_size;
+    if (!sz) {
+      close(fd);
+      return 0;
+    }
+    const char * const base = (const char *) mmap(
+        nullptr, sz, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ALWAYS_ASSERT(base != MAP_FAILED);
+    close(fd);
+    madvise((void *) base, sz, MADV_SEQUENTIAL);
+
+    size_t off = 0, n = 0;
+    while (off < sz) {
+      scoped_str_arena s_arena(arena);
+      void * const txn = db->new_txn(txn_flags, arena, txn_buf());
+      try {
+        for (size_t i = 0; i < ImageBatchSize && off < sz; i++, n++) {
+          uint32_t lens[2];
+          ALWAYS_ASSERT(off + sizeof(lens) <= sz);
+          memcpy(lens, base + off, sizeof(lens));
+          off += sizeof(lens);
+          ALWAYS_ASSERT(off + lens[0] + lens[1] <= sz);
+          idx->insert(txn, string(base + off, lens[0]),
+                      string(base + off + lens[0], lens[1]));
+          off += lens[0] + lens[1];
+        }
+        ALWAYS_ASSERT(db->commit_txn(txn));
+      } catch (abstract_db::abstract_abort_exception &ex) {
+        // the chunks are disjoint, nothing should conflict
+        ALWAYS_ASSERT(false);
+      }
+    }
+    munmap((void *) base, sz);
+    return n;
+  }
+
+  const string dir;
+  const vector<pair<string, abstract_ordered_index *>> tables;
+  const size_t nchunks;
+  const size_t id;
+};
+
+vector<bench_loader *>
+make_db_image_savers(abstract_db *db,
+                     const map<string, abstract_ordered_index *> &open_tables,
+                     const string &dir, size_t nchunks)
+{
+  if (mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+    cerr << "[ERROR] cannot create " << dir << ": " << strerror(errno) << endl;
+    ALWAYS_ASSERT(false);
+  }
+  const auto tables = unique_tables(open_tables);
+  ofstream manifest(dir + "/" + ManifestName);
+  manifest << nchunks << endl;
+  for (auto &t : tables)
+    manifest << t.first << endl;
+  ALWAYS_ASSERT(manifest.good());
+
+  vector<bench_loader *> ret;
+  for (auto &t : tables)
+    ret.push_back(
+        new db_image_saver(db, open_tables, dir, t.first, t.second, nchunks));
+  return ret;
+}
+
+vector<bench_loader *>
+make_db_image_loaders(abstract_db *db,
+                      const map<string, abstract_ordered_index *> &open_tables,
+                      const string &dir)
+{
+  ifstream manifest(dir + "/" + ManifestName);
+  if (!manifest) {
+    cerr << "[ERROR] " << dir << " is not a database image" << endl;
+    ALWAYS_ASSERT(false);
+  }
+  size_t nchunks = 0;
+  manifest >> nchunks;
+  ALWAYS_ASSERT(nchunks > 0);
+  vector<pair<string, abstract_ordered_index *>> tables;
+  string name;
+  while (manifest >> name) {
+    auto it = open_tables.find(name);
+    if (it == open_tables.end()) {
+      cerr << "[ERROR] image table " << name
+           << " does not exist in this benchmark" << endl;
+      ALWAYS_ASSERT(false);
+    }
+    tables.emplace_back(name, it->second);
+  }
+  ALWAYS_ASSERT(tables.size() == unique_tables(open_tables).size());
+
+  vector<bench_loader *> ret;
+  for (size_t i = 0; i < min(nthreads, nchunks); i++)
+    ret.push_back(
+        new db_image_loader(db, open_tables, dir, tables, nchunks, i));
+  return ret;
+}
@@ -5,6 +5,7 @@
 #include <utility>
 #include <string>
 #include <set>
+#include <thread>
 
 #include <getopt.h>
 #include <stdlib.h>
@@ -37,6 +38,42 @@ split_ws(const string &s)
   return r;
 }
 
+typedef void (*test_fn_t)(abstract_db *, int argc, char **argv);
+
+static test_fn_t
+bench_test_fn(const string &bench_type)
+{
+  if (bench_type == "ycsb")
+    return ycsb_do_test;
+  else if (bench_type == "tpcc")
+    return tpcc_do_test;
+  else if (bench_type == "queue")
+    return queue_do_test;
+  else if (bench_type == "encstress")
+    return encstress_do_test;
+  else if (bench_type == "bid")
+    return bid_do_test;
+  return nullptr;
+}
+
+// argv for the benchmark, pointing into toks
+static vector<char *>
+bench_argv(const string &bench_type, vector<string> &toks)
+{
+  vector<char *> argv;
+  argv.push_back((char *) bench_type.c_str());
+  for (auto &t : toks)
+    argv.push_back((char *) t.c_str());
+  return argv;
+}
+
+// a --tenant, name:bench[:bench-opts]
+struct tenant_spec {
+  string name;
+  string bench_type;
+  string bench_opts;
+};
+
 static size_t
 parse_memory_spec(const string &s)
 {
@@ -59,7 +96,7 @@ int
 main(int argc, char **argv)
 {
   abstract_db *db = NULL;
-  void (*test_fn)(abstract_db *, int argc, char **argv) = NULL;
+  test_fn_t test_fn = NULL;
   string bench_type = "ycsb";
   string db_type = "ndb-proto2";
   char *curdir = get_current_dir_name();
@@ -68,14 +105,27 @@ main(int argc, char **argv)
   size_t numa_memory = 0;
   free(curdir);
   int saw_run_spec = 0;
+  int saw_arrival_dist = 0;
   int nofsync = 0;
   int do_compress = 0;
   int fake_writes = 0;
+  int log_io_uring = 0;
+  int log_pin_numa = 0;
   int disable_gc = 0;
   int disable_snapshots = 0;
+  int cold_versions = 0;
+  int prefault_arenas = 0;
+  bool placed_versions = false;
   vector<string> logfiles;
   vector<vector<unsigned>> assignments;
+  vector<string> compressed_tables;
   string stats_server_sockfile;
+  string alloc_placement;
+  uint64_t tick_us = ticker::tick_us;
+  size_t rcu_max_deferred = 0;
+  uint64_t footprint_interval_ms = 0;
+  uint64_t abort_sample_period = 0;
+  vector<tenant_spec> tenant_specs;
   while (1) {
     static struct option long_options[] =
     {
@@ -95,19 +145,36 @@ main(int argc, char **argv)
       {"ops-per-worker"             , required_argument , 0                          , 'n'} ,
       {"bench-opts"                 , required_argument , 0                          , 'o'} ,
       {"numa-memory"                , required_argument , 0                          , 'm'} , // implies --pin-cpus
+      {"alloc-placement"            , required_argument , 0                          , 'P'} , // class=placement,...
+      {"cold-versions"              , no_argument       , &cold_versions             , 1}   , // version=far
+      {"prefault-arenas"            , no_argument       , &prefault_arenas           , 1}   ,
       {"logfile"                    , required_argument , 0                          , 'l'} ,
       {"assignment"                 , required_argument , 0                          , 'a'} ,
       {"log-nofsync"                , no_argument       , &nofsync                   , 1}   ,
       {"log-compress"               , no_argument       , &do_compress               , 1}   ,
       {"log-fake-writes"            , no_argument       , &fake_writes               , 1}   ,
+      {"log-io-uring"               , no_argument       , &log_io_uring              , 1}   ,
+      {"log-pin-numa"               , no_argument       , &log_pin_numa              , 1}   ,
       {"disable-gc"                 , no_argument       , &disable_gc                , 1}   ,
       {"disable-snapshots"          , no_argument       , &disable_snapshots         , 1}   ,
       {"stats-server-sockfile"      , required_argument , 0                          , 'x'} ,
       {"no-reset-counters"          , no_argument       , &no_reset_counters         , 1}   ,
+      {"timeline"                   , required_argument , 0                          , 'T'} ,
+      {"timeline-interval-ms"       , required_argument , 0                          , 'I'} ,
+      {"db-image-save"              , required_argument , 0                          , 'S'} ,
+      {"db-image-load"              , required_argument , 0                          , 'L'} ,
+      {"tick-us"                    , required_argument , 0                          , 'k'} ,
+      {"rcu-max-deferred"           , required_argument , 0                          , 'D'} , // per thread
+      {"footprint-interval-ms"      , required_argument , 0                          , 'F'} , // needs the stats server
+      {"abort-sample-period"        , required_argument , 0                          , 'E'} , // needs the stats server
+      {"arrival-rate"               , required_argument , 0                          , 'R'} , // txns/sec per worker, open-loop
+      {"arrival-dist"               , required_argument , 0                          , 'A'} , // constant|poisson
+      {"tenant"                     , required_argument , 0                          , 'N'} , // name:bench[:bench-opts], repeatable
+      {"value-compress"             , required_argument , 0                          , 'C'} , // table,... or all
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:l:a:x:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:P:l:a:x:T:I:S:L:k:D:F:E:R:A:N:C:", long_options, &option_index);
     if (c == -1)
       break;
 
@@ -158,6 +225,7 @@ main(int argc, char **argv)
       ops_per_worker = strtoul(optarg, NULL, 10);
       ALWAYS_ASSERT(ops_per_worker > 0);
       run_mode = RUNMODE_OPS;
+      break;
 
     case 'o':
       bench_opts = optarg;
@@ -172,6 +240,25 @@ main(int argc, char **argv)
       }
       break;
 
+    case 'P':
+      alloc_placement = optarg;
+      for (auto &tok : split(alloc_placement, ',')) {
+        const size_t eq = tok.find('=');
+        size_t cls = 0;
+        while (cls < ::allocator::NClasses &&
+               tok.substr(0, eq) != ::allocator::ClassName(::allocator::AllocClass(cls)))
+          cls++;
+        ::allocator::Placement p;
+        if (eq == string::npos || cls == ::allocator::NClasses ||
+            !::allocator::ParsePlacement(tok.substr(eq + 1), p)) {
+          cerr << "[ERROR] bad --alloc-placement entry: " << tok << endl;
+          return 1;
+        }
+        ::allocator::SetPlacement(::allocator::AllocClass(cls), p);
+        placed_versions |= cls == ::allocator::ClassVersion;
+      }
+      break;
+
     case 'l':
       logfiles.emplace_back(optarg);
       break;
@@ -185,6 +272,92 @@ main(int argc, char **argv)
       stats_server_sockfile = optarg;
       break;
 
+    case 'T':
+      timeline_file = optarg;
+      break;
+
+    case 'I':
+      timeline_interval_ms = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(timeline_interval_ms > 0);
+      break;
+
+    case 'S':
+      db_image_save = optarg;
+      break;
+
+    case 'L':
+      db_image_load = optarg;
+      break;
+
+    case 'k':
+      tick_us = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(tick_us > 0);
+      ticker::SetTickPeriod(tick_us);
+      break;
+
+    case 'F':
+      footprint_interval_ms = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(footprint_interval_ms > 0);
+      break;
+
+    case 'E':
+      abort_sample_period = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(abort_sample_period > 0);
+      transaction_base::SetAbortSamplePeriod(abort_sample_period);
+      break;
+
+    case 'D':
+      rcu_max_deferred = parse_memory_spec(optarg);
+      ALWAYS_ASSERT(rcu_max_deferred > 0);
+      rcu::SetMaxDeferredBytes(rcu_max_deferred);
+      break;
+
+    case 'R':
+      arrival_rate = strtod(optarg, NULL);
+      ALWAYS_ASSERT(arrival_rate > 0.0);
+      break;
+
+    case 'A':
+      if (!strcmp(optarg, "constant"))
+        arrival_dist = ARRIVAL_CONSTANT;
+      else if (!strcmp(optarg, "poisson"))
+        arrival_dist = ARRIVAL_POISSON;
+      else {
+        cerr << "[ERROR] bad --arrival-dist: " << optarg << endl;
+        return 1;
+      }
+      saw_arrival_dist = 1;
+      break;
+
+    case 'N':
+      {
+        const string spec = optarg;
+        const size_t c0 = spec.find(':');
+        const size_t c1 = c0 == string::npos ? c0 : spec.find(':', c0 + 1);
+        tenant_spec t;
+        t.name = spec.substr(0, c0);
+        if (c0 != string::npos)
+          t.bench_type = spec.substr(c0 + 1, c1 == string::npos ? c1 : c1 - c0 - 1);
+        if (c1 != string::npos)
+          t.bench_opts = spec.substr(c1 + 1);
+        if (t.name.empty() || !bench_test_fn(t.bench_type)) {
+          cerr << "[ERROR] bad --tenant: " << spec << endl;
+          return 1;
+        }
+        tenant_specs.push_back(t);
+      }
+      break;
+
+    case 'C':
+      for (auto &tok : split(optarg, ',')) {
+        if (tok.empty()) {
+          cerr << "[ERROR] bad --value-compress: " << optarg << endl;
+          return 1;
+        }
+        compressed_tables.push_back(tok);
+      }
+      break;
+
     case '?':
       /* getopt_long already printed an error message. */
       exit(1);
@@ -194,18 +367,37 @@ main(int argc, char **argv)
     }
   }
 
-  if (bench_type == "ycsb")
-    test_fn = ycsb_do_test;
-  else if (bench_type == "tpcc")
-    test_fn = tpcc_do_test;
-  else if (bench_type == "queue")
-    test_fn = queue_do_test;
-  else if (bench_type == "encstress")
-    test_fn = encstress_do_test;
-  else if (bench_type == "bid")
-    test_fn = bid_do_test;
-  else
-    ALWAYS_ASSERT(false);
+  test_fn = bench_test_fn(bench_type);
+  ALWAYS_ASSERT(test_fn);
+
+  if (!tenant_specs.empty()) {
+    // the benchmarks keep their options in file statics, and the logger
+    // and the images are global
+    set<string> names, benches;
+    for (auto &t : tenant_specs) {
+      if (!names.insert(t.name).second) {
+        cerr << "[ERROR] --tenant " << t.name << " given twice" << endl;
+        return 1;
+      }
+      if (!benches.insert(t.bench_type).second) {
+        cerr << "[ERROR] benchmark " << t.bench_type
+             << " is used by more than one --tenant" << endl;
+        return 1;
+      }
+    }
+    if (!bench_opts.empty()) {
+      cerr << "[ERROR] --bench-opts specified with --tenant, pass them in the tenant spec" << endl;
+      return 1;
+    }
+    if (!logfiles.empty()) {
+      cerr << "[ERROR] --tenant does not support logging" << endl;
+      return 1;
+    }
+    if (!db_image_save.empty() || !db_image_load.empty()) {
+      cerr << "[ERROR] --tenant does not support database images" << endl;
+      return 1;
+    }
+  }
 
   if (do_compress && logfiles.empty()) {
     cerr << "[ERROR] --log-compress specified without logging enabled" << endl;
@@ -226,18 +418,76 @@ main(int argc, char **argv)
     cerr << "[WARNING] --log-nofsync has no effect with --log-fake-writes enabled" << endl;
   }
 
+  if (log_io_uring && logfiles.empty()) {
+    cerr << "[ERROR] --log-io-uring specified without logging enabled" << endl;
+    return 1;
+  }
+
+  if (log_io_uring && fake_writes) {
+    cerr << "[WARNING] --log-io-uring has no effect with --log-fake-writes enabled" << endl;
+  }
+
+  if (log_pin_numa && logfiles.empty()) {
+    cerr << "[ERROR] --log-pin-numa specified without logging enabled" << endl;
+    return 1;
+  }
+
+  if (log_pin_numa && !pin_cpus) {
+    cerr << "[WARNING] --log-pin-numa assumes the workers are pinned, see --pin-cpus" << endl;
+  }
+
+  if (saw_arrival_dist && arrival_rate == 0.0) {
+    cerr << "[ERROR] --arrival-dist specified without --arrival-rate" << endl;
+    return 1;
+  }
+
+  if (footprint_interval_ms && stats_server_sockfile.empty()) {
+    cerr << "[ERROR] --footprint-interval-ms specified without --stats-server-sockfile" << endl;
+    return 1;
+  }
+
+  if (abort_sample_period && stats_server_sockfile.empty()) {
+    cerr << "[ERROR] --abort-sample-period specified without --stats-server-sockfile" << endl;
+    return 1;
+  }
+
 #ifndef ENABLE_EVENT_COUNTERS
-  if (!stats_server_sockfile.empty()) {
+  if (!stats_server_sockfile.empty() && !footprint_interval_ms &&
+      !abort_sample_period) {
     cerr << "[WARNING] --stats-server-sockfile with no event counters enabled is useless" << endl;
   }
 #endif
 
-  // initialize the numa allocator
+  if (!alloc_placement.empty() && !numa_memory) {
+    cerr << "[ERROR] --alloc-placement specified without --numa-memory" << endl;
+    return 1;
+  }
+
+  if (cold_versions && !numa_memory) {
+    cerr << "[ERROR] --cold-versions specified without --numa-memory" << endl;
+    return 1;
+  }
+
+  if (prefault_arenas && !numa_memory) {
+    cerr << "[ERROR] --prefault-arenas specified without --numa-memory" << endl;
+    return 1;
+  }
+
+  // the spilled old versions get hugepages of their own, away from the
+  // latest versions, and an explicit --alloc-placement wins
+  if (cold_versions && !placed_versions)
+    ::allocator::SetPlacement(::allocator::ClassVersion, ::allocator::PlacementFar);
+
+  // initialize the numa allocator, every tenant runs nthreads workers
   if (numa_memory > 0) {
+    const size_t ncores = nthreads * max<size_t>(1, tenant_specs.size());
     const size_t maxpercpu = util::iceil(
-        numa_memory / nthreads, ::allocator::GetHugepageSize());
-    numa_memory = maxpercpu * nthreads;
-    ::allocator::Initialize(nthreads, maxpercpu);
+        numa_memory / ncores, ::allocator::GetHugepageSize());
+    numa_memory = maxpercpu * ncores;
+    ::allocator::Initialize(ncores, maxpercpu);
+    // otherwise each loader faults its region on its own, see fault_region()
+    if (prefault_arenas)
+      ::allocator::FaultRegions();
   }
 
   const set<string> can_persist({"ndb-proto2"});
@@ -261,6 +511,13 @@ main(int argc, char **argv)
   }
 #endif
 
+  const set<string> has_value_compression({"ndb-proto1", "ndb-proto2"});
+  if (!compressed_tables.empty() && !has_value_compression.count(db_type)) {
+    cerr << "[ERROR] benchmark " << db_type
+         << " does not support --value-compress" << endl;
+    return 1;
+  }
+
 #ifdef PROTO2_CAN_DISABLE_SNAPSHOTS
   const set<string> has_snapshots({"ndb-proto2"});
   if (disable_snapshots && !has_snapshots.count(db_type)) {
@@ -275,44 +532,53 @@ main(int argc, char **argv)
   }
 #endif
 
-  if (db_type == "bdb") {
-    const string cmd = "rm -rf " + basedir + "/db/*";
-    // XXX(stephentu): laziness
-    int ret UNUSED = system(cmd.c_str());
-    db = new bdb_wrapper("db", bench_type + ".db");
-  } else if (db_type == "ndb-proto1") {
-    // XXX: hacky simulation of proto1
-    db = new ndb_wrapper<transaction_proto2>(
-        logfiles, assignments, !nofsync, do_compress, fake_writes);
-    transaction_proto2_static::set_hack_status(true);
-    ALWAYS_ASSERT(transaction_proto2_static::get_hack_status());
+  // one per tenant in multi-tenant runs
+  auto make_db = [&](const string &bench_type) {
+    abstract_db *db = NULL;
+    if (db_type == "bdb") {
+      const string cmd = "rm -rf " + basedir + "/db/*";
+      // XXX(stephentu): laziness
+      int ret UNUSED = system(cmd.c_str());
+      db = new bdb_wrapper("db", bench_type + ".db");
+    } else if (db_type == "ndb-proto1") {
+      // XXX: hacky simulation of proto1
+      db = new ndb_wrapper<transaction_proto2>(
+          logfiles, assignments, !nofsync, do_compress, fake_writes,
+          log_io_uring, log_pin_numa, compressed_tables);
+      transaction_proto2_static::set_hack_status(true);
+      ALWAYS_ASSERT(transaction_proto2_static::get_hack_status());
 #ifdef PROTO2_CAN_DISABLE_GC
-    if (!disable_gc)
-      transaction_proto2_static::InitGC();
+      if (!disable_gc)
+        transaction_proto2_static::InitGC();
 #endif
-  } else if (db_type == "ndb-proto2") {
-    db = new ndb_wrapper<transaction_proto2>(
-        logfiles, assignments, !nofsync, do_compress, fake_writes);
-    ALWAYS_ASSERT(!transaction_proto2_static::get_hack_status());
+    } else if (db_type == "ndb-proto2") {
+      db = new ndb_wrapper<transaction_proto2>(
+          logfiles, assignments, !nofsync, do_compress, fake_writes,
+          log_io_uring, log_pin_numa, compressed_tables);
+      ALWAYS_ASSERT(!transaction_proto2_static::get_hack_status());
 #ifdef PROTO2_CAN_DISABLE_GC
-    if (!disable_gc)
-      transaction_proto2_static::InitGC();
+      if (!disable_gc)
+        transaction_proto2_static::InitGC();
 #endif
 #ifdef PROTO2_CAN_DISABLE_SNAPSHOTS
-    if (disable_snapshots)
-      transaction_proto2_static::DisableSnapshots();
+      if (disable_snapshots)
+        transaction_proto2_static::DisableSnapshots();
 #endif
-  } else if (db_type == "kvdb") {
-    db = new kvdb_wrapper<true>;
-  } else if (db_type == "kvdb-st") {
-    db = new kvdb_wrapper<false>;
+    } else if (db_type == "kvdb") {
+      db = new kvdb_wrapper<true>;
+    } else if (db_type == "kvdb-st") {
+      db = new kvdb_wrapper<false>;
 #if !NO_MYSQL
-  } else if (db_type == "mysql") {
-    string dbdir = basedir + "/mysql-db";
-    db = new mysql_wrapper(dbdir, bench_type);
+    } else if (db_type == "mysql") {
+      string dbdir = basedir + "/mysql-db";
+      db = new mysql_wrapper(dbdir, bench_type);
 #endif
-  } else
-    ALWAYS_ASSERT(false);
+    } else
+      ALWAYS_ASSERT(false);
+    return db;
+  };
+  if (tenant_specs.empty())
+    db = make_db(bench_type);
 
 #ifdef DEBUG
   cerr << "WARNING: benchmark built in DEBUG mode!!!" << endl;
@@ -363,6 +629,7 @@ main(int argc, char **argv)
 #endif
     if (numa_memory > 0) {
       cerr << "  numa-memory : " << numa_memory             << endl;
+      cerr << "  alloc-placement : " << alloc_placement     << endl;
     } else {
       cerr << "  numa-memory : disabled"                    << endl;
     }
@@ -370,7 +637,29 @@ main(int argc, char **argv)
     cerr << "  assignments : " << assignments               << endl;
     cerr << "  disable-gc : " << disable_gc                 << endl;
     cerr << "  disable-snapshots : " << disable_snapshots   << endl;
+    cerr << "  cold-versions : " << cold_versions           << endl;
+    cerr << "  prefault-arenas : " << prefault_arenas       << endl;
+    cerr << "  value-compress : " << compressed_tables      << endl;
+    cerr << "  tick-us : " << tick_us                       << endl;
+    cerr << "  rcu-max-deferred : " << rcu_max_deferred     << endl;
     cerr << "  stats-server-sockfile: " << stats_server_sockfile << endl;
+    cerr << "  footprint-interval-ms: " << footprint_interval_ms << endl;
+    cerr << "  abort-sample-period: " << abort_sample_period << endl;
+    if (arrival_rate > 0.0)
+      cerr << "  arrival : " << arrival_rate << " txns/sec/worker, "
+           << (arrival_dist == ARRIVAL_CONSTANT ? "constant" : "poisson") << endl;
+    else
+      cerr << "  arrival : closed-loop"                     << endl;
+    if (!timeline_file.empty())
+      cerr << "  timeline : " << timeline_file << " every "
+           << timeline_interval_ms << " ms" << endl;
+    if (!db_image_load.empty())
+      cerr << "  db-image-load : " << db_image_load         << endl;
+    if (!db_image_save.empty())
+      cerr << "  db-image-save : " << db_image_save         << endl;
+    for (auto &t : tenant_specs)
+      cerr << "  tenant " << t.name << " : " << t.bench_type
+           << " " << t.bench_opts << endl;
 
     cerr << "system properties:" << endl;
     cerr << "  btree_internal_node_size: " << concurrent_btree::InternalNodeSize() << endl;
@@ -392,16 +681,46 @@ main(int argc, char **argv)
 
   if (!stats_server_sockfile.empty()) {
     stats_server *srvr = new stats_server(stats_server_sockfile);
+    // the footprint walks every table, the abort heatmap is cheap enough to
+    // go out every second if it is all the gauges there are
+    if (footprint_interval_ms || abort_sample_period)
+      srvr->set_gauges([footprint_interval_ms, abort_sample_period] {
+        map<string, uint64_t> ret;
+        if (footprint_interval_ms)
+          ret = bench_footprint();
+        if (abort_sample_period)
+          for (auto &p : transaction_base::AbortHeatmap())
+            ret.insert(p);
+        return ret;
+      }, footprint_interval_ms ? footprint_interval_ms : 1000);
     thread(&stats_server::serve_forever, srvr).detach();
   }
 
-  vector<string> bench_toks = split_ws(bench_opts);
-  int _argc = 1 + bench_toks.size();
-  char *_argv[_argc];
-  _argv[0] = (char *) bench_type.c_str();
-  for (size_t i = 1; i <= bench_toks.size(); i++)
-    _argv[i] = (char *) bench_toks[i - 1].c_str();
-  test_fn(db, _argc, _argv);
-  delete db;
+  if (tenant_specs.empty()) {
+    vector<string> bench_toks = split_ws(bench_opts);
+    vector<char *> _argv = bench_argv(bench_type, bench_toks);
+    test_fn(db, _argv.size(), &_argv[0]);
+    delete db;
+    return 0;
+  }
+
+  // each tenant in a thread of its own, see tenant_group
+  tenants = new tenant_group(tenant_specs.size());
+  vector<abstract_db *> dbs;
+  for (auto &t : tenant_specs)
+    dbs.push_back(make_db(t.bench_type));
+  vector<thread> tenant_threads;
+  for (size_t i = 0; i < tenant_specs.size(); i++)
+    tenant_threads.emplace_back([&tenant_specs, &dbs, i]() {
+      const tenant_spec &t = tenant_specs[i];
+      tenants->begin_setup(t.name);
+      vector<string> toks = split_ws(t.bench_opts);
+      vector<char *> argv = bench_argv(t.bench_type, toks);
+      bench_test_fn(t.bench_type)(dbs[i], argv.size(), &argv[0]);
+    });
+  for (auto &t : tenant_threads)
+    t.join();
+  for (auto d : dbs)
+    delete d;
   return 0;
 }
@@ -0,0 +1,118 @@
+#ifndef _NDB_BENCH_LATENCY_HISTOGRAM_H_
+#define _NDB_BENCH_LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../macros.h"
+
+// fixed-bucket log-linear histogram of latencies in ns, in the spirit of
+// HdrHistogram: each power of two is split into 2^SubBucketBits linear
+// sub-buckets, so a recorded value is off by less than 1/2^SubBucketBits of
+// itself (~3%).
+//
+// recording is a few shifts and a store, without allocation or locking, on
+// cache lines shared with nothing else but the histogram itself. the
+// owning worker is the only writer, readers copy the buckets racily and take
+// the difference between two snapshots for an interval, see merge_delta()
+class latency_histogram {
+public:
+  static const unsigned SubBucketBits = 5;
+  static const uint64_t SubBuckets = uint64_t(1) << SubBucketBits;
+  static const size_t NBuckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+  latency_histogram() { reset(); }
+
+  inline void
+  reset()
+  {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+  }
+
+  inline ALWAYS_INLINE void
+  record(uint64_t ns)
+  {
+    const size_t i = bucket_of(ns);
+    // single writer, the relaxed stores only keep the readers from tearing
+    __atomic_store_n(&counts[i], counts[i] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&total, total + 1, __ATOMIC_RELAXED);
+  }
+
+  inline uint64_t
+  count() const
+  {
+    return __atomic_load_n(&total, __ATOMIC_RELAXED);
+  }
+
+  void
+  merge(const latency_histogram &o)
+  {
+    for (size_t i = 0; i < NBuckets; i++)
+      counts[i] += __atomic_load_n(&o.counts[i], __ATOMIC_RELAXED);
+    total += o.count();
+  }
+
+  // adds what cur recorded since prev was taken, and brings prev up to date
+  void
+  merge_delta(const latency_histogram &cur, latency_histogram &prev)
+  {
+    uint64_t n = 0;
+    for (size_t i = 0; i < NBuckets; i++) {
+      const uint64_t c = __atomic_load_n(&cur.counts[i], __ATOMIC_RELAXED);
+      counts[i] += c - prev.counts[i];
+      n += c - prev.counts[i];
+      prev.counts[i] = c;
+    }
+    // consistent with the buckets even if cur.total moved meanwhile
+    total += n;
+    prev.total += n;
+  }
+
+  // the midpoint of the bucket holding the q-th quantile, 0 if empty
+  uint64_t
+  quantile(double q) const
+  {
+    if (!total)
+      return 0;
+    uint64_t rank = uint64_t(q * total);
+    if (rank >= total)
+      rank = total - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NBuckets; i++) {
+      seen += counts[i];
+      if (seen > rank)
+        return bucket_mid(i);
+    }
+    return bucket_mid(NBuckets - 1);
+  }
+
+private:
+  static inline ALWAYS_INLINE size_t
+  bucket_of(uint64_t v)
+  {
+    if (v < SubBuckets)
+      return v;
+    const unsigned shift = 63 - __builtin_clzll(v) - SubBucketBits;
+    return ((shift + 1) << SubBucketBits) + ((v >> shift) - SubBuckets);
+  }
+
+  static inline uint64_t
+  bucket_mid(size_t i)
+  {
+    if (i < SubBuckets)
+      return i;
+    const unsigned shift = (i >> SubBucketBits) - 1;
+    const uint64_t low = ((i & (SubBuckets - 1)) + SubBuckets) << shift;
+    return low + ((uint64_t(1) << shift) >> 1);
+  }
+
+  // padded rather than aligned, so the workers embedding it still work
+  // with the plain operator new of c++11
+  char pad0[CACHELINE_SIZE];
+  uint64_t total;
+  uint64_t counts[NBuckets];
+  char pad1[CACHELINE_SIZE];
+};
+
+#endif /* _NDB_BENCH_LATENCY_HISTOGRAM_H_ */
@@ -44,7 +44,10 @@ public:
       const std::vector<std::vector<unsigned>> &assignments_given,
       bool call_fsync,
       bool use_compression,
-      bool fake_writes);
+      bool fake_writes,
+      bool use_io_uring = false,
+      bool pin_loggers = false,
+      const std::vector<std::string> &compressed_tables = {});
 
   virtual ssize_t txn_max_batch_size() const OVERRIDE { return 100; }
 
@@ -105,6 +108,11 @@ public:
   virtual void
   close_index(abstract_ordered_index *idx);
 
+private:
+  // tables whose values are stored compressed, see is_compressed()
+  std::vector<std::string> compressed_tables;
+
+  bool is_compressed(const std::string &name) const;
 };
 
 template <template <typename> class Transaction>
@@ -115,11 +123,16 @@ protected:
     using cast = private_::cast_base<Transaction, Traits>;
 
 public:
-  ndb_ordered_index(const std::string &name, size_t value_size_hint, bool mostly_append);
+  ndb_ordered_index(const std::string &name, size_t value_size_hint,
+                    bool mostly_append, bool compress_values = false);
   virtual bool get(
       void *txn,
       const std::string &key,
       std::string &value, size_t max_bytes_read);
+  virtual bool get_u64(
+      void *txn,
+      uint64_t key,
+      std::string &value, size_t max_bytes_read);
   virtual const char * put(
       void *txn,
       const std::string &key,
@@ -128,6 +141,10 @@ public:
       void *txn,
       std::string &&key,
       std::string &&value);
+  virtual const char * put_u64(
+      void *txn,
+      uint64_t key,
+      const std::string &value);
   virtual const char *
   insert(void *txn,
          const std::string &key,
@@ -155,9 +172,18 @@ public:
       void *txn,
       std::string &&key);
   virtual size_t size() const;
+  virtual std::map<std::string, uint64_t> footprint() const;
   virtual std::map<std::string, uint64_t> clear();
 private:
+  // with compress_values the btree holds the encoded values of
+  // private_::value_codec, these translate on the way in and out
+  template <typename Txn, typename Key>
+  bool search(Txn &t, const Key &k, std::string &value, size_t max_bytes_read);
+  template <typename Txn>
+  const std::string &encode(Txn &t, const std::string &value);
+
   std::string name;
+  const bool compress_values;
   txn_btree<Transaction> btr;
 };
 
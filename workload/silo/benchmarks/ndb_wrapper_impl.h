@@ -2,6 +2,7 @@
 #define _NDB_WRAPPER_IMPL_H_
 
 #include <stdint.h>
+#include <lz4.h>
 #include "ndb_wrapper.h"
 #include "../counter.h"
 #include "../rcu.h"
@@ -42,8 +43,7 @@ struct hint_kv_scan_traits {
   typedef str_arena StringAllocator;
 };
 
-// tpcc profiles
-
+// snapshot txns track neither reads nor absent ranges
 struct hint_read_only_traits {
   static const size_t read_set_expected_size = 1;
   static const size_t write_set_expected_size = 1;
@@ -54,6 +54,10 @@ struct hint_read_only_traits {
   typedef str_arena StringAllocator;
 };
 
+struct hint_kv_scan_read_only_traits : public hint_read_only_traits {};
+
+// tpcc profiles
+
 struct hint_tpcc_new_order_traits {
   static const size_t read_set_expected_size = 35;
   static const size_t write_set_expected_size = 35;
@@ -113,6 +117,7 @@ struct hint_tpcc_stock_level_read_only_traits : public hint_read_only_traits {};
   x(abstract_db::HINT_KV_GET_PUT, hint_kv_get_put_traits) \
   x(abstract_db::HINT_KV_RMW, hint_kv_rmw_traits) \
   x(abstract_db::HINT_KV_SCAN, hint_kv_scan_traits) \
+  x(abstract_db::HINT_KV_SCAN_READ_ONLY, hint_kv_scan_read_only_traits) \
   x(abstract_db::HINT_TPCC_NEW_ORDER, hint_tpcc_new_order_traits) \
   x(abstract_db::HINT_TPCC_PAYMENT, hint_tpcc_payment_traits) \
   x(abstract_db::HINT_TPCC_DELIVERY, hint_tpcc_delivery_traits) \
@@ -121,13 +126,82 @@ struct hint_tpcc_stock_level_read_only_traits : public hint_read_only_traits {};
   x(abstract_db::HINT_TPCC_STOCK_LEVEL, hint_tpcc_stock_level_traits) \
   x(abstract_db::HINT_TPCC_STOCK_LEVEL_READ_ONLY, hint_tpcc_stock_level_read_only_traits)
 
+namespace private_ {
+  // the values of a compressed table are a tag byte followed by either the
+  // raw bytes or the uint32 raw size and an lz4 block of them. a value lz4
+  // cannot shrink stays raw, so the worst case is a byte per value
+  struct value_codec {
+    static const char TagRaw = 0;
+    static const char TagLZ4 = 1;
+    static const size_t HeaderSize = 1 + sizeof(uint32_t);
+
+    static void
+    encode(const std::string &v, std::string &out)
+    {
+      out.resize(HeaderSize + v.size());
+      int n = 0;
+      // the block has to beat the raw bytes by the size of its header
+      if (v.size() > HeaderSize)
+        n = LZ4_compress_heap_limitedOutput(
+            ctx(), v.data(), &out[HeaderSize], v.size(), v.size() - HeaderSize);
+      if (n > 0) {
+        const uint32_t sz = v.size();
+        out[0] = TagLZ4;
+        NDB_MEMCPY(&out[1], &sz, sizeof(sz));
+        out.resize(HeaderSize + n);
+      } else {
+        out[0] = TagRaw;
+        NDB_MEMCPY(&out[1], v.data(), v.size());
+        out.resize(1 + v.size());
+      }
+    }
+
+    // the first max_bytes_read bytes of the raw value, lz4 stops decoding
+    // once it has them
+    static void
+    decode(const std::string &v, std::string &out, size_t max_bytes_read)
+    {
+      INVARIANT(!v.empty());
+      if (v[0] == TagRaw) {
+        out.assign(v.data() + 1, std::min(v.size() - 1, max_bytes_read));
+        return;
+      }
+      INVARIANT(v[0] == TagLZ4);
+      uint32_t sz;
+      NDB_MEMCPY(&sz, &v[1], sizeof(sz));
+      const size_t want = std::min(size_t(sz), max_bytes_read);
+      out.resize(sz);
+      const int ret = LZ4_decompress_safe_partial(
+          v.data() + HeaderSize, &out[0], v.size() - HeaderSize, want, sz);
+      ALWAYS_ASSERT(ret >= 0 && size_t(ret) >= want);
+      out.resize(want);
+    }
+
+  private:
+    // the hash table of the compressor, one per thread for the lifetime of
+    // the thread
+    static void *
+    ctx()
+    {
+      static __thread void *tl_ctx = nullptr;
+      if (unlikely(!tl_ctx))
+        tl_ctx = LZ4_create();
+      return tl_ctx;
+    }
+  };
+}
+
 template <template <typename> class Transaction>
 ndb_wrapper<Transaction>::ndb_wrapper(
     const std::vector<std::string> &logfiles,
     const std::vector<std::vector<unsigned>> &assignments_given,
     bool call_fsync,
     bool use_compression,
-    bool fake_writes)
+    bool fake_writes,
+    bool use_io_uring,
+    bool pin_loggers,
+    const std::vector<std::string> &compressed_tables)
+  : compressed_tables(compressed_tables)
 {
   if (logfiles.empty())
     return;
@@ -136,13 +210,17 @@ ndb_wrapper<Transaction>::ndb_wrapper(
       nthreads, logfiles, assignments_given, &assignments_used,
       call_fsync,
       use_compression,
-      fake_writes);
+      fake_writes,
+      use_io_uring,
+      pin_loggers);
   if (verbose) {
     std::cerr << "[logging subsystem]" << std::endl;
     std::cerr << "  assignments: " << assignments_used << std::endl;
     std::cerr << "  call fsync : " << call_fsync       << std::endl;
     std::cerr << "  compression: " << use_compression  << std::endl;
     std::cerr << "  fake_writes: " << fake_writes      << std::endl;
+    std::cerr << "  io_uring   : " << use_io_uring     << std::endl;
+    std::cerr << "  pin numa   : " << pin_loggers      << std::endl;
   }
 }
 
@@ -280,7 +358,26 @@ template <template <typename> class Transaction>
 abstract_ordered_index *
 ndb_wrapper<Transaction>::open_index(const std::string &name, size_t value_size_hint, bool mostly_append)
 {
-  return new ndb_ordered_index<Transaction>(name, value_size_hint, mostly_append);
+  return new ndb_ordered_index<Transaction>(
+      name, value_size_hint, mostly_append, is_compressed(name));
+}
+
+// "all", the name itself, or the name of a partitioned table without its
+// "_<partition>" suffix, e.g. "stock" for stock_3
+template <template <typename> class Transaction>
+bool
+ndb_wrapper<Transaction>::is_compressed(const std::string &name) const
+{
+  for (auto &t : compressed_tables) {
+    if (t == "all" || t == name)
+      return true;
+    if (name.size() > t.size() + 1 &&
+        !name.compare(0, t.size(), t) &&
+        name[t.size()] == '_' &&
+        name.find_first_not_of("0123456789", t.size() + 1) == std::string::npos)
+      return true;
+  }
+  return false;
 }
 
 template <template <typename> class Transaction>
@@ -292,8 +389,10 @@ ndb_wrapper<Transaction>::close_index(abstract_ordered_index *idx)
 
 template <template <typename> class Transaction>
 ndb_ordered_index<Transaction>::ndb_ordered_index(
-    const std::string &name, size_t value_size_hint, bool mostly_append)
-  : name(name), btr(value_size_hint, mostly_append, name)
+    const std::string &name, size_t value_size_hint, bool mostly_append,
+    bool compress_values)
+  : name(name), compress_values(compress_values),
+    btr(value_size_hint, mostly_append, name)
 {
   // for debugging
   //std::cerr << name << " : btree= "
@@ -301,6 +400,37 @@ ndb_ordered_index<Transaction>::ndb_ordered_index(
   //          << std::endl;
 }
 
+// the encoded value is read whole into the arena of the txn, as only its
+// decoded prefix can be cut at max_bytes_read
+template <template <typename> class Transaction>
+template <typename Txn, typename Key>
+bool
+ndb_ordered_index<Transaction>::search(
+    Txn &t, const Key &k, std::string &value, size_t max_bytes_read)
+{
+  if (!compress_values)
+    return btr.search(t, k, value, max_bytes_read);
+  std::string * const px = t.string_allocator()();
+  if (!btr.search(t, k, *px))
+    return false;
+  private_::value_codec::decode(*px, value, max_bytes_read);
+  return true;
+}
+
+// the btree keeps a pointer to what it is given until the commit, so the
+// encoded value lives in the arena of the txn
+template <template <typename> class Transaction>
+template <typename Txn>
+const std::string &
+ndb_ordered_index<Transaction>::encode(Txn &t, const std::string &value)
+{
+  if (!compress_values)
+    return value;
+  std::string * const px = t.string_allocator()();
+  private_::value_codec::encode(value, *px);
+  return *px;
+}
+
 template <template <typename> class Transaction>
 bool
 ndb_ordered_index<Transaction>::get(
@@ -316,7 +446,38 @@ ndb_ordered_index<Transaction>::get(
   case a: \
     { \
       auto t = cast< b >()(p); \
-      if (!btr.search(*t, key, value, max_bytes_read)) \
+      if (!search(*t, key, value, max_bytes_read)) \
+        return false; \
+      return true; \
+    }
+    switch (p->hint) {
+      TXN_PROFILE_HINT_OP(MY_OP_X)
+    default:
+      ALWAYS_ASSERT(false);
+    }
+#undef MY_OP_X
+    INVARIANT(!value.empty());
+    return true;
+  } catch (transaction_abort_exception &ex) {
+    throw abstract_db::abstract_abort_exception();
+  }
+}
+
+template <template <typename> class Transaction>
+bool
+ndb_ordered_index<Transaction>::get_u64(
+    void *txn,
+    uint64_t key,
+    std::string &value, size_t max_bytes_read)
+{
+  ndbtxn * const p = reinterpret_cast<ndbtxn *>(txn);
+  const u64_varkey k(key);
+  try {
+#define MY_OP_X(a, b) \
+  case a: \
+    { \
+      auto t = cast< b >()(p); \
+      if (!search(*t, k, value, max_bytes_read)) \
         return false; \
       return true; \
     }
@@ -350,7 +511,7 @@ ndb_ordered_index<Transaction>::put(
   case a: \
     { \
       auto t = cast< b >()(p); \
-      btr.put(*t, key, value); \
+      btr.put(*t, key, encode(*t, value)); \
       return 0; \
     }
     switch (p->hint) {
@@ -378,7 +539,36 @@ ndb_ordered_index<Transaction>::put(
   case a: \
     { \
       auto t = cast< b >()(p); \
-      btr.put(*t, std::move(key), std::move(value)); \
+      btr.put(*t, std::move(key), encode(*t, value)); \
+      return 0; \
+    }
+    switch (p->hint) {
+      TXN_PROFILE_HINT_OP(MY_OP_X)
+    default:
+      ALWAYS_ASSERT(false);
+    }
+#undef MY_OP_X
+  } catch (transaction_abort_exception &ex) {
+    throw abstract_db::abstract_abort_exception();
+  }
+  return 0;
+}
+
+template <template <typename> class Transaction>
+const char *
+ndb_ordered_index<Transaction>::put_u64(
+    void *txn,
+    uint64_t key,
+    const std::string &value)
+{
+  ndbtxn * const p = reinterpret_cast<ndbtxn *>(txn);
+  const u64_varkey k(key);
+  try {
+#define MY_OP_X(a, b) \
+  case a: \
+    { \
+      auto t = cast< b >()(p); \
+      btr.put(*t, k, encode(*t, value)); \
       return 0; \
     }
     switch (p->hint) {
@@ -408,7 +598,7 @@ ndb_ordered_index<Transaction>::insert(
   case a: \
     { \
       auto t = cast< b >()(p); \
-      btr.insert(*t, key, value); \
+      btr.insert(*t, key, encode(*t, value)); \
       return 0; \
     }
     switch (p->hint) {
@@ -436,7 +626,7 @@ ndb_ordered_index<Transaction>::insert(
   case a: \
     { \
       auto t = cast< b >()(p); \
-      btr.insert(*t, std::move(key), std::move(value)); \
+      btr.insert(*t, std::move(key), encode(*t, value)); \
       return 0; \
     }
     switch (p->hint) {
@@ -454,18 +644,28 @@ ndb_ordered_index<Transaction>::insert(
 template <template <typename> class Transaction>
 class ndb_wrapper_search_range_callback : public txn_btree<Transaction>::search_range_callback {
 public:
-  ndb_wrapper_search_range_callback(abstract_ordered_index::scan_callback &upcall)
-    : upcall(&upcall) {}
+  ndb_wrapper_search_range_callback(abstract_ordered_index::scan_callback &upcall,
+                                    bool compressed = false,
+                                    str_arena *arena = nullptr)
+    : upcall(&upcall), compressed(compressed), arena(arena) {}
 
   virtual bool
   invoke(const typename txn_btree<Transaction>::keystring_type &k,
          const typename txn_btree<Transaction>::string_type &v)
   {
-    return upcall->invoke(k.data(), k.length(), v);
+    if (!compressed)
+      return upcall->invoke(k.data(), k.length(), v);
+    // a value per row from the arena, the upcall may hold on to them
+    std::string * const px = arena ? arena->next() : &buf;
+    private_::value_codec::decode(v, *px, std::string::npos);
+    return upcall->invoke(k.data(), k.length(), *px);
   }
 
 private:
   abstract_ordered_index::scan_callback *upcall;
+  const bool compressed;
+  str_arena *const arena;
+  std::string buf;
 };
 
 template <template <typename> class Transaction>
@@ -480,7 +680,7 @@ ndb_ordered_index<Transaction>::scan(
   PERF_DECL(static std::string probe1_name(std::string(__PRETTY_FUNCTION__) + std::string(":total:")));
   ANON_REGION(probe1_name.c_str(), &private_::ndb_scan_probe0_cg);
   ndbtxn * const p = reinterpret_cast<ndbtxn *>(txn);
-  ndb_wrapper_search_range_callback<Transaction> c(callback);
+  ndb_wrapper_search_range_callback<Transaction> c(callback, compress_values, arena);
   try {
 #define MY_OP_X(a, b) \
   case a: \
@@ -510,7 +710,7 @@ ndb_ordered_index<Transaction>::rscan(
     str_arena *arena)
 {
   ndbtxn * const p = reinterpret_cast<ndbtxn *>(txn);
-  ndb_wrapper_search_range_callback<Transaction> c(callback);
+  ndb_wrapper_search_range_callback<Transaction> c(callback, compress_values, arena);
   try {
 #define MY_OP_X(a, b) \
   case a: \
@@ -587,6 +787,13 @@ ndb_ordered_index<Transaction>::size() const
   return btr.size_estimate();
 }
 
+template <template <typename> class Transaction>
+std::map<std::string, uint64_t>
+ndb_ordered_index<Transaction>::footprint() const
+{
+  return btr.footprint();
+}
+
 template <template <typename> class Transaction>
 std::map<std::string, uint64_t>
 ndb_ordered_index<Transaction>::clear()
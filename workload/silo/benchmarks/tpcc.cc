@@ -12,9 +12,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <numa.h>
 
 #include <set>
 #include <vector>
+#include <memory>
 
 #include "../txn.h"
 #include "../macros.h"
@@ -145,9 +147,12 @@ static int g_disable_read_only_scans = 0;
 static int g_enable_partition_locks = 0;
 static int g_enable_separate_tree_per_partition = 0;
 static int g_new_order_remote_item_pct = 1;
+static int g_payment_remote_customer_pct = 15;
+static int g_numa_partitions = 0;
 static int g_new_order_fast_id_gen = 0;
 static int g_uniform_item_dist = 0;
 static int g_order_status_scan_hack = 0;
+static int g_balanced_loading = 0;
 static unsigned g_txn_workload_mix[] = { 45, 43, 4, 4, 4 }; // default TPC-C workload mix
 
 static aligned_padded_elem<spinlock> *g_partition_locks = nullptr;
@@ -169,6 +174,31 @@ PartitionId(unsigned int wid)
   return partid;
 }
 
+// with --numa-partitions, the tables are partitioned by the numa node of
+// the workers (the node of the cpu PartitionId() pins to), numbered densely
+// from 0: maps a wid-1 => node partition id
+static vector<unsigned> g_node_partitions;
+static unsigned g_num_node_partitions = 0;
+
+static void
+InitNodePartitions()
+{
+  map<int, unsigned> ids;
+  for (unsigned wid = 1; wid <= NumWarehouses(); wid++) {
+    const int node = numa_node_of_cpu(PartitionId(wid));
+    ALWAYS_ASSERT(node >= 0);
+    g_node_partitions.push_back(ids.emplace(node, ids.size()).first->second);
+  }
+  g_num_node_partitions = ids.size();
+}
+
+static inline ALWAYS_INLINE unsigned int
+NodePartitionId(unsigned int wid)
+{
+  INVARIANT(wid >= 1 && wid <= g_node_partitions.size());
+  return g_node_partitions[wid - 1];
+}
+
 static inline ALWAYS_INLINE spinlock &
 LockForPartition(unsigned int wid)
 {
@@ -387,6 +417,26 @@ public:
     return (r.next() % diff) + start;
   }
 
+  // the warehouse of a remote item or customer of wid. with more than one
+  // node partition it lives on another node, so the remote pcts are the
+  // share of cross-node accesses
+  static inline unsigned
+  PickRemoteWarehouseId(fast_random &r, unsigned wid)
+  {
+    INVARIANT(NumWarehouses() > 1);
+    unsigned ret;
+    if (g_num_node_partitions > 1) {
+      do {
+        ret = RandomNumber(r, 1, NumWarehouses());
+      } while (NodePartitionId(ret) == NodePartitionId(wid));
+      return ret;
+    }
+    do {
+      ret = RandomNumber(r, 1, NumWarehouses());
+    } while (ret == wid);
+    return ret;
+  }
+
   static string NameTokens[];
 
   // all tokens are at most 5 chars long
@@ -652,6 +702,8 @@ protected:
     try {
       vector<warehouse::value> warehouses;
       for (uint i = 1; i <= NumWarehouses(); i++) {
+        if (pin_cpus)
+          PinToWarehouseId(i);
         const warehouse::key k(i);
 
         const string w_name = RandomStr(r, RandomNumber(r, 6, 10));
@@ -718,6 +770,28 @@ public:
 protected:
   virtual void
   load()
+  {
+    if (!g_numa_partitions) {
+      load_replica(1);
+      return;
+    }
+    // the same items into the replica of every node, from its node
+    const fast_random r0 = r;
+    vector<bool> loaded(g_num_node_partitions);
+    for (uint w = 1; w <= NumWarehouses(); w++) {
+      if (loaded[NodePartitionId(w)])
+        continue;
+      loaded[NodePartitionId(w)] = true;
+      PinToWarehouseId(w);
+      r = r0;
+      load_replica(w);
+    }
+  }
+
+private:
+  // loads the item table of warehouse wid
+  void
+  load_replica(uint wid)
   {
     string obj_buf;
     const ssize_t bsize = db->txn_max_batch_size();
@@ -726,6 +800,7 @@ protected:
     try {
       for (uint i = 1; i <= NumItems(); i++) {
         // items don't "belong" to a certain warehouse, so no pinning
+        // here, load() pins to the node of a replica
         const item::key k(i);
 
         item::value v;
@@ -746,7 +821,7 @@ protected:
         checker::SanityCheckItem(&k, &v);
         const size_t sz = Size(v);
         total_sz += sz;
-        tbl_item(1)->insert(txn, Encode(k), Encode(obj_buf, v)); // this table is shared, so any partition is OK
+        tbl_item(wid)->insert(txn, Encode(k), Encode(obj_buf, v)); // shared by all warehouses, or by those of the node
 
         if (bsize != -1 && !(i % bsize)) {
           ALWAYS_ASSERT(db->commit_txn(txn));
@@ -1225,6 +1300,81 @@ private:
   ssize_t warehouse_id;
 };
 
+// the per-warehouse loads of all tables, queued on the partition owning
+// their warehouse. a loader drains the queue of its own partition first,
+// then helps with the others. the tasks pin to their warehouse themselves
+// (with --pin-cpus), so the data lands in the arena of the owning worker
+// no matter which loader ends up running them
+class tpcc_load_schedule {
+public:
+  tpcc_load_schedule(size_t npartitions) : queues(npartitions) {}
+
+  ~tpcc_load_schedule()
+  {
+    for (auto &q : queues)
+      for (auto l : q.tasks)
+        delete l;
+  }
+
+  inline void
+  push(unsigned warehouse_id, bench_loader *l)
+  {
+    queues[PartitionId(warehouse_id)].tasks.push_back(l);
+  }
+
+  bench_loader *
+  next(size_t partid)
+  {
+    for (size_t i = 0; i < queues.size(); i++) {
+      queue &q = queues[(partid + i) % queues.size()];
+      if (q.next.load(memory_order_relaxed) >= q.tasks.size())
+        continue;
+      const size_t idx = q.next.fetch_add(1, memory_order_relaxed);
+      if (idx < q.tasks.size())
+        return q.tasks[idx];
+    }
+    return nullptr;
+  }
+
+private:
+  struct queue {
+    queue() : next(0) {}
+    vector<bench_loader *> tasks;
+    atomic<size_t> next;
+  };
+  vector<queue> queues;
+};
+
+class tpcc_scheduled_loader : public bench_loader {
+public:
+  tpcc_scheduled_loader(unsigned long seed,
+                        abstract_db *db,
+                        const map<string, abstract_ordered_index *> &open_tables,
+                        tpcc_load_schedule &schedule,
+                        size_t partid)
+    : bench_loader(seed, db, open_tables),
+      schedule(schedule), partid(partid)
+  {}
+
+protected:
+  virtual void
+  load()
+  {
+    size_t ntasks = 0;
+    while (bench_loader * const l = schedule.next(partid)) {
+      l->load_here();
+      ntasks++;
+    }
+    if (verbose)
+      cerr << "[INFO] loader of partition " << partid
+           << " finished " << ntasks << " tasks" << endl;
+  }
+
+private:
+  tpcc_load_schedule &schedule;
+  size_t partid;
+};
+
 static event_counter evt_tpcc_cross_partition_new_order_txns("tpcc_cross_partition_new_order_txns");
 static event_counter evt_tpcc_cross_partition_payment_txns("tpcc_cross_partition_payment_txns");
 
@@ -1244,9 +1394,7 @@ tpcc_worker::txn_new_order()
                RandomNumber(r, 1, 100) > g_new_order_remote_item_pct)) {
       supplierWarehouseIDs[i] = warehouse_id;
     } else {
-      do {
-       supplierWarehouseIDs[i] = RandomNumber(r, 1, NumWarehouses());
-      } while (supplierWarehouseIDs[i] == warehouse_id);
+      supplierWarehouseIDs[i] = PickRemoteWarehouseId(r, warehouse_id);
       allLocal = false;
     }
     orderQuantities[i] = RandomNumber(r, 1, 10);
@@ -1355,7 +1503,7 @@ tpcc_worker::txn_new_order()
       const uint ol_quantity = orderQuantities[ol_number - 1];
 
       const item::key k_i(ol_i_id);
-      ALWAYS_ASSERT(tbl_item(1)->get(txn, Encode(obj_key0, k_i), obj_v));
+      ALWAYS_ASSERT(tbl_item(warehouse_id)->get(txn, Encode(obj_key0, k_i), obj_v));
       item::value v_i_temp;
       const item::value *v_i = Decode(obj_v, v_i_temp);
       checker::SanityCheckItem(&k_i, v_i);
@@ -1549,14 +1697,12 @@ tpcc_worker::txn_payment()
   uint customerDistrictID, customerWarehouseID;
   if (likely(g_disable_xpartition_txn ||
              NumWarehouses() == 1 ||
-             RandomNumber(r, 1, 100) <= 85)) {
+             RandomNumber(r, 1, 100) > g_payment_remote_customer_pct)) {
     customerDistrictID = districtID;
     customerWarehouseID = warehouse_id;
   } else {
     customerDistrictID = RandomNumber(r, 1, NumDistrictsPerWarehouse());
-    do {
-      customerWarehouseID = RandomNumber(r, 1, NumWarehouses());
-    } while (customerWarehouseID == warehouse_id);
+    customerWarehouseID = PickRemoteWarehouseId(r, warehouse_id);
   }
   const float paymentAmount = (float) (RandomNumber(r, 100, 500000) / 100.0);
   const uint32_t ts = GetCurrentTimeMillis();
@@ -1992,7 +2138,15 @@ private:
     const bool is_append_only = IsTableAppendOnly(name);
     const string s_name(name);
     vector<abstract_ordered_index *> ret(NumWarehouses());
-    if (g_enable_separate_tree_per_partition && !is_read_only) {
+    if (g_numa_partitions) {
+      // one tree per node, the read-only ones replicated
+      vector<abstract_ordered_index *> nodes(g_num_node_partitions);
+      for (size_t i = 0; i < nodes.size(); i++)
+        nodes[i] = db->open_index(
+            s_name + "_n" + to_string(i), expected_size, is_append_only);
+      for (size_t i = 0; i < NumWarehouses(); i++)
+        ret[i] = nodes[NodePartitionId(i + 1)];
+    } else if (g_enable_separate_tree_per_partition && !is_read_only) {
       if (NumWarehouses() <= nthreads) {
         for (size_t i = 0; i < NumWarehouses(); i++)
           ret[i] = db->open_index(s_name + "_" + to_string(i), expected_size, is_append_only);
@@ -2065,6 +2219,22 @@ protected:
     vector<bench_loader *> ret;
     ret.push_back(new tpcc_warehouse_loader(9324, db, open_tables, partitions));
     ret.push_back(new tpcc_item_loader(235443, db, open_tables, partitions));
+    if (g_balanced_loading) {
+      // one loader per worker instead of one per table and warehouse, see
+      // tpcc_load_schedule
+      ret.push_back(new tpcc_district_loader(129856349, db, open_tables, partitions));
+      schedule.reset(new tpcc_load_schedule(nthreads));
+      fast_random rs(89785943), rc(923587856425), ro(2343352);
+      for (uint i = 1; i <= NumWarehouses(); i++) {
+        schedule->push(i, new tpcc_order_loader(ro.next(), db, open_tables, partitions, i));
+        schedule->push(i, new tpcc_customer_loader(rc.next(), db, open_tables, partitions, i));
+        schedule->push(i, new tpcc_stock_loader(rs.next(), db, open_tables, partitions, i));
+      }
+      fast_random r(5413209);
+      for (size_t i = 0; i < nthreads; i++)
+        ret.push_back(new tpcc_scheduled_loader(r.next(), db, open_tables, *schedule, i));
+      return ret;
+    }
     if (enable_parallel_loading) {
       fast_random r(89785943);
       for (uint i = 1; i <= NumWarehouses(); i++)
@@ -2126,6 +2296,7 @@ protected:
 
 private:
   map<string, vector<abstract_ordered_index *>> partitions;
+  unique_ptr<tpcc_load_schedule> schedule;
 };
 
 void
@@ -2142,14 +2313,17 @@ tpcc_do_test(abstract_db *db, int argc, char **argv)
       {"enable-partition-locks"               , no_argument       , &g_enable_partition_locks             , 1}   ,
       {"enable-separate-tree-per-partition"   , no_argument       , &g_enable_separate_tree_per_partition , 1}   ,
       {"new-order-remote-item-pct"            , required_argument , 0                                     , 'r'} ,
+      {"payment-remote-customer-pct"          , required_argument , 0                                     , 'p'} ,
+      {"numa-partitions"                      , no_argument       , &g_numa_partitions                    , 1}   , // needs --pin-cpus
       {"new-order-fast-id-gen"                , no_argument       , &g_new_order_fast_id_gen              , 1}   ,
       {"uniform-item-dist"                    , no_argument       , &g_uniform_item_dist                  , 1}   ,
       {"order-status-scan-hack"               , no_argument       , &g_order_status_scan_hack             , 1}   ,
+      {"balanced-loading"                     , no_argument       , &g_balanced_loading                   , 1}   ,
       {"workload-mix"                         , required_argument , 0                                     , 'w'} ,
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "r:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "r:p:", long_options, &option_index);
     if (c == -1)
       break;
     switch (c) {
@@ -2165,6 +2339,12 @@ tpcc_do_test(abstract_db *db, int argc, char **argv)
       did_spec_remote_pct = true;
       break;
 
+    case 'p':
+      g_payment_remote_customer_pct = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(g_payment_remote_customer_pct >= 0 && g_payment_remote_customer_pct <= 100);
+      did_spec_remote_pct = true;
+      break;
+
     case 'w':
       {
         const vector<string> toks = split(optarg, ',');
@@ -2190,8 +2370,21 @@ tpcc_do_test(abstract_db *db, int argc, char **argv)
   }
 
   if (did_spec_remote_pct && g_disable_xpartition_txn) {
-    cerr << "WARNING: --new-order-remote-item-pct given with --disable-cross-partition-transactions" << endl;
-    cerr << "  --new-order-remote-item-pct will have no effect" << endl;
+    cerr << "WARNING: remote pcts given with --disable-cross-partition-transactions" << endl;
+    cerr << "  --new-order-remote-item-pct and --payment-remote-customer-pct will have no effect" << endl;
+  }
+
+  if (g_numa_partitions) {
+    // the node of a warehouse is the node of the cpu its worker pins to
+    if (!pin_cpus) {
+      cerr << "[ERROR] --numa-partitions needs --pin-cpus" << endl;
+      exit(1);
+    }
+    if (g_enable_separate_tree_per_partition) {
+      cerr << "[ERROR] --numa-partitions and --enable-separate-tree-per-partition are exclusive" << endl;
+      exit(1);
+    }
+    InitNodePartitions();
   }
 
   if (verbose) {
@@ -2201,9 +2394,13 @@ tpcc_do_test(abstract_db *db, int argc, char **argv)
     cerr << "  partition_locks              : " << g_enable_partition_locks << endl;
     cerr << "  separate_tree_per_partition  : " << g_enable_separate_tree_per_partition << endl;
     cerr << "  new_order_remote_item_pct    : " << g_new_order_remote_item_pct << endl;
+    cerr << "  payment_remote_customer_pct  : " << g_payment_remote_customer_pct << endl;
+    cerr << "  numa_partitions              : " << g_numa_partitions
+         << " (" << g_num_node_partitions << " nodes)" << endl;
     cerr << "  new_order_fast_id_gen        : " << g_new_order_fast_id_gen << endl;
     cerr << "  uniform_item_dist            : " << g_uniform_item_dist << endl;
     cerr << "  order_status_scan_hack       : " << g_order_status_scan_hack << endl;
+    cerr << "  balanced_loading             : " << g_balanced_loading << endl;
     cerr << "  workload_mix                 : " <<
       format_list(g_txn_workload_mix,
                   g_txn_workload_mix + ARRAY_NELEMS(g_txn_workload_mix)) << endl;
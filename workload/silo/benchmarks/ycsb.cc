@@ -5,11 +5,14 @@
 #include <string>
 #include <set>
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <numa.h>
 
+#include "../txn.h"
 #include "../macros.h"
 #include "../varkey.h"
 #include "../thread.h"
@@ -23,13 +26,126 @@ using namespace std;
 using namespace util;
 
 static size_t nkeys;
-static const size_t YCSBRecordSize = 100;
+static size_t g_record_size = 100;
+
+// what the records are made of, see --payload. fill repeats a single byte,
+// which any compressor squeezes to nothing, text strings words of a small
+// vocabulary together, closer to the text fields of a real usertable
+enum payload_kind {
+  PAYLOAD_FILL,
+  PAYLOAD_TEXT,
+};
+static const char *const g_payload_names[] = { "fill", "text" };
+static payload_kind g_payload = PAYLOAD_FILL;
+
+static string
+make_payload(fast_random &r, char fill)
+{
+  if (g_payload == PAYLOAD_FILL)
+    return string(g_record_size, fill);
+  static const char *const words[] = {
+    "the", "of", "and", "to", "in", "is", "was", "for", "on", "that",
+    "with", "as", "by", "at", "from", "his", "her", "it", "an", "were",
+    "are", "which", "this", "be", "or", "has", "had", "not", "first", "one",
+    "their", "its", "new", "after", "who", "they", "two", "also", "been", "year",
+    "city", "world", "school", "music", "film", "team", "season", "state", "war", "album",
+  };
+  string s;
+  s.reserve(g_record_size + 16);
+  while (s.size() < g_record_size) {
+    if (!s.empty())
+      s += ' ';
+    s += words[r.next_u32() % ARRAY_NELEMS(words)];
+  }
+  s.resize(g_record_size);
+  return s;
+}
 
 // [R, W, RMW, Scan]
 // we're missing remove for now
 // the default is a modification of YCSB "A" we made (80/20 R/W)
 static unsigned g_txn_workload_mix[] = { 80, 20, 0, 0 };
 
+// how the workers pick the keys, see --key-dist
+enum key_dist {
+  KEY_DIST_UNIFORM,
+  KEY_DIST_ZIPFIAN, // zipfian ranks scattered over the key space
+  KEY_DIST_LATEST,  // zipfian ranks counted down from the last key
+  KEY_DIST_HOTSPOT, // a fraction of the keys gets a fraction of the accesses
+};
+static const char *const g_key_dist_names[] = { "uniform", "zipfian", "latest", "hotspot" };
+static key_dist g_key_dist = KEY_DIST_UNIFORM;
+static double g_zipf_theta = 0.99;
+// [fraction of the keys, fraction of the accesses going to them]
+static double g_hotspot[] = { 0.2, 0.8 };
+
+// the hot keys move by g_phase_shift of the key space every g_phase_secs
+// seconds or g_phase_ops ops (over all workers), whichever is set. the
+// shift defaults to the hotspot size, so consecutive hot sets are disjoint
+static uint64_t g_phase_secs = 0;
+static uint64_t g_phase_ops = 0;
+static double g_phase_shift = -1.0;
+
+// the scans, and with --read-only-reads the reads, run as snapshot txns: they
+// read at the last consistent epoch and have nothing to validate at commit
+static int g_disable_read_only_scans = 0;
+static int g_read_only_reads = 0;
+
+// zipfian ranks in [0, n) following Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases", like YCSB does. the constants only
+// depend on n and theta and are computed once, so a rank costs one pow()
+class zipf_generator {
+public:
+  zipf_generator(uint64_t n, double theta)
+    : n(n), theta(theta)
+  {
+    ALWAYS_ASSERT(n > 0);
+    ALWAYS_ASSERT(theta > 0.0 && theta < 1.0);
+    zetan = zeta(n, theta);
+    alpha = 1.0 / (1.0 - theta);
+    zeta2 = 1.0 + pow(0.5, theta);
+    eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+  }
+
+  inline ALWAYS_INLINE uint64_t
+  next(fast_random &r) const
+  {
+    const double u = r.next_uniform();
+    const double uz = u * zetan;
+    if (uz < 1.0)
+      return 0;
+    if (uz < zeta2)
+      return 1;
+    return min(uint64_t(n * pow(eta * u - eta + 1.0, alpha)), n - 1);
+  }
+
+private:
+  // sums the first terms exactly and approximates the rest with
+  // euler-maclaurin, exact enough and fast for billions of keys
+  static double
+  zeta(uint64_t n, double theta)
+  {
+    static const uint64_t NExactTerms = 1 << 20;
+    double sum = 0.0;
+    const uint64_t m = min(n, NExactTerms);
+    for (uint64_t i = 1; i <= m; i++)
+      sum += pow(double(i), -theta);
+    if (n == m)
+      return sum;
+    // \int_m^n x^-theta dx + (f(n) - f(m)) / 2 - theta (f'(n) - f'(m)) / 12
+    const double a = double(m), b = double(n);
+    sum += (pow(b, 1.0 - theta) - pow(a, 1.0 - theta)) / (1.0 - theta);
+    sum += (pow(b, -theta) - pow(a, -theta)) / 2.0;
+    sum -= theta * (pow(b, -theta - 1.0) - pow(a, -theta - 1.0)) / 12.0;
+    return sum;
+  }
+
+  const uint64_t n;
+  const double theta;
+  double zetan, zeta2, alpha, eta;
+};
+static zipf_generator *g_zipf = nullptr;
+
 class ycsb_worker : public bench_worker {
 public:
   ycsb_worker(unsigned int worker_id,
@@ -39,21 +155,79 @@ public:
     : bench_worker(worker_id, true, seed, db,
                    open_tables, barrier_a, barrier_b),
       tbl(open_tables.at("USERTABLE")),
-      computation_n(0)
+      write_v(make_payload(r, 'b')),
+      rmw_v(make_payload(r, 'c')),
+      computation_n(0),
+      key_offset(0), phase_ops(0), phase_start_us(0)
   {
     obj_key0.reserve(str_arena::MinStrReserveLength);
     obj_key1.reserve(str_arena::MinStrReserveLength);
     obj_v.reserve(str_arena::MinStrReserveLength);
   }
 
+  // moves on to the next phase once the current one is used up, the clock
+  // is only read every few hundred keys
+  inline ALWAYS_INLINE void
+  update_phase()
+  {
+    if (g_phase_ops) {
+      if (++phase_ops < max(g_phase_ops / nthreads, uint64_t(1)))
+        return;
+      phase_ops = 0;
+    } else if (g_phase_secs) {
+      if (++phase_ops & 0xff)
+        return;
+      const uint64_t now = timer::cur_usec();
+      if (!phase_start_us)
+        phase_start_us = now;
+      if (now - phase_start_us < g_phase_secs * 1000000)
+        return;
+      phase_start_us += g_phase_secs * 1000000;
+    } else {
+      return;
+    }
+    set_phase(phase + 1);
+    key_offset = (key_offset + uint64_t(g_phase_shift * nkeys)) % nkeys;
+  }
+
+  inline ALWAYS_INLINE uint64_t
+  next_key()
+  {
+    update_phase();
+    return (next_key_unshifted() + key_offset) % nkeys;
+  }
+
+  inline ALWAYS_INLINE uint64_t
+  next_key_unshifted()
+  {
+    switch (g_key_dist) {
+    case KEY_DIST_ZIPFIAN:
+      // keep the hot keys from sharing the same few leaves
+      return (g_zipf->next(r) * 0x9e3779b97f4a7c15ul) % nkeys;
+    case KEY_DIST_LATEST:
+      return nkeys - 1 - g_zipf->next(r);
+    case KEY_DIST_HOTSPOT:
+      {
+        const uint64_t nhot = min(max(uint64_t(g_hotspot[0] * nkeys), uint64_t(1)), nkeys);
+        if (nhot == nkeys || r.next_uniform() < g_hotspot[1])
+          return r.next() % nhot;
+        return nhot + r.next() % (nkeys - nhot);
+      }
+    default:
+      return r.next() % nkeys;
+    }
+  }
+
   txn_result
   txn_read()
   {
-    void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
+    const uint64_t read_only_mask =
+      g_read_only_reads ? transaction_base::TXN_FLAG_READ_ONLY : 0;
+    void * const txn = db->new_txn(txn_flags | read_only_mask, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
     scoped_str_arena s_arena(arena);
     try {
-      const uint64_t k = r.next() % nkeys;
-      ALWAYS_ASSERT(tbl->get(txn, u64_varkey(k).str(obj_key0), obj_v));
+      const uint64_t k = next_key();
+      ALWAYS_ASSERT(tbl->get_u64(txn, k, obj_v));
       computation_n += obj_v.size();
       measure_txn_counters(txn, "txn_read");
       if (likely(db->commit_txn(txn)))
@@ -76,7 +250,7 @@ public:
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
     scoped_str_arena s_arena(arena);
     try {
-      tbl->put(txn, u64_varkey(r.next() % nkeys).str(str()), str().assign(YCSBRecordSize, 'b'));
+      tbl->put_u64(txn, next_key(), write_v);
       measure_txn_counters(txn, "txn_write");
       if (likely(db->commit_txn(txn)))
         return txn_result(true, 0);
@@ -98,10 +272,10 @@ public:
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_RMW);
     scoped_str_arena s_arena(arena);
     try {
-      const uint64_t key = r.next() % nkeys;
-      ALWAYS_ASSERT(tbl->get(txn, u64_varkey(key).str(obj_key0), obj_v));
+      const uint64_t key = next_key();
+      ALWAYS_ASSERT(tbl->get_u64(txn, key, obj_v));
       computation_n += obj_v.size();
-      tbl->put(txn, obj_key0, str().assign(YCSBRecordSize, 'c'));
+      tbl->put_u64(txn, key, rmw_v);
       measure_txn_counters(txn, "txn_rmw");
       if (likely(db->commit_txn(txn)))
         return txn_result(true, 0);
@@ -132,9 +306,15 @@ public:
   txn_result
   txn_scan()
   {
-    void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_SCAN);
+    const uint64_t read_only_mask =
+      g_disable_read_only_scans ? 0 : transaction_base::TXN_FLAG_READ_ONLY;
+    const abstract_db::TxnProfileHint hint =
+      g_disable_read_only_scans ?
+        abstract_db::HINT_KV_SCAN :
+        abstract_db::HINT_KV_SCAN_READ_ONLY;
+    void * const txn = db->new_txn(txn_flags | read_only_mask, arena, txn_buf(), hint);
     scoped_str_arena s_arena(arena);
-    const size_t kstart = r.next() % nkeys;
+    const size_t kstart = next_key();
     const string &kbegin = u64_varkey(kstart).str(obj_key0);
     const string &kend = u64_varkey(kstart + 100).str(obj_key1);
     worker_scan_callback c;
@@ -214,7 +394,17 @@ private:
   string obj_key1;
   string obj_v;
 
+  // the records written never change, the txn layer copies them into the
+  // arena anyways
+  const string write_v;
+  const string rmw_v;
+
   uint64_t computation_n;
+
+  // the hot keys of the current phase are shifted by this much
+  uint64_t key_offset;
+  uint64_t phase_ops;
+  uint64_t phase_start_us;
 };
 
 static void
@@ -240,6 +430,8 @@ ycsb_load_keyrange(
   const size_t nkeys = keyend - keystart;
   ALWAYS_ASSERT(nkeys > 0);
   const size_t nbatches = nkeys < batchsize ? 1 : (nkeys / batchsize);
+  // the same records whichever loader gets the range
+  fast_random r(keystart + 1);
   for (size_t batchid = 0; batchid < nbatches;) {
     scoped_str_arena s_arena(arena);
     void * const txn = db->new_txn(txn_flags, arena, txn_buf);
@@ -249,7 +441,7 @@ ycsb_load_keyrange(
       for (size_t i = batchid * batchsize + keystart; i < rend; i++) {
         ALWAYS_ASSERT(i >= keystart && i < keyend);
         const string k = u64_varkey(i).str();
-        const string v(YCSBRecordSize, 'a');
+        const string v = make_payload(r, 'a');
         tbl->insert(txn, k, v);
       }
       if (db->commit_txn(txn))
@@ -340,7 +532,7 @@ public:
   ycsb_bench_runner(abstract_db *db)
     : bench_runner(db)
   {
-    open_tables["USERTABLE"] = db->open_index("USERTABLE", YCSBRecordSize);
+    open_tables["USERTABLE"] = db->open_index("USERTABLE", g_record_size);
   }
 
 protected:
@@ -470,10 +662,20 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
   while (1) {
     static struct option long_options[] = {
       {"workload-mix" , required_argument , 0 , 'w'},
+      {"key-dist"     , required_argument , 0 , 'd'},
+      {"zipf-theta"   , required_argument , 0 , 't'},
+      {"hotspot"      , required_argument , 0 , 'h'},
+      {"phase-secs"   , required_argument , 0 , 's'},
+      {"phase-ops"    , required_argument , 0 , 'o'},
+      {"phase-shift"  , required_argument , 0 , 'x'},
+      {"record-size"  , required_argument , 0 , 'r'},
+      {"payload"      , required_argument , 0 , 'p'},
+      {"disable-read-only-snapshots" , no_argument , &g_disable_read_only_scans , 1},
+      {"read-only-reads"             , no_argument , &g_read_only_reads         , 1},
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "w:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "w:d:t:h:s:o:x:r:p:", long_options, &option_index);
     if (c == -1)
       break;
     switch (c) {
@@ -498,6 +700,60 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
       }
       break;
 
+    case 'd':
+      {
+        size_t i = 0;
+        while (i < ARRAY_NELEMS(g_key_dist_names) && strcmp(optarg, g_key_dist_names[i]))
+          i++;
+        ALWAYS_ASSERT(i < ARRAY_NELEMS(g_key_dist_names));
+        g_key_dist = key_dist(i);
+      }
+      break;
+
+    case 't':
+      g_zipf_theta = strtod(optarg, nullptr);
+      ALWAYS_ASSERT(g_zipf_theta > 0.0 && g_zipf_theta < 1.0);
+      break;
+
+    case 'h':
+      {
+        const vector<string> toks = split(optarg, ',');
+        ALWAYS_ASSERT(toks.size() == ARRAY_NELEMS(g_hotspot));
+        for (size_t i = 0; i < toks.size(); i++) {
+          g_hotspot[i] = strtod(toks[i].c_str(), nullptr);
+          ALWAYS_ASSERT(g_hotspot[i] >= 0.0 && g_hotspot[i] <= 1.0);
+        }
+      }
+      break;
+
+    case 's':
+      g_phase_secs = strtoull(optarg, nullptr, 10);
+      break;
+
+    case 'o':
+      g_phase_ops = strtoull(optarg, nullptr, 10);
+      break;
+
+    case 'x':
+      g_phase_shift = strtod(optarg, nullptr);
+      ALWAYS_ASSERT(g_phase_shift >= 0.0 && g_phase_shift <= 1.0);
+      break;
+
+    case 'r':
+      g_record_size = strtoul(optarg, nullptr, 10);
+      ALWAYS_ASSERT(g_record_size > 0);
+      break;
+
+    case 'p':
+      {
+        size_t i = 0;
+        while (i < ARRAY_NELEMS(g_payload_names) && strcmp(optarg, g_payload_names[i]))
+          i++;
+        ALWAYS_ASSERT(i < ARRAY_NELEMS(g_payload_names));
+        g_payload = payload_kind(i);
+      }
+      break;
+
     case '?':
       /* getopt_long already printed an error message. */
       exit(1);
@@ -507,13 +763,35 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
     }
   }
 
+  ALWAYS_ASSERT(!g_phase_secs || !g_phase_ops);
+  if (g_phase_shift < 0.0)
+    g_phase_shift = g_hotspot[0];
+
   if (verbose) {
     cerr << "ycsb settings:" << endl;
     cerr << "  workload_mix: "
          << format_list(g_txn_workload_mix, g_txn_workload_mix + ARRAY_NELEMS(g_txn_workload_mix))
          << endl;
+    cerr << "  key_dist    : " << g_key_dist_names[g_key_dist] << endl;
+    if (g_key_dist == KEY_DIST_ZIPFIAN || g_key_dist == KEY_DIST_LATEST)
+      cerr << "  zipf_theta  : " << g_zipf_theta << endl;
+    if (g_key_dist == KEY_DIST_HOTSPOT)
+      cerr << "  hotspot     : " << format_list(g_hotspot, g_hotspot + ARRAY_NELEMS(g_hotspot)) << endl;
+    if (g_phase_secs)
+      cerr << "  phase_secs  : " << g_phase_secs << endl;
+    if (g_phase_ops)
+      cerr << "  phase_ops   : " << g_phase_ops << endl;
+    if (g_phase_secs || g_phase_ops)
+      cerr << "  phase_shift : " << g_phase_shift << endl;
+    cerr << "  read_only_scans : " << !g_disable_read_only_scans << endl;
+    cerr << "  read_only_reads : " << g_read_only_reads << endl;
+    cerr << "  record_size : " << g_record_size << endl;
+    cerr << "  payload     : " << g_payload_names[g_payload] << endl;
   }
 
+  if (g_key_dist == KEY_DIST_ZIPFIAN || g_key_dist == KEY_DIST_LATEST)
+    g_zipf = new zipf_generator(nkeys, g_zipf_theta);
+
   ycsb_bench_runner r(db);
   r.run();
 }
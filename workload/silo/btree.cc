@@ -765,6 +765,121 @@ maxkey(unsigned size)
   return string(size, 255);
 }
 
+// every isa the cpu has must agree with the binary search, including on
+// slices with the top bit set and on partially filled nodes
+static void
+test_slice_search()
+{
+  using namespace slice_search;
+  const isa_t isas[] = { ISA_AVX2, ISA_AVX512 };
+  fast_random r(9084398309893UL);
+  uint64_t keys[16];
+  for (size_t iter = 0; iter < 100000; iter++) {
+    const size_t n = r.next() % (ARRAY_NELEMS(keys) + 1);
+    for (size_t i = 0; i < ARRAY_NELEMS(keys); i++)
+      // few distinct values, so that there are duplicate slices
+      keys[i] = (r.next() % 8) << 61 | (r.next() % 4);
+    sort(keys, keys + n);
+    const uint64_t k = n && r.next() % 2 ?
+      keys[r.next() % n] : (r.next() % 8) << 61 | (r.next() % 4);
+    for (bool inclusive : {false, true}) {
+      const size_t expected = rank_scalar(keys, n, k, inclusive);
+      for (isa_t isa : isas) {
+        if (!isa_supported(isa))
+          continue;
+        const size_t ret = isa == ISA_AVX2 ?
+          rank_avx2(keys, n, k, inclusive) :
+          rank_avx512(keys, n, k, inclusive);
+        ALWAYS_ASSERT(ret == expected);
+      }
+    }
+  }
+}
+
+static void
+test_search_batch()
+{
+  testing_concurrent_btree btr;
+  typedef typename testing_concurrent_btree::value_type value_type;
+
+  // only the even keys exist, enough of them for a few layers of internodes
+  const size_t nkeys = 20000;
+  for (size_t i = 0; i < nkeys; i += 2)
+    btr.insert(u64_varkey(i), (value_type) i);
+  // and a second layer behind a shared 8-byte prefix
+  const string prefix = "longkey:";
+  vector<string> long_keys;
+  for (size_t i = 0; i < 100; i++)
+    long_keys.push_back(prefix + to_string(i));
+  for (size_t i = 0; i < long_keys.size(); i += 2)
+    btr.insert(varkey(long_keys[i]), (value_type) (nkeys + i));
+
+  // in a scattered order, and not a multiple of the batch width
+  const size_t nsearch = nkeys - 3;
+  // 7919 is prime, so this walks all of [0, nkeys)
+  auto key_of = [nkeys](size_t i) { return (i * 7919) % nkeys; };
+  vector<u64_varkey> u64_keys;
+  u64_keys.reserve(nsearch);
+  vector<varkey> keys;
+  size_t nexpected = 0;
+  for (size_t i = 0; i < nsearch; i++) {
+    u64_keys.emplace_back(key_of(i));
+    keys.emplace_back(u64_keys.back());
+    nexpected += !(key_of(i) % 2);
+  }
+  vector<value_type> values(keys.size());
+  unique_ptr<bool[]> found(new bool[keys.size()]);
+  const size_t nfound = btr.search_batch(&keys[0], keys.size(), &values[0], found.get());
+  ALWAYS_ASSERT(nfound == nexpected);
+  for (size_t i = 0; i < keys.size(); i++) {
+    const uint64_t k = key_of(i);
+    ALWAYS_ASSERT(found[i] == !(k % 2));
+    if (found[i])
+      ALWAYS_ASSERT(values[i] == (value_type) k);
+  }
+
+  vector<varkey> vkeys;
+  for (auto &k : long_keys)
+    vkeys.emplace_back(varkey(k));
+  values.assign(vkeys.size(), nullptr);
+  found.reset(new bool[vkeys.size()]);
+  ALWAYS_ASSERT(btr.search_batch(&vkeys[0], vkeys.size(), &values[0], found.get()) ==
+                long_keys.size() / 2);
+  for (size_t i = 0; i < vkeys.size(); i++) {
+    ALWAYS_ASSERT(found[i] == !(i % 2));
+    if (found[i])
+      ALWAYS_ASSERT(values[i] == (value_type) (nkeys + i));
+  }
+}
+
+static void
+test_footprint()
+{
+  testing_concurrent_btree btr;
+  typedef typename testing_concurrent_btree::value_type value_type;
+
+  auto f = btr.footprint();
+  ALWAYS_ASSERT(f.nleaves_ == 1);
+  ALWAYS_ASSERT(f.ninternodes_ == 0);
+
+  // enough keys for internodes, plus a second layer behind a shared prefix
+  const size_t nkeys = 20000;
+  for (size_t i = 0; i < nkeys; i++)
+    btr.insert(u64_varkey(i), (value_type) i);
+  const string prefix = "longkey:";
+  for (size_t i = 0; i < 100; i++)
+    btr.insert(varkey(prefix + to_string(i)), (value_type) i);
+
+  f = btr.footprint();
+  ALWAYS_ASSERT(f.ninternodes_ > 0);
+  // the leaves hold every key, and each one has room for at most a node's worth
+  ALWAYS_ASSERT(f.nleaves_ * testing_concurrent_btree::NKeysPerNode >= nkeys + 100);
+  ALWAYS_ASSERT(f.nleaves_ < nkeys);
+  ALWAYS_ASSERT(f.bytes_ >=
+      f.nleaves_ * testing_concurrent_btree::LeafNodeSize() +
+      f.ninternodes_ * testing_concurrent_btree::InternalNodeSize());
+}
+
 static void
 test_random_keys()
 {
@@ -1984,6 +2099,9 @@ TestConcurrentBtreeFast()
   test_null_keys();
   test_null_keys_2();
   test_random_keys();
+  test_slice_search();
+  test_search_batch();
+  test_footprint();
   test_insert_remove_mix();
   mp_test_pinning();
   mp_test_inserts_removes();
@@ -20,6 +20,7 @@
 #include "counter.h"
 #include "macros.h"
 #include "prefetch.h"
+#include "key_search.h"
 #include "amd64.h"
 #include "rcu.h"
 #include "util.h"
@@ -850,19 +851,15 @@ private:
     inline key_search_ret
     key_search(key_slice k, size_t len) const
     {
-      size_t n = this->key_slots_used();
-      ssize_t lower = 0;
-      ssize_t upper = n;
-      while (lower < upper) {
-        ssize_t i = (lower + upper) / 2;
-        key_slice k0 = this->keys_[i];
-        size_t len0 = this->keyslice_length(i);
-        if (k0 < k || (k0 == k && len0 < len))
-          lower = i + 1;
-        else if (k0 == k && len0 == len)
+      const size_t n = this->key_slots_used();
+      // the slices equal to k are sorted by length
+      for (size_t i = slice_search::rank(this->keys_, n, k, false);
+           i < n && this->keys_[i] == k; i++) {
+        const size_t len0 = this->keyslice_length(i);
+        if (len0 == len)
           return key_search_ret(i, n);
-        else
-          upper = i;
+        if (len0 > len)
+          break;
       }
       return key_search_ret(-1, n);
     }
@@ -874,22 +871,16 @@ private:
     inline key_search_ret
     key_lower_bound_search(key_slice k, size_t len) const
     {
-      ssize_t ret = -1;
-      size_t n = this->key_slots_used();
-      ssize_t lower = 0;
-      ssize_t upper = n;
-      while (lower < upper) {
-        ssize_t i = (lower + upper) / 2;
-        key_slice k0 = this->keys_[i];
-        size_t len0 = this->keyslice_length(i);
-        if (k0 < k || (k0 == k && len0 < len)) {
-          ret = i;
-          lower = i + 1;
-        } else if (k0 == k && len0 == len) {
+      const size_t n = this->key_slots_used();
+      size_t i = slice_search::rank(this->keys_, n, k, false);
+      ssize_t ret = ssize_t(i) - 1;
+      for (; i < n && this->keys_[i] == k; i++) {
+        const size_t len0 = this->keyslice_length(i);
+        if (len0 == len)
           return key_search_ret(i, n);
-        } else {
-          upper = i;
-        }
+        if (len0 > len)
+          break;
+        ret = i;
       }
       return key_search_ret(ret, n);
     }
@@ -904,7 +895,8 @@ private:
     static inline leaf_node*
     alloc()
     {
-      void * const p = rcu::s_instance.alloc(LeafNodeAllocSize);
+      void * const p =
+        rcu::s_instance.alloc(LeafNodeAllocSize, allocator::ClassIndex);
       INVARIANT(p);
       return new (p) leaf_node;
     }
@@ -925,7 +917,7 @@ private:
       if (unlikely(!n))
         return;
       n->mark_deleting();
-      rcu::s_instance.free_with_fn(n, deleter);
+      rcu::s_instance.free_with_fn(n, deleter, LeafNodeAllocSize);
     }
 
   };
@@ -960,19 +952,10 @@ private:
     inline key_search_ret
     key_search(key_slice k) const
     {
-      size_t n = this->key_slots_used();
-      ssize_t lower = 0;
-      ssize_t upper = n;
-      while (lower < upper) {
-        ssize_t i = (lower + upper) / 2;
-        key_slice k0 = this->keys_[i];
-        if (k0 == k)
-          return key_search_ret(i, n);
-        else if (k0 > k)
-          upper = i;
-        else
-          lower = i + 1;
-      }
+      const size_t n = this->key_slots_used();
+      const size_t i = slice_search::rank(this->keys_, n, k, false);
+      if (i < n && this->keys_[i] == k)
+        return key_search_ret(i, n);
       return key_search_ret(-1, n);
     }
 
@@ -983,23 +966,10 @@ private:
     inline key_search_ret
     key_lower_bound_search(key_slice k) const
     {
-      ssize_t ret = -1;
-      size_t n = this->key_slots_used();
-      ssize_t lower = 0;
-      ssize_t upper = n;
-      while (lower < upper) {
-        ssize_t i = (lower + upper) / 2;
-        key_slice k0 = this->keys_[i];
-        if (k0 == k)
-          return key_search_ret(i, n);
-        else if (k0 > k)
-          upper = i;
-        else {
-          ret = i;
-          lower = i + 1;
-        }
-      }
-      return key_search_ret(ret, n);
+      const size_t n = this->key_slots_used();
+      // the slices are unique, the last one <= k is k itself if present
+      return key_search_ret(
+          ssize_t(slice_search::rank(this->keys_, n, k, true)) - 1, n);
     }
 
     void
@@ -1015,7 +985,8 @@ private:
     static inline internal_node*
     alloc()
     {
-      void * const p = rcu::s_instance.alloc(InternalNodeAllocSize);
+      void * const p =
+        rcu::s_instance.alloc(InternalNodeAllocSize, allocator::ClassIndex);
       INVARIANT(p);
       return new (p) internal_node;
     }
@@ -1036,7 +1007,7 @@ private:
       if (unlikely(!n))
         return;
       n->mark_deleting();
-      rcu::s_instance.free_with_fn(n, deleter);
+      rcu::s_instance.free_with_fn(n, deleter, InternalNodeAllocSize);
     }
 
   } PACKED;
@@ -1238,6 +1209,17 @@ public:
     return search_impl(k, v, ns, search_info);
   }
 
+  // same interface as mbtree<P>::search_batch(), without the prefetching
+  inline size_t
+  search_batch(const key_type *keys, size_t nkeys,
+               value_type *values, bool *found) const
+  {
+    size_t nfound = 0;
+    for (size_t i = 0; i < nkeys; i++)
+      nfound += (found[i] = search(keys[i], values[i]));
+    return nfound;
+  }
+
   /**
    * The low level callback interface is as follows:
    *
@@ -1518,6 +1500,18 @@ public:
     return c.get_size();
   }
 
+  struct node_footprint {
+    size_t nleaves_;
+    size_t ninternodes_;
+    size_t bytes_; // as allocated
+  };
+
+  /**
+   * Walks the nodes of every layer, internal ones included. Same caveats as
+   * size()
+   */
+  node_footprint footprint() const;
+
   static inline uint64_t
   ExtractVersionNumber(const node_opaque_t *n)
   {
@@ -210,7 +210,7 @@ btree<P>::recursive_delete(node *n)
 #endif
     size_t n = leaf->key_slots_used();
     for (size_t i = 0; i < n; i++)
-      if (leaf->is_layer(i))
+      if (leaf->value_is_layer(i))
         recursive_delete(leaf->values_[i].n_);
     leaf_node::deleter(leaf);
   } else {
@@ -614,6 +614,39 @@ retry:
   return false;
 }
 
+template <typename P>
+typename btree<P>::node_footprint
+btree<P>::footprint() const
+{
+  rcu_region guard;
+  node_footprint ret = {0, 0, 0};
+  std::vector<node *> q;
+  // XXX: not sure if cast is safe
+  q.push_back((node *) root_);
+  while (!q.empty()) {
+    node *cur = q.back();
+    q.pop_back();
+    if (!cur->is_leaf_node()) {
+      internal_node *internal = AsInternal(cur);
+      ret.ninternodes_++;
+      ret.bytes_ += InternalNodeAllocSize;
+      const size_t n = internal->key_slots_used();
+      for (size_t i = 0; i <= n; i++)
+        if (node *child = internal->children_[i])
+          q.push_back(child);
+      continue;
+    }
+    leaf_node *leaf = AsLeaf(cur);
+    ret.nleaves_++;
+    ret.bytes_ += LeafNodeAllocSize;
+    const size_t n = leaf->key_slots_used();
+    for (size_t i = 0; i < n; i++)
+      if (leaf->value_is_layer(i))
+        q.push_back(leaf->values_[i].n_);
+  }
+  return ret;
+}
+
 template <typename P>
 typename btree<P>::leaf_node *
 btree<P>::leftmost_descend_layer(node *n) const
@@ -653,7 +686,7 @@ btree<P>::tree_walk(tree_walk_callback &callback) const
       const size_t n = leaf->key_slots_used();
       std::vector<node *> layers;
       for (size_t i = 0; i < n; i++)
-        if (leaf->is_layer(i))
+        if (leaf->value_is_layer(i))
           layers.push_back(leaf->values_[i].n_);
       leaf_node *next = leaf->next_;
       callback.on_node_begin(leaf);
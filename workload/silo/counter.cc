@@ -1,3 +1,6 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "counter.h"
 #include "util.h"
 #include "lockguard.h"
@@ -20,27 +23,50 @@ event_ctx::event_counters_lock()
   return s_lock;
 }
 
+static event_slot *
+alloc_slots()
+{
+  void *p = nullptr;
+  ALWAYS_ASSERT(!posix_memalign(
+        &p, CACHELINE_SIZE, sizeof(event_slot) * coreid::NMaxCores));
+  memset(p, 0, sizeof(event_slot) * coreid::NMaxCores);
+  return (event_slot *) p;
+}
+
+event_ctx::event_ctx(const string &name, bool avg_tag)
+  : name_(name), avg_tag_(avg_tag), slots_(alloc_slots())
+{
+}
+
 void
 event_ctx::stat(counter_data &d)
 {
   for (size_t i = 0; i < coreid::NMaxCores; i++)
-    d.count_ += counts_[i];
+    d.count_ += slots_[i].count_;
   if (avg_tag_) {
     d.type_ = counter_data::TYPE_AGG;
-    uint64_t m = 0;
+    uint64_t m = 0, s = 0;
     for (size_t i = 0; i < coreid::NMaxCores; i++) {
-      m = max(m, static_cast<event_ctx_avg *>(this)->highs_[i]);
+      m = max(m, slots_[i].max_);
+      s += slots_[i].sum_;
     }
-    uint64_t s = 0;
-    for (size_t i = 0; i < coreid::NMaxCores; i++)
-      s += static_cast<event_ctx_avg *>(this)->sums_[i];
     d.sum_ = s;
     d.max_ = m;
   }
 }
 
+void
+event_ctx::reset()
+{
+  for (size_t i = 0; i < coreid::NMaxCores; i++) {
+    slots_[i].count_ = 0;
+    slots_[i].sum_ = 0;
+    slots_[i].max_ = 0;
+  }
+}
+
 map<string, counter_data>
-event_counter::get_all_counters()
+event_counter_base::get_all_counters()
 {
   map<string, counter_data> ret;
   const map<string, event_ctx *> &evts = event_ctx::event_counters();
@@ -57,23 +83,17 @@ event_counter::get_all_counters()
 }
 
 void
-event_counter::reset_all_counters()
+event_counter_base::reset_all_counters()
 {
   const map<string, event_ctx *> &evts = event_ctx::event_counters();
   spinlock &l = event_ctx::event_counters_lock();
   lock_guard<spinlock> sl(l);
   for (auto &p : evts)
-    for (size_t i = 0; i < coreid::NMaxCores; i++) {
-      p.second->counts_[i] = 0;
-      if (p.second->avg_tag_) {
-        static_cast<event_ctx_avg *>(p.second)->sums_[i] = 0;
-        static_cast<event_ctx_avg *>(p.second)->highs_[i] = 0;
-      }
-    }
+    p.second->reset();
 }
 
 bool
-event_counter::stat(const string &name, counter_data &d)
+event_counter_base::stat(const string &name, counter_data &d)
 {
   const map<string, event_ctx *> &evts = event_ctx::event_counters();
   spinlock &l = event_ctx::event_counters_lock();
@@ -90,30 +110,16 @@ event_counter::stat(const string &name, counter_data &d)
   return true;
 }
 
-#ifdef ENABLE_EVENT_COUNTERS
-event_counter::event_counter(const string &name)
-  : ctx_(name, false)
-{
-  spinlock &l = event_ctx::event_counters_lock();
-  map<string, event_ctx *> &evts = event_ctx::event_counters();
-  lock_guard<spinlock> sl(l);
-  evts[name] = ctx_.obj();
-}
-
-event_avg_counter::event_avg_counter(const string &name)
-  : ctx_(name)
+event_counter_base::event_counter_base(
+    const string &name, bool avg_tag, bool enabled)
+  : slots_(nullptr)
 {
+  if (!enabled)
+    return;
+  event_ctx * const ctx = new event_ctx(name, avg_tag);
+  slots_ = ctx->slots_;
   spinlock &l = event_ctx::event_counters_lock();
   map<string, event_ctx *> &evts = event_ctx::event_counters();
   lock_guard<spinlock> sl(l);
-  evts[name] = ctx_.obj();
-}
-#else
-event_counter::event_counter(const string &name)
-{
-}
-
-event_avg_counter::event_avg_counter(const string &name)
-{
+  evts[name] = ctx;
 }
-#endif
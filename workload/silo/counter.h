@@ -42,8 +42,41 @@ struct counter_data {
   }
 };
 
+// counters can be compiled out per category, on top of ENABLE_EVENT_COUNTERS:
+// the categories left out of EVENT_COUNTER_CATEGORIES cost nothing on the
+// hot path and are not registered
+enum event_category {
+  EVENT_CAT_MISC      = 0x1,
+  EVENT_CAT_RCU       = 0x2,
+  EVENT_CAT_ALLOCATOR = 0x4,
+  EVENT_CAT_TUPLE     = 0x8,
+  EVENT_CAT_LOGGER    = 0x10,
+};
+
+#ifndef EVENT_COUNTER_CATEGORIES
+#define EVENT_COUNTER_CATEGORIES (~0u)
+#endif
+
+static inline constexpr bool
+event_category_enabled(unsigned c)
+{
+#ifdef ENABLE_EVENT_COUNTERS
+  return EVENT_COUNTER_CATEGORIES & c;
+#else
+  return false;
+#endif
+}
+
 namespace private_ {
 
+  // everything a core records for one counter lives in its own cache
+  // line, so that an offer() touches a single line no other core writes
+  struct event_slot {
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+  } CACHE_ALIGNED;
+
   // these objects are *never* supposed to be destructed
   // (this is a purposeful memory leak)
   struct event_ctx {
@@ -51,10 +84,7 @@ namespace private_ {
     static std::map<std::string, event_ctx *> &event_counters();
     static spinlock &event_counters_lock();
 
-    // tag to avoid making event_ctx virtual
-    event_ctx(const std::string &name, bool avg_tag)
-      : name_(name), avg_tag_(avg_tag)
-    {}
+    event_ctx(const std::string &name, bool avg_tag);
 
     ~event_ctx()
     {
@@ -65,91 +95,100 @@ namespace private_ {
     event_ctx &operator=(const event_ctx &) = delete;
     event_ctx(event_ctx &&) = delete;
 
+    // sums the slots of all the cores, only done when read
     void stat(counter_data &d);
+    void reset();
 
     const std::string name_;
     const bool avg_tag_;
 
-    // per-thread counts
-    percore<uint64_t, false, false> counts_;
-  };
-
-  // more expensive
-  struct event_ctx_avg : public event_ctx {
-    event_ctx_avg(const std::string &name) : event_ctx(name, true) {}
-    percore<uint64_t, false, false> sums_;
-    percore<uint64_t, false, false> highs_;
+    // NMaxCores slots, cache line aligned
+    event_slot *const slots_;
   };
 }
 
-class event_counter {
+class event_counter_base {
+public:
+  event_counter_base(const event_counter_base &) = delete;
+  event_counter_base &operator=(const event_counter_base &) = delete;
+  event_counter_base(event_counter_base &&) = delete;
+
+  // WARNING: an expensive operation!
+  static std::map<std::string, counter_data> get_all_counters();
+  // WARNING: an expensive operation!
+  static void reset_all_counters();
+  // WARNING: an expensive operation!
+  static bool
+  stat(const std::string &name, counter_data &d);
+
+protected:
+  // registers the counter if enabled, slots_ stays null otherwise
+  event_counter_base(const std::string &name, bool avg_tag, bool enabled);
+
+  inline ALWAYS_INLINE private_::event_slot &
+  my_slot()
+  {
+    return slots_[coreid::core_id()];
+  }
+
+  private_::event_slot *slots_;
+};
+
+template <unsigned Category>
+class basic_event_counter : public event_counter_base {
 public:
-  event_counter(const std::string &name);
+  static const bool Enabled = event_category_enabled(Category);
 
-  event_counter(const event_counter &) = delete;
-  event_counter &operator=(const event_counter &) = delete;
-  event_counter(event_counter &&) = delete;
+  basic_event_counter(const std::string &name)
+    : event_counter_base(name, false, Enabled) {}
 
   inline ALWAYS_INLINE void
   inc(uint64_t i = 1)
   {
-#ifdef ENABLE_EVENT_COUNTERS
-    ctx_->counts_.my() += i;
-#endif
+    if (Enabled)
+      my_slot().count_ += i;
   }
 
-  inline ALWAYS_INLINE event_counter &
+  inline ALWAYS_INLINE basic_event_counter &
   operator++()
   {
     inc();
     return *this;
   }
 
-  inline ALWAYS_INLINE event_counter &
+  inline ALWAYS_INLINE basic_event_counter &
   operator+=(uint64_t i)
   {
     inc(i);
     return *this;
   }
-
-  // WARNING: an expensive operation!
-  static std::map<std::string, counter_data> get_all_counters();
-  // WARNING: an expensive operation!
-  static void reset_all_counters();
-  // WARNING: an expensive operation!
-  static bool
-  stat(const std::string &name, counter_data &d);
-
-private:
-#ifdef ENABLE_EVENT_COUNTERS
-  unmanaged<private_::event_ctx> ctx_;
-#endif
 };
 
-class event_avg_counter {
+template <unsigned Category>
+class basic_event_avg_counter : public event_counter_base {
 public:
-  event_avg_counter(const std::string &name);
+  static const bool Enabled = event_category_enabled(Category);
 
-  event_avg_counter(const event_avg_counter &) = delete;
-  event_avg_counter &operator=(const event_avg_counter &) = delete;
-  event_avg_counter(event_avg_counter &&) = delete;
+  basic_event_avg_counter(const std::string &name)
+    : event_counter_base(name, true, Enabled) {}
 
   inline ALWAYS_INLINE void
   offer(uint64_t value)
   {
-#ifdef ENABLE_EVENT_COUNTERS
-    ctx_->counts_.my()++;
-    ctx_->sums_.my() += value;
-    ctx_->highs_.my() = std::max(ctx_->highs_.my(), value);
-#endif
+    if (Enabled) {
+      private_::event_slot &s = my_slot();
+      s.count_++;
+      s.sum_ += value;
+      // the line is ours, but skip the store when we can
+      if (value > s.max_)
+        s.max_ = value;
+    }
   }
-
-private:
-#ifdef ENABLE_EVENT_COUNTERS
-  unmanaged<private_::event_ctx_avg> ctx_;
-#endif
 };
 
+typedef basic_event_counter<EVENT_CAT_MISC> event_counter;
+typedef basic_event_avg_counter<EVENT_CAT_MISC> event_avg_counter;
+
 inline std::ostream &
 operator<<(std::ostream &o, const counter_data &d)
 {
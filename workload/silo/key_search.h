@@ -0,0 +1,123 @@
+#ifndef _NDB_KEY_SEARCH_H_
+#define _NDB_KEY_SEARCH_H_
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <algorithm>
+
+#include "macros.h"
+
+/**
+ * rank of a key among the sorted key slices of a btree node: the number of
+ * keys in [0, n) below k, or at most k if inclusive.
+ *
+ * nodes are small (NKeysPerNode = 15 by default), so comparing every slot at
+ * once with avx2/avx-512 takes fewer instructions than a binary search and
+ * none of its unpredictable branches. the isa is picked at runtime on the
+ * first call, the binary search is the fallback. the slots past n are never
+ * loaded, the loads are masked
+ */
+namespace slice_search {
+
+enum isa_t {
+  ISA_SCALAR,
+  ISA_AVX2,
+  ISA_AVX512,
+};
+
+static inline bool
+isa_supported(isa_t isa)
+{
+  switch (isa) {
+  case ISA_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case ISA_AVX512:
+    return __builtin_cpu_supports("avx512f");
+  default:
+    return true;
+  }
+}
+
+static inline isa_t
+detect_isa()
+{
+#ifdef BTREE_SIMD_KEY_SEARCH
+  if (isa_supported(ISA_AVX512))
+    return ISA_AVX512;
+  if (isa_supported(ISA_AVX2))
+    return ISA_AVX2;
+#endif
+  return ISA_SCALAR;
+}
+
+static inline isa_t
+current_isa()
+{
+  static const isa_t isa = detect_isa();
+  return isa;
+}
+
+static inline size_t
+rank_scalar(const uint64_t *keys, size_t n, uint64_t k, bool inclusive)
+{
+  return (inclusive ? std::upper_bound(keys, keys + n, k) :
+                      std::lower_bound(keys, keys + n, k)) - keys;
+}
+
+// avx2 only compares signed 64-bit ints, flipping the sign bit of both sides
+// orders the key slices as unsigned
+__attribute__((target("avx2"))) static inline size_t
+rank_avx2(const uint64_t *keys, size_t n, uint64_t k, bool inclusive)
+{
+  const __m256i bias = _mm256_set1_epi64x(int64_t(1) << 63);
+  const __m256i kb = _mm256_xor_si256(_mm256_set1_epi64x(k), bias);
+  const __m256i lanes = _mm256_set_epi64x(3, 2, 1, 0);
+  size_t ret = 0;
+  for (size_t i = 0; i < n; i += 4) {
+    const __m256i valid =
+      _mm256_cmpgt_epi64(_mm256_set1_epi64x(n - i), lanes);
+    const __m256i v = _mm256_xor_si256(
+        _mm256_maskload_epi64((const long long *) (keys + i), valid), bias);
+    // key < k, or !(key > k) for key <= k
+    const __m256i below = inclusive ?
+      _mm256_andnot_si256(_mm256_cmpgt_epi64(v, kb), valid) :
+      _mm256_and_si256(_mm256_cmpgt_epi64(kb, v), valid);
+    ret += __builtin_popcount(
+        _mm256_movemask_pd(_mm256_castsi256_pd(below)));
+  }
+  return ret;
+}
+
+__attribute__((target("avx512f"))) static inline size_t
+rank_avx512(const uint64_t *keys, size_t n, uint64_t k, bool inclusive)
+{
+  const __m512i kv = _mm512_set1_epi64(k);
+  size_t ret = 0;
+  for (size_t i = 0; i < n; i += 8) {
+    const __mmask8 valid = n - i >= 8 ? 0xff : (1u << (n - i)) - 1;
+    const __m512i v = _mm512_maskz_loadu_epi64(valid, keys + i);
+    const __mmask8 below = inclusive ?
+      _mm512_mask_cmple_epu64_mask(valid, v, kv) :
+      _mm512_mask_cmplt_epu64_mask(valid, v, kv);
+    ret += __builtin_popcount(below);
+  }
+  return ret;
+}
+
+static inline ALWAYS_INLINE size_t
+rank(const uint64_t *keys, size_t n, uint64_t k, bool inclusive)
+{
+  switch (current_isa()) {
+  case ISA_AVX512:
+    return rank_avx512(keys, n, k, inclusive);
+  case ISA_AVX2:
+    return rank_avx2(keys, n, k, inclusive);
+  default:
+    return rank_scalar(keys, n, k, inclusive);
+  }
+}
+
+}
+
+#endif /* _NDB_KEY_SEARCH_H_ */
@@ -7,6 +7,7 @@
 /** options */
 //#define TUPLE_PREFETCH
 #define BTREE_NODE_PREFETCH
+#define BTREE_SIMD_KEY_SEARCH
 //#define DIE_ON_ABORT
 //#define TRAP_LARGE_ALLOOCATIONS
 #define USE_BUILTIN_MEMFUNCS
@@ -16,6 +17,7 @@
 #define BTREE_NODE_ALLOC_CACHE_ALIGNED
 #define TXN_BTREE_DUMP_PURGE_STATS
 //#define ENABLE_EVENT_COUNTERS
+//#define EVENT_COUNTER_CATEGORIES (EVENT_CAT_MISC | EVENT_CAT_LOGGER) // see counter.h
 //#define ENABLE_BENCH_TXN_COUNTERS
 #define USE_VARINT_ENCODING
 //#define DISABLE_FIELD_SELECTION
@@ -122,7 +122,7 @@ class simple_threadinfo {
 
     // memory allocation
     void* allocate(size_t sz, memtag) {
-        return rcu::s_instance.alloc(sz);
+        return rcu::s_instance.alloc(sz, allocator::ClassIndex);
     }
     void deallocate(void* p, size_t sz, memtag) {
 	// in C++ allocators, 'p' must be nonnull
@@ -135,7 +135,7 @@ class simple_threadinfo {
 
     void* pool_allocate(size_t sz, memtag) {
 	int nl = (sz + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
-        return rcu::s_instance.alloc(nl * CACHE_LINE_SIZE);
+        return rcu::s_instance.alloc(nl * CACHE_LINE_SIZE, allocator::ClassIndex);
     }
     void pool_deallocate(void* p, size_t sz, memtag) {
 	int nl = (sz + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
@@ -259,6 +259,21 @@ public:
   inline bool search(const key_type &k, value_type &v,
                      versioned_node_t *search_info = nullptr) const;
 
+  // keys searched together by search_batch()
+  static const size_t SearchBatchWidth = 16;
+
+  /**
+   * Looks up nkeys keys at once. The descents of (up to SearchBatchWidth)
+   * keys are first walked in lockstep, prefetching the next level of every
+   * key before reading any of it, so that their cache misses overlap. The
+   * lookups proper then mostly hit in the cache.
+   *
+   * found[i] tells whether keys[i] was found, in which case values[i] holds
+   * its value. Returns the number of keys found
+   */
+  inline size_t search_batch(const key_type *keys, size_t nkeys,
+                             value_type *values, bool *found) const;
+
   /**
    * The low level callback interface is as follows:
    *
@@ -443,6 +458,18 @@ public:
    */
   inline size_t size() const;
 
+  struct node_footprint {
+    size_t nleaves_;
+    size_t ninternodes_;
+    size_t bytes_; // as allocated, without the external key suffixes
+  };
+
+  /**
+   * Walks the nodes of every layer, internal ones included. Same caveats as
+   * size()
+   */
+  node_footprint footprint() const;
+
   static inline uint64_t
   ExtractVersionNumber(const node_opaque_t *n) {
     // XXX(stephentu): I think we must use stable_version() for
@@ -474,6 +501,10 @@ public:
  private:
   Masstree::basic_table<P> table_;
 
+  // only touches the first layer, which is where all the keys of up to
+  // 8 bytes live and where longer keys spend most of their misses
+  inline void prefetch_descents(const key_type *keys, size_t n) const;
+
   static leaf_type* leftmost_descend_layer(node_base_type* n);
   class size_walk_callback;
   template <bool Reverse> class search_range_scanner_base;
@@ -580,6 +611,36 @@ inline size_t mbtree<P>::size() const
   return c.size_;
 }
 
+template <typename P>
+typename mbtree<P>::node_footprint mbtree<P>::footprint() const
+{
+  rcu_region guard;
+  node_footprint ret = {0, 0, 0};
+  std::vector<node_base_type *> q;
+  q.push_back(table_.root());
+  while (!q.empty()) {
+    node_base_type *cur = q.back();
+    q.pop_back();
+    if (!cur->isleaf()) {
+      internode_type *in = static_cast<internode_type*>(cur);
+      ret.ninternodes_++;
+      ret.bytes_ += iceil(sizeof(internode_type), CACHE_LINE_SIZE);
+      for (int i = 0; i <= in->size(); i++)
+        if (node_base_type *child = in->child_[i])
+          q.push_back(child);
+      continue;
+    }
+    leaf_type *leaf = static_cast<leaf_type*>(cur);
+    ret.nleaves_++;
+    ret.bytes_ += leaf->allocated_size();
+    auto perm = leaf->permutation();
+    for (int i = 0; i != perm.size(); ++i)
+      if (leaf->is_layer(perm[i]))
+        q.push_back(leaf->lv_[perm[i]].layer());
+  }
+  return ret;
+}
+
 template <typename P>
 inline bool mbtree<P>::search(const key_type &k, value_type &v,
                               versioned_node_t *search_info) const
@@ -595,6 +656,59 @@ inline bool mbtree<P>::search(const key_type &k, value_type &v,
   return found;
 }
 
+template <typename P>
+inline void mbtree<P>::prefetch_descents(const key_type *keys, size_t n) const
+{
+  INVARIANT(n <= SearchBatchWidth);
+  // the nodes are only read to find out what to prefetch next, so racing
+  // with writers is harmless, and the rcu region keeps them from being freed
+  const node_base_type *nodes[SearchBatchWidth];
+  for (size_t i = 0; i < n; i++)
+    nodes[i] = table_.root();
+  for (bool more = true; more;) {
+    more = false;
+    for (size_t i = 0; i < n; i++) {
+      const node_base_type * const nd = nodes[i];
+      if (!nd || nd->isleaf()) {
+        nodes[i] = nullptr;
+        continue;
+      }
+      const internode_type * const in = static_cast<const internode_type *>(nd);
+      const typename internode_type::key_type ka(
+          reinterpret_cast<const char *>(keys[i].data()), keys[i].length());
+      const node_base_type * const child =
+        in->child_[internode_type::bound_type::upper(ka, *in)];
+      if (child) {
+        child->prefetch_full();
+        more = true;
+      }
+      nodes[i] = child;
+    }
+  }
+}
+
+template <typename P>
+inline size_t mbtree<P>::search_batch(const key_type *keys, size_t nkeys,
+                                      value_type *values, bool *found) const
+{
+  rcu_region guard;
+  threadinfo ti;
+  size_t nfound = 0;
+  for (size_t base = 0; base < nkeys; base += SearchBatchWidth) {
+    const size_t n = std::min(nkeys - base, SearchBatchWidth);
+    prefetch_descents(keys + base, n);
+    for (size_t i = base; i < base + n; i++) {
+      Masstree::unlocked_tcursor<P> lp(table_, keys[i].data(), keys[i].length());
+      found[i] = lp.find_unlocked(ti);
+      if (found[i]) {
+        values[i] = lp.value();
+        nfound++;
+      }
+    }
+  }
+  return nfound;
+}
+
 template <typename P>
 inline bool mbtree<P>::insert(const key_type &k, value_type v,
                               value_type *old_v,
@@ -19,23 +19,28 @@ using namespace util;
 
 rcu rcu::s_instance;
 
-static event_counter evt_rcu_deletes("rcu_deletes");
-static event_counter evt_rcu_frees("rcu_frees");
-static event_counter evt_rcu_local_reaps("rcu_local_reaps");
-static event_counter evt_rcu_incomplete_local_reaps("rcu_incomplete_local_reaps");
-static event_counter evt_rcu_loop_reaps("rcu_loop_reaps");
-static event_counter *evt_allocator_arena_allocations[::allocator::MAX_ARENAS] = {nullptr};
-static event_counter *evt_allocator_arena_deallocations[::allocator::MAX_ARENAS] = {nullptr};
-static event_counter evt_allocator_large_allocation("allocator_large_allocation");
-
-static event_avg_counter evt_avg_gc_reaper_queue_len("avg_gc_reaper_queue_len");
-static event_avg_counter evt_avg_rcu_delete_queue_len("avg_rcu_delete_queue_len");
-static event_avg_counter evt_avg_rcu_local_delete_queue_len("avg_rcu_local_delete_queue_len");
-static event_avg_counter evt_avg_rcu_sync_try_release("avg_rcu_sync_try_release");
-static event_avg_counter evt_avg_time_inbetween_rcu_epochs_usec(
+static basic_event_counter<EVENT_CAT_RCU> evt_rcu_deletes("rcu_deletes");
+static basic_event_counter<EVENT_CAT_RCU> evt_rcu_frees("rcu_frees");
+static basic_event_counter<EVENT_CAT_RCU> evt_rcu_local_reaps("rcu_local_reaps");
+static basic_event_counter<EVENT_CAT_RCU> evt_rcu_incomplete_local_reaps("rcu_incomplete_local_reaps");
+static basic_event_counter<EVENT_CAT_RCU> evt_rcu_loop_reaps("rcu_loop_reaps");
+static basic_event_counter<EVENT_CAT_ALLOCATOR> *evt_allocator_arena_allocations[::allocator::MAX_ARENAS] = {nullptr};
+static basic_event_counter<EVENT_CAT_ALLOCATOR> *evt_allocator_arena_deallocations[::allocator::MAX_ARENAS] = {nullptr};
+static basic_event_counter<EVENT_CAT_ALLOCATOR> evt_allocator_large_allocation("allocator_large_allocation");
+static basic_event_counter<EVENT_CAT_RCU> evt_rcu_deferred_stalls("rcu_deferred_stalls");
+
+static basic_event_avg_counter<EVENT_CAT_RCU> evt_avg_gc_reaper_queue_len("avg_gc_reaper_queue_len");
+static basic_event_avg_counter<EVENT_CAT_RCU> evt_avg_rcu_delete_queue_len("avg_rcu_delete_queue_len");
+static basic_event_avg_counter<EVENT_CAT_RCU> evt_avg_rcu_local_delete_queue_len("avg_rcu_local_delete_queue_len");
+static basic_event_avg_counter<EVENT_CAT_RCU> evt_avg_rcu_sync_try_release("avg_rcu_sync_try_release");
+static basic_event_avg_counter<EVENT_CAT_RCU> evt_avg_time_inbetween_rcu_epochs_usec(
     "avg_time_inbetween_rcu_epochs_usec");
-static event_avg_counter evt_avg_time_inbetween_allocator_releases_usec(
+static basic_event_avg_counter<EVENT_CAT_ALLOCATOR> evt_avg_time_inbetween_allocator_releases_usec(
     "avg_time_inbetween_allocator_releases_usec");
+static basic_event_avg_counter<EVENT_CAT_RCU> evt_avg_rcu_deferred_stall_usec(
+    "avg_rcu_deferred_stall_usec");
+
+static size_t g_max_deferred_bytes = 0;
 
 #ifdef MEMCHECK_MAGIC
 static void
@@ -101,7 +106,7 @@ check_pointer_or_die(void *p, size_t alloc_size)
 #endif
 
 void *
-rcu::sync::alloc(size_t sz)
+rcu::sync::alloc(size_t sz, ::allocator::AllocClass cls)
 {
   if (pin_cpu_ == -1)
     // fallback to regular allocator
@@ -113,14 +118,15 @@ rcu::sync::alloc(size_t sz)
     ++evt_allocator_large_allocation;
     return malloc(sz);
   }
-  ensure_arena(arena);
-  void *p = arenas_[arena];
+  cls = ::allocator::EffectiveClass(cls);
+  ensure_arena(arena, cls);
+  void *p = arenas_[cls][arena];
   INVARIANT(p);
 #ifdef MEMCHECK_MAGIC
   const size_t alloc_size = (arena + 1) * ::allocator::AllocAlignment;
   check_pointer_or_die(p, alloc_size);
 #endif
-  arenas_[arena] = *reinterpret_cast<void **>(p);
+  arenas_[cls][arena] = *reinterpret_cast<void **>(p);
   evt_allocator_arena_allocations[arena]->inc();
   return p;
 }
@@ -147,17 +153,19 @@ rcu::sync::dealloc(void *p, size_t sz)
   auto sizes = ::allocator::ArenaSize(sz);
   auto arena = sizes.second;
   ALWAYS_ASSERT(arena < ::allocator::MAX_ARENAS);
-  *reinterpret_cast<void **>(p) = arenas_[arena];
+  // goes back to the arena of the hugepage it came from
+  void *&head = arenas_[::allocator::PointerToClass(p)][arena];
+  *reinterpret_cast<void **>(p) = head;
 #ifdef MEMCHECK_MAGIC
   const size_t alloc_size = (arena + 1) * ::allocator::AllocAlignment;
   ALWAYS_ASSERT( ((uintptr_t)p % alloc_size) == 0 );
   NDB_MEMSET(
       (char *) p + sizeof(void **),
       MEMCHECK_MAGIC, alloc_size - sizeof(void **));
-  ALWAYS_ASSERT(*((void **) p) == arenas_[arena]);
+  ALWAYS_ASSERT(*((void **) p) == head);
   check_pointer_or_die(p, alloc_size);
 #endif
-  arenas_[arena] = p;
+  head = p;
   evt_allocator_arena_deallocations[arena]->inc();
   deallocs_[arena]++;
 }
@@ -183,33 +191,60 @@ void
 rcu::sync::do_release()
 {
 #ifdef MEMCHECK_MAGIC
-  for (size_t i = 0; i < ::allocator::MAX_ARENAS; i++) {
-    const size_t alloc_size = (i + 1) * ::allocator::AllocAlignment;
-    void *p = arenas_[i];
-    while (p) {
-      check_pointer_or_die(p, alloc_size);
-      p = *((void **) p);
+  for (size_t c = 0; c < ::allocator::NClasses; c++) {
+    for (size_t i = 0; i < ::allocator::MAX_ARENAS; i++) {
+      const size_t alloc_size = (i + 1) * ::allocator::AllocAlignment;
+      void *p = arenas_[c][i];
+      while (p) {
+        check_pointer_or_die(p, alloc_size);
+        p = *((void **) p);
+      }
     }
   }
 #endif
-  ::allocator::ReleaseArenas(&arenas_[0]);
+  for (size_t c = 0; c < ::allocator::NClasses; c++)
+    ::allocator::ReleaseArenas(
+        &arenas_[c][0], ::allocator::AllocClass(c));
   NDB_MEMSET(&arenas_[0], 0, sizeof(arenas_));
   NDB_MEMSET(&deallocs_[0], 0, sizeof(deallocs_));
 }
 
 void
 rcu::sync::do_cleanup()
+{
+  do_reap();
+  if (likely(!g_max_deferred_bytes || deferred_bytes_ <= g_max_deferred_bytes))
+    return;
+  // backpressure, outside of any region so the epochs can move meanwhile.
+  // gives up after a few epochs rather than waiting forever on a thread
+  // stuck in a region
+  ++evt_rcu_deferred_stalls;
+  const uint64_t start_us = timer::cur_usec();
+  const uint64_t tick_ns = ticker::tick_period_us() * 1000;
+  struct timespec t;
+  t.tv_sec  = tick_ns / ONE_SECOND_NS;
+  t.tv_nsec = tick_ns % ONE_SECOND_NS;
+  for (size_t i = 0; i < 4 * EpochTimeMultiplier; i++) {
+    nanosleep(&t, nullptr);
+    if (do_reap() && deferred_bytes_ <= g_max_deferred_bytes)
+      break;
+  }
+  evt_avg_rcu_deferred_stall_usec.offer(timer::cur_usec() - start_us);
+}
+
+bool
+rcu::sync::do_reap()
 {
   // compute cleaner epoch
   const uint64_t clean_tick_exclusive = impl_->cleaning_rcu_tick_exclusive();
   if (!clean_tick_exclusive)
-    return;
+    return false;
   const uint64_t clean_tick = clean_tick_exclusive - 1;
 
   INVARIANT(last_reaped_epoch_ <= clean_tick);
   INVARIANT(scratch_.empty());
   if (last_reaped_epoch_ == clean_tick)
-    return;
+    return false;
 
 #ifdef ENABLE_EVENT_COUNTERS
   const uint64_t now = timer::cur_usec();
@@ -221,12 +256,22 @@ rcu::sync::do_cleanup()
 #endif
   last_reaped_epoch_ = clean_tick;
 
+  for (size_t i = 0; i < NDeferredTicks; i++) {
+    deferred_tick &d = deferred_ticks_[i];
+    if (d.bytes_ && d.tick_ <= clean_tick) {
+      INVARIANT(deferred_bytes_ >= d.bytes_);
+      deferred_bytes_ -= d.bytes_;
+      d.bytes_ = 0;
+    }
+  }
+
   scratch_.empty_accept_from(queue_, clean_tick);
   scratch_.transfer_freelist(queue_);
   rcu::px_queue &q = scratch_;
   if (q.empty())
-    return;
-  scoped_rcu_region guard;
+    return true;
+  // no cleanup when leaving, we are the cleanup
+  scoped_rcu_base<false> guard;
   size_t n = 0;
   for (auto it = q.begin(); it != q.end(); ++it, ++n) {
     try {
@@ -250,10 +295,11 @@ rcu::sync::do_cleanup()
     last_release_timestamp_us_ = now;
 #endif
   }
+  return true;
 }
 
 void
-rcu::free_with_fn(void *p, deleter_t fn)
+rcu::free_with_fn(void *p, deleter_t fn, size_t sz)
 {
   sync &s = mysync();
   uint64_t cur_tick = 0; // ticker units
@@ -264,6 +310,8 @@ rcu::free_with_fn(void *p, deleter_t fn)
   // all threads are either at cur_tick or cur_tick + 1, so we must wait for
   // the system to move beyond cur_tick + 1
   s.queue_.enqueue(delete_entry(p, fn), to_rcu_ticks(cur_tick + 1));
+  if (sz)
+    s.defer_bytes(to_rcu_ticks(cur_tick + 1), sz);
   ++evt_rcu_frees;
 }
 
@@ -279,6 +327,7 @@ rcu::dealloc_rcu(void *p, size_t sz)
   // all threads are either at cur_tick or cur_tick + 1, so we must wait for
   // the system to move beyond cur_tick + 1
   s.queue_.enqueue(delete_entry(p, sz), to_rcu_ticks(cur_tick + 1));
+  s.defer_bytes(to_rcu_ticks(cur_tick + 1), sz);
   ++evt_rcu_frees;
 }
 
@@ -296,6 +345,32 @@ rcu::pin_current_thread(size_t cpu)
   s.do_release();
 }
 
+void
+rcu::SetMaxDeferredBytes(size_t sz)
+{
+  g_max_deferred_bytes = sz;
+}
+
+size_t
+rcu::deferred_bytes() const
+{
+  size_t ret = 0;
+  for (size_t i = 0; i < NMAXCORES; i++)
+    if (const sync *s = syncs_.view(i))
+      ret += s->deferred_bytes();
+  return ret;
+}
+
+size_t
+rcu::peak_deferred_bytes() const
+{
+  size_t ret = 0;
+  for (size_t i = 0; i < NMAXCORES; i++)
+    if (const sync *s = syncs_.view(i))
+      ret += s->peak_deferred_bytes();
+  return ret;
+}
+
 void
 rcu::fault_region()
 {
@@ -312,9 +387,9 @@ rcu::rcu()
   // we are assuming only one rcu object is ever created
   for (size_t i = 0; i < ::allocator::MAX_ARENAS; i++) {
     evt_allocator_arena_allocations[i] =
-      new event_counter("allocator_arena" + to_string(i) + "_allocation");
+      new basic_event_counter<EVENT_CAT_ALLOCATOR>("allocator_arena" + to_string(i) + "_allocation");
     evt_allocator_arena_deallocations[i] =
-      new event_counter("allocator_arena" + to_string(i) + "_deallocation");
+      new basic_event_counter<EVENT_CAT_ALLOCATOR>("allocator_arena" + to_string(i) + "_deallocation");
   }
 }
 
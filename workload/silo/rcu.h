@@ -81,6 +81,10 @@ public:
 
   static const size_t NQueueGroups = 32;
 
+  // the deferred bytes are tracked by the rcu tick they become reclaimable
+  // at, in this many slots
+  static const size_t NDeferredTicks = 4;
+
   // all RCU threads interact w/ the RCU subsystem via
   // a sync struct
   //
@@ -103,10 +107,20 @@ public:
 
     // local memory allocator
     ssize_t pin_cpu_;
-    void *arenas_[allocator::MAX_ARENAS];
+    void *arenas_[allocator::NClasses][allocator::MAX_ARENAS];
     size_t deallocs_[allocator::MAX_ARENAS]; // keeps track of the number of
                                              // un-released deallocations
 
+    // bytes queued for reclamation and not reclaimed yet (as far as the
+    // callers told their size)
+    struct deferred_tick {
+      uint64_t tick_;
+      size_t bytes_;
+    };
+    deferred_tick deferred_ticks_[NDeferredTicks];
+    size_t deferred_bytes_;
+    size_t peak_deferred_bytes_;
+
   public:
 
     sync(rcu *impl)
@@ -118,12 +132,15 @@ public:
 #endif
       , impl_(impl)
       , pin_cpu_(-1)
+      , deferred_bytes_(0)
+      , peak_deferred_bytes_(0)
     {
       ALWAYS_ASSERT(((uintptr_t)this % CACHELINE_SIZE) == 0);
       queue_.alloc_freelist(NQueueGroups);
       scratch_.alloc_freelist(NQueueGroups);
       NDB_MEMSET(&arenas_[0], 0, sizeof(arenas_));
       NDB_MEMSET(&deallocs_[0], 0, sizeof(deallocs_));
+      NDB_MEMSET(&deferred_ticks_[0], 0, sizeof(deferred_ticks_));
     }
 
     inline void
@@ -140,7 +157,8 @@ public:
 
     // allocate a block of memory of size sz. caller needs to remember
     // the size of the allocation when calling free
-    void *alloc(size_t sz);
+    void *alloc(size_t sz,
+                allocator::AllocClass cls = allocator::ClassGeneral);
 
     // allocates a block of memory of size sz, with the intention of never
     // free-ing it. is meant for reasonably large allocations (order of pages)
@@ -158,25 +176,45 @@ public:
 
     inline unsigned depth() const { return depth_; }
 
+    inline size_t deferred_bytes() const { return deferred_bytes_; }
+    inline size_t peak_deferred_bytes() const { return peak_deferred_bytes_; }
+
   private:
 
     void do_release();
 
+    // returns true if anything was reaped
+    bool do_reap();
+
+    inline void
+    defer_bytes(uint64_t rcu_tick, size_t sz)
+    {
+      deferred_tick &d = deferred_ticks_[rcu_tick % NDeferredTicks];
+      // a slot still holding an older tick gets reclaimed later rather
+      // than earlier, so the count only ever overestimates
+      if (d.tick_ < rcu_tick)
+        d.tick_ = rcu_tick;
+      d.bytes_ += sz;
+      deferred_bytes_ += sz;
+      if (deferred_bytes_ > peak_deferred_bytes_)
+        peak_deferred_bytes_ = deferred_bytes_;
+    }
+
     inline void
-    ensure_arena(size_t arena)
+    ensure_arena(size_t arena, allocator::AllocClass cls)
     {
-      if (likely(arenas_[arena]))
+      if (likely(arenas_[cls][arena]))
         return;
       INVARIANT(pin_cpu_ >= 0);
-      arenas_[arena] = allocator::AllocateArenas(pin_cpu_, arena);
+      arenas_[cls][arena] = allocator::AllocateArenas(pin_cpu_, arena, cls);
     }
   };
 
   // thin forwarders
   inline void *
-  alloc(size_t sz)
+  alloc(size_t sz, allocator::AllocClass cls = allocator::ClassGeneral)
   {
-    return mysync().alloc(sz);
+    return mysync().alloc(sz, cls);
   }
 
   inline void *
@@ -207,13 +245,14 @@ public:
     mysync().do_cleanup();
   }
 
-  void free_with_fn(void *p, deleter_t fn);
+  // sz is only accounted for in the deferred bytes, 0 if unknown
+  void free_with_fn(void *p, deleter_t fn, size_t sz = 0);
 
   template <typename T>
   inline void
   free(T *p)
   {
-    free_with_fn(p, deleter<T>);
+    free_with_fn(p, deleter<T>, sizeof(T));
   }
 
   template <typename T>
@@ -263,6 +302,15 @@ public:
 
   void fault_region();
 
+  // a thread leaving its outermost region with more than sz bytes still
+  // deferred waits for the epochs to move until it can reclaim below sz,
+  // bounding the stale memory each thread holds. 0 disables the bound
+  static void SetMaxDeferredBytes(size_t sz);
+
+  // summed over the threads, the peaks are those of each thread
+  size_t deferred_bytes() const;
+  size_t peak_deferred_bytes() const;
+
   static rcu s_instance CACHE_ALIGNED; // system wide instance
 
   static void Test();
@@ -0,0 +1,300 @@
+/**
+ * Rebuilds the database from the log files of the txn_logger, to measure
+ * how long a restart takes.
+ *
+ * A logger writes the buffers of its cores back to back into its own file,
+ * so each file is replayed by a thread of its own and the files are replayed
+ * in parallel. Every write of a txn is applied to one masstree keyed by the
+ * record key: the log does not say which table a record belongs to, and the
+ * keys of the benchmarks are unique across tables anyway. The writes of a key
+ * can be spread over several files, so the one with the largest TID wins, as
+ * in the database itself; an empty value is a delete and stays a tombstone.
+ * Values are the bytes the tuple writers logged, which are whole records for
+ * the string values of benchmarks/.
+ *
+ * A buffer that cannot be decoded, e.g. the partially written tail after a
+ * crash, ends the replay of its file.
+ */
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lz4.h>
+
+#include "macros.h"
+#include "btree_choice.h"
+#include "lockguard.h"
+#include "rcu.h"
+#include "spinlock.h"
+#include "txn_proto2_impl.h"
+#include "record/serializer.h"
+#include "util.h"
+
+using namespace std;
+using namespace util;
+
+static int g_verbose = 0;
+static int g_compress = 0;
+
+// the latest write of a key, allocated with its value behind it
+struct record {
+  uint64_t tid_;
+  uint32_t size_;
+  uint8_t data_[0];
+};
+
+static concurrent_btree g_btr;
+
+// serializes the writes of a key replayed by several files
+static const size_t NStripes = 4096;
+static spinlock g_stripes[NStripes];
+
+static inline spinlock &
+stripe_for(const uint8_t *k, size_t sz)
+{
+  // FNV-1a
+  uint64_t h = 14695981039346656037UL;
+  for (size_t i = 0; i < sz; i++)
+    h = (h ^ k[i]) * 1099511628211UL;
+  return g_stripes[h % NStripes];
+}
+
+struct replay_stats {
+  uint64_t nbytes_ = 0;  // of the log file consumed
+  uint64_t nbufs_ = 0;
+  uint64_t ntxns_ = 0;
+  uint64_t nwrites_ = 0;
+  uint64_t napplied_ = 0; // writes newer than the key had so far
+  uint64_t max_tid_ = 0;
+  bool torn_ = false;
+
+  replay_stats &
+  operator+=(const replay_stats &o)
+  {
+    nbytes_ += o.nbytes_;
+    nbufs_ += o.nbufs_;
+    ntxns_ += o.ntxns_;
+    nwrites_ += o.nwrites_;
+    napplied_ += o.napplied_;
+    max_tid_ = max(max_tid_, o.max_tid_);
+    return *this;
+  }
+};
+
+static bool
+apply(const uint8_t *k, size_t k_nbytes, uint64_t tid,
+      const uint8_t *v, size_t v_nbytes)
+{
+  const varkey key(k, k_nbytes);
+  ::lock_guard<spinlock> l(stripe_for(k, k_nbytes));
+  concurrent_btree::value_type old_v = nullptr;
+  if (g_btr.search(key, old_v) &&
+      reinterpret_cast<const record *>(old_v)->tid_ >= tid)
+    return false;
+  record * const r =
+    reinterpret_cast<record *>(malloc(sizeof(record) + v_nbytes));
+  r->tid_ = tid;
+  r->size_ = v_nbytes;
+  NDB_MEMCPY(&r->data_[0], v, v_nbytes);
+  g_btr.insert(key, reinterpret_cast<concurrent_btree::value_type>(r));
+  free(old_v);
+  return true;
+}
+
+// decodes and applies txns from [p, end) until n of them are done or the
+// input runs out, returns the end of the last txn, nullptr if one is broken
+static const uint8_t *
+replay_txns(const uint8_t *p, const uint8_t *end, uint64_t &n,
+            replay_stats &stats)
+{
+  serializer<uint32_t, true> vs_uint32_t;
+  serializer<uint64_t, false> s_uint64_t;
+  for (; n && p < end; n--) {
+    uint64_t tid;
+    uint32_t nwrites;
+    if (!(p = s_uint64_t.failsafe_read(p, end - p, &tid)) ||
+        !(p = vs_uint32_t.failsafe_read(p, end - p, &nwrites)))
+      return nullptr;
+    for (uint32_t i = 0; i < nwrites; i++) {
+      uint32_t k_nbytes, v_nbytes;
+      if (!(p = vs_uint32_t.failsafe_read(p, end - p, &k_nbytes)) ||
+          size_t(end - p) < k_nbytes)
+        return nullptr;
+      const uint8_t * const k = p;
+      p += k_nbytes;
+      if (!(p = vs_uint32_t.failsafe_read(p, end - p, &v_nbytes)) ||
+          size_t(end - p) < v_nbytes)
+        return nullptr;
+      stats.napplied_ += apply(k, k_nbytes, tid, p, v_nbytes);
+      p += v_nbytes;
+    }
+    stats.ntxns_++;
+    stats.nwrites_ += nwrites;
+    stats.max_tid_ = max(stats.max_tid_, tid);
+  }
+  return p;
+}
+
+// replays the buffer at p, returns its end or nullptr if it is broken
+static const uint8_t *
+replay_buffer(const uint8_t *p, const uint8_t *end, uint8_t *horizon,
+              replay_stats &stats)
+{
+  txn_logger::logbuf_header h;
+  NDB_MEMCPY(&h, p, sizeof(h));
+  p += sizeof(h);
+  uint64_t n = h.nentries_;
+  if (!g_compress)
+    return (p = replay_txns(p, end, n, stats)) && !n ? p : nullptr;
+
+  // a series of lz4 compressed horizons, each prefixed by its size
+  serializer<uint32_t, false> s_uint32_t;
+  while (n) {
+    uint32_t nbytes;
+    if (!(p = s_uint32_t.failsafe_read(p, end - p, &nbytes)) ||
+        size_t(end - p) < nbytes)
+      return nullptr;
+    const int ret = LZ4_decompress_safe(
+        (const char *) p, (char *) horizon, nbytes,
+        txn_logger::g_horizon_buffer_size);
+    if (ret < 0)
+      return nullptr;
+    const uint8_t * const hend = horizon + ret;
+    if (replay_txns(horizon, hend, n, stats) != hend)
+      return nullptr;
+    p += nbytes;
+  }
+  return p;
+}
+
+static void
+replay_file(const string &fname, replay_stats &stats)
+{
+  const int fd = open(fname.c_str(), O_RDONLY);
+  if (fd == -1) {
+    perror(fname.c_str());
+    exit(1);
+  }
+  struct stat st;
+  ALWAYS_ASSERT(fstat(fd, &st) == 0);
+  if (!st.st_size) {
+    close(fd);
+    return;
+  }
+  void * const m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  close(fd);
+  madvise(m, st.st_size, MADV_SEQUENTIAL);
+
+  vector<uint8_t> horizon(txn_logger::g_horizon_buffer_size);
+  const uint8_t * const start = reinterpret_cast<const uint8_t *>(m);
+  const uint8_t * const end = start + st.st_size;
+  const uint8_t *p = start;
+  while (size_t(end - p) >= sizeof(txn_logger::logbuf_header)) {
+    // a preallocated or zeroed tail
+    if (!reinterpret_cast<const txn_logger::logbuf_header *>(p)->nentries_)
+      break;
+    scoped_rcu_region guard;
+    const uint8_t * const next = replay_buffer(p, end, &horizon[0], stats);
+    if (!next) {
+      stats.torn_ = true;
+      break;
+    }
+    p = next;
+    stats.nbufs_++;
+  }
+  stats.nbytes_ = p - start;
+  if (stats.torn_)
+    cerr << fname << ": stopped at a broken buffer at offset "
+         << stats.nbytes_ << " of " << st.st_size << endl;
+  munmap(m, st.st_size);
+}
+
+int
+main(int argc, char **argv)
+{
+  vector<string> logfiles;
+
+  while (1) {
+    static struct option long_options[] =
+    {
+      {"verbose"      , no_argument       , &g_verbose  , 1}   ,
+      {"log-compress" , no_argument       , &g_compress , 1}   ,
+      {"logfile"      , required_argument , 0           , 'l'} ,
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "l:", long_options, &option_index);
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      if (long_options[option_index].flag != 0)
+        break;
+      abort();
+      break;
+
+    case 'l':
+      logfiles.emplace_back(optarg);
+      break;
+
+    case '?':
+      /* getopt_long already printed an error message. */
+      exit(1);
+
+    default:
+      abort();
+    }
+  }
+  ALWAYS_ASSERT(!logfiles.empty());
+  ALWAYS_ASSERT(logfiles.size() <= txn_logger::g_nmax_loggers);
+
+  if (g_verbose)
+    cerr << "{logfiles=" << logfiles
+         << ", compress=" << g_compress
+         << "}" << endl;
+
+  vector<replay_stats> stats(logfiles.size());
+  vector<thread> replayers;
+  timer tt;
+  for (size_t i = 0; i < logfiles.size(); i++)
+    replayers.emplace_back(replay_file, cref(logfiles[i]), ref(stats[i]));
+  for (auto &t : replayers)
+    t.join();
+  const double xsec = tt.lap_ms() / 1000.0;
+
+  replay_stats total;
+  for (auto &s : stats)
+    total += s;
+  const double rate = double(total.ntxns_) / xsec;
+  const double mbsec = double(total.nbytes_) / (1 << 20) / xsec;
+  if (g_verbose) {
+    for (size_t i = 0; i < logfiles.size(); i++)
+      cerr << logfiles[i] << ": " << stats[i].nbufs_ << " buffers, "
+           << stats[i].ntxns_ << " txns, " << stats[i].nbytes_ << " bytes"
+           << (stats[i].torn_ ? " (torn)" : "") << endl;
+    cerr << "recovered " << total.ntxns_ << " txns, " << total.nwrites_
+         << " writes (" << total.napplied_ << " applied) into "
+         << g_btr.size() << " keys in " << xsec << " sec" << endl;
+    cerr << "  last epoch: "
+         << transaction_proto2_static::EpochId(total.max_tid_) << endl;
+    cerr << "replay rate: " << rate << " txns/sec, "
+         << mbsec << " MB/sec" << endl;
+  } else {
+    cout << rate << endl;
+  }
+
+  return 0;
+}
@@ -6,6 +6,9 @@
 #include <stdint.h>
 #include <unordered_map>
 #include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "macros.h"
 #include "counter.h"
@@ -71,16 +74,21 @@ namespace private_ {
     }
   };
 
+  // at most half full, and at least one group of tags
   static inline constexpr size_t
   TableSize(size_t small_size)
   {
-    return round_up_to_pow2_const(small_size);
+    return round_up_to_pow2_const(2 * small_size) < 16 ?
+      16 : round_up_to_pow2_const(2 * small_size);
   }
 }
 
 /**
- * For under SmallSize, uses linear probing on a fixed size array. Otherwise,
- * delegates to a regular std::unordered_map
+ * For under SmallSize, the elements live in a fixed size array, found through
+ * an open addressing table of SwissTable style tags: a slot of the table
+ * holds 0 if empty, or 7 bits of the hash of its element with the high bit
+ * set. A lookup compares a group of 16 tags at once and only compares the
+ * keys whose tag matched. Otherwise, delegates to a regular std::unordered_map
  *
  * XXX(stephentu): allow custom allocator
  */
@@ -108,8 +116,15 @@ private:
     private_::is_trivially_destructible<bucket_value_type>::value;
 
   static const size_t TableSize = private_::TableSize(SmallSize);
+  static const size_t GroupSize = 16;
+  static const size_t NGroups = TableSize / GroupSize;
   static_assert(SmallSize >= 1, "XXX");
-  static_assert(TableSize >= 1, "XXX");
+  static_assert(TableSize % GroupSize == 0, "XXX");
+
+  // index of an element in small_elems
+  typedef
+    typename std::conditional<SmallSize <= 256, uint8_t, uint16_t>::type
+    slot_type;
 
   struct bucket {
     inline ALWAYS_INLINE bucket_value_type *
@@ -151,11 +166,45 @@ private:
         ref().~bucket_value_type();
     }
 
-    struct bucket *bnext;
     size_t h;
     char buf[sizeof(value_type)];
   };
 
+  // the hashes of pointers have poor high bits, so mix them before taking
+  // the group and the tag off the top
+  static inline ALWAYS_INLINE uint64_t
+  Mix(size_t h)
+  {
+    return uint64_t(h) * 0x9E3779B97F4A7C15UL;
+  }
+
+  static inline ALWAYS_INLINE size_t
+  Group(size_t h)
+  {
+    return (Mix(h) >> 32) % NGroups;
+  }
+
+  static inline ALWAYS_INLINE uint8_t
+  Tag(size_t h)
+  {
+    return 0x80 | (Mix(h) >> 57);
+  }
+
+  // bit i is set if tag i of the group g equals tag
+  static inline ALWAYS_INLINE unsigned
+  GroupMatch(const uint8_t *g, uint8_t tag)
+  {
+#ifdef __SSE2__
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(g));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(tag)));
+#else
+    unsigned m = 0;
+    for (size_t i = 0; i < GroupSize; i++)
+      m |= unsigned(g[i] == tag) << i;
+    return m;
+#endif
+  }
+
   // iterators are not stable across mutation
   template <typename SmallIterType,
             typename LargeIterType,
@@ -234,17 +283,6 @@ private:
     LargeIterType large_it;
   };
 
-  static size_t
-  chain_length(bucket *b)
-  {
-    size_t ret = 0;
-    while (b) {
-      ret++;
-      b = b->bnext;
-    }
-    return ret;
-  }
-
 public:
 
   typedef
@@ -264,7 +302,7 @@ public:
   small_unordered_map()
     : n(0), large_elems(0)
   {
-    NDB_MEMSET(&table[0], 0, sizeof(table));
+    NDB_MEMSET(&tags[0], 0, sizeof(tags));
   }
 
   ~small_unordered_map()
@@ -280,7 +318,7 @@ public:
   small_unordered_map(const small_unordered_map &other)
     : n(0), large_elems(0)
   {
-    NDB_MEMSET(&table[0], 0, sizeof(table));
+    NDB_MEMSET(&tags[0], 0, sizeof(tags));
     assignFrom(other);
   }
 
@@ -302,17 +340,37 @@ private:
     const size_t h = Hash()(k);
     if (hash_value)
       *hash_value = h;
-    const size_t i = h % TableSize;
-    bucket *b = table[i];
-    while (b) {
-      const bool check_hash = private_::is_eq_expensive<key_type>::value;
-      if ((!check_hash || b->h == h) && b->ref().first == k)
-        return b;
-      b = b->bnext;
+    const uint8_t tag = Tag(h);
+    const bool check_hash = private_::is_eq_expensive<key_type>::value;
+    for (size_t g = Group(h), i = 0; i < NGroups; g = (g + 1) % NGroups, i++) {
+      const uint8_t * const gtags = &tags[g * GroupSize];
+      for (unsigned m = GroupMatch(gtags, tag); m; m &= m - 1) {
+        bucket * const b = &small_elems[slots[g * GroupSize + __builtin_ctz(m)]];
+        if ((!check_hash || b->h == h) && b->ref().first == k)
+          return b;
+      }
+      // elements are never erased, so an empty slot ends the probe
+      if (GroupMatch(gtags, 0))
+        return 0;
     }
     return 0;
   }
 
+  // makes small_elems[idx] with hash h findable, there is always a free slot
+  inline void
+  link(size_t idx, size_t h)
+  {
+    for (size_t g = Group(h);; g = (g + 1) % NGroups) {
+      const unsigned m = GroupMatch(&tags[g * GroupSize], 0);
+      if (m) {
+        const size_t i = g * GroupSize + __builtin_ctz(m);
+        tags[i] = Tag(h);
+        slots[i] = idx;
+        return;
+      }
+    }
+  }
+
   inline ALWAYS_INLINE const bucket *
   find_bucket(const key_type &k, size_t *hash_value) const
   {
@@ -344,14 +402,14 @@ public:
         b.destroy();
       }
       n = 0;
+      // clear() of the large table goes back to the small one
+      NDB_MEMSET(&tags[0], 0, sizeof(tags));
       return large_elems->operator[](k);
     }
     INVARIANT(n < SmallSize);
-    b = &small_elems[n++];
+    b = &small_elems[n];
     b->construct(h, k, mapped_type());
-    const size_t i = h % TableSize;
-    b->bnext = table[i];
-    table[i] = b;
+    link(n++, h);
     return b->ref().second;
   }
 
@@ -376,14 +434,14 @@ public:
         b.destroy();
       }
       n = 0;
+      // clear() of the large table goes back to the small one
+      NDB_MEMSET(&tags[0], 0, sizeof(tags));
       return large_elems->operator[](std::move(k));
     }
     INVARIANT(n < SmallSize);
-    b = &small_elems[n++];
+    b = &small_elems[n];
     b->construct(h, std::move(k), mapped_type());
-    const size_t i = h % TableSize;
-    b->bnext = table[i];
-    table[i] = b;
+    link(n++, h);
     return b->ref().second;
   }
 
@@ -466,7 +524,7 @@ public:
     }
     if (!n)
       return;
-    NDB_MEMSET(&table[0], 0, sizeof(table));
+    NDB_MEMSET(&tags[0], 0, sizeof(tags));
     for (size_t i = 0; i < n; i++)
       small_elems[i].destroy();
     n = 0;
@@ -491,19 +549,18 @@ private:
     }
     INVARIANT(!large_elems);
     for (size_t i = 0; i < that.n; i++) {
-      bucket * const b = &small_elems[n++];
+      bucket * const b = &small_elems[n];
       const bucket * const that_b = &that.small_elems[i];
       b->construct(that_b->h, that_b->ref().first, that_b->ref().second);
-      const size_t idx = b->h % TableSize;
-      b->bnext = table[idx];
-      table[idx] = b;
+      link(n++, b->h);
     }
   }
 
   size_t n;
 
   bucket small_elems[SmallSize];
-  bucket *table[TableSize];
+  uint8_t tags[TableSize];
+  slot_type slots[TableSize];
 
   large_table_type *large_elems;
 };
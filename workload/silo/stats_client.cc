@@ -26,6 +26,7 @@ main(int argc, char **argv)
 {
   if (argc != 3) {
     cerr << "[usage] " << argv[0] << " sockfile counterspec" << endl;
+    cerr << "  counterspec is name[:name...], the name gauges dumps all the gauges" << endl;
     return 1;
   }
 
@@ -50,8 +51,26 @@ main(int argc, char **argv)
   packet pkt;
   int r;
   timer loop_timer;
+  uint64_t last_gauges_us = 0;
   for (;;) {
     for (auto &name : counter_names) {
+      if (name == "gauges") {
+        const uint8_t cmd = (uint8_t) stats_command::GET_GAUGES;
+        pkt.assign((const char *) &cmd, sizeof(cmd));
+        if ((r = pkt.sendpkt(fd)) || (r = pkt.recvpkt(fd))) {
+          if (r == EOF)
+            return 0;
+          perror("send/recv - disconnecting");
+          return 1;
+        }
+        // only print new samples, they come at the server's own interval
+        const string s(pkt.data(), pkt.size());
+        const uint64_t ts = strtoull(s.c_str(), nullptr, 10);
+        if (ts != last_gauges_us)
+          cout << s << flush;
+        last_gauges_us = ts;
+        continue;
+      }
       uint8_t buf[1 + name.size()];
       buf[0] = (uint8_t) stats_command::GET_COUNTER_VALUE;
       memcpy(&buf[1], name.data(), name.size());
@@ -4,7 +4,10 @@
 #include "macros.h"
 #include "fileutils.h"
 
-enum class stats_command : uint8_t { GET_COUNTER_VALUE = 0x1 };
+enum class stats_command : uint8_t {
+  GET_COUNTER_VALUE = 0x1,
+  GET_GAUGES = 0x2, // "<timestamp_us>\n" then "<name> <value>\n" per gauge
+};
 
 struct get_counter_value_t {
   uint64_t timestamp_us_; // usec
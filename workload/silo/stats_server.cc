@@ -13,7 +13,39 @@ using namespace std;
 using namespace util;
 
 stats_server::stats_server(const string &sockfile)
-  : sockfile_(sockfile) {}
+  : sockfile_(sockfile), gauge_interval_ms_(0), gauge_timestamp_us_(0) {}
+
+void
+stats_server::set_gauges(gauge_source src, uint64_t interval_ms)
+{
+  ALWAYS_ASSERT(interval_ms > 0);
+  gauge_src_ = src;
+  gauge_interval_ms_ = interval_ms;
+}
+
+void
+stats_server::sample_gauges()
+{
+  timer loop_timer;
+  for (;;) {
+    map<string, uint64_t> g = gauge_src_();
+    {
+      lock_guard<mutex> l(gauge_lock_);
+      gauges_.swap(g);
+      gauge_timestamp_us_ = timer::cur_usec();
+    }
+    const uint64_t last_loop_usec = loop_timer.lap();
+    const uint64_t delay_time_usec = gauge_interval_ms_ * 1000;
+    if (last_loop_usec < delay_time_usec) {
+      const uint64_t sleep_ns = (delay_time_usec - last_loop_usec) * 1000;
+      struct timespec t;
+      t.tv_sec  = sleep_ns / ONE_SECOND_NS;
+      t.tv_nsec = sleep_ns % ONE_SECOND_NS;
+      nanosleep(&t, nullptr);
+      loop_timer.lap();
+    }
+  }
+}
 
 void
 stats_server::serve_forever()
@@ -39,6 +71,9 @@ stats_server::serve_forever()
     throw system_error(errno, system_category(),
         "listening on " + sockfile_);
 
+  if (gauge_src_)
+    thread(&stats_server::sample_gauges, this).detach();
+
   for (;;) {
     int cfd = accept(fd, nullptr, 0);
     if (cfd < 0)
@@ -53,12 +88,39 @@ stats_server::handle_cmd_get_counter_value(const string &name, packet &pkt)
 {
   get_counter_value_t ret;
   ret.timestamp_us_ = timer::cur_usec();
-  if (!event_counter::stat(name, ret.d_))
-    cerr << "could not find counter " << name << endl;
+  if (!event_counter::stat(name, ret.d_)) {
+    lock_guard<mutex> l(gauge_lock_);
+    auto it = gauges_.find(name);
+    if (it != gauges_.end()) {
+      ret.timestamp_us_ = gauge_timestamp_us_;
+      ret.d_.count_ = it->second;
+    } else {
+      cerr << "could not find counter " << name << endl;
+    }
+  }
   pkt.assign((const char *) &ret, sizeof(ret));
   return true;
 }
 
+bool
+stats_server::handle_cmd_get_gauges(packet &pkt)
+{
+  string s;
+  {
+    lock_guard<mutex> l(gauge_lock_);
+    s = to_string(gauge_timestamp_us_) + "\n";
+    for (auto &p : gauges_) {
+      const string line = p.first + " " + to_string(p.second) + "\n";
+      // whatever does not fit in a packet is left out
+      if (s.size() + line.size() > packet::MAX_DATA)
+        break;
+      s += line;
+    }
+  }
+  pkt.assign(s);
+  return true;
+}
+
 void
 stats_server::serve_client(int fd)
 {
@@ -86,6 +148,15 @@ stats_server::serve_client(int fd)
         pkt.sendpkt(fd);
         break;
       }
+    case static_cast<uint8_t>(stats_command::GET_GAUGES):
+      {
+        if (!handle_cmd_get_gauges(pkt)) {
+          cerr << "error on handle_cmd_get_gauges(), dropping" << endl;
+          return;
+        }
+        pkt.sendpkt(fd);
+        break;
+      }
     default:
       cerr << "bad command- dropping connection" << endl;
       return;
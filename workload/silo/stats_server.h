@@ -1,15 +1,35 @@
 #pragma once
 
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
 #include "stats_common.h"
 
 // serves over unix socket
 class stats_server {
 public:
+  typedef std::function<std::map<std::string, uint64_t>()> gauge_source;
+
   stats_server(const std::string &sockfile);
+
+  // src is sampled every interval_ms by a thread of serve_forever(), for
+  // values too expensive to compute per request. the last sample is served
+  // by GET_COUNTER_VALUE (as the count, for names that are no event
+  // counter) and by GET_GAUGES. must be called before serve_forever()
+  void set_gauges(gauge_source src, uint64_t interval_ms);
+
   void serve_forever(); // blocks current thread
 private:
   bool handle_cmd_get_counter_value(const std::string &name, packet &pkt);
+  bool handle_cmd_get_gauges(packet &pkt);
   void serve_client(int fd);
+  void sample_gauges();
   std::string sockfile_;
+
+  gauge_source gauge_src_;
+  uint64_t gauge_interval_ms_;
+  std::mutex gauge_lock_;
+  uint64_t gauge_timestamp_us_;
+  std::map<std::string, uint64_t> gauges_;
 };
@@ -5,12 +5,20 @@
 #include "small_vector.h"
 
 // XXX: str arena hardcoded now to handle at most 1024 strings
+//
+// the strings are recycled rather than freed: reset() keeps every string and
+// its capacity, including the overflow ones, so once a worker has seen its
+// largest transaction next() never calls malloc again
 class str_arena {
 public:
 
   static const size_t PreAllocBufSize = 256;
   static const size_t NStrs = 1024;
 
+  // the bulk inserts of the loaders can go way past NStrs, what they do not
+  // hand back to the allocator is capped to this
+  static const size_t MaxRetainedOverflow = NStrs;
+
   static const size_t MinStrReserveLength = 2 * CACHELINE_SIZE;
   static_assert(PreAllocBufSize >= MinStrReserveLength, "xx");
 
@@ -30,7 +38,8 @@ public:
   reset()
   {
     n = 0;
-    overflow.clear();
+    if (unlikely(overflow.size() > MaxRetainedOverflow))
+      overflow.resize(MaxRetainedOverflow);
   }
 
   // next() is guaranteed to return an empty string
@@ -45,8 +54,13 @@ public:
     }
     // only loaders need this- and this allows us to use a unified
     // str_arena for loaders/workers
+    const size_t i = n++ - NStrs;
+    if (i < overflow.size()) {
+      std::string * const px = overflow[i].get();
+      px->clear();
+      return px;
+    }
     overflow.emplace_back(new std::string);
-    ++n;
     return overflow.back().get();
   }
 
@@ -85,8 +99,9 @@ private:
   bool
   manages_overflow(const std::string *px) const
   {
-    for (auto &p : overflow)
-      if (p.get() == px)
+    // only the ones handed out since the last reset()
+    for (size_t i = 0; i + NStrs < n && i < overflow.size(); i++)
+      if (overflow[i].get() == px)
         return true;
     return false;
   }
@@ -808,6 +808,28 @@ Test()
     ALWAYS_ASSERT(m.find(2)->first == 2 && m.find(2)->second == 3);
   }
 
+  { // pointer keys fill whole groups of tags, then spill to the large table
+    typedef small_unordered_map<const int *, int, 32> ptr_map_type;
+    static int xs[64];
+    ptr_map_type m;
+    for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < 32; i++)
+        m[&xs[i]] = i;
+      ALWAYS_ASSERT(m.is_small_type() && m.size() == 32);
+      for (int i = 0; i < 64; i++)
+        ALWAYS_ASSERT((m.find(&xs[i]) != m.end()) == (i < 32));
+      for (int i = 0; i < 32; i++)
+        ALWAYS_ASSERT(m.find(&xs[i])->second == i);
+      ptr_map_type m0(m);
+      for (int i = 0; i < 32; i++)
+        ALWAYS_ASSERT(m0.find(&xs[i])->second == i);
+      m[&xs[32]] = 32;
+      ALWAYS_ASSERT(!m.is_small_type() && m.size() == 33);
+      m.clear();
+      ALWAYS_ASSERT(m.empty() && m.find(&xs[0]) == m.end());
+    }
+  }
+
   cout << "map test passed" << endl;
 }
 }
@@ -1,3 +1,5 @@
 #include "ticker.h"
 
+// constant initialized, so set before s_instance starts ticking
+std::atomic<uint64_t> ticker::g_tick_period_us(ticker::tick_us);
 ticker ticker::s_instance;
@@ -18,6 +18,22 @@ public:
   static const uint64_t tick_us = 40 * 1000; /* 40 ms */
 #endif
 
+  // the period the ticker actually runs at, tick_us unless changed. the rcu
+  // and read-only epochs are multiples of a tick, so they scale with it
+  static inline uint64_t
+  tick_period_us()
+  {
+    return g_tick_period_us.load(std::memory_order_relaxed);
+  }
+
+  // takes effect from the next tick on
+  static void
+  SetTickPeriod(uint64_t us)
+  {
+    ALWAYS_ASSERT(us > 0);
+    g_tick_period_us.store(us, std::memory_order_relaxed);
+  }
+
   ticker()
     : current_tick_(1), last_tick_inclusive_(0)
   {
@@ -177,6 +193,8 @@ public:
 
 private:
 
+  static std::atomic<uint64_t> g_tick_period_us;
+
   void
   tickerloop()
   {
@@ -186,7 +204,7 @@ private:
     for (;;) {
 
       const uint64_t last_loop_usec = loop_timer.lap();
-      const uint64_t delay_time_usec = tick_us;
+      const uint64_t delay_time_usec = tick_period_us();
       if (last_loop_usec < delay_time_usec) {
         const uint64_t sleep_ns = (delay_time_usec - last_loop_usec) * 1000;
         t.tv_sec  = sleep_ns / ONE_SECOND_NS;
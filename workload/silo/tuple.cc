@@ -4,24 +4,24 @@
 using namespace std;
 using namespace util;
 
-event_avg_counter dbtuple::g_evt_avg_dbtuple_stable_version_spins
+basic_event_avg_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_avg_dbtuple_stable_version_spins
   ("avg_dbtuple_stable_version_spins");
-event_avg_counter dbtuple::g_evt_avg_dbtuple_lock_acquire_spins
+basic_event_avg_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_avg_dbtuple_lock_acquire_spins
   ("avg_dbtuple_lock_acquire_spins");
-event_avg_counter dbtuple::g_evt_avg_dbtuple_read_retries
+basic_event_avg_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_avg_dbtuple_read_retries
   ("avg_dbtuple_read_retries");
 
-event_counter dbtuple::g_evt_dbtuple_creates("dbtuple_creates");
-event_counter dbtuple::g_evt_dbtuple_logical_deletes("dbtuple_logical_deletes");
-event_counter dbtuple::g_evt_dbtuple_physical_deletes("dbtuple_physical_deletes");
-event_counter dbtuple::g_evt_dbtuple_bytes_allocated("dbtuple_bytes_allocated");
-event_counter dbtuple::g_evt_dbtuple_bytes_freed("dbtuple_bytes_freed");
-event_counter dbtuple::g_evt_dbtuple_spills("dbtuple_spills");
-event_counter dbtuple::g_evt_dbtuple_inplace_buf_insufficient("dbtuple_inplace_buf_insufficient");
-event_counter dbtuple::g_evt_dbtuple_inplace_buf_insufficient_on_spill("dbtuple_inplace_buf_insufficient_on_spill");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_creates("dbtuple_creates");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_logical_deletes("dbtuple_logical_deletes");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_physical_deletes("dbtuple_physical_deletes");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_bytes_allocated("dbtuple_bytes_allocated");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_bytes_freed("dbtuple_bytes_freed");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_spills("dbtuple_spills");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_inplace_buf_insufficient("dbtuple_inplace_buf_insufficient");
+basic_event_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_dbtuple_inplace_buf_insufficient_on_spill("dbtuple_inplace_buf_insufficient_on_spill");
 
-event_avg_counter dbtuple::g_evt_avg_record_spill_len("avg_record_spill_len");
-static event_avg_counter evt_avg_dbtuple_chain_length("avg_dbtuple_chain_len");
+basic_event_avg_counter<EVENT_CAT_TUPLE> dbtuple::g_evt_avg_record_spill_len("avg_record_spill_len");
+static basic_event_avg_counter<EVENT_CAT_TUPLE> evt_avg_dbtuple_chain_length("avg_dbtuple_chain_len");
 
 dbtuple::~dbtuple()
 {
@@ -291,9 +291,9 @@ private:
   friend class rcu;
   ~dbtuple();
 
-  static event_avg_counter g_evt_avg_dbtuple_stable_version_spins;
-  static event_avg_counter g_evt_avg_dbtuple_lock_acquire_spins;
-  static event_avg_counter g_evt_avg_dbtuple_read_retries;
+  static basic_event_avg_counter<EVENT_CAT_TUPLE> g_evt_avg_dbtuple_stable_version_spins;
+  static basic_event_avg_counter<EVENT_CAT_TUPLE> g_evt_avg_dbtuple_lock_acquire_spins;
+  static basic_event_avg_counter<EVENT_CAT_TUPLE> g_evt_avg_dbtuple_read_retries;
 
 public:
 
@@ -738,15 +738,15 @@ private:
     goto loop;
   }
 
-  static event_counter g_evt_dbtuple_creates;
-  static event_counter g_evt_dbtuple_logical_deletes;
-  static event_counter g_evt_dbtuple_physical_deletes;
-  static event_counter g_evt_dbtuple_bytes_allocated;
-  static event_counter g_evt_dbtuple_bytes_freed;
-  static event_counter g_evt_dbtuple_spills;
-  static event_counter g_evt_dbtuple_inplace_buf_insufficient;
-  static event_counter g_evt_dbtuple_inplace_buf_insufficient_on_spill;
-  static event_avg_counter g_evt_avg_record_spill_len;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_creates;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_logical_deletes;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_physical_deletes;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_bytes_allocated;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_bytes_freed;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_spills;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_inplace_buf_insufficient;
+  static basic_event_counter<EVENT_CAT_TUPLE> g_evt_dbtuple_inplace_buf_insufficient_on_spill;
+  static basic_event_avg_counter<EVENT_CAT_TUPLE> g_evt_avg_record_spill_len;
 
 public:
 
@@ -986,6 +986,16 @@ public:
 #endif
   }
 
+  // superseded versions are only ever read by snapshot transactions, so
+  // they can be placed apart from the latest ones. the spill copies made by
+  // write_record_at() are born superseded. a latest version replaced by a
+  // larger one stays where it is, as readers may still hold it
+  static inline allocator::AllocClass
+  AllocClassOf(bool latest)
+  {
+    return latest ? allocator::ClassTuple : allocator::ClassVersion;
+  }
+
   // NB: we round up allocation sizes because jemalloc will do this
   // internally anyways, so we might as well grab more usable space (really
   // just internal vs external fragmentation)
@@ -1000,7 +1010,8 @@ public:
       std::min(
           util::round_up<size_t, allocator::LgAllocAlignment>(sizeof(dbtuple) + sz),
           max_alloc_sz);
-    char *p = reinterpret_cast<char *>(rcu::s_instance.alloc(alloc_sz));
+    char *p = reinterpret_cast<char *>(
+        rcu::s_instance.alloc(alloc_sz, allocator::ClassTuple));
     INVARIANT(p);
     INVARIANT((alloc_sz - sizeof(dbtuple)) >= sz);
     return new (p) dbtuple(
@@ -1016,7 +1027,8 @@ public:
       std::min(
           util::round_up<size_t, allocator::LgAllocAlignment>(sizeof(dbtuple) + base->size),
           max_alloc_sz);
-    char *p = reinterpret_cast<char *>(rcu::s_instance.alloc(alloc_sz));
+    char *p = reinterpret_cast<char *>(
+        rcu::s_instance.alloc(alloc_sz, AllocClassOf(set_latest)));
     INVARIANT(p);
     return new (p) dbtuple(
         version, base, alloc_sz - sizeof(dbtuple), set_latest);
@@ -1038,7 +1050,8 @@ public:
       std::min(
           util::round_up<size_t, allocator::LgAllocAlignment>(sizeof(dbtuple) + needed_sz),
           max_alloc_sz);
-    char *p = reinterpret_cast<char *>(rcu::s_instance.alloc(alloc_sz));
+    char *p = reinterpret_cast<char *>(
+        rcu::s_instance.alloc(alloc_sz, AllocClassOf(set_latest)));
     INVARIANT(p);
     return new (p) dbtuple(
         version, value, oldsz, newsz,
@@ -1073,7 +1086,8 @@ public:
       return;
     INVARIANT(n->is_locked());
     INVARIANT(!n->is_latest());
-    rcu::s_instance.free_with_fn(n, deleter);
+    rcu::s_instance.free_with_fn(
+        n, deleter, sizeof(dbtuple) + n->alloc_size);
   }
 
   static inline void
@@ -7,8 +7,11 @@
 #include "scopedperf.hh"
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <map>
 #include <sstream>
+#include <tuple>
 #include <vector>
 #include <utility>
 
@@ -65,3 +68,126 @@ event_counter transaction_base::g_evt_dbtuple_write_insert_failed
 event_counter transaction_base::evt_local_search_lookups("local_search_lookups");
 event_counter transaction_base::evt_local_search_write_set_hits("local_search_write_set_hits");
 event_counter transaction_base::evt_dbtuple_latest_replacement("dbtuple_latest_replacement");
+
+uint64_t transaction_base::g_abort_sample_period = 0;
+
+namespace {
+  struct abort_samples {
+    spinlock lock; // against AbortHeatmap()
+    uint64_t countdown = 0;
+    // (btree, reason, key) => # of sampled aborts
+    map<tuple<const concurrent_btree *, int, string>, uint64_t> counts;
+  };
+
+  struct abort_tables {
+    spinlock lock;
+    map<const concurrent_btree *, string> names;
+  };
+}
+
+static percore<abort_samples> g_abort_samples CACHE_ALIGNED;
+
+// tables can be created by static initializers
+static abort_tables &
+AbortTables()
+{
+  static abort_tables t;
+  return t;
+}
+
+void
+transaction_base::SetAbortSamplePeriod(uint64_t period)
+{
+  g_abort_sample_period = period;
+}
+
+void
+transaction_base::NameAbortTable(const concurrent_btree *btr, const string &name)
+{
+  abort_tables &t = AbortTables();
+  ::lock_guard<spinlock> l(t.lock);
+  t.names[btr] = name;
+}
+
+void
+transaction_base::UnnameAbortTable(const concurrent_btree *btr)
+{
+  abort_tables &t = AbortTables();
+  ::lock_guard<spinlock> l(t.lock);
+  t.names.erase(btr);
+}
+
+void
+transaction_base::SampleAbort(
+    abort_reason reason,
+    const concurrent_btree *btr,
+    const string_type *key,
+    const void *obj)
+{
+  abort_samples &s = g_abort_samples.my();
+  if (s.countdown) {
+    s.countdown--;
+    return;
+  }
+  s.countdown = g_abort_sample_period - 1;
+  string k;
+  if (key)
+    k = hexify_buf(key->data(), min(key->size(), MaxAbortSampleKeyBytes));
+  else
+    k = string(reason == ABORT_REASON_NODE_SCAN_READ_VERSION_CHANGED ?
+        "node@" : "@") + hexify(obj);
+  auto e = make_tuple(btr, int(reason), move(k));
+  ::lock_guard<spinlock> l(s.lock);
+  auto it = s.counts.find(e);
+  if (likely(it != s.counts.end())) {
+    it->second++;
+    return;
+  }
+  if (s.counts.size() >= MaxAbortSampleKeys)
+    get<2>(e) = "other";
+  s.counts[e]++;
+}
+
+map<string, uint64_t>
+transaction_base::AbortHeatmap(size_t topk)
+{
+  map<const concurrent_btree *, string> names;
+  {
+    abort_tables &t = AbortTables();
+    ::lock_guard<spinlock> l(t.lock);
+    names = t.names;
+  }
+  map<string, uint64_t> ret;
+  map<string, map<string, uint64_t>> keys; // table => key => # of aborts
+  uint64_t total = 0;
+  for (size_t i = 0; i < g_abort_samples.size(); i++) {
+    abort_samples &s = g_abort_samples[i];
+    ::lock_guard<spinlock> l(s.lock);
+    for (auto &p : s.counts) {
+      auto name = names.find(get<0>(p.first));
+      const string &table = name == names.end() ? "unknown" : name->second;
+      const char * const reason =
+        AbortReasonStr(abort_reason(get<1>(p.first))) + strlen("ABORT_REASON_");
+      ret["aborts_" + table + "_" + reason] += p.second;
+      ret["aborts_" + table + "_total"] += p.second;
+      keys[table][get<2>(p.first)] += p.second;
+      total += p.second;
+    }
+  }
+  for (auto &t : keys) {
+    vector<pair<uint64_t, const string *>> hot;
+    for (auto &k : t.second)
+      hot.emplace_back(k.second, &k.first);
+    const size_t n = min(topk, hot.size());
+    partial_sort(hot.begin(), hot.begin() + n, hot.end(),
+        [](const pair<uint64_t, const string *> &a,
+           const pair<uint64_t, const string *> &b) {
+          return a.first > b.first;
+        });
+    for (size_t i = 0; i < n; i++)
+      ret["aborts_" + t.first + "_key_" + *hot[i].second] = hot[i].first;
+  }
+  ret["aborts_sampled"] = total;
+  ret["aborts_sample_period"] = g_abort_sample_period;
+  return ret;
+}
@@ -135,8 +135,48 @@ protected:
     return 0;
   }
 
+  // every g_abort_sample_period-th abort of a core is recorded by the table,
+  // key and reason it is blamed on, 0 to record none
+  static uint64_t g_abort_sample_period;
+
+  // the record kept for a sampled abort: the key if the txn knows it,
+  // otherwise obj (the tuple or the btree node it conflicted on)
+  static void SampleAbort(abort_reason reason,
+                          const concurrent_btree *btr,
+                          const string_type *key,
+                          const void *obj);
+
+  static inline ALWAYS_INLINE void
+  sample_abort(abort_reason reason,
+               const concurrent_btree *btr,
+               const string_type *key,
+               const void *obj = nullptr)
+  {
+    if (likely(!g_abort_sample_period))
+      return;
+    SampleAbort(reason, btr, key, obj);
+  }
+
 public:
 
+  // sampling of the keys aborts are blamed on, see g_abort_sample_period.
+  // must be set before the workers start
+  static void SetAbortSamplePeriod(uint64_t period);
+
+  // the table name of btr in AbortHeatmap(), for the lifetime of btr
+  static void NameAbortTable(const concurrent_btree *btr, const std::string &name);
+  static void UnnameAbortTable(const concurrent_btree *btr);
+
+  // the aborts sampled by all cores so far, "aborts_<table>_<reason>" and
+  // "aborts_<table>_total" per table, "aborts_<table>_key_<key>" for the
+  // topk keys of each table with the most aborts. keys are hex, a key the
+  // txn did not know is "@<tuple>" or "node@<btree node>", the keys of a
+  // core past its first MaxAbortSampleKeys are "other"
+  static std::map<std::string, uint64_t> AbortHeatmap(size_t topk = 8);
+
+  static const size_t MaxAbortSampleKeys = 4096;
+  static const size_t MaxAbortSampleKeyBytes = 32;
+
   // only fires during invariant checking
   inline void
   ensure_active()
@@ -158,9 +198,10 @@ protected:
   // "write_set" is used to indicate if this read tuple
   // also belongs in the write set.
   struct read_record_t {
-    constexpr read_record_t() : tuple(), t() {}
-    constexpr read_record_t(const dbtuple *tuple, tid_t t)
-      : tuple(tuple), t(t) {}
+    constexpr read_record_t() : tuple(), t(), btr() {}
+    constexpr read_record_t(const dbtuple *tuple, tid_t t,
+                            const concurrent_btree *btr)
+      : tuple(tuple), t(t), btr(btr) {}
     inline const dbtuple *
     get_tuple() const
     {
@@ -171,9 +212,15 @@ protected:
     {
       return t;
     }
+    inline const concurrent_btree *
+    get_btree() const
+    {
+      return btr;
+    }
   private:
     const dbtuple *tuple;
     tid_t t;
+    const concurrent_btree *btr; // only to blame aborts on
   };
 
   friend std::ostream &
@@ -263,7 +310,10 @@ protected:
   operator<<(std::ostream &o, const write_record_t &r);
 
   // the absent set is a mapping from (btree_node -> version_number).
-  struct absent_record_t { uint64_t version; };
+  struct absent_record_t {
+    uint64_t version;
+    const concurrent_btree *btr; // only to blame aborts on
+  };
 
   friend std::ostream &
   operator<<(std::ostream &o, const absent_record_t &r);
@@ -721,10 +771,12 @@ protected:
   // within this transaction context
   template <typename ValueReader>
   bool
-  do_tuple_read(const dbtuple *tuple, ValueReader &value_reader);
+  do_tuple_read(const concurrent_btree *btr, const dbtuple *tuple,
+                ValueReader &value_reader);
 
   void
-  do_node_read(const typename concurrent_btree::node_opaque_t *n, uint64_t version);
+  do_node_read(const concurrent_btree *btr,
+               const typename concurrent_btree::node_opaque_t *n, uint64_t version);
 
 public:
   // expected public overrides
@@ -286,6 +286,52 @@ test_absent_key_race()
   }
 }
 
+template <template <typename> class TxnType, typename Traits>
+static void
+test_abort_heatmap()
+{
+  txn_btree<TxnType> btr(sizeof(rec), false, "heatmap_test");
+  typename Traits::StringAllocator arena;
+  transaction_base::SetAbortSamplePeriod(1);
+
+  {
+    TxnType<Traits> t(0, arena);
+    btr.insert_object(t, u64_varkey(0), rec(0));
+    btr.insert_object(t, u64_varkey(1), rec(1));
+    AssertSuccessfulCommit(t);
+  }
+
+  for (size_t i = 0; i < 2; i++) {
+    TxnType<Traits> t0(0, arena), t1(0, arena);
+    string v0;
+
+    // t0 reads key 0 and read-modify-writes key 1
+    ALWAYS_ASSERT_COND_IN_TXN(t0, btr.search(t0, u64_varkey(0), v0));
+    ALWAYS_ASSERT_COND_IN_TXN(t0, btr.search(t0, u64_varkey(1), v0));
+    btr.insert_object(t0, u64_varkey(1), rec(2));
+
+    // t1 changes one of them under t0, which is blamed on the key it wrote
+    // or on the tuple it only read
+    btr.insert_object(t1, u64_varkey(i), rec(3));
+    AssertSuccessfulCommit(t1);
+    AssertFailedCommit(t0);
+  }
+
+  auto heatmap = transaction_base::AbortHeatmap();
+  ALWAYS_ASSERT(heatmap["aborts_heatmap_test_READ_NODE_INTEREFERENCE"] == 2);
+  ALWAYS_ASSERT(heatmap["aborts_heatmap_test_total"] == 2);
+  ALWAYS_ASSERT(heatmap["aborts_heatmap_test_key_" + hexify(u64_varkey(1).str())] == 1);
+  size_t ntuples = 0;
+  for (auto &p : heatmap)
+    if (p.first.find("aborts_heatmap_test_key_@") == 0)
+      ntuples += p.second;
+  ALWAYS_ASSERT(ntuples == 1);
+
+  transaction_base::SetAbortSamplePeriod(0);
+  txn_epoch_sync<TxnType>::sync();
+  txn_epoch_sync<TxnType>::finish();
+}
+
 template <template <typename> class TxnType, typename Traits>
 static void
 test_inc_value_size()
@@ -1886,6 +1932,7 @@ void txn_btree_test()
   test1<transaction_proto2, default_transaction_traits>();
   test2<transaction_proto2, default_transaction_traits>();
   test_absent_key_race<transaction_proto2, default_transaction_traits>();
+  test_abort_heatmap<transaction_proto2, default_transaction_traits>();
   test_inc_value_size<transaction_proto2, default_transaction_traits>();
   test_multi_btree<transaction_proto2, default_transaction_traits>();
   test_read_only_snapshot<transaction_proto2, default_transaction_traits>();
@@ -295,7 +295,8 @@ public:
          value_type &v,
          size_t max_bytes_read = string_type::npos)
   {
-    return search(t, to_string_type(k), v, max_bytes_read);
+    single_value_reader_type r(&v, max_bytes_read);
+    return this->do_search_bytes(t, k, r);
   }
 
   // either returns false or v is set to not-empty with value
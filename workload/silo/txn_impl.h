@@ -301,6 +301,8 @@ transaction<Protocol, Traits>::commit(bool doThrow)
           // on boundary
           if (unlikely(!handle_last_tuple_in_group(*last_px, inserted_last_run))) {
             abort_trap((reason = ABORT_REASON_WRITE_NODE_INTERFERENCE));
+            sample_abort(reason, last_px->entry->get_btree(),
+                         &last_px->entry->get_key());
             goto do_abort;
           }
           inserted_last_run = false;
@@ -319,6 +321,8 @@ transaction<Protocol, Traits>::commit(bool doThrow)
       if (likely(last_px) &&
           unlikely(!handle_last_tuple_in_group(*last_px, inserted_last_run))) {
         abort_trap((reason = ABORT_REASON_WRITE_NODE_INTERFERENCE));
+        sample_abort(reason, last_px->entry->get_btree(),
+                     &last_px->entry->get_key());
         goto do_abort;
       }
       commit_tid.first = true;
@@ -363,6 +367,16 @@ transaction<Protocol, Traits>::commit(bool doThrow)
           //std::cerr << "failed tuple: " << *it->get_tuple() << std::endl;
 
           abort_trap((reason = ABORT_REASON_READ_NODE_INTEREFERENCE));
+          if (unlikely(g_abort_sample_period)) {
+            // the key is only known if the txn wrote the tuple too
+            auto w = found ?
+              find_write_set(const_cast<dbtuple *>(it->get_tuple())) :
+              write_set.end();
+            if (w != write_set.end())
+              sample_abort(reason, w->get_btree(), &w->get_key());
+            else
+              sample_abort(reason, it->get_btree(), nullptr, it->get_tuple());
+          }
           goto do_abort;
         }
       }
@@ -377,6 +391,7 @@ transaction<Protocol, Traits>::commit(bool doThrow)
             VERBOSE(std::cerr << "expected node " << util::hexify(it->first) << " at v="
                               << it->second.version << ", got v=" << v << std::endl);
             abort_trap((reason = ABORT_REASON_NODE_SCAN_READ_VERSION_CHANGED));
+            sample_abort(reason, it->second.btr, nullptr, it->first);
             goto do_abort;
           }
         }
@@ -549,6 +564,7 @@ transaction<Protocol, Traits>::try_insert_new_tuple(
     if (it != absent_set.end()) {
       if (unlikely(it->second.version != insert_info.old_version)) {
         abort_trap((reason = ABORT_REASON_WRITE_NODE_INTERFERENCE));
+        sample_abort(reason, &btr, key);
         return std::make_pair(tuple, true);
       }
       VERBOSE(std::cerr << "bump node=" << util::hexify(it->first) << " from v=" << insert_info.old_version
@@ -565,7 +581,7 @@ template <template <typename> class Protocol, typename Traits>
 template <typename ValueReader>
 bool
 transaction<Protocol, Traits>::do_tuple_read(
-    const dbtuple *tuple, ValueReader &value_reader)
+    const concurrent_btree *btr, const dbtuple *tuple, ValueReader &value_reader)
 {
   INVARIANT(tuple);
   ++evt_local_search_lookups;
@@ -600,12 +616,14 @@ transaction<Protocol, Traits>::do_tuple_read(
     stat = tuple->stable_read(snapshot_tid, start_t, value_reader, this->string_allocator(), is_snapshot_txn);
     if (unlikely(stat == dbtuple::READ_FAILED)) {
       const transaction_base::abort_reason r = transaction_base::ABORT_REASON_UNSTABLE_READ;
+      sample_abort(r, btr, nullptr, tuple);
       abort_impl(r);
       throw transaction_abort_exception(r);
     }
   }
   if (unlikely(!cast()->can_read_tid(start_t))) {
     const transaction_base::abort_reason r = transaction_base::ABORT_REASON_FUTURE_TID_READ;
+    sample_abort(r, btr, nullptr, tuple);
     abort_impl(r);
     throw transaction_abort_exception(r);
   }
@@ -617,13 +635,14 @@ transaction<Protocol, Traits>::do_tuple_read(
   if (!is_snapshot_txn)
     // read-only txns do not need read-set tracking
     // (b/c we know the values are consistent)
-    read_set.emplace_back(tuple, start_t);
+    read_set.emplace_back(tuple, start_t, btr);
   return !v_empty;
 }
 
 template <template <typename> class Protocol, typename Traits>
 void
 transaction<Protocol, Traits>::do_node_read(
+    const concurrent_btree *btr,
     const typename concurrent_btree::node_opaque_t *n, uint64_t v)
 {
   INVARIANT(n);
@@ -631,10 +650,13 @@ transaction<Protocol, Traits>::do_node_read(
     return;
   auto it = absent_set.find(n);
   if (it == absent_set.end()) {
-    absent_set[n].version = v;
+    absent_record_t &r = absent_set[n];
+    r.version = v;
+    r.btr = btr;
   } else if (it->second.version != v) {
     const transaction_base::abort_reason r =
       transaction_base::ABORT_REASON_NODE_SCAN_READ_VERSION_CHANGED;
+    sample_abort(r, btr, nullptr, n);
     abort_impl(r);
     throw transaction_abort_exception(r);
   }
@@ -1,8 +1,13 @@
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <thread>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 #include <limits.h>
 #include <numa.h>
 
@@ -19,6 +24,8 @@ bool txn_logger::g_persist = false;
 bool txn_logger::g_call_fsync = true;
 bool txn_logger::g_use_compression = false;
 bool txn_logger::g_fake_writes = false;
+bool txn_logger::g_use_io_uring = false;
+bool txn_logger::g_pin_loggers_to_numa_nodes = false;
 size_t txn_logger::g_nworkers = 0;
 txn_logger::epoch_array
   txn_logger::per_thread_sync_epochs_[txn_logger::g_nmax_loggers];
@@ -28,29 +35,142 @@ percore<txn_logger::persist_ctx>
   txn_logger::g_persist_ctxs;
 percore<txn_logger::persist_stats>
   txn_logger::g_persist_stats;
-event_counter
+basic_event_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_log_buffer_epoch_boundary("log_buffer_epoch_boundary");
-event_counter
+basic_event_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_log_buffer_out_of_space("log_buffer_out_of_space");
-event_counter
+basic_event_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_log_buffer_bytes_before_compress("log_buffer_bytes_before_compress");
-event_counter
+basic_event_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_log_buffer_bytes_after_compress("log_buffer_bytes_after_compress");
-event_counter
+basic_event_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_logger_writev_limit_met("logger_writev_limit_met");
-event_counter
+basic_event_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_logger_max_lag_wait("logger_max_lag_wait");
-event_avg_counter
+basic_event_avg_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_avg_log_buffer_compress_time_us("avg_log_buffer_compress_time_us");
-event_avg_counter
+basic_event_avg_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_avg_log_entry_ntxns("avg_log_entry_ntxns_per_entry");
-event_avg_counter
+basic_event_avg_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_avg_logger_bytes_per_writev("avg_logger_bytes_per_writev");
-event_avg_counter
+basic_event_avg_counter<EVENT_CAT_LOGGER>
   txn_logger::g_evt_avg_logger_bytes_per_sec("avg_logger_bytes_per_sec");
 
-static event_avg_counter
+static basic_event_avg_counter<EVENT_CAT_LOGGER>
   evt_avg_log_buffer_iov_len("avg_log_buffer_iov_len");
+static basic_event_counter<EVENT_CAT_LOGGER>
+  evt_logger_io_uring_short_writes("logger_io_uring_short_writes");
+
+// just enough of io_uring for a logger: a writev linked to an fdatasync,
+// submitted and reaped with a single syscall instead of one syscall each.
+// the raw syscalls keep silo free of a liburing dependency
+class log_uring {
+public:
+  log_uring()
+  {
+    struct io_uring_params p;
+    NDB_MEMSET(&p, 0, sizeof(p));
+    fd_ = syscall(__NR_io_uring_setup, 4, &p);
+    if (fd_ < 0) {
+      perror("io_uring_setup");
+      ALWAYS_ASSERT(false);
+    }
+    char * const sq = (char *) map(
+        p.sq_off.array + p.sq_entries * sizeof(unsigned), IORING_OFF_SQ_RING);
+    char * const cq = (char *) map(
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe),
+        IORING_OFF_CQ_RING);
+    sqes_ = (struct io_uring_sqe *) map(
+        p.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES);
+    sq_tail_ = (unsigned *) (sq + p.sq_off.tail);
+    sq_mask_ = *(unsigned *) (sq + p.sq_off.ring_mask);
+    sq_array_ = (unsigned *) (sq + p.sq_off.array);
+    cq_head_ = (unsigned *) (cq + p.cq_off.head);
+    cq_tail_ = (unsigned *) (cq + p.cq_off.tail);
+    cq_mask_ = *(unsigned *) (cq + p.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  }
+
+  // writes iovs at off, followed by an fdatasync() if sync is set. returns
+  // the result of the write, and the one of the fdatasync() in fret (which
+  // is -ECANCELED if the write came up short)
+  ssize_t
+  writev(int fd, const struct iovec *iovs, unsigned n, uint64_t off,
+         bool sync, int &fret)
+  {
+    unsigned tail = *sq_tail_;
+    struct io_uring_sqe *sqe = next_sqe(tail++);
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) iovs;
+    sqe->len = n;
+    sqe->off = off;
+    sqe->user_data = 0;
+    if (sync) {
+      sqe->flags = IOSQE_IO_LINK;
+      sqe = next_sqe(tail++);
+      sqe->opcode = IORING_OP_FSYNC;
+      sqe->fd = fd;
+      sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+      sqe->user_data = 1;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    const unsigned nr = sync ? 2 : 1;
+    ssize_t wret = 0;
+    fret = 0;
+    for (unsigned ndone = 0, nsubmit = nr; ndone < nr;) {
+      const unsigned head = *cq_head_;
+      if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        if (syscall(__NR_io_uring_enter, fd_, nsubmit, nr - ndone,
+                    IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+            errno != EINTR) {
+          perror("io_uring_enter");
+          ALWAYS_ASSERT(false);
+        }
+        nsubmit = 0;
+        continue;
+      }
+      const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      if (cqe.user_data)
+        fret = cqe.res;
+      else
+        wret = cqe.res;
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      ndone++;
+    }
+    return wret;
+  }
+
+private:
+  void *
+  map(size_t sz, off_t off)
+  {
+    void * const p = mmap(nullptr, sz, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd_, off);
+    if (p == MAP_FAILED) {
+      perror("mmap");
+      ALWAYS_ASSERT(false);
+    }
+    return p;
+  }
+
+  inline struct io_uring_sqe *
+  next_sqe(unsigned tail)
+  {
+    const unsigned idx = tail & sq_mask_;
+    struct io_uring_sqe * const sqe = &sqes_[idx];
+    NDB_MEMSET(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    return sqe;
+  }
+
+  int fd_;
+  struct io_uring_sqe *sqes_;
+  unsigned *sq_tail_, *sq_array_, sq_mask_;
+  unsigned *cq_head_, *cq_tail_, cq_mask_;
+  struct io_uring_cqe *cqes_;
+};
 
 void
 txn_logger::Init(
@@ -60,7 +180,9 @@ txn_logger::Init(
     vector<vector<unsigned>> *assignments_used,
     bool call_fsync,
     bool use_compression,
-    bool fake_writes)
+    bool fake_writes,
+    bool use_io_uring,
+    bool pin_loggers)
 {
   INVARIANT(!g_persist);
   INVARIANT(g_nworkers == 0);
@@ -81,6 +203,8 @@ txn_logger::Init(
   g_call_fsync = call_fsync;
   g_use_compression = use_compression;
   g_fake_writes = fake_writes;
+  g_use_io_uring = use_io_uring;
+  g_pin_loggers_to_numa_nodes = pin_loggers;
   g_nworkers = nworkers;
 
   for (size_t i = 0; i < g_nmax_loggers; i++)
@@ -97,14 +221,22 @@ txn_logger::Init(
       for (size_t i = 0; i < g_nworkers; i++)
         assignments.push_back({(unsigned) i});
     } else {
+      // the workers of a node go to the same loggers when pinning, so that
+      // a logger mostly reads buffers from its own node
+      vector<unsigned> workers = MakeRange<unsigned>(0, g_nworkers);
+      if (g_pin_loggers_to_numa_nodes)
+        stable_sort(workers.begin(), workers.end(),
+            [](unsigned a, unsigned b) {
+              return node_of_worker(a) < node_of_worker(b);
+            });
       // XXX: currently we assume each logger is equally as fast- we should
       // adjust ratios accordingly for non-homogenous loggers
       const size_t threads_per_logger = g_nworkers / fds.size();
       for (size_t i = 0; i < fds.size(); i++) {
         assignments.emplace_back(
-            MakeRange<unsigned>(
-              i * threads_per_logger,
-              ((i + 1) == fds.size()) ?  g_nworkers : (i + 1) * threads_per_logger));
+            workers.begin() + i * threads_per_logger,
+            ((i + 1) == fds.size()) ?
+              workers.end() : workers.begin() + (i + 1) * threads_per_logger);
       }
     }
   }
@@ -132,7 +264,7 @@ txn_logger::persister(
   timer loop_timer;
   for (;;) {
     const uint64_t last_loop_usec = loop_timer.lap();
-    const uint64_t delay_time_usec = ticker::tick_us;
+    const uint64_t delay_time_usec = ticker::tick_period_us();
     if (last_loop_usec < delay_time_usec) {
       const uint64_t sleep_ns = (delay_time_usec - last_loop_usec) * 1000;
       struct timespec t;
@@ -220,6 +352,25 @@ txn_logger::advance_system_sync_epoch(
   system_sync_epoch_->store(min_so_far, memory_order_release);
 }
 
+int
+txn_logger::node_of_worker(uint64_t core_id)
+{
+  static const int ncpus = numa_num_configured_cpus();
+  const int node = numa_node_of_cpu((core_id % g_nworkers) % ncpus);
+  return node < 0 ? 0 : node;
+}
+
+char *
+txn_logger::alloc_buffers(uint64_t core_id, size_t sz)
+{
+  if (!g_pin_loggers_to_numa_nodes)
+    return (char *) malloc(sz);
+  // only bound, faulted in by the worker filling them
+  char * const p = (char *) numa_alloc_onnode(sz, node_of_worker(core_id));
+  ALWAYS_ASSERT(p);
+  return p;
+}
+
 void
 txn_logger::writer(
     unsigned id, int fd,
@@ -227,7 +378,18 @@ txn_logger::writer(
 {
 
   if (g_pin_loggers_to_numa_nodes) {
-    ALWAYS_ASSERT(!numa_run_on_node(id % numa_num_configured_nodes()));
+    // run where most of the assigned workers are
+    map<int, size_t> nodes;
+    for (auto w : assignment)
+      nodes[node_of_worker(w)]++;
+    int node = id % numa_num_configured_nodes();
+    size_t most = 0;
+    for (auto &p : nodes)
+      if (p.second > most) {
+        node = p.first;
+        most = p.second;
+      }
+    ALWAYS_ASSERT(!numa_run_on_node(node));
     ALWAYS_ASSERT(!sched_yield());
   }
 
@@ -236,6 +398,10 @@ txn_logger::writer(
   vector<pbuffer *> pxs;
   timer loop_timer;
 
+  // io_uring writes at explicit offsets, the file is ours alone
+  unique_ptr<log_uring> uring(g_use_io_uring ? new log_uring : nullptr);
+  uint64_t file_off = 0;
+
   // XXX: sense is not useful for now, unless we want to
   // fsync in the background...
   bool sense = false; // cur is at sense, prev is at !sense
@@ -250,7 +416,7 @@ txn_logger::writer(
   for (;;) {
 
     const uint64_t last_loop_usec = loop_timer.lap();
-    const uint64_t delay_time_usec = ticker::tick_us;
+    const uint64_t delay_time_usec = ticker::tick_period_us();
     // don't allow this loop to proceed less than an epoch's worth of time,
     // so we can batch IO
     if (last_loop_usec < delay_time_usec && nbufswritten < iovs.size()) {
@@ -345,13 +511,56 @@ txn_logger::writer(
 #ifdef ENABLE_EVENT_COUNTERS
       timer write_timer;
 #endif
-      const ssize_t ret = writev(fd, &iovs[0], nbufswritten);
-      if (unlikely(ret == -1)) {
-        perror("writev");
-        ALWAYS_ASSERT(false);
+      bool need_fsync = g_call_fsync;
+      if (uring) {
+        int fret;
+        ssize_t ret = uring->writev(
+            fd, &iovs[0], nbufswritten, file_off, g_call_fsync, fret);
+        if (unlikely(ret < 0)) {
+          errno = -ret;
+          perror("io_uring writev");
+          ALWAYS_ASSERT(false);
+        }
+        if (unlikely(size_t(ret) < nbyteswritten)) {
+          // the linked fsync was cancelled, finish by hand
+          ++evt_logger_io_uring_short_writes;
+          size_t skip = ret;
+          for (size_t i = 0; i < nbufswritten; i++) {
+            const iovec &iov = iovs[i];
+            if (skip >= iov.iov_len) {
+              skip -= iov.iov_len;
+              continue;
+            }
+            for (size_t done = skip; done < iov.iov_len;) {
+              const ssize_t r = pwrite(
+                  fd, (const char *) iov.iov_base + done, iov.iov_len - done,
+                  file_off + ret);
+              if (unlikely(r == -1)) {
+                perror("pwrite");
+                ALWAYS_ASSERT(false);
+              }
+              done += r;
+              ret += r;
+            }
+            skip = 0;
+          }
+        } else if (unlikely(fret < 0)) {
+          errno = -fret;
+          perror("io_uring fdatasync");
+          ALWAYS_ASSERT(false);
+        } else {
+          need_fsync = false;
+        }
+        file_off += nbyteswritten;
+      } else {
+        const ssize_t ret = writev(fd, &iovs[0], nbufswritten);
+        if (unlikely(ret == -1)) {
+          perror("writev");
+          ALWAYS_ASSERT(false);
+        }
       }
 
-      if (g_call_fsync) {
+      if (need_fsync) {
         const int fret = fdatasync(fd);
         if (unlikely(fret == -1)) {
           perror("fdatasync");
@@ -487,7 +696,8 @@ transaction_proto2_static::InitGC()
 static void
 sleep_ro_epoch()
 {
-  const uint64_t sleep_ns = transaction_proto2_static::ReadOnlyEpochUsec * 1000;
+  const uint64_t sleep_ns = ticker::tick_period_us() *
+    transaction_proto2_static::ReadOnlyEpochMultiplier * 1000;
   struct timespec t;
   t.tv_sec  = sleep_ns / ONE_SECOND_NS;
   t.tv_nsec = sleep_ns % ONE_SECOND_NS;
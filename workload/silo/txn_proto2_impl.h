@@ -37,7 +37,6 @@ public:
   static const size_t g_buffer_size = (1<<20); // in bytes
   static const size_t g_horizon_buffer_size = 2 * (1<<16); // in bytes
   static const size_t g_max_lag_epochs = 128; // cannot lag more than 128 epochs
-  static const bool   g_pin_loggers_to_numa_nodes = false;
 
   static inline bool
   IsPersistenceEnabled()
@@ -62,7 +61,9 @@ public:
       std::vector<std::vector<unsigned>> *assignments_used = nullptr,
       bool call_fsync = true,
       bool use_compression = false,
-      bool fake_writes = false);
+      bool fake_writes = false,
+      bool use_io_uring = false,
+      bool pin_loggers = false);
 
   struct logbuf_header {
     uint64_t nentries_; // > 0 for all valid log buffers
@@ -260,6 +261,13 @@ private:
       unsigned id, int fd,
       std::vector<unsigned> assignment);
 
+  // the node worker core_id runs on, assuming workers are pinned to the cpu
+  // of their id like the benchmarks do
+  static int node_of_worker(uint64_t core_id);
+
+  // the buffers of core_id, on its worker's node when pinning loggers
+  static char *alloc_buffers(uint64_t core_id, size_t sz);
+
   static void persister(
       std::vector<std::vector<unsigned>> assignments);
 
@@ -279,9 +287,11 @@ private:
       if (IsCompressionEnabled())
         needed += size_t(LZ4_create_size()) +
           sizeof(pbuffer) + g_horizon_buffer_size;
+      // the loaders initialize the contexts the workers reuse later, so
+      // only the rcu allocator of a pinned worker is known to be local
       char *mem =
-        (imode == INITMODE_REG) ?
-          (char *) malloc(needed) :
+        (imode == INITMODE_REG || g_pin_loggers_to_numa_nodes) ?
+          alloc_buffers(core_id, needed) :
           (char *) rcu::s_instance.alloc_static(needed);
       if (IsCompressionEnabled()) {
         ctx.lz4ctx_ = mem;
@@ -310,6 +320,13 @@ private:
   static bool g_fake_writes; // whether or not to fake doing writes (to measure
                              // pure overhead of disk)
 
+  static bool g_use_io_uring; // whether or not to submit each write together
+                              // with its fsync through io_uring
+
+  static bool g_pin_loggers_to_numa_nodes; // whether or not to group the
+                                           // workers, their buffers and
+                                           // their logger by node
+
   static size_t g_nworkers; // assignments are computed based on g_nworkers
                             // but a logger responsible for core i is really
                             // responsible for cores i + k * g_nworkers, for k
@@ -334,16 +351,16 @@ private:
 
   // counters
 
-  static event_counter g_evt_log_buffer_epoch_boundary;
-  static event_counter g_evt_log_buffer_out_of_space;
-  static event_counter g_evt_log_buffer_bytes_before_compress;
-  static event_counter g_evt_log_buffer_bytes_after_compress;
-  static event_counter g_evt_logger_writev_limit_met;
-  static event_counter g_evt_logger_max_lag_wait;
-  static event_avg_counter g_evt_avg_log_entry_ntxns;
-  static event_avg_counter g_evt_avg_log_buffer_compress_time_us;
-  static event_avg_counter g_evt_avg_logger_bytes_per_writev;
-  static event_avg_counter g_evt_avg_logger_bytes_per_sec;
+  static basic_event_counter<EVENT_CAT_LOGGER> g_evt_log_buffer_epoch_boundary;
+  static basic_event_counter<EVENT_CAT_LOGGER> g_evt_log_buffer_out_of_space;
+  static basic_event_counter<EVENT_CAT_LOGGER> g_evt_log_buffer_bytes_before_compress;
+  static basic_event_counter<EVENT_CAT_LOGGER> g_evt_log_buffer_bytes_after_compress;
+  static basic_event_counter<EVENT_CAT_LOGGER> g_evt_logger_writev_limit_met;
+  static basic_event_counter<EVENT_CAT_LOGGER> g_evt_logger_max_lag_wait;
+  static basic_event_avg_counter<EVENT_CAT_LOGGER> g_evt_avg_log_entry_ntxns;
+  static basic_event_avg_counter<EVENT_CAT_LOGGER> g_evt_avg_log_buffer_compress_time_us;
+  static basic_event_avg_counter<EVENT_CAT_LOGGER> g_evt_avg_logger_bytes_per_writev;
+  static basic_event_avg_counter<EVENT_CAT_LOGGER> g_evt_avg_logger_bytes_per_sec;
 };
 
 static inline std::ostream &
@@ -373,6 +390,7 @@ public:
 
   static_assert(ReadOnlyEpochMultiplier >= 1, "XX");
 
+  // with the default tick, see ticker::tick_period_us()
   static const uint64_t ReadOnlyEpochUsec =
     ticker::tick_us * ReadOnlyEpochMultiplier;
 
@@ -520,7 +520,11 @@ typed_txn_btree<Transaction, Schema>::search(
 {
   // XXX: template single_value_reader with mask
   single_value_reader vr(v, FieldsMask::value);
-  return this->do_search(t, k, vr);
+  // keys are packed structs of fixed-width fields, so the encoded key fits
+  // on the stack and the search needs no string of the arena
+  uint8_t buf[sizeof(key_type)];
+  key_encoder.write(buf, &k);
+  return this->do_search_bytes(t, varkey(buf, sizeof(buf)), vr);
 }
 
 template <template <typename> class Transaction, typename Schema>
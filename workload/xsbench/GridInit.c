@@ -22,26 +22,22 @@ SimulationData grid_init_do_not_profile( Inputs const in, int mype )
 	{
 		fprintf(stderr, "Allocating memory for index grid...\n");
 		// Allocate space to hold the acceleration grid indices
-		SD.index_grid = (int *) calloc( SD.length_index_grid, sizeof(int));
-		assert(SD.index_grid != NULL);
+		SD.index_grid = (int *) grid_alloc( SD.length_index_grid * sizeof(int), INDEX_GRID, in );
 		nbytes += SD.length_index_grid * sizeof(int);
-		fprintf(stderr, "Allocated %.0lf MB of data.\n", nbytes/1024.0/1024.0 );
+		print_grid_alloc( "index grid", SD.length_index_grid * sizeof(int), INDEX_GRID, in );
 	}
 	if( in.grid_type == UNIONIZED )
 	{
 		fprintf(stderr, "Allocating memory for unionized grid...\n");
 		// Allocate space to hold the union of all nuclide energy data
-		SD.unionized_energy_array = (double *) calloc( SD.length_unionized_energy_array, sizeof(double));
-		assert(SD.unionized_energy_array != NULL );
+		SD.unionized_energy_array = (double *) grid_alloc( SD.length_unionized_energy_array * sizeof(double), UNIONIZED_GRID, in );
 		nbytes += SD.length_unionized_energy_array * sizeof(double);
-		fprintf(stderr, "Allocated %.0lf MB of data.\n", nbytes/1024.0/1024.0 );
+		print_grid_alloc( "unionized grid", SD.length_unionized_energy_array * sizeof(double), UNIONIZED_GRID, in );
 	}
 	fprintf(stderr, "Allocating memory for nuclide grids...\n");
-	SD.nuclide_grid     = (NuclideGridPoint *) calloc( SD.length_nuclide_grid, sizeof(NuclideGridPoint));
-	assert(SD.nuclide_grid != NULL);
-	memset(SD.nuclide_grid, 0, SD.length_nuclide_grid * sizeof(NuclideGridPoint));
+	SD.nuclide_grid     = (NuclideGridPoint *) grid_alloc( SD.length_nuclide_grid * sizeof(NuclideGridPoint), NUCLIDE_GRID, in );
 	nbytes += SD.length_nuclide_grid * sizeof(NuclideGridPoint);
-	fprintf(stderr, "Allocated %.0lf MB of data.\n", nbytes/1024.0/1024.0 );
+	print_grid_alloc( "nuclide grids", SD.length_nuclide_grid * sizeof(NuclideGridPoint), NUCLIDE_GRID, in );
 
 	////////////////////////////////////////////////////////////////////
 	// Initialize Nuclide Grids
@@ -229,3 +225,71 @@ SimulationData grid_init_do_not_profile( Inputs const in, int mype )
 	if(mype == 0) printf("Intialization complete. Allocated %.0lf MB of data.\n", nbytes/1024.0/1024.0 );
 	return SD;
 }
+
+// Replaces the AOS nuclide grids by an array of the gridpoint energies and
+// an array of their cross sections. The grid searches only read energies, so
+// each of their probes now pulls in 8 gridpoints per cache line instead of
+// about 1. The 5 cross sections are still read together, for the 2 points
+// bounding the energy, so they stay grouped per point. The split grids take
+// as many bytes as the AOS grids, which are freed, and are placed like them.
+void split_nuclide_grid( SimulationData * SD, Inputs in, int mype )
+{
+	if(mype == 0) printf("Splitting nuclide grids into energies and cross sections...\n");
+
+	SD->nuclide_energy = (double *) grid_alloc( SD->length_nuclide_grid * sizeof(double), NUCLIDE_GRID, in );
+	SD->nuclide_xs = (NuclideXS *) grid_alloc( SD->length_nuclide_grid * sizeof(NuclideXS), NUCLIDE_GRID, in );
+
+	#pragma omp parallel for
+	for( long i = 0; i < SD->length_nuclide_grid; i++ )
+	{
+		SD->nuclide_energy[i]           = SD->nuclide_grid[i].energy;
+		SD->nuclide_xs[i].total_xs      = SD->nuclide_grid[i].total_xs;
+		SD->nuclide_xs[i].elastic_xs    = SD->nuclide_grid[i].elastic_xs;
+		SD->nuclide_xs[i].absorbtion_xs = SD->nuclide_grid[i].absorbtion_xs;
+		SD->nuclide_xs[i].fission_xs    = SD->nuclide_grid[i].fission_xs;
+		SD->nuclide_xs[i].nu_fission_xs = SD->nuclide_grid[i].nu_fission_xs;
+	}
+
+	grid_free(SD->nuclide_grid);
+	SD->nuclide_grid = NULL;
+}
+
+// Replaces the unionized index grid by the entries of the first energy of
+// every block of INDEX_BLOCK unionized energies and a byte per entry with its
+// offset from them. An entry rises by at most 1 from one unionized energy to
+// the next, so the offsets stay below INDEX_BLOCK and the grid shrinks to
+// about a quarter, which leaves more of the cache to the nuclide grids. The
+// binary files keep the uncompressed grid, which is compressed once loaded.
+void compress_index_grid( SimulationData * SD, Inputs in, int mype )
+{
+	if(mype == 0) printf("Compressing unionized index grid...\n");
+
+	long n_isotopes = in.n_isotopes;
+	long n_energies = SD->length_unionized_energy_array;
+	long n_blocks = (n_energies + INDEX_BLOCK - 1) / INDEX_BLOCK;
+	long length_base = n_blocks * n_isotopes;
+
+	int * index_base = (int *) grid_alloc( length_base * sizeof(int), INDEX_GRID, in );
+	SD->length_index_delta = n_energies * n_isotopes;
+	SD->index_delta = (uint8_t *) grid_alloc( SD->length_index_delta * sizeof(uint8_t), INDEX_GRID, in );
+
+	#pragma omp parallel for
+	for( long b = 0; b < n_blocks; b++ )
+	{
+		int * first = &SD->index_grid[b * INDEX_BLOCK * n_isotopes];
+		memcpy(&index_base[b * n_isotopes], first, n_isotopes * sizeof(int));
+		long end = (b + 1) * INDEX_BLOCK < n_energies ? (b + 1) * INDEX_BLOCK : n_energies;
+		for( long e = b * INDEX_BLOCK; e < end; e++ )
+			for( long i = 0; i < n_isotopes; i++ )
+			{
+				int delta = SD->index_grid[e * n_isotopes + i] - first[i];
+				assert(delta >= 0 && delta < INDEX_BLOCK);
+				SD->index_delta[e * n_isotopes + i] = (uint8_t) delta;
+			}
+	}
+	print_grid_alloc( "compressed index grid", SD->length_index_delta * sizeof(uint8_t) + length_base * sizeof(int), INDEX_GRID, in );
+
+	grid_free(SD->index_grid);
+	SD->index_grid = index_base;
+	SD->length_index_grid = length_base;
+}
@@ -49,6 +49,8 @@ int main( int argc, char* argv[] )
 	// all simulation data structures from file instead
 	if( in.binary_mode == READ )
 		SD = binary_read(in);
+	else if( in.binary_mode == MAPPED_READ || in.binary_mode == MAPPED_POPULATE )
+		SD = binary_map(in);
 	else
 		SD = grid_init_do_not_profile( in, mype );
 
@@ -56,6 +58,16 @@ int main( int argc, char* argv[] )
 	// structures to file
 	if( in.binary_mode == WRITE && mype == 0 )
 		binary_write(in, SD);
+	if( in.binary_mode == MAPPED_WRITE && mype == 0 )
+		binary_write_mapped(in, SD);
+
+	// The data-oriented kernels read the nuclide grids split into their
+	// energies and cross sections
+	if( in.kernel_id == 2 || in.kernel_id == 3 || in.kernel_id == 4 )
+		split_nuclide_grid( &SD, in, mype );
+
+	if( in.compress_index && in.grid_type == UNIONIZED )
+		compress_index_grid( &SD, in, mype );
 
 
 	// =====================================================================
@@ -83,6 +95,10 @@ int main( int argc, char* argv[] )
 			verification = run_event_based_simulation(in, SD, mype);
 		else if( in.kernel_id == 1 )
 			verification = run_event_based_simulation_optimization_1(in, SD, mype);
+		else if( in.kernel_id == 2 )
+			verification = run_event_based_simulation_optimization_2(in, SD, mype);
+		else if( in.kernel_id == 3 )
+			verification = run_event_based_simulation_optimization_3(in, SD, mype);
 		else
 		{
 			printf("Error: No kernel ID %d found!\n", in.kernel_id);
@@ -90,7 +106,19 @@ int main( int argc, char* argv[] )
 		}
 	}
 	else
-		verification = run_history_based_simulation(in, SD, mype);
+	{
+		if( in.kernel_id == 0 )
+			verification = run_history_based_simulation(in, SD, mype);
+		else if( in.kernel_id == 2 )
+			verification = run_history_based_simulation_optimization_2(in, SD, mype);
+		else if( in.kernel_id == 4 )
+			verification = run_history_based_simulation_optimization_4(in, SD, mype);
+		else
+		{
+			printf("Error: No history based kernel ID %d found!\n", in.kernel_id);
+			exit(1);
+		}
+	}
 
 	if( mype == 0)	
 	{	
@@ -80,6 +80,7 @@ unsigned long long run_event_based_simulation(Inputs in, SimulationData SD, int
 				concs,        // Flattened 2-D array with concentration of each nuclide in each material
 				unionized_energy_array, // 1-D Unionized energy array
 				index_grid,   // Flattened 2-D grid holding indices into nuclide grid for each unionized energy level
+				SD.index_delta, // Offsets of the compressed unionized index grid (-C) from its block entries, or NULL
 				nuclide_grid, // Flattened 2-D grid holding energy levels and XS_data for all nuclides in simulation
 				SD.mats,         // Flattened 2-D array with nuclide indices defining composition of each type of material
 				macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
@@ -185,6 +186,7 @@ unsigned long long run_history_based_simulation(Inputs in, SimulationData SD, in
 					concs,        // Flattened 2-D array with concentration of each nuclide in each material
 					unionized_energy_array, // 1-D Unionized energy array
 					index_grid,   // Flattened 2-D grid holding indices into nuclide grid for each unionized energy level
+					SD.index_delta, // Offsets of the compressed unionized index grid (-C) from its block entries, or NULL
 					nuclide_grid, // Flattened 2-D grid holding energy levels and XS_data for all nuclides in simulation
 					SD.mats,         // Flattened 2-D array with nuclide indices for each type of material
 					macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
@@ -239,6 +241,7 @@ unsigned long long run_history_based_simulation(Inputs in, SimulationData SD, in
 void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
                            long n_gridpoints,
                            double * restrict egrid, int * restrict index_data,
+                           uint8_t * restrict index_delta,
                            NuclideGridPoint * restrict nuclide_grids,
                            long idx, double * restrict xs_vector, int grid_type, int hash_bins ){
 	// Variables
@@ -263,10 +266,11 @@ void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
 	{
 		// pull ptr from energy grid and check to ensure that
 		// we're not reading off the end of the nuclide's grid
-		if( index_data[idx * n_isotopes + nuc] == n_gridpoints - 1 )
-			low = &nuclide_grids[nuc*n_gridpoints + index_data[idx * n_isotopes + nuc] - 1];
+		long lower = unionized_index( index_data, index_delta, idx, n_isotopes, nuc );
+		if( lower == n_gridpoints - 1 )
+			low = &nuclide_grids[nuc*n_gridpoints + lower - 1];
 		else
-			low = &nuclide_grids[nuc*n_gridpoints + index_data[idx * n_isotopes + nuc]];
+			low = &nuclide_grids[nuc*n_gridpoints + lower];
 	}
 	else // Hash grid
 	{
@@ -325,6 +329,7 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
                          long n_gridpoints, int * restrict num_nucs,
                          double * restrict concs,
                          double * restrict egrid, int * restrict index_data,
+                         uint8_t * restrict index_delta,
                          NuclideGridPoint * restrict nuclide_grids,
                          int * restrict mats,
                          double * restrict macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs ){
@@ -365,7 +370,7 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 		p_nuc = mats[mat*max_num_nucs + j];
 		conc = concs[mat*max_num_nucs + j];
 		calculate_micro_xs( p_energy, p_nuc, n_isotopes,
-		                    n_gridpoints, egrid, index_data,
+		                    n_gridpoints, egrid, index_data, index_delta,
 		                    nuclide_grids, idx, xs_vector, grid_type, hash_bins );
 		for( int k = 0; k < 5; k++ )
 			macro_xs_vector[k] += xs_vector[k] * conc;
@@ -509,7 +514,7 @@ uint64_t fast_forward_LCG(uint64_t seed, uint64_t n)
 // line argument.
 //
 // As fast parallel sorting will be required for these optimizations, we will
-// first define a set of key-value parallel quicksort routines.
+// first define a key-value parallel radix sort.
 ////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////
@@ -517,163 +522,110 @@ uint64_t fast_forward_LCG(uint64_t seed, uint64_t n)
 
 
 ////////////////////////////////////////////////////////////////////////////////////
-// Parallel Quicksort Key-Value Sorting Algorithms
+// Parallel Radix Key-Value Sorting Algorithm
 ////////////////////////////////////////////////////////////////////////////////////
 //
-// These algorithms are based on the parallel quicksort implementation by
-// Eduard Lopez published at https://github.com/eduardlopez/quicksort-parallel
-//
-// Eduard's original version was for an integer type quicksort, but I have modified
-// it to form two different versions that can sort key-value pairs together without
-// having to bundle them into a separate object. Additionally, I have modified the
-// optimal chunk sizes and restricted the number of threads for the array sizing
-// that XSBench will be using by default.
-//
-// Eduard's original implementation carries the following license, which applies to
-// the following functions only:
-//
-//	void quickSort_parallel_internal_i_d(int* key,double * value, int left, int right, int cutoff) 
-//  void quickSort_parallel_i_d(int* key,double * value, int lenArray, int numThreads)
-//  void quickSort_parallel_internal_d_i(double* key,int * value, int left, int right, int cutoff)
-//  void quickSort_parallel_d_i(double* key,int * value, int lenArray, int numThreads)
-//
-// The MIT License (MIT)
-//
-// Copyright (c) 2016 Eduard López
-//
-// Permission is hereby granted, free of charge, to any person obtaining a copy
-// of this software and associated documentation files (the "Software"), to deal
-// in the Software without restriction, including without limitation the rights
-// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-// copies of the Software, and to permit persons to whom the Software is
-// furnished to do so, subject to the following conditions:
-//
-// The above copyright notice and this permission notice shall be included in all
-// copies or substantial portions of the Software.
-//
-// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
-// SOFTWARE.
-//
+// The lookups are sorted by a 32-bit key made of their material and energy (see
+// lookup_sort_key), which a LSD radix sort orders in 4 passes of 8 bits. In each
+// pass, every thread counts the digits of its static share of the keys, the
+// counts are turned into offsets by digit, then by thread, and every thread
+// scatters its share stably to its offsets. No atomics or recursion are needed,
+// and all threads are busy in every pass, unlike in a recursive quicksort whose
+// first partitioning steps only run on one or two threads. A pass whose digit
+// is the same in all keys is skipped.
 ////////////////////////////////////////////////////////////////////////////////////
-void quickSort_parallel_internal_i_d(int* key,double * value, int left, int right, int cutoff) 
-{
-	int i = left, j = right;
-	int tmp;
-	int pivot = key[(left + right) / 2];
-	
-	{
-		while (i <= j) {
-			while (key[i] < pivot)
-				i++;
-			while (key[j] > pivot)
-				j--;
-			if (i <= j) {
-				tmp = key[i];
-				key[i] = key[j];
-				key[j] = tmp;
-				double tmp_v = value[i];
-				value[i] = value[j];
-				value[j] = tmp_v;
-				i++;
-				j--;
-			}
-		}
 
-	}
-
-	if ( ((right-left)<cutoff) ){
-		if (left < j){ quickSort_parallel_internal_i_d(key, value, left, j, cutoff); }			
-		if (i < right){ quickSort_parallel_internal_i_d(key, value, i, right, cutoff); }
-
-	}else{
-		#pragma omp task 	
-		{ quickSort_parallel_internal_i_d(key, value, left, j, cutoff); }
-		#pragma omp task 	
-		{ quickSort_parallel_internal_i_d(key, value, i, right, cutoff); }		
-	}
+// Bits of the energy in a lookup sort key, the material takes the 4 bits above
+#define SORT_KEY_ENERGY_BITS 28
 
+static inline uint32_t lookup_sort_key( int mat, double p_energy )
+{
+	return ((uint32_t) mat << SORT_KEY_ENERGY_BITS) |
+	       (uint32_t) (p_energy * (1 << SORT_KEY_ENERGY_BITS));
 }
 
-void quickSort_parallel_i_d(int* key,double * value, int lenArray, int numThreads){
-
-	// Set minumum problem size to still spawn threads for
-	int cutoff = 10000;
-
-	// For this problem size, more than 16 threads on CPU is not helpful
-	if( numThreads > 16 )
-		numThreads = 16;
+// sorts key[0, n) and value[0, n) by key, using key_tmp and value_tmp of the
+// same length as scratch
+void radix_sort_parallel_u32_d( uint32_t * key, double * value, uint32_t * key_tmp, double * value_tmp, long n )
+{
+	#ifdef OPENMP
+	int max_threads = omp_get_max_threads();
+	#else
+	int max_threads = 1;
+	#endif
+	long * counts = (long *) malloc( 256 * max_threads * sizeof(long) );
+	assert(counts != NULL);
+	uint32_t * key_in = key, * key_out = key_tmp;
+	double * value_in = value, * value_out = value_tmp;
+	int skip;
+
+	#pragma omp parallel
+	{
+		#ifdef OPENMP
+		int thread = omp_get_thread_num();
+		int nthreads = omp_get_num_threads();
+		#else
+		int thread = 0;
+		int nthreads = 1;
+		#endif
+		long low = n * thread / nthreads;
+		long high = n * (thread + 1) / nthreads;
+		long * count = &counts[256 * thread];
 
-	#pragma omp parallel num_threads(numThreads)
-	{	
-		#pragma omp single nowait
+		for( int shift = 0; shift < 32; shift += 8 )
 		{
-			quickSort_parallel_internal_i_d(key,value, 0, lenArray-1, cutoff);	
-		}
-	}	
+			memset(count, 0, 256 * sizeof(long));
+			for( long i = low; i < high; i++ )
+				count[(key_in[i] >> shift) & 0xff]++;
+			#pragma omp barrier
 
-}
+			#pragma omp single
+			{
+				long offset = 0;
+				skip = 0;
+				for( int d = 0; d < 256; d++ )
+				{
+					long digit_start = offset;
+					for( int t = 0; t < nthreads; t++ )
+					{
+						long c = counts[256 * t + d];
+						counts[256 * t + d] = offset;
+						offset += c;
+					}
+					if( offset - digit_start == n )
+						skip = 1;
+				}
+			}
 
-void quickSort_parallel_internal_d_i(double* key,int * value, int left, int right, int cutoff) 
-{
-	int i = left, j = right;
-	double tmp;
-	double pivot = key[(left + right) / 2];
-	
-	{
-		while (i <= j) {
-			while (key[i] < pivot)
-				i++;
-			while (key[j] > pivot)
-				j--;
-			if (i <= j) {
-				tmp = key[i];
-				key[i] = key[j];
-				key[j] = tmp;
-				int tmp_v = value[i];
-				value[i] = value[j];
-				value[j] = tmp_v;
-				i++;
-				j--;
+			if( !skip )
+			{
+				for( long i = low; i < high; i++ )
+				{
+					long o = count[(key_in[i] >> shift) & 0xff]++;
+					key_out[o] = key_in[i];
+					value_out[o] = value_in[i];
+				}
+				#pragma omp barrier
+
+				#pragma omp single
+				{
+					uint32_t * k = key_in;
+					key_in = key_out;
+					key_out = k;
+					double * v = value_in;
+					value_in = value_out;
+					value_out = v;
+				}
 			}
 		}
-
 	}
 
-	if ( ((right-left)<cutoff) ){
-		if (left < j){ quickSort_parallel_internal_d_i(key, value, left, j, cutoff); }			
-		if (i < right){ quickSort_parallel_internal_d_i(key, value, i, right, cutoff); }
-
-	}else{
-		#pragma omp task 	
-		{ quickSort_parallel_internal_d_i(key, value, left, j, cutoff); }
-		#pragma omp task 	
-		{ quickSort_parallel_internal_d_i(key, value, i, right, cutoff); }		
+	if( key_in != key )
+	{
+		memcpy(key, key_in, n * sizeof(uint32_t));
+		memcpy(value, value_in, n * sizeof(double));
 	}
-
-}
-
-void quickSort_parallel_d_i(double* key,int * value, int lenArray, int numThreads){
-
-	// Set minumum problem size to still spawn threads for
-	int cutoff = 10000;
-
-	// For this problem size, more than 16 threads on CPU is not helpful
-	if( numThreads > 16 )
-		numThreads = 16;
-
-	#pragma omp parallel num_threads(numThreads)
-	{	
-		#pragma omp single nowait
-		{
-			quickSort_parallel_internal_d_i(key,value, 0, lenArray-1, cutoff);	
-		}
-	}	
-
+	free(counts);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -745,20 +697,33 @@ unsigned long long run_event_based_simulation_optimization_1(Inputs in, Simulati
 	if(mype == 0) printf("finished sampling...\n");
 	
 	////////////////////////////////////////////////////////////////////////////////
-	// Sort by Material
+	// Sort by Material and Energy
 	////////////////////////////////////////////////////////////////////////////////
 	
 	start = get_time();
 
-	quickSort_parallel_i_d(SD.mat_samples, SD.p_energy_samples, in.lookups, in.nthreads);
+	// Both are sorted at once, by a key holding the material above the energy
+	uint32_t * keys = (uint32_t *) malloc(2 * in.lookups * sizeof(uint32_t));
+	assert(keys != NULL);
+	double * energy_tmp = (double *) malloc(in.lookups * sizeof(double));
+	assert(energy_tmp != NULL);
+
+	#pragma omp parallel for
+	for( int i = 0; i < in.lookups; i++ )
+		keys[i] = lookup_sort_key(SD.mat_samples[i], SD.p_energy_samples[i]);
+
+	radix_sort_parallel_u32_d(keys, SD.p_energy_samples, keys + in.lookups, energy_tmp, in.lookups);
+
+	#pragma omp parallel for
+	for( int i = 0; i < in.lookups; i++ )
+		SD.mat_samples[i] = keys[i] >> SORT_KEY_ENERGY_BITS;
+
+	free(keys);
+	free(energy_tmp);
 
 	stop = get_time();
 
-	if(mype == 0) printf("Material sort took %.3lf seconds\n", stop-start);
-	
-	////////////////////////////////////////////////////////////////////////////////
-	// Sort by Energy
-	////////////////////////////////////////////////////////////////////////////////
+	if(mype == 0) printf("Material and energy sort took %.3lf seconds\n", stop-start);
 	
 	start = get_time();
 	
@@ -774,15 +739,8 @@ unsigned long long run_event_based_simulation_optimization_1(Inputs in, Simulati
 	
 	stop = get_time();
 	if(mype == 0) printf("Counting samples and offsets took %.3lf seconds\n", stop-start);
-	start = stop;
 
-	// Sort each material type by energy level
 	int offset = 0;
-	for( int m = 0; m < 12; m++ )
-		quickSort_parallel_d_i(SD.p_energy_samples + offsets[m],SD.mat_samples + offsets[m], num_samples_per_mat[m], in.nthreads);
-
-	stop = get_time();
-	if(mype == 0) printf("Energy Sorts took %.3lf seconds\n", stop-start);
 	
 	////////////////////////////////////////////////////////////////////////////////
 	// Perform lookups for each material separately
@@ -828,6 +786,7 @@ unsigned long long run_event_based_simulation_optimization_1(Inputs in, Simulati
 					concs,        // Flattened 2-D array with concentration of each nuclide in each material
 					unionized_energy_array, // 1-D Unionized energy array
 					index_grid,   // Flattened 2-D grid holding indices into nuclide grid for each unionized energy level
+					SD.index_delta, // Offsets of the compressed unionized index grid (-C) from its block entries, or NULL
 					nuclide_grid, // Flattened 2-D grid holding energy levels and XS_data for all nuclides in simulation
 					SD.mats,         // Flattened 2-D array with nuclide indices defining composition of each type of material
 					macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
@@ -864,3 +823,549 @@ unsigned long long run_event_based_simulation_optimization_1(Inputs in, Simulati
 	return verification;
 }
 
+
+////////////////////////////////////////////////////////////////////////////////////
+// Optimization 2 -- Split nuclide grids + two-phase vectorized nuclide loop
+////////////////////////////////////////////////////////////////////////////////////
+// This kernel reads the nuclide grids split by split_nuclide_grid() into an
+// array of energies and an array of cross sections. The grid searches only
+// touch the densely packed energies, the cross sections are only read for the
+// two gridpoints bounding the energy.
+//
+// The macroscopic XS lookup first finds the bounding gridpoint of every nuclide
+// in the material, then interpolates and accumulates the cross sections of all
+// nuclides in one SIMD loop. The searches of the first phase are independent of
+// each other, so they also overlap their cache misses instead of alternating
+// with the arithmetic. It runs in both the event and the history based modes.
+////////////////////////////////////////////////////////////////////////////////////
+
+// binary search for energy in [low, high] of a split nuclide energy grid
+// returns lower index
+long grid_search_energy( double quarry, double * restrict A, long low, long high)
+{
+	long lowerLimit = low;
+	long upperLimit = high;
+	long examinationPoint;
+	long length = upperLimit - lowerLimit;
+
+	while( length > 1 )
+	{
+		examinationPoint = lowerLimit + ( length / 2 );
+		
+		if( A[examinationPoint] > quarry )
+			upperLimit = examinationPoint;
+		else
+			lowerLimit = examinationPoint;
+		
+		length = upperLimit - lowerLimit;
+	}
+	
+	return lowerLimit;
+}
+
+// Interpolates the micro XS of n nuclides at their lower bounding gridpoints
+// low[j] (in the whole split grid) and sums them weighted by conc[j]
+static inline void accumulate_macro_xs( double p_energy, int n, long * restrict low,
+                                        double * restrict conc,
+                                        double * restrict nuclide_energy,
+                                        NuclideXS * restrict nuclide_xs,
+                                        double * restrict macro_xs_vector )
+{
+	double total = 0, elastic = 0, absorbtion = 0, fission = 0, nu_fission = 0;
+	#pragma omp simd reduction(+:total,elastic,absorbtion,fission,nu_fission)
+	for( int j = 0; j < n; j++ )
+	{
+		long l = low[j];
+		double f = (nuclide_energy[l+1] - p_energy) / (nuclide_energy[l+1] - nuclide_energy[l]);
+		NuclideXS * lo = &nuclide_xs[l];
+		NuclideXS * hi = &nuclide_xs[l+1];
+		total      += (hi->total_xs      - f * (hi->total_xs      - lo->total_xs))      * conc[j];
+		elastic    += (hi->elastic_xs    - f * (hi->elastic_xs    - lo->elastic_xs))    * conc[j];
+		absorbtion += (hi->absorbtion_xs - f * (hi->absorbtion_xs - lo->absorbtion_xs)) * conc[j];
+		fission    += (hi->fission_xs    - f * (hi->fission_xs    - lo->fission_xs))    * conc[j];
+		nu_fission += (hi->nu_fission_xs - f * (hi->nu_fission_xs - lo->nu_fission_xs)) * conc[j];
+	}
+
+	macro_xs_vector[0] = total;
+	macro_xs_vector[1] = elastic;
+	macro_xs_vector[2] = absorbtion;
+	macro_xs_vector[3] = fission;
+	macro_xs_vector[4] = nu_fission;
+}
+
+// Same result as calculate_macro_xs, on the split nuclide grids
+void calculate_macro_xs_split( double p_energy, int mat, long n_isotopes,
+                         long n_gridpoints, int * restrict num_nucs,
+                         double * restrict concs,
+                         double * restrict egrid, int * restrict index_data,
+                         uint8_t * restrict index_delta,
+                         double * restrict nuclide_energy,
+                         NuclideXS * restrict nuclide_xs,
+                         int * restrict mats,
+                         double * restrict macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs ){
+	long idx = -1;
+	int n = num_nucs[mat];
+	long low[max_num_nucs]; // lower bounding gridpoint of each nuclide
+
+	if( grid_type == UNIONIZED )
+		idx = grid_search( n_isotopes * n_gridpoints, p_energy, egrid);	
+	else if( grid_type == HASH )
+	{
+		double du = 1.0 / hash_bins;
+		idx = p_energy / du;
+	}
+
+	// Phase 1: find the gridpoints bounding the energy, as calculate_micro_xs
+	for( int j = 0; j < n; j++ )
+	{
+		long nuc = mats[mat*max_num_nucs + j];
+		double * E = &nuclide_energy[nuc*n_gridpoints];
+		long lower;
+
+		if( grid_type == NUCLIDE )
+			lower = grid_search_energy( p_energy, E, 0, n_gridpoints-1);
+		else if( grid_type == UNIONIZED )
+			lower = unionized_index( index_data, index_delta, idx, n_isotopes, nuc );
+		else // Hash grid
+		{
+			long u_low = index_data[idx * n_isotopes + nuc];
+			long u_high;
+			if( idx == hash_bins - 1 )
+				u_high = n_gridpoints - 1;
+			else
+				u_high = index_data[(idx+1)*n_isotopes + nuc] + 1;
+
+			if( p_energy <= E[u_low] )
+				lower = 0;
+			else if( p_energy >= E[u_high] )
+				lower = n_gridpoints - 1;
+			else
+				lower = grid_search_energy( p_energy, E, u_low, u_high);
+		}
+
+		// we must not read off the end of the nuclide's grid
+		if( lower == n_gridpoints - 1 )
+			lower--;
+		low[j] = nuc*n_gridpoints + lower;
+
+		// start loading the cross sections read by phase 2
+		__builtin_prefetch(&nuclide_xs[low[j]]);
+		__builtin_prefetch(&nuclide_xs[low[j]+1].nu_fission_xs);
+	}
+
+	// Phase 2: interpolate and accumulate the micro XS of all nuclides
+	accumulate_macro_xs( p_energy, n, low, &concs[mat*max_num_nucs],
+	                     nuclide_energy, nuclide_xs, macro_xs_vector );
+}
+
+// index of the largest channel of a macro XS vector, plus 1 (verification)
+static inline int macro_xs_max_idx( double * macro_xs_vector )
+{
+	double max = -1.0;
+	int max_idx = 0;
+	for(int j = 0; j < 5; j++ )
+	{
+		if( macro_xs_vector[j] > max )
+		{
+			max = macro_xs_vector[j];
+			max_idx = j;
+		}
+	}
+	return max_idx+1;
+}
+
+unsigned long long run_event_based_simulation_optimization_2(Inputs in, SimulationData SD, int mype)
+{
+	char * optimization_name = "Optimization 2 - Split nuclide grids + vectorized nuclide loop";
+	
+	if( mype == 0)	printf("Simulation Kernel:\"%s\"\n", optimization_name);
+	if( mype == 0)	printf("Beginning event based simulation...\n");
+
+	unsigned long long verification = 0;
+	#pragma omp parallel for schedule(dynamic,100) reduction(+:verification)
+	for( int i = 0; i < in.lookups; i++ )
+	{
+		// Set the initial seed value
+		uint64_t seed = STARTING_SEED;	
+
+		// Forward seed to lookup index (we need 2 samples per lookup)
+		seed = fast_forward_LCG(seed, 2*i);
+
+		// Randomly pick an energy and material for the particle
+		double p_energy = LCG_random_double(&seed);
+		int mat         = pick_mat(&seed); 
+
+		double macro_xs_vector[5];
+
+		calculate_macro_xs_split( p_energy, mat, in.n_isotopes, in.n_gridpoints,
+		                          SD.num_nucs, SD.concs, SD.unionized_energy_array,
+		                          SD.index_grid, SD.index_delta, SD.nuclide_energy, SD.nuclide_xs,
+		                          SD.mats, macro_xs_vector, in.grid_type,
+		                          in.hash_bins, SD.max_num_nucs );
+
+		verification += macro_xs_max_idx(macro_xs_vector);
+	}
+
+	return verification;
+}
+
+unsigned long long run_history_based_simulation_optimization_2(Inputs in, SimulationData SD, int mype)
+{
+	char * optimization_name = "Optimization 2 - Split nuclide grids + vectorized nuclide loop";
+	
+	if( mype == 0)	printf("Simulation Kernel:\"%s\"\n", optimization_name);
+	if( mype == 0)	printf("Beginning history based simulation...\n");
+
+	unsigned long long verification = 0;
+	#pragma omp parallel for schedule(dynamic, 100) reduction(+:verification)
+	for( int p = 0; p < in.particles; p++ )
+	{
+		// Set the initial seed value
+		uint64_t seed = STARTING_SEED;	
+
+		// Forward seed to lookup index (we need 2 samples per lookup, and
+		// we may fast forward up to 5 times after each lookup)
+		seed = fast_forward_LCG(seed, p*in.lookups*2*5);
+
+		// Randomly pick an energy and material for the particle
+		double p_energy = LCG_random_double(&seed);
+		int mat         = pick_mat(&seed); 
+
+		// This loop is dependent, as in run_history_based_simulation
+		for( int i = 0; i < in.lookups; i++ )
+		{
+			double macro_xs_vector[5];
+
+			calculate_macro_xs_split( p_energy, mat, in.n_isotopes, in.n_gridpoints,
+			                          SD.num_nucs, SD.concs, SD.unionized_energy_array,
+			                          SD.index_grid, SD.index_delta, SD.nuclide_energy, SD.nuclide_xs,
+			                          SD.mats, macro_xs_vector, in.grid_type,
+			                          in.hash_bins, SD.max_num_nucs );
+
+			verification += macro_xs_max_idx(macro_xs_vector);
+
+			uint64_t n_forward = 0;
+			for( int j = 0; j < 5; j++ )
+				if( macro_xs_vector[j] > 1.0 )
+					n_forward++;
+			if( n_forward > 0 )
+				seed = fast_forward_LCG(seed, n_forward);
+
+			p_energy = LCG_random_double(&seed);
+			mat      = pick_mat(&seed); 
+		}
+	}
+	return verification;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// Optimization 3 -- Batched event-based kernel, sorted by material and energy
+////////////////////////////////////////////////////////////////////////////////////
+// This kernel samples the lookups in batches of in.batch_size (-B), sorts every
+// batch by material and energy with the parallel radix sort, then performs its
+// lookups in sorted order on the split nuclide grids of optimization 2. Each
+// thread gets a contiguous run of the sorted batch, so it walks the index and
+// nuclide grids of a material in increasing energy: consecutive lookups mostly
+// read the same or the next cache lines and pages, which the hardware
+// prefetchers follow, instead of a random line per lookup. Larger batches make
+// the runs denser, smaller batches keep the samples and keys in cache.
+//
+// Sampling, sorting and lookups are timed separately.
+////////////////////////////////////////////////////////////////////////////////////
+
+unsigned long long run_event_based_simulation_optimization_3(Inputs in, SimulationData SD, int mype)
+{
+	char * optimization_name = "Optimization 3 - Batched material & energy radix sort + split nuclide grids";
+	
+	if( mype == 0)	printf("Simulation Kernel:\"%s\"\n", optimization_name);
+
+	long batch = in.batch_size < in.lookups ? in.batch_size : in.lookups;
+	size_t total_sz = 2 * batch * (sizeof(uint32_t) + sizeof(double));
+	uint32_t * keys = (uint32_t *) malloc(2 * batch * sizeof(uint32_t));
+	assert(keys != NULL);
+	double * energies = (double *) malloc(2 * batch * sizeof(double));
+	assert(energies != NULL);
+
+	if( mype == 0)	printf("Allocated an additional %.0lf MB of data for sorting.\n", total_sz/1024.0/1024.0);
+	if( mype == 0)	printf("Beginning event based simulation...\n");
+
+	double sample_time = 0, sort_time = 0, lookup_time = 0;
+	double start, stop;
+	long nbatches = 0;
+	unsigned long long verification = 0;
+
+	for( long first = 0; first < in.lookups; first += batch, nbatches++ )
+	{
+		long n = in.lookups - first < batch ? in.lookups - first : batch;
+
+		// Sample Materials and Energies, as run_event_based_simulation
+		start = get_time();
+		#pragma omp parallel for schedule(static)
+		for( long i = 0; i < n; i++ )
+		{
+			uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(first + i));
+			double p_energy = LCG_random_double(&seed);
+			int mat         = pick_mat(&seed); 
+			keys[i] = lookup_sort_key(mat, p_energy);
+			energies[i] = p_energy;
+		}
+		stop = get_time();
+		sample_time += stop - start;
+
+		// Sort the batch
+		radix_sort_parallel_u32_d(keys, energies, keys + batch, energies + batch, n);
+		start = get_time();
+		sort_time += start - stop;
+
+		// Perform the lookups in sorted order
+		#pragma omp parallel for schedule(static) reduction(+:verification)
+		for( long i = 0; i < n; i++ )
+		{
+			int mat = keys[i] >> SORT_KEY_ENERGY_BITS;
+			double macro_xs_vector[5];
+
+			calculate_macro_xs_split( energies[i], mat, in.n_isotopes, in.n_gridpoints,
+			                          SD.num_nucs, SD.concs, SD.unionized_energy_array,
+			                          SD.index_grid, SD.index_delta, SD.nuclide_energy, SD.nuclide_xs,
+			                          SD.mats, macro_xs_vector, in.grid_type,
+			                          in.hash_bins, SD.max_num_nucs );
+
+			verification += macro_xs_max_idx(macro_xs_vector);
+		}
+		lookup_time += get_time() - start;
+	}
+
+	free(keys);
+	free(energies);
+
+	if(mype == 0) printf("Sampling took %.3lf seconds\n", sample_time);
+	if(mype == 0) printf("Sorting %ld batches took %.3lf seconds\n", nbatches, sort_time);
+	if(mype == 0) printf("XS Lookups took %.3lf seconds\n", lookup_time);
+	return verification;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// Optimization 4 -- History-based particles in lockstep + interleaved searches
+////////////////////////////////////////////////////////////////////////////////////
+// The lookups of a particle history depend on each other, so the other history
+// based kernels have one lookup per thread in flight, and every probe of a grid
+// search waits for the miss of the previous one. This kernel advances groups of
+// in.particle_group (-L) particles in lockstep instead. The grid searches of all
+// nuclides of all particles in a group are interleaved: each round takes one
+// probe of every unfinished search and prefetches its next probe, so a thread
+// has as many misses in flight as there are searches, and the memory latency is
+// paid once per round rather than once per probe. The index grid entries and
+// the cross sections of the bounding gridpoints are prefetched the same way,
+// then every particle is interpolated with the SIMD loop of optimization 2 on
+// the split nuclide grids.
+//
+// Each particle keeps its own seed and sequence of lookups, so the verification
+// is that of the other history based kernels.
+////////////////////////////////////////////////////////////////////////////////////
+
+// grid_search_energy of quarry[k] in [low[k], high[k]] of A for all k < m, with
+// the probes of the searches interleaved. The lower index is left in low[k].
+static void grid_search_energy_interleaved( long m, double * restrict quarry,
+                                            double * restrict A,
+                                            long * restrict low, long * restrict high )
+{
+	int active = 0;
+	for( long k = 0; k < m; k++ )
+		if( high[k] - low[k] > 1 )
+		{
+			__builtin_prefetch(&A[low[k] + (high[k] - low[k]) / 2]);
+			active = 1;
+		}
+
+	while( active )
+	{
+		active = 0;
+		for( long k = 0; k < m; k++ )
+		{
+			long length = high[k] - low[k];
+			if( length <= 1 )
+				continue;
+
+			long examinationPoint = low[k] + ( length / 2 );
+			if( A[examinationPoint] > quarry[k] )
+				high[k] = examinationPoint;
+			else
+				low[k] = examinationPoint;
+
+			length = high[k] - low[k];
+			if( length > 1 )
+			{
+				__builtin_prefetch(&A[low[k] + length / 2]);
+				active = 1;
+			}
+		}
+	}
+}
+
+unsigned long long run_history_based_simulation_optimization_4(Inputs in, SimulationData SD, int mype)
+{
+	char * optimization_name = "Optimization 4 - Particles in lockstep + interleaved grid searches";
+	
+	if( mype == 0)	printf("Simulation Kernel:\"%s\"\n", optimization_name);
+	if( mype == 0)	printf("Beginning history based simulation...\n");
+
+	long n_isotopes = in.n_isotopes;
+	long n_gridpoints = in.n_gridpoints;
+	int max_num_nucs = SD.max_num_nucs;
+	int group = in.particle_group;
+	long max_searches = (long) group * max_num_nucs;
+	double du = 1.0 / in.hash_bins;
+
+	unsigned long long verification = 0;
+	#pragma omp parallel reduction(+:verification)
+	{
+		// State of the particles of a group, and one search per nuclide in
+		// the material of every particle, those of particle k from first[k]
+		uint64_t * seed  = (uint64_t *) malloc(group * sizeof(uint64_t));
+		double * p_energy = (double *) malloc(group * sizeof(double));
+		int * mat        = (int *) malloc(group * sizeof(int));
+		long * idx       = (long *) malloc(group * sizeof(long));
+		long * idx_high  = (long *) malloc(group * sizeof(long));
+		int * first      = (int *) malloc((group + 1) * sizeof(int));
+		long * nuc       = (long *) malloc(max_searches * sizeof(long));
+		double * quarry  = (double *) malloc(max_searches * sizeof(double));
+		long * low       = (long *) malloc(max_searches * sizeof(long));
+		long * high      = (long *) malloc(max_searches * sizeof(long));
+		assert(seed && p_energy && mat && idx && idx_high && first && nuc && quarry && low && high);
+
+		#pragma omp for schedule(dynamic, 1)
+		for( int p0 = 0; p0 < in.particles; p0 += group )
+		{
+			int n = in.particles - p0 < group ? in.particles - p0 : group;
+
+			// Sample the first energy and material of every particle, as in
+			// run_history_based_simulation
+			for( int k = 0; k < n; k++ )
+			{
+				seed[k] = fast_forward_LCG(STARTING_SEED, (uint64_t) (p0 + k)*in.lookups*2*5);
+				p_energy[k] = LCG_random_double(&seed[k]);
+				mat[k]      = pick_mat(&seed[k]);
+			}
+
+			// This loop is dependent, but the particles of the group are not
+			for( int i = 0; i < in.lookups; i++ )
+			{
+				// Find the index grid rows of the particles
+				if( in.grid_type == UNIONIZED )
+				{
+					for( int k = 0; k < n; k++ )
+					{
+						idx[k] = 0;
+						idx_high[k] = n_isotopes * n_gridpoints - 1;
+					}
+					grid_search_energy_interleaved( n, p_energy, SD.unionized_energy_array, idx, idx_high );
+				}
+				else if( in.grid_type == HASH )
+					for( int k = 0; k < n; k++ )
+						idx[k] = p_energy[k] / du;
+
+				// List the searches and prefetch the index grid entries they start from
+				long m = 0;
+				for( int k = 0; k < n; k++ )
+				{
+					first[k] = m;
+					for( int j = 0; j < SD.num_nucs[mat[k]]; j++, m++ )
+					{
+						nuc[m] = SD.mats[mat[k]*max_num_nucs + j];
+						quarry[m] = p_energy[k];
+						if( in.grid_type != NUCLIDE && SD.index_delta == NULL )
+							__builtin_prefetch(&SD.index_grid[idx[k] * n_isotopes + nuc[m]]);
+						else if( in.grid_type != NUCLIDE )
+							__builtin_prefetch(&SD.index_delta[idx[k] * n_isotopes + nuc[m]]);
+						if( in.grid_type == HASH && idx[k] != in.hash_bins - 1 )
+							__builtin_prefetch(&SD.index_grid[(idx[k]+1) * n_isotopes + nuc[m]]);
+					}
+				}
+				first[n] = m;
+
+				// Set the range of every search in the whole split grid, as
+				// calculate_macro_xs_split, and prefetch the energies
+				// bounding the hash bins
+				for( int k = 0; k < n; k++ )
+					for( long s = first[k]; s < first[k+1]; s++ )
+					{
+						long base = nuc[s] * n_gridpoints;
+						if( in.grid_type == NUCLIDE )
+						{
+							low[s] = base;
+							high[s] = base + n_gridpoints - 1;
+						}
+						else if( in.grid_type == UNIONIZED )
+							low[s] = high[s] = base + unionized_index( SD.index_grid, SD.index_delta, idx[k], n_isotopes, nuc[s] );
+						else
+						{
+							low[s] = base + SD.index_grid[idx[k] * n_isotopes + nuc[s]];
+							if( idx[k] == in.hash_bins - 1 )
+								high[s] = base + n_gridpoints - 1;
+							else
+								high[s] = base + SD.index_grid[(idx[k]+1) * n_isotopes + nuc[s]] + 1;
+							__builtin_prefetch(&SD.nuclide_energy[low[s]]);
+							__builtin_prefetch(&SD.nuclide_energy[high[s]]);
+						}
+					}
+
+				if( in.grid_type == HASH )
+					for( long s = 0; s < m; s++ )
+					{
+						long base = nuc[s] * n_gridpoints;
+						if( quarry[s] <= SD.nuclide_energy[low[s]] )
+							low[s] = high[s] = base;
+						else if( quarry[s] >= SD.nuclide_energy[high[s]] )
+							low[s] = high[s] = base + n_gridpoints - 1;
+					}
+
+				grid_search_energy_interleaved( m, quarry, SD.nuclide_energy, low, high );
+
+				// we must not read off the end of the nuclide's grid, and
+				// start loading the cross sections of the bounding gridpoints
+				for( long s = 0; s < m; s++ )
+				{
+					if( low[s] == nuc[s] * n_gridpoints + n_gridpoints - 1 )
+						low[s]--;
+					__builtin_prefetch(&SD.nuclide_xs[low[s]]);
+					__builtin_prefetch(&SD.nuclide_xs[low[s]+1].nu_fission_xs);
+				}
+
+				for( int k = 0; k < n; k++ )
+				{
+					double macro_xs_vector[5];
+
+					accumulate_macro_xs( p_energy[k], first[k+1] - first[k], &low[first[k]],
+					                     &SD.concs[mat[k]*max_num_nucs], SD.nuclide_energy,
+					                     SD.nuclide_xs, macro_xs_vector );
+
+					verification += macro_xs_max_idx(macro_xs_vector);
+
+					// Pick the next energy and material of the particle, as
+					// in run_history_based_simulation
+					uint64_t n_forward = 0;
+					for( int j = 0; j < 5; j++ )
+						if( macro_xs_vector[j] > 1.0 )
+							n_forward++;
+					if( n_forward > 0 )
+						seed[k] = fast_forward_LCG(seed[k], n_forward);
+
+					p_energy[k] = LCG_random_double(&seed[k]);
+					mat[k]      = pick_mat(&seed[k]); 
+				}
+			}
+		}
+
+		free(seed);
+		free(p_energy);
+		free(mat);
+		free(idx);
+		free(idx_high);
+		free(first);
+		free(nuc);
+		free(quarry);
+		free(low);
+		free(high);
+	}
+	return verification;
+}
@@ -11,6 +11,8 @@
 #include<sys/time.h>
 #include<assert.h>
 #include<stdint.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
 
 #ifdef OPENMP
 #include<omp.h>
@@ -41,10 +43,29 @@
 #define NONE 0
 #define READ 1
 #define WRITE 2
+#define MAPPED_READ 3
+#define MAPPED_POPULATE 4
+#define MAPPED_WRITE 5
 
 // Starting Seed
 #define STARTING_SEED 1070
 
+// Grids with a placement of their own (-P)
+#define NUCLIDE_GRID 0
+#define UNIONIZED_GRID 1
+#define INDEX_GRID 2
+#define N_PLACED_GRIDS 3
+
+// Placement Policies, as the NUMA memory policies of mbind
+#define PLACE_DEFAULT 0
+#define PLACE_PREFERRED 1
+#define PLACE_BIND 2
+#define PLACE_INTERLEAVE 3
+
+// Unionized energies per block of the compressed index grid (-C)
+#define INDEX_BLOCK_SHIFT 8
+#define INDEX_BLOCK (1 << INDEX_BLOCK_SHIFT)
+
 // Structures
 typedef struct{
 	double energy;
@@ -55,6 +76,20 @@ typedef struct{
 	double nu_fission_xs;
 } NuclideGridPoint;
 
+// Cross sections of a gridpoint, without its energy (split nuclide grids)
+typedef struct{
+	double total_xs;
+	double elastic_xs;
+	double absorbtion_xs;
+	double fission_xs;
+	double nu_fission_xs;
+} NuclideXS;
+
+typedef struct{
+	int policy;
+	int node; // PLACE_PREFERRED and PLACE_BIND only
+} Placement;
+
 typedef struct{
 	int nthreads;
 	long n_isotopes;
@@ -67,6 +102,11 @@ typedef struct{
 	int simulation_method;
 	int binary_mode;
 	int kernel_id;
+	int batch_size;
+	int particle_group;
+	int huge_pages;
+	int compress_index;
+	Placement placement[N_PLACED_GRIDS];
 } Inputs;
 
 typedef struct{
@@ -75,7 +115,10 @@ typedef struct{
 	int * mats;                         // Length = length_mats
 	double * unionized_energy_array;    // Length = length_unionized_energy_array
 	int * index_grid;                   // Length = length_index_grid
+	uint8_t * index_delta;              // Length = length_index_delta (compressed unionized index grid only)
 	NuclideGridPoint * nuclide_grid;    // Length = length_nuclide_grid
+	double * nuclide_energy;            // Length = length_nuclide_grid (split grids only)
+	NuclideXS * nuclide_xs;             // Length = length_nuclide_grid (split grids only)
 #ifdef AML
 	struct aml_replicaset * num_nucs_replica;
 	struct aml_replicaset * concs_replica;
@@ -88,6 +131,7 @@ typedef struct{
 	int length_mats;
 	int length_unionized_energy_array;
 	long length_index_grid;
+	long length_index_delta;
 	int length_nuclide_grid;
 	int max_num_nucs;
 	double * p_energy_samples;
@@ -96,6 +140,18 @@ typedef struct{
 	int length_mat_samples;
 } SimulationData;
 
+// Entry of the unionized index grid for a unionized energy and a nuclide.
+// Compressed (-C), index_data holds the entries of the first energy of each
+// block of INDEX_BLOCK energies and index_delta the offset of every entry
+// from them, which is decoded without a branch.
+static inline long unionized_index( int * restrict index_data, uint8_t * restrict index_delta,
+                                    long idx, long n_isotopes, long nuc )
+{
+	if( index_delta == NULL )
+		return index_data[idx * n_isotopes + nuc];
+	return index_data[(idx >> INDEX_BLOCK_SHIFT) * n_isotopes + nuc] + index_delta[idx * n_isotopes + nuc];
+}
+
 // io.c
 void logo(int version);
 void center_print(const char *s, int width);
@@ -107,6 +163,8 @@ void print_inputs(Inputs in, int nprocs, int version);
 int print_results( Inputs in, int mype, double runtime, int nprocs, unsigned long long vhash );
 void binary_write( Inputs in, SimulationData SD );
 SimulationData binary_read( Inputs in );
+void binary_write_mapped( Inputs in, SimulationData SD );
+SimulationData binary_map( Inputs in );
 
 // Simulation.c
 unsigned long long run_event_based_simulation(Inputs in, SimulationData SD, int mype);
@@ -114,12 +172,14 @@ unsigned long long run_history_based_simulation(Inputs in, SimulationData SD, in
 void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
                            long n_gridpoints,
                            double * restrict egrid, int * restrict index_data,
+                           uint8_t * restrict index_delta,
                            NuclideGridPoint * restrict nuclide_grids,
                            long idx, double * restrict xs_vector, int grid_type, int hash_bins );
 void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
                          long n_gridpoints, int * restrict num_nucs,
                          double * restrict concs,
                          double * restrict egrid, int * restrict index_data,
+                         uint8_t * restrict index_delta,
                          NuclideGridPoint * restrict nuclide_grids,
                          int * restrict mats,
                          double * restrict macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs );
@@ -129,15 +189,38 @@ int pick_mat( uint64_t * seed );
 double LCG_random_double(uint64_t * seed);
 uint64_t fast_forward_LCG(uint64_t seed, uint64_t n);
 unsigned long long run_event_based_simulation_optimization_1(Inputs in, SimulationData SD, int mype);
+long grid_search_energy( double quarry, double * restrict A, long low, long high);
+void calculate_macro_xs_split( double p_energy, int mat, long n_isotopes,
+                         long n_gridpoints, int * restrict num_nucs,
+                         double * restrict concs,
+                         double * restrict egrid, int * restrict index_data,
+                         uint8_t * restrict index_delta,
+                         double * restrict nuclide_energy,
+                         NuclideXS * restrict nuclide_xs,
+                         int * restrict mats,
+                         double * restrict macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs );
+unsigned long long run_event_based_simulation_optimization_2(Inputs in, SimulationData SD, int mype);
+unsigned long long run_history_based_simulation_optimization_2(Inputs in, SimulationData SD, int mype);
+void radix_sort_parallel_u32_d( uint32_t * key, double * value, uint32_t * key_tmp, double * value_tmp, long n );
+unsigned long long run_event_based_simulation_optimization_3(Inputs in, SimulationData SD, int mype);
+unsigned long long run_history_based_simulation_optimization_4(Inputs in, SimulationData SD, int mype);
 
 // GridInit.c
 SimulationData grid_init_do_not_profile( Inputs in, int mype );
+void split_nuclide_grid( SimulationData * SD, Inputs in, int mype );
+void compress_index_grid( SimulationData * SD, Inputs in, int mype );
 
 // XSutils.c
 int NGP_compare( const void * a, const void * b );
 int double_compare(const void * a, const void * b);
 size_t estimate_mem_usage( Inputs in );
 double get_time(void);
+void * grid_alloc( size_t nbytes, int grid, Inputs in );
+void grid_free( void * ptr );
+void grid_advise( void * ptr, size_t len, int grid, Inputs in );
+void grid_register( void * ptr, size_t len );
+int parse_placement( char * arg, Inputs * in );
+void print_grid_alloc( const char * name, size_t nbytes, int grid, Inputs in );
 
 // Materials.c
 int * load_num_nucs(long n_isotopes);
@@ -32,6 +32,9 @@ size_t estimate_mem_usage( Inputs in )
 	size_t single_nuclide_grid = in.n_gridpoints * sizeof( NuclideGridPoint );
 	size_t all_nuclide_grids   = in.n_isotopes * single_nuclide_grid;
 	size_t size_UEG            = in.n_isotopes*in.n_gridpoints*sizeof(double) + in.n_isotopes*in.n_gridpoints*in.n_isotopes*sizeof(int);
+	if( in.compress_index )
+		size_UEG               = in.n_isotopes*in.n_gridpoints*sizeof(double) + in.n_isotopes*in.n_gridpoints*in.n_isotopes*sizeof(uint8_t)
+		                       + (in.n_isotopes*in.n_gridpoints / INDEX_BLOCK + 1)*in.n_isotopes*sizeof(int);
 	size_t size_hash_grid      = in.hash_bins * in.n_isotopes * sizeof(int);
 	size_t memtotal;
 
@@ -61,3 +64,152 @@ double get_time(void)
 
 	return time;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Grid Allocation
+////////////////////////////////////////////////////////////////////////////////
+// The grids are mapped directly, so their placement is set before any page is
+// touched: the nuclide grids are small and hot, the index grid is by far the
+// largest and the coldest per byte, and a tiered memory system may want them
+// on different nodes. With -H a grid starts on a 2 MB boundary and is advised
+// for transparent huge pages, so the random lookups miss in the TLB less.
+////////////////////////////////////////////////////////////////////////////////
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define MAX_GRID_ALLOCS 16
+
+static const char * grid_names[N_PLACED_GRIDS] = { "nuclide", "unionized", "index" };
+
+static struct{
+	void * ptr;
+	size_t len;
+} grid_allocs[MAX_GRID_ALLOCS];
+
+void * grid_alloc( size_t nbytes, int grid, Inputs in )
+{
+	size_t align = in.huge_pages ? HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+	size_t len = (nbytes + align - 1) & ~(align - 1);
+	if( len == 0 )
+		len = align;
+
+	// Over-map by the alignment, then trim both ends
+	char * base = mmap(NULL, len + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(base != MAP_FAILED);
+	char * ptr = (char *) (((uintptr_t) base + align - 1) & ~(uintptr_t) (align - 1));
+	size_t head = ptr - base;
+	if( head > 0 )
+		munmap(base, head);
+	if( align - head > 0 )
+		munmap(ptr + len, align - head);
+
+	grid_advise(ptr, len, grid, in);
+	grid_register(ptr, len);
+	return ptr;
+}
+
+// Applies -H and -P to [ptr, ptr + len) of a grid, before it is touched
+void grid_advise( void * ptr, size_t len, int grid, Inputs in )
+{
+	if( in.huge_pages && madvise(ptr, len, MADV_HUGEPAGE) != 0 )
+		fprintf(stderr, "Warning: no transparent huge pages for the %s grid\n", grid_names[grid]);
+
+	Placement p = in.placement[grid];
+	if( p.policy != PLACE_DEFAULT )
+	{
+		unsigned long mask[16] = {0};
+		const unsigned long maxnode = 8 * sizeof(mask);
+		if( p.policy == PLACE_INTERLEAVE )
+		{
+			// interleave over all the nodes we may use
+			if( syscall(SYS_get_mempolicy, NULL, mask, maxnode, NULL, 4 /* MPOL_F_MEMS_ALLOWED */) != 0 )
+				mask[0] = 1;
+		}
+		else
+			mask[p.node / (8 * sizeof(*mask))] = 1UL << (p.node % (8 * sizeof(*mask)));
+		if( syscall(SYS_mbind, ptr, len, p.policy, mask, maxnode, 0) != 0 )
+			fprintf(stderr, "Warning: cannot set the placement of the %s grid\n", grid_names[grid]);
+	}
+}
+
+// Lets grid_free unmap [ptr, ptr + len), e.g. a grid of a mapped file
+void grid_register( void * ptr, size_t len )
+{
+	int i;
+	for( i = 0; i < MAX_GRID_ALLOCS && grid_allocs[i].ptr != NULL; i++ )
+		;
+	assert(i < MAX_GRID_ALLOCS);
+	grid_allocs[i].ptr = ptr;
+	grid_allocs[i].len = len;
+}
+
+void grid_free( void * ptr )
+{
+	if( ptr == NULL )
+		return;
+	for( int i = 0; i < MAX_GRID_ALLOCS; i++ )
+		if( grid_allocs[i].ptr == ptr )
+		{
+			munmap(ptr, grid_allocs[i].len);
+			grid_allocs[i].ptr = NULL;
+			return;
+		}
+	assert(0);
+}
+
+// Parses "<grid>=<policy>" of -P, with the policies default, interleave,
+// preferred:<node> and bind:<node>. Returns 0 if it is not valid.
+int parse_placement( char * arg, Inputs * in )
+{
+	char * policy = strchr(arg, '=');
+	if( policy == NULL )
+		return 0;
+	int grid;
+	for( grid = 0; grid < N_PLACED_GRIDS; grid++ )
+		if( strncmp(arg, grid_names[grid], policy - arg) == 0 && grid_names[grid][policy - arg] == '\0' )
+			break;
+	if( grid == N_PLACED_GRIDS )
+		return 0;
+	policy++;
+
+	Placement p = {PLACE_DEFAULT, 0};
+	char * node = NULL;
+	if( strcmp(policy, "default") == 0 )
+		p.policy = PLACE_DEFAULT;
+	else if( strcmp(policy, "interleave") == 0 )
+		p.policy = PLACE_INTERLEAVE;
+	else if( strncmp(policy, "preferred:", 10) == 0 )
+	{
+		p.policy = PLACE_PREFERRED;
+		node = policy + 10;
+	}
+	else if( strncmp(policy, "bind:", 5) == 0 )
+	{
+		p.policy = PLACE_BIND;
+		node = policy + 5;
+	}
+	else
+		return 0;
+	if( node != NULL )
+	{
+		char * end;
+		long n = strtol(node, &end, 10);
+		if( end == node || *end != '\0' || n < 0 || n >= 1024 )
+			return 0;
+		p.node = n;
+	}
+	in->placement[grid] = p;
+	return 1;
+}
+
+void print_grid_alloc( const char * name, size_t nbytes, int grid, Inputs in )
+{
+	Placement p = in.placement[grid];
+	fprintf(stderr, "Allocated %.0lf MB of data for the %s", nbytes/1024.0/1024.0, name);
+	if( p.policy == PLACE_PREFERRED )
+		fprintf(stderr, " (preferring node %d)", p.node);
+	else if( p.policy == PLACE_BIND )
+		fprintf(stderr, " (bound to node %d)", p.node);
+	else if( p.policy == PLACE_INTERLEAVE )
+		fprintf(stderr, " (interleaved)");
+	fprintf(stderr, "%s.\n", in.huge_pages ? ", huge pages" : "");
+}
@@ -1,4 +1,6 @@
 #include "XSbench_header.h"
+#include<fcntl.h>
+#include<sys/stat.h>
 
 #ifdef MPI
 #include<mpi.h>
@@ -149,6 +151,7 @@ void print_inputs(Inputs in, int nprocs, int version )
 	{
 		printf("Unionized Energy Gridpoints:  ");
 		fancy_int(in.n_isotopes*in.n_gridpoints);
+		printf("Index Grid:                   %s\n", in.compress_index ? "Compressed" : "Uncompressed");
 	}
 	if( in.simulation_method == HISTORY_BASED )
 	{
@@ -156,6 +159,14 @@ void print_inputs(Inputs in, int nprocs, int version )
 		printf("XS Lookups per Particle:      "); fancy_int(in.lookups);
 	}
 	printf("Total XS Lookups:             "); fancy_int(in.lookups);
+	if( in.simulation_method == EVENT_BASED && in.kernel_id == 3 )
+	{
+		printf("Lookups per Sorted Batch:     "); fancy_int(in.batch_size);
+	}
+	if( in.simulation_method == HISTORY_BASED && in.kernel_id == 4 )
+	{
+		printf("Particles in Lockstep:        "); fancy_int(in.particle_group);
+	}
 	#ifdef MPI
 	printf("MPI Ranks:                    %d\n", nprocs);
 	printf("OMP Threads per MPI Rank:     %d\n", in.nthreads);
@@ -169,8 +180,15 @@ void print_inputs(Inputs in, int nprocs, int version )
 		printf("Off\n");
 	else if( in.binary_mode == READ)
 		printf("Read\n");
-	else
+	else if( in.binary_mode == WRITE)
 		printf("Write\n");
+	else if( in.binary_mode == MAPPED_READ)
+		printf("Mapped\n");
+	else if( in.binary_mode == MAPPED_POPULATE)
+		printf("Mapped, populated\n");
+	else
+		printf("Write mappable\n");
+	printf("Huge Pages:                   %s\n", in.huge_pages ? "On" : "Off");
 	border_print();
 	center_print("INITIALIZATION - DO NOT PROFILE", 79);
 	border_print();
@@ -213,13 +231,19 @@ void print_CLI_error(void)
 	printf("  -t <threads>             Number of OpenMP threads to run\n");
 	printf("  -s <size>                Size of H-M Benchmark to run (small, large, XL, XXL)\n");
 	printf("  -g <gridpoints>          Number of gridpoints per nuclide (overrides -s defaults)\n");
-	printf("  -G <grid type>           Grid search type (unionized, nuclide, hash). Defaults to unionized.\n");
+	printf("  -G <grid type>           Grid search type (unionized, nuclide, hash). Defaults to hash.\n");
 	printf("  -p <particles>           Number of particle histories\n");
 	printf("  -l <lookups>             History Based: Number of Cross-section (XS) lookups per particle. Event Based: Total number of XS lookups.\n");
 	printf("  -h <hash bins>           Number of hash bins (only relevant when used with \"-G hash\")\n");
 	printf("  -b <binary mode>         Read or write all data structures to file. If reading, this will skip initialization phase. (read, write)\n");
-	printf("  -k <kernel ID>           Specifies which kernel to run. 0 is baseline, 1, 2, etc are optimized variants. (0 is default.)\n");
-	printf("Default is equivalent to: -m history -s large -l 34 -p 500000 -G unionized\n");
+	printf("                           mmap-write writes a file whose grids are mapped in place by mmap (faulted on first use) or mmap-populate (faulted by all threads up front).\n");
+	printf("  -k <kernel ID>           Specifies which kernel to run. 0 is baseline, 1, 2, etc are optimized variants. (0 is default.) History Based: 0, 2 or 4.\n");
+	printf("  -B <batch size>          Number of lookups sorted together by event based kernel 3. Defaults to 4194304.\n");
+	printf("  -H                       Align the grids to 2 MB and advise transparent huge pages for them.\n");
+	printf("  -P <grid>=<policy>       Placement of a grid (nuclide, unionized, index): default, interleave, preferred:<node> or bind:<node>. Repeat for each grid.\n");
+	printf("  -L <particles>           Number of particles advanced in lockstep by history based kernel 4. Defaults to 16.\n");
+	printf("  -C                       Compress the unionized index grid to a 1 byte offset per entry from the entry of its block of %d energies.\n", INDEX_BLOCK);
+	printf("Default is equivalent to: -m history -s large -l 34 -p 500000 -G hash\n");
 	printf("See readme for full description of default run values\n");
 	exit(4);
 }
@@ -250,8 +274,8 @@ Inputs read_CLI( int argc, char * argv[] )
 	// defaults to 34
 	input.lookups = 34;
 	
-	// default to unionized grid
-	input.grid_type = UNIONIZED;
+	// default to hash grid
+	input.grid_type = HASH;
 
 	// default to unionized grid
 	input.hash_bins = 10000;
@@ -261,6 +285,23 @@ Inputs read_CLI( int argc, char * argv[] )
 	
 	// defaults to baseline kernel
 	input.kernel_id = 0;
+
+	// defaults to sorting 2^22 lookups at a time (kernel 3)
+	input.batch_size = 1 << 22;
+
+	// defaults to 16 particles per group (kernel 4)
+	input.particle_group = 16;
+
+	// defaults to base pages, placed by the kernel
+	input.huge_pages = 0;
+
+	// defaults to an uncompressed unionized index grid
+	input.compress_index = 0;
+	for( int g = 0; g < N_PLACED_GRIDS; g++ )
+	{
+		input.placement[g].policy = PLACE_DEFAULT;
+		input.placement[g].node = 0;
+	}
 	
 	// defaults to H-M Large benchmark
 	input.HM = (char *) malloc( 6 * sizeof(char) );
@@ -394,6 +435,12 @@ Inputs read_CLI( int argc, char * argv[] )
 				input.binary_mode = READ;
 			else if( strcmp(binary_mode, "write") == 0 )
 				input.binary_mode = WRITE;
+			else if( strcmp(binary_mode, "mmap") == 0 )
+				input.binary_mode = MAPPED_READ;
+			else if( strcmp(binary_mode, "mmap-populate") == 0 )
+				input.binary_mode = MAPPED_POPULATE;
+			else if( strcmp(binary_mode, "mmap-write") == 0 )
+				input.binary_mode = MAPPED_WRITE;
 			else
 				print_CLI_error();
 		}
@@ -407,6 +454,34 @@ Inputs read_CLI( int argc, char * argv[] )
 			else
 				print_CLI_error();
 		}
+		// batch size of the sorted event based kernel (-B)
+		else if( strcmp(arg, "-B") == 0 )
+		{
+			if( ++i < argc )
+				input.batch_size = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// particles per group of the lockstep history based kernel (-L)
+		else if( strcmp(arg, "-L") == 0 )
+		{
+			if( ++i < argc )
+				input.particle_group = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// transparent huge pages for the grids (-H)
+		else if( strcmp(arg, "-H") == 0 )
+			input.huge_pages = 1;
+		// compressed unionized index grid (-C)
+		else if( strcmp(arg, "-C") == 0 )
+			input.compress_index = 1;
+		// placement of a grid (-P)
+		else if( strcmp(arg, "-P") == 0 )
+		{
+			if( ++i >= argc || !parse_placement(argv[i], &input) )
+				print_CLI_error();
+		}
 		else
 			print_CLI_error();
 	}
@@ -432,6 +507,20 @@ Inputs read_CLI( int argc, char * argv[] )
 	// Validate Hash Bins 
 	if( input.hash_bins < 1 )
 		print_CLI_error();
+
+	// Validate batch size
+	if( input.batch_size < 1 )
+		print_CLI_error();
+
+	// Validate particle group
+	if( input.particle_group < 1 )
+		print_CLI_error();
+
+	// The AML replicas are of the uncompressed index grid
+	#ifdef AML
+	if( input.compress_index )
+		print_CLI_error();
+	#endif
 	
 	// Validate HM size
 	if( strcasecmp(input.HM, "small") != 0 &&
@@ -490,9 +579,10 @@ SimulationData binary_read( Inputs in )
 	SD.num_nucs = (int *) malloc(SD.length_num_nucs * sizeof(int));
 	SD.concs = (double *) malloc(SD.length_concs * sizeof(double));
 	SD.mats = (int *) malloc(SD.length_mats * sizeof(int));
-	SD.nuclide_grid = (NuclideGridPoint *) malloc(SD.length_nuclide_grid * sizeof(NuclideGridPoint));
-	SD.index_grid = (int *) malloc( SD.length_index_grid * sizeof(int));
-	SD.unionized_energy_array = (double *) malloc( SD.length_unionized_energy_array * sizeof(double));
+	SD.nuclide_grid = (NuclideGridPoint *) grid_alloc(SD.length_nuclide_grid * sizeof(NuclideGridPoint), NUCLIDE_GRID, in);
+	SD.index_grid = (int *) grid_alloc( SD.length_index_grid * sizeof(int), INDEX_GRID, in);
+	SD.unionized_energy_array = (double *) grid_alloc( SD.length_unionized_energy_array * sizeof(double), UNIONIZED_GRID, in);
+	SD.index_delta = NULL;
 
 	// Read heap arrays into SimulationData Object
 	fread(SD.num_nucs,       sizeof(int), SD.length_num_nucs, fp);
@@ -506,3 +596,190 @@ SimulationData binary_read( Inputs in )
 
 	return SD;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Mapped Binary Files
+////////////////////////////////////////////////////////////////////////////////
+// A header, then every array at its own 2 MB aligned offset, so that they are
+// mapped straight from the file instead of being read into memory, and the
+// simulation starts as soon as the header is checked. The file is mapped at a
+// 2 MB aligned address as well, so each grid covers whole huge pages and gets
+// -H and -P like an allocated one (tmpfs honors both for its page cache).
+////////////////////////////////////////////////////////////////////////////////
+
+#define MAPPED_MAGIC "XSBMAP1"
+#define MAPPED_ALIGN (2UL << 20)
+#define N_MAPPED_ARRAYS 6
+
+typedef struct{
+	char magic[8];
+	long n_isotopes;
+	long n_gridpoints;
+	int grid_type;
+	int hash_bins;
+	SimulationData SD; // Pointers are not used
+	size_t offset[N_MAPPED_ARRAYS];
+	size_t nbytes[N_MAPPED_ARRAYS];
+} MappedHeader;
+
+// The arrays of SD in file order, their sizes and grids (-1 for no placement)
+static void mapped_arrays( SimulationData * SD, void ** ptrs[N_MAPPED_ARRAYS],
+                           size_t nbytes[N_MAPPED_ARRAYS], int grids[N_MAPPED_ARRAYS] )
+{
+	ptrs[0] = (void **) &SD->num_nucs;     nbytes[0] = SD->length_num_nucs * sizeof(int);      grids[0] = -1;
+	ptrs[1] = (void **) &SD->concs;        nbytes[1] = SD->length_concs * sizeof(double);      grids[1] = -1;
+	ptrs[2] = (void **) &SD->mats;         nbytes[2] = SD->length_mats * sizeof(int);          grids[2] = -1;
+	ptrs[3] = (void **) &SD->nuclide_grid; nbytes[3] = SD->length_nuclide_grid * sizeof(NuclideGridPoint); grids[3] = NUCLIDE_GRID;
+	ptrs[4] = (void **) &SD->index_grid;   nbytes[4] = SD->length_index_grid * sizeof(int);    grids[4] = INDEX_GRID;
+	ptrs[5] = (void **) &SD->unionized_energy_array;
+	nbytes[5] = SD->length_unionized_energy_array * sizeof(double);                           grids[5] = UNIONIZED_GRID;
+}
+
+static void pwrite_all( int fd, const void * buf, size_t nbytes, off_t offset )
+{
+	while( nbytes > 0 )
+	{
+		ssize_t n = pwrite(fd, buf, nbytes, offset);
+		if( n < 0 )
+		{
+			perror("Writing the mapped binary file");
+			exit(1);
+		}
+		buf = (const char *) buf + n;
+		nbytes -= n;
+		offset += n;
+	}
+}
+
+void binary_write_mapped( Inputs in, SimulationData SD )
+{
+	char * fname = "XS_data.map";
+	printf("Writing all data structures to mappable binary file %s...\n", fname);
+	int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if( fd < 0 )
+	{
+		perror(fname);
+		exit(1);
+	}
+
+	MappedHeader h;
+	memset(&h, 0, sizeof(h));
+	strcpy(h.magic, MAPPED_MAGIC);
+	h.n_isotopes = in.n_isotopes;
+	h.n_gridpoints = in.n_gridpoints;
+	h.grid_type = in.grid_type;
+	h.hash_bins = in.hash_bins;
+	h.SD = SD;
+
+	void ** ptrs[N_MAPPED_ARRAYS];
+	int grids[N_MAPPED_ARRAYS];
+	mapped_arrays(&SD, ptrs, h.nbytes, grids);
+	size_t offset = MAPPED_ALIGN;
+	for( int i = 0; i < N_MAPPED_ARRAYS; i++ )
+	{
+		h.offset[i] = offset;
+		if( h.nbytes[i] > 0 )
+			pwrite_all(fd, *ptrs[i], h.nbytes[i], offset);
+		offset += (h.nbytes[i] + MAPPED_ALIGN - 1) & ~(MAPPED_ALIGN - 1);
+	}
+	pwrite_all(fd, &h, sizeof(h), 0);
+	// The last array ends on a 2 MB boundary too
+	if( ftruncate(fd, offset) != 0 )
+		perror("Extending the mapped binary file");
+	close(fd);
+}
+
+SimulationData binary_map( Inputs in )
+{
+	char * fname = "XS_data.map";
+	printf("Mapping all data structures from binary file %s...\n", fname);
+	double start = get_time();
+
+	int fd = open(fname, O_RDONLY);
+	if( fd < 0 )
+	{
+		perror(fname);
+		exit(1);
+	}
+	struct stat st;
+	MappedHeader h;
+	if( fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+	    strcmp(h.magic, MAPPED_MAGIC) != 0 )
+	{
+		fprintf(stderr, "%s is not a mapped binary file of this XSBench\n", fname);
+		exit(1);
+	}
+	if( h.n_isotopes != in.n_isotopes || h.n_gridpoints != in.n_gridpoints ||
+	    h.grid_type != in.grid_type || (in.grid_type == HASH && h.hash_bins != in.hash_bins) )
+	{
+		fprintf(stderr, "%s was written for %ld isotopes, %ld gridpoints, grid type %d and %d hash bins\n",
+		        fname, h.n_isotopes, h.n_gridpoints, h.grid_type, h.hash_bins);
+		exit(1);
+	}
+
+	// Private, so that the kernels may still write to the arrays; aligned
+	// by over-reserving address space and mapping the file into it
+	size_t len = ((size_t) st.st_size + MAPPED_ALIGN - 1) & ~(MAPPED_ALIGN - 1);
+	char * base = mmap(NULL, len + MAPPED_ALIGN, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(base != MAP_FAILED);
+	char * file = (char *) (((uintptr_t) base + MAPPED_ALIGN - 1) & ~(uintptr_t) (MAPPED_ALIGN - 1));
+	if( mmap(file, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED )
+	{
+		perror("mmap");
+		exit(1);
+	}
+	close(fd);
+	if( file > base )
+		munmap(base, file - base);
+	munmap(file + len, base + MAPPED_ALIGN - file);
+	// The header is not needed once it is copied
+	munmap(file, MAPPED_ALIGN);
+
+	SimulationData SD = h.SD;
+	SD.index_delta = NULL;
+	void ** ptrs[N_MAPPED_ARRAYS];
+	size_t nbytes[N_MAPPED_ARRAYS];
+	int grids[N_MAPPED_ARRAYS];
+	mapped_arrays(&SD, ptrs, nbytes, grids);
+	for( int i = 0; i < N_MAPPED_ARRAYS; i++ )
+	{
+		size_t span = (nbytes[i] + MAPPED_ALIGN - 1) & ~(MAPPED_ALIGN - 1);
+		if( nbytes[i] != h.nbytes[i] || h.offset[i] + span > len )
+		{
+			fprintf(stderr, "%s is truncated or corrupt\n", fname);
+			exit(1);
+		}
+		if( nbytes[i] == 0 )
+		{
+			*ptrs[i] = NULL;
+			continue;
+		}
+		*ptrs[i] = file + h.offset[i];
+		if( grids[i] >= 0 )
+		{
+			grid_advise(*ptrs[i], span, grids[i], in);
+			// split_nuclide_grid frees the nuclide grids
+			grid_register(*ptrs[i], span);
+		}
+	}
+
+	if( in.binary_mode == MAPPED_POPULATE )
+	{
+		// Faults in every page, each thread a 2 MB block at a time
+		const long page = sysconf(_SC_PAGESIZE);
+		const long nblocks = (len - MAPPED_ALIGN) / MAPPED_ALIGN;
+		unsigned long sum = 0;
+		#pragma omp parallel for schedule(dynamic, 1) reduction(+:sum)
+		for( long b = 0; b < nblocks; b++ )
+		{
+			const volatile char * block = file + MAPPED_ALIGN * (b + 1);
+			for( size_t k = 0; k < MAPPED_ALIGN; k += page )
+				sum += block[k];
+		}
+		(void) sum;
+	}
+
+	printf("Mapped %.0lf MB of data in %.3lf seconds.\n",
+	       (len - MAPPED_ALIGN) / 1024.0 / 1024.0, get_time() - start);
+	return SD;
+}